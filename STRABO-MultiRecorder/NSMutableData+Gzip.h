@@ -0,0 +1,27 @@
+//
+//  NSMutableData+Gzip.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Extends NSMutableData with functions to append gzip compressed data.
+ */
+@interface NSMutableData (Gzip)
+
+/**
+ Compresses the contents of a file with gzip and appends the result to the receiver.
+
+ The file is read and compressed in small chunks, so the uncompressed file is never held in memory all at once. The appended bytes form a complete gzip stream (RFC 1952) that can be decompressed by any standard gzip implementation.
+
+ @param path The path to the file to compress.
+
+ @return BOOL YES if the file was compressed and appended. NO if the file could not be read or compressed, in which case the receiver is left unchanged.
+ */
+-(BOOL)appendGzippedContentsOfFile:(NSString *)path;
+
+@end
@@ -0,0 +1,69 @@
+//
+//  NSMutableData+Gzip.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "NSMutableData+Gzip.h"
+#import <zlib.h>
+
+// Size of the read and write buffers used while compressing
+#define kSTRGzipChunkSize 32768
+
+@implementation NSMutableData (Gzip)
+
+-(BOOL)appendGzippedContentsOfFile:(NSString *)path {
+    NSInputStream * input = [NSInputStream inputStreamWithFileAtPath:path];
+    if (!input) return NO;
+
+    // Window bits of 15 + 16 asks zlib for a gzip header and trailer
+    // instead of a raw zlib stream.
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NO;
+    }
+
+    // Remember where we started so that a failure leaves the data untouched
+    NSUInteger originalLength = self.length;
+
+    uint8_t inBuffer[kSTRGzipChunkSize];
+    uint8_t outBuffer[kSTRGzipChunkSize];
+    BOOL success = YES;
+    int flush = Z_NO_FLUSH;
+
+    [input open];
+    do {
+        NSInteger bytesRead = [input read:inBuffer maxLength:kSTRGzipChunkSize];
+        if (bytesRead < 0) {
+            success = NO;
+            break;
+        }
+        flush = (bytesRead == 0) ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = inBuffer;
+        stream.avail_in = (uInt)bytesRead;
+
+        // Drain everything that deflate produces for this chunk
+        do {
+            stream.next_out = outBuffer;
+            stream.avail_out = kSTRGzipChunkSize;
+            if (deflate(&stream, flush) == Z_STREAM_ERROR) {
+                success = NO;
+                break;
+            }
+            [self appendBytes:outBuffer length:kSTRGzipChunkSize - stream.avail_out];
+        } while (stream.avail_out == 0);
+    } while (success && flush != Z_FINISH);
+    [input close];
+
+    deflateEnd(&stream);
+
+    if (!success) {
+        [self setLength:originalLength];
+    }
+    return success;
+}
+
+@end
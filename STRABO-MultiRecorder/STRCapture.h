@@ -11,6 +11,9 @@
 #import <AVFoundation/AVFoundation.h>
 #import <UIKit/UIKit.h>
 
+@class STRCapturePathResolver;
+@class STRTrackSummary;
+
 /**
  Holds all of the information about a capture taken with the Strabo MultiRecorder.
  
@@ -25,11 +28,17 @@
  ------------------------
  
  You are free to edit the public, readwrite properties of this class. When you create an instance of a STRCapture, you can change the values of title and uploadDate. Once you change these values, call the save method to make your changes persistent. The values for the rest of the properties are handled for you, although you have read access to all of them.
+ 
+ Threads
+ -------
+ 
+ A STRCapture is a snapshot of the capture info file taken when it was created, so reading its properties never touches the file system or waits for a lock. Any number of threads can create, read and save STRCapture objects at once, including several objects for the same capture; see STRCaptureLockTable for how the files are kept consistent. A single STRCapture object should still be used from one thread at a time.
  */
 @interface STRCapture : NSObject {
     NSString * _captureInfoPath;
     NSDate * _creationDate;
     NSString * _geoDataPath;
+    NSString * _filteredGeoDataPath;
     NSNumber * _heading;
     NSNumber * _latitude;
     NSNumber * _longitude;
@@ -38,6 +47,7 @@
     NSString * _title;
     NSString * _token;
     NSString * _type;
+    STRTrackSummary * _trackSummary;
     NSDate * _uploadDate;
     UIImage * _thumbnailIamge;
 }
@@ -77,6 +87,15 @@
  */
 @property(readonly)NSNumber * longitude;
 
+/**
+ The duration, length, bounding box, point count, mean accuracy and heading range of the track.
+
+ The summary is kept in the capture info file, so reading it costs the same however long the track is. Use it rather than geoDataPoints for lists of captures.
+
+ @warning Nil for captures saved before summaries were kept, until the backfill started by [STRCaptureFileManager defaultManager] reaches them, or until updateTrackSummary is called.
+ */
+@property(readonly)STRTrackSummary * trackSummary;
+
 ///---------------------------------------------------------------------------------------
 /// @name Associated Files
 ///---------------------------------------------------------------------------------------
@@ -86,6 +105,13 @@
  */
 @property(readonly)NSString * geoDataPath;
 
+/**
+ Path of the filtered geo data file associated with this capture relative to the strabo captures directory.
+ 
+ The filtered file has the same format as the geo data file, with the track cleaned up by a STRTrackFilter. It is nil for captures recorded before filtered tracks were saved, until writeFilteredGeoData is called.
+ */
+@property(readonly)NSString * filteredGeoDataPath;
+
 /**
  Path of the media file associated with this capture relative to the strabo captures directory.
  
@@ -139,7 +165,7 @@
 /**
  The date that the track was uploaded.
  
- Set to nil by default, but can be changed so that you can keep track of if and when tracks are uploaded to the server. Set this property and then use the save method to commit your changes.
+ Set to nil by default. STRCaptureUploadManager sets it with markUploadedAtDate: when the server accepts the capture, so you do not need to set it yourself. You can still set this property and then use the save method to commit your changes, for example to clear it.
  */
 @property(nonatomic, strong, readwrite)NSDate * uploadDate;
 
@@ -150,12 +176,23 @@
 /**
  Returns a new STRCapture object with the files at the directory specified.
  
- Notice that the capture directory is not the absolute path to the directory, but is rather the name of the directory containing the capture media files relative to the "StraboCaptures" directory. ~~For example, under the naming scheme as of July, 2012, the capture directory could be something like: @"1342193443".~~ For example under the naming scheme as of August, 2012, the capture directory could be something like "13asdf193...134asdf93/1342asdf3...13asdf93"
+ Notice that the capture directory is not the absolute path to the directory, but is rather the path of the directory containing the capture media files relative to the "StraboCaptures" directory. ~~For example, under the naming scheme as of July, 2012, the capture directory could be something like: @"1342193443".~~ Since captures are stored in shard directories, the capture directory is something like @"t01390/013901a38fa0f3b9a2c17d04be55e96a". A bare token is also accepted and is looked up with the [STRCapturePathResolver].
  
- @param captureDirectory The name of the directory containing the capture media files.
+ @param captureDirectory The path of the directory containing the capture media files, or the capture's token.
  */
 +(STRCapture *)captureFromFilesAtDirectory:(NSString *)captureDirectory;
 
+/**
+ Returns a new STRCapture object with the files at the directory specified, in a captures directory other than the shared one.
+ 
+ The capture reads and saves its files through the resolver, as captureFromFilesAtDirectory: does through the shared resolver.
+ 
+ @param captureDirectory The path of the directory containing the capture media files relative to the captures directory of the resolver, or the capture's token.
+ 
+ @param resolver The resolver for the captures directory.
+ */
++(STRCapture *)captureFromFilesAtDirectory:(NSString *)captureDirectory pathResolver:(STRCapturePathResolver *)resolver;
+
 /**
  Retrieves the locally stored capture with the specified token and returns a STRCapture object representing the capture.
  
@@ -178,6 +215,17 @@
  */
 -(BOOL)hasBeenUploaded;
 
+/**
+ Records that the capture was uploaded and saves the change.
+ 
+ This is how STRCaptureUploadManager sets the uploadDate of a capture when the server accepts it.
+ 
+ @param date The date of the upload. Pass nil to use the current date.
+ 
+ @return BOOL YES if the change was saved and NO if it was not.
+ */
+-(BOOL)markUploadedAtDate:(NSDate *)date;
+
 ///---------------------------------------------------------------------------------------
 /// @name Geo Data Methods
 ///---------------------------------------------------------------------------------------
@@ -213,6 +261,35 @@
  */
 -(NSDictionary *)geoDataPoints;
 
+/**
+ Generates a dictionary of filtered points, in the same format as geoDataPoints.
+ 
+ The points are read from the filtered geo data file. If the capture has none, the raw track is smoothed with a STRTrackFilter in memory; call writeFilteredGeoData to keep the result. Headings are -1 before the first valid compass reading.
+ 
+ @return NSDictionary A dictionary of key-value pairs that correspond to filtered geodata points. The keys correspond to timestamps and the values are arrays containing CLLocations at index 0 and NSNumber headings at index 1.
+ 
+ Returns nil in the event of an error.
+ */
+-(NSDictionary *)filteredGeoDataPoints;
+
+/**
+ Smooths the raw track with a STRTrackFilter and saves it as the filtered geo data file.
+ 
+ The file is written beside the geo data file and replaces any filtered file from the recording, which was only filtered forwards. The capture info file is updated to point at it.
+ 
+ @return BOOL YES if successful and NO if unsuccessful.
+ */
+-(BOOL)writeFilteredGeoData;
+
+/**
+ Summarizes the geo data file again and saves the summary in the capture info file.
+
+ The SDK summarizes the tracks that it writes, so you only need to call this after changing the geo data file yourself.
+
+ @return BOOL YES if successful and NO if unsuccessful.
+ */
+-(BOOL)updateTrackSummary;
+
 ///---------------------------------------------------------------------------------------
 /// @name Editing Methods
 ///---------------------------------------------------------------------------------------
@@ -222,6 +299,8 @@
  
  If you want to make any changes to readwrite properties of an STRCapture object, set the values of those properties and then call this method to write those changes to the appropriate files. This will make changes to the properties persistent.
  
+ Only the properties that you changed since the capture was read or last saved are written. The rest of the capture info file is kept as it is on disk, so a title saved from one STRCapture object does not undo an upload date saved from another in the meantime. The file is read and replaced under the write lock of the capture.
+ 
  @return BOOL YES if successful and NO if unsuccessful.
  */
 -(BOOL)save;
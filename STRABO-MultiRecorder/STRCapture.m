@@ -7,14 +7,22 @@
 //
 
 #import "STRCapture.h"
-#import "STRSettings.h"
+#import "STRCaptureChangeFeed.h"
+#import "STRCaptureFileParser.h"
+#import "STRCaptureLockTable.h"
+#import "STRCapturePathResolver.h"
+#import "STRTrackFilter.h"
+#import "STRTrackSummary.h"
+#import "STRLogger.h"
 
 @interface STRCapture () {
-    BOOL _advancedLogging;
+    STRCapturePathResolver * _resolver;
+    // The title and upload date as they were last read from or saved to the
+    // capture info file, so save can tell which ones were changed here
+    NSString * _savedTitle;
+    NSDate * _savedUploadDate;
 }
 
-@property()BOOL advancedLogging;
-
 // Make readonly properties writable internally
 @property(readwrite)UIImage * thumbnailImage;
 @property(readwrite)NSDate * creationDate;
@@ -23,9 +31,11 @@
 @property(readwrite)NSNumber * heading;
 @property(readwrite)NSNumber * latitude;
 @property(readwrite)NSNumber * longitude;
+@property(readwrite)STRTrackSummary * trackSummary;
 
 #pragma mark Associated Files
 @property(readwrite)NSString * geoDataPath;
+@property(readwrite)NSString * filteredGeoDataPath;
 @property(readwrite)NSString * mediaPath;
 @property(readwrite)NSString * thumbnailPath;
 @property(readwrite)NSString * captureInfoPath;
@@ -37,7 +47,19 @@
 @end
 
 @interface STRCapture (InternalMethods)
--(NSString *)straboCaptureDirectoryPath;
+
+// -- Files -- //
+-(STRCapturePathResolver *)pathResolver;
+
+// -- Capture Info -- //
+-(void)readCaptureInfoFields:(const STRCaptureInfoFields *)fields parser:(STRCaptureFileParser *)parser directory:(NSString *)captureDirectory;
+-(BOOL)readCaptureInfoDictionary:(NSDictionary *)captureDictionary directory:(NSString *)captureDirectory;
++(NSDate *)uploadDateFromTimestamp:(double)timestamp;
+
+// -- Geo Data -- //
+-(BOOL)readSamplesFromGeoDataFile:(NSString *)path samples:(STRTrackSample **)samples count:(NSUInteger *)count;
+-(NSDictionary *)dataPointsFromSamples:(const STRTrackSample *)samples count:(NSUInteger)count;
+
 @end
 
 @implementation STRCapture
@@ -45,53 +67,65 @@
 #pragma mark - Class Methods
 
 +(STRCapture *)captureFromFilesAtDirectory:(NSString *)captureDirectory {
+    return [self captureFromFilesAtDirectory:captureDirectory pathResolver:[STRCapturePathResolver sharedResolver]];
+}
+
++(STRCapture *)captureFromFilesAtDirectory:(NSString *)captureDirectory pathResolver:(STRCapturePathResolver *)resolver {
     
     STRCapture * newCapture = [[STRCapture alloc] init];
+    newCapture->_resolver = resolver;
     
-    // Set the private advanced logging BOOL value
-    newCapture.advancedLogging = ([[STRSettings sharedSettings] advancedLogging]) ? YES : NO;
-    
-    // Read the appropriate file into a dictionary
-    NSError * error;
-    NSDictionary * captureDictionary = [NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:[newCapture.straboCaptureDirectoryPath stringByAppendingPathComponent:[NSString stringWithFormat:@"%@/capture-info.json", captureDirectory]]] options:NSJSONReadingAllowFragments error:&error];
-    if (error) return nil;
+    // A bare token is looked up in both the sharded and the flat layout
+    if (captureDirectory.pathComponents.count == 1) {
+        NSString * resolvedDirectory = [resolver relativeDirectoryOfCaptureWithToken:captureDirectory];
+        if (resolvedDirectory) captureDirectory = resolvedDirectory;
+    }
     
-    // Build up the newCapture object
-    // Track Info
-    newCapture.title = [captureDictionary objectForKey:@"title"];
-    newCapture.token = [captureDictionary objectForKey:@"token"];
-    newCapture.type = [captureDictionary objectForKey:@"media_type"];
-    NSDate * uploadDate = [NSDate dateWithTimeIntervalSince1970:[[captureDictionary objectForKey:@"uploaded_at"] doubleValue]];
-    if ([uploadDate compare:[NSDate dateWithTimeIntervalSince1970:500]] == NSOrderedAscending) {
-        newCapture.uploadDate = nil;
+    // Most info files are read by the fast parser; anything it does not expect goes
+    // through NSJSONSerialization as before
+    NSString * captureInfoPath = [resolver absolutePathForRelativePath:[captureDirectory stringByAppendingPathComponent:@"capture-info.json"]];
+    STRCaptureFileParser * parser = [STRCaptureFileParser parserForCurrentThread];
+    STRCaptureInfoFields fields;
+    if ([parser parseCaptureInfoAtPath:captureInfoPath fields:&fields]) {
+        [newCapture readCaptureInfoFields:&fields parser:parser directory:captureDirectory];
     } else {
-        newCapture.uploadDate = uploadDate;
+        // A missing or damaged info file gives nil rather than an exception, so listings can skip the capture
+        NSData * captureData = [NSData dataWithContentsOfFile:captureInfoPath];
+        if (!captureData) return nil;
+        NSError * error;
+        NSDictionary * captureDictionary = [NSJSONSerialization JSONObjectWithData:captureData options:NSJSONReadingAllowFragments error:&error];
+        if (error || ![captureDictionary isKindOfClass:[NSDictionary class]]) return nil;
+        if (![newCapture readCaptureInfoDictionary:captureDictionary directory:captureDirectory]) return nil;
     }
-    newCapture.creationDate = [NSDate dateWithTimeIntervalSince1970:[[captureDictionary objectForKey:@"created_at"] doubleValue]];
-    // Geo Data
-    newCapture.heading = [captureDictionary objectForKey:@"heading"];
-    newCapture.latitude = [[captureDictionary objectForKey:@"coords"] objectAtIndex:0];
-    newCapture.longitude = [[captureDictionary objectForKey:@"coords"] objectAtIndex:1];
-    // File Paths
-    newCapture.geoDataPath = [captureDictionary objectForKey:@"geodata_file"];
-    newCapture.mediaPath = [captureDictionary objectForKey:@"media_file"];
-    newCapture.thumbnailPath = [captureDictionary objectForKey:@"thumbnail_file"];
-    newCapture.captureInfoPath = [newCapture.token stringByAppendingPathComponent:@"capture-info.json"];
+    newCapture.captureInfoPath = [captureDirectory stringByAppendingPathComponent:@"capture-info.json"];
+    newCapture->_savedTitle = newCapture.title;
+    newCapture->_savedUploadDate = newCapture.uploadDate;
     // Images
-    newCapture.thumbnailImage = [UIImage imageWithContentsOfFile:[newCapture.straboCaptureDirectoryPath stringByAppendingPathComponent:newCapture.thumbnailPath]];
+    newCapture.thumbnailImage = [UIImage imageWithContentsOfFile:[resolver absolutePathForRelativePath:newCapture.thumbnailPath]];
     
     return newCapture;
 }
 
 +(STRCapture *)captureWithToken:(NSString *)token {
-    // Because of the current directory naming scheme, we can just use the captureFromFilesAtDirectory method to handle this all for us.
+    // captureFromFilesAtDirectory: looks a bare token up through the path resolver
     return [self captureFromFilesAtDirectory:token];
 }
 
 #pragma mark - Utility Methods
 
 -(BOOL)hasBeenUploaded {
-    return (self.uploadDate) ? NO : YES;
+    return (self.uploadDate) ? YES : NO;
+}
+
+-(BOOL)markUploadedAtDate:(NSDate *)date {
+    NSDate * previousDate = self.uploadDate;
+    self.uploadDate = (date) ? date : [NSDate date];
+    if (![self save]) {
+        self.uploadDate = previousDate;
+        return NO;
+    }
+    STRLogDebug(STRLogCategoryStorage, @"STRCapture: Marked capture %@ as uploaded.", self.token);
+    return YES;
 }
 
 #pragma mark - Geo Data Methods
@@ -102,84 +136,246 @@
 }
 
 -(NSArray *)geoDataPointTimestamps {
-    NSString * filePath = [self.straboCaptureDirectoryPath stringByAppendingPathComponent:self.geoDataPath];
-    NSError * error;
-    NSArray * points = [[NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:filePath] options:NSJSONReadingAllowFragments error:&error] objectForKey:@"points"];
-    
-    if (error) {
-        if (_advancedLogging) NSLog(@"STRCapture: Error reading the geodata file. File may have been corrupted.");
+    STRTrackSample * samples;
+    NSUInteger count;
+    if (![self readSamplesFromGeoDataFile:self.geoDataPath samples:&samples count:&count]) {
         // Return nil due to error
         return nil;
     }
     
-    NSMutableArray * timestamps = [[NSMutableArray alloc] initWithCapacity:points.count];
-    for (NSDictionary * point in points) {
+    NSMutableArray * timestamps = [[NSMutableArray alloc] initWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
         
-        CMTime timestamp = CMTimeMake(([[point objectForKey:@"timestamp"] doubleValue] * 1000000000), 1000000000);
+        CMTime timestamp = CMTimeMake((samples[i].timestamp * 1000000000), 1000000000);
     
         [timestamps addObject:[NSValue valueWithCMTime:timestamp]];
     }
+    free(samples);
     
-    // Test code
-    NSLog(@"Timestamps array produced: %@", timestamps);
+    STRLogTrace(STRLogCategoryStorage, @"STRCapture: Read %lu timestamps.", (unsigned long)timestamps.count);
     
     return timestamps;
 }
 
 -(NSDictionary *)geoDataPoints {
-    NSString * filePath = [self.straboCaptureDirectoryPath stringByAppendingPathComponent:self.geoDataPath];
-    NSError * error;
-    NSArray * points = [[NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:filePath] options:NSJSONReadingAllowFragments error:&error] objectForKey:@"points"];
-    
-    if (error) {
-        if (_advancedLogging) NSLog(@"STRCapture: Error reading the geodata file. File may have been corrupted.");
-        // Return nil due to error
-        return nil;
+    STRTrackSample * samples;
+    NSUInteger count;
+    if (![self readSamplesFromGeoDataFile:self.geoDataPath samples:&samples count:&count]) return nil;
+    NSDictionary * dataPoints = [self dataPointsFromSamples:samples count:count];
+    free(samples);
+    return dataPoints;
+}
+
+-(NSDictionary *)filteredGeoDataPoints {
+    STRTrackSample * samples;
+    NSUInteger count;
+    NSString * filePath = (self.filteredGeoDataPath) ? [[self pathResolver] absolutePathForCaptureFile:self.filteredGeoDataPath] : nil;
+    if (filePath && [[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
+        if (![self readSamplesFromGeoDataFile:self.filteredGeoDataPath samples:&samples count:&count]) return nil;
+    } else {
+        // Captures recorded before filtered tracks were saved are smoothed on the fly
+        if (![self readSamplesFromGeoDataFile:self.geoDataPath samples:&samples count:&count]) return nil;
+        [[[STRTrackFilter alloc] init] smoothSamples:samples count:count];
     }
-    
-    NSMutableDictionary * timestamps = [[NSMutableDictionary alloc] initWithCapacity:points.count];
-    for (NSDictionary * point in points) {
-        CLLocation * location = [[CLLocation alloc] initWithLatitude:[[[point objectForKey:@"coords"] objectAtIndex:0] doubleValue] longitude:[[[point objectForKey:@"coords"] objectAtIndex:1] doubleValue]];
-        CMTime timestamp = CMTimeMake(([[point objectForKey:@"timestamp"] doubleValue] * 1000000000), 1000000000);
-        NSDictionary * tempDictionary = @{ [NSValue valueWithCMTime:timestamp] : @[ location, [point objectForKey:@"heading"] ] };
-        [timestamps addEntriesFromDictionary:tempDictionary];
+    NSDictionary * dataPoints = [self dataPointsFromSamples:samples count:count];
+    free(samples);
+    return dataPoints;
+}
+
+-(BOOL)writeFilteredGeoData {
+    STRCapturePathResolver * resolver = [self pathResolver];
+    NSString * filteredGeoDataPath = [[[self.geoDataPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"filtered"] stringByAppendingPathExtension:@"json"];
+    NSString * sourcePath = [resolver absolutePathForCaptureFile:self.geoDataPath];
+    NSString * destinationPath = [[sourcePath stringByDeletingLastPathComponent] stringByAppendingPathComponent:[filteredGeoDataPath lastPathComponent]];
+    if (![[[STRTrackFilter alloc] init] smoothTrackAtPath:sourcePath toPath:destinationPath]) {
+        return NO;
     }
-    return timestamps;
+    NSString * previousPath = self.filteredGeoDataPath;
+    self.filteredGeoDataPath = filteredGeoDataPath;
+    if (![self save]) {
+        self.filteredGeoDataPath = previousPath;
+        return NO;
+    }
+    return YES;
+}
+
+-(BOOL)updateTrackSummary {
+    STRTrackSummary * summary = [STRTrackSummary summaryOfTrackAtPath:[[self pathResolver] absolutePathForCaptureFile:self.geoDataPath]];
+    if (!summary) return NO;
+    STRTrackSummary * previousSummary = self.trackSummary;
+    self.trackSummary = summary;
+    if (![self save]) {
+        self.trackSummary = previousSummary;
+        return NO;
+    }
+    return YES;
 }
 
 #pragma mark - Editing Methods
 
 -(BOOL)save {
-    // Write readonly properties to the file system
-    NSError * error;
-    // Read the mutable dictionary from the file
-    NSMutableDictionary * captureDictionary = [NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:[self.straboCaptureDirectoryPath stringByAppendingPathComponent:self.captureInfoPath]] options:NSJSONReadingMutableContainers error:&error];
-    if (error) {
-        if (_advancedLogging) NSLog(@"STRCapture: There was a problem saving your changes: %@", error.description);
-        return NO;
-    }
-    // Alter the writable entries in the dictionary
-    [captureDictionary setObject:self.title forKey:@"title"];
-    [captureDictionary setObject:@([self.uploadDate timeIntervalSince1970]) forKey:@"uploaded_at"];
-    // Save the changes by overwriting the dictionary
-    // to the capture info json file.
-    NSOutputStream * JSONOutput = [NSOutputStream outputStreamToFileAtPath:[self.straboCaptureDirectoryPath stringByAppendingPathComponent:self.captureInfoPath] append:NO];
-    [JSONOutput open];
-    [NSJSONSerialization writeJSONObject:captureDictionary toStream:JSONOutput options:0 error:&error];
-    [JSONOutput close];
-    if (error) {
-        if (_advancedLogging) NSLog(@"STRCapture: There was a problem saving your changes: %@", error.description);
-        return NO;
+    NSString * title = self.title;
+    NSDate * uploadDate = self.uploadDate;
+    BOOL titleChanged = (title && ![title isEqualToString:_savedTitle]);
+    BOOL uploadDateChanged = (uploadDate != _savedUploadDate && ![uploadDate isEqualToDate:_savedUploadDate]);
+    NSMutableSet * changedFields = [NSMutableSet set];
+    __block BOOL saved = NO;
+    
+    // Another thread may have saved the capture since this object read it, so the file
+    // is read again under the write lock and only what was changed here is applied to it
+    [[STRCaptureLockTable sharedTable] writeCaptureWithToken:self.token usingBlock:^{
+        // Resolved under the lock, since the capture may have moved into its shard since it was read
+        NSString * captureInfoPath = [[self pathResolver] absolutePathForCaptureFile:self.captureInfoPath];
+        NSError * error;
+        NSData * captureData = [NSData dataWithContentsOfFile:captureInfoPath];
+        NSMutableDictionary * captureDictionary = (captureData) ? [NSJSONSerialization JSONObjectWithData:captureData options:NSJSONReadingMutableContainers error:&error] : nil;
+        if (!captureDictionary) {
+            STRLogError(STRLogCategoryStorage, @"STRCapture: There was a problem saving your changes: %@", error.description);
+            return;
+        }
+        // Alter the writable entries in the dictionary, noting which ones change
+        NSDictionary * previousDictionary = [captureDictionary copy];
+        if (titleChanged) [captureDictionary setObject:title forKey:@"title"];
+        if (uploadDateChanged) [captureDictionary setObject:@([uploadDate timeIntervalSince1970]) forKey:@"uploaded_at"];
+        if (self.filteredGeoDataPath) {
+            [captureDictionary setObject:[self.token stringByAppendingPathComponent:[self.filteredGeoDataPath lastPathComponent]] forKey:@"filtered_geodata_file"];
+        }
+        if (self.trackSummary) {
+            [captureDictionary setObject:[self.trackSummary dictionaryRepresentation] forKey:@"track_summary"];
+        }
+        for (STRCaptureField * field in @[ STRCaptureFieldTitle, STRCaptureFieldUploadDate, STRCaptureFieldFilteredGeoData, STRCaptureFieldTrackSummary ]) {
+            id previousValue = [previousDictionary objectForKey:field];
+            id value = [captureDictionary objectForKey:field];
+            if (value && ![value isEqual:previousValue]) [changedFields addObject:field];
+        }
+        // Save the changes by replacing the capture info json file.
+        // The new file is written beside the old one and renamed over it, so a crash
+        // part way through never leaves a truncated info file, and readers that do not
+        // take the lock see either the old file or the new one.
+        NSData * JSONData = [NSJSONSerialization dataWithJSONObject:captureDictionary options:0 error:&error];
+        if (!JSONData || ![JSONData writeToFile:captureInfoPath options:NSDataWritingAtomic error:&error]) {
+            STRLogError(STRLogCategoryStorage, @"STRCapture: There was a problem saving your changes: %@", error.description);
+            return;
+        }
+        saved = YES;
+    }];
+    if (!saved) return NO;
+    
+    _savedTitle = title;
+    _savedUploadDate = uploadDate;
+    if (changedFields.count) {
+        [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeUpdated token:self.token fields:changedFields];
     }
     return YES;
 }
 
 @end
 
+
 @implementation STRCapture (InternalMethods)
 
--(NSString *)straboCaptureDirectoryPath {
-    return [NSHomeDirectory() stringByAppendingPathComponent:@"Documents/StraboCaptures"];
+#pragma mark - Files
+
+-(STRCapturePathResolver *)pathResolver {
+    // Captures put together by hand rather than read from their files use the shared resolver
+    return (_resolver) ? _resolver : [STRCapturePathResolver sharedResolver];
+}
+
+#pragma mark - Capture Info
+
+-(void)readCaptureInfoFields:(const STRCaptureInfoFields *)fields parser:(STRCaptureFileParser *)parser directory:(NSString *)captureDirectory {
+    // Track Info
+    self.title = [parser stringForField:fields->title];
+    self.token = [parser stringForField:fields->token];
+    self.type = [parser stringForField:fields->mediaType];
+    self.uploadDate = [STRCapture uploadDateFromTimestamp:fields->uploadedAt];
+    self.creationDate = [NSDate dateWithTimeIntervalSince1970:fields->createdAt];
+    // Geo Data
+    self.heading = (isnan(fields->heading)) ? nil : @(fields->heading);
+    self.latitude = @(fields->latitude);
+    self.longitude = @(fields->longitude);
+    if (fields->hasTrackSummary) self.trackSummary = [[STRTrackSummary alloc] initWithValues:fields->trackSummary];
+    // File Paths
+    // Only the file names are taken from the info file; the directory is wherever the capture lives now
+    self.geoDataPath = [captureDirectory stringByAppendingPathComponent:[[parser stringForField:fields->geoDataFile] lastPathComponent]];
+    if (fields->filteredGeoDataFile.present) {
+        self.filteredGeoDataPath = [captureDirectory stringByAppendingPathComponent:[[parser stringForField:fields->filteredGeoDataFile] lastPathComponent]];
+    }
+    self.mediaPath = [captureDirectory stringByAppendingPathComponent:[[parser stringForField:fields->mediaFile] lastPathComponent]];
+    self.thumbnailPath = [captureDirectory stringByAppendingPathComponent:[[parser stringForField:fields->thumbnailFile] lastPathComponent]];
+}
+
+-(BOOL)readCaptureInfoDictionary:(NSDictionary *)captureDictionary directory:(NSString *)captureDirectory {
+    NSArray * coords = [captureDictionary objectForKey:@"coords"];
+    if (![coords isKindOfClass:[NSArray class]] || coords.count < 2) return NO;
+    
+    // Track Info
+    self.title = [captureDictionary objectForKey:@"title"];
+    self.token = [captureDictionary objectForKey:@"token"];
+    self.type = [captureDictionary objectForKey:@"media_type"];
+    self.uploadDate = [STRCapture uploadDateFromTimestamp:[[captureDictionary objectForKey:@"uploaded_at"] doubleValue]];
+    self.creationDate = [NSDate dateWithTimeIntervalSince1970:[[captureDictionary objectForKey:@"created_at"] doubleValue]];
+    // Geo Data
+    self.heading = [captureDictionary objectForKey:@"heading"];
+    self.latitude = [coords objectAtIndex:0];
+    self.longitude = [coords objectAtIndex:1];
+    self.trackSummary = [STRTrackSummary summaryFromDictionary:[captureDictionary objectForKey:@"track_summary"]];
+    // File Paths
+    // Only the file names are taken from the info file; the directory is wherever the capture lives now
+    self.geoDataPath = [captureDirectory stringByAppendingPathComponent:[[captureDictionary objectForKey:@"geodata_file"] lastPathComponent]];
+    NSString * filteredGeoDataFile = [captureDictionary objectForKey:@"filtered_geodata_file"];
+    if ([filteredGeoDataFile isKindOfClass:[NSString class]]) {
+        self.filteredGeoDataPath = [captureDirectory stringByAppendingPathComponent:[filteredGeoDataFile lastPathComponent]];
+    }
+    self.mediaPath = [captureDirectory stringByAppendingPathComponent:[[captureDictionary objectForKey:@"media_file"] lastPathComponent]];
+    self.thumbnailPath = [captureDirectory stringByAppendingPathComponent:[[captureDictionary objectForKey:@"thumbnail_file"] lastPathComponent]];
+    return YES;
+}
+
++(NSDate *)uploadDateFromTimestamp:(double)timestamp {
+    NSDate * uploadDate = [NSDate dateWithTimeIntervalSince1970:timestamp];
+    if ([uploadDate compare:[NSDate dateWithTimeIntervalSince1970:500]] == NSOrderedAscending) {
+        return nil;
+    }
+    return uploadDate;
+}
+
+#pragma mark - Geo Data
+
+-(BOOL)readSamplesFromGeoDataFile:(NSString *)path samples:(STRTrackSample **)samples count:(NSUInteger *)count {
+    NSString * filePath = [[self pathResolver] absolutePathForCaptureFile:path];
+    if ([[STRCaptureFileParser parserForCurrentThread] parseGeoDataAtPath:filePath samples:samples count:count]) {
+        return YES;
+    }
+    
+    // Files the fast parser does not expect are read the generic way
+    NSData * geoData = [NSData dataWithContentsOfFile:filePath];
+    NSError * error;
+    id geoDataObject = (geoData) ? [NSJSONSerialization JSONObjectWithData:geoData options:NSJSONReadingAllowFragments error:&error] : nil;
+    NSArray * points = ([geoDataObject isKindOfClass:[NSDictionary class]]) ? [geoDataObject objectForKey:@"points"] : nil;
+    
+    if (!geoData || error || (points && ![points isKindOfClass:[NSArray class]])) {
+        STRLogError(STRLogCategoryStorage, @"STRCapture: Error reading the geodata file. File may have been corrupted.");
+        return NO;
+    }
+    
+    *count = points.count;
+    *samples = (points.count > 0) ? malloc(points.count * sizeof(STRTrackSample)) : NULL;
+    if (points.count > 0 && !*samples) return NO;
+    for (NSUInteger i = 0; i < points.count; i++) {
+        (*samples)[i] = [STRTrackFilter sampleFromPoint:[points objectAtIndex:i]];
+    }
+    return YES;
+}
+
+-(NSDictionary *)dataPointsFromSamples:(const STRTrackSample *)samples count:(NSUInteger)count {
+    NSMutableDictionary * timestamps = [[NSMutableDictionary alloc] initWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        CLLocation * location = [[CLLocation alloc] initWithLatitude:samples[i].latitude longitude:samples[i].longitude];
+        CMTime timestamp = CMTimeMake((samples[i].timestamp * 1000000000), 1000000000);
+        [timestamps setObject:@[ location, @(samples[i].heading) ] forKey:[NSValue valueWithCMTime:timestamp]];
+    }
+    return timestamps;
 }
 
 @end
@@ -0,0 +1,201 @@
+//
+//  STRCaptureChangeFeed.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Posted on the main thread with a batch of changes to the captures on the device.
+
+ The object of the notification is the STRCaptureChangeFeed. The user info dictionary holds the changes under STRCaptureStoreChangesKey and the sequence number of the last change under STRCaptureStoreSequenceNumberKey.
+ */
+extern NSString * const STRCaptureStoreDidChangeNotification;
+
+/**
+ An NSArray of STRCaptureChange objects, in the order of their sequence numbers. Each capture appears at most once.
+ */
+extern NSString * const STRCaptureStoreChangesKey;
+
+/**
+ An NSNumber holding the sequence number of the last change in the batch. Keep it to catch up with changesSinceSequenceNumber: later.
+ */
+extern NSString * const STRCaptureStoreSequenceNumberKey;
+
+/**
+ STRCaptureField
+
+ The fields named in [STRCaptureChange changedFields]. They are the keys of the capture info file.
+ */
+typedef NSString STRCaptureField;
+
+extern STRCaptureField * const STRCaptureFieldTitle;
+extern STRCaptureField * const STRCaptureFieldUploadDate;
+extern STRCaptureField * const STRCaptureFieldFilteredGeoData;
+extern STRCaptureField * const STRCaptureFieldSegments;
+extern STRCaptureField * const STRCaptureFieldTrackSummary;
+
+/**
+ STRCaptureChangeType
+
+ What happened to a capture.
+ */
+typedef enum {
+    STRCaptureChangeAdded,      // The capture was created, or restored from quarantine
+    STRCaptureChangeUpdated,    // Some fields of the capture were saved
+    STRCaptureChangeDeleted     // The capture was deleted or quarantined
+} STRCaptureChangeType;
+
+/**
+ One change to one capture.
+ */
+@interface STRCaptureChange : NSObject
+
+/**
+ Returns a change.
+
+ @param type What happened to the capture.
+
+ @param token The token of the capture.
+
+ @param fields The STRCaptureField names of the fields that changed, or nil if the whole capture should be read again.
+
+ @param sequenceNumber The sequence number of the change.
+
+ @return id The new change.
+ */
+-(id)initWithType:(STRCaptureChangeType)type token:(NSString *)token fields:(NSSet *)fields sequenceNumber:(unsigned long long)sequenceNumber;
+
+/**
+ What happened to the capture.
+ */
+@property(readonly)STRCaptureChangeType type;
+
+/**
+ The token of the capture.
+ */
+@property(readonly)NSString * token;
+
+/**
+ For updates, the STRCaptureField names of the fields that changed. Nil if every field may have changed, and for captures that were added or deleted.
+ */
+@property(readonly)NSSet * changedFields;
+
+/**
+ The sequence number of the change. Later changes have larger numbers.
+ */
+@property(readonly)unsigned long long sequenceNumber;
+
+@end
+
+/**
+ Tells code that shows captures what has changed, so that it does not have to read every capture again.
+
+ The SDK records a change whenever a capture is created, saved, uploaded, deleted, quarantined or restored. Changes are posted in batches with STRCaptureStoreDidChangeNotification. Changes made within coalescingInterval of each other go in the same batch, and several changes to one capture are merged into one: a capture that was added and then updated is reported as added, and a capture that was added and then deleted is not reported at all.
+
+ Every change also goes into a journal file, so that code that was not listening, or an app that was not running, can catch up with changesSinceSequenceNumber:. The journal keeps the last journalLimit changes. Sequence numbers only grow, even across launches and when the journal is deleted.
+
+    // Once
+    NSArray * captures = [fileManager allCapturesSorted:YES];
+    unsigned long long sequenceNumber = [fileManager currentChangeSequenceNumber];
+
+    // Later
+    NSArray * changes = [fileManager changesSinceSequenceNumber:sequenceNumber];
+    if (!changes) {
+        // Too long ago; read every capture again
+    }
+
+ A feed can be used from any thread. Notifications are always posted on the main thread.
+ */
+@interface STRCaptureChangeFeed : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Getting a Feed
+///---------------------------------------------------------------------------------------
+
+/**
+ The feed that the SDK records changes to, kept in `Library/Application Support/StraboCaptureChanges.log`.
+
+ @return STRCaptureChangeFeed The shared feed.
+ */
++(STRCaptureChangeFeed *)sharedFeed;
+
+/**
+ Returns a feed whose journal is kept in the file at the specified path.
+
+ Changes already in the file are loaded. Only one feed should use a file at a time.
+
+ @param path The path of the journal file. It is created with the first change.
+
+ @return id The new feed.
+ */
+-(id)initWithPath:(NSString *)path;
+
+/**
+ The path of the journal file.
+ */
+@property(readonly)NSString * path;
+
+/**
+ The number of seconds that changes are held for, so that changes made close together are posted as one batch. Defaults to 0.25.
+ */
+@property(assign)NSTimeInterval coalescingInterval;
+
+/**
+ The number of changes that the journal keeps. Defaults to 10,000.
+ */
+@property(assign)NSUInteger journalLimit;
+
+///---------------------------------------------------------------------------------------
+/// @name Recording Changes
+///---------------------------------------------------------------------------------------
+
+/**
+ Records a change, writes it to the journal and schedules it to be posted.
+
+ @param type What happened to the capture.
+
+ @param token The token of the capture.
+
+ @param fields For updates, the STRCaptureField names of the fields that changed. Pass nil if every field may have changed.
+ */
+-(void)recordChangeOfType:(STRCaptureChangeType)type token:(NSString *)token fields:(NSSet *)fields;
+
+/**
+ Posts the changes that are waiting for coalescingInterval to pass at once. Call it on the main thread.
+ */
+-(void)publishPendingChanges;
+
+///---------------------------------------------------------------------------------------
+/// @name Catching Up
+///---------------------------------------------------------------------------------------
+
+/**
+ The sequence number of the last change recorded.
+
+ @return unsigned long long The sequence number.
+ */
+-(unsigned long long)currentSequenceNumber;
+
+/**
+ Returns the changes since the change with the specified sequence number, merged the same way as a batch.
+
+ @param sequenceNumber A sequence number from currentSequenceNumber, a notification or an earlier change.
+
+ @return NSArray The STRCaptureChange objects, in order. Empty if nothing has changed. Nil if the journal no longer goes back that far, or the sequence number did not come from this feed; read every capture again.
+ */
+-(NSArray *)changesSinceSequenceNumber:(unsigned long long)sequenceNumber;
+
+/**
+ Merges changes so that each capture appears once, with the effect of all its changes.
+
+ @param changes STRCaptureChange objects in the order of their sequence numbers.
+
+ @return NSArray The merged changes, in the order of their last sequence numbers.
+ */
++(NSArray *)coalescedChanges:(NSArray *)changes;
+
+@end
@@ -0,0 +1,315 @@
+//
+//  STRCaptureChangeFeed.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureChangeFeed.h"
+#import "STRLogger.h"
+#import "STRSettings.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+NSString * const STRCaptureStoreDidChangeNotification = @"STRCaptureStoreDidChangeNotification";
+NSString * const STRCaptureStoreChangesKey = @"STRCaptureStoreChangesKey";
+NSString * const STRCaptureStoreSequenceNumberKey = @"STRCaptureStoreSequenceNumberKey";
+
+STRCaptureField * const STRCaptureFieldTitle = @"title";
+STRCaptureField * const STRCaptureFieldUploadDate = @"uploaded_at";
+STRCaptureField * const STRCaptureFieldFilteredGeoData = @"filtered_geodata_file";
+STRCaptureField * const STRCaptureFieldSegments = @"segments";
+STRCaptureField * const STRCaptureFieldTrackSummary = @"track_summary";
+
+#define kSTRDefaultCoalescingInterval 0.25
+#define kSTRDefaultJournalLimit 10000
+// The first line of a journal gives the sequence number that its changes follow
+#define kSTRJournalHeader "# STRCaptureChangeFeed 1"
+#define kSTRJournalAllFields @"*"
+
+#pragma mark - STRCaptureChange
+
+@interface STRCaptureChange (InternalMethods)
+-(STRCaptureChange *)changeFollowedByChange:(STRCaptureChange *)change;
+@end
+
+@implementation STRCaptureChange
+
+@synthesize type = _type;
+@synthesize token = _token;
+@synthesize changedFields = _changedFields;
+@synthesize sequenceNumber = _sequenceNumber;
+
+-(id)initWithType:(STRCaptureChangeType)type token:(NSString *)token fields:(NSSet *)fields sequenceNumber:(unsigned long long)sequenceNumber {
+    self = [super init];
+    if (self) {
+        _type = type;
+        _token = [token copy];
+        _changedFields = (type == STRCaptureChangeUpdated) ? [fields copy] : nil;
+        _sequenceNumber = sequenceNumber;
+    }
+    return self;
+}
+
+-(NSString *)description {
+    NSString * types[] = { @"added", @"updated", @"deleted" };
+    return [NSString stringWithFormat:@"<STRCaptureChange %llu %@ %@ %@>", _sequenceNumber, types[_type], _token, (_changedFields) ? [[_changedFields allObjects] componentsJoinedByString:@","] : @"*"];
+}
+
+@end
+
+@implementation STRCaptureChange (InternalMethods)
+
+// The single change with the effect of this one and then the later one, or nil if they cancel out
+-(STRCaptureChange *)changeFollowedByChange:(STRCaptureChange *)change {
+    if (change.type == STRCaptureChangeDeleted) {
+        // Whoever missed the addition has nothing to delete
+        if (_type == STRCaptureChangeAdded) return nil;
+        return change;
+    }
+    if (_type == STRCaptureChangeAdded) {
+        return [[STRCaptureChange alloc] initWithType:STRCaptureChangeAdded token:_token fields:nil sequenceNumber:change.sequenceNumber];
+    }
+    if (_type == STRCaptureChangeUpdated && change.type == STRCaptureChangeUpdated && _changedFields && change.changedFields) {
+        return [[STRCaptureChange alloc] initWithType:STRCaptureChangeUpdated token:_token fields:[_changedFields setByAddingObjectsFromSet:change.changedFields] sequenceNumber:change.sequenceNumber];
+    }
+    // A capture that was deleted and is back, or that changed in unknown ways, must be read again
+    return [[STRCaptureChange alloc] initWithType:STRCaptureChangeUpdated token:_token fields:nil sequenceNumber:change.sequenceNumber];
+}
+
+@end
+
+#pragma mark - STRCaptureChangeFeed
+
+@interface STRCaptureChangeFeed () {
+    NSMutableArray * _journal;
+    NSMutableArray * _pending;
+    unsigned long long _baseSequenceNumber;
+    unsigned long long _currentSequenceNumber;
+    BOOL _publishScheduled;
+}
+
+@property(readwrite)NSString * path;
+
+@end
+
+@interface STRCaptureChangeFeed (InternalMethods)
+
+// -- Journal -- //
+-(void)load;
+-(BOOL)appendChange:(STRCaptureChange *)change;
+-(BOOL)rewriteJournal;
+-(void)trimJournalIfNeeded;
++(NSString *)journalLineForChange:(STRCaptureChange *)change;
++(STRCaptureChange *)changeFromJournalLine:(NSString *)line;
+
+// -- Publishing -- //
+-(void)schedulePublish;
+
+@end
+
+@implementation STRCaptureChangeFeed
+
+#pragma mark - Class Methods
+
++(STRCaptureChangeFeed *)sharedFeed {
+    static STRCaptureChangeFeed * sharedFeed = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSString * supportPath = [NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+        sharedFeed = [[STRCaptureChangeFeed alloc] initWithPath:[supportPath stringByAppendingPathComponent:@"StraboCaptureChanges.log"]];
+        STRSettings * settings = [STRSettings sharedSettings];
+        if ([settings changeFeedCoalescingInterval] > 0) sharedFeed.coalescingInterval = [settings changeFeedCoalescingInterval];
+        if ([settings changeFeedJournalLimit] > 0) sharedFeed.journalLimit = [settings changeFeedJournalLimit];
+    });
+    return sharedFeed;
+}
+
++(NSArray *)coalescedChanges:(NSArray *)changes {
+    NSMutableDictionary * merged = [NSMutableDictionary dictionaryWithCapacity:changes.count];
+    for (STRCaptureChange * change in changes) {
+        STRCaptureChange * earlier = [merged objectForKey:change.token];
+        STRCaptureChange * combined = (earlier) ? [earlier changeFollowedByChange:change] : change;
+        if (combined) {
+            [merged setObject:combined forKey:change.token];
+        } else {
+            [merged removeObjectForKey:change.token];
+        }
+    }
+    return [[merged allValues] sortedArrayUsingComparator:^NSComparisonResult(STRCaptureChange * a, STRCaptureChange * b) {
+        if (a.sequenceNumber == b.sequenceNumber) return NSOrderedSame;
+        return (a.sequenceNumber < b.sequenceNumber) ? NSOrderedAscending : NSOrderedDescending;
+    }];
+}
+
+#pragma mark - Instance Methods
+
+-(id)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        self.path = path;
+        self.coalescingInterval = kSTRDefaultCoalescingInterval;
+        self.journalLimit = kSTRDefaultJournalLimit;
+        _journal = [NSMutableArray array];
+        _pending = [NSMutableArray array];
+        [self load];
+    }
+    return self;
+}
+
+-(void)recordChangeOfType:(STRCaptureChangeType)type token:(NSString *)token fields:(NSSet *)fields {
+    if (!token) return;
+    @synchronized(self) {
+        STRCaptureChange * change = [[STRCaptureChange alloc] initWithType:type token:token fields:fields sequenceNumber:_currentSequenceNumber + 1];
+        _currentSequenceNumber = change.sequenceNumber;
+        [_journal addObject:change];
+        [_pending addObject:change];
+        [self appendChange:change];
+        [self trimJournalIfNeeded];
+        [self schedulePublish];
+    }
+}
+
+-(void)publishPendingChanges {
+    NSArray * changes;
+    unsigned long long sequenceNumber;
+    @synchronized(self) {
+        _publishScheduled = NO;
+        if (_pending.count == 0) return;
+        changes = [STRCaptureChangeFeed coalescedChanges:_pending];
+        sequenceNumber = [[_pending lastObject] sequenceNumber];
+        [_pending removeAllObjects];
+    }
+    // Changes that cancelled out still move the sequence number on
+    [[NSNotificationCenter defaultCenter] postNotificationName:STRCaptureStoreDidChangeNotification object:self userInfo:@{ STRCaptureStoreChangesKey : changes, STRCaptureStoreSequenceNumberKey : @(sequenceNumber) }];
+}
+
+-(unsigned long long)currentSequenceNumber {
+    @synchronized(self) {
+        return _currentSequenceNumber;
+    }
+}
+
+-(NSArray *)changesSinceSequenceNumber:(unsigned long long)sequenceNumber {
+    @synchronized(self) {
+        if (sequenceNumber < _baseSequenceNumber || sequenceNumber > _currentSequenceNumber) return nil;
+        // The journal holds every number after the base, so the first change is found by arithmetic
+        NSUInteger first = (NSUInteger)(sequenceNumber - _baseSequenceNumber);
+        NSArray * changes = [_journal subarrayWithRange:NSMakeRange(first, _journal.count - first)];
+        return [STRCaptureChangeFeed coalescedChanges:changes];
+    }
+}
+
+@end
+
+@implementation STRCaptureChangeFeed (InternalMethods)
+
+#pragma mark - Journal
+
+-(void)load {
+    NSString * contents = [NSString stringWithContentsOfFile:self.path encoding:NSUTF8StringEncoding error:nil];
+    NSArray * lines = [contents componentsSeparatedByString:@"\n"];
+    unsigned long long base = 0;
+    if (lines.count == 0 || sscanf([[lines objectAtIndex:0] UTF8String], kSTRJournalHeader " %llu", &base) != 1) {
+        if (contents) STRLogWarning(STRLogCategoryStorage, @"STRCaptureChangeFeed: Starting a new journal in place of an unreadable one.");
+        // Starting from the time in microseconds keeps the numbers of a new journal above those of any journal before it,
+        // since no journal records a change every microsecond
+        _baseSequenceNumber = _currentSequenceNumber = (unsigned long long)([[NSDate date] timeIntervalSince1970] * 1000000.0);
+        [self rewriteJournal];
+        return;
+    }
+
+    _baseSequenceNumber = _currentSequenceNumber = base;
+    for (NSUInteger i = 1; i < lines.count; i++) {
+        NSString * line = [lines objectAtIndex:i];
+        if (line.length == 0) continue;
+        STRCaptureChange * change = [STRCaptureChangeFeed changeFromJournalLine:line];
+        // A change cut short by a crash can only be the last line
+        if (!change || change.sequenceNumber != _currentSequenceNumber + 1) {
+            STRLogWarning(STRLogCategoryStorage, @"STRCaptureChangeFeed: Ignoring the journal after change %llu.", _currentSequenceNumber);
+            [self rewriteJournal];
+            break;
+        }
+        [_journal addObject:change];
+        _currentSequenceNumber = change.sequenceNumber;
+    }
+    [self trimJournalIfNeeded];
+}
+
+-(BOOL)appendChange:(STRCaptureChange *)change {
+    FILE * file = fopen([self.path fileSystemRepresentation], "a");
+    if (!file) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureChangeFeed: Could not open the journal: %s", strerror(errno));
+        return NO;
+    }
+    BOOL written = fputs([[STRCaptureChangeFeed journalLineForChange:change] UTF8String], file) >= 0;
+    written = (fclose(file) == 0) && written;
+    if (!written) STRLogError(STRLogCategoryStorage, @"STRCaptureChangeFeed: Could not write change %llu to the journal.", change.sequenceNumber);
+    return written;
+}
+
+-(BOOL)rewriteJournal {
+    NSMutableString * contents = [NSMutableString stringWithFormat:@"%s %llu\n", kSTRJournalHeader, _baseSequenceNumber];
+    for (STRCaptureChange * change in _journal) {
+        [contents appendString:[STRCaptureChangeFeed journalLineForChange:change]];
+    }
+    [[NSFileManager defaultManager] createDirectoryAtPath:[self.path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    NSError * error;
+    if (![contents writeToFile:self.path atomically:YES encoding:NSUTF8StringEncoding error:&error]) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureChangeFeed: Could not write the journal: %@", error.localizedDescription);
+        return NO;
+    }
+    return YES;
+}
+
+// The journal is allowed to double before it is cut back, so that it is rewritten rarely
+-(void)trimJournalIfNeeded {
+    NSUInteger limit = MAX(self.journalLimit, (NSUInteger)1);
+    if (_journal.count <= limit * 2) return;
+    NSUInteger dropped = _journal.count - limit;
+    _baseSequenceNumber = [[_journal objectAtIndex:dropped - 1] sequenceNumber];
+    [_journal removeObjectsInRange:NSMakeRange(0, dropped)];
+    [self rewriteJournal];
+}
+
+// One line per change: the sequence number, A, U or D, the token and the changed fields
++(NSString *)journalLineForChange:(STRCaptureChange *)change {
+    NSString * types[] = { @"A", @"U", @"D" };
+    NSString * fields = (change.changedFields.count) ? [[change.changedFields allObjects] componentsJoinedByString:@","] : kSTRJournalAllFields;
+    return [NSString stringWithFormat:@"%llu %@ %@ %@\n", change.sequenceNumber, types[change.type], change.token, fields];
+}
+
++(STRCaptureChange *)changeFromJournalLine:(NSString *)line {
+    NSArray * parts = [line componentsSeparatedByString:@" "];
+    if (parts.count != 4) return nil;
+    unsigned long long sequenceNumber = strtoull([[parts objectAtIndex:0] UTF8String], NULL, 10);
+    NSString * typeName = [parts objectAtIndex:1];
+    STRCaptureChangeType type;
+    if ([typeName isEqualToString:@"A"]) {
+        type = STRCaptureChangeAdded;
+    } else if ([typeName isEqualToString:@"U"]) {
+        type = STRCaptureChangeUpdated;
+    } else if ([typeName isEqualToString:@"D"]) {
+        type = STRCaptureChangeDeleted;
+    } else {
+        return nil;
+    }
+    NSString * fieldList = [parts objectAtIndex:3];
+    NSSet * fields = ([fieldList isEqualToString:kSTRJournalAllFields]) ? nil : [NSSet setWithArray:[fieldList componentsSeparatedByString:@","]];
+    return [[STRCaptureChange alloc] initWithType:type token:[parts objectAtIndex:2] fields:fields sequenceNumber:sequenceNumber];
+}
+
+#pragma mark - Publishing
+
+-(void)schedulePublish {
+    if (_publishScheduled) return;
+    _publishScheduled = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.coalescingInterval * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [self publishPendingChanges];
+    });
+}
+
+@end
@@ -0,0 +1,169 @@
+//
+//  STRCaptureClusterIndex.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreLocation/CoreLocation.h>
+
+@class STRCapturePathResolver;
+@class STRCaptureChangeFeed;
+
+/**
+ A group of captures that are close together at some zoom level, to be shown on a map as one pin.
+ */
+@interface STRCaptureCluster : NSObject
+
+/**
+ The average location of the captures in the cluster. For a cluster of one capture, its location.
+ */
+@property(readonly)CLLocationCoordinate2D coordinate;
+
+/**
+ The number of captures in the cluster.
+ */
+@property(readonly)NSUInteger count;
+
+/**
+ The token of one capture in the cluster, to show as its thumbnail. It is the greatest token in the cluster, which for time-ordered tokens is the newest capture.
+ */
+@property(readonly)NSString * representativeToken;
+
+@end
+
+/**
+ Groups the captures on the device into map clusters, without loading them.
+
+ Showing every capture on a map by building a STRCapture for each one and adding a pin for each coordinate does not scale past a few thousand captures. An index holds only the token and the initial coordinates of each capture. They are kept in a quadtree over the Web Mercator square that map tiles use. Every node of the tree keeps the number of captures under it, the sum of their positions and its representative token. These aggregates are kept up to date as captures are added and removed, at a cost that grows with the depth of the tree rather than with the number of captures.
+
+ The clusters for a zoom level are the nodes at the depth that matches cells of cellSize points on screen. A query for a region visits only the nodes that overlap the region down to that depth, so its cost depends on how many clusters are visible, not on how many captures there are:
+
+    STRCaptureClusterIndex * index = [[STRCaptureClusterIndex alloc] init];
+    [index addCapturesFromResolver:[STRCapturePathResolver sharedResolver]];
+    [index followChangesOfFeed:[STRCaptureChangeFeed sharedFeed] resolver:[STRCapturePathResolver sharedResolver]];
+
+    NSUInteger zoomLevel = [STRCaptureClusterIndex zoomLevelForLongitudeDelta:mapView.region.span.longitudeDelta viewWidth:mapView.bounds.size.width];
+    NSArray * clusters = [index clustersFromSouthWest:southWest toNorthEast:northEast zoomLevel:zoomLevel];
+
+ An index is not thread safe. It can be built on a background queue, but once it follows a change feed, use it only from the main thread.
+ */
+@interface STRCaptureClusterIndex : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Building an Index
+///---------------------------------------------------------------------------------------
+
+/**
+ The width and height, in points, of the cells that captures are grouped by. It is rounded down to a power of two between 1 and 256. Defaults to 64, which groups captures into 4 by 4 cells per map tile.
+ */
+@property(nonatomic, assign)NSUInteger cellSize;
+
+/**
+ Adds every capture in the captures directory of a resolver.
+
+ Only the coordinates are read from each capture info file. Captures that cannot be read are skipped. The current sequence number of the shared STRCaptureChangeFeed is noted before the captures are listed, so that followChangesOfFeed:resolver: can catch up with changes made while they were read.
+
+ @param resolver The resolver of the captures directory.
+
+ @return NSUInteger The number of captures added.
+ */
+-(NSUInteger)addCapturesFromResolver:(STRCapturePathResolver *)resolver;
+
+/**
+ Adds a capture, or moves it if it is already in the index.
+
+ @param token The token of the capture.
+
+ @param coordinate The location of the capture.
+ */
+-(void)addCaptureWithToken:(NSString *)token coordinate:(CLLocationCoordinate2D)coordinate;
+
+/**
+ Removes a capture.
+
+ @param token The token of the capture.
+
+ @return BOOL YES if the capture was in the index.
+ */
+-(BOOL)removeCaptureWithToken:(NSString *)token;
+
+/**
+ Removes every capture.
+ */
+-(void)removeAllCaptures;
+
+/**
+ The number of captures in the index.
+ */
+@property(readonly)NSUInteger count;
+
+///---------------------------------------------------------------------------------------
+/// @name Following Changes
+///---------------------------------------------------------------------------------------
+
+/**
+ Adds, moves and removes captures as the changes say.
+
+ Captures that were added, or updated without a list of changed fields, are read again. Updates to other fields do not move a capture and are skipped.
+
+ @param changes STRCaptureChange objects, in order.
+
+ @param resolver The resolver used to find the capture info files.
+ */
+-(void)applyChanges:(NSArray *)changes resolver:(STRCapturePathResolver *)resolver;
+
+/**
+ Catches up with the changes recorded since sequenceNumber, then applies every batch of changes that the feed posts, until stopFollowingChanges is called.
+
+ If the feed no longer goes back to sequenceNumber, every capture is read again. Call this method on the main thread.
+
+ @param feed The change feed.
+
+ @param resolver The resolver used to find the capture info files.
+ */
+-(void)followChangesOfFeed:(STRCaptureChangeFeed *)feed resolver:(STRCapturePathResolver *)resolver;
+
+/**
+ Stops applying the changes of the feed passed to followChangesOfFeed:resolver:.
+ */
+-(void)stopFollowingChanges;
+
+/**
+ The sequence number of the last change that the index reflects.
+ */
+@property(nonatomic, assign)unsigned long long sequenceNumber;
+
+///---------------------------------------------------------------------------------------
+/// @name Getting Clusters
+///---------------------------------------------------------------------------------------
+
+/**
+ Returns the clusters whose cells overlap a region, at a zoom level.
+
+ Every capture in the region is in exactly one of the clusters. A cluster may extend past the edges of the region, and so may count captures outside of it. The region may cross the 180th meridian, in which case the longitude of southWest is greater than that of northEast.
+
+ @param southWest The south-west corner of the region.
+
+ @param northEast The north-east corner of the region.
+
+ @param zoomLevel The zoom level of the map, where 0 shows the whole world in one 256 point tile and each level doubles the scale.
+
+ @return NSArray The STRCaptureCluster objects, in no particular order.
+ */
+-(NSArray *)clustersFromSouthWest:(CLLocationCoordinate2D)southWest toNorthEast:(CLLocationCoordinate2D)northEast zoomLevel:(NSUInteger)zoomLevel;
+
+/**
+ The zoom level of a map showing a span of longitude across a view.
+
+ @param longitudeDelta The span of longitude shown, in degrees.
+
+ @param viewWidth The width of the map view, in points.
+
+ @return NSUInteger The zoom level, rounded down.
+ */
++(NSUInteger)zoomLevelForLongitudeDelta:(CLLocationDegrees)longitudeDelta viewWidth:(double)viewWidth;
+
+@end
@@ -0,0 +1,592 @@
+//
+//  STRCaptureClusterIndex.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureClusterIndex.h"
+#import "STRCaptureChangeFeed.h"
+#import "STRCaptureFileParser.h"
+#import "STRCapturePathResolver.h"
+#import "STRLogger.h"
+
+// Depth 26 cells are about 60 cm across at the equator
+#define kSTRClusterMaxDepth 26
+// A leaf above the deepest level splits when it holds more captures than this
+#define kSTRClusterLeafCapacity 16
+#define kSTRClusterTileSize 256
+#define kSTRDefaultCellSize 64
+// The edges of the Web Mercator square
+#define kSTRMaxMercatorLatitude 85.0511287798
+#define kSTRNone UINT32_MAX
+
+typedef struct {
+    uint32_t children[4];   // Indexed by quadrant: west/east in bit 0, north/south in bit 1. Also links free nodes.
+    uint32_t firstEntry;    // Leaves only
+    uint32_t count;         // Captures under the node
+    uint32_t representative;
+    double sumX;            // Sums of the projected positions, for the average
+    double sumY;
+    uint8_t depth;
+    BOOL leaf;
+} STRClusterNode;
+
+typedef struct {
+    uint32_t x;             // Projected position, in 1/2^32 of the Mercator square
+    uint32_t y;
+    uint32_t previous;      // In the list of the leaf
+    uint32_t next;          // In the list of the leaf, or of free entries
+} STRClusterEntry;
+
+// A query region in projected units. A region across the 180th meridian has two ranges of x.
+typedef struct {
+    uint32_t minX[2];
+    uint32_t maxX[2];
+    NSUInteger rangeCount;
+    uint32_t minY;
+    uint32_t maxY;
+    uint8_t depth;
+} STRClusterQuery;
+
+static inline uint32_t STRClusterUnitToFixed(double unit) {
+    if (!(unit > 0)) return 0;
+    if (unit >= 1) return UINT32_MAX;
+    return (uint32_t)(unit * 4294967296.0);
+}
+
+static inline uint32_t STRClusterProjectLongitude(CLLocationDegrees longitude) {
+    return STRClusterUnitToFixed((longitude + 180.0) / 360.0);
+}
+
+static inline uint32_t STRClusterProjectLatitude(CLLocationDegrees latitude) {
+    latitude = MAX(MIN(latitude, kSTRMaxMercatorLatitude), -kSTRMaxMercatorLatitude);
+    double s = sin(latitude * M_PI / 180.0);
+    return STRClusterUnitToFixed(0.5 - log((1 + s) / (1 - s)) / (4 * M_PI));
+}
+
+static inline CLLocationCoordinate2D STRClusterUnproject(double x, double y) {
+    return CLLocationCoordinate2DMake(90.0 - 360.0 * atan(exp((y - 0.5) * 2 * M_PI)) / M_PI, x * 360.0 - 180.0);
+}
+
+static inline NSUInteger STRClusterQuadrant(uint32_t x, uint32_t y, uint8_t depth) {
+    return ((x >> (31 - depth)) & 1) | (((y >> (31 - depth)) & 1) << 1);
+}
+
+// The first and last projected units of a cell
+static inline BOOL STRClusterCellOverlaps(const STRClusterQuery * query, uint64_t cellX, uint64_t cellY, uint8_t depth) {
+    uint64_t size = 1ULL << (32 - depth);
+    uint64_t minX = cellX * size, maxX = minX + size - 1;
+    uint64_t minY = cellY * size, maxY = minY + size - 1;
+    if (minY > query->maxY || maxY < query->minY) return NO;
+    for (NSUInteger i = 0; i < query->rangeCount; i++) {
+        if (minX <= query->maxX[i] && maxX >= query->minX[i]) return YES;
+    }
+    return NO;
+}
+
+#pragma mark - STRCaptureCluster
+
+@interface STRCaptureCluster ()
+
+-(id)initWithCoordinate:(CLLocationCoordinate2D)coordinate count:(NSUInteger)count representativeToken:(NSString *)representativeToken;
+
+@property(readwrite)CLLocationCoordinate2D coordinate;
+@property(readwrite)NSUInteger count;
+@property(readwrite)NSString * representativeToken;
+
+@end
+
+@implementation STRCaptureCluster
+
+-(id)initWithCoordinate:(CLLocationCoordinate2D)coordinate count:(NSUInteger)count representativeToken:(NSString *)representativeToken {
+    self = [super init];
+    if (self) {
+        self.coordinate = coordinate;
+        self.count = count;
+        self.representativeToken = representativeToken;
+    }
+    return self;
+}
+
+-(NSString *)description {
+    return [NSString stringWithFormat:@"<STRCaptureCluster %.6f,%.6f count=%lu token=%@>", self.coordinate.latitude, self.coordinate.longitude, (unsigned long)self.count, self.representativeToken];
+}
+
+@end
+
+#pragma mark - STRCaptureClusterIndex
+
+@interface STRCaptureClusterIndex () {
+    STRClusterNode * _nodes;
+    uint32_t _nodeCount;
+    uint32_t _nodeCapacity;
+    uint32_t _freeNode;
+    STRClusterEntry * _entries;
+    uint32_t _entryCount;
+    uint32_t _entryCapacity;
+    uint32_t _freeEntry;
+    // The token of each entry, or NSNull for a free one, and the entry of each token
+    NSMutableArray * _tokens;
+    NSMutableDictionary * _entryIndexes;
+    // The feed being followed
+    STRCaptureChangeFeed * _feed;
+    STRCapturePathResolver * _resolver;
+}
+
+@end
+
+@interface STRCaptureClusterIndex (InternalMethods)
+
+// -- Reading Captures -- //
+-(NSUInteger)addCapturesFromResolver:(STRCapturePathResolver *)resolver feed:(STRCaptureChangeFeed *)feed;
+-(BOOL)readCoordinate:(CLLocationCoordinate2D *)coordinate ofCaptureAtDirectory:(NSString *)relativeDirectory resolver:(STRCapturePathResolver *)resolver;
+-(void)feedDidChange:(NSNotification *)notification;
+
+// -- Storage -- //
+-(uint32_t)newNodeAtDepth:(uint8_t)depth;
+-(void)freeNode:(uint32_t)nodeIndex;
+-(uint32_t)newEntryForToken:(NSString *)token;
+-(BOOL)isEntry:(uint32_t)entry greaterThanEntry:(uint32_t)other;
+
+// -- The Tree -- //
+-(void)addEntry:(uint32_t)entry toNode:(uint32_t)nodeIndex;
+-(void)insertEntry:(uint32_t)entry;
+-(void)splitNode:(uint32_t)nodeIndex;
+-(void)removeEntry:(uint32_t)entry;
+-(void)updateRepresentativeOfNode:(uint32_t)nodeIndex;
+
+// -- Queries -- //
+-(void)collectClustersInNode:(uint32_t)nodeIndex cellX:(uint64_t)cellX cellY:(uint64_t)cellY query:(const STRClusterQuery *)query into:(NSMutableArray *)clusters;
+-(void)collectClustersInLeaf:(uint32_t)nodeIndex query:(const STRClusterQuery *)query into:(NSMutableArray *)clusters;
+-(STRCaptureCluster *)clusterWithCount:(NSUInteger)count sumX:(double)sumX sumY:(double)sumY representative:(uint32_t)representative;
+
+@end
+
+@implementation STRCaptureClusterIndex
+
+#pragma mark - Class Methods
+
++(NSUInteger)zoomLevelForLongitudeDelta:(CLLocationDegrees)longitudeDelta viewWidth:(double)viewWidth {
+    if (!(longitudeDelta > 0) || !(viewWidth > 0)) return kSTRClusterMaxDepth;
+    double zoomLevel = log2(360.0 * viewWidth / (kSTRClusterTileSize * MIN(longitudeDelta, 360.0)));
+    return (NSUInteger)MAX(floor(zoomLevel), 0);
+}
+
+#pragma mark - Instance Methods
+
+-(id)init {
+    self = [super init];
+    if (self) {
+        _tokens = [NSMutableArray array];
+        _entryIndexes = [NSMutableDictionary dictionary];
+        self.cellSize = kSTRDefaultCellSize;
+        [self removeAllCaptures];
+    }
+    return self;
+}
+
+-(void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    free(_nodes);
+    free(_entries);
+}
+
+-(void)setCellSize:(NSUInteger)cellSize {
+    NSUInteger rounded = 1;
+    while (rounded * 2 <= MIN(cellSize, (NSUInteger)kSTRClusterTileSize)) rounded *= 2;
+    _cellSize = rounded;
+}
+
+-(NSUInteger)count {
+    return _entryIndexes.count;
+}
+
+#pragma mark - Building
+
+-(NSUInteger)addCapturesFromResolver:(STRCapturePathResolver *)resolver {
+    return [self addCapturesFromResolver:resolver feed:[STRCaptureChangeFeed sharedFeed]];
+}
+
+-(void)addCaptureWithToken:(NSString *)token coordinate:(CLLocationCoordinate2D)coordinate {
+    if (!token) return;
+    [self removeCaptureWithToken:token];
+    uint32_t entry = [self newEntryForToken:token];
+    _entries[entry].x = STRClusterProjectLongitude(coordinate.longitude);
+    _entries[entry].y = STRClusterProjectLatitude(coordinate.latitude);
+    [self insertEntry:entry];
+}
+
+-(BOOL)removeCaptureWithToken:(NSString *)token {
+    NSNumber * entryIndex = (token) ? [_entryIndexes objectForKey:token] : nil;
+    if (!entryIndex) return NO;
+    uint32_t entry = (uint32_t)[entryIndex unsignedIntValue];
+    [self removeEntry:entry];
+    [_entryIndexes removeObjectForKey:token];
+    [_tokens replaceObjectAtIndex:entry withObject:[NSNull null]];
+    _entries[entry].next = _freeEntry;
+    _freeEntry = entry;
+    return YES;
+}
+
+-(void)removeAllCaptures {
+    _nodeCount = 0;
+    _freeNode = kSTRNone;
+    _entryCount = 0;
+    _freeEntry = kSTRNone;
+    [_tokens removeAllObjects];
+    [_entryIndexes removeAllObjects];
+    // The root covers the whole square
+    STRClusterNode * root = &_nodes[[self newNodeAtDepth:0]];
+    root->leaf = YES;
+}
+
+#pragma mark - Following Changes
+
+-(void)applyChanges:(NSArray *)changes resolver:(STRCapturePathResolver *)resolver {
+    for (STRCaptureChange * change in changes) {
+        self.sequenceNumber = MAX(self.sequenceNumber, change.sequenceNumber);
+        if (change.type == STRCaptureChangeDeleted) {
+            [self removeCaptureWithToken:change.token];
+            continue;
+        }
+        // The fields that are saved on their own never include the coordinates
+        if (change.type == STRCaptureChangeUpdated && change.changedFields) continue;
+        NSString * relativeDirectory = [resolver relativeDirectoryOfCaptureWithToken:change.token];
+        CLLocationCoordinate2D coordinate;
+        if (relativeDirectory && [self readCoordinate:&coordinate ofCaptureAtDirectory:relativeDirectory resolver:resolver]) {
+            [self addCaptureWithToken:change.token coordinate:coordinate];
+        } else {
+            [self removeCaptureWithToken:change.token];
+        }
+    }
+}
+
+-(void)followChangesOfFeed:(STRCaptureChangeFeed *)feed resolver:(STRCapturePathResolver *)resolver {
+    [self stopFollowingChanges];
+    NSArray * changes = [feed changesSinceSequenceNumber:self.sequenceNumber];
+    if (changes) {
+        [self applyChanges:changes resolver:resolver];
+    } else {
+        STRLogInfo(STRLogCategoryStorage, @"STRCaptureClusterIndex: The change feed does not go back to change %llu. Reading every capture again.", self.sequenceNumber);
+        [self removeAllCaptures];
+        [self addCapturesFromResolver:resolver feed:feed];
+    }
+    _feed = feed;
+    _resolver = resolver;
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(feedDidChange:) name:STRCaptureStoreDidChangeNotification object:feed];
+}
+
+-(void)stopFollowingChanges {
+    if (!_feed) return;
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:STRCaptureStoreDidChangeNotification object:_feed];
+    _feed = nil;
+    _resolver = nil;
+}
+
+#pragma mark - Getting Clusters
+
+-(NSArray *)clustersFromSouthWest:(CLLocationCoordinate2D)southWest toNorthEast:(CLLocationCoordinate2D)northEast zoomLevel:(NSUInteger)zoomLevel {
+    STRClusterQuery query;
+    query.minY = STRClusterProjectLatitude(MAX(southWest.latitude, northEast.latitude));
+    query.maxY = STRClusterProjectLatitude(MIN(southWest.latitude, northEast.latitude));
+    uint32_t west = STRClusterProjectLongitude(southWest.longitude);
+    uint32_t east = STRClusterProjectLongitude(northEast.longitude);
+    if (west <= east) {
+        query.minX[0] = west;
+        query.maxX[0] = east;
+        query.rangeCount = 1;
+    } else {
+        query.minX[0] = west;
+        query.maxX[0] = UINT32_MAX;
+        query.minX[1] = 0;
+        query.maxX[1] = east;
+        query.rangeCount = 2;
+    }
+
+    // Cells of cellSize points are this many levels below the tiles of the zoom level
+    NSUInteger levelsBelowTiles = 0;
+    while ((kSTRClusterTileSize >> levelsBelowTiles) > self.cellSize) levelsBelowTiles++;
+    query.depth = (uint8_t)MIN(zoomLevel + levelsBelowTiles, (NSUInteger)kSTRClusterMaxDepth);
+
+    NSMutableArray * clusters = [NSMutableArray array];
+    [self collectClustersInNode:0 cellX:0 cellY:0 query:&query into:clusters];
+    return clusters;
+}
+
+@end
+
+@implementation STRCaptureClusterIndex (InternalMethods)
+
+#pragma mark - Reading Captures
+
+-(NSUInteger)addCapturesFromResolver:(STRCapturePathResolver *)resolver feed:(STRCaptureChangeFeed *)feed {
+    // Noted first, so that changes made while the captures are read are applied again later
+    self.sequenceNumber = [feed currentSequenceNumber];
+    NSUInteger added = 0;
+    for (NSString * relativeDirectory in [resolver allCaptureDirectories]) {
+        @autoreleasepool {
+            CLLocationCoordinate2D coordinate;
+            if (![self readCoordinate:&coordinate ofCaptureAtDirectory:relativeDirectory resolver:resolver]) continue;
+            [self addCaptureWithToken:[relativeDirectory lastPathComponent] coordinate:coordinate];
+            added++;
+        }
+    }
+    STRLogDebug(STRLogCategoryStorage, @"STRCaptureClusterIndex: Added %lu captures in %u tree nodes.", (unsigned long)added, _nodeCount);
+    return added;
+}
+
+-(BOOL)readCoordinate:(CLLocationCoordinate2D *)coordinate ofCaptureAtDirectory:(NSString *)relativeDirectory resolver:(STRCapturePathResolver *)resolver {
+    NSString * captureInfoPath = [resolver absolutePathForRelativePath:[relativeDirectory stringByAppendingPathComponent:@"capture-info.json"]];
+    STRCaptureInfoFields fields;
+    if ([[STRCaptureFileParser parserForCurrentThread] parseCaptureInfoAtPath:captureInfoPath fields:&fields]) {
+        *coordinate = CLLocationCoordinate2DMake(fields.latitude, fields.longitude);
+        return YES;
+    }
+    NSData * data = [NSData dataWithContentsOfFile:captureInfoPath];
+    NSDictionary * info = (data) ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+    NSArray * coords = ([info isKindOfClass:[NSDictionary class]]) ? [info objectForKey:@"coords"] : nil;
+    if (![coords isKindOfClass:[NSArray class]] || coords.count < 2) return NO;
+    id latitude = [coords objectAtIndex:0], longitude = [coords objectAtIndex:1];
+    if (![latitude isKindOfClass:[NSNumber class]] || ![longitude isKindOfClass:[NSNumber class]]) return NO;
+    *coordinate = CLLocationCoordinate2DMake([latitude doubleValue], [longitude doubleValue]);
+    return YES;
+}
+
+-(void)feedDidChange:(NSNotification *)notification {
+    // Changes already applied while catching up come round again in the first batch
+    unsigned long long applied = self.sequenceNumber;
+    NSMutableArray * changes = [NSMutableArray array];
+    for (STRCaptureChange * change in [notification.userInfo objectForKey:STRCaptureStoreChangesKey]) {
+        if (change.sequenceNumber > applied) [changes addObject:change];
+    }
+    [self applyChanges:changes resolver:_resolver];
+    // Changes that cancelled out still move the sequence number on
+    self.sequenceNumber = MAX(self.sequenceNumber, [[notification.userInfo objectForKey:STRCaptureStoreSequenceNumberKey] unsignedLongLongValue]);
+}
+
+#pragma mark - Storage
+
+-(uint32_t)newNodeAtDepth:(uint8_t)depth {
+    uint32_t nodeIndex;
+    if (_freeNode != kSTRNone) {
+        nodeIndex = _freeNode;
+        _freeNode = _nodes[nodeIndex].children[0];
+    } else {
+        if (_nodeCount == _nodeCapacity) {
+            _nodeCapacity = MAX(_nodeCapacity * 2, 64);
+            _nodes = realloc(_nodes, _nodeCapacity * sizeof(STRClusterNode));
+        }
+        nodeIndex = _nodeCount++;
+    }
+    STRClusterNode * node = &_nodes[nodeIndex];
+    memset(node, 0, sizeof(STRClusterNode));
+    for (NSUInteger i = 0; i < 4; i++) node->children[i] = kSTRNone;
+    node->firstEntry = kSTRNone;
+    node->representative = kSTRNone;
+    node->depth = depth;
+    node->leaf = YES;
+    return nodeIndex;
+}
+
+-(void)freeNode:(uint32_t)nodeIndex {
+    _nodes[nodeIndex].children[0] = _freeNode;
+    _freeNode = nodeIndex;
+}
+
+-(uint32_t)newEntryForToken:(NSString *)token {
+    uint32_t entry;
+    if (_freeEntry != kSTRNone) {
+        entry = _freeEntry;
+        _freeEntry = _entries[entry].next;
+        [_tokens replaceObjectAtIndex:entry withObject:token];
+    } else {
+        if (_entryCount == _entryCapacity) {
+            _entryCapacity = MAX(_entryCapacity * 2, 256);
+            _entries = realloc(_entries, _entryCapacity * sizeof(STRClusterEntry));
+        }
+        entry = _entryCount++;
+        [_tokens addObject:token];
+    }
+    _entries[entry].previous = kSTRNone;
+    _entries[entry].next = kSTRNone;
+    [_entryIndexes setObject:@(entry) forKey:token];
+    return entry;
+}
+
+-(BOOL)isEntry:(uint32_t)entry greaterThanEntry:(uint32_t)other {
+    if (other == kSTRNone) return YES;
+    return ([[_tokens objectAtIndex:entry] compare:[_tokens objectAtIndex:other]] == NSOrderedDescending);
+}
+
+#pragma mark - The Tree
+
+-(void)addEntry:(uint32_t)entry toNode:(uint32_t)nodeIndex {
+    STRClusterNode * node = &_nodes[nodeIndex];
+    node->count++;
+    node->sumX += _entries[entry].x / 4294967296.0;
+    node->sumY += _entries[entry].y / 4294967296.0;
+    if ([self isEntry:entry greaterThanEntry:node->representative]) node->representative = entry;
+    if (node->leaf) {
+        _entries[entry].previous = kSTRNone;
+        _entries[entry].next = node->firstEntry;
+        if (node->firstEntry != kSTRNone) _entries[node->firstEntry].previous = entry;
+        node->firstEntry = entry;
+    }
+}
+
+-(void)insertEntry:(uint32_t)entry {
+    uint32_t x = _entries[entry].x, y = _entries[entry].y;
+    uint32_t nodeIndex = 0;
+    while (YES) {
+        [self addEntry:entry toNode:nodeIndex];
+        if (_nodes[nodeIndex].leaf) {
+            if (_nodes[nodeIndex].count > kSTRClusterLeafCapacity && _nodes[nodeIndex].depth < kSTRClusterMaxDepth) [self splitNode:nodeIndex];
+            return;
+        }
+        NSUInteger quadrant = STRClusterQuadrant(x, y, _nodes[nodeIndex].depth);
+        uint32_t child = _nodes[nodeIndex].children[quadrant];
+        if (child == kSTRNone) {
+            // Allocating may move the nodes, so none is held across it
+            child = [self newNodeAtDepth:_nodes[nodeIndex].depth + 1];
+            _nodes[nodeIndex].children[quadrant] = child;
+        }
+        nodeIndex = child;
+    }
+}
+
+-(void)splitNode:(uint32_t)nodeIndex {
+    uint32_t entry = _nodes[nodeIndex].firstEntry;
+    uint8_t depth = _nodes[nodeIndex].depth;
+    _nodes[nodeIndex].leaf = NO;
+    _nodes[nodeIndex].firstEntry = kSTRNone;
+    while (entry != kSTRNone) {
+        uint32_t next = _entries[entry].next;
+        NSUInteger quadrant = STRClusterQuadrant(_entries[entry].x, _entries[entry].y, depth);
+        uint32_t child = _nodes[nodeIndex].children[quadrant];
+        if (child == kSTRNone) {
+            child = [self newNodeAtDepth:depth + 1];
+            _nodes[nodeIndex].children[quadrant] = child;
+        }
+        [self addEntry:entry toNode:child];
+        entry = next;
+    }
+    // Captures that all fall in one quadrant split it in turn
+    for (NSUInteger quadrant = 0; quadrant < 4; quadrant++) {
+        uint32_t child = _nodes[nodeIndex].children[quadrant];
+        if (child != kSTRNone && _nodes[child].count > kSTRClusterLeafCapacity && _nodes[child].depth < kSTRClusterMaxDepth) [self splitNode:child];
+    }
+}
+
+-(void)removeEntry:(uint32_t)entry {
+    uint32_t x = _entries[entry].x, y = _entries[entry].y;
+    uint32_t path[kSTRClusterMaxDepth + 1];
+    NSUInteger length = 0;
+    uint32_t nodeIndex = 0;
+    while (nodeIndex != kSTRNone) {
+        path[length++] = nodeIndex;
+        STRClusterNode * node = &_nodes[nodeIndex];
+        node->count--;
+        node->sumX -= x / 4294967296.0;
+        node->sumY -= y / 4294967296.0;
+        if (node->count == 0) node->sumX = node->sumY = 0;
+        if (node->leaf) {
+            uint32_t previous = _entries[entry].previous, next = _entries[entry].next;
+            if (previous != kSTRNone) _entries[previous].next = next; else node->firstEntry = next;
+            if (next != kSTRNone) _entries[next].previous = previous;
+            break;
+        }
+        nodeIndex = node->children[STRClusterQuadrant(x, y, node->depth)];
+    }
+
+    // Empty nodes are released, and representatives chosen again from the bottom up
+    for (NSUInteger i = length; i-- > 0;) {
+        nodeIndex = path[i];
+        if (_nodes[nodeIndex].count == 0 && i > 0) {
+            uint32_t parent = path[i - 1];
+            _nodes[parent].children[STRClusterQuadrant(x, y, _nodes[parent].depth)] = kSTRNone;
+            [self freeNode:nodeIndex];
+        } else if (_nodes[nodeIndex].representative == entry) {
+            [self updateRepresentativeOfNode:nodeIndex];
+        }
+    }
+}
+
+-(void)updateRepresentativeOfNode:(uint32_t)nodeIndex {
+    uint32_t representative = kSTRNone;
+    if (_nodes[nodeIndex].leaf) {
+        for (uint32_t entry = _nodes[nodeIndex].firstEntry; entry != kSTRNone; entry = _entries[entry].next) {
+            if ([self isEntry:entry greaterThanEntry:representative]) representative = entry;
+        }
+    } else {
+        for (NSUInteger quadrant = 0; quadrant < 4; quadrant++) {
+            uint32_t child = _nodes[nodeIndex].children[quadrant];
+            if (child == kSTRNone) continue;
+            uint32_t candidate = _nodes[child].representative;
+            if (candidate != kSTRNone && [self isEntry:candidate greaterThanEntry:representative]) representative = candidate;
+        }
+    }
+    _nodes[nodeIndex].representative = representative;
+}
+
+#pragma mark - Queries
+
+-(void)collectClustersInNode:(uint32_t)nodeIndex cellX:(uint64_t)cellX cellY:(uint64_t)cellY query:(const STRClusterQuery *)query into:(NSMutableArray *)clusters {
+    const STRClusterNode * node = &_nodes[nodeIndex];
+    if (node->count == 0 || !STRClusterCellOverlaps(query, cellX, cellY, node->depth)) return;
+    if (node->depth >= query->depth) {
+        [clusters addObject:[self clusterWithCount:node->count sumX:node->sumX sumY:node->sumY representative:node->representative]];
+        return;
+    }
+    if (node->leaf) {
+        [self collectClustersInLeaf:nodeIndex query:query into:clusters];
+        return;
+    }
+    for (NSUInteger quadrant = 0; quadrant < 4; quadrant++) {
+        uint32_t child = _nodes[nodeIndex].children[quadrant];
+        if (child == kSTRNone) continue;
+        [self collectClustersInNode:child cellX:cellX * 2 + (quadrant & 1) cellY:cellY * 2 + (quadrant >> 1) query:query into:clusters];
+    }
+}
+
+-(void)collectClustersInLeaf:(uint32_t)nodeIndex query:(const STRClusterQuery *)query into:(NSMutableArray *)clusters {
+    // A leaf above the cluster depth holds few captures, which are grouped by the cell they fall in
+    struct {
+        uint64_t cellX, cellY;
+        NSUInteger count;
+        double sumX, sumY;
+        uint32_t representative;
+    } groups[kSTRClusterLeafCapacity];
+    NSUInteger groupCount = 0;
+    unsigned shift = 32 - query->depth;
+    for (uint32_t entry = _nodes[nodeIndex].firstEntry; entry != kSTRNone; entry = _entries[entry].next) {
+        uint64_t cellX = _entries[entry].x >> shift, cellY = _entries[entry].y >> shift;
+        NSUInteger group = 0;
+        while (group < groupCount && (groups[group].cellX != cellX || groups[group].cellY != cellY)) group++;
+        if (group == groupCount) {
+            if (groupCount == kSTRClusterLeafCapacity) break;
+            groups[group].cellX = cellX;
+            groups[group].cellY = cellY;
+            groups[group].count = 0;
+            groups[group].sumX = groups[group].sumY = 0;
+            groups[group].representative = kSTRNone;
+            groupCount++;
+        }
+        groups[group].count++;
+        groups[group].sumX += _entries[entry].x / 4294967296.0;
+        groups[group].sumY += _entries[entry].y / 4294967296.0;
+        if ([self isEntry:entry greaterThanEntry:groups[group].representative]) groups[group].representative = entry;
+    }
+    for (NSUInteger group = 0; group < groupCount; group++) {
+        if (!STRClusterCellOverlaps(query, groups[group].cellX, groups[group].cellY, query->depth)) continue;
+        [clusters addObject:[self clusterWithCount:groups[group].count sumX:groups[group].sumX sumY:groups[group].sumY representative:groups[group].representative]];
+    }
+}
+
+-(STRCaptureCluster *)clusterWithCount:(NSUInteger)count sumX:(double)sumX sumY:(double)sumY representative:(uint32_t)representative {
+    CLLocationCoordinate2D coordinate = STRClusterUnproject(sumX / count, sumY / count);
+    return [[STRCaptureCluster alloc] initWithCoordinate:coordinate count:count representativeToken:[_tokens objectAtIndex:representative]];
+}
+
+@end
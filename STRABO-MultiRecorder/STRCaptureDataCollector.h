@@ -10,6 +10,21 @@
 #import <AVFoundation/AVFoundation.h>
 #import <UIKit/UIKit.h>
 
+/**
+ Posted when a STRCaptureDataCollector starts recording video. The notification object is the data collector.
+ */
+extern NSString * const STRCaptureRecordingDidBeginNotification;
+
+/**
+ Posted when a STRCaptureDataCollector stops recording video, whether or not the recording succeeded. The notification object is the data collector.
+ */
+extern NSString * const STRCaptureRecordingDidEndNotification;
+
+/**
+ In the user info of a STRCaptureRecordingDidBeginNotification, an NSNumber holding YES if the video is recorded in segments.
+ */
+extern NSString * const STRCaptureRecordingSegmentedKey;
+
 /**
  Protocol required to be implemented by the delegate object of a [STRCaptureDataCollector].
  
@@ -23,9 +38,32 @@
 
 -(void)videoRecordingDidBegin;
 -(void)videoRecordingDidEnd;
+
+/**
+ Called instead of videoRecordingDidEnd when a video recording ends with an error.
+
+ In a recording made in segments, the segments reported by videoRecordingDidFinishSegmentAtURL:startTime:duration: before the error are complete; only the movie file that was being recorded is lost.
+
+ @param error The error that ended the recording.
+ */
 -(void)videoRecordingDidFailWithError:(NSError *)error;
 -(void)stillImageWasCaptured;
 
+@optional
+
+/**
+ Called when a segment of a video recorded in segments has been written, before the next segment starts recording.
+
+ The file is only valid for the duration of this call. Move it elsewhere to keep it.
+
+ @param segmentURL The URL of the movie file that holds the segment.
+
+ @param startTime The time at which the segment began recording, as given by CACurrentMediaTime().
+
+ @param duration The length of the segment, in seconds.
+ */
+-(void)videoRecordingDidFinishSegmentAtURL:(NSURL *)segmentURL startTime:(CFTimeInterval)startTime duration:(NSTimeInterval)duration;
+
 @end
 
 /**
@@ -67,6 +105,28 @@
  */
 -(void)setCaptureQuality:(NSString *)captureSessionQualityPreset;
 
+/**
+ The length, in seconds, of the segments that video is recorded in. 0, the default, records each video to a single file.
+
+ When the value is greater than 0, the recording is split into movie files of about this length. As each one is written, the delegate receives [videoRecordingDidFinishSegmentAtURL:startTime:duration:]([STRCaptureDataCollectorDelegate videoRecordingDidFinishSegmentAtURL:startTime:duration:]) and the next segment starts recording. videoRecordingDidBegin and videoRecordingDidEnd are still called once for the whole recording, and the last segment is reported just before videoRecordingDidEnd.
+
+ Set this property before recording starts.
+
+ @warning AVCaptureMovieFileOutput cannot switch files without stopping, so a few frames are lost between two segments.
+ */
+@property(assign)NSTimeInterval segmentDuration;
+
+///---------------------------------------------------------------------------------------
+/// @name Recording State
+///---------------------------------------------------------------------------------------
+
+/**
+ YES while any STRCaptureDataCollector records a video that is not split into segments.
+
+ Code that is set up in the middle of a recording, and so missed its STRCaptureRecordingDidBeginNotification, can check this instead.
+ */
++(BOOL)isRecordingUnsegmentedVideo;
+
 ///---------------------------------------------------------------------------------------
 /// @name Recording Audio and Video
 ///---------------------------------------------------------------------------------------
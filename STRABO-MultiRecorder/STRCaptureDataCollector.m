@@ -6,7 +6,18 @@
 //  Copyright (c) 2012 Strabo. All rights reserved.
 //
 
+#import <QuartzCore/QuartzCore.h>
+#import <libkern/OSAtomic.h>
+
 #import "STRCaptureDataCollector.h"
+#import "STRLogger.h"
+
+NSString * const STRCaptureRecordingDidBeginNotification = @"STRCaptureRecordingDidBeginNotification";
+NSString * const STRCaptureRecordingDidEndNotification = @"STRCaptureRecordingDidEndNotification";
+NSString * const STRCaptureRecordingSegmentedKey = @"STRCaptureRecordingSegmented";
+
+// Unsegmented recordings between their begin and end notifications, over all collectors
+static int32_t volatile _unsegmentedRecordings = 0;
 
 @interface STRCaptureDataCollector (AVCaptureFileOutputRecordingDelegate) <AVCaptureFileOutputRecordingDelegate>
 
@@ -25,6 +36,16 @@
 
 @end
 
+@interface STRCaptureDataCollector () {
+    // Segmented recording support
+    NSUInteger segmentIndex;
+    CFTimeInterval segmentStartTime;
+    BOOL stopRequested;
+    BOOL countedAsUnsegmented;
+}
+
+@end
+
 @interface STRCaptureDataCollector (InternalMethods)
 
 -(void)configureCamera;
@@ -37,6 +58,8 @@
 
 // Utility Methods
 -(NSURL *)videoTempFileURL;
+-(NSURL *)videoTempFileURLForSegmentAtIndex:(NSUInteger)index;
+-(void)startRecordingSegment;
 -(NSString *)imageTempFilePath;
 -(AVCaptureConnection *)videoConnection;
 +(AVCaptureConnection *)connectionWithMediaType:(NSString *)mediaType fromConnections:(NSArray *)connections;
@@ -55,6 +78,12 @@
     return self;
 }
 
+#pragma mark - Recording State
+
++(BOOL)isRecordingUnsegmentedVideo {
+    return _unsegmentedRecordings > 0;
+}
+
 #pragma mark - Setting Capture options
 
 -(void)setCaptureQuality:(NSString *)captureSessionQualityPreset {
@@ -66,6 +95,15 @@
 -(void)startCapturingVideoWithOrientation:(AVCaptureVideoOrientation)deviceOrientation {
     // Set the video orientation
     [[self videoConnection] setVideoOrientation:deviceOrientation];
+    stopRequested = NO;
+    segmentIndex = 0;
+    if (self.segmentDuration > 0) {
+        // The output stops itself at the end of each segment
+        [self movieFileOutput].maxRecordedDuration = CMTimeMakeWithSeconds(self.segmentDuration, 600);
+        [self startRecordingSegment];
+        return;
+    }
+    [self movieFileOutput].maxRecordedDuration = kCMTimeInvalid;
     // Remove the old temp file
     [[NSFileManager defaultManager] removeItemAtURL:[self videoTempFileURL] error:nil];
     // Start recording to the movie file output
@@ -73,6 +111,7 @@
 }
 
 -(void)stopCapturingVideo {
+    stopRequested = YES;
     [[self movieFileOutput] stopRecording];
 }
 
@@ -187,6 +226,17 @@
     return outputURL;
 }
 
+-(NSURL *)videoTempFileURLForSegmentAtIndex:(NSUInteger)index {
+    NSString * fileName = [NSString stringWithFormat:@"output-segment%lu.mov", (unsigned long)index];
+    return [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+}
+
+-(void)startRecordingSegment {
+    NSURL * segmentURL = [self videoTempFileURLForSegmentAtIndex:segmentIndex];
+    [[NSFileManager defaultManager] removeItemAtURL:segmentURL error:nil];
+    [[self movieFileOutput] startRecordingToOutputFileURL:segmentURL recordingDelegate:self];
+}
+
 -(NSString *)imageTempFilePath {
     NSString * outputPath = [[NSString alloc] initWithFormat:@"%@%@", NSTemporaryDirectory(), @"output.jpg"];
     NSFileManager * fileManager = [NSFileManager defaultManager];
@@ -218,14 +268,46 @@
 @implementation STRCaptureDataCollector (AVCaptureFileOutputRecordingDelegate)
 
 -(void)captureOutput:(AVCaptureFileOutput *)captureOutput didFinishRecordingToOutputFileAtURL:(NSURL *)outputFileURL fromConnections:(NSArray *)connections error:(NSError *)error {
+    if (self.segmentDuration > 0) {
+        // Reaching the segment length ends the file with an error, but the file is complete
+        BOOL finished = (!error || [[error.userInfo objectForKey:AVErrorRecordingSuccessfullyFinishedKey] boolValue]);
+        if (finished) {
+            NSTimeInterval duration = CMTimeGetSeconds([[AVURLAsset URLAssetWithURL:outputFileURL options:nil] duration]);
+            if ([_delegate respondsToSelector:@selector(videoRecordingDidFinishSegmentAtURL:startTime:duration:)]) {
+                [_delegate videoRecordingDidFinishSegmentAtURL:outputFileURL startTime:segmentStartTime duration:duration];
+            }
+            if (error.code == AVErrorMaximumDurationReached && !stopRequested) {
+                segmentIndex++;
+                [self startRecordingSegment];
+                return;
+            }
+            error = nil;
+        }
+    }
+    if (countedAsUnsegmented) {
+        countedAsUnsegmented = NO;
+        OSAtomicDecrement32Barrier(&_unsegmentedRecordings);
+    }
+    [[NSNotificationCenter defaultCenter] postNotificationName:STRCaptureRecordingDidEndNotification object:self];
     if (error) {
-        NSLog(@"STRCaptureDataCollector: An error occurred while ending the video recording: %@", error);
+        STRLogError(STRLogCategoryCapture, @"STRCaptureDataCollector: An error occurred while ending the video recording: %@", error);
+        // The segments closed before the error are complete, and the delegate still has to finish them
+        [_delegate videoRecordingDidFailWithError:error];
     } else {
         [_delegate videoRecordingDidEnd];
     }
 }
 
 -(void)captureOutput:(AVCaptureFileOutput *)captureOutput didStartRecordingToOutputFileAtURL:(NSURL *)fileURL fromConnections:(NSArray *)connections {
+    segmentStartTime = CACurrentMediaTime();
+    // Later segments continue the same recording
+    if (segmentIndex > 0) return;
+    if (self.segmentDuration <= 0) {
+        countedAsUnsegmented = YES;
+        OSAtomicIncrement32Barrier(&_unsegmentedRecordings);
+    }
+    NSDictionary * userInfo = @{ STRCaptureRecordingSegmentedKey : @(self.segmentDuration > 0) };
+    [[NSNotificationCenter defaultCenter] postNotificationName:STRCaptureRecordingDidBeginNotification object:self userInfo:userInfo];
     [_delegate videoRecordingDidBegin];
 }
 
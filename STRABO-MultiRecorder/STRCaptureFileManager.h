@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 
 #import "STRCapture.h"
+#import "STRCaptureChangeFeed.h"
 
 // Tools
 #import "NSDate+Date_Utilities.h"
@@ -29,6 +30,16 @@ STRCaptureAttribute * const STRCaptureAttributeHeading;
 STRCaptureAttribute * const STRCaptureAttributeDate;
 STRCaptureAttribute * const STRCaptureAttributeTitle;
 
+/**
+ STRCaptureSortOrder
+ 
+ The order in which capturesWithPageSize:afterCursor:sortOrder:filter:nextCursor: returns captures.
+ */
+typedef enum {
+    STRCaptureSortOrderNewestFirst, // Most recent capture first
+    STRCaptureSortOrderOldestFirst  // Oldest capture first
+} STRCaptureSortOrder;
+
 /**
  You should use an STRCaptureFileManager to access files stored on the device. This class provides methods for deleting, searching, and manipulating Strabo captures.
  
@@ -45,10 +56,21 @@ STRCaptureAttribute * const STRCaptureAttributeTitle;
 /**
  Creates an instance of a STRCaptureFileManager.
  
+ The first call after launch also starts summarizing, in the background, the tracks of captures saved before [STRCapture trackSummary] was kept. See [STRTrackSummary backfillCapturesOfResolver:].
+ 
  @return STRCaptureFileManager A capture file manager set up with default filemanagers, etc.
  */
 +(STRCaptureFileManager *)defaultManager;
 
+/**
+ Creates a capture file manager for the captures managed by a given resolver.
+
+ Unlike defaultManager, this does not start the layout migration or the track summary backfill. Use it to work with a captures directory other than the SDK's, such as in tests.
+
+ @param resolver The resolver for the captures directory.
+ */
+-(id)initWithPathResolver:(STRCapturePathResolver *)resolver;
+
 ///---------------------------------------------------------------------------------------
 /// @name Creating Captures
 ///---------------------------------------------------------------------------------------
@@ -147,6 +169,61 @@ STRCaptureAttribute * const STRCaptureAttributeTitle;
  */
 -(NSNumber *)localCaptureCount;
 
+///---------------------------------------------------------------------------------------
+/// @name Paging Through Local Captures
+///---------------------------------------------------------------------------------------
+
+/**
+ Returns one page of local captures, in date order.
+ 
+ Captures are read from disk one at a time, and reading stops as soon as the page is full, so asking for the first 20 captures costs about the same with a hundred captures on the device as with a hundred thousand. To get the next page, pass the cursor returned through `nextCursor` back in as `cursor`. Captures created or deleted between two calls do not cause other captures to be skipped or repeated.
+ 
+ Captures recorded by earlier versions of the SDK, whose tokens carry no date, are the exception: their info files are read on every call to place them in the order.
+ 
+    NSString * cursor = nil;
+    do {
+        NSArray * page = [fileManager capturesWithPageSize:20 afterCursor:cursor sortOrder:STRCaptureSortOrderNewestFirst filter:nil nextCursor:&cursor];
+        // Show the page
+    } while (cursor);
+ 
+ @param pageSize The largest number of captures to return.
+ 
+ @param cursor A cursor returned by an earlier call, or nil to start from the first capture.
+ 
+ @param sortOrder Whether the newest or the oldest captures come first. Use the same order for every page.
+ 
+ @param filter Called with each capture that is read. Return NO to leave the capture out of the page. Pass nil to include every capture.
+ 
+ @param nextCursor On return, the cursor for the following page, or nil if there are no more captures. May be NULL.
+ 
+ @return NSArray Up to pageSize STRCapture objects. Returns nil if the cursor is not valid.
+ */
+-(NSArray *)capturesWithPageSize:(NSUInteger)pageSize afterCursor:(NSString *)cursor sortOrder:(STRCaptureSortOrder)sortOrder filter:(BOOL (^)(STRCapture * capture))filter nextCursor:(NSString **)nextCursor;
+
+///---------------------------------------------------------------------------------------
+/// @name Following Changes
+///---------------------------------------------------------------------------------------
+
+/**
+ The sequence number of the last change to the captures on the device.
+
+ Read it right after reading the captures, and pass it to changesSinceSequenceNumber: later to learn what changed in between. Changes are also posted as they happen with STRCaptureStoreDidChangeNotification. See [STRCaptureChangeFeed] for more.
+
+ @return unsigned long long The sequence number.
+ */
+-(unsigned long long)currentChangeSequenceNumber;
+
+/**
+ Returns the captures that were added, updated or deleted since a sequence number, each once.
+
+ Only the changed captures need to be read again, so catching up costs the same with a hundred captures on the device as with a hundred thousand.
+
+ @param sequenceNumber A sequence number from currentChangeSequenceNumber or from STRCaptureStoreDidChangeNotification.
+
+ @return NSArray An array of STRCaptureChange objects. Nil if the changes are no longer known, in which case read every capture again.
+ */
+-(NSArray *)changesSinceSequenceNumber:(unsigned long long)sequenceNumber;
+
 ///---------------------------------------------------------------------------------------
 /// @name Deleting Captures
 ///---------------------------------------------------------------------------------------
@@ -7,7 +7,11 @@
 //
 
 #import "STRCaptureFileManager.h"
-#import "STRSettings.h"
+#import "STRCaptureLockTable.h"
+#import "STRCapturePathResolver.h"
+#import "STRCaptureToken.h"
+#import "STRTrackSummary.h"
+#import "STRLogger.h"
 
 STRCaptureAttribute * const STRCaptureAttributeLatitude = @"kSTRCaptureAttributeLatitude";
 STRCaptureAttribute * const STRCaptureAttributeLongitude = @"STRCaptureAttributeLongitude";
@@ -15,12 +19,13 @@ STRCaptureAttribute * const STRCaptureAttributeHeading = @"STRCaptureAttributeHe
 STRCaptureAttribute * const STRCaptureAttributeDate = @"STRCaptureAttributeDate";
 STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitle";
 
+// A cursor is the creation time in milliseconds, as 12 hex digits, followed by the token
+#define kSTRCursorTimeLength 12
+
 @interface STRCaptureFileManager () {
-    BOOL _advancedLogging;
+    STRCapturePathResolver * _pathResolver;
 }
 
-@property()BOOL advancedLogging;
-
 // Make the fileManager read/write
 @property(readwrite)NSFileManager * fileManager;
 
@@ -28,15 +33,18 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
 
 @interface STRCaptureFileManager (InternalMethods)
 
-// -- Filepath Utilities -- //
+// -- Listing Utilities -- //
+-(NSArray *)captureDirectoriesSortedByDate;
+-(NSDate *)creationDateOfCaptureDirectory:(NSString *)directory;
 
--(NSString *)capturesDirectoryPath;
+// -- Paging Utilities -- //
+-(BOOL)enumerateCaptureDirectoriesAfterCursor:(NSString *)cursor oldestFirst:(BOOL)oldestFirst usingBlock:(void (^)(NSString * relativeDirectory, NSString * directoryCursor, BOOL * stop))block;
+-(NSString *)cursorForCaptureDirectory:(NSString *)directory;
+-(BOOL)isValidCursor:(NSString *)cursor;
 
 // -- Capture Creation Utilities -- //
--(NSString *)randomFileName;
 -(UIImage *)thumbnailForImageAtPath:(NSString *)imagePath;
 +(CGImageRef)CGImage:(CGImageRef)imgRef rotatedByAngle:(CGFloat)angle;
-+(NSString *)randomStringWithLength:(int)len;
 
 @end
 
@@ -52,19 +60,47 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
     // Set the locally shared file manager
     newCaptureManager.fileManager = [NSFileManager defaultManager];
     
-    // Get options from settings
-    newCaptureManager.advancedLogging = [[STRSettings sharedSettings] advancedLogging];
+    // Move any captures left in the flat layout into their shards
+    [[STRCapturePathResolver sharedResolver] beginMigrationIfNeeded];
+    
+    // Summarize the tracks of captures saved before summaries were kept, once per launch
+    static dispatch_once_t backfillToken;
+    dispatch_once(&backfillToken, ^{
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+            [STRTrackSummary backfillCapturesOfResolver:[STRCapturePathResolver sharedResolver]];
+        });
+    });
     
     return newCaptureManager;
 }
 
+#pragma mark - Instance Methods
+
+- (id)init
+{
+    return [self initWithPathResolver:[STRCapturePathResolver sharedResolver]];
+}
+
+- (id)initWithPathResolver:(STRCapturePathResolver *)resolver
+{
+    self = [super init];
+    if (self) {
+        _fileManager = [NSFileManager defaultManager];
+        _pathResolver = resolver;
+    }
+    return self;
+}
+
 #pragma mark - Creating Captures
 
 -(STRCapture *)newCaptureWithImageAtPath:(NSString *)mediaPath attributes:(NSDictionary *)attributes {
     
     // Do some initial setup
-    NSString * randomFilename = [self randomFileName];
-    NSString * newDirectoryPath = [[self capturesDirectoryPath] stringByAppendingPathComponent:randomFilename];
+    // Imported images are named after their creation date, so that they sort among the other captures
+    NSDate * ATTRdate = [attributes objectForKey:STRCaptureAttributeDate];
+    NSString * randomFilename = (ATTRdate) ? [STRCaptureToken generateTokenWithDate:ATTRdate] : [STRCaptureToken generateToken];
+    STRCapturePathResolver * resolver = _pathResolver;
+    NSString * newDirectoryPath = [resolver absolutePathForRelativePath:[resolver relativeDirectoryForToken:randomFilename]];
 
     // New paths
     NSString * mediaNewPath = [newDirectoryPath stringByAppendingPathComponent:[randomFilename stringByAppendingPathExtension:@"jpg"]];
@@ -72,16 +108,17 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
     NSString * thumbnailPath = [newDirectoryPath stringByAppendingPathComponent:[randomFilename stringByAppendingPathExtension:@"png"]];
     NSString * captureInfoPath = [newDirectoryPath stringByAppendingPathComponent:@"capture-info.json"];
     
-    // Create new text files
-    [_fileManager createFileAtPath:geoDataNewPath contents:nil attributes:nil];
-    [_fileManager createFileAtPath:captureInfoPath contents:nil attributes:nil];
-    
     // Error handling -> Check for the existance of the passed media file
-    if ([_fileManager fileExistsAtPath:mediaPath isDirectory:NO]) {
-        if (_advancedLogging) NSLog(@"STRCaptureFileManager: Error processing the media file: it appears that the path is invalid.");
+    if (![_fileManager fileExistsAtPath:mediaPath]) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureFileManager: Error processing the media file: it appears that the path is invalid.");
         return nil;
     }
     
+    // Create the capture directory and new text files
+    // The capture info file is written last, so listings never find a capture whose other files are missing
+    [_fileManager createDirectoryAtPath:newDirectoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+    [_fileManager createFileAtPath:geoDataNewPath contents:nil attributes:nil];
+    
     // Generate and write the thumbnail
     [UIImagePNGRepresentation([self thumbnailForImageAtPath:mediaPath]) writeToFile:thumbnailPath atomically:YES];
     
@@ -89,7 +126,7 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
     NSError * error1;
     [_fileManager copyItemAtPath:mediaPath toPath:mediaNewPath error:&error1];
     if (error1) {
-        if (_advancedLogging) NSLog(@"STRCaptureFileManager: Error copying the media file: %@", error1.localizedDescription);
+        STRLogError(STRLogCategoryStorage, @"STRCaptureFileManager: Error copying the media file: %@", error1.localizedDescription);
         return nil;
     }
     
@@ -107,7 +144,7 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
     // Error handling -> Check for the existance of the required attributes
     if (![attributes objectForKey:STRCaptureAttributeLatitude] ||
         ![attributes objectForKey:STRCaptureAttributeLongitude]) {
-        if (_advancedLogging) NSLog(@"STRCaptureFileManager: Error finding required attributes when generating new capture file.");
+        STRLogError(STRLogCategoryStorage, @"STRCaptureFileManager: Error finding required attributes when generating new capture file.");
         return nil;
     }
     
@@ -115,10 +152,13 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
     NSNumber * ATTRlatitude = [attributes objectForKey:STRCaptureAttributeLatitude];
     NSNumber * ATTRlongitude = [attributes objectForKey:STRCaptureAttributeLongitude];
     NSNumber * ATTRheading = ([attributes objectForKey:STRCaptureAttributeHeading]) ? [attributes objectForKey:STRCaptureAttributeHeading] : @(0.0);
-    NSDate * ATTRdate = ([attributes objectForKey:STRCaptureAttributeDate]) ? [attributes objectForKey:STRCaptureAttributeDate] : [NSDate date];
+    if (!ATTRdate) ATTRdate = [STRCaptureToken creationDateForToken:randomFilename];
     NSString * ATTRTitle = ([attributes objectForKey:STRCaptureAttributeTitle]) ? [attributes objectForKey:STRCaptureAttributeTitle] : @"Untitled Track";
     
-    // Save the capture info file
+    // The track is the single point written below
+    STRTrackSample point = { ATTRlatitude.doubleValue, ATTRlongitude.doubleValue, ATTRheading.doubleValue, 15.0, 0.0 };
+    
+    // The capture info file, saved below
     NSDictionary * trackInfo = @{
     @"created_at" : @( [ATTRdate timeIntervalSince1970] ),
     @"geodata_file" : [relativePath stringByAppendingPathExtension:@"json"],
@@ -130,20 +170,9 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
     @"title" : ATTRTitle,
     @"token" : randomFilename,
     @"media_type" : @"image",
+    @"track_summary" : [[STRTrackSummary summaryOfSamples:&point count:1] dictionaryRepresentation],
     @"uploaded_at" : @0
     };
-    NSOutputStream * output1 = [NSOutputStream outputStreamToFileAtPath:captureInfoPath append:NO];
-    [output1 open];
-    NSError * error2;
-    [NSJSONSerialization writeJSONObject:trackInfo toStream:output1 options:0 error:&error2];
-    [output1 close];
-    
-    // Error handling -> Check for an error writing the JSON object to the file
-    if (error2) {
-        if (_advancedLogging) NSLog(@"STRCaptureFileManager: Error writing the info file for the new capture: %@", error2.localizedDescription);
-        return nil;
-    }
-    
     // Save the geodata file
     NSDictionary * geodata = @{ @"points" : @[ @{
     @"timestamp" : @0,
@@ -159,74 +188,69 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
     
     // Error handling -> Check for an error writing the JSON object to the file
     if (error3) {
-        if (_advancedLogging) NSLog(@"STRCaptureFileManager: Error writing the geodata file for the new capture: %@", error3.localizedDescription);
+        STRLogError(STRLogCategoryStorage, @"STRCaptureFileManager: Error writing the geodata file for the new capture: %@", error3.localizedDescription);
+        return nil;
+    }
+    
+    // Save the capture info file. It is renamed into place whole, so readers that
+    // do not take the capture lock never see part of it.
+    NSError * error2;
+    NSData * trackInfoData = [NSJSONSerialization dataWithJSONObject:trackInfo options:0 error:&error2];
+    if (!trackInfoData || ![trackInfoData writeToFile:captureInfoPath options:NSDataWritingAtomic error:&error2]) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureFileManager: Error writing the info file for the new capture: %@", error2.localizedDescription);
         return nil;
     }
     
     // Everything appears to be successful! Capture has been saved locally.
     // Return a new STRCapture object with the newly created files
     NSString * newToken = randomFilename;
+    [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeAdded token:newToken fields:nil];
     return [STRCapture captureWithToken:newToken];
 }
 
 #pragma mark - Getting Local Captures
 
 -(NSArray *)allCapturesSorted:(BOOL)sorted {
-    // Get all local directories
-    NSError * error;
-    NSArray * localDirectories = [self.fileManager contentsOfDirectoryAtPath:self.capturesDirectoryPath error:&error];
-    if (error) {
-        return nil;
-    }
+    // Get all local directories, in date order if necessary
+    NSArray * localDirectories = (sorted) ? [self captureDirectoriesSortedByDate] : [_pathResolver allCaptureDirectories];
     
     // Build an array of STRCapture objects
     NSMutableArray * captures = [NSMutableArray arrayWithCapacity:localDirectories.count];
     for (NSString * subDirectory in localDirectories) {
-        [captures addObject:[STRCapture captureFromFilesAtDirectory:subDirectory]];
-    }
-    
-    // Sort the array if necessary
-    if (sorted) {
-        [captures sortUsingComparator:^NSComparisonResult(id a, id b) {
-            NSDate *first = [(STRCapture *)a creationDate];
-            NSDate *second = [(STRCapture *)b creationDate];
-            return [second compare:first];
-        }];
+        STRCapture * capture = [STRCapture captureFromFilesAtDirectory:subDirectory pathResolver:_pathResolver];
+        if (capture) [captures addObject:capture];
     }
     
     return [NSArray arrayWithArray:captures];
 }
 
 -(NSArray *)recentCapturesWithLimit:(NSNumber *)limit {
-    // Get all local directories
-    NSArray * sortedCaptures = [self allCapturesSorted:YES];
-    
-    if (@(sortedCaptures.count).doubleValue > limit.doubleValue) {
-        NSRange theRange;
-        theRange.location = 0;
-        theRange.length = limit.integerValue;
-        NSArray * subArray = [sortedCaptures subarrayWithRange:theRange];
-        return subArray;
-    }
-    
-    return sortedCaptures;
+    // Only the captures that are returned are read from disk
+    return [self capturesWithPageSize:limit.unsignedIntegerValue afterCursor:nil sortOrder:STRCaptureSortOrderNewestFirst filter:nil nextCursor:NULL];
 }
 
 -(NSArray *)capturesOnDate:(NSDate *)date sorted:(BOOL)sorted {
-    // Get all local directories
-    NSError * error;
-    NSArray * localDirectories = [self.fileManager contentsOfDirectoryAtPath:self.capturesDirectoryPath error:&error];
-    if (error) {
-        return nil;
-    }
+    // Time-ordered captures are only listed from the shards that cover the day
+    NSDate * startOfDay;
+    NSTimeInterval lengthOfDay;
+    [[NSCalendar currentCalendar] rangeOfUnit:NSDayCalendarUnit startDate:&startOfDay interval:&lengthOfDay forDate:date];
+    STRCapturePathResolver * resolver = _pathResolver;
+    NSMutableArray * localDirectories = [NSMutableArray arrayWithArray:[resolver legacyCaptureDirectories]];
+    [resolver enumerateTimeOrderedCaptureDirectoriesFromDate:startOfDay toDate:[startOfDay dateByAddingTimeInterval:lengthOfDay] usingBlock:^(NSString * relativeDirectory, BOOL * stop) {
+        [localDirectories addObject:relativeDirectory];
+    }];
     
     // Build an array of STRCapture objects
     // only including those with the right date
     NSMutableArray * captures = [[NSMutableArray alloc] init];
     for (NSString * subDirectory in localDirectories) {
-        STRCapture * capture = [STRCapture captureFromFilesAtDirectory:subDirectory];
-        if ([capture.creationDate isSameDayAsDate:date]) {
-            NSLog(@"Adding object to the array");
+        // Time-ordered tokens carry their date, so captures from other days are never opened
+        NSDate * tokenDate = [STRCaptureToken creationDateForToken:[subDirectory lastPathComponent]];
+        if (tokenDate && ![tokenDate isSameDayAsDate:date]) continue;
+        
+        STRCapture * capture = [STRCapture captureFromFilesAtDirectory:subDirectory pathResolver:_pathResolver];
+        if (capture && [capture.creationDate isSameDayAsDate:date]) {
+            STRLogTrace(STRLogCategoryStorage, @"STRCaptureFileManager: Capture %@ matches the date.", capture.token);
             [captures addObject:capture];
         }
     }
@@ -244,37 +268,79 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
 }
 
 -(NSNumber *)localCaptureCount {
-    NSError * error;
-    NSArray * localDirectories = [self.fileManager contentsOfDirectoryAtPath:self.capturesDirectoryPath error:&error];
-    if (error) {
+    return @([[_pathResolver allCaptureDirectories] count]);
+}
+
+#pragma mark - Paging Through Local Captures
+
+-(NSArray *)capturesWithPageSize:(NSUInteger)pageSize afterCursor:(NSString *)cursor sortOrder:(STRCaptureSortOrder)sortOrder filter:(BOOL (^)(STRCapture * capture))filter nextCursor:(NSString **)nextCursor {
+    if (nextCursor) *nextCursor = nil;
+    if (cursor && ![self isValidCursor:cursor]) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureFileManager: The cursor %@ is not valid.", cursor);
         return nil;
     }
-    return @(localDirectories.count);
+    NSMutableArray * captures = [NSMutableArray arrayWithCapacity:pageSize];
+    if (pageSize == 0) {
+        if (nextCursor) *nextCursor = cursor;
+        return captures;
+    }
+    
+    __block NSString * lastCursor = nil;
+    BOOL finished = [self enumerateCaptureDirectoriesAfterCursor:cursor oldestFirst:(sortOrder == STRCaptureSortOrderOldestFirst) usingBlock:^(NSString * relativeDirectory, NSString * directoryCursor, BOOL * stop) {
+        @autoreleasepool {
+            STRCapture * capture = [STRCapture captureFromFilesAtDirectory:relativeDirectory pathResolver:_pathResolver];
+            if (capture && (!filter || filter(capture))) [captures addObject:capture];
+        }
+        lastCursor = directoryCursor;
+        *stop = (captures.count >= pageSize);
+    }];
+    
+    // The page was filled before the last capture was reached
+    if (nextCursor && !finished) *nextCursor = lastCursor;
+    return [NSArray arrayWithArray:captures];
+}
+
+#pragma mark - Following Changes
+
+-(unsigned long long)currentChangeSequenceNumber {
+    return [[STRCaptureChangeFeed sharedFeed] currentSequenceNumber];
+}
+
+-(NSArray *)changesSinceSequenceNumber:(unsigned long long)sequenceNumber {
+    return [[STRCaptureChangeFeed sharedFeed] changesSinceSequenceNumber:sequenceNumber];
 }
 
 #pragma mark - Deleting Captures
 
 -(BOOL)deleteCapture:(STRCapture *)capture {
-    NSString * capturePath = [self.capturesDirectoryPath stringByAppendingPathComponent:capture.token];
-    NSError * error;
-    [_fileManager removeItemAtPath:capturePath error:&error];
-
-    if (error) {
-        if (_advancedLogging) NSLog(@"STRCaptureFileManager: Error deleting the capture: %@", error.description);
-        return NO;
-    }
-    return YES;
+    return [self deleteCaptureWithToken:capture.token];
 }
 
 -(BOOL)deleteCaptureWithToken:(NSString *)token {
-    NSError * error;
-    NSString * capturePath = [self.capturesDirectoryPath stringByAppendingPathComponent:token];
-    [_fileManager removeItemAtPath:capturePath error:&error];
+    STRCapturePathResolver * resolver = _pathResolver;
+    __block NSError * error;
+    // Saves, uploads and the migration hold the lock of the capture while they use its files
+    [[STRCaptureLockTable sharedTable] writeCaptureWithToken:token usingBlock:^{
+        NSError * removeError;
+        NSString * relativeDirectory = [resolver relativeDirectoryOfCaptureWithToken:token];
+        if (!relativeDirectory) {
+            removeError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileNoSuchFileError userInfo:nil];
+        } else if (![_fileManager removeItemAtPath:[resolver absolutePathForRelativePath:relativeDirectory] error:&removeError]) {
+            // The migration may have moved it after it was found; look once more
+            NSString * movedDirectory = [resolver relativeDirectoryOfCaptureWithToken:token];
+            if (movedDirectory && ![movedDirectory isEqualToString:relativeDirectory]) {
+                removeError = nil;
+                [_fileManager removeItemAtPath:[resolver absolutePathForRelativePath:movedDirectory] error:&removeError];
+            }
+        }
+        error = removeError;
+    }];
     
     if (error) {
-        if (_advancedLogging) NSLog(@"STRCaptureFileManager: Error deleting the capture: %@", error.description);
+        STRLogError(STRLogCategoryStorage, @"STRCaptureFileManager: Error deleting the capture: %@", error.description);
         return NO;
     }
+    [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeDeleted token:token fields:nil];
     return YES;
 }
 
@@ -282,35 +348,122 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
 
 @implementation STRCaptureFileManager (InternalMethods)
 
-#define kSTRUniqueIdentifierKey @"kSTRUniqueIdentifierKey"
-
-#pragma mark - Filepath Utilities
+#pragma mark - Listing Utilities
+
+-(NSArray *)captureDirectoriesSortedByDate {
+    // Time-ordered tokens sort by name. Only legacy captures need their info files read.
+    STRCapturePathResolver * resolver = _pathResolver;
+    NSMutableArray * sortedTimeOrdered = [NSMutableArray array];
+    [resolver enumerateTimeOrderedCaptureDirectoriesFromDate:nil toDate:nil usingBlock:^(NSString * relativeDirectory, BOOL * stop) {
+        [sortedTimeOrdered addObject:relativeDirectory];
+    }];
+    NSArray * legacy = [resolver legacyCaptureDirectories];
+    if (legacy.count == 0) {
+        return sortedTimeOrdered;
+    }
+    
+    // Merge the legacy captures in by their recorded creation dates
+    NSMutableDictionary * dates = [NSMutableDictionary dictionaryWithCapacity:legacy.count];
+    for (NSString * directory in legacy) {
+        [dates setObject:[self creationDateOfCaptureDirectory:directory] forKey:directory];
+    }
+    NSArray * sortedLegacy = [legacy sortedArrayUsingComparator:^NSComparisonResult(id a, id b) {
+        return [[dates objectForKey:b] compare:[dates objectForKey:a]];
+    }];
+    NSMutableArray * merged = [NSMutableArray arrayWithCapacity:sortedTimeOrdered.count + sortedLegacy.count];
+    NSUInteger i = 0, j = 0;
+    while (i < sortedTimeOrdered.count || j < sortedLegacy.count) {
+        if (j == sortedLegacy.count ||
+            (i < sortedTimeOrdered.count && [[STRCaptureToken creationDateForToken:[[sortedTimeOrdered objectAtIndex:i] lastPathComponent]] compare:[dates objectForKey:[sortedLegacy objectAtIndex:j]]] != NSOrderedAscending)) {
+            [merged addObject:[sortedTimeOrdered objectAtIndex:i++]];
+        } else {
+            [merged addObject:[sortedLegacy objectAtIndex:j++]];
+        }
+    }
+    return merged;
+}
 
--(NSString *)capturesDirectoryPath {
-    return [NSHomeDirectory() stringByAppendingPathComponent:@"Documents/StraboCaptures"];
+-(NSDate *)creationDateOfCaptureDirectory:(NSString *)directory {
+    NSString * captureInfoPath = [[_pathResolver absolutePathForRelativePath:directory] stringByAppendingPathComponent:@"capture-info.json"];
+    NSData * captureInfoData = [NSData dataWithContentsOfFile:captureInfoPath];
+    NSDictionary * captureInfo = (captureInfoData) ? [NSJSONSerialization JSONObjectWithData:captureInfoData options:0 error:nil] : nil;
+    if (![captureInfo isKindOfClass:[NSDictionary class]]) {
+        // Unreadable entries sort last
+        return [NSDate distantPast];
+    }
+    return [NSDate dateWithTimeIntervalSince1970:[[captureInfo objectForKey:@"created_at"] doubleValue]];
 }
 
-#pragma mark - Capture Creation Utilities
+#pragma mark - Paging Utilities
 
--(NSString *)randomFileName {
-    // Get UUID
-    NSUserDefaults * userDefaults = [NSUserDefaults standardUserDefaults];
-    // Generate a new identifier if one does not already exist
-    if (![userDefaults objectForKey:kSTRUniqueIdentifierKey]) {
-        
-        CFUUIDRef theUUID = CFUUIDCreate(NULL);
-        CFStringRef UUIDstring = CFUUIDCreateString(NULL, theUUID);
-        CFRelease(theUUID);
-        
-        [userDefaults setObject:(__bridge_transfer NSString *)UUIDstring forKey:kSTRUniqueIdentifierKey];
-        [userDefaults synchronize];
+-(BOOL)enumerateCaptureDirectoriesAfterCursor:(NSString *)cursor oldestFirst:(BOOL)oldestFirst usingBlock:(void (^)(NSString * relativeDirectory, NSString * directoryCursor, BOOL * stop))block {
+    STRCapturePathResolver * resolver = _pathResolver;
+    // A comes before B in the requested order when [A compare:B] gives this result
+    NSComparisonResult forward = (oldestFirst) ? NSOrderedAscending : NSOrderedDescending;
+    
+    // Legacy captures have to be dated from their info files, so all of them are placed up front
+    NSMutableDictionary * legacyDirectories = [NSMutableDictionary dictionary];
+    for (NSString * directory in [resolver legacyCaptureDirectories]) {
+        NSString * directoryCursor = [self cursorForCaptureDirectory:directory];
+        if (!cursor || [cursor compare:directoryCursor] == forward) {
+            [legacyDirectories setObject:directory forKey:directoryCursor];
+        }
+    }
+    NSArray * legacyCursors = [[legacyDirectories allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    if (!oldestFirst) legacyCursors = [[legacyCursors reverseObjectEnumerator] allObjects];
+    
+    // Time-ordered captures are listed lazily, starting from the shard that holds the cursor. The
+    // date range is widened by a second so that rounding never drops the cursor's own shard.
+    NSDate * cursorDate = nil;
+    if (cursor) {
+        unsigned long long milliseconds = strtoull([[cursor substringToIndex:kSTRCursorTimeLength] UTF8String], NULL, 16);
+        cursorDate = [NSDate dateWithTimeIntervalSince1970:milliseconds / 1000.0];
+    }
+    NSDate * startDate = (oldestFirst) ? [cursorDate dateByAddingTimeInterval:-1] : nil;
+    NSDate * endDate = (oldestFirst) ? nil : [cursorDate dateByAddingTimeInterval:1];
+    
+    __block NSUInteger nextLegacy = 0;
+    __block BOOL stop = NO;
+    [resolver enumerateTimeOrderedCaptureDirectoriesFromDate:startDate toDate:endDate oldestFirst:oldestFirst usingBlock:^(NSString * relativeDirectory, BOOL * stopListing) {
+        NSString * directoryCursor = [self cursorForCaptureDirectory:relativeDirectory];
+        if (cursor && [cursor compare:directoryCursor] != forward) return;
         
+        // Merge in the legacy captures that come before this one
+        while (!stop && nextLegacy < legacyCursors.count && [[legacyCursors objectAtIndex:nextLegacy] compare:directoryCursor] == forward) {
+            NSString * legacyCursor = [legacyCursors objectAtIndex:nextLegacy++];
+            block([legacyDirectories objectForKey:legacyCursor], legacyCursor, &stop);
+        }
+        if (!stop) block(relativeDirectory, directoryCursor, &stop);
+        *stopListing = stop;
+    }];
+    while (!stop && nextLegacy < legacyCursors.count) {
+        NSString * legacyCursor = [legacyCursors objectAtIndex:nextLegacy++];
+        block([legacyDirectories objectForKey:legacyCursor], legacyCursor, &stop);
+    }
+    return !stop;
+}
+
+-(NSString *)cursorForCaptureDirectory:(NSString *)directory {
+    NSString * token = [directory lastPathComponent];
+    if ([STRCaptureToken isTimeOrderedToken:token]) {
+        // The token already starts with its creation time
+        return [[token substringToIndex:kSTRCursorTimeLength] stringByAppendingString:token];
     }
-    NSString * uniqueIdentifier = [userDefaults objectForKey:kSTRUniqueIdentifierKey];
-    NSString * fileName = [NSString stringWithFormat:@"%@-%@-%d", uniqueIdentifier, [STRCaptureFileManager randomStringWithLength:10], (int)[[NSDate date] timeIntervalSince1970]];
-    return [fileName SHA2];
+    NSTimeInterval created = [[self creationDateOfCaptureDirectory:directory] timeIntervalSince1970];
+    unsigned long long milliseconds = (created > 0) ? (unsigned long long)(created * 1000) : 0;
+    return [NSString stringWithFormat:@"%012llx%@", milliseconds, token];
+}
+
+-(BOOL)isValidCursor:(NSString *)cursor {
+    if (cursor.length <= kSTRCursorTimeLength) return NO;
+    NSCharacterSet * nonHexadecimal = [[NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdef"] invertedSet];
+    if ([[cursor substringToIndex:kSTRCursorTimeLength] rangeOfCharacterFromSet:nonHexadecimal].location != NSNotFound) return NO;
+    // Directories from older SDK versions are not always named after valid tokens, so any name is accepted
+    return [[cursor substringFromIndex:kSTRCursorTimeLength] rangeOfString:@"/"].location == NSNotFound;
 }
 
+#pragma mark - Capture Creation Utilities
+
 -(UIImage *)thumbnailForImageAtPath:(NSString *)imagePath {
     // Get a handle on the image at the path specified
     UIImage * image = [UIImage imageWithContentsOfFile:imagePath];
@@ -371,16 +524,4 @@ STRCaptureAttribute * const STRCaptureAttributeTitle = @"STRCaptureAttributeTitl
 	return rotatedImage;
 }
 
-+(NSString *)randomStringWithLength:(int)len {
-    
-    NSString *letters = @"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-    
-    NSMutableString *randomString = [NSMutableString stringWithCapacity: len];
-    
-    for (int i=0; i<len; i++) {
-        [randomString appendFormat: @"%C", [letters characterAtIndex: arc4random() % [letters length]]];
-    }
-    
-    return randomString;}
-
 @end
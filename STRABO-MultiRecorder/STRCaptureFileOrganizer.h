@@ -55,4 +55,17 @@
  */
 -(void)saveMediaToPhotoRollFromPath:(NSString *)mediaPath;
 
+/**
+ Writes a new thumbnail image for a media file.
+ 
+ STRCaptureIntegrityScanner uses this to replace the thumbnails of captures whose thumbnail files have gone missing.
+ 
+ @param mediaPath The absolute path to the media file. The media must be a MOV or a JPG file.
+ 
+ @param thumbnailPath The absolute path to write the PNG thumbnail to.
+ 
+ @return BOOL YES if the thumbnail was written.
+ */
+-(BOOL)writeThumbnailForMediaAtPath:(NSString *)mediaPath toPath:(NSString *)thumbnailPath;
+
 @end
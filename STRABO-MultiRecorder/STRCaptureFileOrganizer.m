@@ -7,19 +7,14 @@
 //
 
 #import "STRCaptureFileOrganizer.h"
-#import "STRSettings.h"
-
-@interface STRCaptureFileOrganizer () {
-    BOOL _advancedLogging;
-}
-
-@property()BOOL advancedLogging;
-
-@end
+#import "STRCaptureChangeFeed.h"
+#import "STRCapturePathResolver.h"
+#import "STRCaptureToken.h"
+#import "STRTrackSummary.h"
+#import "STRLogger.h"
 
 @interface STRCaptureFileOrganizer (InternalMethods)
 
--(NSString *)randomFileName;
 -(NSString *)capturesDirectoryPath;
 
 // -- Media Save Response Handling -- //
@@ -31,25 +26,15 @@
 -(UIImage *)thumbnailForImageAtPath:(NSString *)imagePath;
 -(UIImage *)thumbnailForVideoAtPath:(NSString *)videoPath;
 +(CGImageRef)CGImage:(CGImageRef)imgRef rotatedByAngle:(CGFloat)angle;
-+(NSString *)randomStringWithLength:(int)len;
 
 @end
 
 @implementation STRCaptureFileOrganizer
 
-- (id)init
-{
-    self = [super init];
-    if (self) {
-        _advancedLogging = [[STRSettings sharedSettings] advancedLogging];
-    }
-    return self;
-}
-
 -(void)saveTempImageFilesWithInitialLocation:(CLLocation *)location heading:(CLHeading *)heading {
     NSFileManager * fileManager = [NSFileManager defaultManager];
-    NSString * randomFilename = [self randomFileName];
-    NSString * newDirectoryPath = [[self capturesDirectoryPath] stringByAppendingPathComponent:randomFilename];
+    NSString * randomFilename = [STRCaptureToken generateToken];
+    NSString * newDirectoryPath = [[self capturesDirectoryPath] stringByAppendingPathComponent:[[STRCapturePathResolver sharedResolver] relativeDirectoryForToken:randomFilename]];
     
     // Make the new directory
     [fileManager createDirectoryAtPath:newDirectoryPath withIntermediateDirectories:YES attributes:nil error:nil];
@@ -57,12 +42,13 @@
     // Temp paths
     NSString * mediaTempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"output.jpg"];
     NSString * geoDataTempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"output.json"];
+    NSString * filteredGeoDataTempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"output-filtered.json"];
     // New paths
     NSString * mediaNewPath = [newDirectoryPath stringByAppendingPathComponent:[randomFilename stringByAppendingPathExtension:@"jpg"]];
     NSString * geoDataNewPath = [newDirectoryPath stringByAppendingPathComponent:[randomFilename stringByAppendingPathExtension:@"json"]];
+    NSString * filteredGeoDataNewPath = [newDirectoryPath stringByAppendingPathComponent:[[randomFilename stringByAppendingPathExtension:@"filtered"] stringByAppendingPathExtension:@"json"]];
     NSString * thumbnailPath = [newDirectoryPath stringByAppendingPathComponent:[randomFilename stringByAppendingPathExtension:@"png"]];
     NSString * captureInfoPath = [newDirectoryPath stringByAppendingPathComponent:@"capture-info.json"];
-    [fileManager createFileAtPath:captureInfoPath contents:nil attributes:nil];
     
     // Write the thumbnail image
     [UIImagePNGRepresentation([self thumbnailForImageAtPath:mediaTempPath]) writeToFile:thumbnailPath atomically:YES];
@@ -78,10 +64,11 @@
         orientationString = @"horizontal";
     }
     
-    // Save the capture info file
+    // The capture info file, saved once the other files are in place
     NSDictionary * trackInfo = @{
     @"created_at" : [NSDate currentUnixTimestampNumber],
     @"geodata_file" : [relativePath stringByAppendingPathExtension:@"json"],
+    @"filtered_geodata_file" : [[relativePath stringByAppendingPathExtension:@"filtered"] stringByAppendingPathExtension:@"json"],
     @"coords" : @[ @(location.coordinate.latitude), @(location.coordinate.longitude) ],
     @"heading" : @(heading.trueHeading),
     @"media_file" : [relativePath stringByAppendingPathExtension:@"jpg"],
@@ -92,13 +79,16 @@
     @"media_type" : @"image",
     @"uploaded_at" : @0
     };
-    NSOutputStream * output = [NSOutputStream outputStreamToFileAtPath:captureInfoPath append:NO];
-    [output open];
-    [NSJSONSerialization writeJSONObject:trackInfo toStream:output options:0 error:nil];
-    [output close];
-    
+    // Summarize the track now, so that lists never have to read it
+    NSDictionary * trackSummary = [[STRTrackSummary summaryOfTrackAtPath:geoDataTempPath] dictionaryRepresentation];
+    if (trackSummary) {
+        NSMutableDictionary * summarizedTrackInfo = [trackInfo mutableCopy];
+        [summarizedTrackInfo setObject:trackSummary forKey:@"track_summary"];
+        trackInfo = summarizedTrackInfo;
+    }
     // Copy the files from temp to new
     [fileManager copyItemAtPath:geoDataTempPath toPath:geoDataNewPath error:nil];
+    [fileManager copyItemAtPath:filteredGeoDataTempPath toPath:filteredGeoDataNewPath error:nil];
     
     // Image copying is screwy with orientations. Change the binary image orientation
     // and save the new resulting image to the permanent file.
@@ -115,12 +105,18 @@
     }
     UIImage * newImage = [UIImage imageWithCGImage:imgRef scale:1.0 orientation:UIImageOrientationUp];
     [UIImageJPEGRepresentation(newImage, 1.0) writeToFile:mediaNewPath atomically:YES];
+    
+    // The capture info file goes in last and is renamed into place whole, so listings,
+    // which read it without taking the capture lock, never find a capture half saved
+    [[NSJSONSerialization dataWithJSONObject:trackInfo options:0 error:nil] writeToFile:captureInfoPath atomically:YES];
+    
+    [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeAdded token:randomFilename fields:nil];
 }
 
 -(void)saveTempVideoFilesWithInitialLocation:(CLLocation *)location heading:(CLHeading *)heading {
     NSFileManager * fileManager = [NSFileManager defaultManager];
-    NSString * randomFilename = [self randomFileName];
-    NSString * newDirectoryPath = [[self capturesDirectoryPath] stringByAppendingPathComponent:randomFilename];
+    NSString * randomFilename = [STRCaptureToken generateToken];
+    NSString * newDirectoryPath = [[self capturesDirectoryPath] stringByAppendingPathComponent:[[STRCapturePathResolver sharedResolver] relativeDirectoryForToken:randomFilename]];
     
     // Make the new directory
     [fileManager createDirectoryAtPath:newDirectoryPath withIntermediateDirectories:YES attributes:nil error:nil];
@@ -128,12 +124,13 @@
     // Temp paths
     NSString * mediaTempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"output.mov"];
     NSString * geoDataTempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"output.json"];
+    NSString * filteredGeoDataTempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"output-filtered.json"];
     // New paths
     NSString * mediaNewPath = [newDirectoryPath stringByAppendingPathComponent:[randomFilename stringByAppendingPathExtension:@"mov"]];
     NSString * geoDataNewPath = [newDirectoryPath stringByAppendingPathComponent:[randomFilename stringByAppendingPathExtension:@"json"]];
+    NSString * filteredGeoDataNewPath = [newDirectoryPath stringByAppendingPathComponent:[[randomFilename stringByAppendingPathExtension:@"filtered"] stringByAppendingPathExtension:@"json"]];
     NSString * thumbnailPath = [newDirectoryPath stringByAppendingPathComponent:[randomFilename stringByAppendingPathExtension:@"png"]];
     NSString * captureInfoPath = [newDirectoryPath stringByAppendingPathComponent:@"capture-info.json"];
-    [fileManager createFileAtPath:captureInfoPath contents:nil attributes:nil];
     
     // Write the thumbnail image
     UIImage * thumbnail = [self thumbnailForVideoAtPath:mediaTempPath];
@@ -151,10 +148,11 @@
         orientationString = @"vertical";
     }
     
-    // Save the capture info file
+    // The capture info file, saved once the other files are in place
     NSDictionary * trackInfo = @{
     @"created_at" : [NSDate currentUnixTimestampNumber],
     @"geodata_file" : [relativePath stringByAppendingPathExtension:@"json"],
+    @"filtered_geodata_file" : [[relativePath stringByAppendingPathExtension:@"filtered"] stringByAppendingPathExtension:@"json"],
     @"coords" : @[ @(location.coordinate.latitude), @(location.coordinate.longitude) ],
     @"heading" : @(heading.trueHeading),
     @"media_file" : [relativePath stringByAppendingPathExtension:@"mov"],
@@ -165,14 +163,23 @@
     @"media_type" : @"video",
     @"uploaded_at" : @0
     };
-    NSOutputStream * output = [NSOutputStream outputStreamToFileAtPath:captureInfoPath append:NO];
-    [output open];
-    [NSJSONSerialization writeJSONObject:trackInfo toStream:output options:0 error:nil];
-    [output close];
-    
+    // Summarize the track now, so that lists never have to read it
+    NSDictionary * trackSummary = [[STRTrackSummary summaryOfTrackAtPath:geoDataTempPath] dictionaryRepresentation];
+    if (trackSummary) {
+        NSMutableDictionary * summarizedTrackInfo = [trackInfo mutableCopy];
+        [summarizedTrackInfo setObject:trackSummary forKey:@"track_summary"];
+        trackInfo = summarizedTrackInfo;
+    }
     // Copy the files from temp to new
     [fileManager copyItemAtPath:mediaTempPath toPath:mediaNewPath error:nil];
     [fileManager copyItemAtPath:geoDataTempPath toPath:geoDataNewPath error:nil];
+    [fileManager copyItemAtPath:filteredGeoDataTempPath toPath:filteredGeoDataNewPath error:nil];
+    
+    // The capture info file goes in last and is renamed into place whole, so listings,
+    // which read it without taking the capture lock, never find a capture half saved
+    [[NSJSONSerialization dataWithJSONObject:trackInfo options:0 error:nil] writeToFile:captureInfoPath atomically:YES];
+    
+    [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeAdded token:randomFilename fields:nil];
 }
 
 -(void)saveMediaToPhotoRollFromPath:(NSString *)mediaPath {
@@ -186,14 +193,29 @@
         if (UIVideoAtPathIsCompatibleWithSavedPhotosAlbum(mediaPath)) {
             UISaveVideoAtPathToSavedPhotosAlbum(mediaPath, self, @selector(video:didFinishSavingWithError:contextInfo:), nil);
         } else {
-            if (_advancedLogging) NSLog(@"STRCaptureFileOrganizer: Error saving media to photo roll: video is incompatible.");
+            STRLogError(STRLogCategoryCapture, @"STRCaptureFileOrganizer: Error saving media to photo roll: video is incompatible.");
         }
     } else if ([fileExtension isEqualToString:@"jpg"]) { // Media is image
         UIImage * image = [UIImage imageWithContentsOfFile:mediaPath];
         UIImageWriteToSavedPhotosAlbum(image, self, @selector(image:didFinishSavingWithError:contextInfo:), nil);
     } else {
-        if (_advancedLogging) NSLog(@"STRCaptureFileOrganizer: Error saving media to photo roll: invalid file extension found.");
+        STRLogError(STRLogCategoryCapture, @"STRCaptureFileOrganizer: Error saving media to photo roll: invalid file extension found.");
+    }
+}
+
+-(BOOL)writeThumbnailForMediaAtPath:(NSString *)mediaPath toPath:(NSString *)thumbnailPath {
+    UIImage * thumbnail = nil;
+    if ([[mediaPath pathExtension] isEqualToString:@"mov"]) {
+        thumbnail = [self thumbnailForVideoAtPath:mediaPath];
+    } else if ([[mediaPath pathExtension] isEqualToString:@"jpg"]) {
+        thumbnail = [self thumbnailForImageAtPath:mediaPath];
+    }
+    NSData * thumbnailData = (thumbnail) ? UIImagePNGRepresentation(thumbnail) : nil;
+    if (!thumbnailData) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureFileOrganizer: Could not generate a thumbnail for %@.", [mediaPath lastPathComponent]);
+        return NO;
     }
+    return [thumbnailData writeToFile:thumbnailPath atomically:YES];
 }
 
 @end
@@ -202,31 +224,9 @@
 
 #pragma mark - Utility Methods
 
-#define kSTRUniqueIdentifierKey @"kSTRUniqueIdentifierKey"
-
--(NSString *)randomFileName {
-    
-    // Get UUID
-    NSUserDefaults * userDefaults = [NSUserDefaults standardUserDefaults];
-    // Generate a new identifier if one does not already exist
-    if (![userDefaults objectForKey:kSTRUniqueIdentifierKey]) {
-        
-        CFUUIDRef theUUID = CFUUIDCreate(NULL);
-        CFStringRef UUIDstring = CFUUIDCreateString(NULL, theUUID);
-        CFRelease(theUUID);
-        
-        [userDefaults setObject:(__bridge_transfer NSString *)UUIDstring forKey:kSTRUniqueIdentifierKey];
-        [userDefaults synchronize];
-        
-    }
-    NSString * uniqueIdentifier = [userDefaults objectForKey:kSTRUniqueIdentifierKey];
-    NSString * fileName = [NSString stringWithFormat:@"%@-%@-%d", uniqueIdentifier, [STRCaptureFileOrganizer randomStringWithLength:10], (int)[[NSDate date] timeIntervalSince1970]];
-    return [fileName SHA2];
-}
-
 -(NSString *)capturesDirectoryPath {
     
-    NSString * docPath = [NSHomeDirectory() stringByAppendingPathComponent:@"Documents/StraboCaptures"];
+    NSString * docPath = [[STRCapturePathResolver sharedResolver] capturesDirectoryPath];
     
     if (![[NSFileManager defaultManager] fileExistsAtPath:docPath isDirectory:nil]) {
         [[NSFileManager defaultManager] createDirectoryAtPath:docPath withIntermediateDirectories:YES attributes:nil error:nil];
@@ -239,24 +239,18 @@
 #pragma mark - Response Handling
 
 -(void)image:(UIImage *)image didFinishSavingWithError:(NSError *)error contextInfo:(void *)contextInfo {
-    if (_advancedLogging) {
-        if (error) {
-            NSLog(@"STRCaptureFileOrganizer: Photo library saving returned with an error: %@", error);
-        } else {
-            NSLog(@"STRCaptureFileOrganizer: Photo library saving generated a successful response");
-            
-        }
+    if (error) {
+        STRLogError(STRLogCategoryCapture, @"STRCaptureFileOrganizer: Photo library saving returned with an error: %@", error);
+    } else {
+        STRLogDebug(STRLogCategoryCapture, @"STRCaptureFileOrganizer: Photo library saving generated a successful response");
     }
 }
 
 -(void)video:(NSString *)videoPath didFinishSavingWithError:(NSError *)error contextInfo:(void *)contextInfo {
-    if (_advancedLogging) {
-        if (error) {
-            NSLog(@"STRCaptureFileOrganizer: Photo library saving returned with an error: %@", error);
-        } else {
-            NSLog(@"STRCaptureFileOrganizer: Photo library saving generated a successful response");
-            
-        }
+    if (error) {
+        STRLogError(STRLogCategoryCapture, @"STRCaptureFileOrganizer: Photo library saving returned with an error: %@", error);
+    } else {
+        STRLogDebug(STRLogCategoryCapture, @"STRCaptureFileOrganizer: Photo library saving generated a successful response");
     }
 }
 
@@ -319,7 +313,7 @@
     CMTime time = CMTimeMakeWithSeconds(0,30);
     CGImageRef imgRef = [generator copyCGImageAtTime:time actualTime:NULL error:&error];
     if (error) {
-        NSLog(@"STRCaptureFileOrganizer: Error generating video thumbnail: %@", error);
+        STRLogError(STRLogCategoryCapture, @"STRCaptureFileOrganizer: Error generating video thumbnail: %@", error);
     }
     
     // Rotate the image if necessary
@@ -335,7 +329,7 @@
         // No rotation necessary
         rotatedImgRef = [STRCaptureFileOrganizer CGImage:imgRef rotatedByAngle:0];
     } else {
-        NSLog(@"STRCaptureFileOrganizer: Video file orientation not recognized.");
+        STRLogWarning(STRLogCategoryCapture, @"STRCaptureFileOrganizer: Video file orientation not recognized.");
     }
     CGImageRelease(imgRef);
     
@@ -377,17 +371,4 @@
     return rotatedImage;
 }
 
-+(NSString *)randomStringWithLength:(int)len {
-    
-    NSString *letters = @"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-    
-    NSMutableString *randomString = [NSMutableString stringWithCapacity: len];
-    
-    for (int i=0; i<len; i++) {
-        [randomString appendFormat: @"%C", [letters characterAtIndex: arc4random() % [letters length]]];
-    }
-    
-    return randomString;
-}
-
 @end
@@ -0,0 +1,113 @@
+//
+//  STRCaptureFileParser.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "STRTrackFilter.h"
+#import "STRTrackSummary.h"
+
+/**
+ STRParsedString
+
+ A string value found by a STRCaptureFileParser, given as its place in the file that was parsed. Use [STRCaptureFileParser stringForField:] to get the NSString.
+ */
+typedef struct {
+    NSUInteger offset;  // Bytes from the start of the file to the first character after the opening quote
+    NSUInteger length;  // Bytes up to the closing quote
+    BOOL escaped;       // The value contains backslash escapes
+    BOOL present;       // The key was found with a string value
+} STRParsedString;
+
+/**
+ STRCaptureInfoFields
+
+ The values of a capture info file. Numbers that are missing are 0, except for the heading, which is NAN. The track summary is only set when hasTrackSummary is YES.
+ */
+typedef struct {
+    double createdAt;
+    double uploadedAt;
+    double latitude;
+    double longitude;
+    double heading;
+    STRParsedString title;
+    STRParsedString token;
+    STRParsedString mediaType;
+    STRParsedString geoDataFile;
+    STRParsedString filteredGeoDataFile;
+    STRParsedString mediaFile;
+    STRParsedString thumbnailFile;
+    BOOL hasTrackSummary;
+    STRTrackSummaryValues trackSummary;
+} STRCaptureInfoFields;
+
+/**
+ Reads capture info and geodata files without building a tree of Foundation objects.
+
+ NSJSONSerialization turns every key and value of a file into an object, only for STRCapture to pull a dozen fields or a list of points back out. This parser knows the two schemas that the SDK writes. It scans the bytes of a file once, writes numbers straight into C fields and arrays, and only records where each string is, so a string costs nothing unless it is asked for.
+
+ Small files are read into a buffer that the parser keeps between files. Files larger than 64 KB, such as the geodata files of long videos, are memory-mapped instead of copied. Strings are found by checking eight bytes at a time for a quote, a backslash or a control character.
+
+ The parser only accepts what NSJSONSerialization accepts, with the types the SDK writes. When a file is damaged, uses unexpected types, or has numbers that the fast path cannot convert exactly, the parse methods return NO and the caller should fall back to NSJSONSerialization. Extra keys are skipped.
+
+ A parser is not thread safe. Use parserForCurrentThread, or one parser per thread.
+ */
+@interface STRCaptureFileParser : NSObject
+
+/**
+ A parser that belongs to the calling thread and is reused by every call on that thread.
+
+ @return STRCaptureFileParser The parser of the current thread.
+ */
++(STRCaptureFileParser *)parserForCurrentThread;
+
+///---------------------------------------------------------------------------------------
+/// @name Capture Info Files
+///---------------------------------------------------------------------------------------
+
+/**
+ Parses a capture info file.
+
+ The `coords` array must hold at least two numbers. String fields must be strings and number fields must be numbers, or be missing. A `track_summary` object must have a point count, duration and distance, and its `bounds` and `heading_range` arrays must hold four and two numbers.
+
+ @param path The absolute path of the capture info file.
+
+ @param fields On success, the values of the file. String fields stay valid until the next parse.
+
+ @return BOOL YES if the file was parsed. NO if it could not be read or does not fit the schema.
+ */
+-(BOOL)parseCaptureInfoAtPath:(NSString *)path fields:(STRCaptureInfoFields *)fields;
+
+/**
+ Returns the string value of a field from the last parsed capture info file, with any escapes decoded.
+
+ @param field A string field from parseCaptureInfoAtPath:fields:.
+
+ @return NSString The string, or nil if the field was not present.
+ */
+-(NSString *)stringForField:(STRParsedString)field;
+
+///---------------------------------------------------------------------------------------
+/// @name Geodata Files
+///---------------------------------------------------------------------------------------
+
+/**
+ Parses the points of a geodata file.
+
+ Points without a heading have a heading of -1, and points without an accuracy have an accuracy of -1. Points without coordinates or a timestamp are read as 0, as [STRCapture geoDataPoints] always has.
+
+ @param path The absolute path of the geodata file.
+
+ @param samples On success, a malloc'd array of the points, in order. The caller must free it. NULL if there are no points.
+
+ @param count On success, the number of points.
+
+ @return BOOL YES if the file was parsed. NO if it could not be read or does not fit the schema.
+ */
+-(BOOL)parseGeoDataAtPath:(NSString *)path samples:(STRTrackSample **)samples count:(NSUInteger *)count;
+
+@end
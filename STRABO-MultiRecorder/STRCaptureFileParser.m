@@ -0,0 +1,631 @@
+//
+//  STRCaptureFileParser.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureFileParser.h"
+#import "STRSettings.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Files larger than this are mapped rather than read into the buffer, unless the
+// settings give another threshold
+#define kSTRParserMapThreshold (64 * 1024)
+#define kSTRParserInitialBufferSize 4096
+#define kSTRParserMaximumDepth 64
+// Numbers longer than this are left to NSJSONSerialization
+#define kSTRParserMaximumNumberLength 63
+// A rough size of one point in a geodata file, to size the first samples array
+#define kSTRParserBytesPerPoint 96
+#define kSTRParserThreadKey @"STRCaptureFileParser"
+
+typedef struct {
+    const char * start;
+    const char * p;
+    const char * end;
+} STRScanner;
+
+#pragma mark - Scanning
+
+#define kSTROnes 0x0101010101010101ULL
+#define kSTRHighs 0x8080808080808080ULL
+
+// Nonzero if any byte of the word is zero
+static inline uint64_t STRWordHasZero(uint64_t word) {
+    return (word - kSTROnes) & ~word & kSTRHighs;
+}
+
+// Nonzero if any byte of the word is less than n, for n up to 128
+static inline uint64_t STRWordHasLess(uint64_t word, uint8_t n) {
+    return (word - kSTROnes * n) & ~word & kSTRHighs;
+}
+
+/*
+ Returns the first quote, backslash or control character at or after p, or end.
+
+ Eight bytes are checked at a time; only the word that holds a match is looked at byte by byte.
+ */
+static inline const char * STRScanStringCharacters(const char * p, const char * end) {
+    while (end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        if (STRWordHasZero(word ^ (kSTROnes * '"')) | STRWordHasZero(word ^ (kSTROnes * '\\')) | STRWordHasLess(word, 0x20)) break;
+        p += 8;
+    }
+    while (p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) p++;
+    return p;
+}
+
+static inline void STRSkipWhitespace(STRScanner * s) {
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t')) s->p++;
+}
+
+static inline BOOL STRConsume(STRScanner * s, char c) {
+    STRSkipWhitespace(s);
+    if (s->p < s->end && *s->p == c) {
+        s->p++;
+        return YES;
+    }
+    return NO;
+}
+
+static inline BOOL STRIsHexDigit(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// Reads a string whose opening quote is at s->p
+static BOOL STRScanString(STRScanner * s, STRParsedString * string) {
+    if (s->p >= s->end || *s->p != '"') return NO;
+    s->p++;
+    const char * start = s->p;
+    BOOL escaped = NO;
+    while (YES) {
+        s->p = STRScanStringCharacters(s->p, s->end);
+        if (s->p >= s->end) return NO;
+        char c = *s->p;
+        if (c == '"') break;
+        if (c != '\\') return NO;
+        // Escapes are checked here and decoded only if the string is asked for
+        escaped = YES;
+        if (s->end - s->p < 2) return NO;
+        char e = s->p[1];
+        if (e == 'u') {
+            if (s->end - s->p < 6 || !STRIsHexDigit(s->p[2]) || !STRIsHexDigit(s->p[3]) || !STRIsHexDigit(s->p[4]) || !STRIsHexDigit(s->p[5])) return NO;
+            s->p += 6;
+        } else if (e == '"' || e == '\\' || e == '/' || e == 'b' || e == 'f' || e == 'n' || e == 'r' || e == 't') {
+            s->p += 2;
+        } else {
+            return NO;
+        }
+    }
+    if (string) {
+        string->offset = start - s->start;
+        string->length = s->p - start;
+        string->escaped = escaped;
+        string->present = YES;
+    }
+    s->p++;
+    return YES;
+}
+
+static const double STRPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ Reads a number at s->p.
+
+ Numbers whose digits fit in 53 bits and whose decimal exponent is at most 22 are converted with a single multiplication or division, which is exact. Anything else, such as the 17 digit doubles NSJSONSerialization can write, is copied to the stack and converted with strtod.
+ */
+static BOOL STRScanNumber(STRScanner * s, double * value) {
+    const char * start = s->p;
+    const char * p = s->p;
+    const char * end = s->end;
+    BOOL negative = NO;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    if (p < end && *p == '-') {
+        negative = YES;
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') return NO;
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) mantissa = mantissa * 10 + (*p - '0');
+            else exponent++;
+            if (mantissa || digits) digits++;
+            p++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (p >= end || *p < '0' || *p > '9') return NO;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+                if (mantissa || digits) digits++;
+            }
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        BOOL negativeExponent = NO;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negativeExponent = (*p == '-');
+            p++;
+        }
+        if (p >= end || *p < '0' || *p > '9') return NO;
+        int explicitExponent = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (explicitExponent < 10000) explicitExponent = explicitExponent * 10 + (*p - '0');
+            p++;
+        }
+        exponent += (negativeExponent) ? -explicitExponent : explicitExponent;
+    }
+    s->p = p;
+
+    if (digits < 19 && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double result = (double)mantissa;
+        result = (exponent < 0) ? result / STRPowersOfTen[-exponent] : result * STRPowersOfTen[exponent];
+        *value = (negative) ? -result : result;
+        return YES;
+    }
+
+    size_t length = p - start;
+    if (length > kSTRParserMaximumNumberLength) return NO;
+    char number[kSTRParserMaximumNumberLength + 1];
+    memcpy(number, start, length);
+    number[length] = '\0';
+    *value = strtod(number, NULL);
+    return isfinite(*value);
+}
+
+static BOOL STRSkipValue(STRScanner * s, int depth);
+
+static BOOL STRSkipContainer(STRScanner * s, int depth, char close) {
+    if (depth > kSTRParserMaximumDepth) return NO;
+    s->p++;
+    if (STRConsume(s, close)) return YES;
+    while (YES) {
+        if (close == '}') {
+            STRSkipWhitespace(s);
+            if (!STRScanString(s, NULL) || !STRConsume(s, ':')) return NO;
+        }
+        if (!STRSkipValue(s, depth + 1)) return NO;
+        if (STRConsume(s, close)) return YES;
+        if (!STRConsume(s, ',')) return NO;
+    }
+}
+
+static BOOL STRSkipLiteral(STRScanner * s, const char * literal, size_t length) {
+    if ((size_t)(s->end - s->p) < length || memcmp(s->p, literal, length) != 0) return NO;
+    s->p += length;
+    return YES;
+}
+
+static BOOL STRSkipValue(STRScanner * s, int depth) {
+    STRSkipWhitespace(s);
+    if (s->p >= s->end) return NO;
+    double number;
+    switch (*s->p) {
+        case '{':
+            return STRSkipContainer(s, depth, '}');
+        case '[':
+            return STRSkipContainer(s, depth, ']');
+        case '"':
+            return STRScanString(s, NULL);
+        case 't':
+            return STRSkipLiteral(s, "true", 4);
+        case 'f':
+            return STRSkipLiteral(s, "false", 5);
+        case 'n':
+            return STRSkipLiteral(s, "null", 4);
+        default:
+            return STRScanNumber(s, &number);
+    }
+}
+
+/*
+ Reads the next key of an object, after its opening brace or a comma.
+
+ Keys with escapes are refused rather than decoded, since none of the keys the SDK writes need them.
+ */
+static BOOL STRScanKey(STRScanner * s, const char ** key, size_t * length) {
+    STRParsedString string;
+    STRSkipWhitespace(s);
+    if (!STRScanString(s, &string) || string.escaped || !STRConsume(s, ':')) return NO;
+    *key = s->start + string.offset;
+    *length = string.length;
+    STRSkipWhitespace(s);
+    return YES;
+}
+
+#define STRKeyIs(key, length, literal) ((length) == sizeof(literal) - 1 && memcmp((key), (literal), sizeof(literal) - 1) == 0)
+
+/*
+ Steps to the next key of an object whose opening brace has been read.
+
+ Returns NO at the closing brace, and also when the object is damaged, in which case failed is set.
+ */
+static BOOL STRNextKey(STRScanner * s, BOOL * first, const char ** key, size_t * length, BOOL * failed) {
+    if (STRConsume(s, '}')) return NO;
+    if (!*first && !STRConsume(s, ',')) {
+        *failed = YES;
+        return NO;
+    }
+    *first = NO;
+    if (!STRScanKey(s, key, length)) {
+        *failed = YES;
+        return NO;
+    }
+    return YES;
+}
+
+static inline BOOL STRScanStringValue(STRScanner * s, STRParsedString * string) {
+    return (s->p < s->end && *s->p == '"') ? STRScanString(s, string) : NO;
+}
+
+static BOOL STRScanCoordinates(STRScanner * s, double * latitude, double * longitude) {
+    if (!STRConsume(s, '[')) return NO;
+    double values[2];
+    NSUInteger count = 0;
+    if (!STRConsume(s, ']')) {
+        while (YES) {
+            STRSkipWhitespace(s);
+            double value;
+            if (!STRScanNumber(s, &value)) return NO;
+            if (count < 2) values[count] = value;
+            count++;
+            if (STRConsume(s, ']')) break;
+            if (!STRConsume(s, ',')) return NO;
+        }
+    }
+    if (count < 2) return NO;
+    *latitude = values[0];
+    *longitude = values[1];
+    return YES;
+}
+
+// Reads an array of exactly count numbers
+static BOOL STRScanNumbers(STRScanner * s, double * values, NSUInteger count) {
+    if (!STRConsume(s, '[')) return NO;
+    for (NSUInteger i = 0; i < count; i++) {
+        if (i > 0 && !STRConsume(s, ',')) return NO;
+        STRSkipWhitespace(s);
+        if (!STRScanNumber(s, &values[i])) return NO;
+    }
+    return STRConsume(s, ']');
+}
+
+static BOOL STRScanEndOfDocument(STRScanner * s) {
+    STRSkipWhitespace(s);
+    return s->p == s->end;
+}
+
+#pragma mark - Schemas
+
+static BOOL STRParseTrackSummary(STRScanner * s, STRTrackSummaryValues * summary) {
+    summary->minLatitude = summary->minLongitude = summary->maxLatitude = summary->maxLongitude = NAN;
+    summary->meanAccuracy = summary->headingRangeStart = summary->headingRangeEnd = NAN;
+    double pointCount = NAN, duration = NAN, distance = NAN;
+
+    if (!STRConsume(s, '{')) return NO;
+    BOOL first = YES, failed = NO;
+    const char * key;
+    size_t keyLength;
+    while (STRNextKey(s, &first, &key, &keyLength, &failed)) {
+        BOOL parsed;
+        if (STRKeyIs(key, keyLength, "point_count")) {
+            parsed = STRScanNumber(s, &pointCount);
+        } else if (STRKeyIs(key, keyLength, "duration")) {
+            parsed = STRScanNumber(s, &duration);
+        } else if (STRKeyIs(key, keyLength, "distance")) {
+            parsed = STRScanNumber(s, &distance);
+        } else if (STRKeyIs(key, keyLength, "bounds")) {
+            double bounds[4];
+            parsed = STRScanNumbers(s, bounds, 4);
+            if (parsed) {
+                summary->minLatitude = bounds[0];
+                summary->minLongitude = bounds[1];
+                summary->maxLatitude = bounds[2];
+                summary->maxLongitude = bounds[3];
+            }
+        } else if (STRKeyIs(key, keyLength, "mean_accuracy")) {
+            parsed = STRScanNumber(s, &summary->meanAccuracy);
+        } else if (STRKeyIs(key, keyLength, "heading_range")) {
+            double range[2];
+            parsed = STRScanNumbers(s, range, 2);
+            if (parsed) {
+                summary->headingRangeStart = range[0];
+                summary->headingRangeEnd = range[1];
+            }
+        } else {
+            parsed = STRSkipValue(s, 2);
+        }
+        if (!parsed) return NO;
+    }
+
+    // As for [STRTrackSummary summaryFromDictionary:], the first three values are required
+    if (failed || isnan(pointCount) || isnan(duration) || isnan(distance) || pointCount < 0) return NO;
+    summary->pointCount = (NSUInteger)pointCount;
+    summary->duration = duration;
+    summary->distance = distance;
+    return YES;
+}
+
+static BOOL STRParseCaptureInfo(STRScanner * s, STRCaptureInfoFields * fields) {
+    memset(fields, 0, sizeof(STRCaptureInfoFields));
+    fields->heading = NAN;
+    BOOL hasCoordinates = NO;
+
+    if (!STRConsume(s, '{')) return NO;
+    BOOL first = YES, failed = NO;
+    const char * key;
+    size_t keyLength;
+    while (STRNextKey(s, &first, &key, &keyLength, &failed)) {
+        BOOL parsed;
+        if (STRKeyIs(key, keyLength, "coords")) {
+            parsed = hasCoordinates = STRScanCoordinates(s, &fields->latitude, &fields->longitude);
+        } else if (STRKeyIs(key, keyLength, "heading")) {
+            parsed = STRScanNumber(s, &fields->heading);
+        } else if (STRKeyIs(key, keyLength, "created_at")) {
+            parsed = STRScanNumber(s, &fields->createdAt);
+        } else if (STRKeyIs(key, keyLength, "uploaded_at")) {
+            parsed = STRScanNumber(s, &fields->uploadedAt);
+        } else if (STRKeyIs(key, keyLength, "title")) {
+            parsed = STRScanStringValue(s, &fields->title);
+        } else if (STRKeyIs(key, keyLength, "token")) {
+            parsed = STRScanStringValue(s, &fields->token);
+        } else if (STRKeyIs(key, keyLength, "media_type")) {
+            parsed = STRScanStringValue(s, &fields->mediaType);
+        } else if (STRKeyIs(key, keyLength, "geodata_file")) {
+            parsed = STRScanStringValue(s, &fields->geoDataFile);
+        } else if (STRKeyIs(key, keyLength, "filtered_geodata_file")) {
+            parsed = STRScanStringValue(s, &fields->filteredGeoDataFile);
+        } else if (STRKeyIs(key, keyLength, "media_file")) {
+            parsed = STRScanStringValue(s, &fields->mediaFile);
+        } else if (STRKeyIs(key, keyLength, "thumbnail_file")) {
+            parsed = STRScanStringValue(s, &fields->thumbnailFile);
+        } else if (STRKeyIs(key, keyLength, "track_summary")) {
+            parsed = fields->hasTrackSummary = STRParseTrackSummary(s, &fields->trackSummary);
+        } else {
+            parsed = STRSkipValue(s, 1);
+        }
+        if (!parsed) return NO;
+    }
+
+    return !failed && hasCoordinates && STRScanEndOfDocument(s);
+}
+
+static BOOL STRParsePoint(STRScanner * s, STRTrackSample * sample) {
+    sample->latitude = sample->longitude = sample->timestamp = 0.0;
+    sample->heading = sample->accuracy = -1.0;
+    BOOL hasCoordinates = NO;
+    double accuracy = -1.0;
+
+    if (!STRConsume(s, '{')) return NO;
+    BOOL first = YES, failed = NO;
+    const char * key;
+    size_t keyLength;
+    while (STRNextKey(s, &first, &key, &keyLength, &failed)) {
+        BOOL parsed;
+        if (STRKeyIs(key, keyLength, "coords")) {
+            parsed = hasCoordinates = STRScanCoordinates(s, &sample->latitude, &sample->longitude);
+        } else if (STRKeyIs(key, keyLength, "heading")) {
+            parsed = STRScanNumber(s, &sample->heading);
+        } else if (STRKeyIs(key, keyLength, "accuracy")) {
+            parsed = STRScanNumber(s, &accuracy);
+        } else if (STRKeyIs(key, keyLength, "timestamp")) {
+            parsed = STRScanNumber(s, &sample->timestamp);
+        } else {
+            parsed = STRSkipValue(s, 2);
+        }
+        if (!parsed) return NO;
+    }
+
+    // As in [STRTrackFilter sampleFromPoint:], an accuracy means nothing without a fix
+    if (hasCoordinates) sample->accuracy = accuracy;
+    return !failed;
+}
+
+// Reads a points array into a growing samples array, which the caller frees
+static BOOL STRParsePoints(STRScanner * s, STRTrackSample ** points, NSUInteger * count, NSUInteger * capacity) {
+    if (!STRConsume(s, '[')) return NO;
+    *count = 0;
+    if (STRConsume(s, ']')) return YES;
+    while (YES) {
+        if (!*points || *count == *capacity) {
+            if (*points) *capacity *= 2;
+            STRTrackSample * grown = realloc(*points, *capacity * sizeof(STRTrackSample));
+            if (!grown) return NO;
+            *points = grown;
+        }
+        if (!STRParsePoint(s, &(*points)[*count])) return NO;
+        (*count)++;
+        if (STRConsume(s, ']')) return YES;
+        if (!STRConsume(s, ',')) return NO;
+    }
+}
+
+static BOOL STRParseGeoData(STRScanner * s, STRTrackSample ** samples, NSUInteger * count) {
+    NSUInteger capacity = MAX((NSUInteger)((s->end - s->start) / kSTRParserBytesPerPoint), (NSUInteger)16);
+    STRTrackSample * points = NULL;
+    NSUInteger pointCount = 0;
+    BOOL hasPoints = NO;
+
+    BOOL parsed = STRConsume(s, '{');
+    BOOL first = YES, failed = NO;
+    const char * key;
+    size_t keyLength;
+    while (parsed && STRNextKey(s, &first, &key, &keyLength, &failed)) {
+        if (STRKeyIs(key, keyLength, "points")) {
+            parsed = hasPoints = STRParsePoints(s, &points, &pointCount, &capacity);
+        } else {
+            parsed = STRSkipValue(s, 1);
+        }
+    }
+
+    if (!parsed || failed || !hasPoints || !STRScanEndOfDocument(s)) {
+        free(points);
+        return NO;
+    }
+    if (pointCount == 0) {
+        free(points);
+        points = NULL;
+    }
+    *samples = points;
+    *count = pointCount;
+    return YES;
+}
+
+#pragma mark - STRCaptureFileParser
+
+@interface STRCaptureFileParser () {
+    char * _buffer;
+    size_t _bufferSize;
+    void * _mapping;
+    size_t _mappingLength;
+    const char * _bytes;
+    size_t _length;
+}
+@end
+
+@interface STRCaptureFileParser (InternalMethods)
+
+// -- Files -- //
+-(BOOL)loadFileAtPath:(NSString *)path;
+-(void)unloadFile;
+
+@end
+
+@implementation STRCaptureFileParser
+
++(STRCaptureFileParser *)parserForCurrentThread {
+    NSMutableDictionary * threadDictionary = [[NSThread currentThread] threadDictionary];
+    STRCaptureFileParser * parser = [threadDictionary objectForKey:kSTRParserThreadKey];
+    if (!parser) {
+        parser = [[STRCaptureFileParser alloc] init];
+        [threadDictionary setObject:parser forKey:kSTRParserThreadKey];
+    }
+    return parser;
+}
+
+-(void)dealloc {
+    [self unloadFile];
+    free(_buffer);
+}
+
+#pragma mark - Capture Info Files
+
+-(BOOL)parseCaptureInfoAtPath:(NSString *)path fields:(STRCaptureInfoFields *)fields {
+    if (![self loadFileAtPath:path]) return NO;
+    STRScanner scanner = { _bytes, _bytes, _bytes + _length };
+    return STRParseCaptureInfo(&scanner, fields);
+}
+
+-(NSString *)stringForField:(STRParsedString)field {
+    if (!field.present || !_bytes || field.offset + field.length > _length) return nil;
+    const char * bytes = _bytes + field.offset;
+    if (!field.escaped) {
+        return [[NSString alloc] initWithBytes:bytes length:field.length encoding:NSUTF8StringEncoding];
+    }
+    // Escaped strings are rare enough to decode with the quotes put back
+    NSData * data = [NSData dataWithBytes:bytes - 1 length:field.length + 2];
+    id value = [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingAllowFragments error:nil];
+    return ([value isKindOfClass:[NSString class]]) ? value : nil;
+}
+
+#pragma mark - Geodata Files
+
+-(BOOL)parseGeoDataAtPath:(NSString *)path samples:(STRTrackSample **)samples count:(NSUInteger *)count {
+    if (![self loadFileAtPath:path]) return NO;
+    STRScanner scanner = { _bytes, _bytes, _bytes + _length };
+    BOOL success = STRParseGeoData(&scanner, samples, count);
+    // Nothing points into a geodata file after the parse, so a mapping can go at once
+    [self unloadFile];
+    return success;
+}
+
+@end
+
+@implementation STRCaptureFileParser (InternalMethods)
+
+#pragma mark - Files
+
+-(BOOL)loadFileAtPath:(NSString *)path {
+    [self unloadFile];
+    int file = open([path fileSystemRepresentation], O_RDONLY);
+    if (file < 0) return NO;
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size <= 0) {
+        close(file);
+        return NO;
+    }
+    size_t length = (size_t)info.st_size;
+
+    size_t mapThreshold = [[STRSettings sharedSettings] parserMapThreshold];
+    if (mapThreshold == 0) mapThreshold = kSTRParserMapThreshold;
+    if (length > mapThreshold) {
+        void * mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (mapping == MAP_FAILED) return NO;
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        _mapping = mapping;
+        _mappingLength = length;
+        _bytes = mapping;
+        _length = length;
+        return YES;
+    }
+
+    if (length > _bufferSize) {
+        size_t size = MAX(_bufferSize, (size_t)kSTRParserInitialBufferSize);
+        while (size < length) size *= 2;
+        char * buffer = realloc(_buffer, size);
+        if (!buffer) {
+            close(file);
+            return NO;
+        }
+        _buffer = buffer;
+        _bufferSize = size;
+    }
+    size_t total = 0;
+    while (total < length) {
+        ssize_t readLength = read(file, _buffer + total, length - total);
+        if (readLength <= 0) break;
+        total += readLength;
+    }
+    close(file);
+    if (total != length) return NO;
+    _bytes = _buffer;
+    _length = length;
+    return YES;
+}
+
+-(void)unloadFile {
+    if (_mapping) {
+        munmap(_mapping, _mappingLength);
+        _mapping = NULL;
+        _mappingLength = 0;
+    }
+    _bytes = NULL;
+    _length = 0;
+}
+
+@end
@@ -0,0 +1,80 @@
+//
+//  STRCaptureIntegrityReport.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ STRCaptureIssue
+
+ Problems that STRCaptureIntegrityScanner can find in a capture directory. A capture can have several at once, so the values are combined as bit flags. See the [ConstantsReference] guide for more information.
+ */
+typedef enum {
+    STRCaptureIssueNone                 = 0,
+    STRCaptureIssueInfoUnreadable       = 1 << 0,   // capture-info.json is missing or does not parse
+    STRCaptureIssueMediaMissing         = 1 << 1,   // The media file named in the info file does not exist
+    STRCaptureIssueMediaEmpty           = 1 << 2,   // The media file is empty
+    STRCaptureIssueGeoDataMissing       = 1 << 3,   // The geodata file named in the info file does not exist
+    STRCaptureIssueGeoDataUnreadable    = 1 << 4,   // The geodata file is empty, truncated or does not parse
+    STRCaptureIssueThumbnailMissing     = 1 << 5,   // The thumbnail file is missing or empty
+    STRCaptureIssueChecksumMismatch     = 1 << 6    // A file no longer matches the checksum recorded for it
+} STRCaptureIssue;
+
+/**
+ The results of one pass of an STRCaptureIntegrityScanner over the captures directory.
+ */
+@interface STRCaptureIntegrityReport : NSObject
+
+/**
+ The number of capture directories that were checked.
+ */
+@property(nonatomic, assign)NSUInteger scannedCount;
+
+/**
+ The problems found, keyed by capture token. Each value is an NSNumber holding STRCaptureIssue flags, as found before any repair. Captures without problems are left out.
+ */
+@property(nonatomic, strong)NSDictionary * issues;
+
+/**
+ Tokens of the captures that were repaired and no longer have problems.
+ */
+@property(nonatomic, strong)NSArray * repairedTokens;
+
+/**
+ Tokens of the captures that were moved to the quarantine directory.
+ */
+@property(nonatomic, strong)NSArray * quarantinedTokens;
+
+/**
+ How long the scan took, in seconds.
+ */
+@property(nonatomic, assign)NSTimeInterval duration;
+
+/**
+ Whether every capture that was checked is intact.
+
+ @return BOOL YES if no problems were found.
+ */
+-(BOOL)isClean;
+
+/**
+ Names for a set of issue flags.
+
+ @param issues STRCaptureIssue flags.
+
+ @return NSArray Strings such as `media_missing`, one for each flag that is set.
+ */
++(NSArray *)namesForIssues:(STRCaptureIssue)issues;
+
+/**
+ A dictionary representation of the report that can be written to JSON.
+
+ @return NSDictionary The report with snake_case keys and issue names in place of flags.
+ */
+-(NSDictionary *)dictionaryRepresentation;
+
+@end
@@ -0,0 +1,43 @@
+//
+//  STRCaptureIntegrityReport.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureIntegrityReport.h"
+
+@implementation STRCaptureIntegrityReport
+
+-(BOOL)isClean {
+    return _issues.count == 0;
+}
+
++(NSArray *)namesForIssues:(STRCaptureIssue)issues {
+    NSMutableArray * names = [NSMutableArray array];
+    if (issues & STRCaptureIssueInfoUnreadable) [names addObject:@"info_unreadable"];
+    if (issues & STRCaptureIssueMediaMissing) [names addObject:@"media_missing"];
+    if (issues & STRCaptureIssueMediaEmpty) [names addObject:@"media_empty"];
+    if (issues & STRCaptureIssueGeoDataMissing) [names addObject:@"geodata_missing"];
+    if (issues & STRCaptureIssueGeoDataUnreadable) [names addObject:@"geodata_unreadable"];
+    if (issues & STRCaptureIssueThumbnailMissing) [names addObject:@"thumbnail_missing"];
+    if (issues & STRCaptureIssueChecksumMismatch) [names addObject:@"checksum_mismatch"];
+    return names;
+}
+
+-(NSDictionary *)dictionaryRepresentation {
+    NSMutableDictionary * issueNames = [NSMutableDictionary dictionaryWithCapacity:_issues.count];
+    for (NSString * token in _issues) {
+        [issueNames setObject:[STRCaptureIntegrityReport namesForIssues:[[_issues objectForKey:token] intValue]] forKey:token];
+    }
+    return @{
+    @"scanned" : @(_scannedCount),
+    @"issues" : issueNames,
+    @"repaired" : (_repairedTokens) ? _repairedTokens : @[],
+    @"quarantined" : (_quarantinedTokens) ? _quarantinedTokens : @[],
+    @"duration" : @(_duration)
+    };
+}
+
+@end
@@ -0,0 +1,120 @@
+//
+//  STRCaptureIntegrityScanner.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "STRCaptureIntegrityReport.h"
+
+@class STRCapturePathResolver;
+
+/**
+ Checks every capture directory for damage, and optionally repairs or quarantines the damaged ones.
+
+ A capture is damaged if its capture-info file cannot be read, if a file that the info file names is missing or empty, if its geodata file is truncated, or, when checksums are verified, if a file has changed since its checksum was recorded. Captures are checked in parallel on all cores. The default checks read only the info file and the ends of the geodata file, and take a fraction of a second per thousand captures, so a scan can be started at every launch:
+
+    STRCaptureIntegrityScanner * scanner = [STRCaptureIntegrityScanner scanner];
+    scanner.quarantinesCaptures = YES;
+    [scanner scanInBackgroundWithCompletion:^(STRCaptureIntegrityReport * report) {
+        // Tell the user about report.quarantinedTokens
+    }];
+
+ Repairs rebuild what can be rebuilt from the rest of the capture: a missing info file is written again from the token, the media file and the first geodata point; a missing geodata file is replaced by a single point at the capture's location; a missing thumbnail is generated again from the media. A capture that is still damaged after repair is quarantined, if quarantinesCaptures is set. Quarantined captures are left out of every listing (see STRCapturePathResolver).
+
+ Captures that were changed in the last minute are skipped, because they may still be being written.
+ */
+@interface STRCaptureIntegrityScanner : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Creating a Scanner
+///---------------------------------------------------------------------------------------
+
+/**
+ Creates a scanner for the captures directory used by the SDK.
+
+ @return STRCaptureIntegrityScanner A new scanner with the default, quick checks.
+ */
++(STRCaptureIntegrityScanner *)scanner;
+
+/**
+ Creates a scanner for the captures managed by a given resolver.
+
+ @param resolver The resolver for the captures directory to scan.
+
+ @return STRCaptureIntegrityScanner A new scanner with the default, quick checks.
+ */
+-(id)initWithPathResolver:(STRCapturePathResolver *)resolver;
+
+///---------------------------------------------------------------------------------------
+/// @name Choosing the Checks
+///---------------------------------------------------------------------------------------
+
+/**
+ Whether geodata files are parsed in full. Defaults to NO, in which case a geodata file is only checked for being complete JSON at both ends, which catches truncated writes without reading the whole track.
+ */
+@property(nonatomic, assign)BOOL parsesGeoData;
+
+/**
+ Whether file contents are checked against recorded SHA-1 checksums. Defaults to NO.
+
+ The first scan with this option records checksums of the media, geodata and thumbnail files in a `.checksums.json` file inside each capture directory. Later scans report any file whose size or checksum has changed. Hashing reads every byte of every capture, so this is meant for occasional deep scans rather than launch.
+ */
+@property(nonatomic, assign)BOOL verifiesChecksums;
+
+/**
+ Whether damaged captures are repaired where possible. Defaults to NO.
+ */
+@property(nonatomic, assign)BOOL repairsCaptures;
+
+/**
+ Whether captures that are damaged, and could not be repaired, are moved to the quarantine directory. Defaults to NO.
+ */
+@property(nonatomic, assign)BOOL quarantinesCaptures;
+
+///---------------------------------------------------------------------------------------
+/// @name Scanning
+///---------------------------------------------------------------------------------------
+
+/**
+ Checks every capture on the calling thread, using all cores.
+
+ @return STRCaptureIntegrityReport The results of the scan.
+ */
+-(STRCaptureIntegrityReport *)scan;
+
+/**
+ Checks every capture on a background queue.
+
+ @param completion Called on the main queue with the results of the scan.
+ */
+-(void)scanInBackgroundWithCompletion:(void (^)(STRCaptureIntegrityReport * report))completion;
+
+/**
+ Checks a single capture, without repairing or quarantining it.
+
+ @param relativeDirectory The capture's directory, relative to the captures directory.
+
+ @return STRCaptureIssue The problems found, or STRCaptureIssueNone.
+ */
+-(STRCaptureIssue)issuesForCaptureAtRelativeDirectory:(NSString *)relativeDirectory;
+
+///---------------------------------------------------------------------------------------
+/// @name Checksums
+///---------------------------------------------------------------------------------------
+
+/**
+ Returns the SHA-1 checksums of the media and geodata files of a capture.
+
+ A checksum recorded in the capture's `.checksums.json` file is reused if the file still has the recorded size and has not been modified since, so asking again costs a stat call per file rather than reading every byte. Otherwise the file is hashed. If nothing has been recorded for the capture yet, its media, geodata and thumbnail files are recorded first, as a scan with verifiesChecksums would.
+
+ @param relativeDirectory The capture's directory, relative to the captures directory.
+
+ @return NSDictionary The checksums, as lowercase hexadecimal strings, for the keys `media_file` and `geodata_file`. Nil if the capture info or either file cannot be read.
+ */
+-(NSDictionary *)checksumsOfCaptureAtRelativeDirectory:(NSString *)relativeDirectory;
+
+@end
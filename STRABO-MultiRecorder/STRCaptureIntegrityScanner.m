@@ -0,0 +1,465 @@
+//
+//  STRCaptureIntegrityScanner.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureIntegrityScanner.h"
+#import "STRCaptureFileOrganizer.h"
+#import "STRCaptureLockTable.h"
+#import "STRCapturePathResolver.h"
+#import "STRCaptureToken.h"
+#import "STRLogger.h"
+#import "STRSettings.h"
+
+#import <CommonCrypto/CommonDigest.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kSTRCaptureInfoFile @"capture-info.json"
+#define kSTRChecksumFile @".checksums.json"
+// Captures handed to each parallel worker at a time, unless the settings say otherwise
+#define kSTRScanBatchSize 64
+// Captures changed more recently than this may still be being written
+#define kSTRRecentChangeInterval 60
+#define kSTRGeoDataEdgeLength 32
+#define kSTRChecksumBufferSize (64 * 1024)
+
+typedef enum {
+    STRScanOutcomeNone,
+    STRScanOutcomeSkipped,
+    STRScanOutcomeRepaired,
+    STRScanOutcomeQuarantined
+} STRScanOutcome;
+
+@interface STRCaptureIntegrityScanner () {
+    STRCapturePathResolver * _resolver;
+}
+@end
+
+@interface STRCaptureIntegrityScanner (InternalMethods)
+
+// -- Checking Captures -- //
+-(STRCaptureIssue)checkCaptureAtPath:(NSString *)capturePath info:(NSDictionary **)info;
+-(NSDictionary *)captureInfoAtPath:(NSString *)capturePath;
+-(BOOL)geoDataIsCompleteAtPath:(NSString *)geoDataPath;
+-(BOOL)captureWasRecentlyChangedAtPath:(NSString *)capturePath;
+
+// -- Checksums -- //
+-(STRCaptureIssue)verifyChecksumsOfCaptureAtPath:(NSString *)capturePath fileNames:(NSArray *)fileNames;
+-(NSDictionary *)recordChecksumsOfCaptureAtPath:(NSString *)capturePath fileNames:(NSArray *)fileNames;
+-(NSString *)SHA1OfFileAtPath:(NSString *)path;
+
+// -- Repairing Captures -- //
+-(BOOL)repairCaptureAtPath:(NSString *)capturePath issues:(STRCaptureIssue)issues info:(NSDictionary *)info;
+-(BOOL)rebuildCaptureInfoAtPath:(NSString *)capturePath;
+-(NSString *)mediaFileNameInCaptureAtPath:(NSString *)capturePath;
+
+@end
+
+// The size of a file, or -1 if there is no such file
+static off_t STRFileSize(NSString * path) {
+    struct stat info;
+    if (stat([path fileSystemRepresentation], &info) != 0) return -1;
+    return info.st_size;
+}
+
+@implementation STRCaptureIntegrityScanner
+
+#pragma mark - Creating a Scanner
+
++(STRCaptureIntegrityScanner *)scanner {
+    return [[STRCaptureIntegrityScanner alloc] initWithPathResolver:[STRCapturePathResolver sharedResolver]];
+}
+
+-(id)initWithPathResolver:(STRCapturePathResolver *)resolver {
+    self = [super init];
+    if (self) {
+        _resolver = resolver;
+    }
+    return self;
+}
+
+#pragma mark - Scanning
+
+-(STRCaptureIntegrityReport *)scan {
+    NSDate * startDate = [NSDate date];
+    NSArray * directories = [_resolver allCaptureDirectories];
+    NSUInteger count = directories.count;
+
+    // Each worker writes only its own slots, so no locking is needed
+    STRCaptureIssue * foundIssues = calloc(MAX(count, 1), sizeof(STRCaptureIssue));
+    STRScanOutcome * outcomes = calloc(MAX(count, 1), sizeof(STRScanOutcome));
+    NSUInteger batchSize = [[STRSettings sharedSettings] parallelBatchSize];
+    if (batchSize == 0) batchSize = kSTRScanBatchSize;
+    size_t batches = (count + batchSize - 1) / batchSize;
+    dispatch_apply(batches, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t batch) {
+        NSUInteger end = MIN(count, (batch + 1) * batchSize);
+        for (NSUInteger i = batch * batchSize; i < end; i++) {
+            @autoreleasepool {
+                NSString * relativeDirectory = [directories objectAtIndex:i];
+                NSString * capturePath = [_resolver absolutePathForRelativePath:relativeDirectory];
+                NSDictionary * info = nil;
+                STRCaptureIssue issues = [self checkCaptureAtPath:capturePath info:&info];
+                if (issues == STRCaptureIssueNone) continue;
+
+                // The capture may have been moved, deleted or written to since it was listed
+                NSString * currentDirectory = [_resolver relativeDirectoryOfCaptureWithToken:[relativeDirectory lastPathComponent]];
+                if (!currentDirectory || [self captureWasRecentlyChangedAtPath:[_resolver absolutePathForRelativePath:currentDirectory]]) {
+                    outcomes[i] = STRScanOutcomeSkipped;
+                    continue;
+                }
+                if (![currentDirectory isEqualToString:relativeDirectory]) {
+                    relativeDirectory = currentDirectory;
+                    capturePath = [_resolver absolutePathForRelativePath:relativeDirectory];
+                    issues = [self checkCaptureAtPath:capturePath info:&info];
+                    if (issues == STRCaptureIssueNone) continue;
+                }
+                foundIssues[i] = issues;
+
+                // Repairs rewrite files that a save could be replacing; the resolver locks quarantines itself
+                __block BOOL repaired = NO;
+                if (self.repairsCaptures) {
+                    [[STRCaptureLockTable sharedTable] writeCaptureWithToken:[relativeDirectory lastPathComponent] usingBlock:^{
+                        repaired = [self repairCaptureAtPath:capturePath issues:issues info:info];
+                    }];
+                }
+                if (repaired) {
+                    outcomes[i] = STRScanOutcomeRepaired;
+                } else if (self.quarantinesCaptures && [_resolver quarantineCaptureAtRelativeDirectory:relativeDirectory]) {
+                    outcomes[i] = STRScanOutcomeQuarantined;
+                }
+            }
+        }
+    });
+
+    NSMutableDictionary * issues = [NSMutableDictionary dictionary];
+    NSMutableArray * repairedTokens = [NSMutableArray array];
+    NSMutableArray * quarantinedTokens = [NSMutableArray array];
+    NSUInteger skipped = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString * token = [[directories objectAtIndex:i] lastPathComponent];
+        if (outcomes[i] == STRScanOutcomeSkipped) skipped++;
+        if (outcomes[i] == STRScanOutcomeRepaired) [repairedTokens addObject:token];
+        if (outcomes[i] == STRScanOutcomeQuarantined) [quarantinedTokens addObject:token];
+        if (foundIssues[i] != STRCaptureIssueNone) [issues setObject:@(foundIssues[i]) forKey:token];
+    }
+    free(foundIssues);
+    free(outcomes);
+
+    STRCaptureIntegrityReport * report = [[STRCaptureIntegrityReport alloc] init];
+    report.scannedCount = count - skipped;
+    report.issues = issues;
+    report.repairedTokens = repairedTokens;
+    report.quarantinedTokens = quarantinedTokens;
+    report.duration = -[startDate timeIntervalSinceNow];
+
+    if (issues.count > 0) {
+        STRLogWarning(STRLogCategoryStorage, @"STRCaptureIntegrityScanner: %lu of %lu captures are damaged; %lu repaired, %lu quarantined.", (unsigned long)issues.count, (unsigned long)report.scannedCount, (unsigned long)repairedTokens.count, (unsigned long)quarantinedTokens.count);
+    } else {
+        STRLogInfo(STRLogCategoryStorage, @"STRCaptureIntegrityScanner: %lu captures checked in %.2f seconds.", (unsigned long)report.scannedCount, report.duration);
+    }
+    return report;
+}
+
+-(void)scanInBackgroundWithCompletion:(void (^)(STRCaptureIntegrityReport * report))completion {
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        STRCaptureIntegrityReport * report = [self scan];
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(report);
+            });
+        }
+    });
+}
+
+-(STRCaptureIssue)issuesForCaptureAtRelativeDirectory:(NSString *)relativeDirectory {
+    return [self checkCaptureAtPath:[_resolver absolutePathForRelativePath:relativeDirectory] info:NULL];
+}
+
+#pragma mark - Checksums
+
+-(NSDictionary *)checksumsOfCaptureAtRelativeDirectory:(NSString *)relativeDirectory {
+    NSString * capturePath = [_resolver absolutePathForRelativePath:relativeDirectory];
+    NSDictionary * captureInfo = [self captureInfoAtPath:capturePath];
+    if (!captureInfo) return nil;
+    NSString * mediaName = [[captureInfo objectForKey:@"media_file"] lastPathComponent];
+    NSString * geoDataName = [[captureInfo objectForKey:@"geodata_file"] lastPathComponent];
+    NSString * thumbnailName = [[captureInfo objectForKey:@"thumbnail_file"] lastPathComponent];
+
+    NSData * checksumData = [NSData dataWithContentsOfFile:[capturePath stringByAppendingPathComponent:kSTRChecksumFile]];
+    NSDictionary * recorded = (checksumData) ? [NSJSONSerialization JSONObjectWithData:checksumData options:0 error:nil] : nil;
+    NSDictionary * recordedFiles = ([recorded isKindOfClass:[NSDictionary class]]) ? [recorded objectForKey:@"files"] : nil;
+    double recordedAt = ([recorded isKindOfClass:[NSDictionary class]]) ? [[recorded objectForKey:@"recorded_at"] doubleValue] : 0;
+    if (![recordedFiles isKindOfClass:[NSDictionary class]]) {
+        recordedAt = [[NSDate date] timeIntervalSince1970];
+        recordedFiles = [self recordChecksumsOfCaptureAtPath:capturePath fileNames:@[ mediaName, geoDataName, thumbnailName ]];
+    }
+
+    NSMutableDictionary * checksums = [NSMutableDictionary dictionaryWithCapacity:2];
+    NSDictionary * fileNames = @{ @"media_file" : mediaName, @"geodata_file" : geoDataName };
+    for (NSString * key in fileNames) {
+        NSString * path = [capturePath stringByAppendingPathComponent:[fileNames objectForKey:key]];
+        struct stat info;
+        if (stat([path fileSystemRepresentation], &info) != 0) return nil;
+        // A recorded checksum stands as long as the file has kept its size and not been written since
+        NSDictionary * expected = [recordedFiles objectForKey:[fileNames objectForKey:key]];
+        NSString * checksum = nil;
+        if ([expected isKindOfClass:[NSDictionary class]] && [[expected objectForKey:@"size"] longLongValue] == info.st_size && info.st_mtime <= recordedAt) {
+            checksum = [expected objectForKey:@"sha1"];
+        }
+        if (![checksum isKindOfClass:[NSString class]]) checksum = [self SHA1OfFileAtPath:path];
+        if (!checksum) return nil;
+        [checksums setObject:checksum forKey:key];
+    }
+    return checksums;
+}
+
+@end
+
+@implementation STRCaptureIntegrityScanner (InternalMethods)
+
+#pragma mark - Checking Captures
+
+-(STRCaptureIssue)checkCaptureAtPath:(NSString *)capturePath info:(NSDictionary **)info {
+    STRCaptureIssue issues = STRCaptureIssueNone;
+    NSString * token = [capturePath lastPathComponent];
+    NSDictionary * captureInfo = [self captureInfoAtPath:capturePath];
+    if (info) *info = captureInfo;
+
+    // Without an info file, the files are looked for under the names the SDK gives them
+    NSString * mediaName, * geoDataName, * thumbnailName;
+    if (captureInfo) {
+        mediaName = [[captureInfo objectForKey:@"media_file"] lastPathComponent];
+        geoDataName = [[captureInfo objectForKey:@"geodata_file"] lastPathComponent];
+        thumbnailName = [[captureInfo objectForKey:@"thumbnail_file"] lastPathComponent];
+    } else {
+        issues |= STRCaptureIssueInfoUnreadable;
+        mediaName = [self mediaFileNameInCaptureAtPath:capturePath];
+        geoDataName = [token stringByAppendingPathExtension:@"json"];
+        thumbnailName = [token stringByAppendingPathExtension:@"png"];
+    }
+
+    off_t mediaSize = (mediaName) ? STRFileSize([capturePath stringByAppendingPathComponent:mediaName]) : -1;
+    if (mediaSize < 0) issues |= STRCaptureIssueMediaMissing;
+    else if (mediaSize == 0) issues |= STRCaptureIssueMediaEmpty;
+
+    NSString * geoDataPath = [capturePath stringByAppendingPathComponent:geoDataName];
+    if (STRFileSize(geoDataPath) < 0) {
+        issues |= STRCaptureIssueGeoDataMissing;
+    } else if (self.parsesGeoData) {
+        NSData * geoData = [NSData dataWithContentsOfFile:geoDataPath];
+        id geoDataObject = (geoData) ? [NSJSONSerialization JSONObjectWithData:geoData options:0 error:nil] : nil;
+        if (![geoDataObject isKindOfClass:[NSDictionary class]] || ![[geoDataObject objectForKey:@"points"] isKindOfClass:[NSArray class]]) {
+            issues |= STRCaptureIssueGeoDataUnreadable;
+        }
+    } else if (![self geoDataIsCompleteAtPath:geoDataPath]) {
+        issues |= STRCaptureIssueGeoDataUnreadable;
+    }
+
+    if (STRFileSize([capturePath stringByAppendingPathComponent:thumbnailName]) <= 0) {
+        issues |= STRCaptureIssueThumbnailMissing;
+    }
+
+    if (self.verifiesChecksums && issues == STRCaptureIssueNone) {
+        issues |= [self verifyChecksumsOfCaptureAtPath:capturePath fileNames:@[ mediaName, geoDataName, thumbnailName ]];
+    }
+    return issues;
+}
+
+-(NSDictionary *)captureInfoAtPath:(NSString *)capturePath {
+    NSData * infoData = [NSData dataWithContentsOfFile:[capturePath stringByAppendingPathComponent:kSTRCaptureInfoFile]];
+    NSDictionary * info = (infoData) ? [NSJSONSerialization JSONObjectWithData:infoData options:0 error:nil] : nil;
+    if (![info isKindOfClass:[NSDictionary class]]) return nil;
+
+    // STRCapture needs every one of these to load the capture
+    for (NSString * key in @[ @"token", @"media_file", @"geodata_file", @"thumbnail_file" ]) {
+        if (![[info objectForKey:key] isKindOfClass:[NSString class]]) return nil;
+    }
+    NSArray * coords = [info objectForKey:@"coords"];
+    if (![coords isKindOfClass:[NSArray class]] || coords.count < 2) return nil;
+    return info;
+}
+
+-(BOOL)geoDataIsCompleteAtPath:(NSString *)geoDataPath {
+    // A geodata file is one JSON object, so a complete one starts with { and ends with }
+    int file = open([geoDataPath fileSystemRepresentation], O_RDONLY);
+    if (file < 0) return NO;
+    struct stat info;
+    char head[kSTRGeoDataEdgeLength], tail[kSTRGeoDataEdgeLength];
+    ssize_t headLength = 0, tailLength = 0;
+    if (fstat(file, &info) == 0 && info.st_size > 0) {
+        headLength = pread(file, head, sizeof(head), 0);
+        tailLength = pread(file, tail, sizeof(tail), MAX(info.st_size - (off_t)sizeof(tail), 0));
+    }
+    close(file);
+
+    char first = 0, last = 0;
+    for (ssize_t i = 0; i < headLength && !first; i++) {
+        if (!isspace(head[i])) first = head[i];
+    }
+    for (ssize_t i = tailLength - 1; i >= 0 && !last; i--) {
+        if (!isspace(tail[i])) last = tail[i];
+    }
+    return first == '{' && last == '}';
+}
+
+-(BOOL)captureWasRecentlyChangedAtPath:(NSString *)capturePath {
+    time_t now = time(NULL);
+    for (NSString * path in @[ capturePath, [capturePath stringByAppendingPathComponent:kSTRCaptureInfoFile] ]) {
+        struct stat info;
+        if (stat([path fileSystemRepresentation], &info) == 0 && now - info.st_mtime < kSTRRecentChangeInterval) return YES;
+    }
+    return NO;
+}
+
+#pragma mark - Checksums
+
+-(STRCaptureIssue)verifyChecksumsOfCaptureAtPath:(NSString *)capturePath fileNames:(NSArray *)fileNames {
+    NSString * checksumPath = [capturePath stringByAppendingPathComponent:kSTRChecksumFile];
+    NSData * checksumData = [NSData dataWithContentsOfFile:checksumPath];
+    NSDictionary * recorded = (checksumData) ? [NSJSONSerialization JSONObjectWithData:checksumData options:0 error:nil] : nil;
+    NSDictionary * recordedFiles = ([recorded isKindOfClass:[NSDictionary class]]) ? [recorded objectForKey:@"files"] : nil;
+
+    if ([recordedFiles isKindOfClass:[NSDictionary class]]) {
+        for (NSString * fileName in fileNames) {
+            NSDictionary * expected = [recordedFiles objectForKey:fileName];
+            if (![expected isKindOfClass:[NSDictionary class]]) continue;
+            NSString * path = [capturePath stringByAppendingPathComponent:fileName];
+            // Compare sizes first, which is free, and hash only when they match
+            if (STRFileSize(path) != [[expected objectForKey:@"size"] longLongValue] ||
+                ![[self SHA1OfFileAtPath:path] isEqualToString:[expected objectForKey:@"sha1"]]) {
+                return STRCaptureIssueChecksumMismatch;
+            }
+        }
+        return STRCaptureIssueNone;
+    }
+
+    // Nothing has been recorded yet; record the files as they are now
+    [self recordChecksumsOfCaptureAtPath:capturePath fileNames:fileNames];
+    return STRCaptureIssueNone;
+}
+
+-(NSDictionary *)recordChecksumsOfCaptureAtPath:(NSString *)capturePath fileNames:(NSArray *)fileNames {
+    NSMutableDictionary * files = [NSMutableDictionary dictionaryWithCapacity:fileNames.count];
+    for (NSString * fileName in fileNames) {
+        NSString * path = [capturePath stringByAppendingPathComponent:fileName];
+        NSString * checksum = [self SHA1OfFileAtPath:path];
+        if (checksum) [files setObject:@{ @"size" : @(STRFileSize(path)), @"sha1" : checksum } forKey:fileName];
+    }
+    NSDictionary * checksums = @{ @"algorithm" : @"sha1", @"recorded_at" : @([[NSDate date] timeIntervalSince1970]), @"files" : files };
+    [[NSJSONSerialization dataWithJSONObject:checksums options:0 error:nil] writeToFile:[capturePath stringByAppendingPathComponent:kSTRChecksumFile] atomically:YES];
+    return files;
+}
+
+-(NSString *)SHA1OfFileAtPath:(NSString *)path {
+    int file = open([path fileSystemRepresentation], O_RDONLY);
+    if (file < 0) return nil;
+    CC_SHA1_CTX context;
+    CC_SHA1_Init(&context);
+    char * buffer = malloc(kSTRChecksumBufferSize);
+    ssize_t length;
+    while ((length = read(file, buffer, kSTRChecksumBufferSize)) > 0) {
+        CC_SHA1_Update(&context, buffer, (CC_LONG)length);
+    }
+    free(buffer);
+    close(file);
+    if (length < 0) return nil;
+
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1_Final(digest, &context);
+    NSMutableString * checksum = [NSMutableString stringWithCapacity:CC_SHA1_DIGEST_LENGTH * 2];
+    for (int i = 0; i < CC_SHA1_DIGEST_LENGTH; i++) {
+        [checksum appendFormat:@"%02x", digest[i]];
+    }
+    return checksum;
+}
+
+#pragma mark - Repairing Captures
+
+-(BOOL)repairCaptureAtPath:(NSString *)capturePath issues:(STRCaptureIssue)issues info:(NSDictionary *)info {
+    // Lost media, and files that changed after their checksums were recorded, cannot be rebuilt
+    if (issues & (STRCaptureIssueMediaMissing | STRCaptureIssueMediaEmpty | STRCaptureIssueChecksumMismatch)) return NO;
+
+    if (issues & STRCaptureIssueInfoUnreadable) {
+        if (![self rebuildCaptureInfoAtPath:capturePath]) return NO;
+        info = [self captureInfoAtPath:capturePath];
+    }
+
+    if (issues & STRCaptureIssueGeoDataMissing) {
+        // The same single point that an imported image gets
+        NSArray * coords = [info objectForKey:@"coords"];
+        NSNumber * heading = ([[info objectForKey:@"heading"] isKindOfClass:[NSNumber class]]) ? [info objectForKey:@"heading"] : @(0.0);
+        NSDictionary * geoData = @{ @"points" : @[ @{ @"timestamp" : @0, @"accuracy" : @15, @"coords" : coords, @"heading" : heading } ] };
+        NSString * geoDataPath = [capturePath stringByAppendingPathComponent:[[info objectForKey:@"geodata_file"] lastPathComponent]];
+        [[NSJSONSerialization dataWithJSONObject:geoData options:0 error:nil] writeToFile:geoDataPath atomically:YES];
+    }
+
+    if (issues & STRCaptureIssueThumbnailMissing) {
+        NSString * mediaPath = [capturePath stringByAppendingPathComponent:[[info objectForKey:@"media_file"] lastPathComponent]];
+        NSString * thumbnailPath = [capturePath stringByAppendingPathComponent:[[info objectForKey:@"thumbnail_file"] lastPathComponent]];
+        [[[STRCaptureFileOrganizer alloc] init] writeThumbnailForMediaAtPath:mediaPath toPath:thumbnailPath];
+    }
+
+    BOOL repaired = ([self checkCaptureAtPath:capturePath info:NULL] == STRCaptureIssueNone);
+    if (repaired) {
+        STRLogInfo(STRLogCategoryStorage, @"STRCaptureIntegrityScanner: Repaired capture %@.", [capturePath lastPathComponent]);
+    }
+    return repaired;
+}
+
+-(BOOL)rebuildCaptureInfoAtPath:(NSString *)capturePath {
+    NSString * token = [capturePath lastPathComponent];
+    NSString * mediaName = [self mediaFileNameInCaptureAtPath:capturePath];
+    if (!mediaName) return NO;
+
+    // The location comes from the first point of the track
+    NSString * geoDataPath = [capturePath stringByAppendingPathComponent:[token stringByAppendingPathExtension:@"json"]];
+    NSData * geoData = [NSData dataWithContentsOfFile:geoDataPath];
+    NSDictionary * geoDataObject = (geoData) ? [NSJSONSerialization JSONObjectWithData:geoData options:0 error:nil] : nil;
+    NSArray * points = ([geoDataObject isKindOfClass:[NSDictionary class]]) ? [geoDataObject objectForKey:@"points"] : nil;
+    NSDictionary * firstPoint = ([points isKindOfClass:[NSArray class]] && points.count > 0) ? [points objectAtIndex:0] : nil;
+    NSArray * coords = ([firstPoint isKindOfClass:[NSDictionary class]]) ? [firstPoint objectForKey:@"coords"] : nil;
+    if (![coords isKindOfClass:[NSArray class]] || coords.count < 2) return NO;
+    NSNumber * heading = ([[firstPoint objectForKey:@"heading"] isKindOfClass:[NSNumber class]]) ? [firstPoint objectForKey:@"heading"] : @(0.0);
+
+    // Legacy tokens carry no date; the media file was written when the capture was made
+    NSDate * creationDate = [STRCaptureToken creationDateForToken:token];
+    if (!creationDate) {
+        struct stat info;
+        creationDate = (stat([[capturePath stringByAppendingPathComponent:mediaName] fileSystemRepresentation], &info) == 0) ? [NSDate dateWithTimeIntervalSince1970:info.st_mtime] : [NSDate date];
+    }
+
+    // The upload date is lost with the file, so the capture will be offered for upload again
+    NSString * relativePath = [token stringByAppendingPathComponent:token];
+    NSDictionary * captureInfo = @{
+    @"created_at" : @([creationDate timeIntervalSince1970]),
+    @"geodata_file" : [relativePath stringByAppendingPathExtension:@"json"],
+    @"coords" : @[ [coords objectAtIndex:0], [coords objectAtIndex:1] ],
+    @"heading" : heading,
+    @"media_file" : [token stringByAppendingPathComponent:mediaName],
+    @"orientation" : @"vertical",
+    @"thumbnail_file" : [relativePath stringByAppendingPathExtension:@"png"],
+    @"title" : @"Untitled Capture",
+    @"token" : token,
+    @"media_type" : ([[mediaName pathExtension] isEqualToString:@"mov"]) ? @"video" : @"image",
+    @"uploaded_at" : @0
+    };
+    NSData * captureInfoData = [NSJSONSerialization dataWithJSONObject:captureInfo options:0 error:nil];
+    return [captureInfoData writeToFile:[capturePath stringByAppendingPathComponent:kSTRCaptureInfoFile] atomically:YES];
+}
+
+-(NSString *)mediaFileNameInCaptureAtPath:(NSString *)capturePath {
+    NSString * token = [capturePath lastPathComponent];
+    for (NSString * extension in @[ @"mov", @"jpg" ]) {
+        NSString * name = [token stringByAppendingPathExtension:extension];
+        if (STRFileSize([capturePath stringByAppendingPathComponent:name]) >= 0) return name;
+    }
+    return nil;
+}
+
+@end
@@ -0,0 +1,72 @@
+//
+//  STRCaptureLockTable.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Reader/writer locks for the files of single captures.
+
+ The capture info file of a capture is never changed in place. Every writer builds the new file beside the old one and renames it over it, so anyone who opens the file sees either the old snapshot or the new one in full. Listings, queries and [STRCapture captureWithToken:] read these snapshots without taking any lock.
+
+ What the rename does not cover is two writers doing a read-modify-write of the same info file at once, where the second would write back what it read before the first had finished and lose the first change, and readers that need several files of a capture to belong together, such as the body of an upload, while the capture is being moved or deleted. Those take the lock of the capture:
+
+ - Writers — [STRCapture save], track summary backfills, segment closes, integrity repairs, migration, quarantine and deletion — hold the write lock of the capture while they read and replace its files.
+ - Readers of several files hold the read lock, which any number of them can share.
+
+ Locks are found by hashing the token into a fixed table of stripes, so there is no lock object to create or clean up for each capture, and work on different captures almost never waits. Two captures that share a stripe only wait for each other; they never deadlock, as long as a block never takes a second capture lock. Nothing in the SDK does, and callers should not either.
+ */
+@interface STRCaptureLockTable : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Creating a Lock Table
+///---------------------------------------------------------------------------------------
+
+/**
+ The lock table that guards every capture of the SDK.
+
+ @return STRCaptureLockTable The shared table, with 128 stripes.
+ */
++(STRCaptureLockTable *)sharedTable;
+
+/**
+ Creates a lock table.
+
+ @param stripeCount The number of locks that tokens are spread over. At least 1.
+ */
+-(id)initWithStripeCount:(NSUInteger)stripeCount;
+
+/**
+ The number of locks that tokens are spread over.
+ */
+@property(readonly)NSUInteger stripeCount;
+
+///---------------------------------------------------------------------------------------
+/// @name Locking Captures
+///---------------------------------------------------------------------------------------
+
+/**
+ Runs a block while holding the read lock of a capture.
+
+ Other readers of the capture run at the same time; writers wait until the block returns.
+
+ @param token The token of the capture.
+
+ @param block The block to run. It must not lock another capture.
+ */
+-(void)readCaptureWithToken:(NSString *)token usingBlock:(void (^)(void))block;
+
+/**
+ Runs a block while holding the write lock of a capture.
+
+ @param token The token of the capture.
+
+ @param block The block to run. It must not lock another capture.
+ */
+-(void)writeCaptureWithToken:(NSString *)token usingBlock:(void (^)(void))block;
+
+@end
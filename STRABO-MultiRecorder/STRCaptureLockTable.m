@@ -0,0 +1,94 @@
+//
+//  STRCaptureLockTable.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <pthread.h>
+
+#import "STRCaptureLockTable.h"
+
+// Enough stripes that a few dozen threads working on different captures rarely
+// meet, while the whole table stays a few kilobytes
+#define kSTRDefaultStripeCount 128
+
+@interface STRCaptureLockTable () {
+    pthread_rwlock_t * _locks;
+}
+
+@property(readwrite)NSUInteger stripeCount;
+
+@end
+
+@interface STRCaptureLockTable (InternalMethods)
+
+// -- Stripes -- //
+-(pthread_rwlock_t *)lockForToken:(NSString *)token;
+
+@end
+
+@implementation STRCaptureLockTable
+
++(STRCaptureLockTable *)sharedTable {
+    static STRCaptureLockTable * sharedTable = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedTable = [[STRCaptureLockTable alloc] initWithStripeCount:kSTRDefaultStripeCount];
+    });
+    return sharedTable;
+}
+
+-(id)init {
+    return [self initWithStripeCount:kSTRDefaultStripeCount];
+}
+
+-(id)initWithStripeCount:(NSUInteger)stripeCount {
+    self = [super init];
+    if (self) {
+        self.stripeCount = MAX(stripeCount, (NSUInteger)1);
+        _locks = calloc(self.stripeCount, sizeof(pthread_rwlock_t));
+        if (!_locks) return nil;
+        for (NSUInteger i = 0; i < self.stripeCount; i++) {
+            pthread_rwlock_init(&_locks[i], NULL);
+        }
+    }
+    return self;
+}
+
+-(void)dealloc {
+    for (NSUInteger i = 0; _locks && i < self.stripeCount; i++) {
+        pthread_rwlock_destroy(&_locks[i]);
+    }
+    free(_locks);
+}
+
+-(void)readCaptureWithToken:(NSString *)token usingBlock:(void (^)(void))block {
+    pthread_rwlock_t * lock = [self lockForToken:token];
+    pthread_rwlock_rdlock(lock);
+    block();
+    pthread_rwlock_unlock(lock);
+}
+
+-(void)writeCaptureWithToken:(NSString *)token usingBlock:(void (^)(void))block {
+    pthread_rwlock_t * lock = [self lockForToken:token];
+    pthread_rwlock_wrlock(lock);
+    block();
+    pthread_rwlock_unlock(lock);
+}
+
+@end
+
+
+@implementation STRCaptureLockTable (InternalMethods)
+
+#pragma mark - Stripes
+
+-(pthread_rwlock_t *)lockForToken:(NSString *)token {
+    // Tokens differ in their timestamp and random parts, so their hashes spread
+    // evenly; a nil token always gets the first stripe
+    return &_locks[token.hash % self.stripeCount];
+}
+
+@end
@@ -0,0 +1,222 @@
+//
+//  STRCapturePathResolver.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Decides where captures live on disk and finds them again.
+
+ Every class that reads or writes capture files asks the shared resolver for paths instead of building them from `Documents/StraboCaptures` itself.
+
+ Sharded Layout
+ --------------
+
+ Earlier versions of the SDK kept every capture directory directly inside `Documents/StraboCaptures`. With tens of thousands of captures, listing and looking up paths in that one directory becomes slow. Captures are now grouped into shard directories:
+
+ - A capture with a time-ordered token (see STRCaptureToken) goes into `t` followed by the first 5 characters of its token. Each of these shards holds the captures of about three days, and their names sort by date.
+ - A capture with a legacy hash token goes into `h` followed by the first 2 characters of its token, which spreads legacy captures over 256 shards.
+
+ For example, the capture `013901a38fa0f3b9a2c17d04be55e96a` lives in `StraboCaptures/t01390/013901a38fa0f3b9a2c17d04be55e96a`.
+
+ The paths inside a capture's info file still have the form `token/token.ext`. The SDK only uses the file names from those paths, so moving a capture directory does not require rewriting its info file.
+
+ Migration
+ ---------
+
+ Captures left in the flat layout are moved into their shards by beginMigrationIfNeeded, which STRCaptureFileManager calls the first time it is used. Each capture is moved with a single rename, so at every moment it is either in its old place or in its new one. Lookups check both places, and listings include both, so no capture is ever unreachable while the migration runs. If the app is stopped part way, the migration picks up where it left off on the next launch. When no flat captures are left, a `.sharded-layout` marker file is written to the captures directory and later launches skip the migration.
+
+ Quarantine
+ ----------
+
+ Captures that STRCaptureIntegrityScanner finds damaged beyond repair can be moved to the `.quarantine` directory inside the captures directory. Entries whose names start with a period are never listed, so quarantined captures disappear from every listing but stay on disk until they are restored or deleted.
+ */
+@interface STRCapturePathResolver : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Getting the Resolver
+///---------------------------------------------------------------------------------------
+
+/**
+ The resolver for `Documents/StraboCaptures`, used by the whole SDK.
+
+ @return STRCapturePathResolver The shared resolver.
+ */
++(STRCapturePathResolver *)sharedResolver;
+
+/**
+ Creates a resolver for captures stored somewhere else, such as a test directory.
+
+ @param capturesDirectoryPath The absolute path of the captures directory.
+
+ @return STRCapturePathResolver A new resolver.
+ */
+-(id)initWithCapturesDirectoryPath:(NSString *)capturesDirectoryPath;
+
+/**
+ The absolute path of the directory that holds all captures.
+ */
+@property(readonly)NSString * capturesDirectoryPath;
+
+///---------------------------------------------------------------------------------------
+/// @name Resolving Paths
+///---------------------------------------------------------------------------------------
+
+/**
+ The name of the shard that a capture belongs in.
+
+ @param token The capture's token.
+
+ @return NSString The shard directory name, or nil if the string is not a token.
+ */
+-(NSString *)shardForToken:(NSString *)token;
+
+/**
+ The directory, relative to the captures directory, that a new capture should be written to.
+
+ @param token The capture's token.
+
+ @return NSString A relative path of the form `shard/token`.
+ */
+-(NSString *)relativeDirectoryForToken:(NSString *)token;
+
+/**
+ Finds the directory of an existing capture, in either the sharded or the flat layout.
+
+ @param token The capture's token.
+
+ @return NSString The directory relative to the captures directory, or nil if there is no such capture.
+ */
+-(NSString *)relativeDirectoryOfCaptureWithToken:(NSString *)token;
+
+/**
+ Turns a path relative to the captures directory into an absolute path.
+
+ @param relativePath A path such as the [mediaPath]([STRCapture mediaPath]) of a capture.
+
+ @return NSString The absolute path.
+ */
+-(NSString *)absolutePathForRelativePath:(NSString *)relativePath;
+
+/**
+ Turns the relative path of a capture file into an absolute path, following the capture if it has been moved since the path was read.
+
+ @param relativePath A path of the form `[shard/]token/file`.
+
+ @return NSString The absolute path of the file in the capture's current directory.
+ */
+-(NSString *)absolutePathForCaptureFile:(NSString *)relativePath;
+
+///---------------------------------------------------------------------------------------
+/// @name Listing Captures
+///---------------------------------------------------------------------------------------
+
+/**
+ Lists the directories of all captures, in no particular order.
+
+ @return NSArray Relative directory paths. Each capture appears once, even if it is moved while the list is built.
+ */
+-(NSArray *)allCaptureDirectories;
+
+/**
+ Lists the directories of captures with legacy tokens, in no particular order.
+
+ These captures carry no date in their names, so sorting them requires reading their info files.
+
+ @return NSArray Relative directory paths.
+ */
+-(NSArray *)legacyCaptureDirectories;
+
+/**
+ Visits the captures with time-ordered tokens, newest first.
+
+ Shards are listed one at a time and only when the enumeration reaches them, so stopping early avoids listing the older shards.
+
+ @param startDate The oldest creation date of interest, or nil for no limit.
+
+ @param endDate The newest creation date of interest, or nil for no limit.
+
+ @param block Called with the relative directory of each capture. Set `stop` to YES to end the enumeration.
+ */
+-(void)enumerateTimeOrderedCaptureDirectoriesFromDate:(NSDate *)startDate toDate:(NSDate *)endDate usingBlock:(void (^)(NSString * relativeDirectory, BOOL * stop))block;
+
+/**
+ Visits the captures with time-ordered tokens in either order.
+
+ @param startDate The oldest creation date of interest, or nil for no limit.
+
+ @param endDate The newest creation date of interest, or nil for no limit.
+
+ @param oldestFirst YES to visit the oldest captures first instead of the newest.
+
+ @param block Called with the relative directory of each capture. Set `stop` to YES to end the enumeration.
+ */
+-(void)enumerateTimeOrderedCaptureDirectoriesFromDate:(NSDate *)startDate toDate:(NSDate *)endDate oldestFirst:(BOOL)oldestFirst usingBlock:(void (^)(NSString * relativeDirectory, BOOL * stop))block;
+
+///---------------------------------------------------------------------------------------
+/// @name Migrating From the Flat Layout
+///---------------------------------------------------------------------------------------
+
+/**
+ Whether beginMigrationIfNeeded starts a migration. Defaults to YES.
+ */
+@property(nonatomic, assign)BOOL migratesAutomatically;
+
+/**
+ Starts moving flat captures into their shards on a background queue, unless the migration is already done or running.
+ */
+-(void)beginMigrationIfNeeded;
+
+/**
+ Moves flat captures into their shards on the calling thread.
+
+ @return NSUInteger The number of captures that were moved.
+ */
+-(NSUInteger)migrateFlatCaptures;
+
+/**
+ Checks whether the migration has finished for this captures directory.
+
+ @return BOOL YES if the layout marker file exists.
+ */
+-(BOOL)isMigrationComplete;
+
+///---------------------------------------------------------------------------------------
+/// @name Quarantine
+///---------------------------------------------------------------------------------------
+
+/**
+ The absolute path of the directory that quarantined captures are moved to.
+ */
+-(NSString *)quarantineDirectoryPath;
+
+/**
+ Moves a capture out of the listings and into the quarantine directory.
+
+ @param relativeDirectory The capture's directory, relative to the captures directory.
+
+ @return BOOL YES if the capture was moved.
+ */
+-(BOOL)quarantineCaptureAtRelativeDirectory:(NSString *)relativeDirectory;
+
+/**
+ Lists the captures in the quarantine directory.
+
+ @return NSArray Directory names. A name is the capture's token, followed by `-` and a number if the same capture was quarantined more than once.
+ */
+-(NSArray *)quarantinedCaptureNames;
+
+/**
+ Moves a quarantined capture back into its shard.
+
+ @param name A name returned by quarantinedCaptureNames.
+
+ @return BOOL YES if the capture was restored. NO if it could not be moved or a capture with the same token already exists.
+ */
+-(BOOL)restoreQuarantinedCaptureNamed:(NSString *)name;
+
+@end
@@ -0,0 +1,330 @@
+//
+//  STRCapturePathResolver.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCapturePathResolver.h"
+#import "STRCaptureChangeFeed.h"
+#import "STRCaptureLockTable.h"
+#import "STRCaptureToken.h"
+#import "STRLogger.h"
+
+#import <libkern/OSAtomic.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#define kSTRLayoutMarkerFile @".sharded-layout"
+#define kSTRQuarantineDirectory @".quarantine"
+#define kSTRTimeOrderedShardPrefix @"t"
+#define kSTRLegacyShardPrefix @"h"
+// Token characters in a shard name. A time-ordered shard spans 16^7 milliseconds, about three days.
+#define kSTRTimeOrderedShardLength 5
+#define kSTRLegacyShardLength 2
+#define kSTRTimeOrderedShardSpan (1ULL << 28)
+
+@interface STRCapturePathResolver () {
+    NSFileManager * _fileManager;
+    int32_t volatile _migrationRunning;
+}
+@end
+
+@interface STRCapturePathResolver (InternalMethods)
+-(NSArray *)rootEntries;
+-(BOOL)isTimeOrderedShard:(NSString *)name;
+-(BOOL)isLegacyShard:(NSString *)name;
+-(BOOL)directoryExistsAtRelativePath:(NSString *)relativePath;
+-(void)writeLayoutMarker;
+@end
+
+@implementation STRCapturePathResolver
+
+@synthesize capturesDirectoryPath = _capturesDirectoryPath;
+@synthesize migratesAutomatically = _migratesAutomatically;
+
+#pragma mark - Getting the Resolver
+
++(STRCapturePathResolver *)sharedResolver {
+    static STRCapturePathResolver * sharedResolver;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedResolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:[NSHomeDirectory() stringByAppendingPathComponent:@"Documents/StraboCaptures"]];
+    });
+    return sharedResolver;
+}
+
+-(id)initWithCapturesDirectoryPath:(NSString *)capturesDirectoryPath {
+    self = [super init];
+    if (self) {
+        _capturesDirectoryPath = [capturesDirectoryPath copy];
+        _fileManager = [[NSFileManager alloc] init];
+        _migratesAutomatically = YES;
+    }
+    return self;
+}
+
+#pragma mark - Resolving Paths
+
+-(NSString *)shardForToken:(NSString *)token {
+    if ([STRCaptureToken isTimeOrderedToken:token]) {
+        return [kSTRTimeOrderedShardPrefix stringByAppendingString:[token substringToIndex:kSTRTimeOrderedShardLength]];
+    }
+    if ([STRCaptureToken isValidToken:token]) {
+        return [kSTRLegacyShardPrefix stringByAppendingString:[token substringToIndex:kSTRLegacyShardLength]];
+    }
+    return nil;
+}
+
+-(NSString *)relativeDirectoryForToken:(NSString *)token {
+    NSString * shard = [self shardForToken:token];
+    return (shard) ? [shard stringByAppendingPathComponent:token] : token;
+}
+
+-(NSString *)relativeDirectoryOfCaptureWithToken:(NSString *)token {
+    if (token.length == 0) return nil;
+    NSString * sharded = [self relativeDirectoryForToken:token];
+    if ([self directoryExistsAtRelativePath:sharded]) return sharded;
+    if ([self directoryExistsAtRelativePath:token]) return token;
+    // The migration may have moved it between the two checks
+    if ([self directoryExistsAtRelativePath:sharded]) return sharded;
+    return nil;
+}
+
+-(NSString *)absolutePathForRelativePath:(NSString *)relativePath {
+    return [self.capturesDirectoryPath stringByAppendingPathComponent:relativePath];
+}
+
+-(NSString *)absolutePathForCaptureFile:(NSString *)relativePath {
+    NSString * absolutePath = [self absolutePathForRelativePath:relativePath];
+    if ([_fileManager fileExistsAtPath:absolutePath]) return absolutePath;
+
+    // The capture was moved after the path was read; look it up again by token
+    NSArray * components = [relativePath pathComponents];
+    if (components.count < 2) return absolutePath;
+    NSString * token = [components objectAtIndex:components.count - 2];
+    NSString * directory = [self relativeDirectoryOfCaptureWithToken:token];
+    if (!directory) return absolutePath;
+    return [[self absolutePathForRelativePath:directory] stringByAppendingPathComponent:[relativePath lastPathComponent]];
+}
+
+#pragma mark - Listing Captures
+
+-(NSArray *)allCaptureDirectories {
+    NSMutableArray * directories = [NSMutableArray arrayWithArray:[self legacyCaptureDirectories]];
+    [self enumerateTimeOrderedCaptureDirectoriesFromDate:nil toDate:nil usingBlock:^(NSString * relativeDirectory, BOOL * stop) {
+        [directories addObject:relativeDirectory];
+    }];
+    return directories;
+}
+
+-(NSArray *)legacyCaptureDirectories {
+    // The root is listed before the shards. A capture moved in between then shows up twice rather than not at all.
+    NSArray * rootEntries = [self rootEntries];
+    NSMutableDictionary * directories = [NSMutableDictionary dictionary];
+    NSMutableArray * shards = [NSMutableArray array];
+    for (NSString * entry in rootEntries) {
+        if ([self isLegacyShard:entry]) {
+            [shards addObject:entry];
+        } else if (![STRCaptureToken isTimeOrderedToken:entry] && ![self isTimeOrderedShard:entry] && ![entry hasPrefix:@"."]) {
+            [directories setObject:entry forKey:entry];
+        }
+    }
+    for (NSString * shard in shards) {
+        for (NSString * token in [_fileManager contentsOfDirectoryAtPath:[self absolutePathForRelativePath:shard] error:nil]) {
+            if ([token hasPrefix:@"."]) continue;
+            [directories setObject:[shard stringByAppendingPathComponent:token] forKey:token];
+        }
+    }
+    return [directories allValues];
+}
+
+-(void)enumerateTimeOrderedCaptureDirectoriesFromDate:(NSDate *)startDate toDate:(NSDate *)endDate usingBlock:(void (^)(NSString * relativeDirectory, BOOL * stop))block {
+    [self enumerateTimeOrderedCaptureDirectoriesFromDate:startDate toDate:endDate oldestFirst:NO usingBlock:block];
+}
+
+-(void)enumerateTimeOrderedCaptureDirectoriesFromDate:(NSDate *)startDate toDate:(NSDate *)endDate oldestFirst:(BOOL)oldestFirst usingBlock:(void (^)(NSString * relativeDirectory, BOOL * stop))block {
+    unsigned long long startTime = (startDate) ? (unsigned long long)MAX([startDate timeIntervalSince1970] * 1000, 0) : 0;
+    unsigned long long endTime = (endDate) ? (unsigned long long)MAX([endDate timeIntervalSince1970] * 1000, 0) : ULLONG_MAX;
+
+    // Flat captures that have not been migrated yet are listed with the shard they belong to
+    NSMutableSet * shards = [NSMutableSet set];
+    NSMutableDictionary * flatTokens = [NSMutableDictionary dictionary];
+    for (NSString * entry in [self rootEntries]) {
+        if ([self isTimeOrderedShard:entry]) {
+            [shards addObject:entry];
+        } else if ([STRCaptureToken isTimeOrderedToken:entry]) {
+            NSString * shard = [self shardForToken:entry];
+            [shards addObject:shard];
+            NSMutableArray * tokens = [flatTokens objectForKey:shard];
+            if (!tokens) {
+                tokens = [NSMutableArray array];
+                [flatTokens setObject:tokens forKey:shard];
+            }
+            [tokens addObject:entry];
+        }
+    }
+
+    NSArray * sortedShards = [[shards allObjects] sortedArrayUsingSelector:@selector(compare:)];
+    if (!oldestFirst) sortedShards = [[sortedShards reverseObjectEnumerator] allObjects];
+    BOOL stop = NO;
+    for (NSString * shard in sortedShards) {
+        unsigned long long shardStart = strtoull([[shard substringFromIndex:1] UTF8String], NULL, 16) * kSTRTimeOrderedShardSpan;
+        // Shards outside the range are skipped, and the walk ends at the first shard past it
+        if (shardStart > endTime) {
+            if (oldestFirst) break;
+            continue;
+        }
+        if (shardStart + kSTRTimeOrderedShardSpan <= startTime) {
+            if (oldestFirst) continue;
+            break;
+        }
+
+        @autoreleasepool {
+            NSMutableDictionary * directories = [NSMutableDictionary dictionary];
+            for (NSString * token in [flatTokens objectForKey:shard]) {
+                [directories setObject:token forKey:token];
+            }
+            for (NSString * token in [_fileManager contentsOfDirectoryAtPath:[self absolutePathForRelativePath:shard] error:nil]) {
+                if (![STRCaptureToken isTimeOrderedToken:token]) continue;
+                [directories setObject:[shard stringByAppendingPathComponent:token] forKey:token];
+            }
+            NSArray * tokens = [[directories allKeys] sortedArrayUsingSelector:@selector(compare:)];
+            for (NSString * token in (oldestFirst) ? [tokens objectEnumerator] : [tokens reverseObjectEnumerator]) {
+                block([directories objectForKey:token], &stop);
+                if (stop) return;
+            }
+        }
+    }
+}
+
+#pragma mark - Migrating From the Flat Layout
+
+-(void)beginMigrationIfNeeded {
+    if (!self.migratesAutomatically || [self isMigrationComplete]) return;
+    if (!OSAtomicCompareAndSwap32Barrier(0, 1, &_migrationRunning)) return;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        [self migrateFlatCaptures];
+        OSAtomicCompareAndSwap32Barrier(1, 0, &_migrationRunning);
+    });
+}
+
+-(NSUInteger)migrateFlatCaptures {
+    NSUInteger moved = 0;
+    NSUInteger remaining = 0;
+    for (NSString * entry in [self rootEntries]) {
+        NSString * shard = [self shardForToken:entry];
+        if (!shard) continue;
+        @autoreleasepool {
+            NSString * shardPath = [self absolutePathForRelativePath:shard];
+            [_fileManager createDirectoryAtPath:shardPath withIntermediateDirectories:YES attributes:nil error:nil];
+            NSString * from = [self absolutePathForRelativePath:entry];
+            NSString * to = [shardPath stringByAppendingPathComponent:entry];
+            // A single rename, so the capture is always in exactly one of the two places.
+            // It is made under the write lock, so no save or upload has the capture open.
+            __block int result;
+            [[STRCaptureLockTable sharedTable] writeCaptureWithToken:entry usingBlock:^{
+                result = rename([from fileSystemRepresentation], [to fileSystemRepresentation]);
+            }];
+            if (result == 0) {
+                moved++;
+            } else {
+                remaining++;
+                STRLogWarning(STRLogCategoryStorage, @"STRCapturePathResolver: Could not move capture %@ into its shard: %s", entry, strerror(errno));
+            }
+        }
+    }
+    if (remaining == 0) {
+        [self writeLayoutMarker];
+    }
+    if (moved > 0) {
+        STRLogInfo(STRLogCategoryStorage, @"STRCapturePathResolver: Moved %lu captures into the sharded layout.", (unsigned long)moved);
+    }
+    return moved;
+}
+
+-(BOOL)isMigrationComplete {
+    return [_fileManager fileExistsAtPath:[self absolutePathForRelativePath:kSTRLayoutMarkerFile]];
+}
+
+#pragma mark - Quarantine
+
+-(NSString *)quarantineDirectoryPath {
+    return [self absolutePathForRelativePath:kSTRQuarantineDirectory];
+}
+
+-(BOOL)quarantineCaptureAtRelativeDirectory:(NSString *)relativeDirectory {
+    [_fileManager createDirectoryAtPath:[self quarantineDirectoryPath] withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString * token = [relativeDirectory lastPathComponent];
+    NSString * to = [[self quarantineDirectoryPath] stringByAppendingPathComponent:token];
+    // Keep earlier quarantined copies of the same capture
+    for (int attempt = 1; [_fileManager fileExistsAtPath:to]; attempt++) {
+        to = [[self quarantineDirectoryPath] stringByAppendingPathComponent:[NSString stringWithFormat:@"%@-%d", token, attempt]];
+    }
+    NSString * from = [self absolutePathForRelativePath:relativeDirectory];
+    __block int result;
+    [[STRCaptureLockTable sharedTable] writeCaptureWithToken:token usingBlock:^{
+        result = rename([from fileSystemRepresentation], [to fileSystemRepresentation]);
+    }];
+    if (result != 0) {
+        STRLogError(STRLogCategoryStorage, @"STRCapturePathResolver: Could not quarantine capture %@: %s", token, strerror(errno));
+        return NO;
+    }
+    STRLogWarning(STRLogCategoryStorage, @"STRCapturePathResolver: Quarantined capture %@.", token);
+    [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeDeleted token:token fields:nil];
+    return YES;
+}
+
+-(NSArray *)quarantinedCaptureNames {
+    NSArray * names = [_fileManager contentsOfDirectoryAtPath:[self quarantineDirectoryPath] error:nil];
+    return (names) ? names : @[];
+}
+
+-(BOOL)restoreQuarantinedCaptureNamed:(NSString *)name {
+    NSString * token = [[name componentsSeparatedByString:@"-"] objectAtIndex:0];
+    if ([self relativeDirectoryOfCaptureWithToken:token]) {
+        STRLogError(STRLogCategoryStorage, @"STRCapturePathResolver: Capture %@ already exists and was not restored.", token);
+        return NO;
+    }
+    NSString * to = [self absolutePathForRelativePath:[self relativeDirectoryForToken:token]];
+    [_fileManager createDirectoryAtPath:[to stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString * from = [[self quarantineDirectoryPath] stringByAppendingPathComponent:name];
+    if (rename([from fileSystemRepresentation], [to fileSystemRepresentation]) != 0) {
+        STRLogError(STRLogCategoryStorage, @"STRCapturePathResolver: Could not restore capture %@: %s", token, strerror(errno));
+        return NO;
+    }
+    [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeAdded token:token fields:nil];
+    return YES;
+}
+
+@end
+
+@implementation STRCapturePathResolver (InternalMethods)
+
+-(NSArray *)rootEntries {
+    NSArray * entries = [_fileManager contentsOfDirectoryAtPath:self.capturesDirectoryPath error:nil];
+    return (entries) ? entries : @[];
+}
+
+-(BOOL)isTimeOrderedShard:(NSString *)name {
+    return name.length == kSTRTimeOrderedShardLength + 1 && [name hasPrefix:kSTRTimeOrderedShardPrefix];
+}
+
+-(BOOL)isLegacyShard:(NSString *)name {
+    return name.length == kSTRLegacyShardLength + 1 && [name hasPrefix:kSTRLegacyShardPrefix];
+}
+
+-(BOOL)directoryExistsAtRelativePath:(NSString *)relativePath {
+    BOOL isDirectory = NO;
+    return [_fileManager fileExistsAtPath:[self absolutePathForRelativePath:relativePath] isDirectory:&isDirectory] && isDirectory;
+}
+
+-(void)writeLayoutMarker {
+    NSDictionary * marker = @{ @"layout" : @"sharded", @"version" : @1, @"migrated_at" : @([[NSDate date] timeIntervalSince1970]) };
+    NSData * markerData = [NSJSONSerialization dataWithJSONObject:marker options:0 error:nil];
+    [markerData writeToFile:[self absolutePathForRelativePath:kSTRLayoutMarkerFile] atomically:YES];
+}
+
+@end
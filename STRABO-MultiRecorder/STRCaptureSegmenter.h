@@ -0,0 +1,178 @@
+//
+//  STRCaptureSegmenter.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "STRTrackFilter.h"
+
+@class STRCaptureSegmenter;
+
+/**
+ Implement the STRCaptureSegmenterDelegate to hand each segment of a capture on as soon as it is written.
+
+ All of the methods in this protocol are optional. They are called on the thread that closed the segment or finished the capture.
+ */
+@protocol STRCaptureSegmenterDelegate <NSObject>
+
+@optional
+
+/**
+ Reports that a segment was closed and that its files are in the capture directory.
+
+ @param segmenter The segmenter.
+
+ @param segment The segment, as it is recorded in the `segments` array of the capture info file.
+ */
+-(void)captureSegmenter:(STRCaptureSegmenter *)segmenter didCloseSegment:(NSDictionary *)segment;
+
+/**
+ Reports that the capture is complete: the whole track and its filtered version have been written and the capture info file lists every segment.
+
+ @param segmenter The segmenter.
+ */
+-(void)captureSegmenterDidFinish:(STRCaptureSegmenter *)segmenter;
+
+@end
+
+/**
+ Writes a video capture as a series of fixed-length segments while it is being recorded.
+
+ A STRCaptureViewController with a [segmentDuration]([STRCaptureViewController segmentDuration]) uses a segmenter to store its recordings. Each time the data collector closes a movie file, the segmenter moves it into the capture directory as the next segment, writes the geodata points recorded during the segment beside it, and appends the segment to the `segments` array of the capture info file. The capture is listed by the STRCaptureFileManager as soon as the first segment is closed, and each segment can be uploaded while the next one is being recorded.
+
+ The geodata file of a segment holds the points whose timestamps fall within it, with timestamps counted from the start of the segment. If no point was recorded at the very start of the segment, the last point of the previous segment is repeated there, so that every segment can be placed on a map without the others. When the capture is finished, the whole track is written to the capture's usual geodata file, with timestamps counted from the start of the capture, and smoothed with a STRTrackFilter.
+
+ The segmenter only deals with files, so it does not need a camera. See the [Underlying Mechanics](UnderlyingMechanics) guide for the format of the `segments` array.
+
+ @warning A segmenter is not thread safe. Add samples, close segments and finish the capture from one thread.
+ */
+@interface STRCaptureSegmenter : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Creating Segmenters
+///---------------------------------------------------------------------------------------
+
+/**
+ Returns a segmenter for a new capture in the captures directory.
+
+ The capture gets a new token, and its directory is the one the shared STRCapturePathResolver gives that token.
+
+ @param segmentDuration The length of each segment, in seconds.
+
+ @return STRCaptureSegmenter A new segmenter.
+ */
++(STRCaptureSegmenter *)segmenterWithSegmentDuration:(NSTimeInterval)segmentDuration;
+
+/**
+ Initializes a segmenter that writes a capture into a given directory.
+
+ Nothing is written until the first segment is closed.
+
+ @param token The token of the capture.
+
+ @param directoryPath The absolute path of the capture directory. It is created if it does not exist.
+
+ @param segmentDuration The length of each segment, in seconds.
+
+ @return id The segmenter.
+ */
+-(id)initWithToken:(NSString *)token directoryPath:(NSString *)directoryPath segmentDuration:(NSTimeInterval)segmentDuration;
+
+/**
+ The delegate of the segmenter.
+ */
+@property(weak)id<STRCaptureSegmenterDelegate> delegate;
+
+/**
+ The token of the capture.
+ */
+@property(readonly)NSString * token;
+
+/**
+ The absolute path of the capture directory.
+ */
+@property(readonly)NSString * directoryPath;
+
+/**
+ The length of each segment, in seconds. It is recorded in the capture info file as `segment_duration`.
+ */
+@property(readonly)NSTimeInterval segmentDuration;
+
+/**
+ Fields to add to the capture info file, such as `coords`, `heading` and `orientation`.
+
+ Set them before the first segment is closed. Fields that the segmenter writes itself, such as `media_file` and `segments`, are not replaced.
+ */
+@property(copy)NSDictionary * initialInfo;
+
+///---------------------------------------------------------------------------------------
+/// @name Recording Segments
+///---------------------------------------------------------------------------------------
+
+/**
+ Adds a geodata point to the capture.
+
+ @param sample The point. Its timestamp is counted from the start of the capture, and must not be earlier than that of the point added before it.
+ */
+-(void)addSample:(STRTrackSample)sample;
+
+/**
+ Closes the current segment.
+
+ The media file is moved into the capture directory, and the points recorded before the end of the segment are written to its geodata file. Points with later timestamps are kept for the next segment. The capture info file is then rewritten atomically and the delegate is told about the segment.
+
+ @param mediaPath The path of the movie file that holds the segment.
+
+ @param startTime The time, counted from the start of the capture, at which the movie file began. It is moved forward to the end of the previous segment if it is earlier.
+
+ @param duration The length of the movie file, in seconds.
+
+ @return NSDictionary The segment, as it is recorded in the capture info file. Nil if the files could not be written, in which case the segment is not recorded and its points are kept for the next one.
+ */
+-(NSDictionary *)closeSegmentWithMediaAtPath:(NSString *)mediaPath startTime:(NSTimeInterval)startTime duration:(NSTimeInterval)duration;
+
+/**
+ Writes the whole track of the capture and marks the capture as complete.
+
+ Close the last segment before you call this method. Points recorded after the end of the last segment are kept in the whole track.
+
+ @return BOOL YES if the capture was completed. NO if no segment was closed or the files could not be written.
+ */
+-(BOOL)finish;
+
+/**
+ The segments closed so far, in order. Each is a dictionary as found in the `segments` array of the capture info file.
+ */
+@property(readonly)NSArray * segments;
+
+/**
+ YES once finish has completed the capture.
+ */
+@property(readonly, getter = isFinished)BOOL finished;
+
+///---------------------------------------------------------------------------------------
+/// @name Splitting Tracks
+///---------------------------------------------------------------------------------------
+
+/**
+ Returns the points of a track that belong to one segment.
+
+ This is the rule that closeSegmentWithMediaAtPath:startTime:duration: applies to the points of each segment, for tracks that are already complete.
+
+ @param samples The samples of the track, in the order of their timestamps.
+
+ @param count The number of samples.
+
+ @param startTime The start of the segment, counted from the start of the track.
+
+ @param endTime The end of the segment. Samples at this time belong to the next segment.
+
+ @return NSArray The point dictionaries of the segment, with timestamps counted from the start of the segment.
+ */
++(NSArray *)pointsOfSamples:(const STRTrackSample *)samples count:(NSUInteger)count fromTime:(NSTimeInterval)startTime toTime:(NSTimeInterval)endTime;
+
+@end
@@ -0,0 +1,297 @@
+//
+//  STRCaptureSegmenter.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureSegmenter.h"
+#import "STRCaptureChangeFeed.h"
+#import "STRCaptureLockTable.h"
+#import "STRCapturePathResolver.h"
+#import "STRCaptureToken.h"
+#import "STRTrackSummary.h"
+#import "NSDate+Date_Utilities.h"
+#import "STRLogger.h"
+
+#define kSTRCaptureInfoFile @"capture-info.json"
+#define kSTRDefaultMediaExtension @"mov"
+
+@interface STRCaptureSegmenter () {
+    NSMutableArray * _segments;
+    // Points not yet written to a segment, and the last point that was
+    NSMutableData * pendingSamples;
+    STRTrackSample previousSample;
+    BOOL hasPreviousSample;
+    // Every point of the capture, for the whole track
+    NSMutableData * allSamples;
+    NSTimeInterval closedUntil;
+}
+
+@property(readwrite)NSString * token;
+@property(readwrite)NSString * directoryPath;
+@property(readwrite)NSTimeInterval segmentDuration;
+@property(readwrite, getter = isFinished)BOOL finished;
+
+@end
+
+@interface STRCaptureSegmenter (InternalMethods)
+
+// -- Files -- //
+-(NSString *)relativePathForFileNamed:(NSString *)fileName;
+-(NSString *)fileNameForSegmentAtIndex:(NSUInteger)index extension:(NSString *)extension;
+-(BOOL)writePoints:(NSArray *)points toPath:(NSString *)path;
+-(BOOL)writeSamples:(const STRTrackSample *)samples count:(NSUInteger)count toPath:(NSString *)path;
+
+// -- Capture Info -- //
+-(BOOL)saveCaptureInfoFinished:(BOOL)finished;
+
+@end
+
+@implementation STRCaptureSegmenter
+
+#pragma mark - Creating Segmenters
+
++(STRCaptureSegmenter *)segmenterWithSegmentDuration:(NSTimeInterval)segmentDuration {
+    STRCapturePathResolver * resolver = [STRCapturePathResolver sharedResolver];
+    NSString * token = [STRCaptureToken generateToken];
+    NSString * directoryPath = [resolver absolutePathForRelativePath:[resolver relativeDirectoryForToken:token]];
+    return [[STRCaptureSegmenter alloc] initWithToken:token directoryPath:directoryPath segmentDuration:segmentDuration];
+}
+
+-(id)initWithToken:(NSString *)token directoryPath:(NSString *)directoryPath segmentDuration:(NSTimeInterval)segmentDuration {
+    self = [super init];
+    if (self) {
+        self.token = token;
+        self.directoryPath = directoryPath;
+        self.segmentDuration = segmentDuration;
+        _segments = [NSMutableArray array];
+        pendingSamples = [NSMutableData data];
+        allSamples = [NSMutableData data];
+    }
+    return self;
+}
+
+-(NSArray *)segments {
+    return [_segments copy];
+}
+
+#pragma mark - Recording Segments
+
+-(void)addSample:(STRTrackSample)sample {
+    [pendingSamples appendBytes:&sample length:sizeof(STRTrackSample)];
+    [allSamples appendBytes:&sample length:sizeof(STRTrackSample)];
+}
+
+-(NSDictionary *)closeSegmentWithMediaAtPath:(NSString *)mediaPath startTime:(NSTimeInterval)startTime duration:(NSTimeInterval)duration {
+    if (self.finished) return nil;
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    if (![fileManager createDirectoryAtPath:self.directoryPath withIntermediateDirectories:YES attributes:nil error:nil]) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureSegmenter: Could not create the directory of capture %@.", self.token);
+        return nil;
+    }
+
+    NSUInteger index = _segments.count;
+    NSTimeInterval start = MAX(startTime, closedUntil);
+    NSTimeInterval end = start + MAX(duration, 0);
+
+    // Split the pending points at the end of the segment. The point before
+    // them, if any, is passed along so that it can stand in at the start.
+    const STRTrackSample * pending = (const STRTrackSample *)[pendingSamples bytes];
+    NSUInteger pendingCount = pendingSamples.length / sizeof(STRTrackSample);
+    NSUInteger consumed = 0;
+    while (consumed < pendingCount && pending[consumed].timestamp < end) consumed++;
+    NSMutableData * candidates = [NSMutableData dataWithCapacity:(consumed + 1) * sizeof(STRTrackSample)];
+    if (hasPreviousSample) [candidates appendBytes:&previousSample length:sizeof(STRTrackSample)];
+    [candidates appendBytes:pending length:consumed * sizeof(STRTrackSample)];
+    NSArray * points = [STRCaptureSegmenter pointsOfSamples:(const STRTrackSample *)[candidates bytes] count:candidates.length / sizeof(STRTrackSample) fromTime:start toTime:end];
+
+    NSString * extension = ([mediaPath pathExtension].length > 0) ? [mediaPath pathExtension] : kSTRDefaultMediaExtension;
+    NSString * mediaName = [self fileNameForSegmentAtIndex:index extension:extension];
+    NSString * geoDataName = [self fileNameForSegmentAtIndex:index extension:@"json"];
+    NSString * newMediaPath = [self.directoryPath stringByAppendingPathComponent:mediaName];
+    NSError * error;
+    [fileManager removeItemAtPath:newMediaPath error:nil];
+    if (![fileManager moveItemAtPath:mediaPath toPath:newMediaPath error:&error]) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureSegmenter: Could not move segment %lu of capture %@: %@", (unsigned long)index, self.token, error);
+        return nil;
+    }
+    if (![self writePoints:points toPath:[self.directoryPath stringByAppendingPathComponent:geoDataName]]) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureSegmenter: Could not write the geodata of segment %lu of capture %@.", (unsigned long)index, self.token);
+        [fileManager moveItemAtPath:newMediaPath toPath:mediaPath error:nil];
+        return nil;
+    }
+
+    unsigned long long mediaBytes = [[fileManager attributesOfItemAtPath:newMediaPath error:nil] fileSize];
+    NSDictionary * segment = @{
+    @"index" : @(index),
+    @"start" : @(start),
+    @"duration" : @(end - start),
+    @"media_file" : [self relativePathForFileNamed:mediaName],
+    @"geodata_file" : [self relativePathForFileNamed:geoDataName],
+    @"media_bytes" : @(mediaBytes),
+    @"points" : @(points.count)
+    };
+    [_segments addObject:segment];
+    if (![self saveCaptureInfoFinished:NO]) {
+        [_segments removeLastObject];
+        [fileManager moveItemAtPath:newMediaPath toPath:mediaPath error:nil];
+        return nil;
+    }
+
+    // Only now that the segment is recorded are its points spent
+    if (consumed > 0) {
+        previousSample = pending[consumed - 1];
+        hasPreviousSample = YES;
+        [pendingSamples replaceBytesInRange:NSMakeRange(0, consumed * sizeof(STRTrackSample)) withBytes:NULL length:0];
+    }
+    closedUntil = end;
+
+    if (index == 0) {
+        [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeAdded token:self.token fields:nil];
+    } else {
+        [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeUpdated token:self.token fields:[NSSet setWithObjects:STRCaptureFieldSegments, STRCaptureFieldTrackSummary, nil]];
+    }
+    STRLogDebug(STRLogCategoryCapture, @"STRCaptureSegmenter: Closed segment %lu of capture %@ with %lu points.", (unsigned long)index, self.token, (unsigned long)points.count);
+
+    id<STRCaptureSegmenterDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(captureSegmenter:didCloseSegment:)]) {
+        [delegate captureSegmenter:self didCloseSegment:segment];
+    }
+    return segment;
+}
+
+-(BOOL)finish {
+    if (self.finished) return YES;
+    if (_segments.count == 0) {
+        STRLogError(STRLogCategoryCapture, @"STRCaptureSegmenter: Capture %@ cannot be finished without a segment.", self.token);
+        return NO;
+    }
+
+    // The whole track, and its smoothed version
+    const STRTrackSample * samples = (const STRTrackSample *)[allSamples bytes];
+    NSUInteger count = allSamples.length / sizeof(STRTrackSample);
+    NSMutableData * smoothed = [allSamples mutableCopy];
+    [[[STRTrackFilter alloc] init] smoothSamples:(STRTrackSample *)[smoothed mutableBytes] count:count];
+    NSString * geoDataPath = [self.directoryPath stringByAppendingPathComponent:[self.token stringByAppendingPathExtension:@"json"]];
+    NSString * filteredGeoDataPath = [self.directoryPath stringByAppendingPathComponent:[[self.token stringByAppendingPathExtension:@"filtered"] stringByAppendingPathExtension:@"json"]];
+    if (![self writeSamples:samples count:count toPath:geoDataPath] || ![self writeSamples:(const STRTrackSample *)[smoothed bytes] count:count toPath:filteredGeoDataPath]) {
+        STRLogError(STRLogCategoryStorage, @"STRCaptureSegmenter: Could not write the track of capture %@.", self.token);
+        return NO;
+    }
+    if (![self saveCaptureInfoFinished:YES]) return NO;
+
+    self.finished = YES;
+    [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeUpdated token:self.token fields:nil];
+    STRLogInfo(STRLogCategoryCapture, @"STRCaptureSegmenter: Finished capture %@ with %lu segments.", self.token, (unsigned long)_segments.count);
+
+    id<STRCaptureSegmenterDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(captureSegmenterDidFinish:)]) {
+        [delegate captureSegmenterDidFinish:self];
+    }
+    return YES;
+}
+
+#pragma mark - Splitting Tracks
+
++(NSArray *)pointsOfSamples:(const STRTrackSample *)samples count:(NSUInteger)count fromTime:(NSTimeInterval)startTime toTime:(NSTimeInterval)endTime {
+    NSUInteger first = 0;
+    while (first < count && samples[first].timestamp < startTime) first++;
+    NSUInteger last = first;
+    while (last < count && samples[last].timestamp < endTime) last++;
+
+    NSMutableArray * points = [NSMutableArray arrayWithCapacity:last - first + 1];
+    // Stand the last earlier point in at the start if nothing was recorded there
+    if (first > 0 && (first == last || samples[first].timestamp > startTime)) {
+        STRTrackSample carried = samples[first - 1];
+        carried.timestamp = 0;
+        [points addObject:[STRTrackFilter pointFromSample:carried]];
+    }
+    for (NSUInteger i = first; i < last; i++) {
+        STRTrackSample sample = samples[i];
+        sample.timestamp -= startTime;
+        [points addObject:[STRTrackFilter pointFromSample:sample]];
+    }
+    return points;
+}
+
+@end
+
+@implementation STRCaptureSegmenter (InternalMethods)
+
+#pragma mark - Files
+
+-(NSString *)relativePathForFileNamed:(NSString *)fileName {
+    return [self.token stringByAppendingPathComponent:fileName];
+}
+
+-(NSString *)fileNameForSegmentAtIndex:(NSUInteger)index extension:(NSString *)extension {
+    return [[NSString stringWithFormat:@"%@.s%04lu", self.token, (unsigned long)index] stringByAppendingPathExtension:extension];
+}
+
+-(BOOL)writePoints:(NSArray *)points toPath:(NSString *)path {
+    NSData * data = [NSJSONSerialization dataWithJSONObject:@{ @"points" : points } options:0 error:nil];
+    return (data && [data writeToFile:path atomically:YES]);
+}
+
+-(BOOL)writeSamples:(const STRTrackSample *)samples count:(NSUInteger)count toPath:(NSString *)path {
+    NSMutableArray * points = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [points addObject:[STRTrackFilter pointFromSample:samples[i]]];
+    }
+    return [self writePoints:points toPath:path];
+}
+
+#pragma mark - Capture Info
+
+-(BOOL)saveCaptureInfoFinished:(BOOL)finished {
+    NSString * infoPath = [self.directoryPath stringByAppendingPathComponent:kSTRCaptureInfoFile];
+    // The summary covers the points recorded so far, so that a capture still
+    // being recorded can be listed like the others
+    STRTrackSummary * summary = [STRTrackSummary summaryOfSamples:(const STRTrackSample *)[allSamples bytes] count:allSamples.length / sizeof(STRTrackSample)];
+    __block BOOL saved = NO;
+
+    [[STRCaptureLockTable sharedTable] writeCaptureWithToken:self.token usingBlock:^{
+        // Start from the file on disk, so that a title or upload date saved by
+        // a STRCapture in the meantime is kept
+        NSData * existing = [NSData dataWithContentsOfFile:infoPath];
+        NSMutableDictionary * info = (existing) ? [NSJSONSerialization JSONObjectWithData:existing options:NSJSONReadingMutableContainers error:nil] : nil;
+        if (![info isKindOfClass:[NSMutableDictionary class]]) {
+            info = [NSMutableDictionary dictionaryWithDictionary:(self.initialInfo) ? self.initialInfo : @{}];
+            [info setObject:[NSDate currentUnixTimestampNumber] forKey:@"created_at"];
+            if (![info objectForKey:@"title"]) [info setObject:@"Untitled Capture" forKey:@"title"];
+            [info setObject:@0 forKey:@"uploaded_at"];
+        }
+
+        // Until the capture is finished, the first segment stands in for the
+        // whole capture, so that it can be listed and played back at once
+        NSString * relativePath = [self.token stringByAppendingPathComponent:self.token];
+        NSDictionary * firstSegment = [_segments objectAtIndex:0];
+        [info setObject:self.token forKey:@"token"];
+        [info setObject:@"video" forKey:@"media_type"];
+        [info setObject:[firstSegment objectForKey:@"media_file"] forKey:@"media_file"];
+        [info setObject:[relativePath stringByAppendingPathExtension:@"png"] forKey:@"thumbnail_file"];
+        if (finished) {
+            [info setObject:[relativePath stringByAppendingPathExtension:@"json"] forKey:@"geodata_file"];
+            [info setObject:[[relativePath stringByAppendingPathExtension:@"filtered"] stringByAppendingPathExtension:@"json"] forKey:@"filtered_geodata_file"];
+        } else {
+            [info setObject:[firstSegment objectForKey:@"geodata_file"] forKey:@"geodata_file"];
+        }
+        [info setObject:[summary dictionaryRepresentation] forKey:@"track_summary"];
+        [info setObject:@(self.segmentDuration) forKey:@"segment_duration"];
+        [info setObject:_segments forKey:@"segments"];
+        [info setObject:@(finished) forKey:@"segments_complete"];
+
+        NSError * error;
+        NSData * data = [NSJSONSerialization dataWithJSONObject:info options:0 error:&error];
+        if (!data || ![data writeToFile:infoPath options:NSDataWritingAtomic error:&error]) {
+            STRLogError(STRLogCategoryStorage, @"STRCaptureSegmenter: Could not write the capture info of capture %@: %@", self.token, error);
+            return;
+        }
+        saved = YES;
+    }];
+    return saved;
+}
+
+@end
@@ -0,0 +1,106 @@
+//
+//  STRCaptureSyncManager.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class STRCapturePathResolver;
+
+/**
+ Called on the main thread when a sync has ended.
+
+ @param presentTokens The tokens of the captures that the server already holds with the same content, in the order they were passed.
+
+ @param missingTokens The tokens of the captures that still need to be uploaded, in the order they were passed. Captures whose files could not be read are included.
+
+ @param error Nil if the server answered. Otherwise the error that ended the sync, and both arrays are nil.
+ */
+typedef void (^STRCaptureSyncCompletionHandler)(NSArray * presentTokens, NSArray * missingTokens, NSError * error);
+
+/**
+ Asks the server which captures it already holds, so that only the others are uploaded.
+
+ The upload date of a capture is only kept on the device. After the app is reinstalled, or when `uploaded_at` is cleared, every capture looks new, and uploading them again would send media that the server already has. A sync sends a manifest listing the token and a digest of the content of each capture in a single request. The server answers with the tokens that it does not hold, or holds with different content. [STRCaptureUploadManager beginSyncedUploadForCaptures:] uses a sync to mark the other captures as uploaded and upload only the missing ones.
+
+ The digest of a capture covers its media and geodata files, which are the files that cost the most to send. It is built from the SHA-1 checksums kept by the [STRCaptureIntegrityScanner], so once they have been recorded, a capture is added to a manifest without reading its media. See the [Underlying Mechanics](UnderlyingMechanics) guide for the format of manifests and of the server's answer.
+ */
+@interface STRCaptureSyncManager : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Creating a Sync Manager
+///---------------------------------------------------------------------------------------
+
+/**
+ Creates a sync manager for the captures directory used by the SDK.
+ */
+-(id)init;
+
+/**
+ Creates a sync manager for the captures managed by a given resolver.
+
+ @param resolver The resolver for the captures directory.
+ */
+-(id)initWithPathResolver:(STRCapturePathResolver *)resolver;
+
+/**
+ The URL that manifests are posted to.
+
+ Defaults to the URL built from the `Sync_API_URL` setting.
+ */
+@property(strong)NSURL * syncURL;
+
+///---------------------------------------------------------------------------------------
+/// @name Building Manifests
+///---------------------------------------------------------------------------------------
+
+/**
+ Returns the digest of the content of a capture, as it is sent in a manifest.
+
+ @param token The token of the capture.
+
+ @return NSData The 8 byte digest, or nil if the capture info, media or geodata file cannot be read.
+ */
+-(NSData *)digestOfCaptureWithToken:(NSString *)token;
+
+/**
+ Builds the manifest of some captures.
+
+ Digests are computed on all cores. Each entry takes 25 bytes for a current token and 41 for a legacy one, so a manifest of 100,000 captures is about 2.5 MB.
+
+ @param tokens The tokens of the captures.
+
+ @param unreadableTokens If not NULL, set to the tokens that were left out because the capture could not be read.
+
+ @return NSData The manifest.
+ */
+-(NSData *)manifestForCapturesWithTokens:(NSArray *)tokens unreadableTokens:(NSArray **)unreadableTokens;
+
+/**
+ Reads the entries of a manifest, as the server does.
+
+ @param manifest A manifest built by manifestForCapturesWithTokens:unreadableTokens:.
+
+ @return NSDictionary The digest of each capture, keyed by token, or nil if the manifest is damaged.
+ */
++(NSDictionary *)digestsInManifest:(NSData *)manifest;
+
+///---------------------------------------------------------------------------------------
+/// @name Syncing
+///---------------------------------------------------------------------------------------
+
+/**
+ Builds the manifest of some captures on a background queue, posts it to syncURL and reads the answer.
+
+ Nothing is changed on the device; the caller decides what to do with the captures that are present.
+
+ @param tokens The tokens of the captures.
+
+ @param completionHandler Called on the main thread when the server has answered or the request has failed.
+ */
+-(void)syncCapturesWithTokens:(NSArray *)tokens completionHandler:(STRCaptureSyncCompletionHandler)completionHandler;
+
+@end
@@ -0,0 +1,234 @@
+//
+//  STRCaptureSyncManager.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureSyncManager.h"
+#import "STRCaptureUploadManager.h"
+#import "STRCaptureIntegrityScanner.h"
+#import "STRCapturePathResolver.h"
+#import "STRSettings.h"
+#import "STRLogger.h"
+
+#import <CommonCrypto/CommonDigest.h>
+#include <ctype.h>
+
+#define kSTRManifestMagic "STRM"
+#define kSTRManifestVersion 1
+// Magic, version, digest length and a 32 bit entry count
+#define kSTRManifestHeaderLength 10
+#define kSTRManifestDigestLength 8
+// Captures handed to each parallel worker at a time
+#define kSTRManifestBatchSize 64
+// The server compares every entry before it answers
+#define kSTRSyncTimeoutInterval 120
+
+@interface STRCaptureSyncManager () {
+    STRCapturePathResolver * _resolver;
+    STRCaptureIntegrityScanner * _scanner;
+}
+@end
+
+@interface STRCaptureSyncManager (InternalMethods)
+-(void)handleResponse:(NSURLResponse *)response data:(NSData *)data error:(NSError *)error tokens:(NSArray *)tokens unreadableTokens:(NSArray *)unreadableTokens completionHandler:(STRCaptureSyncCompletionHandler)completionHandler;
+-(NSError *)errorWithCode:(STRCaptureUploadError)code message:(NSString *)message statusCode:(NSInteger)statusCode;
+@end
+
+// Writes the bytes of a hexadecimal token, or returns 0 if it is not one
+static NSUInteger STRTokenBytes(NSString * token, uint8_t * bytes, NSUInteger capacity) {
+    const char * characters = [token UTF8String];
+    size_t length = (characters) ? strlen(characters) : 0;
+    if (length == 0 || length % 2 != 0 || length / 2 > capacity) return 0;
+    for (size_t i = 0; i < length; i += 2) {
+        if (!isxdigit(characters[i]) || !isxdigit(characters[i + 1])) return 0;
+        bytes[i / 2] = (uint8_t)((digittoint(characters[i]) << 4) | digittoint(characters[i + 1]));
+    }
+    return length / 2;
+}
+
+@implementation STRCaptureSyncManager
+
+#pragma mark - Creating a Sync Manager
+
+-(id)init {
+    return [self initWithPathResolver:[STRCapturePathResolver sharedResolver]];
+}
+
+-(id)initWithPathResolver:(STRCapturePathResolver *)resolver {
+    self = [super init];
+    if (self) {
+        _resolver = resolver;
+        _scanner = [[STRCaptureIntegrityScanner alloc] initWithPathResolver:resolver];
+    }
+    return self;
+}
+
+#pragma mark - Building Manifests
+
+-(NSData *)digestOfCaptureWithToken:(NSString *)token {
+    NSString * relativeDirectory = [_resolver relativeDirectoryOfCaptureWithToken:token];
+    NSDictionary * checksums = (relativeDirectory) ? [_scanner checksumsOfCaptureAtRelativeDirectory:relativeDirectory] : nil;
+    if (!checksums) return nil;
+
+    // The server holds the same checksums, so it can rebuild the digest without hashing the media again
+    NSString * combined = [[checksums objectForKey:@"media_file"] stringByAppendingString:[checksums objectForKey:@"geodata_file"]];
+    const char * characters = [combined UTF8String];
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1(characters, (CC_LONG)strlen(characters), digest);
+    return [NSData dataWithBytes:digest length:kSTRManifestDigestLength];
+}
+
+-(NSData *)manifestForCapturesWithTokens:(NSArray *)tokens unreadableTokens:(NSArray **)unreadableTokens {
+    NSUInteger count = tokens.count;
+
+    // Each worker writes only its own slots, so no locking is needed
+    uint8_t * digests = calloc(MAX(count, 1), kSTRManifestDigestLength);
+    BOOL * readable = calloc(MAX(count, 1), sizeof(BOOL));
+    size_t batches = (count + kSTRManifestBatchSize - 1) / kSTRManifestBatchSize;
+    dispatch_apply(batches, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t batch) {
+        NSUInteger end = MIN(count, (batch + 1) * kSTRManifestBatchSize);
+        for (NSUInteger i = batch * kSTRManifestBatchSize; i < end; i++) {
+            @autoreleasepool {
+                NSData * digest = [self digestOfCaptureWithToken:[tokens objectAtIndex:i]];
+                if (!digest) continue;
+                memcpy(digests + i * kSTRManifestDigestLength, digest.bytes, kSTRManifestDigestLength);
+                readable[i] = YES;
+            }
+        }
+    });
+
+    NSMutableData * manifest = [NSMutableData dataWithCapacity:kSTRManifestHeaderLength + count * (1 + 16 + kSTRManifestDigestLength)];
+    uint8_t header[kSTRManifestHeaderLength] = { 'S', 'T', 'R', 'M', kSTRManifestVersion, kSTRManifestDigestLength, 0, 0, 0, 0 };
+    [manifest appendBytes:header length:sizeof(header)];
+    NSMutableArray * unreadable = [NSMutableArray array];
+    uint32_t entryCount = 0;
+    uint8_t entry[1 + 32 + kSTRManifestDigestLength];
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString * token = [tokens objectAtIndex:i];
+        NSUInteger tokenLength = (readable[i]) ? STRTokenBytes(token, entry + 1, 32) : 0;
+        if (tokenLength == 0) {
+            [unreadable addObject:token];
+            continue;
+        }
+        entry[0] = (uint8_t)tokenLength;
+        memcpy(entry + 1 + tokenLength, digests + i * kSTRManifestDigestLength, kSTRManifestDigestLength);
+        [manifest appendBytes:entry length:1 + tokenLength + kSTRManifestDigestLength];
+        entryCount++;
+    }
+    free(digests);
+    free(readable);
+
+    uint32_t bigEndianCount = CFSwapInt32HostToBig(entryCount);
+    [manifest replaceBytesInRange:NSMakeRange(6, 4) withBytes:&bigEndianCount];
+    if (unreadable.count > 0) {
+        STRLogWarning(STRLogCategoryUpload, @"STRCaptureSyncManager: %lu captures could not be read and were left out of the manifest.", (unsigned long)unreadable.count);
+    }
+    if (unreadableTokens) *unreadableTokens = unreadable;
+    return manifest;
+}
+
++(NSDictionary *)digestsInManifest:(NSData *)manifest {
+    const uint8_t * bytes = (const uint8_t *)manifest.bytes;
+    NSUInteger length = manifest.length;
+    if (length < kSTRManifestHeaderLength || memcmp(bytes, kSTRManifestMagic, 4) != 0 || bytes[4] != kSTRManifestVersion) return nil;
+    NSUInteger digestLength = bytes[5];
+    uint32_t count;
+    memcpy(&count, bytes + 6, sizeof(count));
+    count = CFSwapInt32BigToHost(count);
+
+    NSMutableDictionary * digests = [NSMutableDictionary dictionaryWithCapacity:count];
+    NSUInteger offset = kSTRManifestHeaderLength;
+    char token[65];
+    for (uint32_t i = 0; i < count; i++) {
+        if (offset >= length) return nil;
+        NSUInteger tokenLength = bytes[offset];
+        if (tokenLength == 0 || tokenLength > 32 || offset + 1 + tokenLength + digestLength > length) return nil;
+        for (NSUInteger j = 0; j < tokenLength; j++) {
+            snprintf(token + j * 2, 3, "%02x", bytes[offset + 1 + j]);
+        }
+        NSData * digest = [NSData dataWithBytes:bytes + offset + 1 + tokenLength length:digestLength];
+        [digests setObject:digest forKey:[NSString stringWithUTF8String:token]];
+        offset += 1 + tokenLength + digestLength;
+    }
+    return (offset == length) ? digests : nil;
+}
+
+#pragma mark - Syncing
+
+-(void)syncCapturesWithTokens:(NSArray *)tokens completionHandler:(STRCaptureSyncCompletionHandler)completionHandler {
+    tokens = [tokens copy];
+    completionHandler = [completionHandler copy];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSArray * unreadableTokens = nil;
+        NSData * manifest = [self manifestForCapturesWithTokens:tokens unreadableTokens:&unreadableTokens];
+
+        NSURL * syncURL = (self.syncURL) ? self.syncURL : [NSURL URLWithString:[[STRSettings sharedSettings] syncPath]];
+        NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:syncURL cachePolicy:NSURLRequestReloadIgnoringLocalCacheData timeoutInterval:kSTRSyncTimeoutInterval];
+        [request setHTTPMethod:@"POST"];
+        [request setValue:@"application/octet-stream" forHTTPHeaderField:@"Content-Type"];
+        [request setValue:[NSString stringWithFormat:@"%lu", (unsigned long)manifest.length] forHTTPHeaderField:@"Content-Length"];
+        [request setHTTPBody:manifest];
+        STRLogDebug(STRLogCategoryUpload, @"STRCaptureSyncManager: Sending a manifest of %lu captures, %lu bytes.", (unsigned long)(tokens.count - unreadableTokens.count), (unsigned long)manifest.length);
+
+        [NSURLConnection sendAsynchronousRequest:request queue:[NSOperationQueue mainQueue] completionHandler:^(NSURLResponse * response, NSData * data, NSError * error) {
+            [self handleResponse:response data:data error:error tokens:tokens unreadableTokens:unreadableTokens completionHandler:completionHandler];
+        }];
+    });
+}
+
+@end
+
+@implementation STRCaptureSyncManager (InternalMethods)
+
+-(void)handleResponse:(NSURLResponse *)response data:(NSData *)data error:(NSError *)error tokens:(NSArray *)tokens unreadableTokens:(NSArray *)unreadableTokens completionHandler:(STRCaptureSyncCompletionHandler)completionHandler {
+    NSInteger statusCode = ([response isKindOfClass:[NSHTTPURLResponse class]]) ? [(NSHTTPURLResponse *)response statusCode] : 0;
+    NSDictionary * responseDict = nil;
+    if (error) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureSyncManager: Sync failed with error: %@", error.localizedDescription);
+    } else if (statusCode >= 400) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureSyncManager: The server answered a sync with HTTP status %ld", (long)statusCode);
+        error = [self errorWithCode:STRCaptureUploadErrorHTTPStatus message:[NSHTTPURLResponse localizedStringForStatusCode:statusCode] statusCode:statusCode];
+    } else {
+        responseDict = (data) ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+        if (![responseDict isKindOfClass:[NSDictionary class]] || ![[responseDict objectForKey:@"missing"] isKindOfClass:[NSArray class]]) {
+            if ([responseDict isKindOfClass:[NSDictionary class]] && [[responseDict objectForKey:@"error"] isEqual:@"true"]) {
+                STRLogError(STRLogCategoryUpload, @"STRCaptureSyncManager: Error received from server for a sync");
+                error = [self errorWithCode:STRCaptureUploadErrorServerRejected message:[responseDict objectForKey:@"message"] statusCode:statusCode];
+            } else {
+                STRLogError(STRLogCategoryUpload, @"STRCaptureSyncManager: Error - The server returned an unknown response to a sync.");
+                error = [self errorWithCode:STRCaptureUploadErrorUnreadableResponse message:@"The server returned a response that could not be read." statusCode:statusCode];
+            }
+        }
+    }
+    if (error) {
+        if (completionHandler) completionHandler(nil, nil, error);
+        return;
+    }
+
+    // Captures left out of the manifest still need uploading, so that their damage is reported
+    NSMutableSet * missing = [NSMutableSet setWithArray:[responseDict objectForKey:@"missing"]];
+    [missing addObjectsFromArray:unreadableTokens];
+    NSMutableArray * presentTokens = [NSMutableArray arrayWithCapacity:tokens.count];
+    NSMutableArray * missingTokens = [NSMutableArray arrayWithCapacity:missing.count];
+    for (NSString * token in tokens) {
+        if ([missing containsObject:token]) {
+            [missingTokens addObject:token];
+        } else {
+            [presentTokens addObject:token];
+        }
+    }
+    STRLogInfo(STRLogCategoryUpload, @"STRCaptureSyncManager: %lu of %lu captures are already on the server.", (unsigned long)presentTokens.count, (unsigned long)tokens.count);
+    if (completionHandler) completionHandler(presentTokens, missingTokens, nil);
+}
+
+-(NSError *)errorWithCode:(STRCaptureUploadError)code message:(NSString *)message statusCode:(NSInteger)statusCode {
+    NSMutableDictionary * userInfo = [NSMutableDictionary dictionary];
+    if ([message isKindOfClass:[NSString class]]) [userInfo setObject:message forKey:NSLocalizedDescriptionKey];
+    if (code == STRCaptureUploadErrorHTTPStatus) [userInfo setObject:@(statusCode) forKey:STRCaptureUploadHTTPStatusCodeKey];
+    return [NSError errorWithDomain:STRCaptureUploadErrorDomain code:code userInfo:userInfo];
+}
+
+@end
@@ -0,0 +1,79 @@
+//
+//  STRCaptureToken.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Generates and reads the tokens that name captures.
+
+ A capture's token is the name of its directory under `Documents/StraboCaptures` and the base name of each of its files. It is also sent to the server with every upload.
+
+ Token Format
+ ------------
+
+ Tokens are 32 lowercase hexadecimal characters:
+
+ - 12 characters: the creation time, in milliseconds since 1970.
+ - 8 characters: a hash of an identifier that is generated once per installation, so tokens from different devices do not collide.
+ - 12 characters: random bits, so tokens from the same device and millisecond do not collide.
+
+ Because the time comes first and is zero-padded, comparing two tokens as strings compares their creation times. A sorted directory listing is therefore also a list of captures sorted by creation date, and the date of a capture can be read from its token without opening any files.
+
+ Legacy Tokens
+ -------------
+
+ Earlier versions of the SDK named captures with a 64-character SHA-256 hash. Such tokens carry no date. isValidToken: accepts them, and creationDateForToken: returns nil for them, so callers fall back to the `created_at` value in the capture's info file.
+ */
+@interface STRCaptureToken : NSObject
+
+/**
+ Generates a token for a capture created now.
+
+ Tokens generated by this method during the life of the app are strictly increasing, even if several are generated in the same millisecond.
+
+ @return NSString A new token.
+ */
++(NSString *)generateToken;
+
+/**
+ Generates a token for a capture created at the given date, such as an imported image.
+
+ @param date The creation date of the capture.
+
+ @return NSString A new token.
+ */
++(NSString *)generateTokenWithDate:(NSDate *)date;
+
+/**
+ Checks whether a string has the format of a capture token, in either the current or the legacy format.
+
+ @param token The string to check.
+
+ @return BOOL YES if the string is a token.
+ */
++(BOOL)isValidToken:(NSString *)token;
+
+/**
+ Checks whether a token is in the current, time-ordered format.
+
+ @param token The token to check.
+
+ @return BOOL YES if the token starts with its creation time.
+ */
++(BOOL)isTimeOrderedToken:(NSString *)token;
+
+/**
+ Reads the creation date from a time-ordered token.
+
+ @param token The token to read.
+
+ @return NSDate The creation date of the capture, to the millisecond. Nil for legacy tokens and for strings that are not tokens.
+ */
++(NSDate *)creationDateForToken:(NSString *)token;
+
+@end
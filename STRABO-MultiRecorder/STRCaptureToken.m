@@ -0,0 +1,102 @@
+//
+//  STRCaptureToken.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureToken.h"
+#import "NSString+Hash.h"
+
+#import <libkern/OSAtomic.h>
+
+#define kSTRUniqueIdentifierKey @"kSTRUniqueIdentifierKey"
+
+#define kSTRTokenLength 32
+#define kSTRTokenTimeLength 12
+#define kSTRTokenDeviceLength 8
+#define kSTRLegacyTokenLength 64
+
+static OSSpinLock _lastTimeLock = OS_SPINLOCK_INIT;
+static uint64_t _lastTime = 0;
+
+@interface STRCaptureToken (InternalMethods)
++(NSString *)deviceComponent;
++(NSString *)tokenWithMilliseconds:(uint64_t)milliseconds;
++(BOOL)string:(NSString *)string isHexadecimalWithLength:(NSUInteger)length;
+@end
+
+@implementation STRCaptureToken
+
+#pragma mark - Generating Tokens
+
++(NSString *)generateToken {
+    uint64_t milliseconds = (uint64_t)([[NSDate date] timeIntervalSince1970] * 1000);
+    // Never go backwards, so tokens made by this process keep their order
+    OSSpinLockLock(&_lastTimeLock);
+    if (milliseconds <= _lastTime) milliseconds = _lastTime + 1;
+    _lastTime = milliseconds;
+    OSSpinLockUnlock(&_lastTimeLock);
+    return [STRCaptureToken tokenWithMilliseconds:milliseconds];
+}
+
++(NSString *)generateTokenWithDate:(NSDate *)date {
+    NSTimeInterval interval = MAX([date timeIntervalSince1970], 0);
+    return [STRCaptureToken tokenWithMilliseconds:(uint64_t)(interval * 1000)];
+}
+
+#pragma mark - Reading Tokens
+
++(BOOL)isValidToken:(NSString *)token {
+    return [STRCaptureToken isTimeOrderedToken:token] || [STRCaptureToken string:token isHexadecimalWithLength:kSTRLegacyTokenLength];
+}
+
++(BOOL)isTimeOrderedToken:(NSString *)token {
+    return [STRCaptureToken string:token isHexadecimalWithLength:kSTRTokenLength];
+}
+
++(NSDate *)creationDateForToken:(NSString *)token {
+    if (![STRCaptureToken isTimeOrderedToken:token]) return nil;
+    unsigned long long milliseconds = strtoull([[token substringToIndex:kSTRTokenTimeLength] UTF8String], NULL, 16);
+    return [NSDate dateWithTimeIntervalSince1970:milliseconds / 1000.0];
+}
+
+@end
+
+@implementation STRCaptureToken (InternalMethods)
+
++(NSString *)deviceComponent {
+    static NSString * deviceComponent;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // The same identifier that legacy tokens were hashed from
+        NSUserDefaults * userDefaults = [NSUserDefaults standardUserDefaults];
+        NSString * uniqueIdentifier = [userDefaults objectForKey:kSTRUniqueIdentifierKey];
+        if (!uniqueIdentifier) {
+            CFUUIDRef theUUID = CFUUIDCreate(NULL);
+            uniqueIdentifier = (__bridge_transfer NSString *)CFUUIDCreateString(NULL, theUUID);
+            CFRelease(theUUID);
+            [userDefaults setObject:uniqueIdentifier forKey:kSTRUniqueIdentifierKey];
+            [userDefaults synchronize];
+        }
+        deviceComponent = [[uniqueIdentifier SHA2] substringToIndex:kSTRTokenDeviceLength];
+    });
+    return deviceComponent;
+}
+
++(NSString *)tokenWithMilliseconds:(uint64_t)milliseconds {
+    uint64_t random = ((uint64_t)arc4random() << 16) | (arc4random() & 0xffff);
+    return [NSString stringWithFormat:@"%012llx%@%012llx", milliseconds & 0xffffffffffffULL, [STRCaptureToken deviceComponent], random];
+}
+
++(BOOL)string:(NSString *)string isHexadecimalWithLength:(NSUInteger)length {
+    if (string.length != length) return NO;
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar character = [string characterAtIndex:i];
+        if (!((character >= '0' && character <= '9') || (character >= 'a' && character <= 'f'))) return NO;
+    }
+    return YES;
+}
+
+@end
@@ -10,6 +10,27 @@
 #import "STRCapture.h"
 #import "STRCaptureFileManager.h"
 
+/**
+ The domain of the errors that a STRCaptureUploadManager creates itself. Errors from the connection keep their own domain, usually NSURLErrorDomain.
+ */
+extern NSString * const STRCaptureUploadErrorDomain;
+
+/**
+ The key in the userInfo of a STRCaptureUploadErrorHTTPStatus error that holds the HTTP status code as an NSNumber.
+ */
+extern NSString * const STRCaptureUploadHTTPStatusCodeKey;
+
+/**
+ STRCaptureUploadError
+ 
+ The codes of errors in the STRCaptureUploadErrorDomain. See the [ConstantsReference] guide for more information.
+ */
+typedef enum {
+    STRCaptureUploadErrorServerRejected = 1,    // The server read the upload and answered with an error
+    STRCaptureUploadErrorHTTPStatus,            // The server answered with an HTTP status of 400 or more
+    STRCaptureUploadErrorUnreadableResponse     // The server answered with a response that could not be read
+} STRCaptureUploadError;
+
 /**
  You should implement the STRCaptureUploadManagerDelegate to receive notifications when important things happen before, during, and after file uploading. The methods in this protocol will help you handle an upload and alert the user about upload progress, failure, or success.
  
@@ -48,6 +69,8 @@
 /**
  Reports that the upload of the capture has completed and that the server responded successfully.
  
+ By the time this method is called, the capture has been marked as uploaded with [markUploadedAtDate:]([STRCapture markUploadedAtDate:]).
+ 
  @param token The token associated with the track. You should handle the token appropriately, as described in the [Working With The SDK](WorkingWithTheSDK) guide. 
  */
 -(void)fileUploadedSuccessfullyWithToken:(NSString *)token;
@@ -60,10 +83,50 @@
 /**
  Reports that the capture was not able to be successfully uploaded.
  
- @param error The error that occurred which caused the capture upload to fail. Nil if the error is unknown.
+ @param error The error that occurred which caused the capture upload to fail. Errors from the server are in the STRCaptureUploadErrorDomain; errors from the connection are usually in the NSURLErrorDomain. Nil if the error is unknown.
  */
 -(void)fileUploadDidFailWithError:(NSError *)error;
 
+/**
+ Reports that a capture in a batch upload could not be uploaded, even after it was sent again.
+ 
+ Captures in a batch that were uploaded successfully are reported one by one through [fileUploadedSuccessfullyWithToken:]([STRCaptureUploadManagerDelegate fileUploadedSuccessfullyWithToken:]).
+ 
+ @param token The token of the capture that failed.
+ 
+ @param error The error from the last attempt. Nil if the error is unknown.
+ */
+-(void)batchUploadOfCaptureWithToken:(NSString *)token didFailWithError:(NSError *)error;
+
+/**
+ Called when every capture passed to [beginBatchUploadForCaptures:]([STRCaptureUploadManager beginBatchUploadForCaptures:]) has been uploaded or given up on.
+ 
+ @param uploadedTokens The tokens of the captures that were uploaded.
+ 
+ @param failedTokens The tokens of the captures that were not.
+ */
+-(void)batchUploadDidFinishWithUploadedTokens:(NSArray *)uploadedTokens failedTokens:(NSArray *)failedTokens;
+
+/**
+ Reports what the server answered to the manifest sent by [beginSyncedUploadForCaptures:]([STRCaptureUploadManager beginSyncedUploadForCaptures:]).
+
+ By the time this method is called, the captures that the server already holds have been marked as uploaded. The batch upload of the missing captures starts right after.
+
+ @param uploadedTokens The tokens of the captures that the server already holds.
+
+ @param missingTokens The tokens of the captures that are about to be uploaded.
+ */
+-(void)syncFoundUploadedTokens:(NSArray *)uploadedTokens missingTokens:(NSArray *)missingTokens;
+
+/**
+ Reports that the manifest sent by [beginSyncedUploadForCaptures:]([STRCaptureUploadManager beginSyncedUploadForCaptures:]) could not be compared with the captures on the server.
+
+ Every capture is then uploaded, as [beginBatchUploadForCaptures:]([STRCaptureUploadManager beginBatchUploadForCaptures:]) would.
+
+ @param error The error that ended the sync.
+ */
+-(void)syncDidFailWithError:(NSError *)error;
+
 @end
 
 /**
@@ -79,6 +142,10 @@
  
  To cancel and upload in progress, call the cancelCurrentUpload method. 
  
+ A STRCaptureUploadManager makes a single attempt and forgets the capture afterwards. To have captures uploaded even if an attempt fails or the app is stopped, queue them in a [STRUploadOutbox] instead.
+ 
+ Every upload is timed. When an upload ends, its [STRUploadMetrics] are handed to the shared [STRUploadMetricsRecorder], which you can ask for percentiles and throughput or export to a file.
+ 
  Although all of the [STRCaptureUploadManagerDelegate] methods are optional, it is HIGHLY RECOMMENDED that the object that implements a STRCaptureUploadManager also conform to the [STRCaptureUploadManagerDelegate]. The the associated documentation or the [Working with the SDK](WorkingWithTheSDK) guide for more information.
  */
 @interface STRCaptureUploadManager : NSObject {
@@ -94,6 +161,13 @@
  */
 @property(strong)id delegate;
 
+/**
+ The URL that captures are posted to.
+ 
+ Defaults to the URL built from the `Upload_URL` setting. Set it to send uploads somewhere else, such as a test server.
+ */
+@property(strong)NSURL * uploadURL;
+
 /**
  Creates and returns a new STRCaptureUploadManager
  
@@ -108,10 +182,77 @@
  */
 -(void)beginUploadForCapture:(STRCapture *)capture;
 
+/**
+ Uploads many captures, packing several into each POST request.
+ 
+ Each request carries as many captures as fit within maximumBatchBytes, and the server answers with a result for each of them. For a backlog of small image captures, this spends far less time on connection setup and server round trips than uploading the captures one at a time. Requests are sent one after another, and the body of each is streamed from a temporary file.
+ 
+ Captures that fail, alone or because their whole request failed, are sent again in a later request, up to three times in all. As each capture is uploaded, [fileUploadedSuccessfullyWithToken:]([STRCaptureUploadManagerDelegate fileUploadedSuccessfullyWithToken:]) is called; captures that are given up on are reported to [batchUploadOfCaptureWithToken:didFailWithError:]([STRCaptureUploadManagerDelegate batchUploadOfCaptureWithToken:didFailWithError:]). When every capture has been handled, [batchUploadDidFinishWithUploadedTokens:failedTokens:]([STRCaptureUploadManagerDelegate batchUploadDidFinishWithUploadedTokens:failedTokens:]) is called.
+ 
+ See the [Underlying Mechanics](UnderlyingMechanics) guide for the format of batch requests and responses.
+ 
+ @param captures An array of STRCapture objects.
+ */
+-(void)beginBatchUploadForCaptures:(NSArray *)captures;
+
+/**
+ The URL that batch uploads are posted to.
+ 
+ Defaults to the URL built from the `Batch_API_URL` setting.
+ */
+@property(strong)NSURL * batchUploadURL;
+
+/**
+ The largest request body, in bytes, that beginBatchUploadForCaptures: packs captures into.
+ 
+ Defaults to the `Upload_Batch_Max_Bytes` setting. A capture that is larger on its own is sent in a request by itself.
+ */
+@property(assign)unsigned long long maximumBatchBytes;
+
+/**
+ Asks the server which of some captures it already holds, then uploads only the others.
+
+ Use this method rather than beginBatchUploadForCaptures: when the captures may have been uploaded before without the device knowing, for example after the app was reinstalled. A [STRCaptureSyncManager] sends the server a manifest with a digest of each capture, in a single request. Captures that the server holds with the same content are marked as uploaded with [markUploadedAtDate:]([STRCapture markUploadedAtDate:]) and reported to [syncFoundUploadedTokens:missingTokens:]([STRCaptureUploadManagerDelegate syncFoundUploadedTokens:missingTokens:]); they are not reported as uploaded one by one. The missing captures are then uploaded as by beginBatchUploadForCaptures:.
+
+ If the server cannot be asked, for example because it does not support syncing, [syncDidFailWithError:]([STRCaptureUploadManagerDelegate syncDidFailWithError:]) is called and every capture is uploaded.
+
+ @param captures An array of STRCapture objects.
+ */
+-(void)beginSyncedUploadForCaptures:(NSArray *)captures;
+
+/**
+ The URL that sync manifests are posted to.
+
+ Defaults to the URL built from the `Sync_API_URL` setting.
+ */
+@property(strong)NSURL * syncURL;
+
+/**
+ Uploads one segment of a segmented capture, or completes the upload of such a capture.
+
+ A capture recorded by a STRCaptureSegmenter can be sent while it is still being recorded, one segment at a time. Each request carries the media and geodata files of one segment and a `segment_info` part that identifies it. When every segment has been sent, pass nil as the segment to send the capture info file, the whole track and the thumbnail; the server then assembles the capture. Use a STRSegmentUploadQueue rather than calling this method directly, so that segments are sent in order and retried.
+
+ The upload reports to the same delegate methods as beginUploadForCapture:. Only the request that completes the capture marks it as uploaded with [markUploadedAtDate:]([STRCapture markUploadedAtDate:]).
+
+ See the [Underlying Mechanics](UnderlyingMechanics) guide for the format of segment requests.
+
+ @param segment The segment, as found in the `segments` array of the capture info file, or nil to complete the capture.
+
+ @param capturePath The absolute path of the capture directory.
+ */
+-(void)beginUploadForSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath;
+
+/**
+ The URL that segments are posted to.
+
+ Defaults to the URL built from the `Segment_API_URL` setting.
+ */
+@property(strong)NSURL * segmentUploadURL;
+
 /**
  Cancels the current upload. 
  
- This method will call the delegate method [fileUploadDidStop]([STRCaptureUploadManagerDelegate fileUploadDidStop]) once the cancellation is complete.
+ This method will call the delegate method [fileUploadDidStop]([STRCaptureUploadManagerDelegate fileUploadDidStop]) once the cancellation is complete. A batch upload in progress is cancelled as a whole, and the captures that had not been uploaded yet are not reported. So is a synced upload that is still waiting for the server's answer to its manifest.
  */
 -(void)cancelCurrentUpload;
 
@@ -5,9 +5,66 @@
 //  Created by Thomas N Beatty on 7/19/12.
 //  Copyright (c) 2012 Strabo, LLC. All rights reserved.
 //
+#import <QuartzCore/QuartzCore.h>
 #import "STRSettings.h"
 
 #import "STRCaptureUploadManager.h"
+#import "STRCaptureIntegrityScanner.h"
+#import "STRCaptureLockTable.h"
+#import "STRCaptureSyncManager.h"
+#import "STRCapturePathResolver.h"
+#import "NSMutableData+Gzip.h"
+#import "STRUploadBandwidthController.h"
+#import "STRUploadMetricsRecorder.h"
+#import "STRLogger.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kSTRUploadBoundary @"0xKhTmLbOuNdArY"
+// Used if the Upload_Batch_Max_Bytes setting is missing
+#define kSTRDefaultBatchBytes (8 * 1024 * 1024)
+// Times a capture in a batch upload is sent before it is given up on
+#define kSTRBatchMaximumAttempts 3
+// Room for the boundaries and part headers of one capture in a batch body
+#define kSTRBatchPartOverhead 1024
+#define kSTRBatchCopyBufferSize (64 * 1024)
+
+NSString * const STRCaptureUploadErrorDomain = @"STRCaptureUploadErrorDomain";
+NSString * const STRCaptureUploadHTTPStatusCodeKey = @"STRCaptureUploadHTTPStatusCode";
+
+@interface STRCaptureUploadManager () <NSStreamDelegate> {
+    // Streaming request body support
+    NSData * currentBody;
+    NSUInteger currentBodyOffset;
+    NSOutputStream * bodyProducerStream;
+    NSTimer * bodyPumpTimer;
+    STRUploadBandwidthController * bandwidthController;
+    STRUploadRequestMeter * requestMeter;
+    BOOL bodyBufferWasFull;
+    
+    // The capture being uploaded, and the status of the server's response
+    STRCapture * currentCapture;
+    NSInteger responseStatusCode;
+    
+    // Metrics for the upload in progress
+    STRUploadMetrics * currentMetrics;
+    CFTimeInterval uploadStartTime;
+    CFTimeInterval bodySentTime;
+    
+    // Batch upload support
+    BOOL uploadingBatch;
+    NSMutableArray * pendingBatchCaptures;
+    NSArray * currentBatchCaptures;
+    NSMutableDictionary * batchAttempts;
+    NSMutableArray * uploadedBatchTokens;
+    NSMutableArray * failedBatchTokens;
+    
+    // Synced upload support
+    STRCaptureSyncManager * syncManager;
+}
+
+@end
 
 @interface STRCaptureUploadManager (NSURLConnectionDelegate) <NSURLConnectionDelegate>
 -(void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response;
@@ -16,16 +73,42 @@
 -(void)connectionDidFinishLoading:(NSURLConnection *)connection;
 -(void)connection:(NSURLConnection *)connection didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
 -(void)connection:(NSURLConnection *)connection didSendBodyData:(NSInteger)bytesWritten totalBytesWritten:(NSInteger)totalBytesWritten totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite;
+-(NSInputStream *)connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request;
 @end
 
 @interface STRCaptureUploadManager (InternalMethods)
 
 -(BOOL)generateUploadRequestForCapture:(STRCapture *)capture;
+-(BOOL)captureIsIntact:(STRCapture *)capture;
+-(BOOL)generateUploadRequestForSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath;
 -(void)startCurrentUpload;
 -(void)handleResponse:(NSData *)responseJSONdata;
+-(NSError *)errorWithCode:(STRCaptureUploadError)code message:(NSString *)message;
+
+// Batch Upload Support
+-(void)sendNextBatch;
+-(NSArray *)takeNextBatch;
+-(unsigned long long)estimatedUploadSizeOfCapture:(STRCapture *)capture;
+-(BOOL)generateBatchUploadRequestForCaptures:(NSArray *)captures;
+-(void)handleBatchResponse:(NSData *)responseJSONdata;
+-(void)currentBatchFailedWithError:(NSError *)error;
+-(void)batchCapture:(STRCapture *)capture failedWithError:(NSError *)error retry:(BOOL)retry;
+-(void)finishBatch;
+-(BOOL)writeData:(NSData *)data toStream:(NSOutputStream *)stream;
+-(BOOL)writeFileAtPath:(NSString *)path toStream:(NSOutputStream *)stream;
+-(NSString *)temporaryBodyPathWithPrefix:(NSString *)prefix;
+-(NSData *)mappedBodyAtTemporaryPath:(NSString *)path written:(BOOL)written;
+
+// Request Body Support
+-(NSInputStream *)openBodyProducer;
+-(void)pumpBody;
+-(void)closeBodyProducer;
+-(void)finishCurrentUpload;
 
-// Utility Methods
--(NSString *)capturesDirectoryPath;
+// Metrics Support
+-(NSTimeInterval)timeSinceUploadStart;
+-(void)recordCurrentMetricsWithErrorClass:(STRUploadErrorClass)errorClass;
+-(void)appendJSONFileAtPath:(NSString *)path toBody:(NSMutableData *)body partName:(NSString *)partName fileName:(NSString *)fileName compressed:(BOOL)compressed;
 
 @end
 
@@ -37,23 +120,128 @@
     return [[STRCaptureUploadManager alloc] init];
 }
 
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        // All uploads share one bandwidth budget
+        bandwidthController = [STRUploadBandwidthController sharedController];
+        self.maximumBatchBytes = [[STRSettings sharedSettings] uploadBatchMaxBytes];
+        if (self.maximumBatchBytes == 0) self.maximumBatchBytes = kSTRDefaultBatchBytes;
+    }
+    return self;
+}
+
 #pragma mark - Instance Methods
 
 -(void)beginUploadForCapture:(STRCapture *)capture {
-    if ([self generateUploadRequestForCapture:capture]) {
+    currentCapture = capture;
+    currentMetrics = [[STRUploadMetrics alloc] init];
+    currentMetrics.token = capture.token;
+    currentMetrics.startDate = [NSDate date];
+    uploadStartTime = 0;
+    bodySentTime = 0;
+    
+    CFTimeInterval buildStartTime = CACurrentMediaTime();
+    // The body is read from several files, which must not be moved or replaced part way through
+    __block BOOL generated = NO;
+    [[STRCaptureLockTable sharedTable] readCaptureWithToken:capture.token usingBlock:^{
+        generated = [self generateUploadRequestForCapture:capture];
+    }];
+    if (generated) {
+        currentMetrics.requestBuildDuration = CACurrentMediaTime() - buildStartTime;
+        [self startCurrentUpload];
+    } else {
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassRequest];
+        if ([_delegate respondsToSelector:@selector(fileUploadFailedToStart)]) {
+            [_delegate fileUploadFailedToStart];
+        }
+    }
+}
+
+-(void)beginUploadForSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath {
+    NSString * token = [capturePath lastPathComponent];
+    // Only the request that completes the capture marks it as uploaded
+    currentCapture = (segment) ? nil : [STRCapture captureWithToken:token];
+    currentMetrics = [[STRUploadMetrics alloc] init];
+    currentMetrics.token = token;
+    currentMetrics.startDate = [NSDate date];
+    uploadStartTime = 0;
+    bodySentTime = 0;
+    
+    CFTimeInterval buildStartTime = CACurrentMediaTime();
+    __block BOOL generated = NO;
+    [[STRCaptureLockTable sharedTable] readCaptureWithToken:token usingBlock:^{
+        generated = [self generateUploadRequestForSegment:segment ofCaptureAtPath:capturePath];
+    }];
+    if (generated) {
+        currentMetrics.requestBuildDuration = CACurrentMediaTime() - buildStartTime;
         [self startCurrentUpload];
     } else {
+        currentCapture = nil;
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassRequest];
         if ([_delegate respondsToSelector:@selector(fileUploadFailedToStart)]) {
             [_delegate fileUploadFailedToStart];
         }
     }
 }
 
+-(void)beginBatchUploadForCaptures:(NSArray *)captures {
+    uploadingBatch = YES;
+    pendingBatchCaptures = [captures mutableCopy];
+    batchAttempts = [NSMutableDictionary dictionaryWithCapacity:captures.count];
+    uploadedBatchTokens = [NSMutableArray arrayWithCapacity:captures.count];
+    failedBatchTokens = [NSMutableArray array];
+    [self sendNextBatch];
+}
+
+-(void)beginSyncedUploadForCaptures:(NSArray *)captures {
+    STRCaptureSyncManager * manager = [[STRCaptureSyncManager alloc] init];
+    manager.syncURL = self.syncURL;
+    syncManager = manager;
+    [manager syncCapturesWithTokens:[captures valueForKey:@"token"] completionHandler:^(NSArray * presentTokens, NSArray * missingTokens, NSError * error) {
+        // Cancelled, or replaced by a later sync, while the server was being asked
+        if (syncManager != manager) return;
+        syncManager = nil;
+        if (error) {
+            STRLogWarning(STRLogCategoryUpload, @"STRCaptureUploadManager: Could not sync with the server. Uploading all %lu captures.", (unsigned long)captures.count);
+            if ([_delegate respondsToSelector:@selector(syncDidFailWithError:)]) {
+                [_delegate syncDidFailWithError:error];
+            }
+            [self beginBatchUploadForCaptures:captures];
+            return;
+        }
+        
+        NSSet * present = [NSSet setWithArray:presentTokens];
+        NSMutableArray * missingCaptures = [NSMutableArray arrayWithCapacity:missingTokens.count];
+        for (STRCapture * capture in captures) {
+            if ([present containsObject:capture.token]) {
+                [capture markUploadedAtDate:nil];
+            } else {
+                [missingCaptures addObject:capture];
+            }
+        }
+        if ([_delegate respondsToSelector:@selector(syncFoundUploadedTokens:missingTokens:)]) {
+            [_delegate syncFoundUploadedTokens:presentTokens missingTokens:missingTokens];
+        }
+        [self beginBatchUploadForCaptures:missingCaptures];
+    }];
+}
+
 -(void)cancelCurrentUpload {
+    // Stop the batch before the connection, so that nothing is sent again
+    syncManager = nil;
+    uploadingBatch = NO;
+    pendingBatchCaptures = nil;
+    currentBatchCaptures = nil;
+    currentCapture = nil;
+    [currentConnection cancel];
+    [self finishCurrentUpload];
+    [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassCancelled];
     if ([_delegate respondsToSelector:@selector(fileUploadDidStop)]) {
         [_delegate fileUploadDidStop];
     }
-    NSLog(@"STRCaptureUploadManager: File upload was cancelled.");
+    STRLogInfo(STRLogCategoryUpload, @"STRCaptureUploadManager: File upload was cancelled.");
 }
 
 @end
@@ -62,73 +250,189 @@
 
 -(BOOL)generateUploadRequestForCapture:(STRCapture *)capture {
     // Generate the file paths to upload
-    NSString * thumbnailPath = [self.capturesDirectoryPath stringByAppendingPathComponent:capture.thumbnailPath];
-    NSString * mediaPath = [self.capturesDirectoryPath stringByAppendingPathComponent:capture.mediaPath];
-    NSString * geoDataPath = [self.capturesDirectoryPath stringByAppendingPathComponent:capture.geoDataPath];
-    NSString * captureInfoPath = [self.capturesDirectoryPath stringByAppendingPathComponent:capture.captureInfoPath];
-    if ([[STRSettings sharedSettings] advancedLogging]) {
-        NSLog(@"Uploading file: %@", thumbnailPath);
-        NSLog(@"Uploading file: %@", mediaPath);
-    }
-    // Make sure that all files to upload actually exist
-    NSFileManager * fileManager = [NSFileManager defaultManager];
-    if (![fileManager fileExistsAtPath:mediaPath] || ![fileManager fileExistsAtPath:geoDataPath] || ![fileManager fileExistsAtPath:thumbnailPath] || ![fileManager fileExistsAtPath:captureInfoPath]) {
-        NSLog(@"STRCaptureUploadManager: Files not found while generating request.");
-    return NO;
-    }
+    STRCapturePathResolver * resolver = [STRCapturePathResolver sharedResolver];
+    NSString * thumbnailPath = [resolver absolutePathForCaptureFile:capture.thumbnailPath];
+    NSString * mediaPath = [resolver absolutePathForCaptureFile:capture.mediaPath];
+    NSString * geoDataPath = [resolver absolutePathForCaptureFile:capture.geoDataPath];
+    NSString * captureInfoPath = [resolver absolutePathForCaptureFile:capture.captureInfoPath];
+    STRLogDebug(STRLogCategoryUpload, @"STRCaptureUploadManager: Uploading files: %@, %@", thumbnailPath, mediaPath);
+    // Make sure that all files to upload actually exist and are intact
+    if (![self captureIsIntact:capture]) return NO;
     
     // Create the request
-    NSMutableURLRequest * postRequest = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:[[STRSettings sharedSettings] uploadPath]]];
+    STRSettings * settings = [STRSettings sharedSettings];
+    NSURL * uploadURL = (self.uploadURL) ? self.uploadURL : [NSURL URLWithString:[settings uploadPath]];
+    NSMutableURLRequest * postRequest = [NSMutableURLRequest requestWithURL:uploadURL];
     [postRequest setHTTPMethod:@"POST"];
     
     // Set request constants
-    NSString * stringBoundary = @"0xKhTmLbOuNdArY";
+    NSString * stringBoundary = kSTRUploadBoundary;
     NSString *contentType = [NSString stringWithFormat:@"multipart/form-data; boundary=%@",stringBoundary];
     
     // Build the request
     [postRequest addValue:contentType forHTTPHeaderField: @"Content-Type"];
-    // Create the request body
-    NSMutableData *postBody = [NSMutableData data];
-    // Append all data to the mutable request body
-    [postBody appendData:[[NSString stringWithFormat:@"--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    // Create the request body. It is written to a temporary file part by part, so
+    // the media of a long recording and its segments are never read into memory whole
+    NSString * bodyPath = [self temporaryBodyPathWithPrefix:@"STRUpload"];
+    NSOutputStream * body = [NSOutputStream outputStreamToFileAtPath:bodyPath append:NO];
+    [body open];
+    NSMutableData * part = [NSMutableData data];
+    [part appendData:[[NSString stringWithFormat:@"--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
     // Dynamically change the post request for video or image
-    if ([[STRSettings sharedSettings] advancedLogging]) NSLog(@"Uploading capture of type: %@", capture.type);
+    STRLogDebug(STRLogCategoryUpload, @"STRCaptureUploadManager: Uploading capture of type: %@", capture.type);
     if ([capture.type isEqualToString:@"video"]) {
-        [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"media_file\"; filename=\"%@.mov\"\r\n", capture.token] dataUsingEncoding:NSUTF8StringEncoding]];
-        [postBody appendData:[@"Content-Type: video/quicktime\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+        [part appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"media_file\"; filename=\"%@.mov\"\r\n", capture.token] dataUsingEncoding:NSUTF8StringEncoding]];
+        [part appendData:[@"Content-Type: video/quicktime\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
     } else {
-        [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"media_file\"; filename=\"%@.jpg\"\r\n", capture.token] dataUsingEncoding:NSUTF8StringEncoding]];
-        [postBody appendData:[@"Content-Type: image/jpeg\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+        [part appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"media_file\"; filename=\"%@.jpg\"\r\n", capture.token] dataUsingEncoding:NSUTF8StringEncoding]];
+        [part appendData:[@"Content-Type: image/jpeg\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+    BOOL written = [self writeData:part toStream:body] && [self writeFileAtPath:mediaPath toStream:body];
+    written = written && [self writeData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding] toStream:body];
+    // The media of a segmented capture is its first segment. The others follow in order.
+    NSData * captureInfoData = [NSData dataWithContentsOfFile:captureInfoPath];
+    NSDictionary * captureInfo = (captureInfoData) ? [NSJSONSerialization JSONObjectWithData:captureInfoData options:0 error:nil] : nil;
+    NSArray * segments = ([captureInfo isKindOfClass:[NSDictionary class]]) ? [captureInfo objectForKey:@"segments"] : nil;
+    if ([segments isKindOfClass:[NSArray class]]) {
+        for (NSUInteger i = 1; written && i < segments.count; i++) {
+            NSString * segmentMediaFile = [[segments objectAtIndex:i] objectForKey:@"media_file"];
+            NSString * segmentMediaPath = [resolver absolutePathForCaptureFile:segmentMediaFile];
+            if (![[NSFileManager defaultManager] fileExistsAtPath:segmentMediaPath]) {
+                STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Segment %lu of capture %@ is missing.", (unsigned long)i, capture.token);
+                written = NO;
+                break;
+            }
+            part = [NSMutableData data];
+            [part appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"media_segment\"; filename=\"%@\"\r\n", [segmentMediaFile lastPathComponent]] dataUsingEncoding:NSUTF8StringEncoding]];
+            [part appendData:[@"Content-Type: video/quicktime\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+            written = [self writeData:part toStream:body] && [self writeFileAtPath:segmentMediaPath toStream:body];
+            written = written && [self writeData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding] toStream:body];
+        }
     }
-    [postBody appendData:[NSData dataWithContentsOfFile:mediaPath]];
-    [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
     // Add the thumbnail to the request body
-    [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"thumbnail\"; filename=\"%@.png\"\r\n", capture.token] dataUsingEncoding:NSUTF8StringEncoding]];
-    [postBody appendData:[@"Content-Type: image/png\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-    [postBody appendData:[NSData dataWithContentsOfFile:thumbnailPath]];
-    [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
-    // Add the capture info to the request body
-    [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"capture_info\"; filename=\"%@.json\"\r\n", @"capture-info"] dataUsingEncoding:NSUTF8StringEncoding]];
-    [postBody appendData:[@"Content-Type: application/json\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-    [postBody appendData:[NSData dataWithContentsOfFile:captureInfoPath]];
-    [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
-    // Add the geo data info to the request body
-    [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"geo_data\"; filename=\"%@.json\"\r\n", capture.token] dataUsingEncoding:NSUTF8StringEncoding]];
-    [postBody appendData:[@"Content-Type: application/json\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-    [postBody appendData:[NSData dataWithContentsOfFile:geoDataPath]];
+    part = [NSMutableData data];
+    [part appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"thumbnail\"; filename=\"%@.png\"\r\n", capture.token] dataUsingEncoding:NSUTF8StringEncoding]];
+    [part appendData:[@"Content-Type: image/png\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    written = written && [self writeData:part toStream:body] && [self writeFileAtPath:thumbnailPath toStream:body];
+    // Add the capture info and the geo data, which are small enough to build in memory
+    BOOL compressJSON = [settings compressUploadJSON];
+    part = [NSMutableData data];
+    [part appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    [self appendJSONFileAtPath:captureInfoPath toBody:part partName:@"capture_info" fileName:@"capture-info.json" compressed:compressJSON];
+    [part appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    [self appendJSONFileAtPath:geoDataPath toBody:part partName:@"geo_data" fileName:[capture.token stringByAppendingPathExtension:@"json"] compressed:compressJSON];
     // Close the request body with a boundary
-    [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@--\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    [part appendData:[[NSString stringWithFormat:@"\r\n--%@--\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    written = written && [self writeData:part toStream:body];
+    [body close];
+    
+    NSData * postBody = [self mappedBodyAtTemporaryPath:bodyPath written:written];
+    if (!postBody) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Could not write the body of capture %@.", capture.token);
+        return NO;
+    }
     
-    // Add the post body to the request
-    [postRequest setHTTPBody:postBody];
+    // Keep the body aside. It is streamed to the connection in chunks metered
+    // by the bandwidth controller once the upload starts.
+    [postRequest setValue:[NSString stringWithFormat:@"%lu", (unsigned long)postBody.length] forHTTPHeaderField:@"Content-Length"];
+    currentBody = postBody;
     
     currentRequest = postRequest;
     
     return YES;
 }
 
+-(BOOL)captureIsIntact:(STRCapture *)capture {
+    NSString * captureDirectory = (capture.token) ? [[STRCapturePathResolver sharedResolver] relativeDirectoryOfCaptureWithToken:capture.token] : nil;
+    STRCaptureIssue issues = (captureDirectory) ? [[STRCaptureIntegrityScanner scanner] issuesForCaptureAtRelativeDirectory:captureDirectory] : STRCaptureIssueInfoUnreadable;
+    if (issues != STRCaptureIssueNone) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Capture %@ cannot be uploaded: %@", capture.token, [[STRCaptureIntegrityReport namesForIssues:issues] componentsJoinedByString:@", "]);
+        return NO;
+    }
+    return YES;
+}
+
+-(BOOL)generateUploadRequestForSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath {
+    NSString * token = [capturePath lastPathComponent];
+    NSString * captureInfoPath = [capturePath stringByAppendingPathComponent:@"capture-info.json"];
+    NSData * captureInfoData = [NSData dataWithContentsOfFile:captureInfoPath];
+    NSDictionary * captureInfo = (captureInfoData) ? [NSJSONSerialization JSONObjectWithData:captureInfoData options:0 error:nil] : nil;
+    if (![captureInfo isKindOfClass:[NSDictionary class]]) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: The capture info of capture %@ cannot be read.", token);
+        return NO;
+    }
+    
+    // A segment sends its own files; completing the capture sends the files that describe all of it
+    NSMutableDictionary * segmentInfo;
+    NSString * mediaPath = nil;
+    NSString * geoDataPath;
+    NSString * thumbnailPath = nil;
+    if (segment) {
+        segmentInfo = [segment mutableCopy];
+        [segmentInfo setObject:@NO forKey:@"complete"];
+        mediaPath = [capturePath stringByAppendingPathComponent:[[segment objectForKey:@"media_file"] lastPathComponent]];
+        geoDataPath = [capturePath stringByAppendingPathComponent:[[segment objectForKey:@"geodata_file"] lastPathComponent]];
+    } else {
+        NSUInteger segmentCount = [[captureInfo objectForKey:@"segments"] count];
+        segmentInfo = [NSMutableDictionary dictionaryWithObjectsAndKeys:@YES, @"complete", @(segmentCount), @"segments", nil];
+        geoDataPath = [capturePath stringByAppendingPathComponent:[[captureInfo objectForKey:@"geodata_file"] lastPathComponent]];
+        thumbnailPath = [capturePath stringByAppendingPathComponent:[[captureInfo objectForKey:@"thumbnail_file"] lastPathComponent]];
+    }
+    [segmentInfo setObject:token forKey:@"token"];
+    NSMutableArray * requiredPaths = [NSMutableArray arrayWithObject:geoDataPath];
+    if (mediaPath) [requiredPaths addObject:mediaPath];
+    if (thumbnailPath) [requiredPaths addObject:thumbnailPath];
+    for (NSString * path in requiredPaths) {
+        if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Capture %@ cannot be uploaded: %@ is missing.", token, [path lastPathComponent]);
+            return NO;
+        }
+    }
+    
+    // Create the request
+    STRSettings * settings = [STRSettings sharedSettings];
+    NSURL * uploadURL = (self.segmentUploadURL) ? self.segmentUploadURL : [NSURL URLWithString:[settings segmentUploadPath]];
+    NSMutableURLRequest * postRequest = [NSMutableURLRequest requestWithURL:uploadURL];
+    [postRequest setHTTPMethod:@"POST"];
+    NSString * stringBoundary = kSTRUploadBoundary;
+    [postRequest addValue:[NSString stringWithFormat:@"multipart/form-data; boundary=%@",stringBoundary] forHTTPHeaderField: @"Content-Type"];
+    
+    NSMutableData *postBody = [NSMutableData data];
+    [postBody appendData:[[NSString stringWithFormat:@"--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    [postBody appendData:[@"Content-Disposition: form-data; name=\"segment_info\"; filename=\"segment-info.json\"\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    [postBody appendData:[@"Content-Type: application/json\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    [postBody appendData:[NSJSONSerialization dataWithJSONObject:segmentInfo options:0 error:nil]];
+    [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    BOOL compressJSON = [settings compressUploadJSON];
+    if (segment) {
+        [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"media_file\"; filename=\"%@\"\r\n", [mediaPath lastPathComponent]] dataUsingEncoding:NSUTF8StringEncoding]];
+        [postBody appendData:[@"Content-Type: video/quicktime\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+        [postBody appendData:[NSData dataWithContentsOfFile:mediaPath]];
+    } else {
+        [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"thumbnail\"; filename=\"%@.png\"\r\n", token] dataUsingEncoding:NSUTF8StringEncoding]];
+        [postBody appendData:[@"Content-Type: image/png\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+        [postBody appendData:[NSData dataWithContentsOfFile:thumbnailPath]];
+        [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+        [self appendJSONFileAtPath:captureInfoPath toBody:postBody partName:@"capture_info" fileName:@"capture-info.json" compressed:compressJSON];
+    }
+    [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    [self appendJSONFileAtPath:geoDataPath toBody:postBody partName:@"geo_data" fileName:[geoDataPath lastPathComponent] compressed:compressJSON];
+    [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@--\r\n",stringBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    [postRequest setValue:[NSString stringWithFormat:@"%lu", (unsigned long)postBody.length] forHTTPHeaderField:@"Content-Length"];
+    currentBody = postBody;
+    currentRequest = postRequest;
+    return YES;
+}
+
 -(void)startCurrentUpload {
-    currentConnection = [[NSURLConnection alloc] initWithRequest:currentRequest delegate:self];
+    // Attach the streamed body to the request
+    NSMutableURLRequest * streamedRequest = [currentRequest mutableCopy];
+    [streamedRequest setHTTPBodyStream:[self openBodyProducer]];
+    
+    uploadStartTime = CACurrentMediaTime();
+    responseStatusCode = 0;
+    currentConnection = [[NSURLConnection alloc] initWithRequest:streamedRequest delegate:self];
     
     currentRequest = nil;
     
@@ -142,8 +446,12 @@
             [_delegate fileUploadDidStart];
         }
     } else {
-        NSLog(@"STRCaptureUploadManager: Error initiating connection. Alerting delegate.");
-        if ([_delegate respondsToSelector:@selector(fileUploadFailedToStart)]) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Error initiating connection. Alerting delegate.");
+        [self finishCurrentUpload];
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassNetwork];
+        if (uploadingBatch) {
+            [self currentBatchFailedWithError:nil];
+        } else if ([_delegate respondsToSelector:@selector(fileUploadFailedToStart)]) {
             [_delegate fileUploadFailedToStart];
         }
     }
@@ -151,28 +459,45 @@
 }
 
 -(void)handleResponse:(NSData *)responseJSONdata {
+    if (uploadingBatch) {
+        [self handleBatchResponse:responseJSONdata];
+        return;
+    }
+    
     // Print out the server response for testing purposes
-    if ([[STRSettings sharedSettings] advancedLogging]) {
-        NSLog(@"Server Response: %@", [[NSString alloc] initWithData:responseJSONdata encoding:NSUTF8StringEncoding]);
+    STRLogDebug(STRLogCategoryUpload, @"STRCaptureUploadManager: Server Response: %@", [[NSString alloc] initWithData:responseJSONdata encoding:NSUTF8StringEncoding]);
+    STRCapture * capture = currentCapture;
+    currentCapture = nil;
+    
+    // An error status means the body is not the server's usual answer
+    if (responseStatusCode >= 400) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: The server answered with HTTP status %ld", (long)responseStatusCode);
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassServer];
+        if ([_delegate respondsToSelector:@selector(fileUploadDidFailWithError:)]) {
+            [_delegate fileUploadDidFailWithError:[self errorWithCode:STRCaptureUploadErrorHTTPStatus message:[NSHTTPURLResponse localizedStringForStatusCode:responseStatusCode]]];
+        }
+        return;
     }
     
     // Check the server response to verify success
     NSError * error;
     NSDictionary * responseDict = [NSJSONSerialization JSONObjectWithData:responseJSONdata options:NSJSONReadingMutableContainers error:&error];
-    if (error) {
+    if (error || ![responseDict isKindOfClass:[NSDictionary class]]) {
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassResponse];
         // The response is invalid, so notify the delegate
         if ([_delegate respondsToSelector:@selector(fileUploadDidFailWithError:)]) {
-            [_delegate fileUploadDidFailWithError:error];
+            NSError * newError = [self errorWithCode:STRCaptureUploadErrorUnreadableResponse message:@"The server returned a response that could not be read."];
+            [_delegate fileUploadDidFailWithError:newError];
         }
-        NSLog(@"STRCaptureUploadManager: Error - The server returned an unknown response and the JSON data could not be processed: %@", error);
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Error - The server returned an unknown response and the JSON data could not be processed: %@", error);
         return;
     }
     
     // If the server returned an error, notify the delegate
-    if ([[responseDict objectForKey:@"error"] isEqualToString:@"true"]) {
-        NSLog(@"STRCaptureUploadManager: Error received from server");
-        NSDictionary * userInfo = @{ NSLocalizedDescriptionKey : [responseDict objectForKey:@"message"] };
-        NSError * newError = [NSError errorWithDomain:nil code:0 userInfo:userInfo];
+    if ([[responseDict objectForKey:@"error"] isEqual:@"true"]) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Error received from server");
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassServer];
+        NSError * newError = [self errorWithCode:STRCaptureUploadErrorServerRejected message:[responseDict objectForKey:@"message"]];
         if ([_delegate respondsToSelector:@selector(fileUploadDidFailWithError:)]) {
             [_delegate fileUploadDidFailWithError:newError];
         }
@@ -182,15 +507,402 @@
     // At this point, everything should have gone through ok
     // Declare the file upload a success!
     // Respond by alerting the delgate if successful
+    [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassNone];
+    [capture markUploadedAtDate:nil];
     if ([_delegate respondsToSelector:@selector(fileUploadedSuccessfullyWithToken:)]) {
         [_delegate fileUploadedSuccessfullyWithToken:[responseDict objectForKey:@"token"]];
     }
 }
 
-#pragma mark - Utility Methods
+-(NSError *)errorWithCode:(STRCaptureUploadError)code message:(NSString *)message {
+    NSMutableDictionary * userInfo = [NSMutableDictionary dictionary];
+    if ([message isKindOfClass:[NSString class]]) [userInfo setObject:message forKey:NSLocalizedDescriptionKey];
+    if (code == STRCaptureUploadErrorHTTPStatus) [userInfo setObject:@(responseStatusCode) forKey:STRCaptureUploadHTTPStatusCodeKey];
+    return [NSError errorWithDomain:STRCaptureUploadErrorDomain code:code userInfo:userInfo];
+}
+
+#pragma mark - Batch Upload Support
+
+-(void)sendNextBatch {
+    while (uploadingBatch && pendingBatchCaptures.count > 0) {
+        NSArray * batch = [self takeNextBatch];
+        if (batch.count == 0) continue;
+        
+        currentMetrics = [[STRUploadMetrics alloc] init];
+        currentMetrics.token = [[batch objectAtIndex:0] token];
+        currentMetrics.captureCount = batch.count;
+        currentMetrics.startDate = [NSDate date];
+        uploadStartTime = 0;
+        bodySentTime = 0;
+        
+        CFTimeInterval buildStartTime = CACurrentMediaTime();
+        if ([self generateBatchUploadRequestForCaptures:batch]) {
+            currentMetrics.requestBuildDuration = CACurrentMediaTime() - buildStartTime;
+            currentBatchCaptures = batch;
+            STRLogDebug(STRLogCategoryUpload, @"STRCaptureUploadManager: Sending a batch of %lu captures, %lu bytes.", (unsigned long)batch.count, (unsigned long)currentBody.length);
+            [self startCurrentUpload];
+            return;
+        }
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassRequest];
+        for (STRCapture * capture in batch) {
+            [self batchCapture:capture failedWithError:nil retry:NO];
+        }
+    }
+    if (uploadingBatch) [self finishBatch];
+}
+
+-(NSArray *)takeNextBatch {
+    NSMutableArray * batch = [NSMutableArray array];
+    unsigned long long batchBytes = 0;
+    while (pendingBatchCaptures.count > 0) {
+        STRCapture * capture = [pendingBatchCaptures objectAtIndex:0];
+        // Damaged captures would fail again on every attempt
+        if (![self captureIsIntact:capture]) {
+            [pendingBatchCaptures removeObjectAtIndex:0];
+            [self batchCapture:capture failedWithError:nil retry:NO];
+            continue;
+        }
+        unsigned long long captureBytes = [self estimatedUploadSizeOfCapture:capture];
+        if (batch.count > 0 && batchBytes + captureBytes > self.maximumBatchBytes) break;
+        [batch addObject:capture];
+        batchBytes += captureBytes;
+        [pendingBatchCaptures removeObjectAtIndex:0];
+    }
+    return batch;
+}
+
+-(unsigned long long)estimatedUploadSizeOfCapture:(STRCapture *)capture {
+    STRCapturePathResolver * resolver = [STRCapturePathResolver sharedResolver];
+    unsigned long long size = kSTRBatchPartOverhead;
+    for (NSString * relativePath in @[ capture.mediaPath, capture.thumbnailPath, capture.captureInfoPath, capture.geoDataPath ]) {
+        struct stat info;
+        if (stat([[resolver absolutePathForCaptureFile:relativePath] fileSystemRepresentation], &info) == 0) size += info.st_size;
+    }
+    return size;
+}
+
+-(BOOL)generateBatchUploadRequestForCaptures:(NSArray *)captures {
+    STRCapturePathResolver * resolver = [STRCapturePathResolver sharedResolver];
+    STRSettings * settings = [STRSettings sharedSettings];
+    BOOL compressJSON = [settings compressUploadJSON];
+    
+    // The body is written to a temporary file part by part, so media files are
+    // never read into memory whole
+    NSString * bodyPath = [self temporaryBodyPathWithPrefix:@"STRBatchUpload"];
+    NSOutputStream * body = [NSOutputStream outputStreamToFileAtPath:bodyPath append:NO];
+    [body open];
+    
+    // The manifest tells the server which capture each group of parts belongs to
+    NSMutableArray * tokens = [NSMutableArray arrayWithCapacity:captures.count];
+    for (STRCapture * capture in captures) {
+        [tokens addObject:capture.token];
+    }
+    NSMutableData * part = [NSMutableData data];
+    [part appendData:[[NSString stringWithFormat:@"--%@\r\nContent-Disposition: form-data; name=\"manifest\"\r\nContent-Type: application/json\r\n\r\n", kSTRUploadBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    [part appendData:[NSJSONSerialization dataWithJSONObject:@{ @"tokens" : tokens } options:0 error:nil]];
+    BOOL written = [self writeData:part toStream:body];
+    
+    for (NSUInteger index = 0; written && index < captures.count; index++) {
+        STRCapture * capture = [captures objectAtIndex:index];
+        NSString * prefix = [NSString stringWithFormat:@"captures[%lu]", (unsigned long)index];
+        BOOL video = [capture.type isEqualToString:@"video"];
+        
+        // Each capture is read under its own lock, one after the other, so a batch
+        // never holds two capture locks at once
+        __block BOOL captureWritten = NO;
+        [[STRCaptureLockTable sharedTable] readCaptureWithToken:capture.token usingBlock:^{
+            // Media and thumbnail are copied from their files in chunks
+            NSMutableData * capturePart = [NSMutableData data];
+            [capturePart appendData:[[NSString stringWithFormat:@"\r\n--%@\r\nContent-Disposition: form-data; name=\"%@[media_file]\"; filename=\"%@.%@\"\r\nContent-Type: %@\r\n\r\n", kSTRUploadBoundary, prefix, capture.token, (video) ? @"mov" : @"jpg", (video) ? @"video/quicktime" : @"image/jpeg"] dataUsingEncoding:NSUTF8StringEncoding]];
+            captureWritten = [self writeData:capturePart toStream:body] && [self writeFileAtPath:[resolver absolutePathForCaptureFile:capture.mediaPath] toStream:body];
+            capturePart = [NSMutableData data];
+            [capturePart appendData:[[NSString stringWithFormat:@"\r\n--%@\r\nContent-Disposition: form-data; name=\"%@[thumbnail]\"; filename=\"%@.png\"\r\nContent-Type: image/png\r\n\r\n", kSTRUploadBoundary, prefix, capture.token] dataUsingEncoding:NSUTF8StringEncoding]];
+            captureWritten = captureWritten && [self writeData:capturePart toStream:body] && [self writeFileAtPath:[resolver absolutePathForCaptureFile:capture.thumbnailPath] toStream:body];
+            
+            // The JSON parts are built in memory like those of a single upload, so they can be compressed
+            capturePart = [NSMutableData data];
+            [capturePart appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n", kSTRUploadBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+            [self appendJSONFileAtPath:[resolver absolutePathForCaptureFile:capture.captureInfoPath] toBody:capturePart partName:[prefix stringByAppendingString:@"[capture_info]"] fileName:@"capture-info.json" compressed:compressJSON];
+            [capturePart appendData:[[NSString stringWithFormat:@"\r\n--%@\r\n", kSTRUploadBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+            [self appendJSONFileAtPath:[resolver absolutePathForCaptureFile:capture.geoDataPath] toBody:capturePart partName:[prefix stringByAppendingString:@"[geo_data]"] fileName:[capture.token stringByAppendingPathExtension:@"json"] compressed:compressJSON];
+            captureWritten = captureWritten && [self writeData:capturePart toStream:body];
+        }];
+        written = captureWritten;
+    }
+    written = written && [self writeData:[[NSString stringWithFormat:@"\r\n--%@--\r\n", kSTRUploadBoundary] dataUsingEncoding:NSUTF8StringEncoding] toStream:body];
+    [body close];
+    
+    NSData * mappedBody = [self mappedBodyAtTemporaryPath:bodyPath written:written];
+    if (!mappedBody) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Could not write the body of a batch of %lu captures.", (unsigned long)captures.count);
+        return NO;
+    }
+    
+    NSURL * batchURL = (self.batchUploadURL) ? self.batchUploadURL : [NSURL URLWithString:[settings batchUploadPath]];
+    NSMutableURLRequest * postRequest = [NSMutableURLRequest requestWithURL:batchURL];
+    [postRequest setHTTPMethod:@"POST"];
+    [postRequest addValue:[NSString stringWithFormat:@"multipart/form-data; boundary=%@", kSTRUploadBoundary] forHTTPHeaderField:@"Content-Type"];
+    [postRequest setValue:[NSString stringWithFormat:@"%lu", (unsigned long)mappedBody.length] forHTTPHeaderField:@"Content-Length"];
+    currentBody = mappedBody;
+    currentRequest = postRequest;
+    
+    return YES;
+}
+
+-(void)handleBatchResponse:(NSData *)responseJSONdata {
+    STRLogDebug(STRLogCategoryUpload, @"STRCaptureUploadManager: Server Response: %@", [[NSString alloc] initWithData:responseJSONdata encoding:NSUTF8StringEncoding]);
+    
+    if (responseStatusCode >= 400) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: The server answered a batch upload with HTTP status %ld", (long)responseStatusCode);
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassServer];
+        [self currentBatchFailedWithError:[self errorWithCode:STRCaptureUploadErrorHTTPStatus message:[NSHTTPURLResponse localizedStringForStatusCode:responseStatusCode]]];
+        return;
+    }
+    
+    NSError * error;
+    NSDictionary * responseDict = [NSJSONSerialization JSONObjectWithData:responseJSONdata options:0 error:&error];
+    if (error || ![responseDict isKindOfClass:[NSDictionary class]]) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Error - The server returned an unknown response to a batch upload: %@", error);
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassResponse];
+        [self currentBatchFailedWithError:[self errorWithCode:STRCaptureUploadErrorUnreadableResponse message:@"The server returned a response that could not be read."]];
+        return;
+    }
+    if ([[responseDict objectForKey:@"error"] isEqual:@"true"]) {
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Error received from server for a batch upload");
+        [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassServer];
+        [self currentBatchFailedWithError:[self errorWithCode:STRCaptureUploadErrorServerRejected message:[responseDict objectForKey:@"message"]]];
+        return;
+    }
+    
+    // The request went through; each capture has its own result
+    [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassNone];
+    NSMutableDictionary * results = [NSMutableDictionary dictionaryWithCapacity:currentBatchCaptures.count];
+    NSArray * resultList = [responseDict objectForKey:@"results"];
+    if ([resultList isKindOfClass:[NSArray class]]) {
+        for (NSDictionary * result in resultList) {
+            if ([result isKindOfClass:[NSDictionary class]] && [[result objectForKey:@"token"] isKindOfClass:[NSString class]]) {
+                [results setObject:result forKey:[result objectForKey:@"token"]];
+            }
+        }
+    }
+    
+    NSArray * batch = currentBatchCaptures;
+    currentBatchCaptures = nil;
+    for (STRCapture * capture in batch) {
+        NSDictionary * result = [results objectForKey:capture.token];
+        if (result && ![[result objectForKey:@"error"] isEqual:@"true"]) {
+            [uploadedBatchTokens addObject:capture.token];
+            [capture markUploadedAtDate:nil];
+            if ([_delegate respondsToSelector:@selector(fileUploadedSuccessfullyWithToken:)]) {
+                [_delegate fileUploadedSuccessfullyWithToken:capture.token];
+            }
+            continue;
+        }
+        NSString * message = (result) ? [result objectForKey:@"message"] : @"The server did not report a result for this capture.";
+        [self batchCapture:capture failedWithError:[self errorWithCode:STRCaptureUploadErrorServerRejected message:message] retry:YES];
+    }
+    [self sendNextBatch];
+}
+
+-(void)currentBatchFailedWithError:(NSError *)error {
+    NSArray * batch = currentBatchCaptures;
+    currentBatchCaptures = nil;
+    for (STRCapture * capture in batch) {
+        [self batchCapture:capture failedWithError:error retry:YES];
+    }
+    [self sendNextBatch];
+}
 
--(NSString *)capturesDirectoryPath {
-    return [NSHomeDirectory() stringByAppendingPathComponent:@"Documents/StraboCaptures"];
+-(void)batchCapture:(STRCapture *)capture failedWithError:(NSError *)error retry:(BOOL)retry {
+    NSString * token = (capture.token) ? capture.token : @"";
+    NSUInteger attempts = [[batchAttempts objectForKey:token] unsignedIntegerValue] + 1;
+    [batchAttempts setObject:@(attempts) forKey:token];
+    if (retry && attempts < kSTRBatchMaximumAttempts) {
+        // Sent again in a later batch, without the captures that succeeded
+        [pendingBatchCaptures addObject:capture];
+        return;
+    }
+    STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Gave up on uploading capture %@ after %lu attempts: %@", token, (unsigned long)attempts, error.localizedDescription);
+    [failedBatchTokens addObject:token];
+    if ([_delegate respondsToSelector:@selector(batchUploadOfCaptureWithToken:didFailWithError:)]) {
+        [_delegate batchUploadOfCaptureWithToken:token didFailWithError:error];
+    }
+}
+
+-(void)finishBatch {
+    uploadingBatch = NO;
+    NSArray * uploadedTokens = uploadedBatchTokens;
+    NSArray * failedTokens = failedBatchTokens;
+    pendingBatchCaptures = nil;
+    batchAttempts = nil;
+    uploadedBatchTokens = nil;
+    failedBatchTokens = nil;
+    STRLogInfo(STRLogCategoryUpload, @"STRCaptureUploadManager: Batch upload finished: %lu uploaded, %lu failed.", (unsigned long)uploadedTokens.count, (unsigned long)failedTokens.count);
+    if ([_delegate respondsToSelector:@selector(batchUploadDidFinishWithUploadedTokens:failedTokens:)]) {
+        [_delegate batchUploadDidFinishWithUploadedTokens:uploadedTokens failedTokens:failedTokens];
+    }
+}
+
+-(BOOL)writeData:(NSData *)data toStream:(NSOutputStream *)stream {
+    const uint8_t * bytes = (const uint8_t *)[data bytes];
+    NSUInteger offset = 0;
+    while (offset < data.length) {
+        NSInteger written = [stream write:bytes + offset maxLength:data.length - offset];
+        if (written <= 0) return NO;
+        offset += written;
+    }
+    return YES;
+}
+
+-(BOOL)writeFileAtPath:(NSString *)path toStream:(NSOutputStream *)stream {
+    NSInputStream * input = [NSInputStream inputStreamWithFileAtPath:path];
+    [input open];
+    NSMutableData * buffer = [NSMutableData dataWithLength:kSTRBatchCopyBufferSize];
+    BOOL success = YES;
+    NSInteger readLength;
+    while ((readLength = [input read:buffer.mutableBytes maxLength:buffer.length]) > 0) {
+        [buffer setLength:readLength];
+        success = [self writeData:buffer toStream:stream];
+        [buffer setLength:kSTRBatchCopyBufferSize];
+        if (!success) break;
+    }
+    if (readLength < 0) success = NO;
+    [input close];
+    return success;
+}
+
+-(NSString *)temporaryBodyPathWithPrefix:(NSString *)prefix {
+    return [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"%@-%@", prefix, [[NSProcessInfo processInfo] globallyUniqueString]]];
+}
+
+-(NSData *)mappedBodyAtTemporaryPath:(NSString *)path written:(BOOL)written {
+    // The mapping stays valid once the file is unlinked, and nothing is left
+    // behind if the app is stopped during the upload
+    NSData * mappedBody = (written) ? [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:nil] : nil;
+    unlink([path fileSystemRepresentation]);
+    return mappedBody;
+}
+
+#pragma mark - Metrics Support
+
+-(NSTimeInterval)timeSinceUploadStart {
+    return CACurrentMediaTime() - uploadStartTime;
+}
+
+-(void)recordCurrentMetricsWithErrorClass:(STRUploadErrorClass)errorClass {
+    if (!currentMetrics) return;
+    currentMetrics.errorClass = errorClass;
+    if (uploadStartTime > 0) currentMetrics.totalDuration = [self timeSinceUploadStart];
+    [[STRUploadMetricsRecorder sharedRecorder] recordMetrics:currentMetrics];
+    currentMetrics = nil;
+}
+
+#pragma mark - Request Body Support
+
+-(NSInputStream *)openBodyProducer {
+    [self closeBodyProducer];
+    currentBodyOffset = 0;
+    requestMeter = [bandwidthController beginRequest];
+    
+    // The connection reads the body from one end of a bound pair while we
+    // write to the other end. The pair's buffer is kept small so that the
+    // bandwidth controller, not the socket, decides how fast data leaves.
+    CFReadStreamRef readStream = NULL;
+    CFWriteStreamRef writeStream = NULL;
+    CFStreamCreateBoundPair(NULL, &readStream, &writeStream, (CFIndex)bandwidthController.maximumChunkSize);
+    bodyBufferWasFull = NO;
+    
+    bodyProducerStream = (__bridge_transfer NSOutputStream *)writeStream;
+    [bodyProducerStream setDelegate:self];
+    [bodyProducerStream scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
+    [bodyProducerStream open];
+    
+    return (__bridge_transfer NSInputStream *)readStream;
+}
+
+-(void)pumpBody {
+    [bodyPumpTimer invalidate];
+    bodyPumpTimer = nil;
+    if (!bodyProducerStream) return;
+    
+    // Space after a full buffer means the connection has started reading the body
+    if (bodyBufferWasFull && currentMetrics.connectDuration < 0 && [bodyProducerStream hasSpaceAvailable]) {
+        currentMetrics.connectDuration = [self timeSinceUploadStart];
+    }
+    
+    const uint8_t * bytes = (const uint8_t *)[currentBody bytes];
+    NSUInteger bodyLength = currentBody.length;
+    while (currentBodyOffset < bodyLength && [bodyProducerStream hasSpaceAvailable]) {
+        NSUInteger allowed = [bandwidthController bytesAllowedNow];
+        if (allowed == 0) break;
+        NSInteger written = [bodyProducerStream write:bytes + currentBodyOffset maxLength:MIN(allowed, bodyLength - currentBodyOffset)];
+        if (written <= 0) break;
+        currentBodyOffset += written;
+        [requestMeter didWriteBytes:written endingAtOffset:currentBodyOffset];
+    }
+    if (![bodyProducerStream hasSpaceAvailable]) bodyBufferWasFull = YES;
+    
+    if (currentBodyOffset >= bodyLength) {
+        // Closing our end tells the connection that the body is complete
+        [self closeBodyProducer];
+        return;
+    }
+    
+    // If the bandwidth controller held us back, check back when it expects to
+    // allow more. Otherwise the next space available event wakes us up.
+    if ([bodyProducerStream hasSpaceAvailable]) {
+        NSTimeInterval delay = MAX([bandwidthController delayUntilBytesAllowed], 0.01);
+        bodyPumpTimer = [NSTimer scheduledTimerWithTimeInterval:delay target:self selector:@selector(pumpBody) userInfo:nil repeats:NO];
+    }
+}
+
+-(void)closeBodyProducer {
+    [bodyPumpTimer invalidate];
+    bodyPumpTimer = nil;
+    [bodyProducerStream setDelegate:nil];
+    [bodyProducerStream removeFromRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
+    [bodyProducerStream close];
+    bodyProducerStream = nil;
+}
+
+-(void)finishCurrentUpload {
+    [self closeBodyProducer];
+    currentBody = nil;
+    currentConnection = nil;
+}
+
+-(void)stream:(NSStream *)stream handleEvent:(NSStreamEvent)eventCode {
+    if (stream != bodyProducerStream) return;
+    
+    if (eventCode == NSStreamEventHasSpaceAvailable) {
+        [self pumpBody];
+    } else if (eventCode == NSStreamEventErrorOccurred) {
+        // The connection reports the failure to us and the delegate
+        STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Error streaming the request body: %@", [stream streamError]);
+        [self closeBodyProducer];
+    }
+}
+
+-(void)appendJSONFileAtPath:(NSString *)path toBody:(NSMutableData *)body partName:(NSString *)partName fileName:(NSString *)fileName compressed:(BOOL)compressed {
+    [body appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"%@\"; filename=\"%@\"\r\n", partName, fileName] dataUsingEncoding:NSUTF8StringEncoding]];
+    [body appendData:[@"Content-Type: application/json\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    if (compressed) {
+        // Mark the part so that the server knows to inflate it. If compression
+        // fails, roll back to the end of the plain headers and send the JSON as is.
+        NSUInteger plainHeaderLength = body.length;
+        [body appendData:[@"Content-Encoding: gzip\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+        NSUInteger headerLength = body.length;
+        if ([body appendGzippedContentsOfFile:path]) {
+            STRLogDebug(STRLogCategoryUpload, @"STRCaptureUploadManager: Compressed %@ to %lu bytes.", partName, (unsigned long)(body.length - headerLength));
+            return;
+        }
+        STRLogWarning(STRLogCategoryUpload, @"STRCaptureUploadManager: Could not compress %@. Sending it uncompressed.", partName);
+        [body setLength:plainHeaderLength];
+    }
+    
+    [body appendData:[@"\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    [body appendData:[NSData dataWithContentsOfFile:path]];
 }
 
 @end
@@ -198,6 +910,11 @@
 @implementation STRCaptureUploadManager (NSURLConnectionDelegate)
 
 -(void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response {
+    if (bodySentTime > 0 && currentMetrics.responseLatency < 0) {
+        currentMetrics.responseLatency = CACurrentMediaTime() - bodySentTime;
+    }
+    responseStatusCode = ([response isKindOfClass:[NSHTTPURLResponse class]]) ? [(NSHTTPURLResponse *)response statusCode] : 0;
+    
     // Reset the received data
     [receivedData setLength:0];
 }
@@ -208,17 +925,26 @@
 }
 
 -(void)connection:(NSURLConnection *)connection didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge {
-    NSLog(@"STRCaptureUploadManager: Connection failed - authentication challenge received.");
+    STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: Connection failed - authentication challenge received.");
 }
 
 -(void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error {
+    [self finishCurrentUpload];
+    currentCapture = nil;
+    [self recordCurrentMetricsWithErrorClass:STRUploadErrorClassNetwork];
+    STRLogError(STRLogCategoryUpload, @"STRCaptureUploadManager: File upload failed with error: %@", error.localizedDescription);
+    if (uploadingBatch) {
+        [self currentBatchFailedWithError:error];
+        return;
+    }
     if ([_delegate respondsToSelector:@selector(fileUploadDidFailWithError:)]) {
         [_delegate fileUploadDidFailWithError:error];
     }
-    NSLog(@"STRCaptureUploadManager: File upload failed with error: %@", error.localizedDescription);
 }
 
 -(void)connectionDidFinishLoading:(NSURLConnection *)connection {
+    [self finishCurrentUpload];
+    
     // Make sure that the delegate is informed of 100% progress
     if ([_delegate respondsToSelector:@selector(fileUploadDidProgress:)]) {
         [_delegate fileUploadDidProgress:@1.0];
@@ -231,10 +957,32 @@
 }
 
 -(void)connection:(NSURLConnection *)connection didSendBodyData:(NSInteger)bytesWritten totalBytesWritten:(NSInteger)totalBytesWritten totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite {
+    // Feed the measured progress back into the bandwidth controller
+    [requestMeter didConfirmBytesSent:totalBytesWritten];
+    
+    // Update the metrics for this upload
+    NSTimeInterval elapsed = [self timeSinceUploadStart];
+    currentMetrics.bytesSent = totalBytesWritten;
+    if (currentMetrics.firstBodyByteDuration < 0) currentMetrics.firstBodyByteDuration = elapsed;
+    if (currentMetrics.connectDuration < 0) currentMetrics.connectDuration = elapsed;
+    if (totalBytesWritten >= totalBytesExpectedToWrite && currentMetrics.sendDuration < 0) {
+        currentMetrics.sendDuration = elapsed;
+        bodySentTime = CACurrentMediaTime();
+    }
+    
     // Notify the delegate that uploading progress has been made
     if ([_delegate respondsToSelector:@selector(fileUploadDidProgress:)]) {
         [_delegate fileUploadDidProgress:@((double)totalBytesWritten/(double)totalBytesExpectedToWrite)];
     }
 }
 
+-(NSInputStream *)connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request {
+    // The connection needs to resend the body, for example after a redirect
+    if (!currentBody) return nil;
+    currentMetrics.bodyResends++;
+    currentMetrics.sendDuration = -1;
+    bodySentTime = 0;
+    return [self openBodyProducer];
+}
+
 @end
@@ -16,6 +16,8 @@
 
 // File management
 #import "STRCaptureFileOrganizer.h"
+#import "STRCaptureSegmenter.h"
+#import "STRSegmentUploadQueue.h"
 
 //****************************************************************************************
 // Constant Definitions
@@ -167,6 +169,15 @@ NSTimeInterval const STRLenscapAnimationDuration;
  */
 @property(getter = captureMode, setter = setCaptureMode:)STRCaptureModeState captureMode;
 
+/**
+ The length, in seconds, of the segments that videos are recorded in. 0, the default, records each video as one file.
+
+ When the value is greater than 0, a video is written by a [STRCaptureSegmenter] as a series of segments of about this length. The capture appears in the STRCaptureFileManager as soon as its first segment is written, and each segment is handed to the shared [STRSegmentUploadQueue] as soon as it closes, so that most of a long video is uploaded by the time the recording stops. When the recording stops, the last segment and a request that completes the capture are queued.
+
+ Set this property before recording starts. Segmented videos are not saved to the photo roll.
+ */
+@property(nonatomic, assign)NSTimeInterval segmentDuration;
+
 /**
  The current device orientation.
  
@@ -6,6 +6,7 @@
 //  Copyright (c) 2012 Strabo. All rights reserved.
 //
 #import "STRSettings.h"
+#import "STRLogger.h"
 
 #import "STRCaptureViewController.h"
 
@@ -101,6 +102,13 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
 -(void)videoRecordingDidBegin;
 -(void)videoRecordingDidEnd;
 -(void)videoRecordingDidFailWithError:(NSError *)error;
+-(void)videoRecordingDidFinishSegmentAtURL:(NSURL *)segmentURL startTime:(CFTimeInterval)startTime duration:(NSTimeInterval)duration;
+
+@end
+
+@interface STRCaptureViewController (STRCaptureSegmenterDelegate) <STRCaptureSegmenterDelegate>
+
+-(void)captureSegmenter:(STRCaptureSegmenter *)segmenter didCloseSegment:(NSDictionary *)segment;
 
 @end
 
@@ -120,12 +128,12 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
 
 @interface STRCaptureViewController () {
     
-    BOOL _advancedLogging;
-    
     // Location Support
     STRGeoLocationData * geoLocationData;
+    STRCaptureSegmenter * captureSegmenter;
     CLLocation * initialLocation;
     CLHeading * initialHeading;
+    double lastSampleTime;
     
     // Camera capture support
     STRCaptureDataCollector * captureDataCollector;
@@ -140,7 +148,6 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
     
 }
 
-@property()BOOL advancedLogging;
 
 // Make the currentOrientation internally readwrite
 @property(nonatomic, readwrite)UIDeviceOrientation currentOrientation;
@@ -164,9 +171,6 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
 {
     [super viewDidLoad];
     
-    // Retrieve options from settings
-    _advancedLogging = [[STRSettings sharedSettings] advancedLogging];
-    
     // Set up recording constants
     mediaStartTime = CACurrentMediaTime();
     self.isRecording = NO;
@@ -270,16 +274,7 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
         [self syncSelectorUI];
     }
     
-    // Annoying logging stuff
-    if (_advancedLogging) {
-        NSString * modeString;
-        if (_captureMode == STRCaptureModeVideo) {
-            modeString = @"STRCaptureModeVideo";
-        } else {
-            modeString = @"STRCaptureModeImage";
-        }
-        NSLog(@"STRCaptureViewController: Capture mode constant set to %@", modeString);
-    }
+    STRLogDebug(STRLogCategoryCapture, @"STRCaptureViewController: Capture mode constant set to %@", (_captureMode == STRCaptureModeVideo) ? @"STRCaptureModeVideo" : @"STRCaptureModeImage");
 }
 
 -(STRCaptureModeState)captureMode {
@@ -309,7 +304,7 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
         // Update the Location Manager with the new orientation setting.
         _locationManager.headingOrientation = _currentOrientation;
         
-        if (_advancedLogging) NSLog(@"STRCaptureViewController: Orientation changed to: %i", _currentOrientation);
+        STRLogDebug(STRLogCategoryCapture, @"STRCaptureViewController: Orientation changed to: %i", _currentOrientation);
     }
 }
 
@@ -391,16 +386,34 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
 #pragma mark - Recording Services
 
 -(void)recordCurrentLocationToGeodataObject {
+    // Drop updates that come sooner than the sampling interval of the settings allows
+    double now = CACurrentMediaTime();
+    NSTimeInterval samplingInterval = [[STRSettings sharedSettings] geoDataSamplingInterval];
+    if (samplingInterval > 0 && now - lastSampleTime < samplingInterval) return;
+    lastSampleTime = now;
+
+    // A segmented recording keeps its points in the segmenter
+    if (captureSegmenter) {
+        STRTrackSample sample = { _locationManager.location.coordinate.latitude, _locationManager.location.coordinate.longitude, _locationManager.heading.trueHeading, _locationManager.location.horizontalAccuracy, now - mediaStartTime };
+        [captureSegmenter addSample:sample];
+        return;
+    }
     // Add a point taken from the locationManager
     [geoLocationData addDataPointWithLatitude:_locationManager.location.coordinate.latitude
                                     longitude:_locationManager.location.coordinate.longitude
                                       heading:_locationManager.heading.trueHeading
-                                    timestamp:(CACurrentMediaTime() - mediaStartTime)
+                                    timestamp:(now - mediaStartTime)
                                      accuracy:_locationManager.location.horizontalAccuracy];
 }
 
 -(void)startCapturingVideo {
     geoLocationData = [[STRGeoLocationData alloc] init];
+    captureSegmenter = nil;
+    if (self.segmentDuration > 0) {
+        captureSegmenter = [STRCaptureSegmenter segmenterWithSegmentDuration:self.segmentDuration];
+        captureSegmenter.delegate = self;
+    }
+    captureDataCollector.segmentDuration = self.segmentDuration;
     [captureDataCollector startCapturingVideoWithOrientation:_currentOrientation];
 }
 
@@ -456,13 +469,13 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
         // Move image files
         [fileOrganizer saveTempImageFilesWithInitialLocation:initialLocation heading:initialHeading];
     } else {
-        if (_advancedLogging) NSLog(@"STRCaptureViewController: Method resaveTemporaryFilesOfType: called with improper parameters. Please see documentation.");
+        STRLogError(STRLogCategoryCapture, @"STRCaptureViewController: Method resaveTemporaryFilesOfType: called with improper parameters. Please see documentation.");
     }
     
     // If necessary, save the media file to the photo roll
     
     if ([[STRSettings sharedSettings] saveToPhotoRoll]) {
-        if (_advancedLogging) NSLog(@"STRCaptureViewController: Saving media files to the photo roll if possible.");
+        STRLogDebug(STRLogCategoryCapture, @"STRCaptureViewController: Saving media files to the photo roll if possible.");
         [fileOrganizer saveMediaToPhotoRollFromPath:mediaPath];
     }
     
@@ -480,7 +493,7 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
     } else if (_captureMode == STRCaptureModeImage) {
         [self setCaptureMode:STRCaptureModeVideo];
     } else {
-        if (_advancedLogging) NSLog(@"STRCaptureViewController: Invalid STRCaptureModeState set for captureMode property.");
+        STRLogError(STRLogCategoryCapture, @"STRCaptureViewController: Invalid STRCaptureModeState set for captureMode property.");
     }
     
     // Selector UI is automatically changed because setCaptureMode: automatically
@@ -525,7 +538,7 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
         recordButton.title = @"Rec";
         mediaSelectorControl.selectedSegmentIndex = 0;
     } else {
-        if (_advancedLogging) NSLog(@"STRCaptureViewController: Invalid STRCaptureModeState set for captureMode property.");
+        STRLogError(STRLogCategoryCapture, @"STRCaptureViewController: Invalid STRCaptureModeState set for captureMode property.");
     }
 }
 
@@ -593,7 +606,7 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
     
     NSTimeInterval animationHalfDuration = (double)STRLenscapAnimationDuration / (double)2.0;
     
-    if (_advancedLogging) NSLog(@"STRCaptureViewController: Opening Lenscap with duration 2 x %0.01f", animationHalfDuration);
+    STRLogTrace(STRLogCategoryCapture, @"STRCaptureViewController: Opening Lenscap with duration 2 x %0.01f", animationHalfDuration);
     
     __block UIImageView * lenscapTopView = [lenscapView.subviews objectAtIndex:0];
     __block CGRect lenscapTopFrame = lenscapTopView.frame;
@@ -641,7 +654,7 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
 }
 
 -(void)locationManager:(CLLocationManager *)manager didFailWithError:(NSError *)error {
-    NSLog(@"STRCaptureViewController: Location manager failed and could not receive location data: %@", error.description);
+    STRLogError(STRLogCategoryCapture, @"STRCaptureViewController: Location manager failed and could not receive location data: %@", error.description);
 }
 
 #pragma mark - Responding to heading events
@@ -666,14 +679,25 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
 
 
 -(void)videoRecordingDidBegin {
-    if (_advancedLogging) NSLog(@"STRCaptureViewController: Video recording did begin.");
+    STRLogDebug(STRLogCategoryCapture, @"STRCaptureViewController: Video recording did begin.");
     self.isRecording = YES;
     
     // Force record the first geodata point
     mediaStartTime = CACurrentMediaTime();
+    lastSampleTime = 0;
     // Write an initial point to the data
     initialLocation = _locationManager.location;
     initialHeading = _locationManager.heading;
+    if (captureSegmenter) {
+        BOOL landscape = UIDeviceOrientationIsLandscape(_currentOrientation);
+        captureSegmenter.initialInfo = @{
+        @"coords" : @[ @(initialLocation.coordinate.latitude), @(initialLocation.coordinate.longitude) ],
+        @"heading" : @(initialHeading.trueHeading),
+        @"orientation" : (landscape) ? @"horizontal" : @"vertical"
+        };
+        [self recordCurrentLocationToGeodataObject];
+        return;
+    }
     [geoLocationData addDataPointWithLatitude:_locationManager.location.coordinate.latitude
                                     longitude:_locationManager.location.coordinate.longitude
                                       heading:_locationManager.heading.trueHeading
@@ -681,11 +705,26 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
                                      accuracy:_locationManager.location.horizontalAccuracy];
 }
 
+-(void)videoRecordingDidFinishSegmentAtURL:(NSURL *)segmentURL startTime:(CFTimeInterval)startTime duration:(NSTimeInterval)duration {
+    [captureSegmenter closeSegmentWithMediaAtPath:[segmentURL path] startTime:(startTime - mediaStartTime) duration:duration];
+}
+
 -(void)videoRecordingDidEnd {
-    if (_advancedLogging) NSLog(@"STRCaptureViewController: Video recording did end.");
+    STRLogDebug(STRLogCategoryCapture, @"STRCaptureViewController: Video recording did end.");
     self.isRecording = NO;
     self.isReadyToRecord = NO;
     
+    // The segments are already saved; write the whole track and complete the upload
+    if (captureSegmenter) {
+        if ([captureSegmenter finish]) {
+            [[STRSegmentUploadQueue sharedQueue] enqueueCompletionOfCaptureAtPath:captureSegmenter.directoryPath];
+        }
+        captureSegmenter = nil;
+        [activityIndicator stopAnimating];
+        self.isReadyToRecord = YES;
+        return;
+    }
+    
     // Write the JSON geo-data
     [geoLocationData writeDataPointsToTempFile];
     
@@ -695,7 +734,18 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
 }
 
 -(void)videoRecordingDidFailWithError:(NSError *)error {
-    NSLog(@"STRCaptureViewController: !!!ERROR: Video recording failed: %@", error.description);
+    STRLogError(STRLogCategoryCapture, @"STRCaptureViewController: !!!ERROR: Video recording failed: %@", error.description);
+    self.isRecording = NO;
+    
+    // Keep the segments recorded before the failure, so that the capture is completed on the
+    // server or, if the queue has given up on it, handed to the outbox
+    if (captureSegmenter) {
+        if ([captureSegmenter finish]) {
+            [[STRSegmentUploadQueue sharedQueue] enqueueCompletionOfCaptureAtPath:captureSegmenter.directoryPath];
+        }
+        captureSegmenter = nil;
+        [activityIndicator stopAnimating];
+    }
     self.isReadyToRecord = YES;
 }
 
@@ -706,3 +756,17 @@ NSTimeInterval const STRLenscapAnimationDuration = 0.6;
 }
 
 @end
+
+@implementation STRCaptureViewController (STRCaptureSegmenterDelegate)
+
+-(void)captureSegmenter:(STRCaptureSegmenter *)segmenter didCloseSegment:(NSDictionary *)segment {
+    // The first segment provides the thumbnail of the capture
+    if ([[segment objectForKey:@"index"] unsignedIntegerValue] == 0) {
+        NSString * mediaPath = [segmenter.directoryPath stringByAppendingPathComponent:[[segment objectForKey:@"media_file"] lastPathComponent]];
+        NSString * thumbnailPath = [segmenter.directoryPath stringByAppendingPathComponent:[segmenter.token stringByAppendingPathExtension:@"png"]];
+        [[[STRCaptureFileOrganizer alloc] init] writeThumbnailForMediaAtPath:mediaPath toPath:thumbnailPath];
+    }
+    [[STRSegmentUploadQueue sharedQueue] enqueueSegment:segment ofCaptureAtPath:segmenter.directoryPath];
+}
+
+@end
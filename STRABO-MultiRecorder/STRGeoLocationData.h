@@ -8,6 +8,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class STRTrackFilter;
+
 /**
  Holds the geo-location data recorded by a capture.
  
@@ -18,11 +20,15 @@
 @interface STRGeoLocationData : NSObject {
     id delegate;
     NSMutableArray * dataPoints;
+    STRTrackFilter * trackFilter;
+    NSMutableArray * filteredDataPoints;
 }
 
 /**
  Add a datapoint to the list of points.
  
+ The point is also passed through a STRTrackFilter, and the filtered point is added to the filteredDataPointList.
+ 
  @param latitude The latitude double value.
  
  @param longitude The longitude double value.
@@ -58,10 +64,17 @@
  */
 -(NSArray *)dataPointList;
 
+/**
+ Returns the points filtered by a STRTrackFilter as they were added, in the same format as the dataPointList.
+ 
+ Each filtered point is the best estimate given the points up to it. Repeated fixes and compass jitter are smoothed out, and the accuracy is the estimated error of the filtered position.
+ */
+-(NSArray *)filteredDataPointList;
+
 /**
  Write the collected data points to a temporary file in the tmp directory.
  
- The name of this file will be output.JSON
+ The name of this file will be output.JSON. The filtered data points are written beside it, to output-filtered.json.
  */
 -(void)writeDataPointsToTempFile;
 
@@ -7,10 +7,13 @@
 //
 
 #import "STRGeoLocationData.h"
+#import "STRTrackFilter.h"
 
 @interface STRGeoLocationData (InternalMathods)
 
 -(NSString *)tempFilePath;
+-(NSString *)tempFilePathWithName:(NSString *)name;
+-(void)writePoints:(NSArray *)points toPath:(NSString *)path;
 
 @end
 
@@ -20,6 +23,8 @@
     self = [super init];
     if (self) {
         dataPoints = [[NSMutableArray alloc] init];
+        trackFilter = [[STRTrackFilter alloc] init];
+        filteredDataPoints = [[NSMutableArray alloc] init];
     }
     return self;
 }
@@ -33,22 +38,22 @@
     };
 
     [dataPoints addObject:point];
+    
+    STRTrackSample sample = { latitude, longitude, heading, accuracy, timestamp };
+    [filteredDataPoints addObject:[STRTrackFilter pointFromSample:[trackFilter filterSample:sample]]];
 }
 
 -(NSArray *)dataPointList {
     return dataPoints;
 }
 
+-(NSArray *)filteredDataPointList {
+    return filteredDataPoints;
+}
+
 -(void)writeDataPointsToTempFile {
-    
-    NSDictionary * points = [NSDictionary dictionaryWithObject:dataPoints forKey:@"points"];
-    
-    NSOutputStream * output = [NSOutputStream outputStreamToFileAtPath:[self tempFilePath] append:NO];
-    [output open];
-    
-    [NSJSONSerialization writeJSONObject:points toStream:output options:0 error:nil];
-    
-    [output close];
+    [self writePoints:dataPoints toPath:[self tempFilePath]];
+    [self writePoints:filteredDataPoints toPath:[self tempFilePathWithName:@"output-filtered"]];
 }
 
 @end
@@ -57,7 +62,11 @@
 @implementation STRGeoLocationData (InternalMathods)
 
 -(NSString *)tempFilePath {
-    NSString *outputPath = [[NSString alloc] initWithFormat:@"%@%@%@", NSTemporaryDirectory(), @"output", @".json"];
+    return [self tempFilePathWithName:@"output"];
+}
+
+-(NSString *)tempFilePathWithName:(NSString *)name {
+    NSString *outputPath = [[NSString alloc] initWithFormat:@"%@%@%@", NSTemporaryDirectory(), name, @".json"];
     
     NSFileManager *fileManager = [NSFileManager defaultManager];
     // Remove the old file
@@ -70,4 +79,16 @@
     return outputPath;
 }
 
+-(void)writePoints:(NSArray *)points toPath:(NSString *)path {
+    
+    NSDictionary * geoData = [NSDictionary dictionaryWithObject:points forKey:@"points"];
+    
+    NSOutputStream * output = [NSOutputStream outputStreamToFileAtPath:path append:NO];
+    [output open];
+    
+    [NSJSONSerialization writeJSONObject:geoData toStream:output options:0 error:nil];
+    
+    [output close];
+}
+
 @end
\ No newline at end of file
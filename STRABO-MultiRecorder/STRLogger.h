@@ -0,0 +1,133 @@
+//
+//  STRLogger.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ STRLogLevel
+
+ The severity of a log message. A message is written only if its level is at or below the level of its category. See the [ConstantsReference] guide for more information.
+ */
+typedef enum {
+    STRLogLevelOff,         // Nothing is logged
+    STRLogLevelError,       // Something failed
+    STRLogLevelWarning,     // Something unexpected happened but was handled
+    STRLogLevelInfo,        // Notable events, such as an upload finishing
+    STRLogLevelDebug,       // Details that help when debugging
+    STRLogLevelTrace        // Very frequent messages from hot paths
+} STRLogLevel;
+
+/**
+ STRLogCategory
+
+ The part of the SDK that a log message comes from. Each category has its own level.
+ */
+typedef enum {
+    STRLogCategoryGeneral,
+    STRLogCategoryCapture,  // Recording and capture objects
+    STRLogCategoryStorage,  // Reading and writing capture files
+    STRLogCategoryUpload,   // Uploading captures
+    STRLogCategoryPlayback, // Playing captures back
+    STRLogCategoryCount
+} STRLogCategory;
+
+// Used by the logging macros. Do not use these directly.
+extern STRLogLevel volatile STRLogCategoryLevels[STRLogCategoryCount];
+extern int32_t volatile STRLogConfigured;
+void STRLogConfigure(void);
+void STRLogWrite(STRLogCategory category, STRLogLevel level, NSString * format, ...) NS_FORMAT_FUNCTION(3,4);
+
+static inline BOOL STRLogIsEnabled(STRLogCategory category, STRLogLevel level) {
+    if (__builtin_expect(!STRLogConfigured, 0)) STRLogConfigure();
+    return level <= STRLogCategoryLevels[category];
+}
+
+// Logs a message. The format arguments are only evaluated if the level is enabled for the category.
+#define STRLog(category, level, format, ...) do { if (STRLogIsEnabled(category, level)) STRLogWrite(category, level, format, ##__VA_ARGS__); } while (0)
+
+#define STRLogError(category, format, ...)      STRLog(category, STRLogLevelError, format, ##__VA_ARGS__)
+#define STRLogWarning(category, format, ...)    STRLog(category, STRLogLevelWarning, format, ##__VA_ARGS__)
+#define STRLogInfo(category, format, ...)       STRLog(category, STRLogLevelInfo, format, ##__VA_ARGS__)
+#define STRLogDebug(category, format, ...)      STRLog(category, STRLogLevelDebug, format, ##__VA_ARGS__)
+#define STRLogTrace(category, format, ...)      STRLog(category, STRLogLevelTrace, format, ##__VA_ARGS__)
+
+/**
+ Controls the SDK's log.
+
+ Log messages are written with the `STRLogError`, `STRLogWarning`, `STRLogInfo`, `STRLogDebug` and `STRLogTrace` macros, which take a STRLogCategory followed by a format string and its arguments:
+
+    STRLogDebug(STRLogCategoryUpload, @"Uploading file: %@", path);
+
+ Checking whether a message is enabled costs a load and a compare, and the format arguments are not evaluated when it is not, so it is safe to leave logging in hot paths. Enabled messages are formatted on the calling thread and copied into a fixed-size, lock-free ring buffer. A private serial queue drains the buffer to the console and to a log file in `Library/Caches/StraboLogs`, which is rotated when it grows past the `Log_File_Max_Bytes` setting. If the queue falls a whole buffer behind, new messages are dropped rather than blocking the caller; see droppedMessageCount.
+
+ The levels are read from the `Log_Level` and `Advanced_Logging` settings the first time anything is logged. Use the class methods below to change them at runtime.
+ */
+@interface STRLogger : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Levels
+///---------------------------------------------------------------------------------------
+
+/**
+ The current level of a category.
+
+ @param category The category.
+
+ @return STRLogLevel The most verbose level that is logged for the category.
+ */
++(STRLogLevel)levelForCategory:(STRLogCategory)category;
+
+/**
+ Changes the level of a category.
+
+ @param level The most verbose level to log for the category.
+
+ @param category The category.
+ */
++(void)setLevel:(STRLogLevel)level forCategory:(STRLogCategory)category;
+
+/**
+ Changes the level of every category.
+
+ @param level The most verbose level to log.
+ */
++(void)setLevel:(STRLogLevel)level;
+
+///---------------------------------------------------------------------------------------
+/// @name Output
+///---------------------------------------------------------------------------------------
+
+/**
+ Turns writing messages to the console on or off. It is on by default.
+
+ @param enabled NO to only write messages to the log file.
+ */
++(void)setConsoleOutputEnabled:(BOOL)enabled;
+
+/**
+ The path of the current log file.
+
+ Older messages are in the files with the same name followed by `.1` and `.2`.
+
+ @return NSString The path, or nil if the `Log_To_File` setting is off.
+ */
++(NSString *)logFilePath;
+
+/**
+ Waits until every message logged so far has been written.
+ */
++(void)flush;
+
+/**
+ The number of messages dropped because the ring buffer was full.
+
+ @return NSUInteger The count since the app started.
+ */
++(NSUInteger)droppedMessageCount;
+
+@end
@@ -0,0 +1,242 @@
+//
+//  STRLogger.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRLogger.h"
+#import "STRSettings.h"
+
+#import <libkern/OSAtomic.h>
+#include <stdio.h>
+#include <time.h>
+
+// Number of records in the ring buffer. Must be a power of two.
+#define kSTRLogRingCapacity 1024
+// Longest message kept, in bytes. Longer messages are truncated.
+#define kSTRLogMessageLength 256
+// Log file size used when the settings do not provide one
+#define kSTRLogDefaultMaxFileSize (512 * 1024)
+// The current log file plus this many older ones are kept
+#define kSTRLogRotatedFileCount 2
+
+typedef struct {
+    // Equal to the record's position when it is free, and to the position + 1 once it holds a message
+    uint32_t volatile sequence;
+    CFAbsoluteTime timestamp;
+    STRLogCategory category;
+    STRLogLevel level;
+    NSUInteger length;
+    char message[kSTRLogMessageLength];
+} STRLogRecord;
+
+STRLogLevel volatile STRLogCategoryLevels[STRLogCategoryCount];
+int32_t volatile STRLogConfigured = 0;
+
+static STRLogRecord _ring[kSTRLogRingCapacity];
+static uint32_t volatile _enqueuePosition = 0;
+static uint32_t _dequeuePosition = 0;           // Only touched on the drain queue
+static int32_t volatile _drainScheduled = 0;
+static int32_t volatile _droppedMessages = 0;
+static BOOL volatile _consoleOutput = YES;
+
+static dispatch_queue_t _drainQueue;
+static NSString * _logFilePath;
+static FILE * _logFile;
+static unsigned long long _logFileSize;
+static unsigned long long _maxLogFileSize;
+
+static const char * const STRLogLevelLabels[] = { "OFF", "ERROR", "WARN", "INFO", "DEBUG", "TRACE" };
+static const char * const STRLogCategoryLabels[] = { "general", "capture", "storage", "upload", "playback" };
+
+#pragma mark - Configuration
+
+static STRLogLevel STRLogLevelNamed(NSString * name, BOOL advancedLogging) {
+    NSArray * names = @[ @"off", @"error", @"warning", @"info", @"debug", @"trace" ];
+    NSUInteger index = [names indexOfObject:[name lowercaseString]];
+    if (index != NSNotFound) return (STRLogLevel)index;
+    // Without an explicit level, fall back to the older on/off switch
+    return (advancedLogging) ? STRLogLevelDebug : STRLogLevelWarning;
+}
+
+static void STRLogOpenFile(void) {
+    _logFile = fopen([_logFilePath fileSystemRepresentation], "a");
+    if (!_logFile) return;
+    fseek(_logFile, 0, SEEK_END);
+    _logFileSize = ftell(_logFile);
+}
+
+void STRLogConfigure(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        STRSettings * settings = [STRSettings sharedSettings];
+        STRLogLevel level = STRLogLevelNamed([settings logLevel], [settings advancedLogging]);
+        for (int i = 0; i < STRLogCategoryCount; i++) {
+            STRLogCategoryLevels[i] = level;
+        }
+
+        for (uint32_t i = 0; i < kSTRLogRingCapacity; i++) {
+            _ring[i].sequence = i;
+        }
+
+        _maxLogFileSize = [settings logFileMaxBytes];
+        if (_maxLogFileSize == 0) _maxLogFileSize = kSTRLogDefaultMaxFileSize;
+        if ([settings logToFile]) {
+            NSString * cachesPath = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+            NSString * logDirectory = [cachesPath stringByAppendingPathComponent:@"StraboLogs"];
+            [[NSFileManager defaultManager] createDirectoryAtPath:logDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+            _logFilePath = [logDirectory stringByAppendingPathComponent:@"strabo.log"];
+            STRLogOpenFile();
+        }
+
+        _drainQueue = dispatch_queue_create("com.strabogis.log", DISPATCH_QUEUE_SERIAL);
+
+        // A runtime override of the level applies to every category, as the plist does
+        [[NSNotificationCenter defaultCenter] addObserverForName:STRSettingsDidChangeNotification object:nil queue:nil usingBlock:^(NSNotification * notification) {
+            NSSet * keys = [notification.userInfo objectForKey:STRSettingsChangedKeysKey];
+            if (![keys containsObject:@"Log_Level"] && ![keys containsObject:@"Advanced_Logging"]) return;
+            STRSettings * changedSettings = notification.object;
+            [STRLogger setLevel:STRLogLevelNamed([changedSettings logLevel], [changedSettings advancedLogging])];
+        }];
+
+        OSMemoryBarrier();
+        STRLogConfigured = 1;
+    });
+}
+
+#pragma mark - Draining
+
+static void STRLogRotateFile(void) {
+    fclose(_logFile);
+    _logFile = NULL;
+    for (int i = kSTRLogRotatedFileCount; i > 0; i--) {
+        NSString * from = (i == 1) ? _logFilePath : [_logFilePath stringByAppendingFormat:@".%d", i - 1];
+        NSString * to = [_logFilePath stringByAppendingFormat:@".%d", i];
+        rename([from fileSystemRepresentation], [to fileSystemRepresentation]);
+    }
+    STRLogOpenFile();
+}
+
+static void STRLogEmit(STRLogRecord * record) {
+    if (_consoleOutput) {
+        NSString * message = [[NSString alloc] initWithBytes:record->message length:record->length encoding:NSUTF8StringEncoding];
+        NSLog(@"[%s] %@", STRLogCategoryLabels[record->category], message);
+    }
+    if (!_logFile) return;
+
+    CFAbsoluteTime timestamp = record->timestamp + kCFAbsoluteTimeIntervalSince1970;
+    time_t seconds = (time_t)timestamp;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char date[24];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &local);
+
+    int written = fprintf(_logFile, "%s.%03d %-5s %-8s %.*s\n", date, (int)((timestamp - seconds) * 1000), STRLogLevelLabels[record->level], STRLogCategoryLabels[record->category], (int)record->length, record->message);
+    if (written > 0) _logFileSize += written;
+    if (_logFileSize >= _maxLogFileSize) STRLogRotateFile();
+}
+
+static void STRLogDrain(void) {
+    // Cleared first, so a message published after this point schedules another drain
+    _drainScheduled = 0;
+    OSMemoryBarrier();
+
+    for (;;) {
+        STRLogRecord * record = &_ring[_dequeuePosition & (kSTRLogRingCapacity - 1)];
+        if ((int32_t)(record->sequence - (_dequeuePosition + 1)) < 0) break;
+        OSMemoryBarrier();
+        STRLogEmit(record);
+        OSMemoryBarrier();
+        record->sequence = _dequeuePosition + kSTRLogRingCapacity;
+        _dequeuePosition++;
+    }
+    if (_logFile) fflush(_logFile);
+}
+
+#pragma mark - Writing
+
+void STRLogWrite(STRLogCategory category, STRLogLevel level, NSString * format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    NSString * message = [[NSString alloc] initWithFormat:format arguments:arguments];
+    va_end(arguments);
+
+    // Claim a record. Producers race on the enqueue position; the record's sequence says whether it is free.
+    uint32_t position;
+    STRLogRecord * record;
+    for (;;) {
+        position = _enqueuePosition;
+        record = &_ring[position & (kSTRLogRingCapacity - 1)];
+        int32_t difference = (int32_t)(record->sequence - position);
+        if (difference == 0) {
+            if (OSAtomicCompareAndSwap32Barrier((int32_t)position, (int32_t)(position + 1), (int32_t volatile *)&_enqueuePosition)) break;
+        } else if (difference < 0) {
+            // The drain is a whole ring behind. Drop the message rather than block the caller.
+            OSAtomicIncrement32(&_droppedMessages);
+            return;
+        }
+    }
+
+    record->timestamp = CFAbsoluteTimeGetCurrent();
+    record->category = category;
+    record->level = level;
+    NSUInteger length = 0;
+    [message getBytes:record->message maxLength:kSTRLogMessageLength usedLength:&length encoding:NSUTF8StringEncoding options:NSStringEncodingConversionAllowLossy range:NSMakeRange(0, message.length) remainingRange:NULL];
+    record->length = length;
+
+    // Publish the record, then make sure a drain is on its way
+    OSMemoryBarrier();
+    record->sequence = position + 1;
+    if (OSAtomicCompareAndSwap32Barrier(0, 1, &_drainScheduled)) {
+        dispatch_async(_drainQueue, ^{
+            STRLogDrain();
+        });
+    }
+}
+
+@implementation STRLogger
+
+#pragma mark - Levels
+
++(STRLogLevel)levelForCategory:(STRLogCategory)category {
+    STRLogConfigure();
+    return STRLogCategoryLevels[category];
+}
+
++(void)setLevel:(STRLogLevel)level forCategory:(STRLogCategory)category {
+    STRLogConfigure();
+    STRLogCategoryLevels[category] = level;
+}
+
++(void)setLevel:(STRLogLevel)level {
+    STRLogConfigure();
+    for (int i = 0; i < STRLogCategoryCount; i++) {
+        STRLogCategoryLevels[i] = level;
+    }
+}
+
+#pragma mark - Output
+
++(void)setConsoleOutputEnabled:(BOOL)enabled {
+    _consoleOutput = enabled;
+}
+
++(NSString *)logFilePath {
+    STRLogConfigure();
+    return _logFilePath;
+}
+
++(void)flush {
+    STRLogConfigure();
+    dispatch_sync(_drainQueue, ^{
+        STRLogDrain();
+    });
+}
+
++(NSUInteger)droppedMessageCount {
+    return (NSUInteger)_droppedMessages;
+}
+
+@end
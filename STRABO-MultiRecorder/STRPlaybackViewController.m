@@ -7,7 +7,8 @@
 //
 
 #import "STRPlaybackViewController.h"
-#import "STRSettings.h"
+#import "STRCapturePathResolver.h"
+#import "STRLogger.h"
 
 // UIImage extension
 
@@ -54,8 +55,6 @@ CGFloat RadiansToDegrees(CGFloat radians) {return radians * 180/M_PI;};
 // STRPlaybackViewController stuff
 
 @interface STRPlaybackViewController () {
-    BOOL _advancedLogging;
-    
     // A dictionary to store the dataPoints of the local track
     // so that they are readily accessible
     NSDictionary * _dataPoints;
@@ -67,7 +66,6 @@ CGFloat RadiansToDegrees(CGFloat radians) {return radians * 180/M_PI;};
     
 }
 
-@property()BOOL advancedLogging;
 @property(nonatomic, strong)NSDictionary * dataPoints;
 @property(nonatomic, strong)NSArray * dataKeys;
 @property(nonatomic, strong)NSNumber * playTracker;
@@ -121,11 +119,9 @@ static const NSString *ItemStatusContext;
 {
     [super viewDidLoad];
     
-    // Retrieve Settings
-    _advancedLogging = [[STRSettings sharedSettings] advancedLogging];
-    
     // Populate the datapoints from the local capture
-    _dataPoints = [_localCapture geoDataPoints];
+    // The filtered track keeps the pin from jittering between fixes
+    _dataPoints = [_localCapture filteredGeoDataPoints];
     _dataKeys = [_dataPoints.allKeys sortedArrayUsingComparator:^NSComparisonResult(id obj1, id obj2) {
         CMTime time1 = [obj1 CMTimeValue];
         CMTime time2 = [obj2 CMTimeValue];
@@ -157,7 +153,7 @@ static const NSString *ItemStatusContext;
 
 -(void)viewDidAppear:(BOOL)animated {
     // Load the video
-    NSString * assetFilePath = [[NSHomeDirectory() stringByAppendingPathComponent:@"Documents/StraboCaptures"] stringByAppendingPathComponent:_localCapture.mediaPath];
+    NSString * assetFilePath = [[STRCapturePathResolver sharedResolver] absolutePathForCaptureFile:_localCapture.mediaPath];
     [self setUpMap];
     [self loadVideoAssetFromFile:assetFilePath];
 }
@@ -239,10 +235,10 @@ static const NSString *ItemStatusContext;
              name:AVPlayerItemDidPlayToEndTimeNotification
              object:[_player currentItem]];
             
-            if (_advancedLogging) NSLog(@"STRPlaybackViewController: Video successfully loaded.");
+            STRLogDebug(STRLogCategoryPlayback, @"STRPlaybackViewController: Video successfully loaded.");
             
         } else {
-            if (_advancedLogging) NSLog(@"STRPlaybackViewController: Error loading the capture's video asset: %@", error.localizedDescription);
+            STRLogError(STRLogCategoryPlayback, @"STRPlaybackViewController: Error loading the capture's video asset: %@", error.localizedDescription);
         }
     }];
     
@@ -283,7 +279,7 @@ static const NSString *ItemStatusContext;
 // Respond to the player's status change
 -(void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object
                        change:(NSDictionary *)change context:(void *)context {
-    if (_advancedLogging) NSLog(@"STRPlaybackViewController: Player status change detected");
+    STRLogDebug(STRLogCategoryPlayback, @"STRPlaybackViewController: Player status change detected");
     if (context == &ItemStatusContext) {
         [self addTimeObserverToPlayer:_player];
         [self syncUI];
@@ -310,7 +306,7 @@ static const NSString *ItemStatusContext;
             [self movePinToLocation:[locationPoint objectAtIndex:0] withHeading:[locationPoint objectAtIndex:1]];
             [self incrementPlayTracker];
         } else {
-            if (_advancedLogging) NSLog(@"STRPlaybackViewController: NSArray bounds error");
+            STRLogWarning(STRLogCategoryPlayback, @"STRPlaybackViewController: NSArray bounds error");
         }
     }];
 }
@@ -348,7 +344,7 @@ static const NSString *ItemStatusContext;
 }
 
 -(void)movePinToLocation:(CLLocation *)coordinate withHeading:(NSNumber *)heading {
-    if (_advancedLogging) NSLog(@"Location: %f, %f Heading: %@", coordinate.coordinate.latitude, coordinate.coordinate.longitude, heading);
+    STRLogTrace(STRLogCategoryPlayback, @"STRPlaybackViewController: Location: %f, %f Heading: %@", coordinate.coordinate.latitude, coordinate.coordinate.longitude, heading);
     MKPointAnnotation * theAnnotation = [self.mapView.annotations objectAtIndex:0];
     [theAnnotation willChangeValueForKey:@"coordinate"];
     [theAnnotation setCoordinate:coordinate.coordinate];
@@ -0,0 +1,158 @@
+//
+//  STRSegmentUploadQueue.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class STRSegmentUploadQueue;
+
+/**
+ Called by a STRSegmentUploadSender when an attempt to send a segment has ended.
+
+ @param uploaded YES if the server accepted the segment.
+
+ @param error The error that ended a failed attempt. Nil if the segment was uploaded, or if its files could not be read.
+ */
+typedef void (^STRSegmentUploadCompletionHandler)(BOOL uploaded, NSError * error);
+
+/**
+ Sends one segment of a capture, or completes the capture when the segment is nil, and calls the completion handler on the main thread when the attempt has ended.
+ */
+typedef void (^STRSegmentUploadSender)(NSDictionary * segment, NSString * capturePath, STRSegmentUploadCompletionHandler completionHandler);
+
+/**
+ Implement the STRSegmentUploadQueueDelegate to hear what becomes of the segments in a [STRSegmentUploadQueue].
+
+ All of the methods in this protocol are optional. They are called on the main thread.
+ */
+@protocol STRSegmentUploadQueueDelegate <NSObject>
+
+@optional
+
+/**
+ Reports that a segment was uploaded.
+
+ @param queue The queue.
+
+ @param segment The segment.
+
+ @param capturePath The absolute path of the capture directory.
+ */
+-(void)segmentUploadQueue:(STRSegmentUploadQueue *)queue didUploadSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath;
+
+/**
+ Reports that every segment of a capture was uploaded and that the capture was completed on the server.
+
+ @param queue The queue.
+
+ @param capturePath The absolute path of the capture directory.
+ */
+-(void)segmentUploadQueue:(STRSegmentUploadQueue *)queue didCompleteCaptureAtPath:(NSString *)capturePath;
+
+/**
+ Reports that the queue gave up on sending a capture in segments.
+
+ The segments of the capture that had not been sent are dropped. Once the capture is finished, it is queued in the shared STRUploadOutbox, which uploads it whole.
+
+ @param queue The queue.
+
+ @param capturePath The absolute path of the capture directory.
+
+ @param error The error that ended the last attempt. Nil if the files of a segment could not be read.
+ */
+-(void)segmentUploadQueue:(STRSegmentUploadQueue *)queue didGiveUpOnCaptureAtPath:(NSString *)capturePath error:(NSError *)error;
+
+@end
+
+/**
+ Uploads the segments of captures in order, as soon as they are recorded.
+
+ A STRCaptureViewController that records in segments adds each segment to the shared queue when it is closed, and asks the queue to complete the capture when the recording ends. The queue sends one request at a time: segments of a capture are sent in order, and the request that completes a capture is sent after its last segment. Upload time thus overlaps recording time, and when the recording stops, only the last segment and the small completion request remain to be sent.
+
+ A failed request is tried again after a delay that doubles with each failure, following the same policy and settings as a STRUploadOutbox. If a request fails maximumAttempts times, or fails in a way that no retry would fix, the queue gives up on the capture and hands it to the shared STRUploadOutbox once it is finished.
+
+ The queue is kept in memory only. A capture whose segments were still queued when the app stopped is not marked as uploaded, and can be uploaded whole like any other capture.
+
+ Use a queue from the main thread.
+ */
+@interface STRSegmentUploadQueue : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Creating a Queue
+///---------------------------------------------------------------------------------------
+
+/**
+ The queue that the app uses. It sends segments with a STRCaptureUploadManager.
+
+ @return STRSegmentUploadQueue The shared queue.
+ */
++(STRSegmentUploadQueue *)sharedQueue;
+
+/**
+ Returns a queue that sends segments with a custom sender instead of a STRCaptureUploadManager.
+
+ @param sender The block that sends each segment.
+
+ @return id The new queue.
+ */
+-(id)initWithSender:(STRSegmentUploadSender)sender;
+
+/**
+ The delegate of the queue.
+ */
+@property(weak)id<STRSegmentUploadQueueDelegate> delegate;
+
+/**
+ The URL that segments are posted to. Nil uses the default of STRCaptureUploadManager.
+ */
+@property(strong)NSURL * segmentUploadURL;
+
+/**
+ The average number of seconds before the first retry of a request. Defaults to the `Upload_Retry_Base_Delay` setting.
+ */
+@property(assign)NSTimeInterval baseRetryDelay;
+
+/**
+ The longest number of seconds between two attempts to send a request. Defaults to the `Upload_Retry_Max_Delay` setting.
+ */
+@property(assign)NSTimeInterval maximumRetryDelay;
+
+/**
+ The number of attempts at one request after which its capture is given up on. Defaults to the `Upload_Max_Attempts` setting.
+ */
+@property(assign)NSUInteger maximumAttempts;
+
+///---------------------------------------------------------------------------------------
+/// @name Queueing Segments
+///---------------------------------------------------------------------------------------
+
+/**
+ Adds a segment to the end of the queue.
+
+ Segments of a capture that has been given up on are ignored.
+
+ @param segment The segment, as returned by [closeSegmentWithMediaAtPath:startTime:duration:]([STRCaptureSegmenter closeSegmentWithMediaAtPath:startTime:duration:]).
+
+ @param capturePath The absolute path of the capture directory.
+ */
+-(void)enqueueSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath;
+
+/**
+ Adds the request that completes a capture to the end of the queue.
+
+ Call this method once the capture has been finished with [finish]([STRCaptureSegmenter finish]). If the capture has been given up on, it is queued in the shared STRUploadOutbox instead.
+
+ @param capturePath The absolute path of the capture directory.
+ */
+-(void)enqueueCompletionOfCaptureAtPath:(NSString *)capturePath;
+
+/**
+ The number of requests waiting to be sent, including the one being sent.
+ */
+@property(readonly)NSUInteger pendingRequestCount;
+
+@end
@@ -0,0 +1,234 @@
+//
+//  STRSegmentUploadQueue.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRSegmentUploadQueue.h"
+#import "STRCaptureUploadManager.h"
+#import "STRUploadOutbox.h"
+#import "STRLogger.h"
+
+@interface STRSegmentUploadQueue () <STRCaptureUploadManagerDelegate> {
+    STRSegmentUploadSender _sender;
+    // Each job is a capture path, the segment to send or none to complete
+    // the capture, and the number of failed attempts
+    NSMutableArray * _jobs;
+    NSMutableDictionary * _currentJob;
+    NSTimer * _retryTimer;
+    NSMutableSet * _abandonedCapturePaths;
+    // Sending with a STRCaptureUploadManager
+    STRCaptureUploadManager * _currentUpload;
+    STRSegmentUploadCompletionHandler _currentCompletionHandler;
+}
+
+@end
+
+@interface STRSegmentUploadQueue (InternalMethods)
+
+// -- Sending -- //
+-(void)scheduleNextRequest;
+-(void)sendNextRequest;
+-(void)retryTimerDidFire:(NSTimer *)timer;
+-(void)job:(NSMutableDictionary *)job didFinishWithSuccess:(BOOL)uploaded error:(NSError *)error;
+-(void)giveUpOnCaptureAtPath:(NSString *)capturePath error:(NSError *)error;
+-(void)handCaptureAtPathToOutbox:(NSString *)capturePath;
+
+// -- Sending With an Upload Manager -- //
+-(void)sendSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath completionHandler:(STRSegmentUploadCompletionHandler)completionHandler;
+-(void)finishCurrentUploadWithSuccess:(BOOL)uploaded error:(NSError *)error;
+
+@end
+
+@implementation STRSegmentUploadQueue
+
+#pragma mark - Class Methods
+
++(STRSegmentUploadQueue *)sharedQueue {
+    static STRSegmentUploadQueue * sharedQueue = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedQueue = [[STRSegmentUploadQueue alloc] initWithSender:nil];
+    });
+    return sharedQueue;
+}
+
+#pragma mark - Instance Methods
+
+-(id)initWithSender:(STRSegmentUploadSender)sender {
+    self = [super init];
+    if (self) {
+        _sender = [sender copy];
+        _jobs = [NSMutableArray array];
+        _abandonedCapturePaths = [NSMutableSet set];
+        // The same retry policy as the outbox that failed captures end up in
+        self.baseRetryDelay = [STRUploadOutbox defaultBaseRetryDelay];
+        self.maximumRetryDelay = [STRUploadOutbox defaultMaximumRetryDelay];
+        self.maximumAttempts = [STRUploadOutbox defaultMaximumAttempts];
+    }
+    return self;
+}
+
+-(id)init {
+    return [self initWithSender:nil];
+}
+
+-(void)enqueueSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath {
+    if (!segment || !capturePath || [_abandonedCapturePaths containsObject:capturePath]) return;
+    [_jobs addObject:[NSMutableDictionary dictionaryWithObjectsAndKeys:capturePath, @"path", segment, @"segment", @0, @"attempts", nil]];
+    STRLogDebug(STRLogCategoryUpload, @"STRSegmentUploadQueue: Queued segment %@ of capture %@.", [segment objectForKey:@"index"], [capturePath lastPathComponent]);
+    [self scheduleNextRequest];
+}
+
+-(void)enqueueCompletionOfCaptureAtPath:(NSString *)capturePath {
+    if (!capturePath) return;
+    if ([_abandonedCapturePaths containsObject:capturePath]) {
+        [self handCaptureAtPathToOutbox:capturePath];
+        return;
+    }
+    [_jobs addObject:[NSMutableDictionary dictionaryWithObjectsAndKeys:capturePath, @"path", @0, @"attempts", nil]];
+    [self scheduleNextRequest];
+}
+
+-(NSUInteger)pendingRequestCount {
+    return _jobs.count;
+}
+
+@end
+
+@implementation STRSegmentUploadQueue (InternalMethods)
+
+#pragma mark - Sending
+
+-(void)scheduleNextRequest {
+    // Sent from the run loop, so that delegate callbacks never nest
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(sendNextRequest) object:nil];
+    [self performSelector:@selector(sendNextRequest) withObject:nil afterDelay:0];
+}
+
+-(void)sendNextRequest {
+    // A failed request holds back the queue until its retry is due, even when new segments arrive
+    if (_retryTimer || _currentJob || _jobs.count == 0) return;
+
+    NSMutableDictionary * job = [_jobs objectAtIndex:0];
+    _currentJob = job;
+    __weak STRSegmentUploadQueue * weakSelf = self;
+    STRSegmentUploadCompletionHandler completionHandler = ^(BOOL uploaded, NSError * error) {
+        [weakSelf job:job didFinishWithSuccess:uploaded error:error];
+    };
+    NSDictionary * segment = [job objectForKey:@"segment"];
+    NSString * capturePath = [job objectForKey:@"path"];
+    if (_sender) {
+        _sender(segment, capturePath, completionHandler);
+    } else {
+        [self sendSegment:segment ofCaptureAtPath:capturePath completionHandler:completionHandler];
+    }
+}
+
+-(void)job:(NSMutableDictionary *)job didFinishWithSuccess:(BOOL)uploaded error:(NSError *)error {
+    if (job != _currentJob) return;
+    _currentJob = nil;
+    NSString * capturePath = [job objectForKey:@"path"];
+    NSDictionary * segment = [job objectForKey:@"segment"];
+
+    if (uploaded) {
+        [_jobs removeObject:job];
+        if (segment) {
+            STRLogDebug(STRLogCategoryUpload, @"STRSegmentUploadQueue: Uploaded segment %@ of capture %@.", [segment objectForKey:@"index"], [capturePath lastPathComponent]);
+            if ([self.delegate respondsToSelector:@selector(segmentUploadQueue:didUploadSegment:ofCaptureAtPath:)]) {
+                [self.delegate segmentUploadQueue:self didUploadSegment:segment ofCaptureAtPath:capturePath];
+            }
+        } else {
+            STRLogInfo(STRLogCategoryUpload, @"STRSegmentUploadQueue: Completed capture %@.", [capturePath lastPathComponent]);
+            if ([self.delegate respondsToSelector:@selector(segmentUploadQueue:didCompleteCaptureAtPath:)]) {
+                [self.delegate segmentUploadQueue:self didCompleteCaptureAtPath:capturePath];
+            }
+        }
+        [self scheduleNextRequest];
+        return;
+    }
+
+    // Unreadable files are not worth another attempt
+    NSUInteger attempts = [[job objectForKey:@"attempts"] unsignedIntegerValue] + 1;
+    [job setObject:@(attempts) forKey:@"attempts"];
+    if (!error || ![STRUploadOutbox isRetryableError:error] || attempts >= self.maximumAttempts) {
+        [self giveUpOnCaptureAtPath:capturePath error:error];
+        [self scheduleNextRequest];
+        return;
+    }
+
+    // The segments after this one wait for it, so that the server receives them in order
+    NSTimeInterval delay = [STRUploadOutbox retryDelayAfterAttempts:attempts baseDelay:self.baseRetryDelay maximumDelay:self.maximumRetryDelay];
+    STRLogWarning(STRLogCategoryUpload, @"STRSegmentUploadQueue: Attempt %lu at capture %@ failed. Retrying in %.1f seconds: %@", (unsigned long)attempts, [capturePath lastPathComponent], delay, error.localizedDescription);
+    _retryTimer = [NSTimer scheduledTimerWithTimeInterval:delay target:self selector:@selector(retryTimerDidFire:) userInfo:nil repeats:NO];
+}
+
+-(void)retryTimerDidFire:(NSTimer *)timer {
+    if (timer != _retryTimer) return;
+    _retryTimer = nil;
+    [self sendNextRequest];
+}
+
+-(void)giveUpOnCaptureAtPath:(NSString *)capturePath error:(NSError *)error {
+    BOOL finished = NO;
+    for (NSDictionary * job in [_jobs copy]) {
+        if (![[job objectForKey:@"path"] isEqualToString:capturePath]) continue;
+        if (![job objectForKey:@"segment"]) finished = YES;
+        [_jobs removeObject:job];
+    }
+    STRLogError(STRLogCategoryUpload, @"STRSegmentUploadQueue: Gave up on sending capture %@ in segments: %@", [capturePath lastPathComponent], (error) ? error.localizedDescription : @"a segment could not be read");
+    if ([self.delegate respondsToSelector:@selector(segmentUploadQueue:didGiveUpOnCaptureAtPath:error:)]) {
+        [self.delegate segmentUploadQueue:self didGiveUpOnCaptureAtPath:capturePath error:error];
+    }
+
+    // A capture that is still being recorded is handed over once it is finished
+    if (finished) {
+        [self handCaptureAtPathToOutbox:capturePath];
+    } else {
+        [_abandonedCapturePaths addObject:capturePath];
+    }
+}
+
+-(void)handCaptureAtPathToOutbox:(NSString *)capturePath {
+    [_abandonedCapturePaths removeObject:capturePath];
+    STRCapture * capture = [STRCapture captureWithToken:[capturePath lastPathComponent]];
+    if (capture && [[STRUploadOutbox sharedOutbox] enqueueCapture:capture]) {
+        STRLogInfo(STRLogCategoryUpload, @"STRSegmentUploadQueue: Queued capture %@ to be uploaded whole.", capture.token);
+    }
+}
+
+#pragma mark - Sending With an Upload Manager
+
+-(void)sendSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath completionHandler:(STRSegmentUploadCompletionHandler)completionHandler {
+    _currentCompletionHandler = [completionHandler copy];
+    _currentUpload = [STRCaptureUploadManager defaultManager];
+    _currentUpload.delegate = self;
+    if (self.segmentUploadURL) _currentUpload.segmentUploadURL = self.segmentUploadURL;
+    [_currentUpload beginUploadForSegment:segment ofCaptureAtPath:capturePath];
+}
+
+-(void)finishCurrentUploadWithSuccess:(BOOL)uploaded error:(NSError *)error {
+    STRSegmentUploadCompletionHandler completionHandler = _currentCompletionHandler;
+    _currentCompletionHandler = nil;
+    _currentUpload.delegate = nil;
+    _currentUpload = nil;
+    if (completionHandler) completionHandler(uploaded, error);
+}
+
+#pragma mark - STRCaptureUploadManagerDelegate
+
+-(void)fileUploadedSuccessfullyWithToken:(NSString *)token {
+    [self finishCurrentUploadWithSuccess:YES error:nil];
+}
+
+-(void)fileUploadFailedToStart {
+    [self finishCurrentUploadWithSuccess:NO error:nil];
+}
+
+-(void)fileUploadDidFailWithError:(NSError *)error {
+    [self finishCurrentUploadWithSuccess:NO error:error];
+}
+
+@end
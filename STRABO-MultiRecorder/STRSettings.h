@@ -8,16 +8,141 @@
 
 #import <Foundation/Foundation.h>
 
-@interface STRSettings : NSObject {
-    NSDictionary * settingsDict;
-}
+/**
+ Posted after the overrides of the settings change.
 
-@property(nonatomic, strong)NSDictionary * settingsDict;
+ The object of the notification is the new STRSettings snapshot. The user info dictionary holds the keys whose values changed under STRSettingsChangedKeysKey. The notification is posted on the thread that changed the overrides, after sharedSettings has started returning the new snapshot.
+ */
+extern NSString * const STRSettingsDidChangeNotification;
 
+/**
+ An NSSet of the STRSettings.plist keys whose values changed, such as `Upload_Max_Bytes_Per_Second`.
+ */
+extern NSString * const STRSettingsChangedKeysKey;
+
+/**
+ The runtime configuration of the SDK.
+
+ STRSettings.plist is read once, the first time any code asks for the settings. Each STRSettings object is an immutable snapshot of its values, parsed into the typed properties below, so reading a setting is a plain method call. [STRSettings sharedSettings] returns the current snapshot after holding a spin lock only long enough to retain it, and is cheap enough to call for every capture of a listing or every location update.
+
+ Values can be overridden at runtime, for a test, a benchmark or a remote configuration. Every change of the overrides builds a new snapshot from the plist and the overrides and swaps it in at once; code that holds an older snapshot keeps reading consistent values from it. A snapshot is freed once sharedSettings no longer returns it and no code holds it.
+
+ A value that is missing, or 0, means that the code that uses it picks its own default. Components that read a value when they are created, such as the upload queues, keep it until they are created again; the upload bandwidth controller follows STRSettingsDidChangeNotification for `Upload_Max_Bytes_Per_Second` and `Pause_Uploads_While_Recording`, and the logger follows it for its own settings.
+ */
+@interface STRSettings : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Reading the Settings
+///---------------------------------------------------------------------------------------
+
+/**
+ The current settings.
+
+ @return STRSettings The snapshot of STRSettings.plist with the current overrides applied.
+ */
 +(STRSettings *)sharedSettings;
 
--(NSString *)uploadPath;
--(BOOL)advancedLogging;
--(BOOL)saveToPhotoRoll;
+/**
+ The values of the snapshot, keyed as in STRSettings.plist.
+ */
+@property(nonatomic, readonly)NSDictionary * settingsDict;
+
+///---------------------------------------------------------------------------------------
+/// @name Overriding Settings
+///---------------------------------------------------------------------------------------
+
+/**
+ The values that currently replace those of STRSettings.plist, keyed as in the plist.
+ */
++(NSDictionary *)overrideValues;
+
+/**
+ Replaces one value of STRSettings.plist until the app quits.
+
+ A top level key is replaced as a whole; to change one URL, override `Upload_URL` with a dictionary of every URL.
+
+ @param value The new value, of the type of the plist value. Pass nil to remove the override.
+
+ @param key The plist key, such as `Geodata_Sampling_Interval`.
+ */
++(void)setOverrideValue:(id)value forKey:(NSString *)key;
+
+/**
+ Replaces several values of STRSettings.plist in a single snapshot.
+
+ @param values The new values keyed as in the plist. NSNull removes the override of its key.
+ */
++(void)setOverrideValues:(NSDictionary *)values;
+
+/**
+ Goes back to the values of STRSettings.plist.
+ */
++(void)removeAllOverrides;
+
+///---------------------------------------------------------------------------------------
+/// @name Upload Endpoints
+///---------------------------------------------------------------------------------------
+
+@property(nonatomic, readonly)NSString * uploadPath;
+@property(nonatomic, readonly)NSString * batchUploadPath;
+@property(nonatomic, readonly)NSString * segmentUploadPath;
+@property(nonatomic, readonly)NSString * syncPath;
+
+///---------------------------------------------------------------------------------------
+/// @name Uploads
+///---------------------------------------------------------------------------------------
+
+@property(nonatomic, readonly)BOOL compressUploadJSON;
+@property(nonatomic, readonly)NSUInteger uploadMaxBytesPerSecond;
+@property(nonatomic, readonly)NSUInteger uploadBatchMaxBytes;
+@property(nonatomic, readonly)NSTimeInterval uploadRetryBaseDelay;
+@property(nonatomic, readonly)NSTimeInterval uploadRetryMaxDelay;
+@property(nonatomic, readonly)NSUInteger uploadMaxAttempts;
+@property(nonatomic, readonly)BOOL pauseUploadsWhileRecording;
+@property(nonatomic, readonly)NSUInteger uploadMetricsWindow;
+
+///---------------------------------------------------------------------------------------
+/// @name Recording
+///---------------------------------------------------------------------------------------
+
+@property(nonatomic, readonly)BOOL saveToPhotoRoll;
+
+/**
+ The shortest time between two recorded geodata points, in seconds. Location and heading updates that come sooner are dropped. 0 records every update.
+ */
+@property(nonatomic, readonly)NSTimeInterval geoDataSamplingInterval;
+
+///---------------------------------------------------------------------------------------
+/// @name Storage
+///---------------------------------------------------------------------------------------
+
+/**
+ The number of captures each thread takes at a time in integrity scans and summary backfills. 0 means 64.
+ */
+@property(nonatomic, readonly)NSUInteger parallelBatchSize;
+
+/**
+ The size in bytes above which STRCaptureFileParser maps a file instead of reading it into memory. 0 means 64 KB.
+ */
+@property(nonatomic, readonly)NSUInteger parserMapThreshold;
+
+/**
+ The coalescingInterval of the shared STRCaptureChangeFeed, in seconds. 0 means 0.25.
+ */
+@property(nonatomic, readonly)NSTimeInterval changeFeedCoalescingInterval;
+
+/**
+ The journalLimit of the shared STRCaptureChangeFeed. 0 means 10,000 changes.
+ */
+@property(nonatomic, readonly)NSUInteger changeFeedJournalLimit;
+
+///---------------------------------------------------------------------------------------
+/// @name Logging
+///---------------------------------------------------------------------------------------
+
+@property(nonatomic, readonly)BOOL advancedLogging;
+@property(nonatomic, readonly)NSString * logLevel;
+@property(nonatomic, readonly)BOOL logToFile;
+@property(nonatomic, readonly)NSUInteger logFileMaxBytes;
 
 @end
@@ -8,32 +8,189 @@
 
 #import "STRSettings.h"
 
+#import <libkern/OSAtomic.h>
+
+NSString * const STRSettingsDidChangeNotification = @"STRSettingsDidChangeNotification";
+NSString * const STRSettingsChangedKeysKey = @"STRSettingsChangedKeysKey";
+
+// The snapshot that sharedSettings returns. Readers retain it under _currentSettingsLock,
+// so an update can never free a snapshot between the load and the retain
+static STRSettings * _currentSettings = nil;
+static OSSpinLock _currentSettingsLock = OS_SPINLOCK_INIT;
+static NSDictionary * _fileValues = nil;
+static NSDictionary * _overrides = nil;
+static dispatch_once_t _loadToken;
+
+#pragma mark - Typed Values
+
+// Values of the wrong type read as missing rather than raising, since overrides
+// can come from outside the app
+static BOOL STRSettingsBool(NSDictionary * values, NSString * key) {
+    id value = [values objectForKey:key];
+    return ([value respondsToSelector:@selector(boolValue)]) ? [value boolValue] : NO;
+}
+
+static NSUInteger STRSettingsUnsigned(NSDictionary * values, NSString * key) {
+    id value = [values objectForKey:key];
+    if (![value respondsToSelector:@selector(longLongValue)]) return 0;
+    long long integer = [value longLongValue];
+    return (integer > 0) ? (NSUInteger)MIN(integer, (long long)NSUIntegerMax) : 0;
+}
+
+static NSTimeInterval STRSettingsInterval(NSDictionary * values, NSString * key) {
+    id value = [values objectForKey:key];
+    if (![value respondsToSelector:@selector(doubleValue)]) return 0;
+    return MAX([value doubleValue], 0.0);
+}
+
+static NSString * STRSettingsString(NSDictionary * values, NSString * key) {
+    id value = [values objectForKey:key];
+    return ([value isKindOfClass:[NSString class]]) ? value : nil;
+}
+
+static NSString * STRSettingsURL(NSDictionary * URLs, NSString * key) {
+    NSString * basePath = STRSettingsString(URLs, @"Base_URL");
+    NSString * apiPath = STRSettingsString(URLs, key);
+    if (!basePath || !apiPath) return nil;
+    return [basePath stringByAppendingPathComponent:apiPath];
+}
+
 @interface STRSettings ()
+-(id)initWithValues:(NSDictionary *)values;
+@end
+
+@interface STRSettings (InternalMethods)
+
+// -- Snapshots -- //
++(void)updateOverridesUsingBlock:(void (^)(NSMutableDictionary * overrides))block;
 
 @end
 
 @implementation STRSettings
 
+@synthesize settingsDict = _settingsDict;
+
+#pragma mark - Class Methods
+
 +(STRSettings *)sharedSettings {
-    STRSettings * settings = [[STRSettings alloc] init];
-    settings.settingsDict = [[NSMutableDictionary alloc] initWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"STRSettings" ofType:@"plist"]];
+    dispatch_once(&_loadToken, ^{
+        // The logger reads the settings while it configures itself, so nothing here may log
+        _fileValues = [NSDictionary dictionaryWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"STRSettings" ofType:@"plist"]];
+        if (!_fileValues) _fileValues = [NSDictionary dictionary];
+        _overrides = [NSDictionary dictionary];
+        _currentSettings = [[STRSettings alloc] initWithValues:_fileValues];
+    });
+    STRSettings * settings;
+    OSSpinLockLock(&_currentSettingsLock);
+    settings = _currentSettings;
+    OSSpinLockUnlock(&_currentSettingsLock);
     return settings;
 }
 
--(NSString *)uploadPath {
-    NSDictionary * URLs = [_settingsDict objectForKey:@"Upload_URL"];
-    NSString * basePath = [URLs objectForKey:@"Base_URL"];
-    NSString * apiPath = [URLs objectForKey:@"API_URL"];
-    NSString * fullPath = [basePath stringByAppendingPathComponent:apiPath];
-    return fullPath;
++(NSDictionary *)overrideValues {
+    [self sharedSettings];
+    @synchronized(self) {
+        return _overrides;
+    }
 }
 
--(BOOL)advancedLogging {
-    return [[_settingsDict objectForKey:@"Advanced_Logging"] boolValue];
++(void)setOverrideValue:(id)value forKey:(NSString *)key {
+    if (!key) return;
+    [self setOverrideValues:@{ key : (value) ? value : [NSNull null] }];
 }
 
--(BOOL)saveToPhotoRoll {
-    return [[_settingsDict objectForKey:@"Save_To_Photo_Roll"] boolValue];
++(void)setOverrideValues:(NSDictionary *)values {
+    [self updateOverridesUsingBlock:^(NSMutableDictionary * overrides) {
+        [values enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if (value == [NSNull null]) {
+                [overrides removeObjectForKey:key];
+            } else {
+                [overrides setObject:value forKey:key];
+            }
+        }];
+    }];
+}
+
++(void)removeAllOverrides {
+    [self updateOverridesUsingBlock:^(NSMutableDictionary * overrides) {
+        [overrides removeAllObjects];
+    }];
+}
+
+#pragma mark - Instance Methods
+
+-(id)initWithValues:(NSDictionary *)values {
+    self = [super init];
+    if (self) {
+        _settingsDict = [values copy];
+
+        NSDictionary * URLs = [values objectForKey:@"Upload_URL"];
+        if (![URLs isKindOfClass:[NSDictionary class]]) URLs = nil;
+        _uploadPath = STRSettingsURL(URLs, @"API_URL");
+        _batchUploadPath = STRSettingsURL(URLs, @"Batch_API_URL");
+        _segmentUploadPath = STRSettingsURL(URLs, @"Segment_API_URL");
+        _syncPath = STRSettingsURL(URLs, @"Sync_API_URL");
+
+        _compressUploadJSON = STRSettingsBool(values, @"Compress_Upload_JSON");
+        _uploadMaxBytesPerSecond = STRSettingsUnsigned(values, @"Upload_Max_Bytes_Per_Second");
+        _uploadBatchMaxBytes = STRSettingsUnsigned(values, @"Upload_Batch_Max_Bytes");
+        _uploadRetryBaseDelay = STRSettingsInterval(values, @"Upload_Retry_Base_Delay");
+        _uploadRetryMaxDelay = STRSettingsInterval(values, @"Upload_Retry_Max_Delay");
+        _uploadMaxAttempts = STRSettingsUnsigned(values, @"Upload_Max_Attempts");
+        _pauseUploadsWhileRecording = STRSettingsBool(values, @"Pause_Uploads_While_Recording");
+        _uploadMetricsWindow = STRSettingsUnsigned(values, @"Upload_Metrics_Window");
+
+        _saveToPhotoRoll = STRSettingsBool(values, @"Save_To_Photo_Roll");
+        _geoDataSamplingInterval = STRSettingsInterval(values, @"Geodata_Sampling_Interval");
+
+        _parallelBatchSize = STRSettingsUnsigned(values, @"Parallel_Batch_Size");
+        _parserMapThreshold = STRSettingsUnsigned(values, @"Parser_Map_Threshold");
+        _changeFeedCoalescingInterval = STRSettingsInterval(values, @"Change_Feed_Coalescing_Interval");
+        _changeFeedJournalLimit = STRSettingsUnsigned(values, @"Change_Feed_Journal_Limit");
+
+        _advancedLogging = STRSettingsBool(values, @"Advanced_Logging");
+        _logLevel = STRSettingsString(values, @"Log_Level");
+        _logToFile = STRSettingsBool(values, @"Log_To_File");
+        _logFileMaxBytes = STRSettingsUnsigned(values, @"Log_File_Max_Bytes");
+    }
+    return self;
+}
+
+@end
+
+
+@implementation STRSettings (InternalMethods)
+
+#pragma mark - Snapshots
+
++(void)updateOverridesUsingBlock:(void (^)(NSMutableDictionary * overrides))block {
+    [self sharedSettings];
+    STRSettings * previous, * settings = nil;
+    NSMutableSet * changedKeys = [NSMutableSet set];
+    @synchronized(self) {
+        previous = _currentSettings;
+        NSMutableDictionary * overrides = [_overrides mutableCopy];
+        block(overrides);
+        _overrides = [overrides copy];
+
+        NSMutableDictionary * values = [_fileValues mutableCopy];
+        [values addEntriesFromDictionary:overrides];
+        NSMutableSet * keys = [NSMutableSet setWithArray:[values allKeys]];
+        [keys addObjectsFromArray:[previous.settingsDict allKeys]];
+        for (NSString * key in keys) {
+            id value = [values objectForKey:key];
+            id previousValue = [previous.settingsDict objectForKey:key];
+            if (value != previousValue && ![value isEqual:previousValue]) [changedKeys addObject:key];
+        }
+        if (changedKeys.count == 0) return;
+
+        settings = [[STRSettings alloc] initWithValues:values];
+        // The previous snapshot is released outside the lock, once previous goes out of scope
+        OSSpinLockLock(&_currentSettingsLock);
+        _currentSettings = settings;
+        OSSpinLockUnlock(&_currentSettingsLock);
+    }
+    [[NSNotificationCenter defaultCenter] postNotificationName:STRSettingsDidChangeNotification object:settings userInfo:@{ STRSettingsChangedKeysKey : changedKeys }];
 }
 
 @end
@@ -0,0 +1,128 @@
+//
+//  STRTrackExporter.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class STRCapture;
+@class STRCapturePathResolver;
+
+/**
+ STRTrackExportFormat
+
+ The file format written by an STRTrackExporter.
+
+ See the [ConstantsReference] guide for more information.
+ */
+typedef enum {
+    STRTrackExportFormatGeoJSON, // A GeoJSON FeatureCollection with one Feature per capture
+    STRTrackExportFormatGPX,     // A GPX 1.1 file with one trk per capture
+    STRTrackExportFormatKML      // A KML 2.2 file with one gx:Track Placemark per capture
+} STRTrackExportFormat;
+
+/**
+ Writes the geodata tracks of captures in formats that GIS tools read: GeoJSON, GPX and KML.
+
+ Every point carries its position, its time, the heading of the device and the accuracy of the fix. The time of a point is the capture's creation date plus the point's timestamp. Each capture's token, title, media type, creation date and upload date are written with its track.
+
+ Exports are streamed: geodata files are read and output is written through small fixed-size buffers, and no document is built in memory, so exporting millions of points uses no more memory than exporting a few. Geodata files are read once for every list of values the format needs, which is once for GPX and up to four times for GeoJSON and KML.
+
+    STRTrackExporter * exporter = [STRTrackExporter exporterWithFormat:STRTrackExportFormatGPX];
+    [exporter exportCaptures:[fileManager allCapturesSorted:YES] toPath:path];
+
+ An exporter writes one export at a time. Use one exporter per thread to export in parallel.
+
+ GPX has no elements for heading or accuracy, so they are written as `strabo:heading` and `strabo:accuracy` extensions of each `trkpt`, in the `urn:strabo:multirecorder:1` namespace. KML writes headings as `gx:angles` and accuracies as a `gx:SimpleArrayData` named `accuracy`. GeoJSON writes times, headings and accuracies as the `coordTimes`, `headings` and `accuracies` arrays of each Feature's properties, in the same order as the coordinates.
+ */
+@interface STRTrackExporter : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Creating an Exporter
+///---------------------------------------------------------------------------------------
+
+/**
+ Creates an exporter for captures in the captures directory used by the SDK.
+
+ @param format The format to write.
+
+ @return STRTrackExporter A new exporter.
+ */
++(STRTrackExporter *)exporterWithFormat:(STRTrackExportFormat)format;
+
+/**
+ Creates an exporter for captures managed by a given resolver.
+
+ @param format The format to write.
+
+ @param resolver The resolver used to find the captures' geodata files.
+
+ @return STRTrackExporter A new exporter.
+ */
+-(id)initWithFormat:(STRTrackExportFormat)format pathResolver:(STRCapturePathResolver *)resolver;
+
+/**
+ The format that this exporter writes.
+ */
+@property(readonly)STRTrackExportFormat format;
+
+/**
+ The file extension for the format, such as `geojson`, `gpx` or `kml`.
+
+ @return NSString The extension, without a leading period.
+ */
+-(NSString *)pathExtension;
+
+///---------------------------------------------------------------------------------------
+/// @name Exporting
+///---------------------------------------------------------------------------------------
+
+/**
+ Writes the track of one capture to a file.
+
+ @param capture The capture to export.
+
+ @param path The path of the file to write. An existing file is replaced.
+
+ @return BOOL YES if successful and NO if the file could not be written.
+ */
+-(BOOL)exportCapture:(STRCapture *)capture toPath:(NSString *)path;
+
+/**
+ Writes the tracks of several captures to one file.
+
+ The file is written beside path and moved into place once it is complete, so a failed export never leaves a partial file at path. A capture whose geodata cannot be read is logged and exported without points.
+
+ @param captures An array of STRCapture objects.
+
+ @param path The path of the file to write. An existing file is replaced.
+
+ @return BOOL YES if successful and NO if the file could not be written.
+ */
+-(BOOL)exportCaptures:(NSArray *)captures toPath:(NSString *)path;
+
+/**
+ Writes the tracks of several captures to a stream, such as a socket or a compressing stream.
+
+ @param captures An array of STRCapture objects.
+
+ @param stream An open output stream. It is not closed when the export is done.
+
+ @return BOOL YES if successful and NO if the stream stopped accepting data.
+ */
+-(BOOL)exportCaptures:(NSArray *)captures toStream:(NSOutputStream *)stream;
+
+/**
+ The number of points written by the last export.
+ */
+@property(readonly)NSUInteger pointsWritten;
+
+/**
+ The number of bytes written by the last export.
+ */
+@property(readonly)unsigned long long bytesWritten;
+
+@end
@@ -0,0 +1,596 @@
+//
+//  STRTrackExporter.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackExporter.h"
+#import "STRCapture.h"
+#import "STRCapturePathResolver.h"
+#import "STRLogger.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define kSTRExportBufferSize (64 * 1024)
+// The most that a single append may add, so that the buffer never has to grow
+#define kSTRExportMaximumAppendLength 512
+// A point object longer than this is treated as a damaged file
+#define kSTRGeoDataReadBufferSize (64 * 1024)
+#define kSTRStraboNamespace "urn:strabo:multirecorder:1"
+
+typedef struct {
+    double latitude;
+    double longitude;
+    double heading;   // NAN if not recorded
+    double accuracy;  // NAN if not recorded
+    double timestamp; // Seconds since the start of the capture
+} STRTrackPoint;
+
+typedef void (^STRTrackPointBlock)(const STRTrackPoint * point, BOOL * stop);
+
+@interface STRTrackExporter () {
+    STRCapturePathResolver * _resolver;
+    NSOutputStream * _stream;
+    char * _buffer;
+    NSUInteger _bufferLength;
+    BOOL _failed;
+}
+
+@property(readwrite)STRTrackExportFormat format;
+@property(readwrite)NSUInteger pointsWritten;
+@property(readwrite)unsigned long long bytesWritten;
+
+@end
+
+@interface STRTrackExporter (InternalMethods)
+
+// -- Formats -- //
+-(void)writeGeoJSONCapture:(STRCapture *)capture geoDataPath:(NSString *)geoDataPath first:(BOOL)first;
+-(void)writeGPXCapture:(STRCapture *)capture geoDataPath:(NSString *)geoDataPath;
+-(void)writeKMLCapture:(STRCapture *)capture geoDataPath:(NSString *)geoDataPath;
+-(void)writeHeader;
+-(void)writeFooter;
+
+// -- Buffered Output -- //
+-(void)appendCString:(const char *)string;
+-(void)appendFormat:(const char *)format, ... __attribute__((format(printf, 2, 3)));
+-(void)appendJSONString:(NSString *)string;
+-(void)appendXMLString:(NSString *)string;
+-(void)appendTime:(NSTimeInterval)time;
+-(void)reserve:(NSUInteger)length;
+-(void)flush;
+
+@end
+
+#pragma mark - Reading Geodata
+
+// The end of the JSON object or array that starts at start, or 0 if it does not end before length
+static size_t STRJSONValueEnd(const char * bytes, size_t start, size_t length) {
+    int depth = 0;
+    BOOL inString = NO;
+    for (size_t i = start; i < length; i++) {
+        char c = bytes[i];
+        if (inString) {
+            if (c == '\\') i++;
+            else if (c == '"') inString = NO;
+        } else if (c == '"') {
+            inString = YES;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// The first character of the value of a key in a flat JSON object, or NULL
+static const char * STRJSONValueForKey(const char * start, const char * end, const char * quotedKey) {
+    size_t keyLength = strlen(quotedKey);
+    const char * found = memmem(start, end - start, quotedKey, keyLength);
+    if (!found) return NULL;
+    const char * cursor = found + keyLength;
+    while (cursor < end && (isspace(*cursor) || *cursor == ':')) cursor++;
+    return cursor;
+}
+
+// Reads a number and moves the cursor past it. Values that are not numbers, such as null, give NAN.
+static double STRJSONReadNumber(const char ** cursor, const char * end) {
+    if (!*cursor || *cursor >= end) return NAN;
+    char * numberEnd;
+    double value = strtod(*cursor, &numberEnd);
+    if (numberEnd == *cursor || numberEnd > end) return NAN;
+    *cursor = numberEnd;
+    return value;
+}
+
+static BOOL STRParseTrackPoint(const char * start, const char * end, STRTrackPoint * point) {
+    const char * coords = STRJSONValueForKey(start, end, "\"coords\"");
+    if (!coords || *coords != '[') return NO;
+    coords++;
+    while (coords < end && isspace(*coords)) coords++;
+    point->latitude = STRJSONReadNumber(&coords, end);
+    while (coords < end && (isspace(*coords) || *coords == ',')) coords++;
+    point->longitude = STRJSONReadNumber(&coords, end);
+    if (!isfinite(point->latitude) || !isfinite(point->longitude)) return NO;
+
+    const char * value = STRJSONValueForKey(start, end, "\"heading\"");
+    point->heading = STRJSONReadNumber(&value, end);
+    value = STRJSONValueForKey(start, end, "\"accuracy\"");
+    point->accuracy = STRJSONReadNumber(&value, end);
+    value = STRJSONValueForKey(start, end, "\"timestamp\"");
+    point->timestamp = STRJSONReadNumber(&value, end);
+    if (!isfinite(point->timestamp)) point->timestamp = 0;
+    return YES;
+}
+
+/*
+ Calls block with each point of the geodata file at path, in order, without loading the file.
+
+ The file is read through a fixed buffer and each point object is scanned for the handful of keys that STRGeoLocationData writes. Points without coordinates are skipped. Returns NO if the file cannot be read or ends before its points array does.
+ */
+static BOOL STREnumerateTrackPoints(NSString * path, STRTrackPointBlock block) {
+    int file = open([path fileSystemRepresentation], O_RDONLY);
+    if (file < 0) return NO;
+
+    char * buffer = malloc(kSTRGeoDataReadBufferSize + 1);
+    size_t length = 0;
+    size_t offset = 0;
+    BOOL inPoints = NO, finished = NO, failed = NO, stop = NO, endOfFile = NO;
+
+    while (!finished && !failed && !stop) {
+        // Keep the bytes not yet scanned and fill the rest of the buffer
+        if (offset > 0) {
+            memmove(buffer, buffer + offset, length - offset);
+            length -= offset;
+            offset = 0;
+        }
+        if (length == kSTRGeoDataReadBufferSize) {
+            failed = YES;
+            break;
+        }
+        ssize_t readLength = read(file, buffer + length, kSTRGeoDataReadBufferSize - length);
+        if (readLength < 0) {
+            failed = YES;
+            break;
+        }
+        if (readLength == 0) endOfFile = YES;
+        length += readLength;
+        // Stops strtod at the end of the data
+        buffer[length] = '\0';
+
+        if (!inPoints) {
+            const char * key = memmem(buffer, length, "\"points\"", 8);
+            const char * arrayStart = (key) ? memchr(key + 8, '[', buffer + length - (key + 8)) : NULL;
+            if (!arrayStart) {
+                // The key may be split across two reads
+                if (key) offset = key - buffer;
+                else if (length > 8) offset = length - 8;
+                if (endOfFile) failed = YES;
+                continue;
+            }
+            inPoints = YES;
+            offset = arrayStart + 1 - buffer;
+        }
+
+        while (offset < length) {
+            char c = buffer[offset];
+            if (isspace(c) || c == ',') {
+                offset++;
+                continue;
+            }
+            if (c == ']') {
+                finished = YES;
+                break;
+            }
+            if (c != '{') {
+                failed = YES;
+                break;
+            }
+            size_t end = STRJSONValueEnd(buffer, offset, length);
+            // The rest of the object has not been read yet
+            if (!end) break;
+            STRTrackPoint point;
+            if (STRParseTrackPoint(buffer + offset, buffer + end, &point)) {
+                block(&point, &stop);
+            }
+            offset = end;
+            if (stop) break;
+        }
+        if (endOfFile && !finished && !stop) failed = YES;
+    }
+
+    free(buffer);
+    close(file);
+    return !failed;
+}
+
+@implementation STRTrackExporter
+
+#pragma mark - Creating an Exporter
+
++(STRTrackExporter *)exporterWithFormat:(STRTrackExportFormat)format {
+    return [[STRTrackExporter alloc] initWithFormat:format pathResolver:[STRCapturePathResolver sharedResolver]];
+}
+
+-(id)initWithFormat:(STRTrackExportFormat)format pathResolver:(STRCapturePathResolver *)resolver {
+    self = [super init];
+    if (self) {
+        _resolver = resolver;
+        self.format = format;
+    }
+    return self;
+}
+
+-(NSString *)pathExtension {
+    switch (self.format) {
+        case STRTrackExportFormatGPX:
+            return @"gpx";
+        case STRTrackExportFormatKML:
+            return @"kml";
+        default:
+            return @"geojson";
+    }
+}
+
+#pragma mark - Exporting
+
+-(BOOL)exportCapture:(STRCapture *)capture toPath:(NSString *)path {
+    if (!capture) return NO;
+    return [self exportCaptures:@[ capture ] toPath:path];
+}
+
+-(BOOL)exportCaptures:(NSArray *)captures toPath:(NSString *)path {
+    // Written beside the destination so that the final move is a rename
+    NSString * partialPath = [path stringByAppendingPathExtension:@"partial"];
+    NSOutputStream * stream = [NSOutputStream outputStreamToFileAtPath:partialPath append:NO];
+    [stream open];
+    BOOL success = [self exportCaptures:captures toStream:stream];
+    [stream close];
+
+    if (success && rename([partialPath fileSystemRepresentation], [path fileSystemRepresentation]) != 0) {
+        STRLogError(STRLogCategoryStorage, @"STRTrackExporter: Could not move the export to %@: %s", path, strerror(errno));
+        success = NO;
+    }
+    if (!success) {
+        [[NSFileManager defaultManager] removeItemAtPath:partialPath error:nil];
+    }
+    return success;
+}
+
+-(BOOL)exportCaptures:(NSArray *)captures toStream:(NSOutputStream *)stream {
+    _stream = stream;
+    _buffer = malloc(kSTRExportBufferSize);
+    _bufferLength = 0;
+    _failed = NO;
+    self.pointsWritten = 0;
+    self.bytesWritten = 0;
+
+    [self writeHeader];
+    BOOL first = YES;
+    for (STRCapture * capture in captures) {
+        if (_failed) break;
+        @autoreleasepool {
+            NSString * geoDataPath = (capture.geoDataPath) ? [_resolver absolutePathForCaptureFile:capture.geoDataPath] : nil;
+            switch (self.format) {
+                case STRTrackExportFormatGPX:
+                    [self writeGPXCapture:capture geoDataPath:geoDataPath];
+                    break;
+                case STRTrackExportFormatKML:
+                    [self writeKMLCapture:capture geoDataPath:geoDataPath];
+                    break;
+                default:
+                    [self writeGeoJSONCapture:capture geoDataPath:geoDataPath first:first];
+                    break;
+            }
+        }
+        first = NO;
+    }
+    [self writeFooter];
+    [self flush];
+
+    free(_buffer);
+    _buffer = NULL;
+    _stream = nil;
+    if (_failed) {
+        STRLogError(STRLogCategoryStorage, @"STRTrackExporter: The export stream stopped accepting data after %llu bytes.", self.bytesWritten);
+    }
+    return !_failed;
+}
+
+@end
+
+@implementation STRTrackExporter (InternalMethods)
+
+#pragma mark - Formats
+
+-(void)writeHeader {
+    switch (self.format) {
+        case STRTrackExportFormatGPX:
+            [self appendCString:"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<gpx version=\"1.1\" creator=\"Strabo MultiRecorder\" xmlns=\"http://www.topografix.com/GPX/1/1\" xmlns:strabo=\"" kSTRStraboNamespace "\">\n"];
+            break;
+        case STRTrackExportFormatKML:
+            [self appendCString:"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<kml xmlns=\"http://www.opengis.net/kml/2.2\" xmlns:gx=\"http://www.google.com/kml/ext/2.2\">\n"
+             "<Document>\n"
+             "<name>Strabo Captures</name>\n"
+             "<Schema id=\"strabo_point\"><gx:SimpleArrayField name=\"accuracy\" type=\"float\"><displayName>Accuracy (m)</displayName></gx:SimpleArrayField></Schema>\n"];
+            break;
+        default:
+            [self appendCString:"{\"type\":\"FeatureCollection\",\"features\":["];
+            break;
+    }
+}
+
+-(void)writeFooter {
+    switch (self.format) {
+        case STRTrackExportFormatGPX:
+            [self appendCString:"</gpx>\n"];
+            break;
+        case STRTrackExportFormatKML:
+            [self appendCString:"</Document>\n</kml>\n"];
+            break;
+        default:
+            [self appendCString:"]}\n"];
+            break;
+    }
+}
+
+-(void)writeGeoJSONCapture:(STRCapture *)capture geoDataPath:(NSString *)geoDataPath first:(BOOL)first {
+    NSTimeInterval start = [capture.creationDate timeIntervalSince1970];
+    __block NSUInteger count = 0;
+
+    // A LineString needs two positions, so look ahead before choosing the geometry
+    BOOL readable = geoDataPath && STREnumerateTrackPoints(geoDataPath, ^(const STRTrackPoint * point, BOOL * stop) {
+        if (++count == 2) *stop = YES;
+    });
+    if (!readable) {
+        STRLogError(STRLogCategoryStorage, @"STRTrackExporter: Could not read the geodata of capture %@.", capture.token);
+        count = 0;
+    }
+
+    [self appendCString:(first) ? "\n" : ",\n"];
+    [self appendCString:"{\"type\":\"Feature\",\"geometry\":"];
+    if (count == 0) {
+        [self appendCString:"null"];
+    } else {
+        [self appendCString:(count == 1) ? "{\"type\":\"Point\",\"coordinates\":" : "{\"type\":\"LineString\",\"coordinates\":["];
+        __block BOOL firstPoint = YES;
+        STREnumerateTrackPoints(geoDataPath, ^(const STRTrackPoint * point, BOOL * stop) {
+            [self appendFormat:"%s[%.7f,%.7f]", (firstPoint) ? "" : ",", point->longitude, point->latitude];
+            firstPoint = NO;
+            self.pointsWritten++;
+        });
+        [self appendCString:(count == 1) ? "}" : "]}"];
+    }
+
+    [self appendCString:",\"properties\":{\"token\":"];
+    [self appendJSONString:capture.token];
+    [self appendCString:",\"title\":"];
+    [self appendJSONString:capture.title];
+    [self appendCString:",\"media_type\":"];
+    [self appendJSONString:capture.type];
+    [self appendCString:",\"created_at\":\""];
+    [self appendTime:start];
+    [self appendCString:"\",\"uploaded_at\":"];
+    if (capture.uploadDate) {
+        [self appendCString:"\""];
+        [self appendTime:[capture.uploadDate timeIntervalSince1970]];
+        [self appendCString:"\""];
+    } else {
+        [self appendCString:"null"];
+    }
+
+    if (count > 0) {
+        // Parallel to the coordinates, one pass over the track each
+        const char * names[] = { "coordTimes", "headings", "accuracies" };
+        for (int list = 0; list < 3; list++) {
+            [self appendFormat:",\"%s\":[", names[list]];
+            __block BOOL firstPoint = YES;
+            STREnumerateTrackPoints(geoDataPath, ^(const STRTrackPoint * point, BOOL * stop) {
+                if (!firstPoint) [self appendCString:","];
+                firstPoint = NO;
+                double value = (list == 1) ? point->heading : point->accuracy;
+                if (list == 0) {
+                    [self appendCString:"\""];
+                    [self appendTime:start + point->timestamp];
+                    [self appendCString:"\""];
+                } else if (isfinite(value)) {
+                    [self appendFormat:"%.2f", value];
+                } else {
+                    [self appendCString:"null"];
+                }
+            });
+            [self appendCString:"]"];
+        }
+    }
+    [self appendCString:"}}"];
+}
+
+-(void)writeGPXCapture:(STRCapture *)capture geoDataPath:(NSString *)geoDataPath {
+    NSTimeInterval start = [capture.creationDate timeIntervalSince1970];
+
+    [self appendCString:"<trk>\n<name>"];
+    [self appendXMLString:capture.title];
+    [self appendCString:"</name>\n<type>"];
+    [self appendXMLString:capture.type];
+    [self appendCString:"</type>\n<extensions><strabo:token>"];
+    [self appendXMLString:capture.token];
+    [self appendCString:"</strabo:token><strabo:created_at>"];
+    [self appendTime:start];
+    [self appendCString:"</strabo:created_at>"];
+    if (capture.uploadDate) {
+        [self appendCString:"<strabo:uploaded_at>"];
+        [self appendTime:[capture.uploadDate timeIntervalSince1970]];
+        [self appendCString:"</strabo:uploaded_at>"];
+    }
+    [self appendCString:"</extensions>\n<trkseg>\n"];
+
+    BOOL readable = geoDataPath && STREnumerateTrackPoints(geoDataPath, ^(const STRTrackPoint * point, BOOL * stop) {
+        [self appendFormat:"<trkpt lat=\"%.7f\" lon=\"%.7f\"><time>", point->latitude, point->longitude];
+        [self appendTime:start + point->timestamp];
+        [self appendCString:"</time>"];
+        if (isfinite(point->heading) || isfinite(point->accuracy)) {
+            [self appendCString:"<extensions>"];
+            if (isfinite(point->heading)) [self appendFormat:"<strabo:heading>%.2f</strabo:heading>", point->heading];
+            if (isfinite(point->accuracy)) [self appendFormat:"<strabo:accuracy>%.2f</strabo:accuracy>", point->accuracy];
+            [self appendCString:"</extensions>"];
+        }
+        [self appendCString:"</trkpt>\n"];
+        self.pointsWritten++;
+    });
+    if (!readable) {
+        STRLogError(STRLogCategoryStorage, @"STRTrackExporter: Could not read all of the geodata of capture %@.", capture.token);
+    }
+    [self appendCString:"</trkseg>\n</trk>\n"];
+}
+
+-(void)writeKMLCapture:(STRCapture *)capture geoDataPath:(NSString *)geoDataPath {
+    NSTimeInterval start = [capture.creationDate timeIntervalSince1970];
+
+    [self appendCString:"<Placemark>\n<name>"];
+    [self appendXMLString:capture.title];
+    [self appendCString:"</name>\n<ExtendedData><Data name=\"token\"><value>"];
+    [self appendXMLString:capture.token];
+    [self appendCString:"</value></Data><Data name=\"media_type\"><value>"];
+    [self appendXMLString:capture.type];
+    [self appendCString:"</value></Data><Data name=\"created_at\"><value>"];
+    [self appendTime:start];
+    [self appendCString:"</value></Data>"];
+    if (capture.uploadDate) {
+        [self appendCString:"<Data name=\"uploaded_at\"><value>"];
+        [self appendTime:[capture.uploadDate timeIntervalSince1970]];
+        [self appendCString:"</value></Data>"];
+    }
+    [self appendCString:"</ExtendedData>\n<gx:Track>\n"];
+
+    // gx:Track lists every time, then every position, then every angle, then every accuracy
+    BOOL readable = geoDataPath && STREnumerateTrackPoints(geoDataPath, ^(const STRTrackPoint * point, BOOL * stop) {
+        [self appendCString:"<when>"];
+        [self appendTime:start + point->timestamp];
+        [self appendCString:"</when>\n"];
+        self.pointsWritten++;
+    });
+    if (readable) {
+        STREnumerateTrackPoints(geoDataPath, ^(const STRTrackPoint * point, BOOL * stop) {
+            [self appendFormat:"<gx:coord>%.7f %.7f 0</gx:coord>\n", point->longitude, point->latitude];
+        });
+        STREnumerateTrackPoints(geoDataPath, ^(const STRTrackPoint * point, BOOL * stop) {
+            [self appendFormat:"<gx:angles>%.2f 0 0</gx:angles>\n", (isfinite(point->heading)) ? point->heading : 0.0];
+        });
+        [self appendCString:"<ExtendedData><SchemaData schemaUrl=\"#strabo_point\"><gx:SimpleArrayData name=\"accuracy\">\n"];
+        STREnumerateTrackPoints(geoDataPath, ^(const STRTrackPoint * point, BOOL * stop) {
+            if (isfinite(point->accuracy)) [self appendFormat:"<gx:value>%.2f</gx:value>\n", point->accuracy];
+            else [self appendCString:"<gx:value/>\n"];
+        });
+        [self appendCString:"</gx:SimpleArrayData></SchemaData></ExtendedData>\n"];
+    } else {
+        STRLogError(STRLogCategoryStorage, @"STRTrackExporter: Could not read all of the geodata of capture %@.", capture.token);
+    }
+    [self appendCString:"</gx:Track>\n</Placemark>\n"];
+}
+
+#pragma mark - Buffered Output
+
+-(void)reserve:(NSUInteger)length {
+    if (_bufferLength + length > kSTRExportBufferSize) [self flush];
+}
+
+-(void)appendCString:(const char *)string {
+    size_t length = strlen(string);
+    while (length > 0) {
+        [self reserve:MIN(length, (size_t)kSTRExportBufferSize)];
+        size_t chunk = MIN(length, kSTRExportBufferSize - _bufferLength);
+        memcpy(_buffer + _bufferLength, string, chunk);
+        _bufferLength += chunk;
+        string += chunk;
+        length -= chunk;
+    }
+}
+
+-(void)appendFormat:(const char *)format, ... {
+    [self reserve:kSTRExportMaximumAppendLength];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(_buffer + _bufferLength, kSTRExportMaximumAppendLength, format, arguments);
+    va_end(arguments);
+    if (length > 0) _bufferLength += MIN(length, kSTRExportMaximumAppendLength - 1);
+}
+
+-(void)appendJSONString:(NSString *)string {
+    if (!string) {
+        [self appendCString:"null"];
+        return;
+    }
+    [self appendCString:"\""];
+    for (const unsigned char * c = (const unsigned char *)[string UTF8String]; *c; c++) {
+        [self reserve:8];
+        if (*c == '"' || *c == '\\') {
+            _buffer[_bufferLength++] = '\\';
+            _buffer[_bufferLength++] = *c;
+        } else if (*c < 0x20) {
+            _bufferLength += snprintf(_buffer + _bufferLength, 8, "\\u%04x", *c);
+        } else {
+            _buffer[_bufferLength++] = *c;
+        }
+    }
+    [self appendCString:"\""];
+}
+
+-(void)appendXMLString:(NSString *)string {
+    if (!string) return;
+    for (const unsigned char * c = (const unsigned char *)[string UTF8String]; *c; c++) {
+        switch (*c) {
+            case '&': [self appendCString:"&amp;"]; break;
+            case '<': [self appendCString:"&lt;"]; break;
+            case '>': [self appendCString:"&gt;"]; break;
+            case '"': [self appendCString:"&quot;"]; break;
+            case '\'': [self appendCString:"&apos;"]; break;
+            default:
+                // XML 1.0 allows no control characters other than whitespace
+                if (*c < 0x20 && *c != '\t' && *c != '\n' && *c != '\r') break;
+                [self reserve:1];
+                _buffer[_bufferLength++] = *c;
+                break;
+        }
+    }
+}
+
+-(void)appendTime:(NSTimeInterval)time {
+    // ISO 8601 in UTC with milliseconds; NSDateFormatter is too slow to call once per point
+    time_t seconds = (time_t)floor(time);
+    int milliseconds = (int)llround((time - seconds) * 1000);
+    if (milliseconds == 1000) {
+        seconds++;
+        milliseconds = 0;
+    }
+    struct tm parts;
+    gmtime_r(&seconds, &parts);
+    [self appendFormat:"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", parts.tm_year + 1900, parts.tm_mon + 1, parts.tm_mday, parts.tm_hour, parts.tm_min, parts.tm_sec, milliseconds];
+}
+
+-(void)flush {
+    NSUInteger offset = 0;
+    while (!_failed && offset < _bufferLength) {
+        NSInteger written = [_stream write:(const uint8_t *)_buffer + offset maxLength:_bufferLength - offset];
+        if (written <= 0) {
+            _failed = YES;
+            break;
+        }
+        offset += written;
+    }
+    self.bytesWritten += offset;
+    _bufferLength = 0;
+}
+
+@end
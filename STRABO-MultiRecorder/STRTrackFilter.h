@@ -0,0 +1,141 @@
+//
+//  STRTrackFilter.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ STRTrackSample
+
+ One point of a geodata track, with the same fields as a point in a geodata file.
+ */
+typedef struct {
+    double latitude;    // Degrees
+    double longitude;   // Degrees
+    double heading;     // Degrees clockwise from true north; negative if unknown
+    double accuracy;    // Meters; zero or negative if there is no fix
+    double timestamp;   // Seconds from the start of the capture
+} STRTrackSample;
+
+/**
+ Cleans up the noisy positions and headings in geodata tracks.
+
+ Positions are run through a Kalman filter with a constant velocity model. Each fix is weighted by its own accuracy, so a fix that Core Location reports as accurate to 5 meters pulls the track much harder than one accurate to 65 meters. Headings are run through a one dimensional Kalman filter that works on the circle, so a compass swinging between 359 and 1 degrees averages to 0 rather than 180.
+
+ STRCaptureViewController records a sample whenever either the location or the heading changes, so most samples repeat the previous fix or the previous heading. A fix or heading identical to the one before it is not counted again. Samples without a fix (accuracy zero or negative) or without a heading (negative heading) only carry the estimate forward.
+
+ A filter can be used in two ways:
+
+ - Incrementally, with filterSample:, which returns the best estimate given the samples so far. Each call costs a few dozen floating point operations, so it can run on every sample while recording. STRGeoLocationData uses it to write the filtered track beside the raw one.
+ - Offline, with smoothSamples:count: or smoothTrackAtPath:toPath:, which also runs a backward pass over the whole track (a Rauch-Tung-Striebel smoother), so that every point benefits from the fixes after it as well as before it. [STRCapture writeFilteredGeoData] uses this for captures that were recorded without a filtered track.
+
+ Filtered points have the same format as raw points. Their accuracy is the filter's estimate of its own error in meters, and their heading is -1 until the first valid heading.
+ */
+@interface STRTrackFilter : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Tuning
+///---------------------------------------------------------------------------------------
+
+/**
+ How much the speed of the device is expected to change, in meters per second squared. Larger values follow turns and stops more closely; smaller values give smoother tracks. Defaults to 1.5, which suits walking and driving alike.
+ */
+@property(nonatomic, assign)double accelerationNoise;
+
+/**
+ How fast the heading is expected to change, in degrees per second. Defaults to 45.
+ */
+@property(nonatomic, assign)double headingRateNoise;
+
+/**
+ The expected error of a compass reading, in degrees. Defaults to 10.
+ */
+@property(nonatomic, assign)double headingMeasurementNoise;
+
+/**
+ The smallest accuracy, in meters, that a fix is trusted to. Fixes that report better accuracy are treated as this accurate. Defaults to 3.
+ */
+@property(nonatomic, assign)double minimumAccuracy;
+
+///---------------------------------------------------------------------------------------
+/// @name Filtering While Recording
+///---------------------------------------------------------------------------------------
+
+/**
+ Adds a sample to the track and returns the filtered estimate at its time.
+
+ Samples should be passed in the order they were recorded.
+
+ @param sample The raw sample.
+
+ @return STRTrackSample The filtered sample, with the timestamp of the raw one.
+ */
+-(STRTrackSample)filterSample:(STRTrackSample)sample;
+
+/**
+ Forgets every sample passed to filterSample:, so that the filter can start on a new track.
+ */
+-(void)reset;
+
+///---------------------------------------------------------------------------------------
+/// @name Smoothing Saved Tracks
+///---------------------------------------------------------------------------------------
+
+/**
+ Replaces a whole track with its smoothed version.
+
+ The samples passed to filterSample: are not affected.
+
+ @param samples The samples of the track, in the order they were recorded.
+
+ @param count The number of samples.
+ */
+-(void)smoothSamples:(STRTrackSample *)samples count:(NSUInteger)count;
+
+/**
+ Smooths a track given as the points of a geodata file.
+
+ @param points An array of point dictionaries, as found under the `points` key of a geodata file.
+
+ @return NSArray The smoothed points, in the same format.
+ */
+-(NSArray *)smoothedPointsFromPoints:(NSArray *)points;
+
+/**
+ Reads a geodata file, smooths its track, and writes the result as a new geodata file.
+
+ @param sourcePath The path of the raw geodata file.
+
+ @param destinationPath The path to write the smoothed geodata file to. It is replaced atomically.
+
+ @return BOOL YES if the smoothed file was written. NO if the source could not be read or the destination could not be written.
+ */
+-(BOOL)smoothTrackAtPath:(NSString *)sourcePath toPath:(NSString *)destinationPath;
+
+///---------------------------------------------------------------------------------------
+/// @name Converting Points
+///---------------------------------------------------------------------------------------
+
+/**
+ Converts a point dictionary from a geodata file to a sample.
+
+ @param point The point dictionary.
+
+ @return STRTrackSample The sample. Missing fields count as unknown.
+ */
++(STRTrackSample)sampleFromPoint:(NSDictionary *)point;
+
+/**
+ Converts a sample to a point dictionary in the format of a geodata file.
+
+ @param sample The sample.
+
+ @return NSDictionary The point dictionary.
+ */
++(NSDictionary *)pointFromSample:(STRTrackSample)sample;
+
+@end
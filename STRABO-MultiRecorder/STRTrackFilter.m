@@ -0,0 +1,404 @@
+//
+//  STRTrackFilter.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackFilter.h"
+#import "STRCaptureFileParser.h"
+#import "STRLogger.h"
+
+#define kSTREarthRadius 6371008.8
+#define kSTRInitialSpeedVariance 100.0 // (10 m/s)^2 until the second fix
+
+// Position state on one axis. Both axes see the same fixes with the same accuracy,
+// so they share a covariance.
+typedef struct {
+    double x[2];            // Meters east and north of the first fix
+    double v[2];            // Meters per second east and north
+    double pp, pv, vv;      // Covariance of position and velocity
+} STRPositionState;
+
+typedef struct {
+    // Tuning
+    double accelerationVariance;
+    double headingRateVariance;
+    double headingMeasurementVariance;
+    double minimumAccuracy;
+
+    // Position
+    BOOL hasPosition;
+    double originLatitude, originLongitude;
+    double metersPerDegreeLatitude, metersPerDegreeLongitude;
+    STRPositionState position;
+    double lastLatitude, lastLongitude, lastAccuracy;
+
+    // Heading
+    BOOL hasHeading;
+    double heading, headingVariance;
+    double lastRawHeading;
+
+    BOOL hasTimestamp;
+    double lastTimestamp;
+} STRTrackFilterState;
+
+// The filtered estimate after one sample, kept for the backward pass
+typedef struct {
+    STRPositionState position;
+    double heading, headingVariance;
+    double dt;              // Seconds since the previous sample
+    BOOL hasPosition, hasHeading;
+} STRTrackFilterStep;
+
+#pragma mark - Filter Math
+
+static inline double STRWrapDegrees(double angle) {
+    angle = fmod(angle, 360.0);
+    if (angle > 180.0) angle -= 360.0;
+    else if (angle <= -180.0) angle += 360.0;
+    return angle;
+}
+
+static inline double STRNormalizeDegrees(double angle) {
+    angle = fmod(angle, 360.0);
+    return (angle < 0.0) ? angle + 360.0 : angle;
+}
+
+static inline void STRPredictedCovariance(const STRPositionState * s, double dt, double q, double * pp, double * pv, double * vv) {
+    double dt2 = dt * dt;
+    *pp = s->pp + 2.0 * dt * s->pv + dt2 * s->vv + q * dt2 * dt / 3.0;
+    *pv = s->pv + dt * s->vv + q * dt2 / 2.0;
+    *vv = s->vv + q * dt;
+}
+
+static inline void STRPredictPosition(STRPositionState * s, double dt, double q) {
+    STRPredictedCovariance(s, dt, q, &s->pp, &s->pv, &s->vv);
+    s->x[0] += s->v[0] * dt;
+    s->x[1] += s->v[1] * dt;
+}
+
+static inline void STRUpdatePosition(STRPositionState * s, double east, double north, double variance) {
+    double kp = s->pp / (s->pp + variance);
+    double kv = s->pv / (s->pp + variance);
+    double innovationEast = east - s->x[0];
+    double innovationNorth = north - s->x[1];
+    s->x[0] += kp * innovationEast;
+    s->x[1] += kp * innovationNorth;
+    s->v[0] += kv * innovationEast;
+    s->v[1] += kv * innovationNorth;
+    double pv = s->pv;
+    s->vv -= kv * pv;
+    s->pv = (1.0 - kp) * pv;
+    s->pp = (1.0 - kp) * s->pp;
+}
+
+static void STRTrackFilterStateReset(STRTrackFilterState * state) {
+    state->hasPosition = NO;
+    state->hasHeading = NO;
+    state->hasTimestamp = NO;
+}
+
+static double STRTrackFilterStateAdvance(STRTrackFilterState * state, const STRTrackSample * sample) {
+    double dt = (state->hasTimestamp) ? sample->timestamp - state->lastTimestamp : 0.0;
+    // Samples out of order are taken to be simultaneous
+    if (dt < 0.0) dt = 0.0;
+    state->lastTimestamp = sample->timestamp;
+    state->hasTimestamp = YES;
+
+    if (dt > 0.0) {
+        if (state->hasPosition) STRPredictPosition(&state->position, dt, state->accelerationVariance);
+        if (state->hasHeading) state->headingVariance += state->headingRateVariance * dt;
+    }
+
+    // Position
+    BOOL repeatedFix = state->hasPosition && sample->latitude == state->lastLatitude && sample->longitude == state->lastLongitude && sample->accuracy == state->lastAccuracy;
+    if (sample->accuracy > 0.0 && !repeatedFix) {
+        if (!state->hasPosition) {
+            state->originLatitude = sample->latitude;
+            state->originLongitude = sample->longitude;
+            state->metersPerDegreeLatitude = kSTREarthRadius * M_PI / 180.0;
+            state->metersPerDegreeLongitude = MAX(state->metersPerDegreeLatitude * cos(sample->latitude * M_PI / 180.0), 1.0);
+        }
+        double east = (sample->longitude - state->originLongitude) * state->metersPerDegreeLongitude;
+        double north = (sample->latitude - state->originLatitude) * state->metersPerDegreeLatitude;
+        double accuracy = MAX(sample->accuracy, state->minimumAccuracy);
+        if (!state->hasPosition) {
+            state->position.x[0] = east;
+            state->position.x[1] = north;
+            state->position.v[0] = state->position.v[1] = 0.0;
+            state->position.pp = accuracy * accuracy;
+            state->position.pv = 0.0;
+            state->position.vv = kSTRInitialSpeedVariance;
+            state->hasPosition = YES;
+        } else {
+            STRUpdatePosition(&state->position, east, north, accuracy * accuracy);
+        }
+        state->lastLatitude = sample->latitude;
+        state->lastLongitude = sample->longitude;
+        state->lastAccuracy = sample->accuracy;
+    }
+
+    // Heading
+    if (sample->heading >= 0.0) {
+        if (!state->hasHeading) {
+            state->heading = STRNormalizeDegrees(sample->heading);
+            state->headingVariance = state->headingMeasurementVariance;
+            state->hasHeading = YES;
+        } else if (sample->heading != state->lastRawHeading) {
+            double gain = state->headingVariance / (state->headingVariance + state->headingMeasurementVariance);
+            state->heading = STRNormalizeDegrees(state->heading + gain * STRWrapDegrees(sample->heading - state->heading));
+            state->headingVariance *= (1.0 - gain);
+        }
+        state->lastRawHeading = sample->heading;
+    }
+
+    return dt;
+}
+
+static inline void STRTrackFilterOutput(const STRTrackFilterState * state, const STRPositionState * position, BOOL hasPosition, double heading, BOOL hasHeading, STRTrackSample * sample) {
+    if (hasPosition) {
+        sample->latitude = state->originLatitude + position->x[1] / state->metersPerDegreeLatitude;
+        sample->longitude = state->originLongitude + position->x[0] / state->metersPerDegreeLongitude;
+        sample->accuracy = sqrt(position->pp);
+    }
+    sample->heading = (hasHeading) ? heading : -1.0;
+}
+
+#pragma mark - STRTrackFilter
+
+@interface STRTrackFilter () {
+    STRTrackFilterState _state;
+}
+@end
+
+@interface STRTrackFilter (InternalMethods)
+
+// -- Tuning -- //
+-(void)applyTuningToState:(STRTrackFilterState *)state;
+
+@end
+
+@implementation STRTrackFilter
+
+@synthesize accelerationNoise = _accelerationNoise;
+@synthesize headingRateNoise = _headingRateNoise;
+@synthesize headingMeasurementNoise = _headingMeasurementNoise;
+@synthesize minimumAccuracy = _minimumAccuracy;
+
+-(id)init {
+    self = [super init];
+    if (self) {
+        _accelerationNoise = 1.5;
+        _headingRateNoise = 45.0;
+        _headingMeasurementNoise = 10.0;
+        _minimumAccuracy = 3.0;
+        [self reset];
+    }
+    return self;
+}
+
+#pragma mark - Filtering While Recording
+
+-(STRTrackSample)filterSample:(STRTrackSample)sample {
+    STRTrackFilterStateAdvance(&_state, &sample);
+    STRTrackSample filtered = sample;
+    STRTrackFilterOutput(&_state, &_state.position, _state.hasPosition, _state.heading, _state.hasHeading, &filtered);
+    return filtered;
+}
+
+-(void)reset {
+    STRTrackFilterStateReset(&_state);
+    [self applyTuningToState:&_state];
+}
+
+-(void)setAccelerationNoise:(double)accelerationNoise {
+    _accelerationNoise = accelerationNoise;
+    [self applyTuningToState:&_state];
+}
+
+-(void)setHeadingRateNoise:(double)headingRateNoise {
+    _headingRateNoise = headingRateNoise;
+    [self applyTuningToState:&_state];
+}
+
+-(void)setHeadingMeasurementNoise:(double)headingMeasurementNoise {
+    _headingMeasurementNoise = headingMeasurementNoise;
+    [self applyTuningToState:&_state];
+}
+
+-(void)setMinimumAccuracy:(double)minimumAccuracy {
+    _minimumAccuracy = minimumAccuracy;
+    [self applyTuningToState:&_state];
+}
+
+#pragma mark - Smoothing Saved Tracks
+
+-(void)smoothSamples:(STRTrackSample *)samples count:(NSUInteger)count {
+    if (count == 0) return;
+    STRTrackFilterStep * steps = malloc(count * sizeof(STRTrackFilterStep));
+    if (!steps) return;
+
+    // Forward pass
+    STRTrackFilterState state;
+    STRTrackFilterStateReset(&state);
+    [self applyTuningToState:&state];
+    for (NSUInteger i = 0; i < count; i++) {
+        steps[i].dt = STRTrackFilterStateAdvance(&state, &samples[i]);
+        steps[i].position = state.position;
+        steps[i].hasPosition = state.hasPosition;
+        steps[i].heading = state.heading;
+        steps[i].headingVariance = state.headingVariance;
+        steps[i].hasHeading = state.hasHeading;
+    }
+
+    // Backward pass. Each step is corrected by the smoothed step after it, and
+    // steps before the first fix or heading take the first smoothed value.
+    STRPositionState smoothed = steps[count - 1].position;
+    BOOL hasSmoothedPosition = steps[count - 1].hasPosition;
+    double smoothedHeading = steps[count - 1].heading;
+    BOOL hasSmoothedHeading = steps[count - 1].hasHeading;
+    STRTrackFilterOutput(&state, &smoothed, hasSmoothedPosition, smoothedHeading, hasSmoothedHeading, &samples[count - 1]);
+    double q = state.accelerationVariance;
+    for (NSUInteger i = count - 1; i-- > 0;) {
+        const STRTrackFilterStep * step = &steps[i];
+        double dt = steps[i + 1].dt;
+
+        if (step->hasPosition) {
+            const STRPositionState * f = &step->position;
+            double ppP, pvP, vvP;
+            STRPredictedCovariance(f, dt, q, &ppP, &pvP, &vvP);
+            double det = ppP * vvP - pvP * pvP;
+            if (det > 0.0) {
+                // C = P F' inverse(predicted P)
+                double a00 = f->pp + dt * f->pv, a01 = f->pv;
+                double a10 = f->pv + dt * f->vv, a11 = f->vv;
+                double c00 = (a00 * vvP - a01 * pvP) / det, c01 = (a01 * ppP - a00 * pvP) / det;
+                double c10 = (a10 * vvP - a11 * pvP) / det, c11 = (a11 * ppP - a10 * pvP) / det;
+                STRPositionState next = smoothed;
+                for (int axis = 0; axis < 2; axis++) {
+                    double dx = next.x[axis] - (f->x[axis] + f->v[axis] * dt);
+                    double dv = next.v[axis] - f->v[axis];
+                    smoothed.x[axis] = f->x[axis] + c00 * dx + c01 * dv;
+                    smoothed.v[axis] = f->v[axis] + c10 * dx + c11 * dv;
+                }
+                // P + C (next P - predicted P) C'
+                double d00 = next.pp - ppP, d01 = next.pv - pvP, d11 = next.vv - vvP;
+                double e00 = c00 * d00 + c01 * d01, e01 = c00 * d01 + c01 * d11;
+                double e10 = c10 * d00 + c11 * d01, e11 = c10 * d01 + c11 * d11;
+                smoothed.pp = f->pp + e00 * c00 + e01 * c01;
+                smoothed.pv = f->pv + e00 * c10 + e01 * c11;
+                smoothed.vv = f->vv + e10 * c10 + e11 * c11;
+            }
+            hasSmoothedPosition = YES;
+        }
+
+        if (step->hasHeading) {
+            double gain = step->headingVariance / (step->headingVariance + state.headingRateVariance * dt);
+            smoothedHeading = STRNormalizeDegrees(step->heading + gain * STRWrapDegrees(smoothedHeading - step->heading));
+            hasSmoothedHeading = YES;
+        }
+
+        STRTrackFilterOutput(&state, &smoothed, hasSmoothedPosition, smoothedHeading, hasSmoothedHeading, &samples[i]);
+    }
+
+    free(steps);
+}
+
+-(NSArray *)smoothedPointsFromPoints:(NSArray *)points {
+    NSUInteger count = points.count;
+    if (count == 0) return @[];
+    STRTrackSample * samples = malloc(count * sizeof(STRTrackSample));
+    if (!samples) return nil;
+    for (NSUInteger i = 0; i < count; i++) {
+        samples[i] = [STRTrackFilter sampleFromPoint:[points objectAtIndex:i]];
+    }
+    [self smoothSamples:samples count:count];
+    NSMutableArray * smoothedPoints = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [smoothedPoints addObject:[STRTrackFilter pointFromSample:samples[i]]];
+    }
+    free(samples);
+    return smoothedPoints;
+}
+
+-(BOOL)smoothTrackAtPath:(NSString *)sourcePath toPath:(NSString *)destinationPath {
+    NSError * error;
+    NSArray * smoothedPoints;
+    STRTrackSample * samples;
+    NSUInteger count;
+    if ([[STRCaptureFileParser parserForCurrentThread] parseGeoDataAtPath:sourcePath samples:&samples count:&count]) {
+        [self smoothSamples:samples count:count];
+        NSMutableArray * points = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++) {
+            [points addObject:[STRTrackFilter pointFromSample:samples[i]]];
+        }
+        free(samples);
+        smoothedPoints = points;
+    } else {
+        // Files the fast parser does not expect are read the generic way
+        NSData * data = [NSData dataWithContentsOfFile:sourcePath];
+        if (!data) {
+            STRLogError(STRLogCategoryStorage, @"STRTrackFilter: Could not read the geodata file at %@", sourcePath);
+            return NO;
+        }
+        NSDictionary * geoData = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+        NSArray * points = ([geoData isKindOfClass:[NSDictionary class]]) ? [geoData objectForKey:@"points"] : nil;
+        if (![points isKindOfClass:[NSArray class]]) {
+            STRLogError(STRLogCategoryStorage, @"STRTrackFilter: The geodata file at %@ has no points: %@", sourcePath, error);
+            return NO;
+        }
+        smoothedPoints = [self smoothedPointsFromPoints:points];
+    }
+
+    NSData * smoothedData = (smoothedPoints) ? [NSJSONSerialization dataWithJSONObject:@{ @"points" : smoothedPoints } options:0 error:&error] : nil;
+    if (!smoothedData || ![smoothedData writeToFile:destinationPath options:NSDataWritingAtomic error:&error]) {
+        STRLogError(STRLogCategoryStorage, @"STRTrackFilter: Could not write the smoothed geodata file to %@: %@", destinationPath, error);
+        return NO;
+    }
+    return YES;
+}
+
+#pragma mark - Converting Points
+
++(STRTrackSample)sampleFromPoint:(NSDictionary *)point {
+    STRTrackSample sample = { 0.0, 0.0, -1.0, -1.0, 0.0 };
+    if (![point isKindOfClass:[NSDictionary class]]) return sample;
+    NSArray * coords = [point objectForKey:@"coords"];
+    if ([coords isKindOfClass:[NSArray class]] && coords.count >= 2) {
+        sample.latitude = [[coords objectAtIndex:0] doubleValue];
+        sample.longitude = [[coords objectAtIndex:1] doubleValue];
+        NSNumber * accuracy = [point objectForKey:@"accuracy"];
+        if ([accuracy isKindOfClass:[NSNumber class]]) sample.accuracy = [accuracy doubleValue];
+    }
+    NSNumber * heading = [point objectForKey:@"heading"];
+    if ([heading isKindOfClass:[NSNumber class]]) sample.heading = [heading doubleValue];
+    NSNumber * timestamp = [point objectForKey:@"timestamp"];
+    if ([timestamp isKindOfClass:[NSNumber class]]) sample.timestamp = [timestamp doubleValue];
+    return sample;
+}
+
++(NSDictionary *)pointFromSample:(STRTrackSample)sample {
+    return @{
+        @"coords" : @[ @(sample.latitude), @(sample.longitude) ],
+        @"heading" : @(sample.heading),
+        @"accuracy" : @(sample.accuracy),
+        @"timestamp" : @(sample.timestamp)
+    };
+}
+
+@end
+
+@implementation STRTrackFilter (InternalMethods)
+
+#pragma mark - Tuning
+
+-(void)applyTuningToState:(STRTrackFilterState *)state {
+    state->accelerationVariance = _accelerationNoise * _accelerationNoise;
+    state->headingRateVariance = _headingRateNoise * _headingRateNoise;
+    state->headingMeasurementVariance = _headingMeasurementNoise * _headingMeasurementNoise;
+    state->minimumAccuracy = _minimumAccuracy;
+}
+
+@end
@@ -0,0 +1,158 @@
+//
+//  STRTrackSummary.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreLocation/CoreLocation.h>
+
+#import "STRTrackFilter.h"
+
+@class STRCapturePathResolver;
+
+/**
+ STRTrackSummaryValues
+
+ The values of a track summary, as they are kept in the `track_summary` object of a capture info file. Values that the track does not have are NAN.
+ */
+typedef struct {
+    NSUInteger pointCount;
+    double duration;            // Seconds from the earliest point to the latest
+    double distance;            // Meters along the fixes
+    double minLatitude;         // Degrees; NAN without a fix, as are the other bounds
+    double minLongitude;
+    double maxLatitude;
+    double maxLongitude;
+    double meanAccuracy;        // Meters; NAN without a fix
+    double headingRangeStart;   // Degrees clockwise from true north; NAN without a heading
+    double headingRangeEnd;     // Less than the start when the range crosses north
+} STRTrackSummaryValues;
+
+/**
+ The duration, length, extent, point count, accuracy and heading range of a geodata track.
+
+ Working any of these out means reading and parsing the whole geodata file, which grows with the length of the capture. A list of captures wants them for every row, so the summary is worked out once, when the track is written, and kept in the capture info file, which [STRCapture captureFromFilesAtDirectory:] reads anyway. [STRCapture trackSummary] then costs the same for a 5 second capture as for a 2 hour one.
+
+ STRCaptureFileOrganizer, STRCaptureSegmenter and [STRCaptureFileManager newCaptureWithImageAtPath:attributes:] summarize the tracks that they write. Captures saved before summaries were kept are summarized by backfillCapturesOfResolver:, which [STRCaptureFileManager defaultManager] starts in the background.
+
+ A point has a fix when its accuracy is positive, and a heading when its heading is not negative, as for a STRTrackFilter. Only fixes count towards the distance, bounds and mean accuracy.
+ */
+@interface STRTrackSummary : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Summarizing Tracks
+///---------------------------------------------------------------------------------------
+
+/**
+ Summarizes some samples.
+
+ @param samples The points of the track, in the order they were recorded.
+
+ @param count The number of samples. A track without points gives a summary with a point count of 0.
+
+ @return STRTrackSummary The summary.
+ */
++(STRTrackSummary *)summaryOfSamples:(const STRTrackSample *)samples count:(NSUInteger)count;
+
+/**
+ Reads and summarizes a geodata file.
+
+ @param path The absolute path of the geodata file.
+
+ @return STRTrackSummary The summary, or nil if the file cannot be read.
+ */
++(STRTrackSummary *)summaryOfTrackAtPath:(NSString *)path;
+
+/**
+ Summarizes the tracks of the captures that do not have a summary yet and saves each summary in the capture info file.
+
+ Captures are summarized on all cores, 64 at a time. A capture that cannot be read is skipped and is tried again by the next backfill.
+
+ @param resolver The resolver for the captures directory.
+
+ @return NSUInteger The number of captures that were summarized.
+ */
++(NSUInteger)backfillCapturesOfResolver:(STRCapturePathResolver *)resolver;
+
+///---------------------------------------------------------------------------------------
+/// @name Reading and Writing Summaries
+///---------------------------------------------------------------------------------------
+
+/**
+ Creates a summary from its values.
+
+ @param values The values, as read by a STRCaptureFileParser.
+ */
+-(id)initWithValues:(STRTrackSummaryValues)values;
+
+/**
+ Creates a summary from the `track_summary` object of a capture info file.
+
+ @param dictionary The object, as read by NSJSONSerialization.
+
+ @return STRTrackSummary The summary, or nil if the object does not have a point count, duration and distance.
+ */
++(STRTrackSummary *)summaryFromDictionary:(NSDictionary *)dictionary;
+
+/**
+ The `track_summary` object to save in a capture info file.
+
+ Values that the track does not have are left out. See the [Underlying Mechanics](UnderlyingMechanics) guide for the keys.
+ */
+-(NSDictionary *)dictionaryRepresentation;
+
+/**
+ The values of the summary.
+ */
+@property(readonly)STRTrackSummaryValues values;
+
+///---------------------------------------------------------------------------------------
+/// @name Summary Values
+///---------------------------------------------------------------------------------------
+
+/**
+ The number of points in the track.
+ */
+@property(readonly)NSUInteger pointCount;
+
+/**
+ The time from the earliest point to the latest, in seconds.
+ */
+@property(readonly)NSTimeInterval duration;
+
+/**
+ The length of the path through the fixes, in meters.
+ */
+@property(readonly)CLLocationDistance distance;
+
+/**
+ The south west corner of the box around the fixes, or kCLLocationCoordinate2DInvalid if the track has none.
+ */
+@property(readonly)CLLocationCoordinate2D southWest;
+
+/**
+ The north east corner of the box around the fixes, or kCLLocationCoordinate2DInvalid if the track has none.
+ */
+@property(readonly)CLLocationCoordinate2D northEast;
+
+/**
+ The mean accuracy of the fixes in meters, or -1 if the track has none.
+ */
+@property(readonly)CLLocationAccuracy meanAccuracy;
+
+/**
+ The first heading of the smallest arc that holds every heading of the track, or -1 if the track has none.
+
+ The arc runs clockwise from headingRangeStart to headingRangeEnd. When it crosses north, the end is less than the start; a track heading between 350 and 10 degrees has a range from 350 to 10.
+ */
+@property(readonly)CLLocationDirection headingRangeStart;
+
+/**
+ The last heading of the smallest arc that holds every heading of the track, or -1 if the track has none.
+ */
+@property(readonly)CLLocationDirection headingRangeEnd;
+
+@end
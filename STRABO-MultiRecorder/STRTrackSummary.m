@@ -0,0 +1,326 @@
+//
+//  STRTrackSummary.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackSummary.h"
+#import "STRCaptureChangeFeed.h"
+#import "STRCaptureFileParser.h"
+#import "STRCaptureLockTable.h"
+#import "STRCapturePathResolver.h"
+#import "STRLogger.h"
+#import "STRSettings.h"
+
+#define kSTRCaptureInfoFile @"capture-info.json"
+#define kSTRTrackSummaryKey @"track_summary"
+#define kSTRBackfillBatchSize 64
+#define kSTREarthRadius 6371008.8
+
+@interface STRTrackSummary () {
+    STRTrackSummaryValues _values;
+}
+
+@end
+
+@interface STRTrackSummary (InternalMethods)
+
+// -- Headings -- //
++(void)headingRangeOfSamples:(const STRTrackSample *)samples count:(NSUInteger)count start:(double *)start end:(double *)end;
+
+// -- Backfill -- //
++(BOOL)backfillCaptureAtPath:(NSString *)capturePath;
+
+@end
+
+static inline double STRRadians(double degrees) {
+    return degrees * M_PI / 180.0;
+}
+
+// Great circle distance between two points, in meters
+static double STRHaversineDistance(double latitude1, double longitude1, double latitude2, double longitude2) {
+    double dLatitude = STRRadians(latitude2 - latitude1);
+    double dLongitude = STRRadians(longitude2 - longitude1);
+    double a = sin(dLatitude / 2.0) * sin(dLatitude / 2.0) + cos(STRRadians(latitude1)) * cos(STRRadians(latitude2)) * sin(dLongitude / 2.0) * sin(dLongitude / 2.0);
+    return 2.0 * kSTREarthRadius * atan2(sqrt(a), sqrt(1.0 - a));
+}
+
+static int STRCompareDoubles(const void * a, const void * b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+@implementation STRTrackSummary
+
+#pragma mark - Summarizing Tracks
+
++(STRTrackSummary *)summaryOfSamples:(const STRTrackSample *)samples count:(NSUInteger)count {
+    STRTrackSummaryValues values;
+    values.pointCount = count;
+    values.duration = values.distance = 0.0;
+    values.minLatitude = values.minLongitude = values.maxLatitude = values.maxLongitude = NAN;
+    values.meanAccuracy = NAN;
+
+    double firstTime = INFINITY, lastTime = -INFINITY;
+    double accuracySum = 0.0;
+    NSUInteger fixes = 0;
+    const STRTrackSample * previousFix = NULL;
+    for (NSUInteger i = 0; i < count; i++) {
+        const STRTrackSample * sample = &samples[i];
+        firstTime = MIN(firstTime, sample->timestamp);
+        lastTime = MAX(lastTime, sample->timestamp);
+        if (!(sample->accuracy > 0.0)) continue;
+
+        if (fixes == 0) {
+            values.minLatitude = values.maxLatitude = sample->latitude;
+            values.minLongitude = values.maxLongitude = sample->longitude;
+        } else {
+            values.minLatitude = MIN(values.minLatitude, sample->latitude);
+            values.maxLatitude = MAX(values.maxLatitude, sample->latitude);
+            values.minLongitude = MIN(values.minLongitude, sample->longitude);
+            values.maxLongitude = MAX(values.maxLongitude, sample->longitude);
+        }
+        if (previousFix) {
+            values.distance += STRHaversineDistance(previousFix->latitude, previousFix->longitude, sample->latitude, sample->longitude);
+        }
+        previousFix = sample;
+        accuracySum += sample->accuracy;
+        fixes++;
+    }
+    if (count > 0) values.duration = lastTime - firstTime;
+    if (fixes > 0) values.meanAccuracy = accuracySum / fixes;
+    [self headingRangeOfSamples:samples count:count start:&values.headingRangeStart end:&values.headingRangeEnd];
+
+    return [[STRTrackSummary alloc] initWithValues:values];
+}
+
++(STRTrackSummary *)summaryOfTrackAtPath:(NSString *)path {
+    STRTrackSample * samples;
+    NSUInteger count;
+    if ([[STRCaptureFileParser parserForCurrentThread] parseGeoDataAtPath:path samples:&samples count:&count]) {
+        STRTrackSummary * summary = [self summaryOfSamples:samples count:count];
+        free(samples);
+        return summary;
+    }
+
+    // Files the fast parser does not expect are read the generic way
+    NSData * data = [NSData dataWithContentsOfFile:path];
+    NSDictionary * geoData = (data) ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+    NSArray * points = ([geoData isKindOfClass:[NSDictionary class]]) ? [geoData objectForKey:@"points"] : nil;
+    if (![points isKindOfClass:[NSArray class]]) {
+        STRLogWarning(STRLogCategoryStorage, @"STRTrackSummary: Could not read the geodata file at %@", path);
+        return nil;
+    }
+    NSMutableData * sampleData = [NSMutableData dataWithLength:points.count * sizeof(STRTrackSample)];
+    samples = (STRTrackSample *)[sampleData mutableBytes];
+    for (NSUInteger i = 0; i < points.count; i++) {
+        samples[i] = [STRTrackFilter sampleFromPoint:[points objectAtIndex:i]];
+    }
+    return [self summaryOfSamples:samples count:points.count];
+}
+
++(NSUInteger)backfillCapturesOfResolver:(STRCapturePathResolver *)resolver {
+    NSArray * directories = [resolver allCaptureDirectories];
+    NSUInteger count = directories.count;
+
+    // Each worker writes only its own slots, so no locking is needed
+    BOOL * summarized = calloc(MAX(count, 1), sizeof(BOOL));
+    NSUInteger batchSize = [[STRSettings sharedSettings] parallelBatchSize];
+    if (batchSize == 0) batchSize = kSTRBackfillBatchSize;
+    size_t batches = (count + batchSize - 1) / batchSize;
+    dispatch_apply(batches, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t batch) {
+        NSUInteger end = MIN(count, (batch + 1) * batchSize);
+        for (NSUInteger i = batch * batchSize; i < end; i++) {
+            @autoreleasepool {
+                summarized[i] = [self backfillCaptureAtPath:[resolver absolutePathForRelativePath:[directories objectAtIndex:i]]];
+            }
+        }
+    });
+
+    NSUInteger backfilled = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        if (summarized[i]) backfilled++;
+    }
+    free(summarized);
+    if (backfilled > 0) {
+        STRLogInfo(STRLogCategoryStorage, @"STRTrackSummary: Summarized the tracks of %lu captures.", (unsigned long)backfilled);
+    }
+    return backfilled;
+}
+
+#pragma mark - Reading and Writing Summaries
+
+-(id)initWithValues:(STRTrackSummaryValues)values {
+    self = [super init];
+    if (self) {
+        _values = values;
+    }
+    return self;
+}
+
++(STRTrackSummary *)summaryFromDictionary:(NSDictionary *)dictionary {
+    if (![dictionary isKindOfClass:[NSDictionary class]]) return nil;
+    NSNumber * pointCount = [dictionary objectForKey:@"point_count"];
+    NSNumber * duration = [dictionary objectForKey:@"duration"];
+    NSNumber * distance = [dictionary objectForKey:@"distance"];
+    if (![pointCount isKindOfClass:[NSNumber class]] || ![duration isKindOfClass:[NSNumber class]] || ![distance isKindOfClass:[NSNumber class]]) return nil;
+
+    STRTrackSummaryValues values;
+    values.pointCount = [pointCount unsignedIntegerValue];
+    values.duration = [duration doubleValue];
+    values.distance = [distance doubleValue];
+    values.minLatitude = values.minLongitude = values.maxLatitude = values.maxLongitude = NAN;
+    values.meanAccuracy = values.headingRangeStart = values.headingRangeEnd = NAN;
+
+    NSArray * bounds = [dictionary objectForKey:@"bounds"];
+    if ([bounds isKindOfClass:[NSArray class]] && bounds.count == 4) {
+        values.minLatitude = [[bounds objectAtIndex:0] doubleValue];
+        values.minLongitude = [[bounds objectAtIndex:1] doubleValue];
+        values.maxLatitude = [[bounds objectAtIndex:2] doubleValue];
+        values.maxLongitude = [[bounds objectAtIndex:3] doubleValue];
+    }
+    NSNumber * meanAccuracy = [dictionary objectForKey:@"mean_accuracy"];
+    if ([meanAccuracy isKindOfClass:[NSNumber class]]) values.meanAccuracy = [meanAccuracy doubleValue];
+    NSArray * headingRange = [dictionary objectForKey:@"heading_range"];
+    if ([headingRange isKindOfClass:[NSArray class]] && headingRange.count == 2) {
+        values.headingRangeStart = [[headingRange objectAtIndex:0] doubleValue];
+        values.headingRangeEnd = [[headingRange objectAtIndex:1] doubleValue];
+    }
+    return [[STRTrackSummary alloc] initWithValues:values];
+}
+
+-(NSDictionary *)dictionaryRepresentation {
+    NSMutableDictionary * dictionary = [NSMutableDictionary dictionaryWithCapacity:6];
+    [dictionary setObject:@(_values.pointCount) forKey:@"point_count"];
+    [dictionary setObject:@(_values.duration) forKey:@"duration"];
+    [dictionary setObject:@(_values.distance) forKey:@"distance"];
+    if (!isnan(_values.minLatitude)) {
+        [dictionary setObject:@[ @(_values.minLatitude), @(_values.minLongitude), @(_values.maxLatitude), @(_values.maxLongitude) ] forKey:@"bounds"];
+    }
+    if (!isnan(_values.meanAccuracy)) [dictionary setObject:@(_values.meanAccuracy) forKey:@"mean_accuracy"];
+    if (!isnan(_values.headingRangeStart)) {
+        [dictionary setObject:@[ @(_values.headingRangeStart), @(_values.headingRangeEnd) ] forKey:@"heading_range"];
+    }
+    return dictionary;
+}
+
+-(STRTrackSummaryValues)values {
+    return _values;
+}
+
+#pragma mark - Summary Values
+
+-(NSUInteger)pointCount {
+    return _values.pointCount;
+}
+
+-(NSTimeInterval)duration {
+    return _values.duration;
+}
+
+-(CLLocationDistance)distance {
+    return _values.distance;
+}
+
+-(CLLocationCoordinate2D)southWest {
+    if (isnan(_values.minLatitude)) return kCLLocationCoordinate2DInvalid;
+    return CLLocationCoordinate2DMake(_values.minLatitude, _values.minLongitude);
+}
+
+-(CLLocationCoordinate2D)northEast {
+    if (isnan(_values.maxLatitude)) return kCLLocationCoordinate2DInvalid;
+    return CLLocationCoordinate2DMake(_values.maxLatitude, _values.maxLongitude);
+}
+
+-(CLLocationAccuracy)meanAccuracy {
+    return (isnan(_values.meanAccuracy)) ? -1.0 : _values.meanAccuracy;
+}
+
+-(CLLocationDirection)headingRangeStart {
+    return (isnan(_values.headingRangeStart)) ? -1.0 : _values.headingRangeStart;
+}
+
+-(CLLocationDirection)headingRangeEnd {
+    return (isnan(_values.headingRangeEnd)) ? -1.0 : _values.headingRangeEnd;
+}
+
+@end
+
+
+@implementation STRTrackSummary (InternalMethods)
+
+#pragma mark - Headings
+
++(void)headingRangeOfSamples:(const STRTrackSample *)samples count:(NSUInteger)count start:(double *)start end:(double *)end {
+    *start = *end = NAN;
+    double * headings = (count > 0) ? malloc(count * sizeof(double)) : NULL;
+    NSUInteger headingCount = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        if (samples[i].heading < 0.0) continue;
+        headings[headingCount++] = fmod(samples[i].heading, 360.0);
+    }
+    if (headingCount == 0) {
+        free(headings);
+        return;
+    }
+
+    // The smallest arc holding every heading is the circle less the widest gap between neighbours
+    qsort(headings, headingCount, sizeof(double), STRCompareDoubles);
+    NSUInteger gapEnd = 0;
+    double widestGap = headings[0] + 360.0 - headings[headingCount - 1];
+    for (NSUInteger i = 1; i < headingCount; i++) {
+        double gap = headings[i] - headings[i - 1];
+        if (gap > widestGap) {
+            widestGap = gap;
+            gapEnd = i;
+        }
+    }
+    *start = headings[gapEnd];
+    *end = headings[(gapEnd + headingCount - 1) % headingCount];
+    free(headings);
+}
+
+#pragma mark - Backfill
+
++(BOOL)backfillCaptureAtPath:(NSString *)capturePath {
+    NSString * infoPath = [capturePath stringByAppendingPathComponent:kSTRCaptureInfoFile];
+
+    // Most captures are read by the fast parser, which can tell whether a summary is there
+    STRCaptureFileParser * parser = [STRCaptureFileParser parserForCurrentThread];
+    STRCaptureInfoFields fields;
+    if ([parser parseCaptureInfoAtPath:infoPath fields:&fields] && fields.hasTrackSummary) return NO;
+
+    NSData * data = [NSData dataWithContentsOfFile:infoPath];
+    NSDictionary * info = (data) ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+    NSString * geoDataFile = ([info isKindOfClass:[NSDictionary class]]) ? [info objectForKey:@"geodata_file"] : nil;
+    NSString * token = [info objectForKey:@"token"];
+    if (![geoDataFile isKindOfClass:[NSString class]] || ![token isKindOfClass:[NSString class]]) return NO;
+    if ([STRTrackSummary summaryFromDictionary:[info objectForKey:kSTRTrackSummaryKey]]) return NO;
+
+    // Only the file name is taken from the info file; the directory is wherever the capture lives now.
+    // The track is summarized without the lock, and only the info file is read again and
+    // replaced under it, so a title saved meanwhile is not written over.
+    STRTrackSummary * summary = [STRTrackSummary summaryOfTrackAtPath:[capturePath stringByAppendingPathComponent:[geoDataFile lastPathComponent]]];
+    if (!summary) return NO;
+    __block BOOL saved = NO;
+    [[STRCaptureLockTable sharedTable] writeCaptureWithToken:token usingBlock:^{
+        NSData * currentData = [NSData dataWithContentsOfFile:infoPath];
+        NSMutableDictionary * currentInfo = (currentData) ? [NSJSONSerialization JSONObjectWithData:currentData options:NSJSONReadingMutableContainers error:nil] : nil;
+        if (![currentInfo isKindOfClass:[NSMutableDictionary class]] || [STRTrackSummary summaryFromDictionary:[currentInfo objectForKey:kSTRTrackSummaryKey]]) return;
+        [currentInfo setObject:[summary dictionaryRepresentation] forKey:kSTRTrackSummaryKey];
+        NSError * error;
+        NSData * infoData = [NSJSONSerialization dataWithJSONObject:currentInfo options:0 error:&error];
+        if (!infoData || ![infoData writeToFile:infoPath options:NSDataWritingAtomic error:&error]) {
+            STRLogError(STRLogCategoryStorage, @"STRTrackSummary: Could not save the track summary of capture %@: %@", token, error);
+            return;
+        }
+        saved = YES;
+    }];
+    if (!saved) return NO;
+    [[STRCaptureChangeFeed sharedFeed] recordChangeOfType:STRCaptureChangeUpdated token:token fields:[NSSet setWithObject:STRCaptureFieldTrackSummary]];
+    return YES;
+}
+
+@end
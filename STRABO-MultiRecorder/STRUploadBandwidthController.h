@@ -0,0 +1,160 @@
+//
+//  STRUploadBandwidthController.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class STRUploadRequestMeter;
+
+/**
+ Decides how fast capture uploads are allowed to send data.
+
+ A STRCaptureUploadManager does not hand its whole request body to the connection at once. Instead, it feeds the body to the connection in chunks, and before each chunk it asks the shared bandwidth controller how many bytes it may send right now. This lets uploads share a field link with other traffic, like live telemetry, instead of saturating it.
+
+ Rate Limiting
+ -------------
+
+ The controller enforces maxBytesPerSecond with a token bucket that holds at most one second worth of bytes. A value of 0 means that uploads are not rate limited.
+
+ Adaptive Chunk Sizing
+ ---------------------
+
+ The size of each chunk follows the throughput and round-trip time that the controller measures from the progress reported by the connections. Each request reports its progress through its own STRUploadRequestMeter, so uploads that run at the same time keep their offsets apart while they share the rate limit and the estimates. On a fast link, chunks grow so that the connection always has data queued. On a slow or congested link, they shrink so that little data sits in buffers ahead of the socket. Chunks never leave the range defined by minimumChunkSize and maximumChunkSize.
+
+ Pausing Uploads
+ ---------------
+
+ Call pause when the device is busy, for example while it is recording, and resume when it is done. While paused, uploads keep their connection but stop sending body data. If `Pause_Uploads_While_Recording` is set in `STRSettings.plist`, the shared controller does this automatically when it receives STRCaptureRecordingDidBeginNotification and STRCaptureRecordingDidEndNotification. The controller follows STRSettingsDidChangeNotification for this setting too: turning it off in the middle of a recording resumes uploads, turning it on pauses them for the recording in progress, and a recording that is already running when the controller is created is paused for as well. Recordings made in segments are not paused for, because their segments are uploaded while they are recorded; the rate limit still applies to them. A call to pause stands until resume is called, whatever recordings begin or end and however the setting changes.
+
+ @warning A connection that is paused for longer than its request timeout may fail. The upload manager reports this to its delegate like any other failed upload.
+ */
+@interface STRUploadBandwidthController : NSObject
+
+/**
+ The maximum number of body bytes that all uploads together may send per second. Pass 0 for no limit.
+
+ The default value is read from the `Upload_Max_Bytes_Per_Second` setting.
+ */
+@property(nonatomic, assign)NSUInteger maxBytesPerSecond;
+
+/**
+ The smallest chunk that is handed to a connection at a time, in bytes.
+ */
+@property(nonatomic, assign)NSUInteger minimumChunkSize;
+
+/**
+ The largest chunk that is handed to a connection at a time, in bytes.
+
+ This is also the size of the buffer that sits between the upload manager and the connection.
+ */
+@property(nonatomic, assign)NSUInteger maximumChunkSize;
+
+/**
+ YES while uploads are paused.
+ */
+@property(nonatomic, readonly, getter = isPaused)BOOL paused;
+
+/**
+ The current estimate of upload throughput, in bytes per second. Zero until the first progress report arrives.
+ */
+@property(nonatomic, readonly)double measuredThroughput;
+
+/**
+ The current estimate of the round-trip time of the upload link, in seconds. Zero until the first progress report arrives.
+ */
+@property(nonatomic, readonly)NSTimeInterval measuredRoundTripTime;
+
+///---------------------------------------------------------------------------------------
+/// @name Class Methods
+///---------------------------------------------------------------------------------------
+
+/**
+ The controller shared by all upload managers.
+
+ @return STRUploadBandwidthController The shared bandwidth controller.
+ */
++(STRUploadBandwidthController *)sharedController;
+
+///---------------------------------------------------------------------------------------
+/// @name Pausing and Resuming
+///---------------------------------------------------------------------------------------
+
+/**
+ Stops all uploads from sending body data until resume is called.
+ */
+-(void)pause;
+
+/**
+ Lets uploads continue sending body data after a call to pause.
+ */
+-(void)resume;
+
+///---------------------------------------------------------------------------------------
+/// @name Metering Uploads
+///---------------------------------------------------------------------------------------
+
+/**
+ Returns the number of body bytes that an upload may write right now.
+
+ The value is the adaptive chunk size, reduced to what the rate limit currently allows. It is 0 while uploads are paused or while the rate limit has been used up.
+
+ @return NSUInteger The number of bytes that may be written.
+ */
+-(NSUInteger)bytesAllowedNow;
+
+/**
+ Returns a meter for a request that is starting. Call this each time a request body is opened, including when the connection asks for the body again.
+
+ The throughput and round-trip time estimates are kept, since the next request most likely uses the same link.
+
+ @return STRUploadRequestMeter The meter that the request reports its progress to.
+ */
+-(STRUploadRequestMeter *)beginRequest;
+
+/**
+ The number of seconds until bytesAllowedNow is expected to return a non-zero value.
+
+ @return NSTimeInterval The delay in seconds. Returns 0 if bytes may be written right now.
+ */
+-(NSTimeInterval)delayUntilBytesAllowed;
+
+@end
+
+
+/**
+ The progress of one upload request, as seen by its STRUploadBandwidthController.
+
+ The meter remembers when each part of the body was handed to the connection and how much the connection has reported as sent. From these it takes throughput and round-trip time samples and folds them into the estimates of its controller. Bytes that are written also come out of the rate limit of the controller.
+
+ A meter belongs to one request and is used on one thread; get a new one from beginRequest for every request.
+ */
+@interface STRUploadRequestMeter : NSObject
+
+/**
+ The controller that the samples of this meter go to.
+ */
+@property(readonly)STRUploadBandwidthController * controller;
+
+/**
+ Records that the request handed bytes to its connection.
+
+ @param bytes The number of bytes written.
+
+ @param offset The offset of the end of the written bytes within the request body.
+ */
+-(void)didWriteBytes:(NSUInteger)bytes endingAtOffset:(NSUInteger)offset;
+
+/**
+ Records that the connection reported sending body data.
+
+ Call this method from connection:didSendBodyData:totalBytesWritten:totalBytesExpectedToWrite:.
+
+ @param totalBytesSent The total number of body bytes that the connection has sent for this request.
+ */
+-(void)didConfirmBytesSent:(NSUInteger)totalBytesSent;
+
+@end
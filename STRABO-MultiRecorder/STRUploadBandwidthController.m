@@ -0,0 +1,343 @@
+//
+//  STRUploadBandwidthController.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <QuartzCore/QuartzCore.h>
+
+#import "STRUploadBandwidthController.h"
+#import "STRCaptureDataCollector.h"
+#import "STRSettings.h"
+
+// Default chunk sizes in bytes
+#define kSTRDefaultMinimumChunkSize 4096
+#define kSTRDefaultMaximumChunkSize 65536
+#define kSTRInitialChunkSize 16384
+
+// Smoothing factors for the running estimates. The round-trip time uses the
+// same gain as TCP's smoothed RTT.
+#define kSTRThroughputGain 0.25
+#define kSTRRoundTripTimeGain 0.125
+
+// The shortest round-trip time used when sizing chunks. Keeps chunks from
+// collapsing to the minimum on very fast local links.
+#define kSTRMinimumRoundTripTime 0.1
+
+// How often to check back while uploads are paused
+#define kSTRPausedPollInterval 0.25
+
+// Number of outstanding writes remembered for round-trip time measurement
+#define kSTRWriteMarkCount 64
+
+typedef struct {
+    NSUInteger offset;
+    CFTimeInterval time;
+} STRWriteMark;
+
+@interface STRUploadBandwidthController () {
+    BOOL _paused;
+    // YES while the pause is for a recording rather than a call to pause
+    BOOL _pausedForRecording;
+    double _measuredThroughput;
+    NSTimeInterval _measuredRoundTripTime;
+
+    // Token bucket
+    double _availableBytes;
+    CFTimeInterval _lastRefillTime;
+}
+
+@end
+
+@interface STRUploadRequestMeter () {
+    // Progress tracking for this request only
+    NSUInteger _lastConfirmedBytes;
+    CFTimeInterval _lastConfirmationTime;
+    STRWriteMark _writeMarks[kSTRWriteMarkCount];
+    NSUInteger _writeMarkHead;
+    NSUInteger _writeMarkCount;
+}
+
+-(id)initWithController:(STRUploadBandwidthController *)controller;
+
+@end
+
+@interface STRUploadBandwidthController (InternalMethods)
+
+-(void)refillAvailableBytes;
+-(NSUInteger)adaptiveChunkSize;
+-(NSUInteger)minimumWriteSize;
+
+// Request Meters
+-(void)consumeBytes:(NSUInteger)bytes;
+-(void)addThroughputSample:(double)sample;
+-(void)addRoundTripTimeSample:(NSTimeInterval)sample;
+
+// Notification Handling
+-(void)recordingDidBegin:(NSNotification *)notification;
+-(void)recordingDidEnd:(NSNotification *)notification;
+-(void)pauseForRecording;
+-(void)resumeFromRecording;
+-(void)settingsDidChange:(NSNotification *)notification;
+
+@end
+
+@implementation STRUploadBandwidthController
+
+@synthesize maxBytesPerSecond = _maxBytesPerSecond;
+@synthesize minimumChunkSize = _minimumChunkSize;
+@synthesize maximumChunkSize = _maximumChunkSize;
+@synthesize paused = _paused;
+@synthesize measuredThroughput = _measuredThroughput;
+@synthesize measuredRoundTripTime = _measuredRoundTripTime;
+
+#pragma mark - Class Methods
+
++(STRUploadBandwidthController *)sharedController {
+    static STRUploadBandwidthController * sharedController = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedController = [[STRUploadBandwidthController alloc] init];
+
+        STRSettings * settings = [STRSettings sharedSettings];
+        sharedController.maxBytesPerSecond = [settings uploadMaxBytesPerSecond];
+        NSNotificationCenter * center = [NSNotificationCenter defaultCenter];
+        [center addObserver:sharedController selector:@selector(settingsDidChange:) name:STRSettingsDidChangeNotification object:nil];
+
+        // Step aside while the device is recording if the settings ask for it. The
+        // setting is checked as each recording begins and again whenever it changes
+        [center addObserver:sharedController selector:@selector(recordingDidBegin:) name:STRCaptureRecordingDidBeginNotification object:nil];
+        [center addObserver:sharedController selector:@selector(recordingDidEnd:) name:STRCaptureRecordingDidEndNotification object:nil];
+        // A recording that began before anyone asked for the controller has already posted its notification
+        if ([settings pauseUploadsWhileRecording] && [STRCaptureDataCollector isRecordingUnsegmentedVideo]) {
+            [sharedController pauseForRecording];
+        }
+    });
+    return sharedController;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _minimumChunkSize = kSTRDefaultMinimumChunkSize;
+        _maximumChunkSize = kSTRDefaultMaximumChunkSize;
+        _lastRefillTime = CACurrentMediaTime();
+    }
+    return self;
+}
+
+-(void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+#pragma mark - Pausing and Resuming
+
+-(void)pause {
+    @synchronized(self) {
+        _paused = YES;
+        // A pause asked for directly is not undone when the recording ends
+        _pausedForRecording = NO;
+    }
+}
+
+-(void)resume {
+    @synchronized(self) {
+        _paused = NO;
+        _pausedForRecording = NO;
+        // Do not let the pause turn into a burst
+        _lastRefillTime = CACurrentMediaTime();
+    }
+}
+
+#pragma mark - Metering Uploads
+
+-(void)setMaxBytesPerSecond:(NSUInteger)maxBytesPerSecond {
+    @synchronized(self) {
+        _maxBytesPerSecond = maxBytesPerSecond;
+        _availableBytes = MIN(_availableBytes, (double)maxBytesPerSecond);
+    }
+}
+
+-(NSUInteger)bytesAllowedNow {
+    @synchronized(self) {
+        if (_paused) return 0;
+
+        NSUInteger chunkSize = [self adaptiveChunkSize];
+        if (_maxBytesPerSecond == 0) return chunkSize;
+
+        [self refillAvailableBytes];
+        NSUInteger allowed = MIN(chunkSize, (NSUInteger)_availableBytes);
+        // Wait for the bucket to fill a little instead of dribbling tiny writes
+        return (allowed < [self minimumWriteSize]) ? 0 : allowed;
+    }
+}
+
+-(NSTimeInterval)delayUntilBytesAllowed {
+    @synchronized(self) {
+        if (_paused) return kSTRPausedPollInterval;
+        if (_maxBytesPerSecond == 0) return 0;
+
+        [self refillAvailableBytes];
+        double missingBytes = (double)[self minimumWriteSize] - _availableBytes;
+        if (missingBytes <= 0) return 0;
+        return missingBytes / (double)_maxBytesPerSecond;
+    }
+}
+
+-(STRUploadRequestMeter *)beginRequest {
+    return [[STRUploadRequestMeter alloc] initWithController:self];
+}
+
+@end
+
+@implementation STRUploadBandwidthController (InternalMethods)
+
+-(void)refillAvailableBytes {
+    CFTimeInterval now = CACurrentMediaTime();
+    double capacity = (double)_maxBytesPerSecond;
+    _availableBytes = MIN(capacity, _availableBytes + (now - _lastRefillTime) * capacity);
+    _lastRefillTime = now;
+}
+
+-(NSUInteger)adaptiveChunkSize {
+    if (_measuredThroughput == 0) {
+        return MAX(_minimumChunkSize, MIN(_maximumChunkSize, (NSUInteger)kSTRInitialChunkSize));
+    }
+
+    // Keep about one bandwidth-delay product queued for the connection
+    double throughput = _measuredThroughput;
+    if (_maxBytesPerSecond > 0) throughput = MIN(throughput, (double)_maxBytesPerSecond);
+    NSTimeInterval roundTripTime = MAX(_measuredRoundTripTime, kSTRMinimumRoundTripTime);
+    NSUInteger chunkSize = (NSUInteger)(throughput * roundTripTime);
+
+    return MAX(_minimumChunkSize, MIN(_maximumChunkSize, chunkSize));
+}
+
+-(NSUInteger)minimumWriteSize {
+    // A rate limit below the minimum chunk size would otherwise never allow a write
+    return MIN(_minimumChunkSize, _maxBytesPerSecond);
+}
+
+#pragma mark - Request Meters
+
+-(void)consumeBytes:(NSUInteger)bytes {
+    @synchronized(self) {
+        if (_maxBytesPerSecond > 0) {
+            _availableBytes -= bytes;
+        }
+    }
+}
+
+-(void)addThroughputSample:(double)sample {
+    @synchronized(self) {
+        _measuredThroughput = (_measuredThroughput == 0) ? sample : _measuredThroughput + kSTRThroughputGain * (sample - _measuredThroughput);
+    }
+}
+
+-(void)addRoundTripTimeSample:(NSTimeInterval)sample {
+    @synchronized(self) {
+        _measuredRoundTripTime = (_measuredRoundTripTime == 0) ? sample : _measuredRoundTripTime + kSTRRoundTripTimeGain * (sample - _measuredRoundTripTime);
+    }
+}
+
+#pragma mark - Notification Handling
+
+-(void)recordingDidBegin:(NSNotification *)notification {
+    if (![[STRSettings sharedSettings] pauseUploadsWhileRecording]) return;
+    // A recording in segments is uploaded while it is recorded
+    if ([[notification.userInfo objectForKey:STRCaptureRecordingSegmentedKey] boolValue]) return;
+    [self pauseForRecording];
+}
+
+-(void)recordingDidEnd:(NSNotification *)notification {
+    [self resumeFromRecording];
+}
+
+-(void)pauseForRecording {
+    @synchronized(self) {
+        _paused = YES;
+        _pausedForRecording = YES;
+    }
+}
+
+-(void)resumeFromRecording {
+    @synchronized(self) {
+        if (!_pausedForRecording) return;
+        [self resume];
+    }
+}
+
+-(void)settingsDidChange:(NSNotification *)notification {
+    NSSet * changedKeys = [notification.userInfo objectForKey:STRSettingsChangedKeysKey];
+    STRSettings * settings = notification.object;
+    // The rate limit can change in the middle of an upload; the bucket follows it at once
+    if ([changedKeys containsObject:@"Upload_Max_Bytes_Per_Second"]) {
+        self.maxBytesPerSecond = [settings uploadMaxBytesPerSecond];
+    }
+    if ([changedKeys containsObject:@"Pause_Uploads_While_Recording"]) {
+        // Only a pause for a recording is undone; a call to pause stands until resume
+        if (![settings pauseUploadsWhileRecording]) {
+            [self resumeFromRecording];
+        } else if (!self.isPaused && [STRCaptureDataCollector isRecordingUnsegmentedVideo]) {
+            [self pauseForRecording];
+        }
+    }
+}
+
+@end
+
+
+@implementation STRUploadRequestMeter
+
+@synthesize controller = _controller;
+
+-(id)initWithController:(STRUploadBandwidthController *)controller {
+    self = [super init];
+    if (self) {
+        _controller = controller;
+    }
+    return self;
+}
+
+-(void)didWriteBytes:(NSUInteger)bytes endingAtOffset:(NSUInteger)offset {
+    [_controller consumeBytes:bytes];
+
+    // Remember when this offset was handed over so that we can time
+    // how long it takes the connection to report it as sent.
+    if (_writeMarkCount == kSTRWriteMarkCount) {
+        // Drop the oldest mark
+        _writeMarkHead = (_writeMarkHead + 1) % kSTRWriteMarkCount;
+        _writeMarkCount--;
+    }
+    NSUInteger index = (_writeMarkHead + _writeMarkCount) % kSTRWriteMarkCount;
+    _writeMarks[index].offset = offset;
+    _writeMarks[index].time = CACurrentMediaTime();
+    _writeMarkCount++;
+}
+
+-(void)didConfirmBytesSent:(NSUInteger)totalBytesSent {
+    CFTimeInterval now = CACurrentMediaTime();
+
+    // Throughput from the bytes confirmed since the last report
+    if (_lastConfirmationTime > 0 && totalBytesSent > _lastConfirmedBytes && now > _lastConfirmationTime) {
+        [_controller addThroughputSample:(double)(totalBytesSent - _lastConfirmedBytes) / (now - _lastConfirmationTime)];
+    }
+    _lastConfirmedBytes = totalBytesSent;
+    _lastConfirmationTime = now;
+
+    // Round-trip time from the newest write that this report covers
+    CFTimeInterval writeTime = 0;
+    while (_writeMarkCount > 0 && _writeMarks[_writeMarkHead].offset <= totalBytesSent) {
+        writeTime = _writeMarks[_writeMarkHead].time;
+        _writeMarkHead = (_writeMarkHead + 1) % kSTRWriteMarkCount;
+        _writeMarkCount--;
+    }
+    if (writeTime > 0) {
+        [_controller addRoundTripTimeSample:now - writeTime];
+    }
+}
+
+@end
@@ -0,0 +1,110 @@
+//
+//  STRUploadMetrics.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ STRUploadErrorClass
+
+ Describes how an upload ended. See the [ConstantsReference] guide for more information.
+ */
+typedef enum {
+    STRUploadErrorClassNone,        // The server accepted the upload
+    STRUploadErrorClassRequest,     // The request could not be built, for example because files were missing
+    STRUploadErrorClassNetwork,     // The connection failed
+    STRUploadErrorClassServer,      // The server answered with an error
+    STRUploadErrorClassResponse,    // The server answered with a response that could not be read
+    STRUploadErrorClassCancelled    // The upload was cancelled
+} STRUploadErrorClass;
+
+/**
+ Timing and size measurements for a single capture upload.
+
+ A STRCaptureUploadManager fills in one of these objects for every upload that it attempts and hands it to the [STRUploadMetricsRecorder] when the upload ends. All durations are in seconds and are measured from the moment the connection was started, except for requestBuildDuration and responseLatency. A duration is negative if the upload ended before reaching that point.
+
+ @warning NSURLConnection does not report when its socket connects. connectDuration is measured up to the moment the connection first reads body data, which is after the connection has been established and the request headers have been written.
+ */
+@interface STRUploadMetrics : NSObject
+
+/**
+ The token of the uploaded capture. For a batch upload, the token of the first capture in the batch.
+ */
+@property(nonatomic, copy)NSString * token;
+
+/**
+ The number of captures sent in the request. 1 unless the request was a batch.
+ */
+@property(nonatomic, assign)NSUInteger captureCount;
+
+/**
+ The wall-clock date when the upload was requested.
+ */
+@property(nonatomic, strong)NSDate * startDate;
+
+/**
+ Time spent building the POST request.
+ */
+@property(nonatomic, assign)NSTimeInterval requestBuildDuration;
+
+/**
+ Time until the connection first read body data.
+ */
+@property(nonatomic, assign)NSTimeInterval connectDuration;
+
+/**
+ Time until the connection reported sending the first body bytes.
+ */
+@property(nonatomic, assign)NSTimeInterval firstBodyByteDuration;
+
+/**
+ Time until the connection reported sending the whole body.
+ */
+@property(nonatomic, assign)NSTimeInterval sendDuration;
+
+/**
+ Time from the end of the body until the server's response arrived.
+ */
+@property(nonatomic, assign)NSTimeInterval responseLatency;
+
+/**
+ Time until the upload ended, successfully or not.
+ */
+@property(nonatomic, assign)NSTimeInterval totalDuration;
+
+/**
+ The number of body bytes that the connection reported as sent.
+ */
+@property(nonatomic, assign)unsigned long long bytesSent;
+
+/**
+ The number of times the connection asked for the body again within this upload, for example after a redirect or an authentication challenge.
+
+ A failed upload that STRUploadOutbox tries again is a new upload with metrics of its own, so this does not count those attempts.
+ */
+@property(nonatomic, assign)NSUInteger bodyResends;
+
+/**
+ How the upload ended.
+ */
+@property(nonatomic, assign)STRUploadErrorClass errorClass;
+
+/**
+ Body throughput in bytes per second, or 0 if the body was never completely sent.
+
+ @return double The number of body bytes sent per second of sendDuration.
+ */
+-(double)throughput;
+
+/**
+ A dictionary representation of the metrics that can be written to JSON.
+
+ @return NSDictionary The metrics with snake_case keys.
+ */
+-(NSDictionary *)dictionaryRepresentation;
+
+@end
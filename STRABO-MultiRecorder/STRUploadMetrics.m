@@ -0,0 +1,72 @@
+//
+//  STRUploadMetrics.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadMetrics.h"
+
+@interface STRUploadMetrics (InternalMethods)
++(NSString *)nameForErrorClass:(STRUploadErrorClass)errorClass;
+@end
+
+@implementation STRUploadMetrics
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _captureCount = 1;
+        // Mark every stage as not reached
+        _requestBuildDuration = -1;
+        _connectDuration = -1;
+        _firstBodyByteDuration = -1;
+        _sendDuration = -1;
+        _responseLatency = -1;
+        _totalDuration = -1;
+    }
+    return self;
+}
+
+-(double)throughput {
+    if (_sendDuration <= 0) return 0;
+    return (double)_bytesSent / _sendDuration;
+}
+
+-(NSDictionary *)dictionaryRepresentation {
+    return @{
+    @"token" : (_token) ? _token : @"",
+    @"capture_count" : @(_captureCount),
+    @"started_at" : @([_startDate timeIntervalSince1970]),
+    @"request_build_duration" : @(_requestBuildDuration),
+    @"connect_duration" : @(_connectDuration),
+    @"first_body_byte_duration" : @(_firstBodyByteDuration),
+    @"send_duration" : @(_sendDuration),
+    @"response_latency" : @(_responseLatency),
+    @"total_duration" : @(_totalDuration),
+    @"bytes_sent" : @(_bytesSent),
+    @"body_resends" : @(_bodyResends),
+    @"error_class" : [STRUploadMetrics nameForErrorClass:_errorClass],
+    @"throughput" : @([self throughput])
+    };
+}
+
+@end
+
+@implementation STRUploadMetrics (InternalMethods)
+
++(NSString *)nameForErrorClass:(STRUploadErrorClass)errorClass {
+    switch (errorClass) {
+        case STRUploadErrorClassNone: return @"none";
+        case STRUploadErrorClassRequest: return @"request";
+        case STRUploadErrorClassNetwork: return @"network";
+        case STRUploadErrorClassServer: return @"server";
+        case STRUploadErrorClassResponse: return @"response";
+        case STRUploadErrorClassCancelled: return @"cancelled";
+    }
+    return @"unknown";
+}
+
+@end
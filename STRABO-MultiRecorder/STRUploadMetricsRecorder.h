@@ -0,0 +1,88 @@
+//
+//  STRUploadMetricsRecorder.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "STRUploadMetrics.h"
+
+/**
+ Collects the [STRUploadMetrics] of recent uploads and summarizes them.
+
+ Every STRCaptureUploadManager reports to the shared recorder. The recorder keeps the metrics of the most recent uploads in a rolling window whose size is read from the `Upload_Metrics_Window` setting. Use summary to get percentiles and throughput over that window, or exportToFileAtPath:error: to write the window and its summary to a JSON file that can be collected from devices.
+
+ Recording happens on a private serial queue, so reporting an upload costs the upload path no more than handing over an object.
+ */
+@interface STRUploadMetricsRecorder : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Class Methods
+///---------------------------------------------------------------------------------------
+
+/**
+ The recorder shared by all upload managers.
+
+ @return STRUploadMetricsRecorder The shared recorder.
+ */
++(STRUploadMetricsRecorder *)sharedRecorder;
+
+///---------------------------------------------------------------------------------------
+/// @name Recording Metrics
+///---------------------------------------------------------------------------------------
+
+/**
+ Adds the metrics of a finished upload to the rolling window.
+
+ The oldest metrics are dropped once the window is full.
+
+ @param metrics The metrics of the finished upload. The object must not be changed afterwards.
+ */
+-(void)recordMetrics:(STRUploadMetrics *)metrics;
+
+/**
+ Drops all recorded metrics.
+ */
+-(void)reset;
+
+///---------------------------------------------------------------------------------------
+/// @name Reading Metrics
+///---------------------------------------------------------------------------------------
+
+/**
+ The metrics in the rolling window.
+
+ @return NSArray An array of STRUploadMetrics objects, oldest first.
+ */
+-(NSArray *)recentMetrics;
+
+/**
+ Aggregates over the rolling window.
+
+ The returned dictionary has the following keys:
+
+ - `count`, `succeeded` and `failed`: the number of uploads.
+ - `errors`: a dictionary mapping error class names to counts.
+ - `bytes_sent` and `body_resends`: totals over the window.
+ - `throughput`: the total bytes divided by the total send time of completed bodies, in bytes per second.
+ - `request_build_duration`, `connect_duration`, `first_body_byte_duration`, `send_duration`, `response_latency` and `total_duration`: dictionaries with the keys `p50`, `p90`, `p99`, `min` and `max`, in seconds. Uploads that did not reach a stage are left out of that stage's percentiles.
+
+ @return NSDictionary The summary. It can be written to JSON.
+ */
+-(NSDictionary *)summary;
+
+/**
+ Writes the summary and the metrics in the rolling window to a JSON file.
+
+ @param path The path of the file to write. An existing file is replaced.
+
+ @param error On return, the error that occurred, if any. You may pass NULL.
+
+ @return BOOL YES if the file was written.
+ */
+-(BOOL)exportToFileAtPath:(NSString *)path error:(NSError **)error;
+
+@end
@@ -0,0 +1,179 @@
+//
+//  STRUploadMetricsRecorder.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadMetricsRecorder.h"
+#import "STRSettings.h"
+
+// Window size used when the settings do not provide one
+#define kSTRDefaultMetricsWindow 500
+
+@interface STRUploadMetricsRecorder () {
+    NSMutableArray * _metrics;
+    NSUInteger _windowSize;
+    dispatch_queue_t _queue;
+}
+
+@end
+
+@interface STRUploadMetricsRecorder (InternalMethods)
+
+-(NSDictionary *)summaryOfMetrics:(NSArray *)metrics;
++(NSDictionary *)percentilesOfValues:(NSMutableArray *)values;
+
+@end
+
+@implementation STRUploadMetricsRecorder
+
+#pragma mark - Class Methods
+
++(STRUploadMetricsRecorder *)sharedRecorder {
+    static STRUploadMetricsRecorder * sharedRecorder = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedRecorder = [[STRUploadMetricsRecorder alloc] init];
+    });
+    return sharedRecorder;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        NSUInteger windowSize = [[STRSettings sharedSettings] uploadMetricsWindow];
+        _windowSize = (windowSize > 0) ? windowSize : kSTRDefaultMetricsWindow;
+        _metrics = [[NSMutableArray alloc] initWithCapacity:_windowSize];
+        _queue = dispatch_queue_create("com.strabogis.uploadmetrics", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+#pragma mark - Recording Metrics
+
+-(void)recordMetrics:(STRUploadMetrics *)metrics {
+    if (!metrics) return;
+    dispatch_async(_queue, ^{
+        if (_metrics.count == _windowSize) {
+            [_metrics removeObjectAtIndex:0];
+        }
+        [_metrics addObject:metrics];
+    });
+}
+
+-(void)reset {
+    dispatch_async(_queue, ^{
+        [_metrics removeAllObjects];
+    });
+}
+
+#pragma mark - Reading Metrics
+
+-(NSArray *)recentMetrics {
+    __block NSArray * metrics;
+    dispatch_sync(_queue, ^{
+        metrics = [_metrics copy];
+    });
+    return metrics;
+}
+
+-(NSDictionary *)summary {
+    return [self summaryOfMetrics:[self recentMetrics]];
+}
+
+-(BOOL)exportToFileAtPath:(NSString *)path error:(NSError **)error {
+    NSArray * metrics = [self recentMetrics];
+    NSMutableArray * records = [NSMutableArray arrayWithCapacity:metrics.count];
+    for (STRUploadMetrics * uploadMetrics in metrics) {
+        [records addObject:[uploadMetrics dictionaryRepresentation]];
+    }
+    NSDictionary * export = @{
+    @"exported_at" : @([[NSDate date] timeIntervalSince1970]),
+    @"summary" : [self summaryOfMetrics:metrics],
+    @"uploads" : records
+    };
+
+    NSData * data = [NSJSONSerialization dataWithJSONObject:export options:NSJSONWritingPrettyPrinted error:error];
+    if (!data) return NO;
+    return [data writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+@end
+
+@implementation STRUploadMetricsRecorder (InternalMethods)
+
+-(NSDictionary *)summaryOfMetrics:(NSArray *)metrics {
+    NSUInteger succeeded = 0;
+    unsigned long long totalBytes = 0;
+    unsigned long long completedBytes = 0;
+    NSTimeInterval completedSendTime = 0;
+    NSUInteger bodyResends = 0;
+    NSUInteger captures = 0;
+    NSMutableDictionary * errors = [NSMutableDictionary dictionary];
+
+    NSArray * stages = @[ @"request_build_duration", @"connect_duration", @"first_body_byte_duration", @"send_duration", @"response_latency", @"total_duration" ];
+    NSMutableDictionary * stageValues = [NSMutableDictionary dictionaryWithCapacity:stages.count];
+    for (NSString * stage in stages) {
+        [stageValues setObject:[NSMutableArray arrayWithCapacity:metrics.count] forKey:stage];
+    }
+
+    for (STRUploadMetrics * uploadMetrics in metrics) {
+        NSDictionary * record = [uploadMetrics dictionaryRepresentation];
+        for (NSString * stage in stages) {
+            NSNumber * value = [record objectForKey:stage];
+            if (value.doubleValue >= 0) [[stageValues objectForKey:stage] addObject:value];
+        }
+
+        if (uploadMetrics.errorClass == STRUploadErrorClassNone) {
+            succeeded++;
+        } else {
+            NSString * name = [record objectForKey:@"error_class"];
+            [errors setObject:@([[errors objectForKey:name] unsignedIntegerValue] + 1) forKey:name];
+        }
+        totalBytes += uploadMetrics.bytesSent;
+        bodyResends += uploadMetrics.bodyResends;
+        captures += uploadMetrics.captureCount;
+        if (uploadMetrics.sendDuration > 0) {
+            completedBytes += uploadMetrics.bytesSent;
+            completedSendTime += uploadMetrics.sendDuration;
+        }
+    }
+
+    NSMutableDictionary * summary = [NSMutableDictionary dictionary];
+    [summary setObject:@(metrics.count) forKey:@"count"];
+    [summary setObject:@(succeeded) forKey:@"succeeded"];
+    [summary setObject:@(metrics.count - succeeded) forKey:@"failed"];
+    [summary setObject:errors forKey:@"errors"];
+    [summary setObject:@(totalBytes) forKey:@"bytes_sent"];
+    [summary setObject:@(bodyResends) forKey:@"body_resends"];
+    [summary setObject:@(captures) forKey:@"captures"];
+    [summary setObject:@((completedSendTime > 0) ? (double)completedBytes / completedSendTime : 0) forKey:@"throughput"];
+    for (NSString * stage in stages) {
+        [summary setObject:[STRUploadMetricsRecorder percentilesOfValues:[stageValues objectForKey:stage]] forKey:stage];
+    }
+    return summary;
+}
+
++(NSDictionary *)percentilesOfValues:(NSMutableArray *)values {
+    if (values.count == 0) return @{};
+    [values sortUsingSelector:@selector(compare:)];
+
+    // Nearest-rank percentiles
+    NSUInteger count = values.count;
+    NSNumber * (^percentile)(double) = ^NSNumber *(double p) {
+        NSUInteger rank = (NSUInteger)ceil(p * count);
+        return [values objectAtIndex:(rank > 0) ? rank - 1 : 0];
+    };
+    return @{
+    @"p50" : percentile(0.50),
+    @"p90" : percentile(0.90),
+    @"p99" : percentile(0.99),
+    @"min" : [values objectAtIndex:0],
+    @"max" : [values lastObject]
+    };
+}
+
+@end
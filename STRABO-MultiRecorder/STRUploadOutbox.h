@@ -0,0 +1,261 @@
+//
+//  STRUploadOutbox.h
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "STRCapture.h"
+
+/**
+ Implement the STRUploadOutboxDelegate to hear what becomes of the captures in a [STRUploadOutbox].
+
+ All of the methods in this protocol are optional. They are called on the main thread.
+ */
+@protocol STRUploadOutboxDelegate
+
+@optional
+
+/**
+ Reports that a queued capture was uploaded and has left the outbox.
+
+ The capture has been marked as uploaded with [markUploadedAtDate:]([STRCapture markUploadedAtDate:]) by the time this method is called.
+
+ @param token The token of the capture.
+ */
+-(void)outboxDidUploadCaptureWithToken:(NSString *)token;
+
+/**
+ Reports that an attempt to upload a queued capture failed and that the capture will be tried again.
+
+ @param token The token of the capture.
+
+ @param delay The number of seconds until the next attempt.
+
+ @param error The error that ended the attempt. Nil if the error is unknown.
+ */
+-(void)outboxWillRetryCaptureWithToken:(NSString *)token afterDelay:(NSTimeInterval)delay error:(NSError *)error;
+
+/**
+ Reports that the outbox gave up on a capture and removed it.
+
+ This happens when an error would recur however often the upload is tried, such as the server rejecting the capture, or when maximumAttempts attempts have failed.
+
+ @param token The token of the capture.
+
+ @param error The error that ended the last attempt. Nil if the capture could not be read or is damaged.
+ */
+-(void)outboxDidGiveUpOnCaptureWithToken:(NSString *)token error:(NSError *)error;
+
+@end
+
+/**
+ A persistent queue of captures waiting to be uploaded.
+
+ Captures added to the outbox are written to a small file at once, so they stay queued if the upload fails, the app is stopped, or the device restarts. While the outbox is running, it uploads the queued captures one at a time with a STRCaptureUploadManager.
+
+ When an attempt fails, the outbox decides whether the error is worth retrying; see isRetryableError:. Retryable failures are tried again after a delay that doubles with each failure, up to maximumRetryDelay. Half of each delay is random, so that devices that lost their connection at the same moment do not all retry at the same moment. A capture is given up on after maximumAttempts failures, or at once if its error is permanent.
+
+ A capture that is uploaded is marked with [markUploadedAtDate:]([STRCapture markUploadedAtDate:]) and removed from the outbox. Captures that have already been uploaded are not queued again.
+
+ Use an outbox from the main thread. Start the shared outbox when your app launches, so that captures left over from an earlier run are sent:
+
+    STRUploadOutbox * outbox = [STRUploadOutbox sharedOutbox];
+    outbox.delegate = self;
+    [outbox start];
+ */
+@interface STRUploadOutbox : NSObject
+
+///---------------------------------------------------------------------------------------
+/// @name Creating an Outbox
+///---------------------------------------------------------------------------------------
+
+/**
+ The outbox that the app uses, kept in `Library/Application Support/StraboUploadOutbox.json`.
+
+ @return STRUploadOutbox The shared outbox.
+ */
++(STRUploadOutbox *)sharedOutbox;
+
+/**
+ Returns an outbox kept in the file at the specified path.
+
+ Captures queued in the file by an earlier outbox are loaded, with their attempts and retry dates. Only one outbox should use a file at a time.
+
+ @param path The path of the outbox file. It is created when the first capture is queued.
+
+ @return id The new outbox.
+ */
+-(id)initWithPath:(NSString *)path;
+
+/**
+ The path of the outbox file.
+ */
+@property(readonly)NSString * path;
+
+/**
+ The delegate of the outbox. Must implement [STRUploadOutboxDelegate].
+ */
+@property(weak)id delegate;
+
+/**
+ The URL that captures are posted to. Nil uses the default of STRCaptureUploadManager.
+ */
+@property(strong)NSURL * uploadURL;
+
+///---------------------------------------------------------------------------------------
+/// @name Retry Policy
+///---------------------------------------------------------------------------------------
+
+/**
+ The average number of seconds before the first retry of a capture. Defaults to the `Upload_Retry_Base_Delay` setting.
+ */
+@property(assign)NSTimeInterval baseRetryDelay;
+
+/**
+ The longest number of seconds between two attempts to upload a capture. Defaults to the `Upload_Retry_Max_Delay` setting.
+ */
+@property(assign)NSTimeInterval maximumRetryDelay;
+
+/**
+ The number of attempts after which a capture is given up on. Defaults to the `Upload_Max_Attempts` setting.
+ */
+@property(assign)NSUInteger maximumAttempts;
+
+/**
+ The number of seconds to wait after a capture has failed a number of times.
+
+ The delay is baseRetryDelay doubled for every failure after the first, capped at maximumRetryDelay. The result is then halved and a random amount of up to the same half is added, so the delay falls between half and all of the capped value.
+
+ @param attempts The number of failed attempts so far.
+
+ @return NSTimeInterval The delay in seconds.
+ */
+-(NSTimeInterval)retryDelayAfterAttempts:(NSUInteger)attempts;
+
+/**
+ The number of seconds to wait after a request has failed a number of times, for any queue that follows the retry policy of the outbox.
+
+ STRSegmentUploadQueue uses this method too, so that both queues back off on the same schedule. See retryDelayAfterAttempts:.
+
+ @param attempts The number of failed attempts so far.
+
+ @param baseDelay The average number of seconds before the first retry.
+
+ @param maximumDelay The longest number of seconds between two attempts.
+
+ @return NSTimeInterval The delay in seconds.
+ */
++(NSTimeInterval)retryDelayAfterAttempts:(NSUInteger)attempts baseDelay:(NSTimeInterval)baseDelay maximumDelay:(NSTimeInterval)maximumDelay;
+
+/**
+ The `Upload_Retry_Base_Delay` setting, or 5 seconds if it is missing.
+
+ @return NSTimeInterval The default baseRetryDelay.
+ */
++(NSTimeInterval)defaultBaseRetryDelay;
+
+/**
+ The `Upload_Retry_Max_Delay` setting, or 900 seconds if it is missing.
+
+ @return NSTimeInterval The default maximumRetryDelay.
+ */
++(NSTimeInterval)defaultMaximumRetryDelay;
+
+/**
+ The `Upload_Max_Attempts` setting, or 8 if it is missing.
+
+ @return NSUInteger The default maximumAttempts.
+ */
++(NSUInteger)defaultMaximumAttempts;
+
+/**
+ Whether an upload that failed with the specified error is worth trying again.
+
+ Connection errors, such as timeouts, lost connections and a missing network, are retryable, as are HTTP status codes 408, 429 and 500 and above, and responses that could not be read. A capture that the server read and rejected, other HTTP client errors, and bad or unsupported URLs are permanent. Errors that are not recognized, including nil, are retried.
+
+ @param error The error that ended an upload.
+
+ @return BOOL YES if the upload should be tried again.
+ */
++(BOOL)isRetryableError:(NSError *)error;
+
+///---------------------------------------------------------------------------------------
+/// @name Queueing Captures
+///---------------------------------------------------------------------------------------
+
+/**
+ Adds a capture to the outbox and saves the outbox.
+
+ A capture that is already queued is not queued twice. If the outbox is running, the capture is sent as soon as the uploads ahead of it are done.
+
+ @param capture The capture to upload.
+
+ @return BOOL YES if the capture is queued. NO if it has already been uploaded, has no token, or the outbox could not be saved.
+ */
+-(BOOL)enqueueCapture:(STRCapture *)capture;
+
+/**
+ Removes a capture from the outbox. An upload of the capture in progress is cancelled.
+
+ @param token The token of the capture.
+
+ @return BOOL YES if the capture was queued.
+ */
+-(BOOL)removeCaptureWithToken:(NSString *)token;
+
+/**
+ The tokens of the queued captures, in the order they were queued.
+
+ @return NSArray An array of NSString tokens.
+ */
+-(NSArray *)pendingTokens;
+
+/**
+ The number of failed attempts to upload a queued capture.
+
+ @param token The token of the capture.
+
+ @return NSUInteger The number of failed attempts. 0 if the capture is not queued.
+ */
+-(NSUInteger)attemptsForCaptureWithToken:(NSString *)token;
+
+/**
+ The earliest date at which a queued capture is sent again.
+
+ @param token The token of the capture.
+
+ @return NSDate The date of the next attempt. Nil if the capture is not queued.
+ */
+-(NSDate *)nextAttemptDateForCaptureWithToken:(NSString *)token;
+
+///---------------------------------------------------------------------------------------
+/// @name Sending Captures
+///---------------------------------------------------------------------------------------
+
+/**
+ Starts uploading the queued captures whose next attempt is due, and schedules the rest.
+ */
+-(void)start;
+
+/**
+ Stops uploading. An upload in progress is cancelled and does not count as an attempt.
+
+ Call this before you release an outbox that was started.
+ */
+-(void)stop;
+
+/**
+ Makes every queued capture due at once, for example when the network becomes reachable again.
+ */
+-(void)retryNow;
+
+/**
+ Whether the outbox is uploading or waiting to upload queued captures.
+ */
+@property(readonly, getter = isRunning)BOOL running;
+
+@end
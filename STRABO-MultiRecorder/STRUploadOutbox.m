@@ -0,0 +1,369 @@
+//
+//  STRUploadOutbox.m
+//  STRABO-MultiRecorder
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadOutbox.h"
+#import "STRCaptureUploadManager.h"
+#import "STRSettings.h"
+#import "STRLogger.h"
+
+// Used if the retry settings are missing
+#define kSTRDefaultRetryBaseDelay 5
+#define kSTRDefaultRetryMaxDelay 900
+#define kSTRDefaultMaxAttempts 8
+#define kSTROutboxFileVersion 1
+
+@interface STRUploadOutbox () <STRCaptureUploadManagerDelegate> {
+    NSMutableArray * _jobs;
+    NSTimer * _retryTimer;
+    STRCaptureUploadManager * _currentUpload;
+    NSString * _currentToken;
+}
+
+@property(readwrite)NSString * path;
+@property(readwrite, getter = isRunning)BOOL running;
+
+@end
+
+@interface STRUploadOutbox (InternalMethods)
+
+// -- Persistence -- //
+-(void)load;
+-(BOOL)save;
+-(NSMutableDictionary *)jobForToken:(NSString *)token;
+
+// -- Sending -- //
+-(void)scheduleNextJob;
+-(void)sendNextJob;
+-(void)finishCurrentJob;
+-(void)currentJobSucceeded;
+-(void)currentJobFailedWithError:(NSError *)error retryable:(BOOL)retryable;
+-(void)giveUpOnJob:(NSMutableDictionary *)job error:(NSError *)error;
+
+@end
+
+@implementation STRUploadOutbox
+
+#pragma mark - Class Methods
+
++(STRUploadOutbox *)sharedOutbox {
+    static STRUploadOutbox * sharedOutbox = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSString * supportPath = [NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+        sharedOutbox = [[STRUploadOutbox alloc] initWithPath:[supportPath stringByAppendingPathComponent:@"StraboUploadOutbox.json"]];
+    });
+    return sharedOutbox;
+}
+
++(BOOL)isRetryableError:(NSError *)error {
+    if ([error.domain isEqualToString:STRCaptureUploadErrorDomain]) {
+        if (error.code == STRCaptureUploadErrorHTTPStatus) {
+            // Timeouts, throttling and server faults pass; other client errors would recur
+            NSInteger statusCode = [[error.userInfo objectForKey:STRCaptureUploadHTTPStatusCodeKey] integerValue];
+            return (statusCode == 408 || statusCode == 429 || statusCode >= 500);
+        }
+        // A garbled response usually comes from a proxy or a dropped connection,
+        // while a rejection is the server's final word on the capture
+        return (error.code == STRCaptureUploadErrorUnreadableResponse);
+    }
+    if ([error.domain isEqualToString:NSURLErrorDomain]) {
+        switch (error.code) {
+            case NSURLErrorBadURL:
+            case NSURLErrorUnsupportedURL:
+            case NSURLErrorUserCancelledAuthentication:
+            case NSURLErrorUserAuthenticationRequired:
+            case NSURLErrorNoPermissionsToReadFile:
+            case NSURLErrorDataLengthExceedsMaximum:
+                return NO;
+            default:
+                return YES;
+        }
+    }
+    return YES;
+}
+
++(NSTimeInterval)retryDelayAfterAttempts:(NSUInteger)attempts baseDelay:(NSTimeInterval)baseDelay maximumDelay:(NSTimeInterval)maximumDelay {
+    NSTimeInterval delay = baseDelay * pow(2.0, (double)MAX(attempts, (NSUInteger)1) - 1.0);
+    delay = MIN(delay, maximumDelay);
+    return delay / 2.0 + (delay / 2.0) * ((double)arc4random() / UINT32_MAX);
+}
+
++(NSTimeInterval)defaultBaseRetryDelay {
+    NSTimeInterval delay = [[STRSettings sharedSettings] uploadRetryBaseDelay];
+    return (delay > 0) ? delay : kSTRDefaultRetryBaseDelay;
+}
+
++(NSTimeInterval)defaultMaximumRetryDelay {
+    NSTimeInterval delay = [[STRSettings sharedSettings] uploadRetryMaxDelay];
+    return (delay > 0) ? delay : kSTRDefaultRetryMaxDelay;
+}
+
++(NSUInteger)defaultMaximumAttempts {
+    NSUInteger attempts = [[STRSettings sharedSettings] uploadMaxAttempts];
+    return (attempts > 0) ? attempts : kSTRDefaultMaxAttempts;
+}
+
+#pragma mark - Instance Methods
+
+-(id)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        self.path = path;
+        self.baseRetryDelay = [STRUploadOutbox defaultBaseRetryDelay];
+        self.maximumRetryDelay = [STRUploadOutbox defaultMaximumRetryDelay];
+        self.maximumAttempts = [STRUploadOutbox defaultMaximumAttempts];
+        [self load];
+    }
+    return self;
+}
+
+-(NSTimeInterval)retryDelayAfterAttempts:(NSUInteger)attempts {
+    return [STRUploadOutbox retryDelayAfterAttempts:attempts baseDelay:self.baseRetryDelay maximumDelay:self.maximumRetryDelay];
+}
+
+-(BOOL)enqueueCapture:(STRCapture *)capture {
+    if (!capture.token || [capture hasBeenUploaded]) return NO;
+    if ([self jobForToken:capture.token]) return YES;
+
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    NSMutableDictionary * job = [NSMutableDictionary dictionaryWithObjectsAndKeys:capture.token, @"token", @0, @"attempts", @(now), @"enqueued_at", @(now), @"next_attempt_at", nil];
+    [_jobs addObject:job];
+    if (![self save]) {
+        [_jobs removeObject:job];
+        return NO;
+    }
+    STRLogDebug(STRLogCategoryUpload, @"STRUploadOutbox: Queued capture %@.", capture.token);
+    [self scheduleNextJob];
+    return YES;
+}
+
+-(BOOL)removeCaptureWithToken:(NSString *)token {
+    NSMutableDictionary * job = [self jobForToken:token];
+    if (!job) return NO;
+    if ([token isEqualToString:_currentToken]) {
+        [_currentUpload cancelCurrentUpload];
+        [self finishCurrentJob];
+        [self scheduleNextJob];
+    }
+    [_jobs removeObject:job];
+    [self save];
+    return YES;
+}
+
+-(NSArray *)pendingTokens {
+    return [_jobs valueForKey:@"token"];
+}
+
+-(NSUInteger)attemptsForCaptureWithToken:(NSString *)token {
+    return [[[self jobForToken:token] objectForKey:@"attempts"] unsignedIntegerValue];
+}
+
+-(NSDate *)nextAttemptDateForCaptureWithToken:(NSString *)token {
+    NSMutableDictionary * job = [self jobForToken:token];
+    return (job) ? [NSDate dateWithTimeIntervalSince1970:[[job objectForKey:@"next_attempt_at"] doubleValue]] : nil;
+}
+
+-(void)start {
+    if (self.running) return;
+    self.running = YES;
+    STRLogInfo(STRLogCategoryUpload, @"STRUploadOutbox: Started with %lu queued captures.", (unsigned long)_jobs.count);
+    [self sendNextJob];
+}
+
+-(void)stop {
+    self.running = NO;
+    [_retryTimer invalidate];
+    _retryTimer = nil;
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(sendNextJob) object:nil];
+    if (_currentUpload) {
+        // The job keeps its attempts, so being stopped costs it nothing
+        _currentUpload.delegate = nil;
+        [_currentUpload cancelCurrentUpload];
+        [self finishCurrentJob];
+    }
+}
+
+-(void)retryNow {
+    NSNumber * now = @([[NSDate date] timeIntervalSince1970]);
+    for (NSMutableDictionary * job in _jobs) {
+        [job setObject:now forKey:@"next_attempt_at"];
+    }
+    [self save];
+    [self scheduleNextJob];
+}
+
+@end
+
+@implementation STRUploadOutbox (InternalMethods)
+
+#pragma mark - Persistence
+
+-(void)load {
+    _jobs = [NSMutableArray array];
+    NSData * data = [NSData dataWithContentsOfFile:self.path];
+    if (!data) return;
+    NSDictionary * outbox = [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingMutableContainers error:nil];
+    NSArray * jobs = ([outbox isKindOfClass:[NSDictionary class]]) ? [outbox objectForKey:@"jobs"] : nil;
+    if (![jobs isKindOfClass:[NSArray class]]) {
+        STRLogWarning(STRLogCategoryUpload, @"STRUploadOutbox: The outbox file at %@ could not be read. Starting with an empty outbox.", self.path);
+        return;
+    }
+    for (NSMutableDictionary * job in jobs) {
+        if ([job isKindOfClass:[NSMutableDictionary class]] && [[job objectForKey:@"token"] isKindOfClass:[NSString class]]) {
+            [_jobs addObject:job];
+        }
+    }
+    STRLogDebug(STRLogCategoryUpload, @"STRUploadOutbox: Loaded %lu queued captures.", (unsigned long)_jobs.count);
+}
+
+-(BOOL)save {
+    // Written beside the old file and renamed over it, so a crash never leaves half an outbox
+    NSError * error;
+    NSData * data = [NSJSONSerialization dataWithJSONObject:@{ @"version" : @kSTROutboxFileVersion, @"jobs" : _jobs } options:0 error:&error];
+    [[NSFileManager defaultManager] createDirectoryAtPath:[self.path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    if (!data || ![data writeToFile:self.path options:NSDataWritingAtomic error:&error]) {
+        STRLogError(STRLogCategoryUpload, @"STRUploadOutbox: Could not save the outbox: %@", error.localizedDescription);
+        return NO;
+    }
+    return YES;
+}
+
+-(NSMutableDictionary *)jobForToken:(NSString *)token {
+    for (NSMutableDictionary * job in _jobs) {
+        if ([[job objectForKey:@"token"] isEqualToString:token]) return job;
+    }
+    return nil;
+}
+
+#pragma mark - Sending
+
+-(void)scheduleNextJob {
+    // Sent from the run loop, so that delegate callbacks never nest
+    if (!self.running) return;
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(sendNextJob) object:nil];
+    [self performSelector:@selector(sendNextJob) withObject:nil afterDelay:0];
+}
+
+-(void)sendNextJob {
+    [_retryTimer invalidate];
+    _retryTimer = nil;
+    if (!self.running || _currentUpload) return;
+
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    NSTimeInterval nextAttempt = 0;
+    for (NSMutableDictionary * job in [_jobs copy]) {
+        NSTimeInterval jobAttempt = [[job objectForKey:@"next_attempt_at"] doubleValue];
+        if (jobAttempt > now) {
+            if (nextAttempt == 0 || jobAttempt < nextAttempt) nextAttempt = jobAttempt;
+            continue;
+        }
+
+        NSString * token = [job objectForKey:@"token"];
+        STRCapture * capture = [STRCapture captureWithToken:token];
+        if (!capture) {
+            [self giveUpOnJob:job error:nil];
+            continue;
+        }
+        if ([capture hasBeenUploaded]) {
+            // Uploaded some other way since it was queued
+            [_jobs removeObject:job];
+            [self save];
+            if ([self.delegate respondsToSelector:@selector(outboxDidUploadCaptureWithToken:)]) {
+                [self.delegate outboxDidUploadCaptureWithToken:token];
+            }
+            continue;
+        }
+
+        _currentToken = token;
+        _currentUpload = [STRCaptureUploadManager defaultManager];
+        _currentUpload.delegate = self;
+        if (self.uploadURL) _currentUpload.uploadURL = self.uploadURL;
+        STRLogDebug(STRLogCategoryUpload, @"STRUploadOutbox: Sending capture %@, attempt %lu.", token, (unsigned long)[[job objectForKey:@"attempts"] unsignedIntegerValue] + 1);
+        [_currentUpload beginUploadForCapture:capture];
+        return;
+    }
+
+    if (nextAttempt > 0) {
+        _retryTimer = [NSTimer scheduledTimerWithTimeInterval:MAX(nextAttempt - now, 0.0) target:self selector:@selector(sendNextJob) userInfo:nil repeats:NO];
+    }
+}
+
+-(void)finishCurrentJob {
+    _currentUpload.delegate = nil;
+    _currentUpload = nil;
+    _currentToken = nil;
+}
+
+-(void)currentJobSucceeded {
+    NSString * token = _currentToken;
+    NSMutableDictionary * job = [self jobForToken:token];
+    [self finishCurrentJob];
+    if (job) {
+        [_jobs removeObject:job];
+        [self save];
+    }
+    STRLogInfo(STRLogCategoryUpload, @"STRUploadOutbox: Uploaded capture %@.", token);
+    if ([self.delegate respondsToSelector:@selector(outboxDidUploadCaptureWithToken:)]) {
+        [self.delegate outboxDidUploadCaptureWithToken:token];
+    }
+    [self scheduleNextJob];
+}
+
+-(void)currentJobFailedWithError:(NSError *)error retryable:(BOOL)retryable {
+    NSMutableDictionary * job = [self jobForToken:_currentToken];
+    [self finishCurrentJob];
+    if (!job) {
+        [self scheduleNextJob];
+        return;
+    }
+
+    NSUInteger attempts = [[job objectForKey:@"attempts"] unsignedIntegerValue] + 1;
+    [job setObject:@(attempts) forKey:@"attempts"];
+    if (error.localizedDescription) [job setObject:error.localizedDescription forKey:@"last_error"];
+    if (!retryable || attempts >= self.maximumAttempts) {
+        [self giveUpOnJob:job error:error];
+        [self scheduleNextJob];
+        return;
+    }
+
+    NSTimeInterval delay = [self retryDelayAfterAttempts:attempts];
+    [job setObject:@([[NSDate date] timeIntervalSince1970] + delay) forKey:@"next_attempt_at"];
+    [self save];
+    STRLogWarning(STRLogCategoryUpload, @"STRUploadOutbox: Attempt %lu at capture %@ failed. Retrying in %.1f seconds: %@", (unsigned long)attempts, [job objectForKey:@"token"], delay, error.localizedDescription);
+    if ([self.delegate respondsToSelector:@selector(outboxWillRetryCaptureWithToken:afterDelay:error:)]) {
+        [self.delegate outboxWillRetryCaptureWithToken:[job objectForKey:@"token"] afterDelay:delay error:error];
+    }
+    [self scheduleNextJob];
+}
+
+-(void)giveUpOnJob:(NSMutableDictionary *)job error:(NSError *)error {
+    NSString * token = [job objectForKey:@"token"];
+    [_jobs removeObject:job];
+    [self save];
+    STRLogError(STRLogCategoryUpload, @"STRUploadOutbox: Gave up on capture %@ after %lu attempts: %@", token, (unsigned long)[[job objectForKey:@"attempts"] unsignedIntegerValue], (error) ? error.localizedDescription : @"the capture could not be read");
+    if ([self.delegate respondsToSelector:@selector(outboxDidGiveUpOnCaptureWithToken:error:)]) {
+        [self.delegate outboxDidGiveUpOnCaptureWithToken:token error:error];
+    }
+}
+
+#pragma mark - STRCaptureUploadManagerDelegate
+
+-(void)fileUploadedSuccessfullyWithToken:(NSString *)token {
+    [self currentJobSucceeded];
+}
+
+-(void)fileUploadFailedToStart {
+    // The capture's files are missing or damaged, which no retry will fix
+    [self currentJobFailedWithError:nil retryable:NO];
+}
+
+-(void)fileUploadDidFailWithError:(NSError *)error {
+    [self currentJobFailedWithError:error retryable:[STRUploadOutbox isRetryableError:error]];
+}
+
+@end
@@ -0,0 +1,80 @@
+//
+//  STRBenchmark.h
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Times a block of code and records the result in a machine-readable form.
+
+ Each run produces one JSON object with the following keys:
+
+ - `benchmark` and `parameters`: what was measured.
+ - `iterations`: how many times the block ran.
+ - `wall_time`: a dictionary with `total`, `mean`, `median`, `min` and `max`, in seconds.
+ - `allocations` and `allocated_bytes`: heap allocations per iteration. These count every thread in the process, so background work that happens during the run is included.
+ - `peak_rss`: the highest resident memory size, in bytes, seen while the block ran.
+ - `max_rss`: the highest resident memory size of the whole process so far, as reported by the kernel.
+ - `device`, `system_version` and `date`: where and when the run happened.
+
+ The object is logged on a line starting with `BENCHMARK ` and appended to a JSON lines file. The file is `STRBenchmarkResults.jsonl` in the temporary directory unless the `STR_BENCHMARK_RESULTS` environment variable names another path. Compare the files from two builds to find regressions.
+ */
+@interface STRBenchmark : NSObject
+
+/**
+ Runs a block several times and records how long it took and how much memory it used.
+
+ Every iteration runs inside its own autorelease pool.
+
+ @param name The name of the benchmark, such as `file_manager.all_captures_sorted`.
+
+ @param parameters The inputs of this run, such as the corpus size. They must be JSON-compatible. You may pass nil.
+
+ @param iterations The number of times to run the block. At least one.
+
+ @param block The code to measure.
+
+ @return NSDictionary The recorded result.
+ */
++(NSDictionary *)runBenchmarkNamed:(NSString *)name parameters:(NSDictionary *)parameters iterations:(NSUInteger)iterations block:(void (^)(void))block;
+
+/**
+ Records latencies that were measured elsewhere, such as by several threads at once.
+
+ The result has the same `benchmark`, `parameters`, memory and device keys as runBenchmarkNamed:parameters:iterations:block:. Instead of `iterations` and `wall_time` it has `operations` and a `latency` dictionary with `mean`, `p50`, `p90`, `p99` and `max`, in seconds.
+
+ @param name The name of the benchmark, such as `load.save`.
+
+ @param parameters The inputs of this run. They must be JSON-compatible. You may pass nil.
+
+ @param latencies An array of NSNumber durations, in seconds.
+
+ @param extra Additional JSON-compatible keys to add to the result, such as error counts. You may pass nil.
+
+ @return NSDictionary The recorded result.
+ */
++(NSDictionary *)recordBenchmarkNamed:(NSString *)name parameters:(NSDictionary *)parameters latencies:(NSArray *)latencies extra:(NSDictionary *)extra;
+
+/**
+ The path that results are appended to.
+
+ @return NSString The path of the JSON lines file.
+ */
++(NSString *)resultsPath;
+
+/**
+ Reads a list of integers from an environment variable, so that sizes can be changed without rebuilding.
+
+ @param name The name of the environment variable. Its value is a comma-separated list, such as `100,10000`.
+
+ @param defaultValues The values to use if the variable is not set.
+
+ @return NSArray An array of NSNumber objects.
+ */
++(NSArray *)integersFromEnvironment:(NSString *)name defaultValues:(NSArray *)defaultValues;
+
+@end
@@ -0,0 +1,242 @@
+//
+//  STRBenchmark.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRBenchmark.h"
+
+#import <UIKit/UIKit.h>
+#import <libkern/OSAtomic.h>
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <sys/resource.h>
+#include <sys/sysctl.h>
+
+// How often resident memory is sampled while a benchmark runs
+#define kSTRMemorySampleInterval (1 * NSEC_PER_MSEC)
+
+#pragma mark - Allocation Counting
+
+static void * (*STROriginalMalloc)(malloc_zone_t * zone, size_t size);
+static void * (*STROriginalCalloc)(malloc_zone_t * zone, size_t count, size_t size);
+static void * (*STROriginalRealloc)(malloc_zone_t * zone, void * pointer, size_t size);
+static int64_t volatile STRAllocationCount = 0;
+static int64_t volatile STRAllocatedBytes = 0;
+static BOOL STRAllocationCountingInstalled = NO;
+
+static void * STRCountingMalloc(malloc_zone_t * zone, size_t size) {
+    OSAtomicIncrement64(&STRAllocationCount);
+    OSAtomicAdd64((int64_t)size, &STRAllocatedBytes);
+    return STROriginalMalloc(zone, size);
+}
+
+static void * STRCountingCalloc(malloc_zone_t * zone, size_t count, size_t size) {
+    OSAtomicIncrement64(&STRAllocationCount);
+    OSAtomicAdd64((int64_t)(count * size), &STRAllocatedBytes);
+    return STROriginalCalloc(zone, count, size);
+}
+
+static void * STRCountingRealloc(malloc_zone_t * zone, void * pointer, size_t size) {
+    OSAtomicIncrement64(&STRAllocationCount);
+    OSAtomicAdd64((int64_t)size, &STRAllocatedBytes);
+    return STROriginalRealloc(zone, pointer, size);
+}
+
+// Wraps the default malloc zone's functions with counting versions. Objective-C objects,
+// CoreFoundation objects and plain malloc calls all go through the default zone.
+static void STRInstallAllocationCounting(void) {
+    malloc_zone_t * zone = malloc_default_zone();
+    // Newer zones are write protected after they are set up
+    BOOL protectedZone = (zone->version >= 8);
+    if (protectedZone && vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(malloc_zone_t), 0, VM_PROT_READ | VM_PROT_WRITE) != KERN_SUCCESS) {
+        return;
+    }
+    STROriginalMalloc = zone->malloc;
+    STROriginalCalloc = zone->calloc;
+    STROriginalRealloc = zone->realloc;
+    zone->malloc = STRCountingMalloc;
+    zone->calloc = STRCountingCalloc;
+    zone->realloc = STRCountingRealloc;
+    if (protectedZone) {
+        vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(malloc_zone_t), 0, VM_PROT_READ);
+    }
+    STRAllocationCountingInstalled = YES;
+}
+
+#pragma mark - Memory Sampling
+
+static uint64_t STRResidentSize(void) {
+    struct task_basic_info info;
+    mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return info.resident_size;
+}
+
+static uint64_t STRMaximumResidentSize(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    // Darwin reports this in bytes
+    return (uint64_t)usage.ru_maxrss;
+}
+
+@interface STRBenchmark (InternalMethods)
++(void)addEnvironmentToResult:(NSMutableDictionary *)result;
++(NSString *)deviceModel;
++(void)writeResult:(NSDictionary *)result;
+@end
+
+@implementation STRBenchmark
+
++(NSDictionary *)runBenchmarkNamed:(NSString *)name parameters:(NSDictionary *)parameters iterations:(NSUInteger)iterations block:(void (^)(void))block {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        STRInstallAllocationCounting();
+    });
+    if (iterations == 0) iterations = 1;
+
+    // Sample resident memory in the background while the block runs
+    __block uint64_t peakResidentSize = STRResidentSize();
+    dispatch_queue_t samplingQueue = dispatch_queue_create("com.strabogis.benchmark.memory", DISPATCH_QUEUE_SERIAL);
+    dispatch_source_t sampler = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, samplingQueue);
+    dispatch_source_set_timer(sampler, dispatch_time(DISPATCH_TIME_NOW, 0), kSTRMemorySampleInterval, kSTRMemorySampleInterval / 2);
+    dispatch_source_set_event_handler(sampler, ^{
+        uint64_t residentSize = STRResidentSize();
+        if (residentSize > peakResidentSize) peakResidentSize = residentSize;
+    });
+    dispatch_resume(sampler);
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    NSMutableArray * durations = [NSMutableArray arrayWithCapacity:iterations];
+
+    int64_t allocationsBefore = STRAllocationCount;
+    int64_t bytesBefore = STRAllocatedBytes;
+    for (NSUInteger i = 0; i < iterations; i++) {
+        uint64_t start = mach_absolute_time();
+        @autoreleasepool {
+            block();
+        }
+        uint64_t elapsed = mach_absolute_time() - start;
+        [durations addObject:@((double)elapsed * timebase.numer / timebase.denom / NSEC_PER_SEC)];
+    }
+    int64_t allocations = STRAllocationCount - allocationsBefore;
+    int64_t allocatedBytes = STRAllocatedBytes - bytesBefore;
+
+    dispatch_source_cancel(sampler);
+    dispatch_sync(samplingQueue, ^{
+        uint64_t residentSize = STRResidentSize();
+        if (residentSize > peakResidentSize) peakResidentSize = residentSize;
+    });
+
+    double total = [[durations valueForKeyPath:@"@sum.self"] doubleValue];
+    [durations sortUsingSelector:@selector(compare:)];
+    NSDictionary * wallTime = @{
+    @"total" : @(total),
+    @"mean" : @(total / iterations),
+    @"median" : [durations objectAtIndex:iterations / 2],
+    @"min" : [durations objectAtIndex:0],
+    @"max" : [durations lastObject]
+    };
+
+    NSMutableDictionary * result = [NSMutableDictionary dictionary];
+    [result setObject:name forKey:@"benchmark"];
+    [result setObject:(parameters) ? parameters : @{} forKey:@"parameters"];
+    [result setObject:@(iterations) forKey:@"iterations"];
+    [result setObject:wallTime forKey:@"wall_time"];
+    if (STRAllocationCountingInstalled) {
+        [result setObject:@((double)allocations / iterations) forKey:@"allocations"];
+        [result setObject:@((double)allocatedBytes / iterations) forKey:@"allocated_bytes"];
+    } else {
+        [result setObject:[NSNull null] forKey:@"allocations"];
+        [result setObject:[NSNull null] forKey:@"allocated_bytes"];
+    }
+    [result setObject:@(peakResidentSize) forKey:@"peak_rss"];
+    [STRBenchmark addEnvironmentToResult:result];
+
+    [STRBenchmark writeResult:result];
+    return result;
+}
+
++(NSDictionary *)recordBenchmarkNamed:(NSString *)name parameters:(NSDictionary *)parameters latencies:(NSArray *)latencies extra:(NSDictionary *)extra {
+    NSArray * sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger count = sorted.count;
+    NSMutableDictionary * latency = [NSMutableDictionary dictionary];
+    if (count > 0) {
+        [latency setObject:@([[sorted valueForKeyPath:@"@sum.self"] doubleValue] / count) forKey:@"mean"];
+        // Nearest-rank percentiles
+        for (NSNumber * percentile in @[ @50, @90, @99 ]) {
+            NSUInteger rank = (NSUInteger)ceil(percentile.doubleValue / 100.0 * count);
+            [latency setObject:[sorted objectAtIndex:MAX(rank, (NSUInteger)1) - 1] forKey:[NSString stringWithFormat:@"p%@", percentile]];
+        }
+        [latency setObject:[sorted lastObject] forKey:@"max"];
+    }
+
+    NSMutableDictionary * result = [NSMutableDictionary dictionary];
+    [result setObject:name forKey:@"benchmark"];
+    [result setObject:(parameters) ? parameters : @{} forKey:@"parameters"];
+    [result setObject:@(count) forKey:@"operations"];
+    [result setObject:latency forKey:@"latency"];
+    if (extra) [result addEntriesFromDictionary:extra];
+    [result setObject:@(STRResidentSize()) forKey:@"peak_rss"];
+    [STRBenchmark addEnvironmentToResult:result];
+
+    [STRBenchmark writeResult:result];
+    return result;
+}
+
++(NSString *)resultsPath {
+    NSString * path = [[[NSProcessInfo processInfo] environment] objectForKey:@"STR_BENCHMARK_RESULTS"];
+    if (path.length > 0) return path;
+    return [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRBenchmarkResults.jsonl"];
+}
+
++(NSArray *)integersFromEnvironment:(NSString *)name defaultValues:(NSArray *)defaultValues {
+    NSString * value = [[[NSProcessInfo processInfo] environment] objectForKey:name];
+    if (value.length == 0) return defaultValues;
+    NSMutableArray * integers = [NSMutableArray array];
+    for (NSString * component in [value componentsSeparatedByString:@","]) {
+        NSInteger integer = [component integerValue];
+        if (integer > 0) [integers addObject:@(integer)];
+    }
+    return (integers.count > 0) ? integers : defaultValues;
+}
+
+@end
+
+@implementation STRBenchmark (InternalMethods)
+
++(void)addEnvironmentToResult:(NSMutableDictionary *)result {
+    [result setObject:@(STRMaximumResidentSize()) forKey:@"max_rss"];
+    [result setObject:[STRBenchmark deviceModel] forKey:@"device"];
+    [result setObject:[[UIDevice currentDevice] systemVersion] forKey:@"system_version"];
+    [result setObject:@([[NSDate date] timeIntervalSince1970]) forKey:@"date"];
+}
+
++(NSString *)deviceModel {
+    char model[64];
+    size_t size = sizeof(model);
+    if (sysctlbyname("hw.machine", model, &size, NULL, 0) != 0) return @"unknown";
+    return [NSString stringWithUTF8String:model];
+}
+
++(void)writeResult:(NSDictionary *)result {
+    NSData * JSONData = [NSJSONSerialization dataWithJSONObject:result options:0 error:nil];
+    if (!JSONData) return;
+    NSLog(@"BENCHMARK %@", [[NSString alloc] initWithData:JSONData encoding:NSUTF8StringEncoding]);
+
+    NSString * path = [STRBenchmark resultsPath];
+    if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        [[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:nil];
+    }
+    NSFileHandle * fileHandle = [NSFileHandle fileHandleForWritingAtPath:path];
+    [fileHandle seekToEndOfFile];
+    [fileHandle writeData:JSONData];
+    [fileHandle writeData:[@"\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    [fileHandle closeFile];
+}
+
+@end
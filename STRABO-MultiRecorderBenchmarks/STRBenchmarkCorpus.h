@@ -0,0 +1,81 @@
+//
+//  STRBenchmarkCorpus.h
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Writes synthetic captures for the benchmarks to use.
+
+ Captures are written in the same layout as STRCaptureFileOrganizer uses, directly into the SDK's captures directory, so that STRCaptureFileManager and STRCapture read them exactly as they read real captures. Call setUpEmptyCapturesDirectory before writing a corpus and restoreCapturesDirectory when done; any captures that were already on the device are moved aside in between.
+
+ The contents are generated from a fixed seed, so a corpus of a given size is the same on every run.
+ */
+@interface STRBenchmarkCorpus : NSObject
+
+/**
+ Moves the current captures directory aside, if there is one, and creates an empty one.
+ */
++(void)setUpEmptyCapturesDirectory;
+
+/**
+ Deletes the benchmark captures and moves the original captures directory back.
+ */
++(void)restoreCapturesDirectory;
+
+/**
+ Chooses the token format of the captures written from now on.
+
+ By default captures get time-ordered tokens, like the ones STRCaptureToken generates. Legacy tokens are the 64-character hashes that earlier versions of the SDK wrote. They carry no date, so listings of them have to read every capture's info file.
+
+ @param legacyTokens YES to write legacy tokens.
+ */
++(void)setWritesLegacyTokens:(BOOL)legacyTokens;
+
+/**
+ Chooses where the captures written from now on are put.
+
+ By default captures go into their shards, as STRCapturePathResolver places them. The flat layout puts every capture directly in the captures directory, like earlier versions of the SDK did. setUpEmptyCapturesDirectory turns off automatic migration so that a flat corpus stays flat while it is measured.
+
+ @param flatLayout YES to write the flat layout.
+ */
++(void)setWritesFlatLayout:(BOOL)flatLayout;
+
+/**
+ The date that corpus creation dates count back from.
+
+ @return NSDate Noon on the day of the most recent capture in a corpus.
+ */
++(NSDate *)referenceDate;
+
+/**
+ Writes a corpus of captures whose creation dates are spread over the year before referenceDate.
+
+ @param count The number of captures to write.
+
+ @param points The number of points in each capture's geodata track.
+
+ @param mediaSize The size in bytes of each capture's media file.
+
+ @return NSArray The tokens of the new captures.
+ */
++(NSArray *)writeCapturesWithCount:(NSUInteger)count pointsPerTrack:(NSUInteger)points mediaSize:(NSUInteger)mediaSize;
+
+/**
+ Writes a single capture.
+
+ @param points The number of points in the capture's geodata track.
+
+ @param mediaSize The size in bytes of the capture's media file.
+
+ @param date The creation date of the capture.
+
+ @return NSString The token of the new capture.
+ */
++(NSString *)writeCaptureWithPoints:(NSUInteger)points mediaSize:(NSUInteger)mediaSize date:(NSDate *)date;
+
+@end
@@ -0,0 +1,175 @@
+//
+//  STRBenchmarkCorpus.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRBenchmarkCorpus.h"
+#import "STRCapturePathResolver.h"
+
+#define kSTRCorpusSeed 20121019
+#define kSTRCorpusSpan (365 * 24 * 60 * 60)
+
+// A 1x1 transparent PNG, used as every capture's thumbnail
+static const unsigned char STRThumbnailBytes[] = {
+    0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x48, 0x44, 0x52,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06, 0x00, 0x00, 0x00, 0x1F, 0x15, 0xC4,
+    0x89, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9C, 0x63, 0x00, 0x01, 0x00, 0x00,
+    0x05, 0x00, 0x01, 0x0D, 0x0A, 0x2D, 0xB4, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE,
+    0x42, 0x60, 0x82
+};
+
+@interface STRBenchmarkCorpus (InternalMethods)
++(NSString *)capturesDirectoryPath;
++(NSString *)backupDirectoryPath;
++(NSString *)randomTokenWithDate:(NSDate *)date;
++(NSData *)geoDataWithPoints:(NSUInteger)points latitude:(double)latitude longitude:(double)longitude;
+@end
+
+static BOOL _legacyTokens = NO;
+static BOOL _flatLayout = NO;
+
+@implementation STRBenchmarkCorpus
+
++(void)setWritesLegacyTokens:(BOOL)legacyTokens {
+    _legacyTokens = legacyTokens;
+}
+
++(void)setWritesFlatLayout:(BOOL)flatLayout {
+    _flatLayout = flatLayout;
+}
+
++(void)setUpEmptyCapturesDirectory {
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    NSString * capturesPath = [self capturesDirectoryPath];
+    NSString * backupPath = [self backupDirectoryPath];
+    if ([fileManager fileExistsAtPath:backupPath]) {
+        // A previous run did not finish; its captures are not worth keeping
+        [fileManager removeItemAtPath:capturesPath error:nil];
+    } else if ([fileManager fileExistsAtPath:capturesPath]) {
+        [fileManager moveItemAtPath:capturesPath toPath:backupPath error:nil];
+    }
+    [fileManager createDirectoryAtPath:capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    srandom(kSTRCorpusSeed);
+    // A migration running in the background would skew the measurements
+    [STRCapturePathResolver sharedResolver].migratesAutomatically = NO;
+}
+
++(void)restoreCapturesDirectory {
+    NSFileManager * fileManager = [NSFileManager defaultManager];
+    NSString * capturesPath = [self capturesDirectoryPath];
+    NSString * backupPath = [self backupDirectoryPath];
+    [fileManager removeItemAtPath:capturesPath error:nil];
+    if ([fileManager fileExistsAtPath:backupPath]) {
+        [fileManager moveItemAtPath:backupPath toPath:capturesPath error:nil];
+    }
+    [STRCapturePathResolver sharedResolver].migratesAutomatically = YES;
+}
+
++(NSDate *)referenceDate {
+    NSCalendar * calendar = [NSCalendar currentCalendar];
+    NSDateComponents * components = [[NSDateComponents alloc] init];
+    components.year = 2012;
+    components.month = 10;
+    components.day = 19;
+    components.hour = 12;
+    return [calendar dateFromComponents:components];
+}
+
++(NSArray *)writeCapturesWithCount:(NSUInteger)count pointsPerTrack:(NSUInteger)points mediaSize:(NSUInteger)mediaSize {
+    NSMutableArray * tokens = [NSMutableArray arrayWithCapacity:count];
+    NSTimeInterval reference = [[self referenceDate] timeIntervalSince1970];
+    for (NSUInteger i = 0; i < count; i++) {
+        @autoreleasepool {
+            NSTimeInterval offset = (double)random() / RAND_MAX * kSTRCorpusSpan;
+            NSDate * date = [NSDate dateWithTimeIntervalSince1970:floor(reference - offset)];
+            [tokens addObject:[self writeCaptureWithPoints:points mediaSize:mediaSize date:date]];
+        }
+    }
+    return tokens;
+}
+
++(NSString *)writeCaptureWithPoints:(NSUInteger)points mediaSize:(NSUInteger)mediaSize date:(NSDate *)date {
+    NSString * token = [self randomTokenWithDate:date];
+    NSString * relativeDirectory = (_flatLayout) ? token : [[STRCapturePathResolver sharedResolver] relativeDirectoryForToken:token];
+    NSString * directoryPath = [[self capturesDirectoryPath] stringByAppendingPathComponent:relativeDirectory];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString * relativePath = [token stringByAppendingPathComponent:token];
+    BOOL video = (points > 1);
+
+    // Start somewhere around Columbus, Ohio
+    double latitude = 39.96 + ((double)random() / RAND_MAX - 0.5) * 0.2;
+    double longitude = -83.00 + ((double)random() / RAND_MAX - 0.5) * 0.2;
+
+    NSDictionary * captureInfo = @{
+    @"created_at" : @((NSInteger)[date timeIntervalSince1970]),
+    @"geodata_file" : [relativePath stringByAppendingPathExtension:@"json"],
+    @"coords" : @[ @(latitude), @(longitude) ],
+    @"heading" : @(random() % 360),
+    @"media_file" : [relativePath stringByAppendingPathExtension:(video) ? @"mov" : @"jpg"],
+    @"orientation" : @"vertical",
+    @"thumbnail_file" : [relativePath stringByAppendingPathExtension:@"png"],
+    @"title" : @"Untitled Capture",
+    @"token" : token,
+    @"media_type" : (video) ? @"video" : @"image",
+    @"uploaded_at" : @0
+    };
+    NSData * captureInfoData = [NSJSONSerialization dataWithJSONObject:captureInfo options:0 error:nil];
+    [captureInfoData writeToFile:[directoryPath stringByAppendingPathComponent:@"capture-info.json"] atomically:NO];
+
+    NSString * basePath = [directoryPath stringByAppendingPathComponent:token];
+    [[self geoDataWithPoints:MAX(points, 1) latitude:latitude longitude:longitude] writeToFile:[basePath stringByAppendingPathExtension:@"json"] atomically:NO];
+    [[NSData dataWithBytes:STRThumbnailBytes length:sizeof(STRThumbnailBytes)] writeToFile:[basePath stringByAppendingPathExtension:@"png"] atomically:NO];
+    [[NSMutableData dataWithLength:mediaSize] writeToFile:[basePath stringByAppendingPathExtension:(video) ? @"mov" : @"jpg"] atomically:NO];
+
+    return token;
+}
+
+@end
+
+@implementation STRBenchmarkCorpus (InternalMethods)
+
++(NSString *)capturesDirectoryPath {
+    return [NSHomeDirectory() stringByAppendingPathComponent:@"Documents/StraboCaptures"];
+}
+
++(NSString *)backupDirectoryPath {
+    return [NSHomeDirectory() stringByAppendingPathComponent:@"Documents/StraboCaptures-BenchmarkBackup"];
+}
+
++(NSString *)randomTokenWithDate:(NSDate *)date {
+    if (_legacyTokens) {
+        NSMutableString * token = [NSMutableString stringWithCapacity:64];
+        for (int i = 0; i < 8; i++) {
+            [token appendFormat:@"%08lx", (unsigned long)(random() & 0xFFFFFFFF)];
+        }
+        return token;
+    }
+    // The STRCaptureToken layout, but drawn from the seeded generator so the corpus is reproducible
+    unsigned long long milliseconds = (unsigned long long)([date timeIntervalSince1970] * 1000);
+    return [NSString stringWithFormat:@"%012llx%08lx%06lx%06lx", milliseconds, (unsigned long)(random() & 0xFFFFFFFF), (unsigned long)(random() & 0xFFFFFF), (unsigned long)(random() & 0xFFFFFF)];
+}
+
++(NSData *)geoDataWithPoints:(NSUInteger)points latitude:(double)latitude longitude:(double)longitude {
+    // A walk at about 1.5 m/s with a point roughly every second
+    NSMutableArray * track = [NSMutableArray arrayWithCapacity:points];
+    double heading = random() % 360;
+    double timestamp = 0;
+    for (NSUInteger i = 0; i < points; i++) {
+        [track addObject:@{
+         @"coords" : @[ @(latitude), @(longitude) ],
+         @"heading" : @(heading),
+         @"accuracy" : @(5 + random() % 25),
+         @"timestamp" : @(timestamp)
+         }];
+        heading = fmod(heading + ((double)random() / RAND_MAX - 0.5) * 20 + 360, 360);
+        latitude += cos(heading * M_PI / 180) * 1.5 / 111111;
+        longitude += sin(heading * M_PI / 180) * 1.5 / (111111 * cos(latitude * M_PI / 180));
+        timestamp += 0.5 + (double)random() / RAND_MAX;
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{ @"points" : track } options:0 error:nil];
+}
+
+@end
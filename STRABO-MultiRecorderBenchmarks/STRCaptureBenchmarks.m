@@ -0,0 +1,54 @@
+//
+//  STRCaptureBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCapture.h"
+
+// Points read per track length, so short tracks get enough iterations to time
+#define kTrackWorkPerLength 100000
+#define kMaximumTrackIterations 100
+
+@implementation STRCaptureBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+- (void)testBenchmarkGeoDataPoints
+{
+    NSArray * lengths = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_TRACK_LENGTHS" defaultValues:@[ @10, @100, @1000, @10000, @100000 ]];
+    for (NSNumber * length in lengths) {
+        NSString * token = [STRBenchmarkCorpus writeCaptureWithPoints:length.unsignedIntegerValue mediaSize:1024 date:[STRBenchmarkCorpus referenceDate]];
+        STRCapture * capture = [STRCapture captureWithToken:token];
+        NSUInteger iterations = MIN(kMaximumTrackIterations, MAX(1, kTrackWorkPerLength / length.unsignedIntegerValue));
+        NSDictionary * parameters = @{ @"points" : length };
+        __block NSUInteger count = 0;
+
+        [STRBenchmark runBenchmarkNamed:@"capture.geodata_points" parameters:parameters iterations:iterations block:^{
+            count = [[capture geoDataPoints] count];
+        }];
+        STAssertTrue(count > 0, @"No geodata points were read");
+
+        [STRBenchmark runBenchmarkNamed:@"capture.geodata_point_timestamps" parameters:parameters iterations:iterations block:^{
+            count = [[capture geoDataPointTimestamps] count];
+        }];
+        STAssertEquals(count, length.unsignedIntegerValue, @"Not every timestamp was read");
+    }
+}
+
+@end
@@ -0,0 +1,103 @@
+//
+//  STRCaptureChangeFeedBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureChangeFeedBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCaptureChangeFeed.h"
+#import "STRCaptureFileManager.h"
+
+#define kFeedIterations 5
+#define kFeedChangedCaptures 10
+#define kFeedRecordedChanges 10000
+
+@implementation STRCaptureChangeFeedBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// Bringing a list of every capture up to date after a few edits: reading it all again, or reading the changes
+- (void)testBenchmarkCatchUp
+{
+    NSArray * sizes = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_FEED_CAPTURES" defaultValues:@[ @1000, @10000 ]];
+    for (NSNumber * size in sizes) {
+        [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+        NSArray * tokens = [STRBenchmarkCorpus writeCapturesWithCount:size.unsignedIntegerValue pointsPerTrack:1 mediaSize:16];
+        STRCaptureFileManager * fileManager = [STRCaptureFileManager defaultManager];
+        NSMutableDictionary * view = [NSMutableDictionary dictionaryWithCapacity:tokens.count];
+        for (STRCapture * capture in [fileManager allCapturesSorted:YES]) {
+            [view setObject:capture forKey:capture.token];
+        }
+        unsigned long long sequenceNumber = [fileManager currentChangeSequenceNumber];
+
+        for (NSUInteger i = 0; i < kFeedChangedCaptures; i++) {
+            STRCapture * capture = [STRCapture captureWithToken:[tokens objectAtIndex:i * tokens.count / kFeedChangedCaptures]];
+            capture.title = [NSString stringWithFormat:@"Edited %u", (unsigned)i];
+            [capture save];
+        }
+        NSDictionary * parameters = @{ @"captures" : size, @"changed" : @kFeedChangedCaptures };
+
+        __block NSUInteger reloaded = 0;
+        [STRBenchmark runBenchmarkNamed:@"change_feed.full_reload" parameters:parameters iterations:kFeedIterations block:^{
+            @autoreleasepool {
+                reloaded = [fileManager allCapturesSorted:YES].count;
+            }
+        }];
+        STAssertEquals(reloaded, tokens.count, @"Every capture should be read again");
+
+        __block NSUInteger read = 0;
+        [STRBenchmark runBenchmarkNamed:@"change_feed.catch_up" parameters:parameters iterations:kFeedIterations block:^{
+            read = 0;
+            for (STRCaptureChange * change in [fileManager changesSinceSequenceNumber:sequenceNumber]) {
+                if (change.type == STRCaptureChangeDeleted) {
+                    [view removeObjectForKey:change.token];
+                    continue;
+                }
+                STRCapture * capture = [STRCapture captureWithToken:change.token];
+                if (capture) [view setObject:capture forKey:change.token];
+                read++;
+            }
+        }];
+        STAssertEquals(read, (NSUInteger)kFeedChangedCaptures, @"Only the edited captures should be read");
+        STAssertEqualObjects([[view objectForKey:[tokens objectAtIndex:0]] title], @"Edited 0", @"The edit should reach the view");
+    }
+}
+
+// The cost that every create, save and delete now pays to write the journal
+- (void)testBenchmarkRecordChange
+{
+    NSString * path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureChangeFeedBenchmarks/changes.log"];
+    [[NSFileManager defaultManager] removeItemAtPath:[path stringByDeletingLastPathComponent] error:nil];
+    STRCaptureChangeFeed * feed = [[STRCaptureChangeFeed alloc] initWithPath:path];
+    NSSet * fields = [NSSet setWithObject:STRCaptureFieldTitle];
+
+    [STRBenchmark runBenchmarkNamed:@"change_feed.record_change" parameters:@{ @"changes" : @kFeedRecordedChanges } iterations:1 block:^{
+        for (NSUInteger i = 0; i < kFeedRecordedChanges; i++) {
+            [feed recordChangeOfType:STRCaptureChangeUpdated token:[NSString stringWithFormat:@"capture%u", (unsigned)(i % 100)] fields:fields];
+        }
+    }];
+    [feed publishPendingChanges];
+
+    __block STRCaptureChangeFeed * relaunched = nil;
+    [STRBenchmark runBenchmarkNamed:@"change_feed.load_journal" parameters:@{ @"changes" : @kFeedRecordedChanges } iterations:kFeedIterations block:^{
+        relaunched = [[STRCaptureChangeFeed alloc] initWithPath:path];
+    }];
+    STAssertEquals([relaunched currentSequenceNumber], [feed currentSequenceNumber], @"The journal should be read back");
+    [[NSFileManager defaultManager] removeItemAtPath:[path stringByDeletingLastPathComponent] error:nil];
+}
+
+@end
@@ -0,0 +1,171 @@
+//
+//  STRCaptureClusterIndexBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureClusterIndexBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCaptureClusterIndex.h"
+#import "STRCaptureFileManager.h"
+#import "STRCapturePathResolver.h"
+
+#include <mach/mach_time.h>
+
+#define kClusterIterations 5
+#define kClusterQueries 200
+#define kClusterUpdates 1000
+// A phone screen in portrait, in points
+#define kClusterViewWidth 320
+#define kClusterViewHeight 480
+
+@interface STRCaptureClusterIndexBenchmarks (InternalMethods)
+-(CLLocationCoordinate2D *)newCoordinatesWithCount:(NSUInteger)count;
+-(void)getRegionAround:(CLLocationCoordinate2D)center zoomLevel:(NSUInteger)zoomLevel southWest:(CLLocationCoordinate2D *)southWest northEast:(CLLocationCoordinate2D *)northEast;
+-(NSUInteger)gridClustersOfCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count southWest:(CLLocationCoordinate2D)southWest northEast:(CLLocationCoordinate2D)northEast zoomLevel:(NSUInteger)zoomLevel;
+@end
+
+@implementation STRCaptureClusterIndexBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// Viewport queries at state, city and street zoom levels, against grouping every capture for each query
+- (void)testBenchmarkViewportQueries
+{
+    NSArray * sizes = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_CLUSTER_CAPTURES" defaultValues:@[ @10000, @100000 ]];
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    for (NSNumber * size in sizes) {
+        NSUInteger count = size.unsignedIntegerValue;
+        CLLocationCoordinate2D * coordinates = [self newCoordinatesWithCount:count];
+        NSMutableArray * tokens = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++) [tokens addObject:[NSString stringWithFormat:@"%032lx", (unsigned long)i]];
+
+        __block STRCaptureClusterIndex * index = nil;
+        [STRBenchmark runBenchmarkNamed:@"cluster_index.build" parameters:@{ @"captures" : size } iterations:kClusterIterations block:^{
+            index = [[STRCaptureClusterIndex alloc] init];
+            for (NSUInteger i = 0; i < count; i++) {
+                [index addCaptureWithToken:[tokens objectAtIndex:i] coordinate:coordinates[i]];
+            }
+        }];
+        STAssertEquals(index.count, count, @"Every capture should be indexed");
+
+        for (NSNumber * zoomLevel in @[ @6, @11, @16 ]) {
+            NSMutableArray * indexLatencies = [NSMutableArray arrayWithCapacity:kClusterQueries];
+            NSMutableArray * scanLatencies = [NSMutableArray arrayWithCapacity:kClusterQueries];
+            NSUInteger clusterTotal = 0;
+            srandom(1);
+            for (NSUInteger i = 0; i < kClusterQueries; i++) {
+                @autoreleasepool {
+                    CLLocationCoordinate2D southWest, northEast;
+                    [self getRegionAround:coordinates[random() % count] zoomLevel:zoomLevel.unsignedIntegerValue southWest:&southWest northEast:&northEast];
+
+                    uint64_t start = mach_absolute_time();
+                    NSArray * clusters = [index clustersFromSouthWest:southWest toNorthEast:northEast zoomLevel:zoomLevel.unsignedIntegerValue];
+                    uint64_t middle = mach_absolute_time();
+                    NSUInteger scanned = [self gridClustersOfCoordinates:coordinates count:count southWest:southWest northEast:northEast zoomLevel:zoomLevel.unsignedIntegerValue];
+                    uint64_t end = mach_absolute_time();
+
+                    [indexLatencies addObject:@((double)(middle - start) * timebase.numer / timebase.denom / NSEC_PER_SEC)];
+                    [scanLatencies addObject:@((double)(end - middle) * timebase.numer / timebase.denom / NSEC_PER_SEC)];
+                    STAssertTrue(clusters.count >= scanned, @"Every occupied cell in the region should be a cluster");
+                    clusterTotal += clusters.count;
+                }
+            }
+            NSDictionary * parameters = @{ @"captures" : size, @"zoom_level" : zoomLevel };
+            [STRBenchmark recordBenchmarkNamed:@"cluster_index.viewport" parameters:parameters latencies:indexLatencies extra:@{ @"mean_clusters" : @((double)clusterTotal / kClusterQueries) }];
+            [STRBenchmark recordBenchmarkNamed:@"cluster_index.linear_scan" parameters:parameters latencies:scanLatencies extra:nil];
+        }
+
+        // Captures added and deleted while a map is shown
+        srandom(2);
+        [STRBenchmark runBenchmarkNamed:@"cluster_index.update" parameters:@{ @"captures" : size, @"updates" : @kClusterUpdates } iterations:kClusterIterations block:^{
+            for (NSUInteger i = 0; i < kClusterUpdates; i++) {
+                NSUInteger victim = random() % count;
+                [index removeCaptureWithToken:[tokens objectAtIndex:victim]];
+                [index addCaptureWithToken:[tokens objectAtIndex:victim] coordinate:coordinates[victim]];
+            }
+        }];
+        STAssertEquals(index.count, count, @"Updates should not change the number of captures");
+        free(coordinates);
+    }
+}
+
+// Building the index from the captures directory, against loading every capture as the map did before
+- (void)testBenchmarkLoadFromDisk
+{
+    NSArray * sizes = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_CLUSTER_DISK_CAPTURES" defaultValues:@[ @10000 ]];
+    for (NSNumber * size in sizes) {
+        [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+        [STRBenchmarkCorpus writeCapturesWithCount:size.unsignedIntegerValue pointsPerTrack:1 mediaSize:16];
+        NSDictionary * parameters = @{ @"captures" : size };
+
+        __block NSUInteger loaded = 0;
+        [STRBenchmark runBenchmarkNamed:@"cluster_index.load_captures" parameters:parameters iterations:kClusterIterations block:^{
+            loaded = [[STRCaptureFileManager defaultManager] allCapturesSorted:NO].count;
+        }];
+
+        __block NSUInteger indexed = 0;
+        [STRBenchmark runBenchmarkNamed:@"cluster_index.load_index" parameters:parameters iterations:kClusterIterations block:^{
+            indexed = [[[STRCaptureClusterIndex alloc] init] addCapturesFromResolver:[STRCapturePathResolver sharedResolver]];
+        }];
+        STAssertEquals(indexed, loaded, @"The index should hold every capture");
+    }
+}
+
+@end
+
+@implementation STRCaptureClusterIndexBenchmarks (InternalMethods)
+
+-(CLLocationCoordinate2D *)newCoordinatesWithCount:(NSUInteger)count {
+    // Most captures are near a few places the user goes often, the rest along trips
+    srandom(7);
+    CLLocationCoordinate2D * coordinates = malloc(count * sizeof(CLLocationCoordinate2D));
+    for (NSUInteger i = 0; i < count; i++) {
+        double spread = (i % 10 == 0) ? 4.0 : 0.05;
+        double latitude = 39.96 + (double)(i % 12) * 0.15 + ((double)random() / RAND_MAX - 0.5) * spread;
+        double longitude = -83.0 + (double)(i % 9) * 0.2 + ((double)random() / RAND_MAX - 0.5) * spread;
+        coordinates[i] = CLLocationCoordinate2DMake(latitude, longitude);
+    }
+    return coordinates;
+}
+
+-(void)getRegionAround:(CLLocationCoordinate2D)center zoomLevel:(NSUInteger)zoomLevel southWest:(CLLocationCoordinate2D *)southWest northEast:(CLLocationCoordinate2D *)northEast {
+    // The span of a view of that many points; near enough for latitude away from the poles
+    double longitudeDelta = 360.0 * kClusterViewWidth / (256.0 * pow(2.0, (double)zoomLevel));
+    double latitudeDelta = longitudeDelta * kClusterViewHeight / kClusterViewWidth * cos(center.latitude * M_PI / 180);
+    *southWest = CLLocationCoordinate2DMake(center.latitude - latitudeDelta / 2, center.longitude - longitudeDelta / 2);
+    *northEast = CLLocationCoordinate2DMake(center.latitude + latitudeDelta / 2, center.longitude + longitudeDelta / 2);
+}
+
+-(NSUInteger)gridClustersOfCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count southWest:(CLLocationCoordinate2D)southWest northEast:(CLLocationCoordinate2D)northEast zoomLevel:(NSUInteger)zoomLevel {
+    // What a map does without an index: check every capture, and group those in view by 64 point cells
+    double cells = pow(2.0, (double)zoomLevel + 2);
+    NSMutableDictionary * groups = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < count; i++) {
+        CLLocationCoordinate2D coordinate = coordinates[i];
+        if (coordinate.latitude < southWest.latitude || coordinate.latitude > northEast.latitude) continue;
+        if (coordinate.longitude < southWest.longitude || coordinate.longitude > northEast.longitude) continue;
+        double s = sin(coordinate.latitude * M_PI / 180);
+        long long x = (long long)floor((coordinate.longitude + 180) / 360 * cells);
+        long long y = (long long)floor((0.5 - log((1 + s) / (1 - s)) / (4 * M_PI)) * cells);
+        NSNumber * key = @((x << 32) | y);
+        [groups setObject:@([[groups objectForKey:key] unsignedIntegerValue] + 1) forKey:key];
+    }
+    return groups.count;
+}
+
+@end
@@ -0,0 +1,130 @@
+//
+//  STRCaptureConcurrencyBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureConcurrencyBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCapture.h"
+#import "STRCaptureLockTable.h"
+
+#define kConcurrencyCorpusSize 256
+#define kConcurrencyPointsPerTrack 30
+#define kConcurrencyMediaSize 1024
+// Operations each thread runs
+#define kConcurrencyOperationsPerThread 400
+// The captures that every thread shares in the contended run
+#define kConcurrencySharedCaptures 4
+#define kLockOperationsPerThread 1000000
+
+@interface STRCaptureConcurrencyBenchmarks (InternalMethods)
+-(double)runThreads:(NSUInteger)threads tokens:(NSArray *)tokens shared:(BOOL)shared;
+-(void)runOperation:(unsigned int)operation token:(NSString *)token seed:(unsigned int *)seed;
+@end
+
+@implementation STRCaptureConcurrencyBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// The same mix of loads, renames and upload marks on 1, 2, 4 and 8 threads, first
+// with each thread on captures of its own and then with every thread on the same few
+- (void)testBenchmarkThroughputScaling
+{
+    NSArray * threadCounts = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_CONCURRENCY_THREADS" defaultValues:@[ @1, @2, @4, @8 ]];
+    NSArray * tokens = [STRBenchmarkCorpus writeCapturesWithCount:kConcurrencyCorpusSize pointsPerTrack:kConcurrencyPointsPerTrack mediaSize:kConcurrencyMediaSize];
+
+    for (NSNumber * shared in @[ @NO, @YES ]) {
+        NSString * name = (shared.boolValue) ? @"concurrency.shared_captures" : @"concurrency.separate_captures";
+        double baseThroughput = 0;
+        for (NSNumber * threads in threadCounts) {
+            double elapsed = [self runThreads:threads.unsignedIntegerValue tokens:tokens shared:shared.boolValue];
+            double throughput = threads.unsignedIntegerValue * kConcurrencyOperationsPerThread / elapsed;
+            if (baseThroughput == 0) baseThroughput = throughput;
+            NSDictionary * parameters = @{ @"captures" : @(tokens.count), @"threads" : threads, @"cores" : @([[NSProcessInfo processInfo] activeProcessorCount]) };
+            [STRBenchmark recordBenchmarkNamed:name parameters:parameters latencies:@[ @(elapsed) ] extra:@{ @"operations_per_second" : @(throughput), @"speedup" : @(throughput / baseThroughput) }];
+        }
+    }
+}
+
+// The cost of the lock itself, with every thread on its own capture, when the
+// captures are spread over stripes and when they all share one lock
+- (void)testBenchmarkLockStripes
+{
+    NSArray * threadCounts = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_CONCURRENCY_THREADS" defaultValues:@[ @1, @2, @4, @8 ]];
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+
+    for (NSNumber * stripes in @[ @1, @128 ]) {
+        STRCaptureLockTable * table = [[STRCaptureLockTable alloc] initWithStripeCount:stripes.unsignedIntegerValue];
+        for (NSNumber * threads in threadCounts) {
+            uint64_t start = mach_absolute_time();
+            dispatch_apply(threads.unsignedIntegerValue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+                NSString * token = [NSString stringWithFormat:@"capture-%lu", (unsigned long)thread];
+                __block NSUInteger count = 0;
+                for (int i = 0; i < kLockOperationsPerThread; i++) {
+                    [table writeCaptureWithToken:token usingBlock:^{
+                        count++;
+                    }];
+                }
+            });
+            double elapsed = (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom / NSEC_PER_SEC;
+            NSDictionary * parameters = @{ @"stripes" : stripes, @"threads" : threads };
+            [STRBenchmark recordBenchmarkNamed:@"concurrency.lock_table" parameters:parameters latencies:@[ @(elapsed) ] extra:@{ @"operations_per_second" : @(threads.unsignedIntegerValue * kLockOperationsPerThread / elapsed) }];
+        }
+    }
+}
+
+@end
+
+@implementation STRCaptureConcurrencyBenchmarks (InternalMethods)
+
+-(double)runThreads:(NSUInteger)threads tokens:(NSArray *)tokens shared:(BOOL)shared {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    uint64_t start = mach_absolute_time();
+    dispatch_apply(threads, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+        unsigned int seed = 20121019 + (unsigned int)thread;
+        // Separate runs give each thread its own slice of the corpus
+        NSUInteger sliceSize = (shared) ? kConcurrencySharedCaptures : tokens.count / threads;
+        NSUInteger sliceStart = (shared) ? 0 : thread * sliceSize;
+        for (int i = 0; i < kConcurrencyOperationsPerThread; i++) {
+            @autoreleasepool {
+                NSString * token = [tokens objectAtIndex:sliceStart + rand_r(&seed) % sliceSize];
+                [self runOperation:rand_r(&seed) % 4 token:token seed:&seed];
+            }
+        }
+    });
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom / NSEC_PER_SEC;
+}
+
+-(void)runOperation:(unsigned int)operation token:(NSString *)token seed:(unsigned int *)seed {
+    STRCapture * capture = [STRCapture captureWithToken:token];
+    switch (operation) {
+        case 0:
+            capture.title = [NSString stringWithFormat:@"Capture %d", rand_r(seed) % 1000000];
+            [capture save];
+            break;
+        case 1:
+            [capture markUploadedAtDate:nil];
+            break;
+        default:
+            // Half of the operations only read, as a list does
+            break;
+    }
+}
+
+@end
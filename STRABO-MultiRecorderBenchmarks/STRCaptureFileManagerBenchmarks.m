@@ -0,0 +1,120 @@
+//
+//  STRCaptureFileManagerBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureFileManagerBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCaptureFileManager.h"
+
+// Every corpus capture is a short video
+#define kCorpusPointsPerTrack 30
+#define kCorpusMediaSize 1024
+// Listing work per size, so small corpora get enough iterations to time
+#define kListingWorkPerSize 2000
+#define kPageSize 20
+#define kPageIterations 20
+
+@implementation STRCaptureFileManagerBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+- (void)testBenchmarkListings
+{
+    NSArray * sizes = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_CORPUS_SIZES" defaultValues:@[ @100, @10000, @100000 ]];
+    sizes = [sizes sortedArrayUsingSelector:@selector(compare:)];
+    STRCaptureFileManager * fileManager = [STRCaptureFileManager defaultManager];
+    NSDate * queryDate = [[STRBenchmarkCorpus referenceDate] dateByAddingTimeInterval:-180 * 24 * 60 * 60];
+
+    // Time-ordered tokens let listings sort by name; legacy tokens show the cost of reading every info file
+    for (NSString * tokenFormat in @[ @"time_ordered", @"legacy" ]) {
+        [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+        [STRBenchmarkCorpus setWritesLegacyTokens:[tokenFormat isEqualToString:@"legacy"]];
+
+        NSUInteger corpusSize = 0;
+        for (NSNumber * size in sizes) {
+            // Grow the corpus to the next size rather than writing it again
+            [STRBenchmarkCorpus writeCapturesWithCount:size.unsignedIntegerValue - corpusSize pointsPerTrack:kCorpusPointsPerTrack mediaSize:kCorpusMediaSize];
+            corpusSize = size.unsignedIntegerValue;
+
+            NSUInteger iterations = MAX(1, kListingWorkPerSize / corpusSize);
+            NSDictionary * parameters = @{ @"captures" : size, @"tokens" : tokenFormat };
+            __block NSUInteger count = 0;
+
+            [STRBenchmark runBenchmarkNamed:@"file_manager.all_captures_sorted" parameters:parameters iterations:iterations block:^{
+                count = [[fileManager allCapturesSorted:YES] count];
+            }];
+            STAssertEquals(count, corpusSize, @"Not every capture was listed");
+
+            [STRBenchmark runBenchmarkNamed:@"file_manager.captures_on_date" parameters:parameters iterations:iterations block:^{
+                count = [[fileManager capturesOnDate:queryDate sorted:YES] count];
+            }];
+
+            [STRBenchmark runBenchmarkNamed:@"file_manager.recent_captures" parameters:@{ @"captures" : size, @"tokens" : tokenFormat, @"limit" : @20 } iterations:iterations block:^{
+                count = [[fileManager recentCapturesWithLimit:@20] count];
+            }];
+            STAssertEquals(count, MIN(corpusSize, (NSUInteger)20), @"The wrong number of recent captures was listed");
+        }
+    }
+    [STRBenchmarkCorpus setWritesLegacyTokens:NO];
+}
+
+- (void)testBenchmarkPaging
+{
+    NSArray * sizes = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_PAGING_SIZES" defaultValues:@[ @10000, @100000 ]];
+    sizes = [sizes sortedArrayUsingSelector:@selector(compare:)];
+    STRCaptureFileManager * fileManager = [STRCaptureFileManager defaultManager];
+
+    NSUInteger corpusSize = 0;
+    for (NSNumber * size in sizes) {
+        [STRBenchmarkCorpus writeCapturesWithCount:size.unsignedIntegerValue - corpusSize pointsPerTrack:kCorpusPointsPerTrack mediaSize:kCorpusMediaSize];
+        corpusSize = size.unsignedIntegerValue;
+
+        for (NSNumber * order in @[ @(STRCaptureSortOrderNewestFirst), @(STRCaptureSortOrderOldestFirst) ]) {
+            STRCaptureSortOrder sortOrder = (STRCaptureSortOrder)order.intValue;
+            NSString * orderName = (sortOrder == STRCaptureSortOrderNewestFirst) ? @"newest_first" : @"oldest_first";
+
+            // Walk to the start of each measured page, then time fetching it
+            NSString * cursor = nil;
+            NSUInteger pageNumber = 1;
+            for (NSNumber * measuredPage in @[ @1, @10, @100 ]) {
+                while (pageNumber < measuredPage.unsignedIntegerValue) {
+                    [fileManager capturesWithPageSize:kPageSize afterCursor:cursor sortOrder:sortOrder filter:nil nextCursor:&cursor];
+                    pageNumber++;
+                }
+                NSString * pageCursor = cursor;
+                __block NSUInteger count = 0;
+                NSDictionary * parameters = @{ @"captures" : size, @"page" : measuredPage, @"page_size" : @kPageSize, @"order" : orderName };
+                [STRBenchmark runBenchmarkNamed:@"file_manager.page" parameters:parameters iterations:kPageIterations block:^{
+                    count = [[fileManager capturesWithPageSize:kPageSize afterCursor:pageCursor sortOrder:sortOrder filter:nil nextCursor:NULL] count];
+                }];
+                STAssertEquals(count, (NSUInteger)kPageSize, @"A full page should be returned");
+            }
+        }
+
+        // A selective filter makes the page read about sixteen times as many captures as it returns
+        __block NSUInteger count = 0;
+        [STRBenchmark runBenchmarkNamed:@"file_manager.page_filtered" parameters:@{ @"captures" : size, @"page" : @1, @"page_size" : @kPageSize } iterations:kPageIterations block:^{
+            count = [[fileManager capturesWithPageSize:kPageSize afterCursor:nil sortOrder:STRCaptureSortOrderNewestFirst filter:^BOOL(STRCapture * capture) {
+                return [capture.token hasSuffix:@"0"];
+            } nextCursor:NULL] count];
+        }];
+        STAssertTrue(count <= kPageSize, @"A page should never exceed its size");
+    }
+}
+
+@end
@@ -0,0 +1,147 @@
+//
+//  STRCaptureFileParserBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureFileParserBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCapture.h"
+#import "STRCaptureFileParser.h"
+#import "STRCapturePathResolver.h"
+#import "STRTrackFilter.h"
+
+#define kParserIterations 5
+
+@interface STRCaptureFileParserBenchmarks (InternalMethods)
+-(NSString *)geoDataPathForToken:(NSString *)token;
+-(NSString *)captureInfoPathForToken:(NSString *)token;
+@end
+
+@implementation STRCaptureFileParserBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// One long track read into samples, by the parser and the way STRCapture read it before
+- (void)testBenchmarkGeoData
+{
+    NSArray * lengths = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_PARSER_POINTS" defaultValues:@[ @10000, @100000, @1000000 ]];
+    for (NSNumber * length in lengths) {
+        NSString * token = [STRBenchmarkCorpus writeCaptureWithPoints:length.unsignedIntegerValue mediaSize:1024 date:[STRBenchmarkCorpus referenceDate]];
+        NSString * path = [self geoDataPathForToken:token];
+        NSDictionary * parameters = @{ @"points" : length };
+        __block double fastChecksum = 0, genericChecksum = 0;
+
+        [STRBenchmark runBenchmarkNamed:@"capture_parser.geodata_generic" parameters:parameters iterations:kParserIterations block:^{
+            @autoreleasepool {
+                NSData * data = [NSData dataWithContentsOfFile:path];
+                NSArray * points = [[NSJSONSerialization JSONObjectWithData:data options:0 error:nil] objectForKey:@"points"];
+                STRTrackSample * samples = malloc(MAX(points.count, 1) * sizeof(STRTrackSample));
+                NSUInteger i = 0;
+                for (NSDictionary * point in points) {
+                    samples[i++] = [STRTrackFilter sampleFromPoint:point];
+                }
+                genericChecksum = (i) ? samples[i - 1].latitude + samples[i - 1].timestamp : 0;
+                free(samples);
+            }
+        }];
+
+        [STRBenchmark runBenchmarkNamed:@"capture_parser.geodata_fast" parameters:parameters iterations:kParserIterations block:^{
+            STRTrackSample * samples = NULL;
+            NSUInteger count = 0;
+            if ([[STRCaptureFileParser parserForCurrentThread] parseGeoDataAtPath:path samples:&samples count:&count]) {
+                fastChecksum = (count) ? samples[count - 1].latitude + samples[count - 1].timestamp : 0;
+            }
+            free(samples);
+        }];
+
+        STAssertEquals(fastChecksum, genericChecksum, @"Both paths should read the same track");
+    }
+}
+
+// Every capture info file of a large library, the work of listing all captures
+- (void)testBenchmarkCaptureInfoBatch
+{
+    NSArray * counts = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_PARSER_CAPTURES" defaultValues:@[ @1000, @10000 ]];
+    for (NSNumber * countNumber in counts) {
+        [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+        NSArray * tokens = [STRBenchmarkCorpus writeCapturesWithCount:countNumber.unsignedIntegerValue pointsPerTrack:1 mediaSize:16];
+        NSMutableArray * paths = [NSMutableArray arrayWithCapacity:tokens.count];
+        for (NSString * token in tokens) {
+            [paths addObject:[self captureInfoPathForToken:token]];
+        }
+        NSDictionary * parameters = @{ @"captures" : countNumber };
+        __block double fastChecksum = 0, genericChecksum = 0;
+
+        // The fields that STRCapture keeps, so neither path gets away with reading less
+        [STRBenchmark runBenchmarkNamed:@"capture_parser.capture_info_generic" parameters:parameters iterations:kParserIterations block:^{
+            genericChecksum = 0;
+            for (NSString * path in paths) {
+                @autoreleasepool {
+                    NSDictionary * info = [NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:path] options:0 error:nil];
+                    NSString * token = [info objectForKey:@"token"];
+                    NSString * mediaFile = [info objectForKey:@"media_file"];
+                    NSArray * coords = [info objectForKey:@"coords"];
+                    genericChecksum += [[info objectForKey:@"created_at"] doubleValue] + [[coords objectAtIndex:0] doubleValue] + token.length + mediaFile.length;
+                }
+            }
+        }];
+
+        [STRBenchmark runBenchmarkNamed:@"capture_parser.capture_info_fast" parameters:parameters iterations:kParserIterations block:^{
+            fastChecksum = 0;
+            STRCaptureFileParser * parser = [STRCaptureFileParser parserForCurrentThread];
+            STRCaptureInfoFields fields;
+            for (NSString * path in paths) {
+                @autoreleasepool {
+                    if (![parser parseCaptureInfoAtPath:path fields:&fields]) continue;
+                    NSString * token = [parser stringForField:fields.token];
+                    NSString * mediaFile = [parser stringForField:fields.mediaFile];
+                    fastChecksum += fields.createdAt + fields.latitude + token.length + mediaFile.length;
+                }
+            }
+        }];
+        STAssertEquals(fastChecksum, genericChecksum, @"Both paths should read the same fields");
+
+        // Loading the captures themselves, which now goes through the parser
+        __block NSUInteger loaded = 0;
+        [STRBenchmark runBenchmarkNamed:@"capture_parser.capture_with_token" parameters:parameters iterations:kParserIterations block:^{
+            loaded = 0;
+            for (NSString * token in tokens) {
+                @autoreleasepool {
+                    if ([STRCapture captureWithToken:token]) loaded++;
+                }
+            }
+        }];
+        STAssertEquals(loaded, tokens.count, @"Every capture should load");
+    }
+}
+
+@end
+
+@implementation STRCaptureFileParserBenchmarks (InternalMethods)
+
+-(NSString *)geoDataPathForToken:(NSString *)token {
+    STRCapture * capture = [STRCapture captureWithToken:token];
+    return [[STRCapturePathResolver sharedResolver] absolutePathForCaptureFile:capture.geoDataPath];
+}
+
+-(NSString *)captureInfoPathForToken:(NSString *)token {
+    STRCapturePathResolver * resolver = [STRCapturePathResolver sharedResolver];
+    NSString * directory = [resolver absolutePathForRelativePath:[resolver relativeDirectoryOfCaptureWithToken:token]];
+    return [directory stringByAppendingPathComponent:@"capture-info.json"];
+}
+
+@end
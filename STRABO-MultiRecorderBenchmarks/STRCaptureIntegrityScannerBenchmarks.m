@@ -0,0 +1,64 @@
+//
+//  STRCaptureIntegrityScannerBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureIntegrityScannerBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCaptureIntegrityScanner.h"
+
+#define kScanCorpusPointsPerTrack 300
+#define kScanCorpusMediaSize 4096
+
+@implementation STRCaptureIntegrityScannerBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+- (void)testBenchmarkScan
+{
+    NSUInteger corpusSize = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_SCAN_CORPUS_SIZE" defaultValues:@[ @50000 ]] objectAtIndex:0] unsignedIntegerValue];
+    [STRBenchmarkCorpus writeCapturesWithCount:corpusSize pointsPerTrack:kScanCorpusPointsPerTrack mediaSize:kScanCorpusMediaSize];
+    NSDictionary * parameters = @{ @"captures" : @(corpusSize), @"points" : @kScanCorpusPointsPerTrack, @"cores" : @([[NSProcessInfo processInfo] activeProcessorCount]) };
+    __block STRCaptureIntegrityReport * report = nil;
+
+    // The checks a launch scan runs
+    STRCaptureIntegrityScanner * scanner = [STRCaptureIntegrityScanner scanner];
+    [STRBenchmark runBenchmarkNamed:@"integrity.scan_quick" parameters:parameters iterations:3 block:^{
+        report = [scanner scan];
+    }];
+    STAssertTrue([report isClean], @"The corpus should be intact");
+    STAssertEquals(report.scannedCount, corpusSize, @"Every capture should be checked");
+
+    scanner.parsesGeoData = YES;
+    [STRBenchmark runBenchmarkNamed:@"integrity.scan_parse_geodata" parameters:parameters iterations:1 block:^{
+        report = [scanner scan];
+    }];
+    STAssertTrue([report isClean], @"The corpus should be intact");
+
+    // The first checksum scan hashes and records every file; the second hashes and compares
+    scanner.parsesGeoData = NO;
+    scanner.verifiesChecksums = YES;
+    [STRBenchmark runBenchmarkNamed:@"integrity.scan_record_checksums" parameters:parameters iterations:1 block:^{
+        report = [scanner scan];
+    }];
+    [STRBenchmark runBenchmarkNamed:@"integrity.scan_verify_checksums" parameters:parameters iterations:1 block:^{
+        report = [scanner scan];
+    }];
+    STAssertTrue([report isClean], @"Unchanged files should match their checksums");
+}
+
+@end
@@ -0,0 +1,110 @@
+//
+//  STRCapturePathResolverBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCapturePathResolverBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCaptureFileManager.h"
+#import "STRCapturePathResolver.h"
+
+#define kLayoutCorpusPointsPerTrack 10
+#define kLayoutCorpusMediaSize 256
+#define kLayoutLookups 1000
+
+@interface STRCapturePathResolverBenchmarks (InternalMethods)
+-(void)benchmarkLayout:(NSString *)layout tokens:(NSArray *)tokens;
+@end
+
+@implementation STRCapturePathResolverBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus setWritesFlatLayout:NO];
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+- (void)testBenchmarkFlatAndShardedLayouts
+{
+    NSUInteger corpusSize = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_LAYOUT_CORPUS_SIZE" defaultValues:@[ @100000 ]] objectAtIndex:0] unsignedIntegerValue];
+    STRCapturePathResolver * resolver = [STRCapturePathResolver sharedResolver];
+
+    // Write the corpus the way an older version of the SDK left it, then measure it before and after migrating
+    [STRBenchmarkCorpus setWritesFlatLayout:YES];
+    NSArray * tokens = [STRBenchmarkCorpus writeCapturesWithCount:corpusSize pointsPerTrack:kLayoutCorpusPointsPerTrack mediaSize:kLayoutCorpusMediaSize];
+    [self benchmarkLayout:@"flat" tokens:tokens];
+
+    __block NSUInteger moved = 0;
+    [STRBenchmark runBenchmarkNamed:@"layout.migration" parameters:@{ @"captures" : @(corpusSize) } iterations:1 block:^{
+        moved = [resolver migrateFlatCaptures];
+    }];
+    STAssertEquals(moved, corpusSize, @"Not every capture was migrated");
+    STAssertTrue([resolver isMigrationComplete], @"The layout marker was not written");
+
+    [self benchmarkLayout:@"sharded" tokens:tokens];
+}
+
+@end
+
+@implementation STRCapturePathResolverBenchmarks (InternalMethods)
+
+-(void)benchmarkLayout:(NSString *)layout tokens:(NSArray *)tokens {
+    STRCaptureFileManager * fileManager = [STRCaptureFileManager defaultManager];
+    STRCapturePathResolver * resolver = [STRCapturePathResolver sharedResolver];
+    NSDictionary * parameters = @{ @"captures" : @(tokens.count), @"layout" : layout };
+    NSDate * queryDate = [[STRBenchmarkCorpus referenceDate] dateByAddingTimeInterval:-180 * 24 * 60 * 60];
+    __block NSUInteger count = 0;
+
+    // The same pseudo-random tokens are looked up in both layouts
+    srandom(20121019);
+    NSMutableArray * lookupTokens = [NSMutableArray arrayWithCapacity:kLayoutLookups];
+    for (int i = 0; i < kLayoutLookups; i++) {
+        [lookupTokens addObject:[tokens objectAtIndex:random() % tokens.count]];
+    }
+
+    [STRBenchmark runBenchmarkNamed:@"layout.lookup" parameters:@{ @"captures" : @(tokens.count), @"layout" : layout, @"lookups" : @kLayoutLookups } iterations:1 block:^{
+        count = 0;
+        for (NSString * token in lookupTokens) {
+            @autoreleasepool {
+                if ([STRCapture captureWithToken:token]) count++;
+            }
+        }
+    }];
+    STAssertEquals(count, (NSUInteger)kLayoutLookups, @"A capture could not be found by its token");
+
+    [STRBenchmark runBenchmarkNamed:@"layout.list_directories" parameters:parameters iterations:1 block:^{
+        count = [[resolver allCaptureDirectories] count];
+    }];
+    STAssertEquals(count, tokens.count, @"Not every capture directory was listed");
+
+    [STRBenchmark runBenchmarkNamed:@"layout.local_capture_count" parameters:parameters iterations:1 block:^{
+        count = [[fileManager localCaptureCount] unsignedIntegerValue];
+    }];
+
+    [STRBenchmark runBenchmarkNamed:@"layout.captures_on_date" parameters:parameters iterations:1 block:^{
+        count = [[fileManager capturesOnDate:queryDate sorted:YES] count];
+    }];
+
+    [STRBenchmark runBenchmarkNamed:@"layout.recent_captures" parameters:@{ @"captures" : @(tokens.count), @"layout" : layout, @"limit" : @20 } iterations:10 block:^{
+        count = [[fileManager recentCapturesWithLimit:@20] count];
+    }];
+    STAssertEquals(count, MIN(tokens.count, (NSUInteger)20), @"The wrong number of recent captures was listed");
+
+    [STRBenchmark runBenchmarkNamed:@"layout.all_captures_sorted" parameters:parameters iterations:1 block:^{
+        count = [[fileManager allCapturesSorted:YES] count];
+    }];
+    STAssertEquals(count, tokens.count, @"Not every capture was listed");
+}
+
+@end
@@ -0,0 +1,194 @@
+//
+//  STRCaptureStoreLoadBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureStoreLoadBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCaptureFileManager.h"
+
+#import <UIKit/UIKit.h>
+#include <mach/mach_time.h>
+
+#define kLoadCorpusPointsPerTrack 30
+#define kLoadCorpusMediaSize 1024
+// Operations each worker runs
+#define kLoadOperationsPerWorker 200
+
+typedef enum {
+    STRLoadOperationCreate,
+    STRLoadOperationList,
+    STRLoadOperationQuery,
+    STRLoadOperationRecent,
+    STRLoadOperationSave,
+    STRLoadOperationDelete,
+    STRLoadOperationTrack,
+    STRLoadOperationCount
+} STRLoadOperation;
+
+static NSString * const STRLoadOperationNames[] = { @"create", @"list", @"query", @"recent", @"save", @"delete", @"track" };
+// Relative frequency of each operation, in the same order
+static const int STRLoadOperationWeights[] = { 1, 1, 2, 2, 4, 1, 3 };
+
+@interface STRCaptureStoreLoadBenchmarks () {
+    NSString * _imagePath;
+}
+@end
+
+@interface STRCaptureStoreLoadBenchmarks (InternalMethods)
+-(STRLoadOperation)randomOperationWithSeed:(unsigned int *)seed;
+-(void)runOperation:(STRLoadOperation)operation tokens:(NSMutableArray *)tokens seed:(unsigned int *)seed;
+@end
+
+@implementation STRCaptureStoreLoadBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+
+    // An image for the create operations to import
+    UIGraphicsBeginImageContext(CGSizeMake(64, 48));
+    [[UIColor grayColor] setFill];
+    UIRectFill(CGRectMake(0, 0, 64, 48));
+    UIImage * image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    _imagePath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRLoadBenchmarkImage.jpg"];
+    [UIImageJPEGRepresentation(image, 0.8) writeToFile:_imagePath atomically:YES];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_imagePath error:nil];
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+- (void)testBenchmarkConcurrentLoad
+{
+    NSUInteger corpusSize = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_LOAD_CORPUS_SIZE" defaultValues:@[ @1000 ]] objectAtIndex:0] unsignedIntegerValue];
+    NSArray * workerCounts = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_LOAD_WORKERS" defaultValues:@[ @1, @4, @8 ]];
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+
+    for (NSNumber * workers in workerCounts) {
+        // Every run starts from the same corpus
+        [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+        NSMutableArray * tokens = [[STRBenchmarkCorpus writeCapturesWithCount:corpusSize pointsPerTrack:kLoadCorpusPointsPerTrack mediaSize:kLoadCorpusMediaSize] mutableCopy];
+
+        NSMutableArray * latencies = [NSMutableArray arrayWithCapacity:STRLoadOperationCount];
+        NSMutableArray * errors = [NSMutableArray arrayWithCapacity:STRLoadOperationCount];
+        for (int i = 0; i < STRLoadOperationCount; i++) {
+            [latencies addObject:[NSMutableArray array]];
+            [errors addObject:[NSMutableDictionary dictionary]];
+        }
+
+        dispatch_apply(workers.unsignedIntegerValue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+            unsigned int seed = 20121019 + (unsigned int)worker;
+            for (int i = 0; i < kLoadOperationsPerWorker; i++) {
+                @autoreleasepool {
+                    STRLoadOperation operation = [self randomOperationWithSeed:&seed];
+                    uint64_t start = mach_absolute_time();
+                    NSString * failure = nil;
+                    @try {
+                        [self runOperation:operation tokens:tokens seed:&seed];
+                    }
+                    @catch (NSException * exception) {
+                        // A listing that races a delete can throw; count it instead of stopping the run
+                        failure = exception.name;
+                    }
+                    double elapsed = (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom / NSEC_PER_SEC;
+                    @synchronized(latencies) {
+                        if (failure) {
+                            NSMutableDictionary * operationErrors = [errors objectAtIndex:operation];
+                            [operationErrors setObject:@([[operationErrors objectForKey:failure] integerValue] + 1) forKey:failure];
+                        } else {
+                            [[latencies objectAtIndex:operation] addObject:@(elapsed)];
+                        }
+                    }
+                }
+            }
+        });
+
+        NSDictionary * parameters = @{ @"captures" : @(corpusSize), @"workers" : workers };
+        for (int i = 0; i < STRLoadOperationCount; i++) {
+            [STRBenchmark recordBenchmarkNamed:[@"load." stringByAppendingString:STRLoadOperationNames[i]] parameters:parameters latencies:[latencies objectAtIndex:i] extra:@{ @"errors" : [errors objectAtIndex:i] }];
+        }
+    }
+}
+
+@end
+
+@implementation STRCaptureStoreLoadBenchmarks (InternalMethods)
+
+-(STRLoadOperation)randomOperationWithSeed:(unsigned int *)seed {
+    int totalWeight = 0;
+    for (int i = 0; i < STRLoadOperationCount; i++) totalWeight += STRLoadOperationWeights[i];
+    int pick = rand_r(seed) % totalWeight;
+    for (int i = 0; i < STRLoadOperationCount; i++) {
+        pick -= STRLoadOperationWeights[i];
+        if (pick < 0) return (STRLoadOperation)i;
+    }
+    return STRLoadOperationTrack;
+}
+
+-(void)runOperation:(STRLoadOperation)operation tokens:(NSMutableArray *)tokens seed:(unsigned int *)seed {
+    STRCaptureFileManager * fileManager = [STRCaptureFileManager defaultManager];
+
+    // Operations on a single capture pick one that has not been deleted
+    NSString * token = nil;
+    if (operation == STRLoadOperationSave || operation == STRLoadOperationDelete || operation == STRLoadOperationTrack) {
+        @synchronized(tokens) {
+            if (tokens.count == 0) return;
+            NSUInteger index = rand_r(seed) % tokens.count;
+            token = [tokens objectAtIndex:index];
+            if (operation == STRLoadOperationDelete) [tokens removeObjectAtIndex:index];
+        }
+    }
+
+    switch (operation) {
+        case STRLoadOperationCreate: {
+            NSDictionary * attributes = @{
+            STRCaptureAttributeLatitude : @(39.96 + (rand_r(seed) % 1000) / 10000.0),
+            STRCaptureAttributeLongitude : @(-83.0 + (rand_r(seed) % 1000) / 10000.0)
+            };
+            STRCapture * capture = [fileManager newCaptureWithImageAtPath:_imagePath attributes:attributes];
+            if (capture) {
+                @synchronized(tokens) {
+                    [tokens addObject:capture.token];
+                }
+            }
+            break;
+        }
+        case STRLoadOperationList:
+            [fileManager allCapturesSorted:YES];
+            break;
+        case STRLoadOperationQuery:
+            [fileManager capturesOnDate:[[STRBenchmarkCorpus referenceDate] dateByAddingTimeInterval:-(rand_r(seed) % 365) * 24 * 60 * 60] sorted:YES];
+            break;
+        case STRLoadOperationRecent:
+            [fileManager recentCapturesWithLimit:@20];
+            break;
+        case STRLoadOperationSave: {
+            STRCapture * capture = [STRCapture captureWithToken:token];
+            capture.title = [NSString stringWithFormat:@"Capture %d", rand_r(seed) % 1000000];
+            [capture save];
+            break;
+        }
+        case STRLoadOperationDelete:
+            [fileManager deleteCaptureWithToken:token];
+            break;
+        case STRLoadOperationTrack:
+            [[STRCapture captureWithToken:token] geoDataPoints];
+            break;
+        default:
+            break;
+    }
+}
+
+@end
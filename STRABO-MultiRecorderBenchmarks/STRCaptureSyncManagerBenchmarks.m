@@ -0,0 +1,136 @@
+//
+//  STRCaptureSyncManagerBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureSyncManagerBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRLoopbackHTTPServer.h"
+#import "STRCaptureSyncManager.h"
+#import "STRCapturePathResolver.h"
+
+#include <mach/mach_time.h>
+
+#define kSyncIterations 5
+#define kSyncMediaSize (64 * 1024)
+// The server already holds all but one capture in this many
+#define kSyncMissingInterval 100
+
+@interface STRCaptureSyncManagerBenchmarks (InternalMethods)
+-(NSData *)manifestWithEntryCount:(NSUInteger)count;
+@end
+
+@implementation STRCaptureSyncManagerBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// Building a manifest from the captures directory, first hashing every file, then with the recorded checksums
+- (void)testBenchmarkManifestBuilding
+{
+    NSArray * sizes = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_SYNC_CAPTURES" defaultValues:@[ @1000, @10000 ]];
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    for (NSNumber * size in sizes) {
+        [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+        NSArray * tokens = [STRBenchmarkCorpus writeCapturesWithCount:size.unsignedIntegerValue pointsPerTrack:60 mediaSize:kSyncMediaSize];
+        STRCaptureSyncManager * syncManager = [[STRCaptureSyncManager alloc] init];
+        NSDictionary * parameters = @{ @"captures" : size, @"media_bytes" : @kSyncMediaSize };
+
+        uint64_t start = mach_absolute_time();
+        NSData * manifest = [syncManager manifestForCapturesWithTokens:tokens unreadableTokens:NULL];
+        uint64_t end = mach_absolute_time();
+        [STRBenchmark recordBenchmarkNamed:@"sync.manifest_first" parameters:parameters latencies:@[ @((double)(end - start) * timebase.numer / timebase.denom / NSEC_PER_SEC) ] extra:@{ @"manifest_bytes" : @(manifest.length) }];
+
+        __block NSUInteger entryCount = 0;
+        [STRBenchmark runBenchmarkNamed:@"sync.manifest" parameters:parameters iterations:kSyncIterations block:^{
+            entryCount = [[STRCaptureSyncManager digestsInManifest:[syncManager manifestForCapturesWithTokens:tokens unreadableTokens:NULL]] count];
+        }];
+        STAssertEquals(entryCount, size.unsignedIntegerValue, @"Every capture should be in the manifest");
+    }
+}
+
+// Posting a manifest to the loopback server, which reads it and answers with the missing captures
+- (void)testBenchmarkSyncRoundTrip
+{
+    NSArray * sizes = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_SYNC_MANIFEST_ENTRIES" defaultValues:@[ @10000, @100000 ]];
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    STRLoopbackHTTPServer * server = [[STRLoopbackHTTPServer alloc] init];
+    STAssertTrue([server start], @"The loopback server did not start");
+    server.responseBodyHandler = ^NSData * (NSData * requestBody) {
+        NSDictionary * digests = [STRCaptureSyncManager digestsInManifest:requestBody];
+        NSMutableArray * missing = [NSMutableArray arrayWithCapacity:digests.count / kSyncMissingInterval + 1];
+        for (NSString * token in digests) {
+            if ([[digests objectForKey:token] hash] % kSyncMissingInterval == 0) [missing addObject:token];
+        }
+        return [NSJSONSerialization dataWithJSONObject:@{ @"error" : @"false", @"missing" : missing } options:0 error:nil];
+    };
+
+    for (NSNumber * size in sizes) {
+        NSData * manifest = [self manifestWithEntryCount:size.unsignedIntegerValue];
+        NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:server.URL];
+        [request setHTTPMethod:@"POST"];
+        [request setValue:@"application/octet-stream" forHTTPHeaderField:@"Content-Type"];
+        [request setHTTPBody:manifest];
+
+        NSMutableArray * latencies = [NSMutableArray arrayWithCapacity:kSyncIterations];
+        NSUInteger missingCount = 0;
+        NSUInteger responseBytes = 0;
+        NSUInteger requestsBefore = server.requestCount;
+        for (NSUInteger i = 0; i < kSyncIterations; i++) {
+            @autoreleasepool {
+                uint64_t start = mach_absolute_time();
+                NSData * response = [NSURLConnection sendSynchronousRequest:request returningResponse:NULL error:NULL];
+                NSDictionary * responseDict = (response) ? [NSJSONSerialization JSONObjectWithData:response options:0 error:nil] : nil;
+                NSSet * missing = [NSSet setWithArray:[responseDict objectForKey:@"missing"]];
+                uint64_t end = mach_absolute_time();
+                [latencies addObject:@((double)(end - start) * timebase.numer / timebase.denom / NSEC_PER_SEC)];
+                missingCount = missing.count;
+                responseBytes = response.length;
+            }
+        }
+        STAssertEquals(server.requestCount - requestsBefore, (NSUInteger)kSyncIterations, @"Each sync should take a single request");
+        STAssertTrue(missingCount > 0 && missingCount < size.unsignedIntegerValue, @"Some captures should be missing");
+        NSDictionary * extra = @{ @"manifest_bytes" : @(manifest.length), @"response_bytes" : @(responseBytes), @"missing" : @(missingCount) };
+        [STRBenchmark recordBenchmarkNamed:@"sync.round_trip" parameters:@{ @"entries" : size } latencies:latencies extra:extra];
+    }
+    [server stop];
+}
+
+@end
+
+@implementation STRCaptureSyncManagerBenchmarks (InternalMethods)
+
+-(NSData *)manifestWithEntryCount:(NSUInteger)count {
+    // The format described in the Underlying Mechanics guide, with time-ordered tokens and random digests
+    NSMutableData * manifest = [NSMutableData dataWithCapacity:10 + count * 25];
+    uint8_t header[10] = { 'S', 'T', 'R', 'M', 1, 8, (uint8_t)(count >> 24), (uint8_t)(count >> 16), (uint8_t)(count >> 8), (uint8_t)count };
+    [manifest appendBytes:header length:sizeof(header)];
+    uint64_t milliseconds = (uint64_t)([[STRBenchmarkCorpus referenceDate] timeIntervalSince1970] * 1000);
+    srandom(11);
+    for (NSUInteger i = 0; i < count; i++) {
+        uint8_t entry[25];
+        entry[0] = 16;
+        uint64_t time = milliseconds + i * 60000;
+        for (NSUInteger j = 0; j < 6; j++) entry[1 + j] = (uint8_t)(time >> (8 * (5 - j)));
+        for (NSUInteger j = 7; j < 25; j++) entry[j] = (uint8_t)random();
+        [manifest appendBytes:entry length:sizeof(entry)];
+    }
+    return manifest;
+}
+
+@end
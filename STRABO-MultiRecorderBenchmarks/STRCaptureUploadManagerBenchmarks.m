@@ -0,0 +1,231 @@
+//
+//  STRCaptureUploadManagerBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureUploadManagerBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRLoopbackHTTPServer.h"
+#import "STRCaptureUploadManager.h"
+
+#define kBuildIterations 10
+#define kSendIterations 5
+#define kUploadTimeout 120
+#define kTrackPoints 600
+#define kBatchMediaSize (50 * 1024)
+
+// Exposes the request building step so that it can be timed on its own
+@interface STRCaptureUploadManager (BenchmarkAccess)
+-(BOOL)generateUploadRequestForCapture:(STRCapture *)capture;
+@end
+
+@interface STRCaptureUploadManagerBenchmarks () <STRCaptureUploadManagerDelegate> {
+    STRLoopbackHTTPServer * server;
+    BOOL uploadFinished;
+    BOOL uploadSucceeded;
+    BOOL batchRunning;
+    NSArray * batchUploadedTokens;
+    NSArray * batchFailedTokens;
+}
+
+@end
+
+@implementation STRCaptureUploadManagerBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+    server = [[STRLoopbackHTTPServer alloc] init];
+    STAssertTrue([server start], @"The loopback server did not start");
+}
+
+- (void)tearDown
+{
+    [server stop];
+    server = nil;
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+- (void)testBenchmarkRequestBuilding
+{
+    for (NSNumber * mediaSize in [self mediaSizes]) {
+        STRCapture * capture = [STRCapture captureWithToken:[STRBenchmarkCorpus writeCaptureWithPoints:kTrackPoints mediaSize:mediaSize.unsignedIntegerValue date:[STRBenchmarkCorpus referenceDate]]];
+        STRCaptureUploadManager * uploadManager = [STRCaptureUploadManager defaultManager];
+        uploadManager.uploadURL = server.URL;
+        __block BOOL built = NO;
+        [STRBenchmark runBenchmarkNamed:@"upload_manager.build_request" parameters:@{ @"media_bytes" : mediaSize, @"points" : @kTrackPoints } iterations:kBuildIterations block:^{
+            built = [uploadManager generateUploadRequestForCapture:capture];
+        }];
+        STAssertTrue(built, @"The upload request was not built");
+    }
+}
+
+- (void)testBenchmarkSending
+{
+    for (NSNumber * mediaSize in [self mediaSizes]) {
+        STRCapture * capture = [STRCapture captureWithToken:[STRBenchmarkCorpus writeCaptureWithPoints:kTrackPoints mediaSize:mediaSize.unsignedIntegerValue date:[STRBenchmarkCorpus referenceDate]]];
+        NSUInteger requestsBefore = server.requestCount;
+        __block NSUInteger successes = 0;
+        [STRBenchmark runBenchmarkNamed:@"upload_manager.send" parameters:@{ @"media_bytes" : mediaSize, @"points" : @kTrackPoints } iterations:kSendIterations block:^{
+            STRCaptureUploadManager * uploadManager = [STRCaptureUploadManager defaultManager];
+            uploadManager.uploadURL = server.URL;
+            uploadManager.delegate = self;
+            if ([self runUploadWithManager:uploadManager capture:capture]) successes++;
+        }];
+        STAssertEquals(successes, (NSUInteger)kSendIterations, @"Not every upload succeeded");
+        STAssertEquals(server.requestCount - requestsBefore, (NSUInteger)kSendIterations, @"The server did not receive every upload");
+    }
+}
+
+// A backlog of small image captures against a server that takes a realistic
+// time to answer each request. Captures per second is captures / wall_time.total.
+- (void)testBenchmarkBatchSending
+{
+    NSUInteger captureCount = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_BATCH_CAPTURES" defaultValues:@[ @200 ]] objectAtIndex:0] unsignedIntegerValue];
+    NSUInteger latency = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_SERVER_LATENCY_MS" defaultValues:@[ @150 ]] objectAtIndex:0] unsignedIntegerValue];
+    server.responseDelay = latency / 1000.0;
+    server.responseBodyHandler = ^NSData *(NSData * requestBody) {
+        return [STRCaptureUploadManagerBenchmarks batchResponseForRequestBody:requestBody failingTokens:nil];
+    };
+    NSMutableArray * captures = [NSMutableArray arrayWithCapacity:captureCount];
+    for (NSString * token in [STRBenchmarkCorpus writeCapturesWithCount:captureCount pointsPerTrack:1 mediaSize:kBatchMediaSize]) {
+        [captures addObject:[STRCapture captureWithToken:token]];
+    }
+    NSDictionary * parameters = @{ @"captures" : @(captureCount), @"media_bytes" : @kBatchMediaSize, @"server_latency_ms" : @(latency) };
+
+    __block NSUInteger successes = 0;
+    [STRBenchmark runBenchmarkNamed:@"upload_manager.send_one_by_one" parameters:parameters iterations:1 block:^{
+        for (STRCapture * capture in captures) {
+            STRCaptureUploadManager * uploadManager = [STRCaptureUploadManager defaultManager];
+            uploadManager.uploadURL = server.URL;
+            uploadManager.delegate = self;
+            if ([self runUploadWithManager:uploadManager capture:capture]) successes++;
+        }
+    }];
+    STAssertEquals(successes, captureCount, @"Not every capture was uploaded one by one");
+
+    NSUInteger requestsBefore = server.requestCount;
+    [STRBenchmark runBenchmarkNamed:@"upload_manager.send_batch" parameters:parameters iterations:1 block:^{
+        STRCaptureUploadManager * uploadManager = [STRCaptureUploadManager defaultManager];
+        uploadManager.batchUploadURL = server.URL;
+        uploadManager.delegate = self;
+        [self runBatchUploadWithManager:uploadManager captures:captures];
+    }];
+    STAssertEquals(batchUploadedTokens.count, captureCount, @"Not every capture was uploaded in batches");
+    STAssertTrue(server.requestCount - requestsBefore < captureCount, @"Captures were not packed into batches");
+}
+
+- (void)testBatchRetriesOnlyFailedCaptures
+{
+    NSArray * tokens = [STRBenchmarkCorpus writeCapturesWithCount:10 pointsPerTrack:1 mediaSize:kBatchMediaSize];
+    NSMutableArray * captures = [NSMutableArray arrayWithCapacity:tokens.count];
+    for (NSString * token in tokens) {
+        [captures addObject:[STRCapture captureWithToken:token]];
+    }
+    // The server rejects two captures the first time it sees them
+    NSMutableSet * failingTokens = [NSMutableSet setWithObjects:[tokens objectAtIndex:2], [tokens objectAtIndex:5], nil];
+    server.responseBodyHandler = ^NSData *(NSData * requestBody) {
+        @synchronized(failingTokens) {
+            return [STRCaptureUploadManagerBenchmarks batchResponseForRequestBody:requestBody failingTokens:failingTokens];
+        }
+    };
+
+    NSUInteger requestsBefore = server.requestCount;
+    STRCaptureUploadManager * uploadManager = [STRCaptureUploadManager defaultManager];
+    uploadManager.batchUploadURL = server.URL;
+    uploadManager.delegate = self;
+    [self runBatchUploadWithManager:uploadManager captures:captures];
+
+    STAssertEquals(batchUploadedTokens.count, (NSUInteger)10, @"Every capture should be uploaded in the end");
+    STAssertEquals(batchFailedTokens.count, (NSUInteger)0, @"No capture should be given up on");
+    STAssertEquals(server.requestCount - requestsBefore, (NSUInteger)2, @"The failed captures should be sent again in one more request");
+    NSArray * resent = [STRCaptureUploadManagerBenchmarks manifestTokensOfRequestBody:server.lastRequestBody];
+    STAssertEqualObjects([NSSet setWithArray:resent], ([NSSet setWithObjects:[tokens objectAtIndex:2], [tokens objectAtIndex:5], nil]), @"Only the failed captures should be sent again");
+}
+
+#pragma mark - Helpers
+
++(NSArray *)manifestTokensOfRequestBody:(NSData *)body {
+    NSData * marker = [@"name=\"manifest\"" dataUsingEncoding:NSUTF8StringEncoding];
+    NSRange manifestRange = [body rangeOfData:marker options:0 range:NSMakeRange(0, body.length)];
+    if (manifestRange.location == NSNotFound) return nil;
+    NSRange start = [body rangeOfData:[@"\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding] options:0 range:NSMakeRange(NSMaxRange(manifestRange), body.length - NSMaxRange(manifestRange))];
+    NSRange end = [body rangeOfData:[@"\r\n--" dataUsingEncoding:NSUTF8StringEncoding] options:0 range:NSMakeRange(NSMaxRange(start), body.length - NSMaxRange(start))];
+    NSData * manifest = [body subdataWithRange:NSMakeRange(NSMaxRange(start), end.location - NSMaxRange(start))];
+    return [[NSJSONSerialization JSONObjectWithData:manifest options:0 error:nil] objectForKey:@"tokens"];
+}
+
+// Fails each token in failingTokens once, and removes it from the set
++(NSData *)batchResponseForRequestBody:(NSData *)body failingTokens:(NSMutableSet *)failingTokens {
+    NSMutableArray * results = [NSMutableArray array];
+    for (NSString * token in [self manifestTokensOfRequestBody:body]) {
+        BOOL fails = [failingTokens containsObject:token];
+        [failingTokens removeObject:token];
+        [results addObject:@{ @"token" : token, @"error" : (fails) ? @"true" : @"false", @"message" : (fails) ? @"Rejected by the benchmark server" : @"" }];
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{ @"error" : @"false", @"message" : @"", @"results" : results } options:0 error:nil];
+}
+
+-(void)runBatchUploadWithManager:(STRCaptureUploadManager *)uploadManager captures:(NSArray *)captures {
+    uploadFinished = NO;
+    batchRunning = YES;
+    batchUploadedTokens = nil;
+    batchFailedTokens = nil;
+    [uploadManager beginBatchUploadForCaptures:captures];
+    NSDate * timeout = [NSDate dateWithTimeIntervalSinceNow:kUploadTimeout];
+    while (!uploadFinished && [timeout timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    if (!uploadFinished) [uploadManager cancelCurrentUpload];
+    batchRunning = NO;
+}
+
+-(NSArray *)mediaSizes {
+    return [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_MEDIA_SIZES" defaultValues:@[ @(100 * 1024), @(1024 * 1024), @(10 * 1024 * 1024) ]];
+}
+
+-(BOOL)runUploadWithManager:(STRCaptureUploadManager *)uploadManager capture:(STRCapture *)capture {
+    uploadFinished = NO;
+    uploadSucceeded = NO;
+    [uploadManager beginUploadForCapture:capture];
+    NSDate * timeout = [NSDate dateWithTimeIntervalSinceNow:kUploadTimeout];
+    while (!uploadFinished && [timeout timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    if (!uploadFinished) [uploadManager cancelCurrentUpload];
+    return uploadSucceeded;
+}
+
+#pragma mark - STRCaptureUploadManagerDelegate
+
+-(void)fileUploadedSuccessfullyWithToken:(NSString *)token {
+    uploadSucceeded = YES;
+    // A batch upload reports each capture, and finishes separately
+    if (!batchRunning) uploadFinished = YES;
+}
+
+-(void)batchUploadDidFinishWithUploadedTokens:(NSArray *)uploadedTokens failedTokens:(NSArray *)failedTokens {
+    batchUploadedTokens = uploadedTokens;
+    batchFailedTokens = failedTokens;
+    uploadFinished = YES;
+}
+
+-(void)fileUploadFailedToStart {
+    uploadFinished = YES;
+}
+
+-(void)fileUploadDidFailWithError:(NSError *)error {
+    uploadFinished = YES;
+}
+
+-(void)fileUploadDidStop {
+    uploadFinished = YES;
+}
+
+@end
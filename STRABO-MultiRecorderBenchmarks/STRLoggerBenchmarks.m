@@ -0,0 +1,71 @@
+//
+//  STRLoggerBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRLoggerBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRLogger.h"
+
+#define kDisabledMessages 10000000
+#define kEnabledMessages 100000
+#define kSettingsLookups 1000
+
+@implementation STRLoggerBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRLogger setConsoleOutputEnabled:NO];
+}
+
+- (void)tearDown
+{
+    [STRLogger flush];
+    [STRLogger setLevel:STRLogLevelWarning];
+    [STRLogger setConsoleOutputEnabled:YES];
+    [super tearDown];
+}
+
+- (void)testBenchmarkDisabledLogging
+{
+    [STRLogger setLevel:STRLogLevelInfo];
+    [STRBenchmark runBenchmarkNamed:@"logger.disabled" parameters:@{ @"messages" : @kDisabledMessages } iterations:1 block:^{
+        for (NSUInteger i = 0; i < kDisabledMessages; i++) {
+            STRLogTrace(STRLogCategoryPlayback, @"Location: %f, %f Heading: %@", (double)i, (double)i, @(i));
+        }
+    }];
+}
+
+- (void)testBenchmarkEnabledLogging
+{
+    [STRLogger setLevel:STRLogLevelTrace];
+    NSUInteger droppedBefore = [STRLogger droppedMessageCount];
+    [STRBenchmark runBenchmarkNamed:@"logger.enabled" parameters:@{ @"messages" : @kEnabledMessages } iterations:1 block:^{
+        for (NSUInteger i = 0; i < kEnabledMessages; i++) {
+            STRLogTrace(STRLogCategoryPlayback, @"Location: %f, %f Heading: %@", (double)i, (double)i, @(i));
+        }
+    }];
+    NSUInteger dropped = [STRLogger droppedMessageCount] - droppedBefore;
+    [STRBenchmark runBenchmarkNamed:@"logger.enabled_drained" parameters:@{ @"messages" : @kEnabledMessages, @"dropped" : @(dropped) } iterations:1 block:^{
+        [STRLogger flush];
+    }];
+}
+
+- (void)testBenchmarkSettingsLookupPerMessage
+{
+    // The pattern the logger replaced: read the settings before every message. The
+    // settings are cached now, so the plist is parsed here as sharedSettings used to
+    __block NSUInteger logged = 0;
+    NSString * settingsPath = [[NSBundle mainBundle] pathForResource:@"STRSettings" ofType:@"plist"];
+    [STRBenchmark runBenchmarkNamed:@"logger.settings_lookup_per_message" parameters:@{ @"messages" : @kSettingsLookups } iterations:1 block:^{
+        for (NSUInteger i = 0; i < kSettingsLookups; i++) {
+            if ([[[NSDictionary dictionaryWithContentsOfFile:settingsPath] objectForKey:@"Advanced_Logging"] boolValue]) logged++;
+        }
+    }];
+}
+
+@end
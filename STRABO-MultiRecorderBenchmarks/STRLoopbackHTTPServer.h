@@ -0,0 +1,75 @@
+//
+//  STRLoopbackHTTPServer.h
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ A minimal HTTP server on the loopback interface, used in place of the upload server.
+
+ The server listens on 127.0.0.1 on a port chosen by the system. It reads each request completely, including bodies sent with a Content-Length or in chunks, answers with responseStatusCode and responseBody, and closes the connection. Requests are handled on background queues, so the run loop of the thread that uploads stays free.
+ */
+@interface STRLoopbackHTTPServer : NSObject
+
+/**
+ The URL to send requests to. Nil until the server is started.
+ */
+@property(readonly)NSURL * URL;
+
+/**
+ The status code of every response. Defaults to 200.
+ */
+@property(assign)NSInteger responseStatusCode;
+
+/**
+ Chooses the status code of each response, in place of responseStatusCode. Called on a background queue with the number of the request, counting from 1 since the server was created. Defaults to nil.
+ */
+@property(copy)NSInteger (^responseStatusCodeHandler)(NSUInteger requestNumber);
+
+/**
+ The body of every response. Defaults to a JSON body that STRCaptureUploadManager accepts as a successful upload.
+ */
+@property(copy)NSData * responseBody;
+
+/**
+ Builds the body of the response to each request, in place of responseBody. Called on a background queue with the request body. Defaults to nil.
+ */
+@property(copy)NSData * (^responseBodyHandler)(NSData * requestBody);
+
+/**
+ Seconds to wait between reading a request and answering it, to stand in for the network round trip and the server's own work. Defaults to 0.
+ */
+@property(assign)NSTimeInterval responseDelay;
+
+/**
+ The number of requests that have been read completely.
+ */
+@property(readonly)NSUInteger requestCount;
+
+/**
+ The total number of body bytes received.
+ */
+@property(readonly)unsigned long long receivedBodyBytes;
+
+/**
+ The body of the most recent request.
+ */
+@property(readonly)NSData * lastRequestBody;
+
+/**
+ Starts listening.
+
+ @return BOOL YES if the server is listening.
+ */
+-(BOOL)start;
+
+/**
+ Stops listening. Requests that are being handled are finished.
+ */
+-(void)stop;
+
+@end
@@ -0,0 +1,203 @@
+//
+//  STRLoopbackHTTPServer.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRLoopbackHTTPServer.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define kSTRReadBufferSize (64 * 1024)
+
+@interface STRLoopbackHTTPServer () {
+    int _listeningSocket;
+    dispatch_source_t _acceptSource;
+    dispatch_queue_t _stateQueue;
+}
+
+@property(readwrite)NSURL * URL;
+@property(readwrite)NSUInteger requestCount;
+@property(readwrite)unsigned long long receivedBodyBytes;
+@property(readwrite)NSData * lastRequestBody;
+
+@end
+
+@interface STRLoopbackHTTPServer (InternalMethods)
+-(void)handleConnection:(int)connection;
+-(NSData *)readBodyFromConnection:(int)connection buffer:(NSMutableData *)buffer headers:(NSString *)headers;
+-(BOOL)readFromConnection:(int)connection intoBuffer:(NSMutableData *)buffer;
+@end
+
+@implementation STRLoopbackHTTPServer
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _listeningSocket = -1;
+        _stateQueue = dispatch_queue_create("com.strabogis.loopbackserver", DISPATCH_QUEUE_SERIAL);
+        _responseStatusCode = 200;
+        _responseBody = [@"{\"error\":\"false\",\"message\":\"\",\"token\":\"benchmark\"}" dataUsingEncoding:NSUTF8StringEncoding];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stop];
+}
+
+-(BOOL)start {
+    if (_listeningSocket >= 0) return YES;
+
+    _listeningSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listeningSocket < 0) return NO;
+    int reuse = 1;
+    setsockopt(_listeningSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if (bind(_listeningSocket, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(_listeningSocket, 16) != 0 || getsockname(_listeningSocket, (struct sockaddr *)&address, &addressLength) != 0) {
+        close(_listeningSocket);
+        _listeningSocket = -1;
+        return NO;
+    }
+    self.URL = [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%d/upload", ntohs(address.sin_port)]];
+
+    int listeningSocket = _listeningSocket;
+    __weak STRLoopbackHTTPServer * weakSelf = self;
+    _acceptSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, listeningSocket, 0, _stateQueue);
+    dispatch_source_set_event_handler(_acceptSource, ^{
+        int connection = accept(listeningSocket, NULL, NULL);
+        if (connection < 0) return;
+        int noSigPipe = 1;
+        setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [weakSelf handleConnection:connection];
+            close(connection);
+        });
+    });
+    dispatch_source_set_cancel_handler(_acceptSource, ^{
+        close(listeningSocket);
+    });
+    dispatch_resume(_acceptSource);
+    return YES;
+}
+
+-(void)stop {
+    if (_listeningSocket < 0) return;
+    dispatch_source_cancel(_acceptSource);
+    _acceptSource = nil;
+    _listeningSocket = -1;
+}
+
+@end
+
+@implementation STRLoopbackHTTPServer (InternalMethods)
+
+-(void)handleConnection:(int)connection {
+    NSMutableData * buffer = [NSMutableData data];
+    NSData * headerTerminator = [@"\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding];
+
+    // Read up to the end of the headers
+    NSRange headerEnd;
+    for (;;) {
+        headerEnd = [buffer rangeOfData:headerTerminator options:0 range:NSMakeRange(0, buffer.length)];
+        if (headerEnd.location != NSNotFound) break;
+        if (![self readFromConnection:connection intoBuffer:buffer]) return;
+    }
+    NSString * headers = [[NSString alloc] initWithData:[buffer subdataWithRange:NSMakeRange(0, headerEnd.location)] encoding:NSUTF8StringEncoding];
+    [buffer replaceBytesInRange:NSMakeRange(0, NSMaxRange(headerEnd)) withBytes:NULL length:0];
+
+    if ([headers rangeOfString:@"Expect: 100-continue" options:NSCaseInsensitiveSearch].location != NSNotFound) {
+        const char * continueResponse = "HTTP/1.1 100 Continue\r\n\r\n";
+        write(connection, continueResponse, strlen(continueResponse));
+    }
+
+    NSData * body = [self readBodyFromConnection:connection buffer:buffer headers:headers];
+    if (!body) return;
+
+    __block NSUInteger requestNumber;
+    dispatch_sync(_stateQueue, ^{
+        self.requestCount = self.requestCount + 1;
+        requestNumber = self.requestCount;
+        self.receivedBodyBytes = self.receivedBodyBytes + body.length;
+        self.lastRequestBody = body;
+    });
+
+    if (self.responseDelay > 0) [NSThread sleepForTimeInterval:self.responseDelay];
+    NSData * (^responseBodyHandler)(NSData *) = self.responseBodyHandler;
+    NSData * responseBody = (responseBodyHandler) ? responseBodyHandler(body) : self.responseBody;
+    NSInteger (^responseStatusCodeHandler)(NSUInteger) = self.responseStatusCodeHandler;
+    NSInteger statusCode = (responseStatusCodeHandler) ? responseStatusCodeHandler(requestNumber) : self.responseStatusCode;
+    NSString * responseHeaders = [NSString stringWithFormat:@"HTTP/1.1 %ld Benchmark\r\nContent-Type: application/json\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n", (long)statusCode, (unsigned long)responseBody.length];
+    NSMutableData * response = [[responseHeaders dataUsingEncoding:NSUTF8StringEncoding] mutableCopy];
+    [response appendData:responseBody];
+    const uint8_t * bytes = response.bytes;
+    NSUInteger written = 0;
+    while (written < response.length) {
+        ssize_t result = write(connection, bytes + written, response.length - written);
+        if (result <= 0) return;
+        written += result;
+    }
+}
+
+-(NSData *)readBodyFromConnection:(int)connection buffer:(NSMutableData *)buffer headers:(NSString *)headers {
+    NSUInteger contentLength = 0;
+    BOOL chunked = NO;
+    for (NSString * line in [headers componentsSeparatedByString:@"\r\n"]) {
+        NSRange colon = [line rangeOfString:@":"];
+        if (colon.location == NSNotFound) continue;
+        NSString * name = [[line substringToIndex:colon.location] lowercaseString];
+        NSString * value = [[line substringFromIndex:colon.location + 1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if ([name isEqualToString:@"content-length"]) contentLength = (NSUInteger)[value longLongValue];
+        if ([name isEqualToString:@"transfer-encoding"] && [[value lowercaseString] isEqualToString:@"chunked"]) chunked = YES;
+    }
+
+    if (!chunked) {
+        while (buffer.length < contentLength) {
+            if (![self readFromConnection:connection intoBuffer:buffer]) return nil;
+        }
+        return [buffer subdataWithRange:NSMakeRange(0, contentLength)];
+    }
+
+    // Chunked body: a hex size line, the data, and a CRLF, until a chunk of size zero
+    NSMutableData * body = [NSMutableData data];
+    NSData * lineTerminator = [@"\r\n" dataUsingEncoding:NSUTF8StringEncoding];
+    for (;;) {
+        NSRange lineEnd;
+        while ((lineEnd = [buffer rangeOfData:lineTerminator options:0 range:NSMakeRange(0, buffer.length)]).location == NSNotFound) {
+            if (![self readFromConnection:connection intoBuffer:buffer]) return nil;
+        }
+        NSString * sizeLine = [[NSString alloc] initWithData:[buffer subdataWithRange:NSMakeRange(0, lineEnd.location)] encoding:NSUTF8StringEncoding];
+        NSUInteger chunkSize = (NSUInteger)strtoul([sizeLine UTF8String], NULL, 16);
+        [buffer replaceBytesInRange:NSMakeRange(0, NSMaxRange(lineEnd)) withBytes:NULL length:0];
+        if (chunkSize == 0) return body;
+        while (buffer.length < chunkSize + 2) {
+            if (![self readFromConnection:connection intoBuffer:buffer]) return nil;
+        }
+        [body appendData:[buffer subdataWithRange:NSMakeRange(0, chunkSize)]];
+        [buffer replaceBytesInRange:NSMakeRange(0, chunkSize + 2) withBytes:NULL length:0];
+    }
+}
+
+-(BOOL)readFromConnection:(int)connection intoBuffer:(NSMutableData *)buffer {
+    uint8_t bytes[kSTRReadBufferSize];
+    ssize_t count = read(connection, bytes, sizeof(bytes));
+    if (count <= 0) return NO;
+    [buffer appendBytes:bytes length:count];
+    return YES;
+}
+
+@end
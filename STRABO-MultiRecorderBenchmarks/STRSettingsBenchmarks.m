@@ -0,0 +1,91 @@
+//
+//  STRSettingsBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRSettingsBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCapture.h"
+#import "STRSettings.h"
+
+#import <libkern/OSAtomic.h>
+
+#define kSettingsIterations 3
+#define kSettingsPointsPerTrack 10
+#define kSettingsMediaSize 16
+#define kSettingsLookups 1000000
+
+@implementation STRSettingsBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// A list that loads each capture and reads a setting for it, as captureFromFilesAtDirectory:
+// did for its logging, first parsing STRSettings.plist for every capture as sharedSettings
+// used to and then reading the cached snapshot
+- (void)testBenchmarkCaptureListing
+{
+    NSArray * sizes = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_SETTINGS_CAPTURES" defaultValues:@[ @1000, @10000 ]];
+    NSString * settingsPath = [[NSBundle mainBundle] pathForResource:@"STRSettings" ofType:@"plist"];
+    for (NSNumber * size in sizes) {
+        [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+        NSArray * tokens = [STRBenchmarkCorpus writeCapturesWithCount:size.unsignedIntegerValue pointsPerTrack:kSettingsPointsPerTrack mediaSize:kSettingsMediaSize];
+        NSDictionary * parameters = @{ @"captures" : @(tokens.count) };
+        __block NSUInteger perCallListed = 0, snapshotListed = 0;
+
+        [STRBenchmark runBenchmarkNamed:@"settings.list_per_call_parse" parameters:parameters iterations:kSettingsIterations block:^{
+            perCallListed = 0;
+            for (NSString * token in tokens) {
+                @autoreleasepool {
+                    STRCapture * capture = [STRCapture captureWithToken:token];
+                    BOOL advancedLogging = [[[NSDictionary dictionaryWithContentsOfFile:settingsPath] objectForKey:@"Advanced_Logging"] boolValue];
+                    if (capture) perCallListed += 1 + advancedLogging;
+                }
+            }
+        }];
+
+        [STRBenchmark runBenchmarkNamed:@"settings.list_snapshot" parameters:parameters iterations:kSettingsIterations block:^{
+            snapshotListed = 0;
+            for (NSString * token in tokens) {
+                @autoreleasepool {
+                    STRCapture * capture = [STRCapture captureWithToken:token];
+                    BOOL advancedLogging = [[STRSettings sharedSettings] advancedLogging];
+                    if (capture) snapshotListed += 1 + advancedLogging;
+                }
+            }
+        }];
+        STAssertEquals(snapshotListed, perCallListed, @"Both lists should load every capture");
+    }
+}
+
+// The cost of one read of a setting, with every core reading at once
+- (void)testBenchmarkSettingsLookup
+{
+    NSUInteger threads = [[NSProcessInfo processInfo] activeProcessorCount];
+    __block volatile int64_t total = 0;
+    [STRBenchmark runBenchmarkNamed:@"settings.lookup" parameters:@{ @"lookups_per_thread" : @kSettingsLookups, @"threads" : @(threads) } iterations:kSettingsIterations block:^{
+        dispatch_apply(threads, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+            // Summed so that the reads cannot be optimized away
+            int64_t sum = 0;
+            for (NSUInteger i = 0; i < kSettingsLookups; i++) {
+                sum += [[STRSettings sharedSettings] parallelBatchSize];
+            }
+            OSAtomicAdd64Barrier(sum, &total);
+        });
+    }];
+}
+
+@end
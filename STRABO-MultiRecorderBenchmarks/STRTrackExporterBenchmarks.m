@@ -0,0 +1,87 @@
+//
+//  STRTrackExporterBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackExporterBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCapture.h"
+#import "STRCaptureFileManager.h"
+#import "STRTrackExporter.h"
+
+#define kExportIterations 3
+#define kBatchCaptureCount 1000
+#define kBatchPointsPerTrack 600
+
+@interface STRTrackExporterBenchmarks () {
+    NSString * _exportPath;
+}
+@end
+
+@implementation STRTrackExporterBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+    _exportPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRTrackExporterBenchmarks"];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_exportPath error:nil];
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// Long single tracks: points per second, and peak_rss should not grow with the track
+- (void)testBenchmarkExportLongTrack
+{
+    NSArray * lengths = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_EXPORT_POINTS" defaultValues:@[ @100000, @1000000 ]];
+    for (NSNumber * length in lengths) {
+        NSString * token = [STRBenchmarkCorpus writeCaptureWithPoints:length.unsignedIntegerValue mediaSize:1024 date:[STRBenchmarkCorpus referenceDate]];
+        STRCapture * capture = [STRCapture captureWithToken:token];
+
+        for (NSNumber * format in @[ @(STRTrackExportFormatGeoJSON), @(STRTrackExportFormatGPX), @(STRTrackExportFormatKML) ]) {
+            STRTrackExporter * exporter = [STRTrackExporter exporterWithFormat:format.intValue];
+            NSString * path = [_exportPath stringByAppendingPathExtension:[exporter pathExtension]];
+            NSString * name = [NSString stringWithFormat:@"export.track_%@", [exporter pathExtension]];
+            __block BOOL success = NO;
+
+            [STRBenchmark runBenchmarkNamed:name parameters:@{ @"points" : length } iterations:kExportIterations block:^{
+                success = [exporter exportCapture:capture toPath:path];
+            }];
+            STAssertTrue(success, @"The export failed");
+            STAssertEquals(exporter.pointsWritten, length.unsignedIntegerValue, @"Not every point was exported");
+            [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        }
+        [[STRCaptureFileManager defaultManager] deleteCaptureWithToken:token];
+    }
+}
+
+// Many ordinary captures in one file, as the GIS team exports them
+- (void)testBenchmarkExportBatch
+{
+    [STRBenchmarkCorpus writeCapturesWithCount:kBatchCaptureCount pointsPerTrack:kBatchPointsPerTrack mediaSize:1024];
+    NSArray * captures = [[STRCaptureFileManager defaultManager] allCapturesSorted:YES];
+    NSDictionary * parameters = @{ @"captures" : @(captures.count), @"points" : @(kBatchPointsPerTrack) };
+
+    for (NSNumber * format in @[ @(STRTrackExportFormatGeoJSON), @(STRTrackExportFormatGPX), @(STRTrackExportFormatKML) ]) {
+        STRTrackExporter * exporter = [STRTrackExporter exporterWithFormat:format.intValue];
+        NSString * path = [_exportPath stringByAppendingPathExtension:[exporter pathExtension]];
+        NSString * name = [NSString stringWithFormat:@"export.batch_%@", [exporter pathExtension]];
+        __block BOOL success = NO;
+
+        [STRBenchmark runBenchmarkNamed:name parameters:parameters iterations:kExportIterations block:^{
+            success = [exporter exportCaptures:captures toPath:path];
+        }];
+        STAssertTrue(success, @"The export failed");
+        [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    }
+}
+
+@end
@@ -0,0 +1,151 @@
+//
+//  STRTrackFilterBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackFilterBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCapture.h"
+#import "STRGeoLocationData.h"
+#import "STRTrackFilter.h"
+
+#include <mach/mach_time.h>
+
+#define kFilterIterations 5
+// Latencies are timed over blocks of samples, since one sample is faster than the clock is fine
+#define kFilterLatencyBlock 1000
+// The compass updates about ten times as often as the location
+#define kHeadingUpdatesPerFix 10
+
+@interface STRTrackFilterBenchmarks (InternalMethods)
+-(STRTrackSample *)newReplayTrackWithCount:(NSUInteger)count;
+@end
+
+@implementation STRTrackFilterBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// Replays recorded samples one at a time, as STRGeoLocationData does while recording.
+// Divide the wall time by the points for the cost of one sample.
+- (void)testBenchmarkFilterSample
+{
+    NSArray * lengths = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_FILTER_POINTS" defaultValues:@[ @100000, @1000000 ]];
+    for (NSNumber * length in lengths) {
+        NSUInteger count = length.unsignedIntegerValue;
+        STRTrackSample * samples = [self newReplayTrackWithCount:count];
+        __block double checksum = 0;
+
+        [STRBenchmark runBenchmarkNamed:@"track_filter.filter_sample" parameters:@{ @"points" : length } iterations:kFilterIterations block:^{
+            STRTrackFilter * filter = [[STRTrackFilter alloc] init];
+            for (NSUInteger i = 0; i < count; i++) {
+                checksum += [filter filterSample:samples[i]].latitude;
+            }
+        }];
+        STAssertFalse(isnan(checksum), @"The filter produced NaN");
+
+        // The spread matters as much as the mean for a filter on the recording path
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        NSMutableArray * latencies = [NSMutableArray arrayWithCapacity:count / kFilterLatencyBlock];
+        STRTrackFilter * filter = [[STRTrackFilter alloc] init];
+        for (NSUInteger block = 0; block + kFilterLatencyBlock <= count; block += kFilterLatencyBlock) {
+            uint64_t start = mach_absolute_time();
+            for (NSUInteger i = block; i < block + kFilterLatencyBlock; i++) {
+                checksum += [filter filterSample:samples[i]].latitude;
+            }
+            double elapsed = (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom / NSEC_PER_SEC;
+            [latencies addObject:@(elapsed / kFilterLatencyBlock)];
+        }
+        [STRBenchmark recordBenchmarkNamed:@"track_filter.filter_sample_latency" parameters:@{ @"points" : length } latencies:latencies extra:@{ @"samples_per_block" : @kFilterLatencyBlock }];
+
+        free(samples);
+    }
+}
+
+// The whole recording path: the raw point, the filtered point and both dictionaries
+- (void)testBenchmarkRecordWithFilter
+{
+    NSUInteger count = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_FILTER_POINTS" defaultValues:@[ @100000 ]] objectAtIndex:0] unsignedIntegerValue];
+    STRTrackSample * samples = [self newReplayTrackWithCount:count];
+
+    [STRBenchmark runBenchmarkNamed:@"track_filter.record_point" parameters:@{ @"points" : @(count) } iterations:kFilterIterations block:^{
+        STRGeoLocationData * geoData = [[STRGeoLocationData alloc] init];
+        for (NSUInteger i = 0; i < count; i++) {
+            [geoData addDataPointWithLatitude:samples[i].latitude longitude:samples[i].longitude heading:samples[i].heading timestamp:samples[i].timestamp accuracy:samples[i].accuracy];
+        }
+    }];
+
+    free(samples);
+}
+
+// Smoothing saved tracks in both directions, in memory and from the geodata file of a capture
+- (void)testBenchmarkSmoothTrack
+{
+    NSArray * lengths = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_FILTER_POINTS" defaultValues:@[ @100000, @1000000 ]];
+    for (NSNumber * length in lengths) {
+        NSUInteger count = length.unsignedIntegerValue;
+        STRTrackSample * samples = [self newReplayTrackWithCount:count];
+        STRTrackSample * smoothed = malloc(count * sizeof(STRTrackSample));
+
+        [STRBenchmark runBenchmarkNamed:@"track_filter.smooth_samples" parameters:@{ @"points" : length } iterations:kFilterIterations block:^{
+            memcpy(smoothed, samples, count * sizeof(STRTrackSample));
+            [[[STRTrackFilter alloc] init] smoothSamples:smoothed count:count];
+        }];
+        STAssertFalse(isnan(smoothed[0].latitude), @"The smoother produced NaN");
+        free(smoothed);
+        free(samples);
+
+        NSString * token = [STRBenchmarkCorpus writeCaptureWithPoints:count mediaSize:1024 date:[STRBenchmarkCorpus referenceDate]];
+        STRCapture * capture = [STRCapture captureWithToken:token];
+        __block BOOL success = NO;
+        [STRBenchmark runBenchmarkNamed:@"track_filter.write_filtered_geodata" parameters:@{ @"points" : length } iterations:1 block:^{
+            success = [capture writeFilteredGeoData];
+        }];
+        STAssertTrue(success, @"The filtered track was not written");
+        STAssertEquals([[STRCapture captureWithToken:token] filteredGeoDataPoints].count, [capture geoDataPoints].count, @"Every point should be filtered");
+    }
+}
+
+@end
+
+@implementation STRTrackFilterBenchmarks (InternalMethods)
+
+// A random walk at 1.5 m/s with a fix every second and compass readings in between,
+// so most samples repeat the last fix the way recorded tracks do
+-(STRTrackSample *)newReplayTrackWithCount:(NSUInteger)count {
+    STRTrackSample * samples = malloc(count * sizeof(STRTrackSample));
+    srandom(20121019);
+    double latitude = 43.6254, longitude = -72.5179, course = 90;
+    STRTrackSample fix = { latitude, longitude, course, 10, 0 };
+    for (NSUInteger i = 0; i < count; i++) {
+        double timestamp = (double)i / kHeadingUpdatesPerFix;
+        if (i % kHeadingUpdatesPerFix == 0) {
+            course = fmod(course + ((double)random() / RAND_MAX - 0.5) * 20 + 360, 360);
+            latitude += cos(course * M_PI / 180) * 1.5 / 111111;
+            longitude += sin(course * M_PI / 180) * 1.5 / (111111 * cos(latitude * M_PI / 180));
+            fix.accuracy = 5 + random() % 25;
+            fix.latitude = latitude + ((double)random() / RAND_MAX - 0.5) * fix.accuracy / 111111;
+            fix.longitude = longitude + ((double)random() / RAND_MAX - 0.5) * fix.accuracy / (111111 * cos(latitude * M_PI / 180));
+        }
+        samples[i] = fix;
+        samples[i].heading = fmod(course + ((double)random() / RAND_MAX - 0.5) * 30 + 360, 360);
+        samples[i].timestamp = timestamp;
+    }
+    return samples;
+}
+
+@end
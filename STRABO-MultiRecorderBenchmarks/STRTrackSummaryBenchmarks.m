@@ -0,0 +1,77 @@
+//
+//  STRTrackSummaryBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackSummaryBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRCapture.h"
+#import "STRCapturePathResolver.h"
+#import "STRTrackSummary.h"
+
+#define kSummaryIterations 5
+#define kSummaryListCaptures 100
+
+@implementation STRTrackSummaryBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+}
+
+- (void)tearDown
+{
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// The rows of a list that shows the duration and length of each track, from the
+// geodata files and from the summaries, for tracks of growing length
+- (void)testBenchmarkListRows
+{
+    NSArray * lengths = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_SUMMARY_POINTS" defaultValues:@[ @100, @1000, @10000 ]];
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    for (NSNumber * length in lengths) {
+        [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+        NSArray * tokens = [STRBenchmarkCorpus writeCapturesWithCount:kSummaryListCaptures pointsPerTrack:length.unsignedIntegerValue mediaSize:16];
+        NSDictionary * parameters = @{ @"captures" : @(tokens.count), @"points" : length };
+        __block double geoDataChecksum = 0, summaryChecksum = 0;
+
+        [STRBenchmark runBenchmarkNamed:@"track_summary.list_from_geodata" parameters:parameters iterations:kSummaryIterations block:^{
+            geoDataChecksum = 0;
+            STRCapturePathResolver * resolver = [STRCapturePathResolver sharedResolver];
+            for (NSString * token in tokens) {
+                @autoreleasepool {
+                    STRCapture * capture = [STRCapture captureWithToken:token];
+                    STRTrackSummary * summary = [STRTrackSummary summaryOfTrackAtPath:[resolver absolutePathForCaptureFile:capture.geoDataPath]];
+                    geoDataChecksum += summary.duration + summary.pointCount;
+                }
+            }
+        }];
+
+        uint64_t start = mach_absolute_time();
+        NSUInteger backfilled = [STRTrackSummary backfillCapturesOfResolver:[STRCapturePathResolver sharedResolver]];
+        uint64_t end = mach_absolute_time();
+        [STRBenchmark recordBenchmarkNamed:@"track_summary.backfill" parameters:parameters latencies:@[ @((double)(end - start) * timebase.numer / timebase.denom / NSEC_PER_SEC) ] extra:@{ @"summarized" : @(backfilled) }];
+        STAssertEquals(backfilled, tokens.count, @"Every capture should be summarized");
+
+        [STRBenchmark runBenchmarkNamed:@"track_summary.list_from_summary" parameters:parameters iterations:kSummaryIterations block:^{
+            summaryChecksum = 0;
+            for (NSString * token in tokens) {
+                @autoreleasepool {
+                    STRTrackSummary * summary = [STRCapture captureWithToken:token].trackSummary;
+                    summaryChecksum += summary.duration + summary.pointCount;
+                }
+            }
+        }];
+        STAssertEquals(summaryChecksum, geoDataChecksum, @"Both paths should give the same summaries");
+    }
+}
+
+@end
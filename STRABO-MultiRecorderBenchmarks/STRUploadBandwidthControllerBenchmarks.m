@@ -0,0 +1,114 @@
+//
+//  STRUploadBandwidthControllerBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadBandwidthControllerBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRLoopbackHTTPServer.h"
+#import "STRCaptureUploadManager.h"
+#import "STRSettings.h"
+
+#import <mach/mach_time.h>
+
+#define kUploadTimeout 120
+#define kTrackPoints 600
+// Each upload lasts about this long at its cap, so that the second of bytes
+// the bucket can hold when it starts is a small part of the result
+#define kSecondsPerUpload 5
+
+@interface STRUploadBandwidthControllerBenchmarks () <STRCaptureUploadManagerDelegate> {
+    STRLoopbackHTTPServer * server;
+    BOOL uploadFinished;
+    BOOL uploadSucceeded;
+}
+
+@end
+
+@implementation STRUploadBandwidthControllerBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+    server = [[STRLoopbackHTTPServer alloc] init];
+    STAssertTrue([server start], @"The loopback server did not start");
+}
+
+- (void)tearDown
+{
+    [STRSettings removeAllOverrides];
+    [server stop];
+    server = nil;
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// The loopback link is far faster than any cap, so the cap plays the part of
+// a slow link. The achieved rate should stay close to it and never well above.
+- (void)testBenchmarkCappedUploads
+{
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    NSArray * caps = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_BANDWIDTH_CAPS" defaultValues:@[ @(64 * 1024), @(256 * 1024), @(1024 * 1024) ]];
+    for (NSNumber * cap in caps) {
+        NSUInteger mediaSize = cap.unsignedIntegerValue * kSecondsPerUpload;
+        STRCapture * capture = [STRCapture captureWithToken:[STRBenchmarkCorpus writeCaptureWithPoints:kTrackPoints mediaSize:mediaSize date:[STRBenchmarkCorpus referenceDate]]];
+        [STRSettings setOverrideValue:cap forKey:@"Upload_Max_Bytes_Per_Second"];
+
+        STRCaptureUploadManager * uploadManager = [STRCaptureUploadManager defaultManager];
+        uploadManager.uploadURL = server.URL;
+        uploadManager.delegate = self;
+        unsigned long long bytesBefore = server.receivedBodyBytes;
+        uint64_t start = mach_absolute_time();
+        BOOL succeeded = [self runUploadWithManager:uploadManager capture:capture];
+        double seconds = (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom / NSEC_PER_SEC;
+        unsigned long long bodyBytes = server.receivedBodyBytes - bytesBefore;
+        STAssertTrue(succeeded, @"The upload capped at %@ bytes per second did not succeed", cap);
+
+        double achieved = (seconds > 0) ? bodyBytes / seconds : 0;
+        double ratio = achieved / cap.doubleValue;
+        [STRBenchmark recordBenchmarkNamed:@"bandwidth.capped_upload" parameters:@{ @"cap_bytes_per_second" : cap, @"media_bytes" : @(mediaSize) } latencies:@[ @(seconds) ] extra:@{ @"body_bytes" : @(bodyBytes), @"achieved_bytes_per_second" : @(achieved), @"ratio_to_cap" : @(ratio) }];
+        STAssertTrue(ratio < 1.3, @"Uploads capped at %@ bytes per second went %.2f times faster", cap, ratio);
+        STAssertTrue(ratio > 0.5, @"Uploads capped at %@ bytes per second reached only %.2f of the cap", cap, ratio);
+    }
+}
+
+#pragma mark - Helpers
+
+-(BOOL)runUploadWithManager:(STRCaptureUploadManager *)uploadManager capture:(STRCapture *)capture {
+    uploadFinished = NO;
+    uploadSucceeded = NO;
+    [uploadManager beginUploadForCapture:capture];
+    NSDate * timeout = [NSDate dateWithTimeIntervalSinceNow:kUploadTimeout];
+    while (!uploadFinished && [timeout timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    if (!uploadFinished) [uploadManager cancelCurrentUpload];
+    return uploadSucceeded;
+}
+
+#pragma mark - STRCaptureUploadManagerDelegate
+
+-(void)fileUploadedSuccessfullyWithToken:(NSString *)token {
+    uploadSucceeded = YES;
+    uploadFinished = YES;
+}
+
+-(void)fileUploadFailedToStart {
+    uploadFinished = YES;
+}
+
+-(void)fileUploadDidFailWithError:(NSError *)error {
+    uploadFinished = YES;
+}
+
+-(void)fileUploadDidStop {
+    uploadFinished = YES;
+}
+
+@end
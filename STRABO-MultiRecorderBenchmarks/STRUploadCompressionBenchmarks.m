@@ -0,0 +1,131 @@
+//
+//  STRUploadCompressionBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadCompressionBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRLoopbackHTTPServer.h"
+#import "STRCaptureUploadManager.h"
+#import "STRCapturePathResolver.h"
+#import "STRSettings.h"
+
+#import <mach/mach_time.h>
+
+#define kUploadTimeout 300
+// Small next to the geodata of a long track, so the JSON parts decide the size of the body
+#define kMediaSize (16 * 1024)
+
+@interface STRUploadCompressionBenchmarks () <STRCaptureUploadManagerDelegate> {
+    STRLoopbackHTTPServer * server;
+    BOOL uploadFinished;
+    BOOL uploadSucceeded;
+}
+
+@end
+
+@interface STRUploadCompressionBenchmarks (InternalMethods)
+-(BOOL)runUploadWithManager:(STRCaptureUploadManager *)uploadManager capture:(STRCapture *)capture;
+@end
+
+@implementation STRUploadCompressionBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+    server = [[STRLoopbackHTTPServer alloc] init];
+    STAssertTrue([server start], @"The loopback server did not start");
+}
+
+- (void)tearDown
+{
+    [STRSettings removeAllOverrides];
+    [server stop];
+    server = nil;
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// Long tracks are uploaded with Compress_Upload_JSON off and then on, under a cap
+// that stands in for a cellular link. The bytes on the wire and the time of the
+// whole upload show whether gzip pays for itself on the device.
+- (void)testBenchmarkCompressedUploads
+{
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    NSArray * trackPoints = [STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_COMPRESSION_POINTS" defaultValues:@[ @3600, @36000 ]];
+    NSNumber * cap = [[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_COMPRESSION_CAP" defaultValues:@[ @(256 * 1024) ]] objectAtIndex:0];
+    [STRSettings setOverrideValue:cap forKey:@"Upload_Max_Bytes_Per_Second"];
+
+    for (NSNumber * points in trackPoints) {
+        STRCapture * capture = [STRCapture captureWithToken:[STRBenchmarkCorpus writeCaptureWithPoints:points.unsignedIntegerValue mediaSize:kMediaSize date:[STRBenchmarkCorpus referenceDate]]];
+        NSString * geoDataPath = [[STRCapturePathResolver sharedResolver] absolutePathForCaptureFile:capture.geoDataPath];
+        unsigned long long geoDataBytes = [[[NSFileManager defaultManager] attributesOfItemAtPath:geoDataPath error:nil] fileSize];
+
+        unsigned long long plainBodyBytes = 0;
+        for (NSNumber * compressed in @[ @NO, @YES ]) {
+            [STRSettings setOverrideValue:compressed forKey:@"Compress_Upload_JSON"];
+            STRCaptureUploadManager * uploadManager = [STRCaptureUploadManager defaultManager];
+            uploadManager.uploadURL = server.URL;
+            uploadManager.delegate = self;
+            unsigned long long bytesBefore = server.receivedBodyBytes;
+            uint64_t start = mach_absolute_time();
+            BOOL succeeded = [self runUploadWithManager:uploadManager capture:capture];
+            double seconds = (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom / NSEC_PER_SEC;
+            unsigned long long bodyBytes = server.receivedBodyBytes - bytesBefore;
+            STAssertTrue(succeeded, @"The upload of a track of %@ points did not succeed", points);
+
+            NSDictionary * parameters = @{ @"track_points" : points, @"compressed" : compressed, @"cap_bytes_per_second" : cap };
+            NSMutableDictionary * extra = [NSMutableDictionary dictionaryWithObjectsAndKeys:@(bodyBytes), @"body_bytes", @(geoDataBytes), @"geodata_file_bytes", nil];
+            if (compressed.boolValue && plainBodyBytes > 0) {
+                [extra setObject:@((double)bodyBytes / plainBodyBytes) forKey:@"ratio_to_uncompressed"];
+                STAssertTrue(bodyBytes < plainBodyBytes, @"Compressing the JSON of a track of %@ points did not shrink the body", points);
+            } else {
+                plainBodyBytes = bodyBytes;
+            }
+            [STRBenchmark recordBenchmarkNamed:@"upload.compressed_json" parameters:parameters latencies:@[ @(seconds) ] extra:extra];
+        }
+    }
+}
+
+#pragma mark - STRCaptureUploadManagerDelegate
+
+-(void)fileUploadedSuccessfullyWithToken:(NSString *)token {
+    uploadSucceeded = YES;
+    uploadFinished = YES;
+}
+
+-(void)fileUploadFailedToStart {
+    uploadFinished = YES;
+}
+
+-(void)fileUploadDidFailWithError:(NSError *)error {
+    uploadFinished = YES;
+}
+
+-(void)fileUploadDidStop {
+    uploadFinished = YES;
+}
+
+@end
+
+@implementation STRUploadCompressionBenchmarks (InternalMethods)
+
+-(BOOL)runUploadWithManager:(STRCaptureUploadManager *)uploadManager capture:(STRCapture *)capture {
+    uploadFinished = NO;
+    uploadSucceeded = NO;
+    [uploadManager beginUploadForCapture:capture];
+    NSDate * timeout = [NSDate dateWithTimeIntervalSinceNow:kUploadTimeout];
+    while (!uploadFinished && [timeout timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    if (!uploadFinished) [uploadManager cancelCurrentUpload];
+    return uploadSucceeded;
+}
+
+@end
@@ -0,0 +1,116 @@
+//
+//  STRUploadMetricsBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadMetricsBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRUploadMetrics.h"
+#import "STRUploadMetricsRecorder.h"
+
+#import <QuartzCore/QuartzCore.h>
+
+#define kMetricsIterations 5
+// The number of didSendBodyData: callbacks of an upload of about 1 MB
+#define kProgressReportsPerUpload 64
+#define kBytesPerProgressReport 16384
+
+@interface STRUploadMetricsBenchmarks (InternalMethods)
++(STRUploadMetrics *)metricsOfSimulatedUploadNumber:(NSUInteger)number;
+@end
+
+@implementation STRUploadMetricsBenchmarks
+
+// The bookkeeping that STRCaptureUploadManager does for every upload, with the
+// metrics thrown away and then handed to a recorder. The second includes the
+// time the recorder's queue takes to file them, so the difference is the whole
+// cost of recording.
+- (void)testBenchmarkUploadBookkeeping
+{
+    NSUInteger uploads = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_METRICS_UPLOADS" defaultValues:@[ @100000 ]] objectAtIndex:0] unsignedIntegerValue];
+    NSDictionary * parameters = @{ @"uploads" : @(uploads), @"progress_reports" : @kProgressReportsPerUpload };
+
+    __block unsigned long long bytesWithout = 0;
+    [STRBenchmark runBenchmarkNamed:@"upload_metrics.bookkeeping_without_recorder" parameters:parameters iterations:kMetricsIterations block:^{
+        bytesWithout = 0;
+        for (NSUInteger i = 0; i < uploads; i++) {
+            @autoreleasepool {
+                bytesWithout += [[STRUploadMetricsBenchmarks metricsOfSimulatedUploadNumber:i] bytesSent];
+            }
+        }
+    }];
+
+    STRUploadMetricsRecorder * recorder = [[STRUploadMetricsRecorder alloc] init];
+    __block NSUInteger recorded = 0;
+    [STRBenchmark runBenchmarkNamed:@"upload_metrics.bookkeeping_with_recorder" parameters:parameters iterations:kMetricsIterations block:^{
+        for (NSUInteger i = 0; i < uploads; i++) {
+            @autoreleasepool {
+                [recorder recordMetrics:[STRUploadMetricsBenchmarks metricsOfSimulatedUploadNumber:i]];
+            }
+        }
+        // Wait for the queue to file everything
+        recorded = [[recorder recentMetrics] count];
+    }];
+
+    STAssertEquals(bytesWithout, (unsigned long long)uploads * kProgressReportsPerUpload * kBytesPerProgressReport, @"Every simulated upload should send its body");
+    STAssertTrue(recorded > 0 && recorded <= uploads, @"The recorder should keep the latest uploads in its window");
+}
+
+// recordMetrics: alone, as seen by the upload manager that calls it, and the
+// summary that reads the window back
+- (void)testBenchmarkRecording
+{
+    NSUInteger uploads = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_METRICS_UPLOADS" defaultValues:@[ @100000 ]] objectAtIndex:0] unsignedIntegerValue];
+    NSMutableArray * metrics = [NSMutableArray arrayWithCapacity:uploads];
+    for (NSUInteger i = 0; i < uploads; i++) {
+        [metrics addObject:[STRUploadMetricsBenchmarks metricsOfSimulatedUploadNumber:i]];
+    }
+
+    STRUploadMetricsRecorder * recorder = [[STRUploadMetricsRecorder alloc] init];
+    [STRBenchmark runBenchmarkNamed:@"upload_metrics.record" parameters:@{ @"uploads" : @(uploads) } iterations:kMetricsIterations block:^{
+        for (STRUploadMetrics * uploadMetrics in metrics) {
+            [recorder recordMetrics:uploadMetrics];
+        }
+    }];
+    // Let the queue catch up before the summary is timed
+    [recorder recentMetrics];
+
+    __block NSDictionary * summary = nil;
+    [STRBenchmark runBenchmarkNamed:@"upload_metrics.summary" parameters:@{ @"window" : @([[recorder recentMetrics] count]) } iterations:kMetricsIterations block:^{
+        summary = [recorder summary];
+    }];
+    STAssertNotNil(summary, @"The recorder should summarize its window");
+}
+
+@end
+
+@implementation STRUploadMetricsBenchmarks (InternalMethods)
+
+// Fills in metrics the way STRCaptureUploadManager does from its callbacks
++(STRUploadMetrics *)metricsOfSimulatedUploadNumber:(NSUInteger)number {
+    CFTimeInterval startTime = CACurrentMediaTime();
+    STRUploadMetrics * metrics = [[STRUploadMetrics alloc] init];
+    metrics.token = @"benchmark";
+    metrics.startDate = [NSDate date];
+    metrics.requestBuildDuration = CACurrentMediaTime() - startTime;
+
+    unsigned long long totalBytes = (unsigned long long)kProgressReportsPerUpload * kBytesPerProgressReport;
+    for (NSUInteger report = 1; report <= kProgressReportsPerUpload; report++) {
+        NSTimeInterval elapsed = CACurrentMediaTime() - startTime;
+        unsigned long long bytesSent = (unsigned long long)report * kBytesPerProgressReport;
+        metrics.bytesSent = bytesSent;
+        if (metrics.firstBodyByteDuration < 0) metrics.firstBodyByteDuration = elapsed;
+        if (metrics.connectDuration < 0) metrics.connectDuration = elapsed;
+        if (bytesSent >= totalBytes && metrics.sendDuration < 0) metrics.sendDuration = elapsed;
+    }
+    metrics.responseLatency = CACurrentMediaTime() - startTime - metrics.sendDuration;
+    // Spread the outcomes a little so that the summary has something to count
+    metrics.errorClass = (number % 10 == 0) ? STRUploadErrorClassNetwork : STRUploadErrorClassNone;
+    metrics.totalDuration = CACurrentMediaTime() - startTime;
+    return metrics;
+}
+
+@end
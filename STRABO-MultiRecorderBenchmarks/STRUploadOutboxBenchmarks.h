@@ -0,0 +1,13 @@
+//
+//  STRUploadOutboxBenchmarks.h
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface STRUploadOutboxBenchmarks : SenTestCase
+
+@end
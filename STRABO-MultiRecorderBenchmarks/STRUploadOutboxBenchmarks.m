@@ -0,0 +1,197 @@
+//
+//  STRUploadOutboxBenchmarks.m
+//  STRABO-MultiRecorderBenchmarks
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadOutboxBenchmarks.h"
+#import "STRBenchmark.h"
+#import "STRBenchmarkCorpus.h"
+#import "STRLoopbackHTTPServer.h"
+#import "STRUploadOutbox.h"
+
+#define kOutboxTimeout 120
+#define kOutboxMediaSize (20 * 1024)
+
+@interface STRUploadOutboxBenchmarks () <STRUploadOutboxDelegate> {
+    STRLoopbackHTTPServer * server;
+    NSString * outboxPath;
+    NSMutableArray * uploadedTokens;
+    NSMutableArray * givenUpTokens;
+    NSUInteger retryCount;
+}
+@end
+
+@interface STRUploadOutboxBenchmarks (InternalMethods)
+-(STRUploadOutbox *)newOutbox;
+-(NSArray *)writeCaptures:(NSUInteger)count;
+-(BOOL)runUntil:(BOOL (^)(void))condition;
+@end
+
+@implementation STRUploadOutboxBenchmarks
+
+- (void)setUp
+{
+    [super setUp];
+    [STRBenchmarkCorpus setUpEmptyCapturesDirectory];
+    outboxPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRUploadOutboxBenchmarks.json"];
+    [[NSFileManager defaultManager] removeItemAtPath:outboxPath error:nil];
+    server = [[STRLoopbackHTTPServer alloc] init];
+    STAssertTrue([server start], @"The loopback server did not start");
+    uploadedTokens = [NSMutableArray array];
+    givenUpTokens = [NSMutableArray array];
+    retryCount = 0;
+}
+
+- (void)tearDown
+{
+    [server stop];
+    server = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:outboxPath error:nil];
+    [STRBenchmarkCorpus restoreCapturesDirectory];
+    [super tearDown];
+}
+
+// Every failureEvery-th request fails with a 503, so most captures go through
+// at once and the rest are retried after a short backoff.
+- (void)testBenchmarkDrainThroughIntermittentFailures
+{
+    NSUInteger captureCount = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_OUTBOX_CAPTURES" defaultValues:@[ @50 ]] objectAtIndex:0] unsignedIntegerValue];
+    NSUInteger failureEvery = [[[STRBenchmark integersFromEnvironment:@"STR_BENCHMARK_OUTBOX_FAILURE_EVERY" defaultValues:@[ @3 ]] objectAtIndex:0] unsignedIntegerValue];
+    server.responseStatusCodeHandler = ^NSInteger(NSUInteger requestNumber) {
+        return (failureEvery > 0 && requestNumber % failureEvery == 0) ? 503 : 200;
+    };
+    NSArray * tokens = [self writeCaptures:captureCount];
+
+    __block BOOL drained = NO;
+    [STRBenchmark runBenchmarkNamed:@"upload_outbox.drain" parameters:@{ @"captures" : @(captureCount), @"failure_every" : @(failureEvery), @"media_bytes" : @kOutboxMediaSize } iterations:1 block:^{
+        STRUploadOutbox * outbox = [self newOutbox];
+        for (NSString * token in tokens) {
+            [outbox enqueueCapture:[STRCapture captureWithToken:token]];
+        }
+        [outbox start];
+        drained = [self runUntil:^BOOL{ return [outbox pendingTokens].count == 0; }];
+        [outbox stop];
+    }];
+
+    STAssertTrue(drained, @"The outbox did not drain");
+    STAssertEquals(uploadedTokens.count, captureCount, @"Every capture should be uploaded");
+    STAssertEquals(givenUpTokens.count, (NSUInteger)0, @"No capture should be given up on");
+    if (failureEvery > 0) STAssertTrue(retryCount > 0, @"Some uploads should have been retried");
+    STAssertEquals(server.requestCount, captureCount + retryCount, @"Each retry should cost exactly one more request");
+    for (NSString * token in tokens) {
+        STAssertTrue([[STRCapture captureWithToken:token] hasBeenUploaded], @"Capture %@ should be marked as uploaded", token);
+    }
+}
+
+- (void)testOutboxResumesAfterRestart
+{
+    __block BOOL serverHealthy = NO;
+    server.responseStatusCodeHandler = ^NSInteger(NSUInteger requestNumber) {
+        return (serverHealthy) ? 200 : 503;
+    };
+    NSArray * tokens = [self writeCaptures:5];
+
+    // The app is stopped in the middle of an upload; the attempt does not count
+    server.responseDelay = 5;
+    STRUploadOutbox * outbox = [self newOutbox];
+    for (NSString * token in tokens) {
+        [outbox enqueueCapture:[STRCapture captureWithToken:token]];
+    }
+    [outbox start];
+    STAssertTrue([self runUntil:^BOOL{ return server.requestCount > 0; }], @"The first upload was not sent");
+    [outbox stop];
+    outbox = [self newOutbox];
+    STAssertEqualObjects([outbox pendingTokens], tokens, @"Every capture should still be queued after a restart");
+    STAssertEquals([outbox attemptsForCaptureWithToken:[tokens objectAtIndex:0]], (NSUInteger)0, @"An interrupted upload should not count as an attempt");
+
+    // The server fails for a while, and the app is stopped again
+    server.responseDelay = 0;
+    [outbox start];
+    STAssertTrue([self runUntil:^BOOL{ return retryCount >= 8; }], @"The failing uploads were not retried");
+    [outbox stop];
+    outbox = [self newOutbox];
+    NSUInteger attempts = 0;
+    for (NSString * token in tokens) {
+        attempts += [outbox attemptsForCaptureWithToken:token];
+    }
+    STAssertTrue(attempts >= 8, @"Failed attempts should survive a restart");
+    STAssertEquals(uploadedTokens.count, (NSUInteger)0, @"Nothing should have been uploaded yet");
+
+    // The server recovers, and the relaunched outbox finishes the job
+    serverHealthy = YES;
+    [outbox start];
+    STAssertTrue([self runUntil:^BOOL{ return [outbox pendingTokens].count == 0; }], @"The outbox did not drain after the restart");
+    [outbox stop];
+    STAssertEqualObjects([NSSet setWithArray:uploadedTokens], [NSSet setWithArray:tokens], @"Every capture should be uploaded");
+    STAssertEquals(givenUpTokens.count, (NSUInteger)0, @"No capture should be given up on");
+    STAssertEquals([[self newOutbox] pendingTokens].count, (NSUInteger)0, @"The emptied outbox should be saved");
+    for (NSString * token in tokens) {
+        STAssertTrue([[STRCapture captureWithToken:token] hasBeenUploaded], @"Capture %@ should be marked as uploaded", token);
+    }
+}
+
+- (void)testOutboxGivesUpOnRejectedCaptures
+{
+    server.responseStatusCode = 400;
+    NSArray * tokens = [self writeCaptures:5];
+    STRUploadOutbox * outbox = [self newOutbox];
+    for (NSString * token in tokens) {
+        [outbox enqueueCapture:[STRCapture captureWithToken:token]];
+    }
+    [outbox start];
+    STAssertTrue([self runUntil:^BOOL{ return [outbox pendingTokens].count == 0; }], @"The outbox did not empty");
+    [outbox stop];
+
+    STAssertEquals(givenUpTokens.count, tokens.count, @"Every capture should be given up on");
+    STAssertEquals(retryCount, (NSUInteger)0, @"Rejected captures should not be retried");
+    STAssertEquals(server.requestCount, tokens.count, @"Each capture should be sent once");
+    for (NSString * token in tokens) {
+        STAssertFalse([[STRCapture captureWithToken:token] hasBeenUploaded], @"Capture %@ should not be marked as uploaded", token);
+    }
+}
+
+#pragma mark - STRUploadOutboxDelegate
+
+-(void)outboxDidUploadCaptureWithToken:(NSString *)token {
+    [uploadedTokens addObject:token];
+}
+
+-(void)outboxWillRetryCaptureWithToken:(NSString *)token afterDelay:(NSTimeInterval)delay error:(NSError *)error {
+    retryCount++;
+}
+
+-(void)outboxDidGiveUpOnCaptureWithToken:(NSString *)token error:(NSError *)error {
+    [givenUpTokens addObject:token];
+}
+
+@end
+
+@implementation STRUploadOutboxBenchmarks (InternalMethods)
+
+-(STRUploadOutbox *)newOutbox {
+    // Each new outbox on the same file stands in for a relaunch of the app
+    STRUploadOutbox * outbox = [[STRUploadOutbox alloc] initWithPath:outboxPath];
+    outbox.delegate = self;
+    outbox.uploadURL = server.URL;
+    outbox.baseRetryDelay = 0.02;
+    outbox.maximumRetryDelay = 0.1;
+    outbox.maximumAttempts = 20;
+    return outbox;
+}
+
+-(NSArray *)writeCaptures:(NSUInteger)count {
+    return [STRBenchmarkCorpus writeCapturesWithCount:count pointsPerTrack:1 mediaSize:kOutboxMediaSize];
+}
+
+-(BOOL)runUntil:(BOOL (^)(void))condition {
+    NSDate * timeout = [NSDate dateWithTimeIntervalSinceNow:kOutboxTimeout];
+    while (!condition() && [timeout timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    return condition();
+}
+
+@end
@@ -0,0 +1,217 @@
+//
+//  STRCaptureChangeFeedTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureChangeFeedTests.h"
+#import "STRCaptureChangeFeed.h"
+
+@interface STRCaptureChangeFeedTests () {
+    NSString * _journalPath;
+    NSMutableArray * _notifications;
+}
+@end
+
+@interface STRCaptureChangeFeedTests (InternalMethods)
+-(void)feedDidChange:(NSNotification *)notification;
+-(NSString *)tokenWithIndex:(NSUInteger)index;
+@end
+
+@implementation STRCaptureChangeFeedTests
+
+- (void)setUp
+{
+    [super setUp];
+    _journalPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureChangeFeedTests/changes.log"];
+    [[NSFileManager defaultManager] removeItemAtPath:[_journalPath stringByDeletingLastPathComponent] error:nil];
+    _notifications = [NSMutableArray array];
+}
+
+- (void)tearDown
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [[NSFileManager defaultManager] removeItemAtPath:[_journalPath stringByDeletingLastPathComponent] error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Coalescing
+
+- (void)testChangesToOneCaptureAreMerged
+{
+    STRCaptureChangeFeed * feed = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    unsigned long long start = [feed currentSequenceNumber];
+
+    [feed recordChangeOfType:STRCaptureChangeAdded token:@"added" fields:nil];
+    [feed recordChangeOfType:STRCaptureChangeUpdated token:@"added" fields:[NSSet setWithObject:STRCaptureFieldTitle]];
+    [feed recordChangeOfType:STRCaptureChangeUpdated token:@"updated" fields:[NSSet setWithObject:STRCaptureFieldTitle]];
+    [feed recordChangeOfType:STRCaptureChangeAdded token:@"gone" fields:nil];
+    [feed recordChangeOfType:STRCaptureChangeUpdated token:@"updated" fields:[NSSet setWithObject:STRCaptureFieldUploadDate]];
+    [feed recordChangeOfType:STRCaptureChangeDeleted token:@"gone" fields:nil];
+    [feed recordChangeOfType:STRCaptureChangeUpdated token:@"deleted" fields:[NSSet setWithObject:STRCaptureFieldTitle]];
+    [feed recordChangeOfType:STRCaptureChangeDeleted token:@"deleted" fields:nil];
+    [feed recordChangeOfType:STRCaptureChangeDeleted token:@"restored" fields:nil];
+    [feed recordChangeOfType:STRCaptureChangeAdded token:@"restored" fields:nil];
+
+    NSArray * changes = [feed changesSinceSequenceNumber:start];
+    STAssertEqualObjects([changes valueForKey:@"token"], (@[ @"added", @"updated", @"deleted", @"restored" ]), @"Each capture should appear once, in the order of its last change");
+    if (changes.count != 4) return;
+
+    STAssertEquals([[changes objectAtIndex:0] type], STRCaptureChangeAdded, @"An added capture that was updated is still new");
+    STAssertEquals([[changes objectAtIndex:1] type], STRCaptureChangeUpdated, @"Updates stay updates");
+    STAssertEqualObjects([[changes objectAtIndex:1] changedFields], ([NSSet setWithObjects:STRCaptureFieldTitle, STRCaptureFieldUploadDate, nil]), @"The changed fields of updates add up");
+    STAssertEquals([[changes objectAtIndex:2] type], STRCaptureChangeDeleted, @"An update followed by a deletion is a deletion");
+    STAssertEquals([[changes objectAtIndex:3] type], STRCaptureChangeUpdated, @"A capture that came back must be read again");
+    STAssertNil([[changes objectAtIndex:3] changedFields], @"Every field of a capture that came back may have changed");
+    STAssertEquals([[changes lastObject] sequenceNumber], [feed currentSequenceNumber], @"Merged changes carry their last sequence number");
+}
+
+- (void)testChangesArePostedInOneBatch
+{
+    STRCaptureChangeFeed * feed = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    feed.coalescingInterval = 0.05;
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(feedDidChange:) name:STRCaptureStoreDidChangeNotification object:feed];
+
+    for (NSUInteger i = 0; i < 50; i++) {
+        [feed recordChangeOfType:STRCaptureChangeUpdated token:[self tokenWithIndex:i % 5] fields:[NSSet setWithObject:STRCaptureFieldTitle]];
+    }
+    STAssertEquals(_notifications.count, (NSUInteger)0, @"Changes should wait for the coalescing interval");
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.3]];
+
+    STAssertEquals(_notifications.count, (NSUInteger)1, @"Changes made together should be posted together");
+    NSDictionary * userInfo = [[_notifications lastObject] userInfo];
+    STAssertEquals([[userInfo objectForKey:STRCaptureStoreChangesKey] count], (NSUInteger)5, @"A batch should hold each capture once");
+    STAssertEquals([[userInfo objectForKey:STRCaptureStoreSequenceNumberKey] unsignedLongLongValue], [feed currentSequenceNumber], @"A batch should give the last sequence number");
+
+    [feed publishPendingChanges];
+    STAssertEquals(_notifications.count, (NSUInteger)1, @"Nothing is left to post");
+}
+
+#pragma mark - Catching Up
+
+- (void)testJournalSurvivesRestart
+{
+    STRCaptureChangeFeed * feed = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    unsigned long long start = [feed currentSequenceNumber];
+    [feed recordChangeOfType:STRCaptureChangeAdded token:@"a" fields:nil];
+    unsigned long long seen = [feed currentSequenceNumber];
+    [feed recordChangeOfType:STRCaptureChangeUpdated token:@"a" fields:[NSSet setWithObjects:STRCaptureFieldTitle, STRCaptureFieldFilteredGeoData, nil]];
+    [feed recordChangeOfType:STRCaptureChangeDeleted token:@"b" fields:nil];
+
+    // A new feed on the same file stands in for the app being launched again
+    STRCaptureChangeFeed * relaunched = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    STAssertEquals([relaunched currentSequenceNumber], [feed currentSequenceNumber], @"The sequence number should be read back");
+    NSArray * changes = [relaunched changesSinceSequenceNumber:seen];
+    STAssertEqualObjects([changes valueForKey:@"token"], (@[ @"a", @"b" ]), @"The changes after the sequence number should be read back");
+    STAssertEqualObjects([[changes objectAtIndex:0] changedFields], ([NSSet setWithObjects:STRCaptureFieldTitle, STRCaptureFieldFilteredGeoData, nil]), @"The changed fields should be read back");
+    STAssertEquals([[relaunched changesSinceSequenceNumber:start] count], (NSUInteger)2, @"The whole journal should be read back");
+    STAssertEquals([[relaunched changesSinceSequenceNumber:[relaunched currentSequenceNumber]] count], (NSUInteger)0, @"Nothing has changed since the last change");
+
+    [relaunched recordChangeOfType:STRCaptureChangeAdded token:@"c" fields:nil];
+    STAssertEquals([relaunched currentSequenceNumber], [feed currentSequenceNumber] + 1, @"Numbering should carry on after a restart");
+}
+
+- (void)testOldAndForeignSequenceNumbersAreRefused
+{
+    STRCaptureChangeFeed * feed = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    feed.journalLimit = 10;
+    unsigned long long start = [feed currentSequenceNumber];
+    for (NSUInteger i = 0; i < 25; i++) {
+        [feed recordChangeOfType:STRCaptureChangeAdded token:[self tokenWithIndex:i] fields:nil];
+    }
+    STAssertNil([feed changesSinceSequenceNumber:start], @"Changes that were dropped from the journal cannot be replayed");
+    STAssertEquals([[feed changesSinceSequenceNumber:[feed currentSequenceNumber] - 5] count], (NSUInteger)5, @"Recent changes are still known");
+    STAssertNil([feed changesSinceSequenceNumber:[feed currentSequenceNumber] + 1], @"A number from the future did not come from this feed");
+
+    // A damaged journal starts over with numbers above the old ones
+    unsigned long long last = [feed currentSequenceNumber];
+    [@"garbage" writeToFile:_journalPath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+    STRCaptureChangeFeed * restarted = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    STAssertTrue([restarted currentSequenceNumber] > last, @"A new journal should not reuse sequence numbers");
+    STAssertNil([restarted changesSinceSequenceNumber:last], @"The changes of a lost journal are not known");
+}
+
+- (void)testTruncatedLastChangeIsIgnored
+{
+    STRCaptureChangeFeed * feed = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    unsigned long long start = [feed currentSequenceNumber];
+    [feed recordChangeOfType:STRCaptureChangeAdded token:@"a" fields:nil];
+    [feed recordChangeOfType:STRCaptureChangeAdded token:@"b" fields:nil];
+
+    // As if the app was stopped in the middle of writing a change
+    NSFileHandle * handle = [NSFileHandle fileHandleForWritingAtPath:_journalPath];
+    [handle seekToEndOfFile];
+    [handle writeData:[[NSString stringWithFormat:@"%llu A", [feed currentSequenceNumber] + 1] dataUsingEncoding:NSUTF8StringEncoding]];
+    [handle closeFile];
+
+    STRCaptureChangeFeed * relaunched = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    STAssertEquals([relaunched currentSequenceNumber], [feed currentSequenceNumber], @"The partial change should be ignored");
+    STAssertEquals([[relaunched changesSinceSequenceNumber:start] count], (NSUInteger)2, @"The complete changes should be kept");
+    [relaunched recordChangeOfType:STRCaptureChangeAdded token:@"c" fields:nil];
+    STRCaptureChangeFeed * relaunchedAgain = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+    STAssertEquals([[relaunchedAgain changesSinceSequenceNumber:start] count], (NSUInteger)3, @"Changes after the repair should be readable");
+}
+
+// A consumer that keeps its own copy of the store, as a table view does, and catches up after being away.
+// Its work depends on how many captures changed, not on how many there are.
+- (void)testCatchingUpCostsTheChangesNotTheCaptures
+{
+    for (NSNumber * storeSize in @[ @100, @5000 ]) {
+        [[NSFileManager defaultManager] removeItemAtPath:_journalPath error:nil];
+        STRCaptureChangeFeed * feed = [[STRCaptureChangeFeed alloc] initWithPath:_journalPath];
+        NSMutableDictionary * store = [NSMutableDictionary dictionary];
+        for (NSUInteger i = 0; i < storeSize.unsignedIntegerValue; i++) {
+            [store setObject:@"Untitled Capture" forKey:[self tokenWithIndex:i]];
+            [feed recordChangeOfType:STRCaptureChangeAdded token:[self tokenWithIndex:i] fields:nil];
+        }
+
+        // The consumer reads everything once
+        NSMutableDictionary * view = [store mutableCopy];
+        unsigned long long sequenceNumber = [feed currentSequenceNumber];
+
+        // While it is away, a few captures change, some of them more than once
+        for (NSUInteger i = 0; i < 3; i++) {
+            NSString * token = [self tokenWithIndex:i * 7];
+            [store setObject:[NSString stringWithFormat:@"Title %u", (unsigned)i] forKey:token];
+            [feed recordChangeOfType:STRCaptureChangeUpdated token:token fields:[NSSet setWithObject:STRCaptureFieldTitle]];
+            [feed recordChangeOfType:STRCaptureChangeUpdated token:token fields:[NSSet setWithObject:STRCaptureFieldTitle]];
+        }
+        [store removeObjectForKey:[self tokenWithIndex:1]];
+        [feed recordChangeOfType:STRCaptureChangeDeleted token:[self tokenWithIndex:1] fields:nil];
+        [store setObject:@"New Capture" forKey:@"new"];
+        [feed recordChangeOfType:STRCaptureChangeAdded token:@"new" fields:nil];
+
+        // Catching up reads only the captures that changed
+        NSUInteger capturesRead = 0;
+        NSArray * changes = [feed changesSinceSequenceNumber:sequenceNumber];
+        for (STRCaptureChange * change in changes) {
+            if (change.type == STRCaptureChangeDeleted) {
+                [view removeObjectForKey:change.token];
+            } else {
+                [view setObject:[store objectForKey:change.token] forKey:change.token];
+                capturesRead++;
+            }
+        }
+
+        STAssertEquals(changes.count, (NSUInteger)5, @"With %@ captures, five captures changed", storeSize);
+        STAssertEquals(capturesRead, (NSUInteger)4, @"With %@ captures, only the four captures still there should be read", storeSize);
+        STAssertEqualObjects(view, store, @"With %@ captures, the consumer should end up with the store", storeSize);
+    }
+}
+
+@end
+
+@implementation STRCaptureChangeFeedTests (InternalMethods)
+
+-(void)feedDidChange:(NSNotification *)notification {
+    STAssertTrue([NSThread isMainThread], @"Changes should be posted on the main thread");
+    [_notifications addObject:notification];
+}
+
+-(NSString *)tokenWithIndex:(NSUInteger)index {
+    return [NSString stringWithFormat:@"capture%05u", (unsigned)index];
+}
+
+@end
@@ -0,0 +1,13 @@
+//
+//  STRCaptureClusterIndexTests.h
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface STRCaptureClusterIndexTests : SenTestCase
+
+@end
@@ -0,0 +1,206 @@
+//
+//  STRCaptureClusterIndexTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureClusterIndexTests.h"
+#import "STRCaptureClusterIndex.h"
+#import "STRCaptureChangeFeed.h"
+#import "STRCapturePathResolver.h"
+
+// A Web Mercator cell, counted from the north-west corner
+typedef struct {
+    double x;
+    double y;
+} STRTestCell;
+
+@interface STRCaptureClusterIndexTests () {
+    NSString * _rootPath;
+}
+@end
+
+@interface STRCaptureClusterIndexTests (InternalMethods)
+-(STRTestCell)cellOfCoordinate:(CLLocationCoordinate2D)coordinate depth:(NSUInteger)depth;
+-(NSUInteger)totalCountOfClusters:(NSArray *)clusters;
+-(void)writeCaptureWithToken:(NSString *)token coordinate:(CLLocationCoordinate2D)coordinate resolver:(STRCapturePathResolver *)resolver;
+@end
+
+@implementation STRCaptureClusterIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+    _rootPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureClusterIndexTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_rootPath error:nil];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_rootPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Clustering
+
+- (void)testClustersMatchAGroupingOfEveryCapture
+{
+    // Captures around a few towns, and some spread across the state
+    srandom(7);
+    STRCaptureClusterIndex * index = [[STRCaptureClusterIndex alloc] init];
+    CLLocationCoordinate2D coordinates[3000];
+    for (NSUInteger i = 0; i < 3000; i++) {
+        double spread = (i % 3 == 0) ? 2.0 : 0.02;
+        double latitude = 39.96 + (i % 5) * 0.3 + ((double)random() / RAND_MAX - 0.5) * spread;
+        double longitude = -83.0 + (i % 7) * 0.2 + ((double)random() / RAND_MAX - 0.5) * spread;
+        coordinates[i] = CLLocationCoordinate2DMake(latitude, longitude);
+        [index addCaptureWithToken:[NSString stringWithFormat:@"capture%05u", (unsigned)i] coordinate:coordinates[i]];
+    }
+    STAssertEquals(index.count, (NSUInteger)3000, @"Every capture should be indexed");
+
+    CLLocationCoordinate2D southWest = CLLocationCoordinate2DMake(39.0, -84.5);
+    CLLocationCoordinate2D northEast = CLLocationCoordinate2DMake(41.5, -81.0);
+    for (NSUInteger zoomLevel = 0; zoomLevel <= 18; zoomLevel += 3) {
+        // With 64 point cells, clusters are two levels below the tiles. Each
+        // occupied cell that overlaps the region is a cluster.
+        NSUInteger depth = zoomLevel + 2;
+        STRTestCell first = [self cellOfCoordinate:CLLocationCoordinate2DMake(northEast.latitude, southWest.longitude) depth:depth];
+        STRTestCell last = [self cellOfCoordinate:CLLocationCoordinate2DMake(southWest.latitude, northEast.longitude) depth:depth];
+        NSMutableSet * cells = [NSMutableSet set];
+        NSUInteger inCells = 0;
+        for (NSUInteger i = 0; i < 3000; i++) {
+            STRTestCell cell = [self cellOfCoordinate:coordinates[i] depth:depth];
+            if (cell.x < first.x || cell.x > last.x || cell.y < first.y || cell.y > last.y) continue;
+            [cells addObject:[NSString stringWithFormat:@"%.0f/%.0f", cell.x, cell.y]];
+            inCells++;
+        }
+        NSArray * clusters = [index clustersFromSouthWest:southWest toNorthEast:northEast zoomLevel:zoomLevel];
+        STAssertEquals(clusters.count, cells.count, @"There should be one cluster per occupied cell at zoom level %u", (unsigned)zoomLevel);
+        STAssertEquals([self totalCountOfClusters:clusters], inCells, @"Every capture in those cells should be counted once at zoom level %u", (unsigned)zoomLevel);
+    }
+
+    NSArray * world = [index clustersFromSouthWest:CLLocationCoordinate2DMake(-85, -180) toNorthEast:CLLocationCoordinate2DMake(85, 180) zoomLevel:0];
+    STAssertEquals(world.count, (NSUInteger)1, @"All of the captures share a cell when the world is one tile");
+    STAssertEquals([[world lastObject] count], (NSUInteger)3000, @"The cluster should count every capture");
+    STAssertEqualObjects([[world lastObject] representativeToken], @"capture02999", @"The greatest token represents the cluster");
+}
+
+- (void)testSingleCaptureKeepsItsCoordinate
+{
+    STRCaptureClusterIndex * index = [[STRCaptureClusterIndex alloc] init];
+    [index addCaptureWithToken:@"alone" coordinate:CLLocationCoordinate2DMake(43.62538491, -72.51787712)];
+    NSArray * clusters = [index clustersFromSouthWest:CLLocationCoordinate2DMake(43, -73) toNorthEast:CLLocationCoordinate2DMake(44, -72) zoomLevel:14];
+    STAssertEquals(clusters.count, (NSUInteger)1, @"The capture should be found");
+    CLLocationCoordinate2D coordinate = [[clusters lastObject] coordinate];
+    STAssertEqualsWithAccuracy(coordinate.latitude, 43.62538491, 1e-6, @"The latitude should survive the projection");
+    STAssertEqualsWithAccuracy(coordinate.longitude, -72.51787712, 1e-6, @"The longitude should survive the projection");
+}
+
+- (void)testRegionAcrossTheDateLine
+{
+    STRCaptureClusterIndex * index = [[STRCaptureClusterIndex alloc] init];
+    [index addCaptureWithToken:@"fiji" coordinate:CLLocationCoordinate2DMake(-17.7, 178.1)];
+    [index addCaptureWithToken:@"samoa" coordinate:CLLocationCoordinate2DMake(-13.8, -171.8)];
+    [index addCaptureWithToken:@"greenwich" coordinate:CLLocationCoordinate2DMake(51.48, 0)];
+    NSArray * clusters = [index clustersFromSouthWest:CLLocationCoordinate2DMake(-20, 170) toNorthEast:CLLocationCoordinate2DMake(-10, -170) zoomLevel:6];
+    STAssertEqualObjects([NSSet setWithArray:[clusters valueForKey:@"representativeToken"]], ([NSSet setWithObjects:@"fiji", @"samoa", nil]), @"Both sides of the date line should be searched");
+}
+
+#pragma mark - Updates
+
+- (void)testRemovingCapturesUpdatesClusters
+{
+    STRCaptureClusterIndex * index = [[STRCaptureClusterIndex alloc] init];
+    // Many captures at one spot split the tree down to its deepest level
+    for (NSUInteger i = 0; i < 100; i++) {
+        [index addCaptureWithToken:[NSString stringWithFormat:@"capture%03u", (unsigned)i] coordinate:CLLocationCoordinate2DMake(39.96, -83.0 + (i % 2) * 1e-4)];
+    }
+    CLLocationCoordinate2D southWest = CLLocationCoordinate2DMake(39, -84);
+    CLLocationCoordinate2D northEast = CLLocationCoordinate2DMake(41, -82);
+    for (NSUInteger i = 50; i < 100; i++) {
+        STAssertTrue([index removeCaptureWithToken:[NSString stringWithFormat:@"capture%03u", (unsigned)i]], @"The capture should be removed");
+    }
+    STAssertFalse([index removeCaptureWithToken:@"capture099"], @"A capture is removed once");
+
+    NSArray * clusters = [index clustersFromSouthWest:southWest toNorthEast:northEast zoomLevel:10];
+    STAssertEquals(clusters.count, (NSUInteger)1, @"The captures should form one cluster");
+    STAssertEquals([[clusters lastObject] count], (NSUInteger)50, @"The removed captures should not be counted");
+    STAssertEqualObjects([[clusters lastObject] representativeToken], @"capture049", @"A new representative should be chosen");
+
+    // Moving a capture takes it out of its old cell
+    [index addCaptureWithToken:@"capture000" coordinate:CLLocationCoordinate2DMake(10, 10)];
+    STAssertEquals(index.count, (NSUInteger)50, @"A moved capture is not added twice");
+    STAssertEquals([self totalCountOfClusters:[index clustersFromSouthWest:southWest toNorthEast:northEast zoomLevel:10]], (NSUInteger)49, @"The capture should have left the region");
+
+    [index removeAllCaptures];
+    STAssertEquals([index clustersFromSouthWest:southWest toNorthEast:northEast zoomLevel:10].count, (NSUInteger)0, @"Nothing should be left");
+}
+
+- (void)testIndexFollowsTheChangeFeed
+{
+    NSString * capturesPath = [_rootPath stringByAppendingPathComponent:@"StraboCaptures"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    STRCapturePathResolver * resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:capturesPath];
+    STRCaptureChangeFeed * feed = [[STRCaptureChangeFeed alloc] initWithPath:[_rootPath stringByAppendingPathComponent:@"changes.log"]];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [self writeCaptureWithToken:[NSString stringWithFormat:@"%032x", (unsigned)i] coordinate:CLLocationCoordinate2DMake(39.96, -83.0 + i * 0.01) resolver:resolver];
+    }
+
+    STRCaptureClusterIndex * index = [[STRCaptureClusterIndex alloc] init];
+    STAssertEquals([index addCapturesFromResolver:resolver], (NSUInteger)10, @"Every capture should be read");
+    index.sequenceNumber = [feed currentSequenceNumber];
+
+    // A change made before the index follows the feed is caught up with
+    NSString * added = [NSString stringWithFormat:@"%032x", 10];
+    [self writeCaptureWithToken:added coordinate:CLLocationCoordinate2DMake(40.5, -82.5) resolver:resolver];
+    [feed recordChangeOfType:STRCaptureChangeAdded token:added fields:nil];
+    [index followChangesOfFeed:feed resolver:resolver];
+    STAssertEquals(index.count, (NSUInteger)11, @"The added capture should be caught up with");
+
+    [feed recordChangeOfType:STRCaptureChangeDeleted token:[NSString stringWithFormat:@"%032x", 0] fields:nil];
+    [feed recordChangeOfType:STRCaptureChangeUpdated token:[NSString stringWithFormat:@"%032x", 1] fields:[NSSet setWithObject:STRCaptureFieldTitle]];
+    [feed publishPendingChanges];
+    STAssertEquals(index.count, (NSUInteger)10, @"The deleted capture should be removed");
+    STAssertEquals(index.sequenceNumber, [feed currentSequenceNumber], @"The index should be up to date");
+
+    [index stopFollowingChanges];
+    [feed recordChangeOfType:STRCaptureChangeDeleted token:[NSString stringWithFormat:@"%032x", 2] fields:nil];
+    [feed publishPendingChanges];
+    STAssertEquals(index.count, (NSUInteger)10, @"Changes are not applied once the index stops following");
+}
+
+- (void)testZoomLevels
+{
+    STAssertEquals([STRCaptureClusterIndex zoomLevelForLongitudeDelta:360 viewWidth:256], (NSUInteger)0, @"The world in one tile is zoom level 0");
+    STAssertEquals([STRCaptureClusterIndex zoomLevelForLongitudeDelta:360.0 / 1024 viewWidth:512], (NSUInteger)11, @"Each halving of the span is one level");
+}
+
+@end
+
+@implementation STRCaptureClusterIndexTests (InternalMethods)
+
+-(STRTestCell)cellOfCoordinate:(CLLocationCoordinate2D)coordinate depth:(NSUInteger)depth {
+    double x = (coordinate.longitude + 180.0) / 360.0;
+    double s = sin(coordinate.latitude * M_PI / 180.0);
+    double y = 0.5 - log((1 + s) / (1 - s)) / (4 * M_PI);
+    double cells = pow(2.0, (double)depth);
+    STRTestCell cell = { floor(x * cells), floor(y * cells) };
+    return cell;
+}
+
+-(NSUInteger)totalCountOfClusters:(NSArray *)clusters {
+    NSUInteger total = 0;
+    for (STRCaptureCluster * cluster in clusters) total += cluster.count;
+    return total;
+}
+
+-(void)writeCaptureWithToken:(NSString *)token coordinate:(CLLocationCoordinate2D)coordinate resolver:(STRCapturePathResolver *)resolver {
+    NSString * directory = [resolver absolutePathForRelativePath:[resolver relativeDirectoryForToken:token]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+    NSDictionary * info = @{ @"token" : token, @"title" : @"Untitled Capture", @"coords" : @[ @(coordinate.latitude), @(coordinate.longitude) ] };
+    [[NSJSONSerialization dataWithJSONObject:info options:0 error:nil] writeToFile:[directory stringByAppendingPathComponent:@"capture-info.json"] atomically:YES];
+}
+
+@end
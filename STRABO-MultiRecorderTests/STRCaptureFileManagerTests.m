@@ -0,0 +1,191 @@
+//
+//  STRCaptureFileManagerTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureFileManagerTests.h"
+#import "STRCaptureFileManager.h"
+#import "STRCapturePathResolver.h"
+#import "STRTestCaptureFixtures.h"
+#import "NSString+Hash.h"
+
+// The first capture of the test library, with one more every minute after it
+#define kFirstCaptureTime 1344352260
+
+@interface STRCaptureFileManagerTests () {
+    NSString * _capturesPath;
+    STRCapturePathResolver * _resolver;
+    STRTestCaptureFixtures * _fixtures;
+    STRCaptureFileManager * _fileManager;
+}
+@end
+
+@interface STRCaptureFileManagerTests (InternalMethods)
+-(NSString *)writeCaptureAtMinute:(NSUInteger)minute;
+-(NSString *)writeLegacyCaptureAtMinute:(NSUInteger)minute;
+-(NSArray *)tokensOfAllPagesWithSize:(NSUInteger)pageSize sortOrder:(STRCaptureSortOrder)sortOrder;
++(NSArray *)tokensOfCaptures:(NSArray *)captures;
+@end
+
+@implementation STRCaptureFileManagerTests
+
+- (void)setUp
+{
+    [super setUp];
+    _capturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureFileManagerTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:_capturesPath];
+    _fixtures = [[STRTestCaptureFixtures alloc] initWithPathResolver:_resolver];
+    _fileManager = [[STRCaptureFileManager alloc] initWithPathResolver:_resolver];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Paging
+
+- (void)testPagesListEveryCaptureInBothOrders
+{
+    for (NSUInteger minute = 0; minute < 25; minute++) {
+        [self writeCaptureAtMinute:minute];
+    }
+    NSArray * newestFirst = [STRCaptureFileManagerTests tokensOfCaptures:[_fileManager allCapturesSorted:YES]];
+    STAssertEquals(newestFirst.count, (NSUInteger)25, @"Every capture should be listed");
+
+    STAssertEqualObjects([self tokensOfAllPagesWithSize:7 sortOrder:STRCaptureSortOrderNewestFirst], newestFirst, @"The pages should list every capture once, newest first");
+    STAssertEqualObjects([self tokensOfAllPagesWithSize:7 sortOrder:STRCaptureSortOrderOldestFirst], [[newestFirst reverseObjectEnumerator] allObjects], @"The pages should list every capture once, oldest first");
+}
+
+- (void)testPagesMergeLegacyAndTimeOrderedCaptures
+{
+    // Legacy captures are dated from their info files, between the time-ordered ones
+    for (NSUInteger minute = 0; minute < 20; minute++) {
+        if (minute % 2) {
+            [self writeLegacyCaptureAtMinute:minute];
+        } else {
+            [self writeCaptureAtMinute:minute];
+        }
+    }
+    NSArray * newestFirst = [STRCaptureFileManagerTests tokensOfCaptures:[_fileManager allCapturesSorted:YES]];
+    STAssertEquals(newestFirst.count, (NSUInteger)20, @"Every capture should be listed");
+
+    for (NSUInteger pageSize = 1; pageSize <= 6; pageSize++) {
+        STAssertEqualObjects([self tokensOfAllPagesWithSize:pageSize sortOrder:STRCaptureSortOrderNewestFirst], newestFirst, @"Pages of %lu should match the sorted listing", (unsigned long)pageSize);
+        STAssertEqualObjects([self tokensOfAllPagesWithSize:pageSize sortOrder:STRCaptureSortOrderOldestFirst], [[newestFirst reverseObjectEnumerator] allObjects], @"Pages of %lu should match the sorted listing in reverse", (unsigned long)pageSize);
+    }
+}
+
+- (void)testChangesBetweenPagesDoNotSkipOrRepeatCaptures
+{
+    NSMutableArray * tokens = [NSMutableArray array];
+    for (NSUInteger minute = 0; minute < 20; minute++) {
+        [tokens addObject:[self writeCaptureAtMinute:minute * 2]];
+    }
+    NSString * cursor = nil;
+    NSArray * firstPage = [STRCaptureFileManagerTests tokensOfCaptures:[_fileManager capturesWithPageSize:5 afterCursor:nil sortOrder:STRCaptureSortOrderNewestFirst filter:nil nextCursor:&cursor]];
+    STAssertEqualObjects(firstPage, ([[[tokens subarrayWithRange:NSMakeRange(15, 5)] reverseObjectEnumerator] allObjects]), @"The first page should hold the newest captures");
+    STAssertNotNil(cursor, @"There should be more pages");
+
+    // Delete a capture that was already listed and one that was not, and add one
+    // on each side of the cursor
+    STAssertTrue([_fileManager deleteCaptureWithToken:[tokens objectAtIndex:17]], @"A listed capture should be deleted");
+    STAssertTrue([_fileManager deleteCaptureWithToken:[tokens objectAtIndex:10]], @"An unlisted capture should be deleted");
+    NSString * newer = [self writeCaptureAtMinute:41];
+    NSString * older = [self writeCaptureAtMinute:21];
+
+    NSMutableArray * rest = [NSMutableArray array];
+    while (cursor) {
+        NSArray * page = [_fileManager capturesWithPageSize:5 afterCursor:cursor sortOrder:STRCaptureSortOrderNewestFirst filter:nil nextCursor:&cursor];
+        STAssertNotNil(page, @"A cursor of the listing should stay valid");
+        [rest addObjectsFromArray:[STRCaptureFileManagerTests tokensOfCaptures:page]];
+    }
+
+    NSMutableArray * expected = [NSMutableArray array];
+    for (NSInteger i = 14; i >= 0; i--) {
+        if (i == 10) continue;
+        [expected addObject:[tokens objectAtIndex:i]];
+        // Minute 21 falls between the captures of minutes 20 and 22
+        if (i == 11) [expected addObject:older];
+    }
+    STAssertEqualObjects(rest, expected, @"The later pages should go on from the cursor, with the capture added after it and without the deleted one");
+    STAssertFalse([rest containsObject:newer], @"A capture added before the cursor should not show up on later pages");
+}
+
+- (void)testInvalidCursorsReturnNil
+{
+    [self writeCaptureAtMinute:0];
+    for (NSString * cursor in @[ @"", @"0139", @"not a cursor at all", @"0139ZZZZZZZZ013901a38fa0f3b9", @"01390000000a../t01390/x" ]) {
+        STAssertNil([_fileManager capturesWithPageSize:5 afterCursor:cursor sortOrder:STRCaptureSortOrderNewestFirst filter:nil nextCursor:NULL], @"The cursor \"%@\" should be refused", cursor);
+    }
+}
+
+- (void)testFullLastPageIsFollowedByAnEmptyPage
+{
+    for (NSUInteger minute = 0; minute < 10; minute++) {
+        [self writeCaptureAtMinute:minute];
+    }
+    NSString * cursor = nil;
+    NSArray * page = [_fileManager capturesWithPageSize:5 afterCursor:nil sortOrder:STRCaptureSortOrderOldestFirst filter:nil nextCursor:&cursor];
+    STAssertEquals(page.count, (NSUInteger)5, @"The first page should be full");
+    page = [_fileManager capturesWithPageSize:5 afterCursor:cursor sortOrder:STRCaptureSortOrderOldestFirst filter:nil nextCursor:&cursor];
+    STAssertEquals(page.count, (NSUInteger)5, @"The last page should be full");
+    // The listing stops as soon as the page is full, so it cannot know that nothing follows
+    STAssertNotNil(cursor, @"A full page should come with a cursor");
+
+    page = [_fileManager capturesWithPageSize:5 afterCursor:cursor sortOrder:STRCaptureSortOrderOldestFirst filter:nil nextCursor:&cursor];
+    STAssertNotNil(page, @"The cursor after the last capture should be valid");
+    STAssertEquals(page.count, (NSUInteger)0, @"Nothing should follow the last capture");
+    STAssertNil(cursor, @"The empty page should end the listing");
+}
+
+- (void)testFilteredPagesStillEnd
+{
+    for (NSUInteger minute = 0; minute < 12; minute++) {
+        [self writeCaptureAtMinute:minute];
+    }
+    NSString * cursor = nil;
+    NSArray * page = [_fileManager capturesWithPageSize:5 afterCursor:nil sortOrder:STRCaptureSortOrderNewestFirst filter:^BOOL(STRCapture * capture) {
+        return NO;
+    } nextCursor:&cursor];
+    STAssertEquals(page.count, (NSUInteger)0, @"The filter should drop every capture");
+    STAssertNil(cursor, @"Every capture was read, so there should be no next page");
+}
+
+@end
+
+@implementation STRCaptureFileManagerTests (InternalMethods)
+
+-(NSString *)writeCaptureAtMinute:(NSUInteger)minute {
+    return [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:kFirstCaptureTime + minute * 60]];
+}
+
+-(NSString *)writeLegacyCaptureAtMinute:(NSUInteger)minute {
+    NSString * token = [[NSString stringWithFormat:@"Legacy capture %lu", (unsigned long)minute] SHA2];
+    return [_fixtures writeCaptureWithToken:token date:[NSDate dateWithTimeIntervalSince1970:kFirstCaptureTime + minute * 60] info:nil points:nil media:nil];
+}
+
+-(NSArray *)tokensOfAllPagesWithSize:(NSUInteger)pageSize sortOrder:(STRCaptureSortOrder)sortOrder {
+    NSMutableArray * tokens = [NSMutableArray array];
+    NSString * cursor = nil;
+    // More pages than there are captures means the cursor is not moving
+    for (NSUInteger pages = 0; pages <= 100; pages++) {
+        NSArray * page = [_fileManager capturesWithPageSize:pageSize afterCursor:cursor sortOrder:sortOrder filter:nil nextCursor:&cursor];
+        if (!page) return nil;
+        [tokens addObjectsFromArray:[STRCaptureFileManagerTests tokensOfCaptures:page]];
+        if (!cursor) return tokens;
+    }
+    return nil;
+}
+
++(NSArray *)tokensOfCaptures:(NSArray *)captures {
+    return [captures valueForKey:@"token"];
+}
+
+@end
@@ -0,0 +1,212 @@
+//
+//  STRCaptureFileParserTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureFileParserTests.h"
+#import "STRCaptureFileParser.h"
+#import "STRTrackFilter.h"
+
+@interface STRCaptureFileParserTests () {
+    NSString * _directoryPath;
+    STRCaptureFileParser * _parser;
+}
+@end
+
+@interface STRCaptureFileParserTests (InternalMethods)
+-(NSString *)writeFileWithString:(NSString *)contents;
+@end
+
+@implementation STRCaptureFileParserTests
+
+- (void)setUp
+{
+    [super setUp];
+    _directoryPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureFileParserTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_directoryPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_directoryPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _parser = [[STRCaptureFileParser alloc] init];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_directoryPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Capture Info Files
+
+- (void)testCaptureInfoFieldsMatchFoundation
+{
+    NSDictionary * info = @{
+    @"created_at" : @1350658800,
+    @"uploaded_at" : @1350662400.25,
+    @"coords" : @[ @43.62541234567, @-72.51789876543 ],
+    @"heading" : @271.5,
+    @"title" : @"Café \"on the green\"\n日本 \U0001F600",
+    @"token" : @"20121019-153000-0a1b2c3d",
+    @"media_type" : @"video",
+    @"geodata_file" : @"2012/10/19/20121019-153000-0a1b2c3d/20121019-153000-0a1b2c3d.json",
+    @"media_file" : @"2012/10/19/20121019-153000-0a1b2c3d/20121019-153000-0a1b2c3d.mov",
+    @"thumbnail_file" : @"2012/10/19/20121019-153000-0a1b2c3d/20121019-153000-0a1b2c3d.png",
+    @"extra" : @{ @"nested" : @[ @1, @"two", @{ @"three" : [NSNull null] }, @YES ] }
+    };
+    NSData * data = [NSJSONSerialization dataWithJSONObject:info options:NSJSONWritingPrettyPrinted error:nil];
+    NSString * path = [_directoryPath stringByAppendingPathComponent:@"capture-info.json"];
+    [data writeToFile:path atomically:NO];
+
+    STRCaptureInfoFields fields;
+    STAssertTrue([_parser parseCaptureInfoAtPath:path fields:&fields], @"The capture info should parse");
+    STAssertEquals(fields.createdAt, [[info objectForKey:@"created_at"] doubleValue], @"created_at");
+    STAssertEquals(fields.uploadedAt, [[info objectForKey:@"uploaded_at"] doubleValue], @"uploaded_at");
+    STAssertEquals(fields.latitude, 43.62541234567, @"The latitude should be exact");
+    STAssertEquals(fields.longitude, -72.51789876543, @"The longitude should be exact");
+    STAssertEquals(fields.heading, 271.5, @"heading");
+    // Foundation writes the slashes of paths as \/, so these go through the escaped path
+    for (NSString * key in @[ @"title", @"token", @"media_type", @"geodata_file", @"media_file", @"thumbnail_file" ]) {
+        STRParsedString field = ([key isEqualToString:@"title"]) ? fields.title : ([key isEqualToString:@"token"]) ? fields.token : ([key isEqualToString:@"media_type"]) ? fields.mediaType : ([key isEqualToString:@"geodata_file"]) ? fields.geoDataFile : ([key isEqualToString:@"media_file"]) ? fields.mediaFile : fields.thumbnailFile;
+        STAssertEqualObjects([_parser stringForField:field], [info objectForKey:key], @"%@ should match", key);
+    }
+    STAssertFalse(fields.filteredGeoDataFile.present, @"A missing string should not be present");
+    STAssertNil([_parser stringForField:fields.filteredGeoDataFile], @"A missing string should be nil");
+}
+
+- (void)testMissingHeadingIsNotANumber
+{
+    NSString * path = [self writeFileWithString:@"{\"coords\":[1,2],\"token\":\"abc\"}"];
+    STRCaptureInfoFields fields;
+    STAssertTrue([_parser parseCaptureInfoAtPath:path fields:&fields], @"The capture info should parse");
+    STAssertTrue(isnan(fields.heading), @"A missing heading should be NAN");
+    STAssertEquals(fields.createdAt, 0.0, @"A missing number should be 0");
+    STAssertEqualObjects([_parser stringForField:fields.token], @"abc", @"An unescaped string should be read in place");
+}
+
+- (void)testMalformedCaptureInfoIsRefused
+{
+    NSArray * documents = @[
+    @"",
+    @"{\"coords\":[1,2]",
+    @"{\"coords\":[1,2]} x",
+    @"{\"coords\":[1,2],}",
+    @"{\"coords\":[1]}",
+    @"{\"coords\":\"1,2\"}",
+    @"{\"token\":\"abc\"}",
+    @"{\"coords\":[1,2],\"token\":7}",
+    @"{\"coords\":[1,2],\"heading\":\"north\"}",
+    @"{\"coords\":[1,2],\"title\":\"unterminated}",
+    @"{\"coords\":[1,2],\"title\":\"bad \\q escape\"}",
+    @"{\"coords\":[01,2]}",
+    @"{\"coords\":[1.,2]}",
+    @"{\"coords\":[1,2],\"extra\":[tru]}",
+    @"[{\"coords\":[1,2]}]"
+    ];
+    STRCaptureInfoFields fields;
+    for (NSString * document in documents) {
+        NSString * path = [self writeFileWithString:document];
+        STAssertFalse([_parser parseCaptureInfoAtPath:path fields:&fields], @"%@ should be refused", document);
+    }
+    STAssertFalse([_parser parseCaptureInfoAtPath:[_directoryPath stringByAppendingPathComponent:@"missing.json"] fields:&fields], @"A missing file should be refused");
+}
+
+#pragma mark - Geodata Files
+
+- (void)testNumbersMatchFoundation
+{
+    NSArray * numbers = @[ @"0", @"1e3", @"-2.5E-3", @"0.1", @"123456789012345678", @"1.7976931348623157e308", @"43.625412345678901234", @"-72.5", @"9007199254740993", @"1e-30", @"1e23" ];
+    NSMutableArray * points = [NSMutableArray array];
+    for (NSString * number in numbers) {
+        [points addObject:[NSString stringWithFormat:@"{\"coords\":[%@,%@],\"timestamp\":%@}", number, number, number]];
+    }
+    NSString * json = [NSString stringWithFormat:@"{\"points\":[%@]}", [points componentsJoinedByString:@","]];
+    NSString * path = [self writeFileWithString:json];
+
+    STRTrackSample * samples = NULL;
+    NSUInteger count = 0;
+    STAssertTrue([_parser parseGeoDataAtPath:path samples:&samples count:&count], @"The geodata should parse");
+    STAssertEquals(count, numbers.count, @"Every point should be read");
+    NSArray * expected = [[NSJSONSerialization JSONObjectWithData:[json dataUsingEncoding:NSUTF8StringEncoding] options:0 error:nil] objectForKey:@"points"];
+    for (NSUInteger i = 0; i < MIN(count, expected.count); i++) {
+        double value = [[[expected objectAtIndex:i] objectForKey:@"timestamp"] doubleValue];
+        STAssertEquals(samples[i].latitude, value, @"%@ should convert as Foundation does", [numbers objectAtIndex:i]);
+        STAssertEquals(samples[i].timestamp, value, @"%@ should convert as Foundation does", [numbers objectAtIndex:i]);
+    }
+    free(samples);
+}
+
+- (void)testMissingPointFields
+{
+    NSString * path = [self writeFileWithString:@"{\"version\":2,\"points\":[{\"coords\":[1,2],\"timestamp\":3,\"speed\":[4,{}]},{\"heading\":90,\"accuracy\":5,\"timestamp\":4}]}"];
+    STRTrackSample * samples = NULL;
+    NSUInteger count = 0;
+    STAssertTrue([_parser parseGeoDataAtPath:path samples:&samples count:&count], @"Unknown keys should be skipped");
+    STAssertEquals(count, (NSUInteger)2, @"Both points should be read");
+    if (count == 2) {
+        STAssertEquals(samples[0].heading, -1.0, @"A missing heading should be -1");
+        STAssertEquals(samples[0].accuracy, -1.0, @"A missing accuracy should be -1");
+        STAssertEquals(samples[1].latitude, 0.0, @"Missing coordinates should be 0");
+        STAssertEquals(samples[1].heading, 90.0, @"heading");
+        STAssertEquals(samples[1].accuracy, -1.0, @"An accuracy without a fix should be -1");
+        STRTrackSample generic = [STRTrackFilter sampleFromPoint:@{ @"heading" : @90, @"accuracy" : @5, @"timestamp" : @4 }];
+        STAssertEquals(samples[1].accuracy, generic.accuracy, @"The accuracy should match sampleFromPoint:");
+    }
+    free(samples);
+
+    path = [self writeFileWithString:@"{\"points\":[]}"];
+    samples = NULL;
+    STAssertTrue([_parser parseGeoDataAtPath:path samples:&samples count:&count], @"An empty track should parse");
+    STAssertEquals(count, (NSUInteger)0, @"An empty track has no points");
+    STAssertTrue(samples == NULL, @"An empty track has no samples");
+
+    for (NSString * document in @[ @"{}", @"{\"points\":[{\"coords\":[1,2]},]}", @"{\"points\":[{\"coords\":[1,2]}]", @"{\"points\":{}}" ]) {
+        path = [self writeFileWithString:document];
+        STAssertFalse([_parser parseGeoDataAtPath:path samples:&samples count:&count], @"%@ should be refused", document);
+    }
+}
+
+- (void)testLargeTrackIsMapped
+{
+    // Well over the size that is read into the buffer
+    NSUInteger pointCount = 20000;
+    NSMutableArray * track = [NSMutableArray arrayWithCapacity:pointCount];
+    for (NSUInteger i = 0; i < pointCount; i++) {
+        [track addObject:@{ @"coords" : @[ @(43.6254 + i * 1e-6), @(-72.5179 - i * 1e-6) ], @"heading" : @(i % 360), @"accuracy" : @(5 + i % 25), @"timestamp" : @(i * 0.5) }];
+    }
+    NSString * path = [_directoryPath stringByAppendingPathComponent:@"track.json"];
+    NSData * data = [NSJSONSerialization dataWithJSONObject:@{ @"points" : track } options:0 error:nil];
+    [data writeToFile:path atomically:NO];
+    // Compare with the numbers as written, which need not round trip
+    NSArray * points = [[NSJSONSerialization JSONObjectWithData:data options:0 error:nil] objectForKey:@"points"];
+    STAssertTrue([[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize] > 64 * 1024, @"The track should be large enough to be mapped");
+
+    STRTrackSample * samples = NULL;
+    NSUInteger count = 0;
+    STAssertTrue([_parser parseGeoDataAtPath:path samples:&samples count:&count], @"The track should parse");
+    STAssertEquals(count, pointCount, @"Every point should be read");
+    for (NSUInteger i = 0; i < MIN(count, pointCount); i++) {
+        STRTrackSample expected = [STRTrackFilter sampleFromPoint:[points objectAtIndex:i]];
+        if (memcmp(&samples[i], &expected, sizeof(STRTrackSample)) != 0) {
+            STFail(@"Point %u does not match", (unsigned)i);
+            break;
+        }
+    }
+    free(samples);
+
+    // The buffer for small files still works after a mapping
+    STRCaptureInfoFields fields;
+    STAssertTrue([_parser parseCaptureInfoAtPath:[self writeFileWithString:@"{\"coords\":[1,2]}"] fields:&fields], @"A small file should parse after a large one");
+}
+
+@end
+
+@implementation STRCaptureFileParserTests (InternalMethods)
+
+-(NSString *)writeFileWithString:(NSString *)contents {
+    NSString * path = [_directoryPath stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+    [contents writeToFile:path atomically:NO encoding:NSUTF8StringEncoding error:nil];
+    return path;
+}
+
+@end
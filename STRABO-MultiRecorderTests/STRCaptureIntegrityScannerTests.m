@@ -0,0 +1,133 @@
+//
+//  STRCaptureIntegrityScannerTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureIntegrityScannerTests.h"
+#import "STRCaptureIntegrityScanner.h"
+#import "STRCapturePathResolver.h"
+#import "STRTestCaptureFixtures.h"
+
+#include <utime.h>
+
+@interface STRCaptureIntegrityScannerTests () {
+    NSString * _capturesPath;
+    STRCapturePathResolver * _resolver;
+    STRTestCaptureFixtures * _fixtures;
+}
+@end
+
+@interface STRCaptureIntegrityScannerTests (InternalMethods)
+-(void)backdateCapture:(NSString *)token;
+@end
+
+@implementation STRCaptureIntegrityScannerTests
+
+- (void)setUp
+{
+    [super setUp];
+    _capturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureIntegrityScannerTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:_capturesPath];
+    _fixtures = [[STRTestCaptureFixtures alloc] initWithPathResolver:_resolver];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Behavior
+
+- (void)testIntactCapturesAreClean
+{
+    for (int i = 0; i < 100; i++) {
+        [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260 + i * 3600]];
+    }
+    STRCaptureIntegrityScanner * scanner = [[STRCaptureIntegrityScanner alloc] initWithPathResolver:_resolver];
+    scanner.parsesGeoData = YES;
+    STRCaptureIntegrityReport * report = [scanner scan];
+    STAssertEquals(report.scannedCount, (NSUInteger)100, @"Every capture should be checked");
+    STAssertTrue([report isClean], @"Intact captures should have no issues: %@", [report dictionaryRepresentation]);
+}
+
+- (void)testDamageIsFoundAndQuarantined
+{
+    NSString * intact = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    NSString * badInfo = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352261]];
+    NSString * noMedia = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352262]];
+    NSString * truncatedTrack = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352263]];
+    [@"{\"token\":" writeToFile:[_fixtures pathOfFile:@"capture-info.json" inCapture:badInfo] atomically:NO encoding:NSUTF8StringEncoding error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[_fixtures pathOfFile:[noMedia stringByAppendingPathExtension:@"jpg"] inCapture:noMedia] error:nil];
+    [@"{\"points\":[{\"timestamp\":0," writeToFile:[_fixtures pathOfFile:[truncatedTrack stringByAppendingPathExtension:@"json"] inCapture:truncatedTrack] atomically:NO encoding:NSUTF8StringEncoding error:nil];
+    for (NSString * token in @[ intact, badInfo, noMedia, truncatedTrack ]) {
+        [self backdateCapture:token];
+    }
+
+    STRCaptureIntegrityScanner * scanner = [[STRCaptureIntegrityScanner alloc] initWithPathResolver:_resolver];
+    scanner.quarantinesCaptures = YES;
+    STRCaptureIntegrityReport * report = [scanner scan];
+
+    STAssertNil([report.issues objectForKey:intact], @"The intact capture should have no issues");
+    STAssertTrue([[report.issues objectForKey:badInfo] intValue] & STRCaptureIssueInfoUnreadable, @"A damaged info file should be found");
+    STAssertTrue([[report.issues objectForKey:noMedia] intValue] & STRCaptureIssueMediaMissing, @"Missing media should be found");
+    STAssertTrue([[report.issues objectForKey:truncatedTrack] intValue] & STRCaptureIssueGeoDataUnreadable, @"A truncated track should be found without parsing it");
+    STAssertEquals(report.quarantinedTokens.count, (NSUInteger)3, @"Every damaged capture should be quarantined");
+
+    NSArray * listed = [_resolver allCaptureDirectories];
+    STAssertEquals(listed.count, (NSUInteger)1, @"Quarantined captures should not be listed");
+    STAssertEqualObjects([[listed objectAtIndex:0] lastPathComponent], intact, @"Only the intact capture should be listed");
+    STAssertEquals([[_resolver quarantinedCaptureNames] count], (NSUInteger)3, @"The damaged captures should be kept in quarantine");
+}
+
+- (void)testRepairRebuildsLostFiles
+{
+    NSString * token = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    [[NSFileManager defaultManager] removeItemAtPath:[_fixtures pathOfFile:@"capture-info.json" inCapture:token] error:nil];
+    [self backdateCapture:token];
+
+    STRCaptureIntegrityScanner * scanner = [[STRCaptureIntegrityScanner alloc] initWithPathResolver:_resolver];
+    scanner.repairsCaptures = YES;
+    scanner.quarantinesCaptures = YES;
+    STRCaptureIntegrityReport * report = [scanner scan];
+
+    STAssertEqualObjects(report.repairedTokens, @[ token ], @"The capture should be repaired");
+    STAssertEquals(report.quarantinedTokens.count, (NSUInteger)0, @"A repaired capture should not be quarantined");
+    STAssertEquals([scanner issuesForCaptureAtRelativeDirectory:[_resolver relativeDirectoryOfCaptureWithToken:token]], STRCaptureIssueNone, @"The rebuilt capture should be intact");
+}
+
+- (void)testChecksumsCatchChangedFiles
+{
+    NSString * token = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    [self backdateCapture:token];
+    STRCaptureIntegrityScanner * scanner = [[STRCaptureIntegrityScanner alloc] initWithPathResolver:_resolver];
+    scanner.verifiesChecksums = YES;
+    STAssertTrue([[scanner scan] isClean], @"The first scan should record checksums");
+
+    // Same size, different contents
+    NSString * mediaPath = [_fixtures pathOfFile:[token stringByAppendingPathExtension:@"jpg"] inCapture:token];
+    NSMutableData * media = [NSMutableData dataWithContentsOfFile:mediaPath];
+    ((unsigned char *)media.mutableBytes)[media.length / 2] ^= 0xff;
+    [media writeToFile:mediaPath atomically:NO];
+    [self backdateCapture:token];
+
+    STAssertEquals([[[[scanner scan] issues] objectForKey:token] intValue], (int)STRCaptureIssueChecksumMismatch, @"A changed media file should be found");
+}
+
+@end
+
+@implementation STRCaptureIntegrityScannerTests (InternalMethods)
+
+-(void)backdateCapture:(NSString *)token {
+    // The scanner leaves captures alone while they may still be being written
+    struct utimbuf times = { time(NULL) - 3600, time(NULL) - 3600 };
+    utime([[_resolver absolutePathForRelativePath:[_resolver relativeDirectoryForToken:token]] fileSystemRepresentation], &times);
+    utime([[_fixtures pathOfFile:@"capture-info.json" inCapture:token] fileSystemRepresentation], &times);
+}
+
+@end
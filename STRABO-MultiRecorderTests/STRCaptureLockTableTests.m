@@ -0,0 +1,216 @@
+//
+//  STRCaptureLockTableTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureLockTableTests.h"
+#import "STRCaptureLockTable.h"
+#import "STRCapture.h"
+#import "STRCapturePathResolver.h"
+#import "STRCaptureToken.h"
+#import "STRTrackSummary.h"
+#import "STRTestCaptureFixtures.h"
+
+#import <libkern/OSAtomic.h>
+
+// The stress test gives each capture one thread that renames it and one that marks it uploaded
+#define kStressCaptureCount 8
+#define kStressEditsPerThread 50
+#define kStressListingThreads 4
+#define kStressTimeout 60
+
+@interface STRCaptureLockTableTests () {
+    NSString * _capturesPath;
+    STRCapturePathResolver * _resolver;
+    STRTestCaptureFixtures * _fixtures;
+}
+@end
+
+@implementation STRCaptureLockTableTests
+
+- (void)setUp
+{
+    [super setUp];
+    _capturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureLockTableTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:_capturesPath];
+    _fixtures = [[STRTestCaptureFixtures alloc] initWithPathResolver:_resolver];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Locking
+
+- (void)testWritersExcludeEachOther
+{
+    STRCaptureLockTable * table = [[STRCaptureLockTable alloc] initWithStripeCount:4];
+    __block NSUInteger counter = 0;
+    // A plain increment loses updates unless the writers really take turns
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+        for (int i = 0; i < 10000; i++) {
+            [table writeCaptureWithToken:@"capture" usingBlock:^{
+                NSUInteger value = counter;
+                counter = value + 1;
+            }];
+        }
+    });
+    STAssertEquals(counter, (NSUInteger)80000, @"Every increment should be kept");
+}
+
+- (void)testReadersShareALock
+{
+    STRCaptureLockTable * table = [[STRCaptureLockTable alloc] initWithStripeCount:1];
+    dispatch_semaphore_t firstReaderIn = dispatch_semaphore_create(0);
+    dispatch_semaphore_t secondReaderIn = dispatch_semaphore_create(0);
+    __block long secondReaderWait = -1;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [table readCaptureWithToken:@"capture" usingBlock:^{
+            dispatch_semaphore_signal(firstReaderIn);
+            // Only returns in time if the second reader gets in while this one holds the lock
+            secondReaderWait = dispatch_semaphore_wait(secondReaderIn, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC));
+        }];
+    });
+    dispatch_semaphore_wait(firstReaderIn, DISPATCH_TIME_FOREVER);
+    [table readCaptureWithToken:@"capture" usingBlock:^{
+        dispatch_semaphore_signal(secondReaderIn);
+    }];
+    // Taking the write lock waits for the first reader to finish
+    [table writeCaptureWithToken:@"capture" usingBlock:^{}];
+    STAssertEquals(secondReaderWait, 0L, @"Two readers should hold the lock at once");
+}
+
+- (void)testCapturesOnDifferentStripesDoNotWait
+{
+    STRCaptureLockTable * table = [[STRCaptureLockTable alloc] initWithStripeCount:2];
+    NSString * first = [STRCaptureToken generateToken];
+    NSString * second = [STRCaptureToken generateToken];
+    while (second.hash % 2 == first.hash % 2) second = [STRCaptureToken generateToken];
+
+    dispatch_semaphore_t holding = dispatch_semaphore_create(0);
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [table writeCaptureWithToken:first usingBlock:^{
+            dispatch_semaphore_signal(holding);
+            dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+        }];
+    });
+    dispatch_semaphore_wait(holding, DISPATCH_TIME_FOREVER);
+    __block BOOL ran = NO;
+    // Would never return if the second capture shared the lock of the first
+    [table writeCaptureWithToken:second usingBlock:^{
+        ran = YES;
+    }];
+    dispatch_semaphore_signal(done);
+    STAssertTrue(ran, @"A capture on another stripe should be locked at once");
+}
+
+#pragma mark - Concurrent Capture Access
+
+- (void)testConcurrentEditsKeepEveryChange
+{
+    NSMutableArray * tokens = [NSMutableArray arrayWithCapacity:kStressCaptureCount];
+    for (NSUInteger i = 0; i < kStressCaptureCount; i++) {
+        [tokens addObject:[_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260 + i * 3600]]];
+    }
+
+    __block volatile int32_t failures = 0;
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    for (NSString * token in tokens) {
+        // Renames and upload marks of the same capture, saved from separate STRCapture objects
+        dispatch_group_async(group, queue, ^{
+            for (int i = 1; i <= kStressEditsPerThread; i++) {
+                @autoreleasepool {
+                    STRCapture * capture = [STRCapture captureFromFilesAtDirectory:token pathResolver:_resolver];
+                    capture.title = [NSString stringWithFormat:@"Title %d", i];
+                    if (![capture save]) OSAtomicIncrement32Barrier(&failures);
+                }
+            }
+        });
+        dispatch_group_async(group, queue, ^{
+            for (int i = 1; i <= kStressEditsPerThread; i++) {
+                @autoreleasepool {
+                    STRCapture * capture = [STRCapture captureFromFilesAtDirectory:token pathResolver:_resolver];
+                    if (![capture markUploadedAtDate:[NSDate dateWithTimeIntervalSince1970:1350000000 + i]]) OSAtomicIncrement32Barrier(&failures);
+                }
+            }
+        });
+    }
+    // Listings read without locks, and must never find a capture half written
+    for (int reader = 0; reader < kStressListingThreads; reader++) {
+        dispatch_group_async(group, queue, ^{
+            for (int i = 0; i < kStressEditsPerThread; i++) {
+                @autoreleasepool {
+                    for (NSString * directory in [_resolver allCaptureDirectories]) {
+                        if (![STRCapture captureFromFilesAtDirectory:directory pathResolver:_resolver]) OSAtomicIncrement32Barrier(&failures);
+                    }
+                }
+            }
+        });
+    }
+    // A backfill rewrites the same info files in the middle of it all
+    dispatch_group_async(group, queue, ^{
+        [STRTrackSummary backfillCapturesOfResolver:_resolver];
+    });
+    STAssertEquals(dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, kStressTimeout * NSEC_PER_SEC)), 0L, @"The threads should finish without deadlocking");
+    STAssertTrue(failures == 0, @"Every save and every read should succeed, but %d failed", failures);
+
+    for (NSString * token in tokens) {
+        NSDictionary * info = [_fixtures captureInfoOfCapture:token];
+        STAssertEqualObjects([info objectForKey:@"title"], ([NSString stringWithFormat:@"Title %d", kStressEditsPerThread]), @"The last rename should be kept");
+        STAssertEquals([[info objectForKey:@"uploaded_at"] doubleValue], (double)(1350000000 + kStressEditsPerThread), @"The last upload mark should be kept");
+        STAssertNotNil([STRTrackSummary summaryFromDictionary:[info objectForKey:@"track_summary"]], @"The backfilled summary should be kept");
+    }
+}
+
+- (void)testSaveOnlyWritesChangedProperties
+{
+    NSString * token = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    STRCapture * renamed = [STRCapture captureFromFilesAtDirectory:token pathResolver:_resolver];
+    STRCapture * uploaded = [STRCapture captureFromFilesAtDirectory:token pathResolver:_resolver];
+
+    renamed.title = @"Renamed";
+    STAssertTrue([renamed save], @"The title should be saved");
+    STAssertTrue([uploaded markUploadedAtDate:[NSDate dateWithTimeIntervalSince1970:1350000000]], @"The upload date should be saved");
+
+    NSDictionary * info = [_fixtures captureInfoOfCapture:token];
+    STAssertEqualObjects([info objectForKey:@"title"], @"Renamed", @"Saving the upload date should not bring back the old title");
+    STAssertEquals([[info objectForKey:@"uploaded_at"] doubleValue], 1350000000.0, @"The upload date should be saved");
+}
+
+- (void)testSaveFollowsACaptureMovedWhileItWaits
+{
+    // Put the capture where earlier versions of the SDK kept it
+    NSString * token = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    NSString * shardedDirectory = [_resolver absolutePathForRelativePath:[_resolver relativeDirectoryForToken:token]];
+    NSString * flatDirectory = [_resolver absolutePathForRelativePath:token];
+    [[NSFileManager defaultManager] moveItemAtPath:shardedDirectory toPath:flatDirectory error:nil];
+    STRCapture * capture = [STRCapture captureFromFilesAtDirectory:token pathResolver:_resolver];
+    STAssertNotNil(capture, @"The flat capture should be read");
+
+    // The migration moves the capture into its shard while the save waits for the lock
+    dispatch_semaphore_t locked = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [[STRCaptureLockTable sharedTable] writeCaptureWithToken:token usingBlock:^{
+            dispatch_semaphore_signal(locked);
+            [NSThread sleepForTimeInterval:0.2];
+            [[NSFileManager defaultManager] moveItemAtPath:flatDirectory toPath:shardedDirectory error:nil];
+        }];
+    });
+    dispatch_semaphore_wait(locked, DISPATCH_TIME_FOREVER);
+
+    capture.title = @"Renamed";
+    STAssertTrue([capture save], @"The save should find the capture where it was moved");
+    STAssertEqualObjects([[_fixtures captureInfoOfCapture:token] objectForKey:@"title"], @"Renamed", @"The title should be saved in the moved capture");
+    STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:flatDirectory], @"Nothing should be written where the capture used to be");
+}
+
+@end
@@ -0,0 +1,75 @@
+//
+//  STRCapturePathResolverTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCapturePathResolverTests.h"
+#import "STRCapturePathResolver.h"
+#import "STRCaptureToken.h"
+
+@interface STRCapturePathResolverTests () {
+    NSString * _capturesPath;
+    STRCapturePathResolver * _resolver;
+}
+@end
+
+@implementation STRCapturePathResolverTests
+
+- (void)setUp
+{
+    [super setUp];
+    _capturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCapturePathResolverTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:_capturesPath];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Behavior
+
+- (void)testTokensMapToShards
+{
+    STAssertEqualObjects([_resolver relativeDirectoryForToken:@"013901a38fa0f3b9a2c17d04be55e96a"], @"t01390/013901a38fa0f3b9a2c17d04be55e96a", @"Time-ordered tokens should be sharded by date");
+    STAssertEqualObjects([_resolver shardForToken:@"338d2c23d2308bfced6117b3e9d63180d5594c8a9f5b8bd5a050914c239f358d"], @"h33", @"Legacy tokens should be sharded by prefix");
+    STAssertNil([_resolver shardForToken:@".DS_Store"], @"Other directory entries have no shard");
+}
+
+- (void)testMigrationKeepsCapturesReachable
+{
+    NSMutableArray * tokens = [NSMutableArray array];
+    for (int i = 0; i < 20; i++) {
+        NSString * token = [STRCaptureToken generateTokenWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260 + i * 86400]];
+        [[NSFileManager defaultManager] createDirectoryAtPath:[_capturesPath stringByAppendingPathComponent:token] withIntermediateDirectories:NO attributes:nil error:nil];
+        [[token dataUsingEncoding:NSUTF8StringEncoding] writeToFile:[[_capturesPath stringByAppendingPathComponent:token] stringByAppendingPathComponent:@"capture-info.json"] atomically:YES];
+        [tokens addObject:token];
+    }
+
+    NSString * token = [tokens objectAtIndex:0];
+    STAssertEqualObjects([_resolver relativeDirectoryOfCaptureWithToken:token], token, @"A flat capture should be found before the migration");
+    STAssertEquals([[_resolver allCaptureDirectories] count], tokens.count, @"Flat captures should be listed before the migration");
+    STAssertFalse([_resolver isMigrationComplete], @"The migration has not run yet");
+
+    STAssertEquals([_resolver migrateFlatCaptures], tokens.count, @"Every flat capture should be moved");
+    STAssertTrue([_resolver isMigrationComplete], @"The layout marker should be written");
+    STAssertEqualObjects([_resolver relativeDirectoryOfCaptureWithToken:token], [_resolver relativeDirectoryForToken:token], @"A migrated capture should be found in its shard");
+
+    // A path read before the migration still leads to the file
+    NSString * stalePath = [token stringByAppendingPathComponent:@"capture-info.json"];
+    STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[_resolver absolutePathForCaptureFile:stalePath]], @"Stale paths should follow the capture");
+
+    NSMutableArray * listed = [NSMutableArray array];
+    [_resolver enumerateTimeOrderedCaptureDirectoriesFromDate:nil toDate:nil usingBlock:^(NSString * relativeDirectory, BOOL * stop) {
+        [listed addObject:[relativeDirectory lastPathComponent]];
+    }];
+    STAssertEqualObjects(listed, [[tokens reverseObjectEnumerator] allObjects], @"Captures should be listed newest first");
+}
+
+@end
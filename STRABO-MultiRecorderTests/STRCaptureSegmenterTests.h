@@ -0,0 +1,13 @@
+//
+//  STRCaptureSegmenterTests.h
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface STRCaptureSegmenterTests : SenTestCase
+
+@end
@@ -0,0 +1,229 @@
+//
+//  STRCaptureSegmenterTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureSegmenterTests.h"
+#import "STRCaptureSegmenter.h"
+#import "STRCaptureToken.h"
+
+@interface STRCaptureSegmenterTests () {
+    NSString * _rootPath;
+    NSString * _token;
+    NSString * _capturePath;
+}
+@end
+
+@interface STRCaptureSegmenterTests (InternalMethods)
+-(STRCaptureSegmenter *)segmenter;
+-(NSString *)mediaFileWithBytes:(NSUInteger)bytes;
+-(STRTrackSample)sampleAtTime:(double)timestamp;
+-(id)JSONObjectAtPath:(NSString *)path;
+-(NSArray *)pointsOfSegment:(NSDictionary *)segment;
+@end
+
+@implementation STRCaptureSegmenterTests
+
+- (void)setUp
+{
+    [super setUp];
+    _rootPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureSegmenterTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_rootPath error:nil];
+    _token = [STRCaptureToken generateToken];
+    _capturePath = [_rootPath stringByAppendingPathComponent:_token];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_rootPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Bookkeeping
+
+- (void)testSegmentsAreRecordedInCaptureInfo
+{
+    STRCaptureSegmenter * segmenter = [self segmenter];
+    for (NSUInteger i = 0; i < 30; i++) [segmenter addSample:[self sampleAtTime:i]];
+    NSString * firstMedia = [self mediaFileWithBytes:1000];
+    for (NSUInteger i = 0; i < 3; i++) {
+        NSString * media = (i == 0) ? firstMedia : [self mediaFileWithBytes:1000 + i];
+        STAssertNotNil([segmenter closeSegmentWithMediaAtPath:media startTime:i * 10 duration:10], @"Segment %u should close", (unsigned)i);
+    }
+    STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:firstMedia], @"The media should be moved, not copied");
+
+    NSDictionary * info = [self JSONObjectAtPath:[_capturePath stringByAppendingPathComponent:@"capture-info.json"]];
+    NSArray * segments = [info objectForKey:@"segments"];
+    STAssertEqualObjects(segments, segmenter.segments, @"The capture info should list the closed segments");
+    STAssertEquals(segments.count, (NSUInteger)3, @"Three segments were closed");
+    STAssertEqualObjects([info objectForKey:@"segment_duration"], @10, @"The segment length should be recorded");
+    STAssertEqualObjects([info objectForKey:@"segments_complete"], @NO, @"The capture is still being recorded");
+    STAssertEqualObjects([info objectForKey:@"media_file"], [[segments objectAtIndex:0] objectForKey:@"media_file"], @"The first segment stands in for the capture");
+    STAssertEqualObjects([info objectForKey:@"token"], _token, @"The token should be recorded");
+
+    for (NSUInteger i = 0; i < 3; i++) {
+        NSDictionary * segment = [segments objectAtIndex:i];
+        STAssertEqualObjects([segment objectForKey:@"index"], @(i), @"Segments should be numbered in order");
+        STAssertEqualObjects([segment objectForKey:@"start"], @(i * 10.0), @"Segments should follow each other");
+        STAssertEqualObjects([segment objectForKey:@"media_bytes"], @(1000 + i), @"The media size should be recorded");
+        STAssertTrue([[segment objectForKey:@"media_file"] hasPrefix:[_token stringByAppendingString:@"/"]], @"Paths should be relative to the captures directory");
+        NSArray * points = [self pointsOfSegment:segment];
+        STAssertEquals(points.count, (NSUInteger)10, @"Each segment holds its own ten points");
+        STAssertEqualObjects([[points objectAtIndex:0] objectForKey:@"timestamp"], @0, @"Segment timestamps count from the segment start");
+    }
+}
+
+- (void)testFailedSegmentKeepsItsPoints
+{
+    STRCaptureSegmenter * segmenter = [self segmenter];
+    for (NSUInteger i = 0; i < 5; i++) [segmenter addSample:[self sampleAtTime:i]];
+    NSString * missing = [_rootPath stringByAppendingPathComponent:@"missing.mov"];
+    STAssertNil([segmenter closeSegmentWithMediaAtPath:missing startTime:0 duration:10], @"A segment without media cannot close");
+    STAssertEquals(segmenter.segments.count, (NSUInteger)0, @"The failed segment should not be recorded");
+
+    NSDictionary * segment = [segmenter closeSegmentWithMediaAtPath:[self mediaFileWithBytes:10] startTime:0 duration:10];
+    STAssertEqualObjects([segment objectForKey:@"index"], @0, @"The next segment takes the place of the failed one");
+    STAssertEquals([self pointsOfSegment:segment].count, (NSUInteger)5, @"The points of the failed segment should not be lost");
+}
+
+- (void)testEditsToCaptureInfoAreKept
+{
+    STRCaptureSegmenter * segmenter = [self segmenter];
+    segmenter.initialInfo = @{ @"title" : @"Morning Ride", @"orientation" : @"horizontal" };
+    [segmenter closeSegmentWithMediaAtPath:[self mediaFileWithBytes:10] startTime:0 duration:10];
+
+    // A title saved by a STRCapture while the recording goes on
+    NSString * infoPath = [_capturePath stringByAppendingPathComponent:@"capture-info.json"];
+    NSMutableDictionary * info = [[self JSONObjectAtPath:infoPath] mutableCopy];
+    STAssertEqualObjects([info objectForKey:@"title"], @"Morning Ride", @"The initial info should be written");
+    [info setObject:@"Evening Ride" forKey:@"title"];
+    [[NSJSONSerialization dataWithJSONObject:info options:0 error:nil] writeToFile:infoPath atomically:YES];
+
+    [segmenter closeSegmentWithMediaAtPath:[self mediaFileWithBytes:10] startTime:10 duration:10];
+    info = [self JSONObjectAtPath:infoPath];
+    STAssertEqualObjects([info objectForKey:@"title"], @"Evening Ride", @"The edited title should survive the next segment");
+    STAssertEqualObjects([info objectForKey:@"orientation"], @"horizontal", @"The initial info should survive the next segment");
+    STAssertEquals([[info objectForKey:@"segments"] count], (NSUInteger)2, @"The new segment should be recorded");
+}
+
+#pragma mark - Splitting Geodata
+
+- (void)testPointsAfterTheEndWaitForTheNextSegment
+{
+    STRCaptureSegmenter * segmenter = [self segmenter];
+    // The location manager runs ahead of the movie file output
+    for (NSUInteger i = 0; i < 13; i++) [segmenter addSample:[self sampleAtTime:i]];
+    NSDictionary * first = [segmenter closeSegmentWithMediaAtPath:[self mediaFileWithBytes:10] startTime:0 duration:10];
+    STAssertEquals([self pointsOfSegment:first].count, (NSUInteger)10, @"Points at or after the end belong to the next segment");
+
+    for (NSUInteger i = 13; i < 20; i++) [segmenter addSample:[self sampleAtTime:i]];
+    // The next file starts a little late, and the segment before it ran a little long
+    NSDictionary * second = [segmenter closeSegmentWithMediaAtPath:[self mediaFileWithBytes:10] startTime:10.25 duration:9.75];
+    NSArray * points = [self pointsOfSegment:second];
+    STAssertEqualObjects([second objectForKey:@"start"], @10.25, @"The segment starts when its file did");
+    STAssertEquals(points.count, (NSUInteger)10, @"Nine points, and the point before the start repeated");
+    NSDictionary * carried = [points objectAtIndex:0];
+    STAssertEqualObjects([carried objectForKey:@"timestamp"], @0, @"The repeated point stands at the start");
+    STAssertEqualsWithAccuracy([[[carried objectForKey:@"coords"] objectAtIndex:0] doubleValue], [self sampleAtTime:10].latitude, 1e-9, @"The point at 10 s is the last one before the start");
+    STAssertEqualsWithAccuracy([[[points objectAtIndex:1] objectForKey:@"timestamp"] doubleValue], 0.75, 1e-9, @"Timestamps count from the segment start");
+}
+
+- (void)testSplittingCompleteTracks
+{
+    STRTrackSample samples[] = { [self sampleAtTime:0], [self sampleAtTime:5], [self sampleAtTime:12] };
+    NSArray * first = [STRCaptureSegmenter pointsOfSamples:samples count:3 fromTime:0 toTime:10];
+    STAssertEqualObjects([first valueForKey:@"timestamp"], (@[ @0, @5 ]), @"The first segment holds the points before 10 s");
+
+    NSArray * second = [STRCaptureSegmenter pointsOfSamples:samples count:3 fromTime:10 toTime:20];
+    STAssertEqualObjects([second valueForKey:@"timestamp"], (@[ @0, @2 ]), @"The point at 5 s is repeated at the start of the second");
+    STAssertEqualsWithAccuracy([[[[second objectAtIndex:0] objectForKey:@"coords"] objectAtIndex:0] doubleValue], samples[1].latitude, 1e-9, @"The repeated point is the one at 5 s");
+
+    NSArray * exact = [STRCaptureSegmenter pointsOfSamples:samples count:3 fromTime:5 toTime:10];
+    STAssertEquals(exact.count, (NSUInteger)1, @"A point at the very start is not repeated");
+
+    NSArray * empty = [STRCaptureSegmenter pointsOfSamples:samples count:3 fromTime:20 toTime:30];
+    STAssertEquals(empty.count, (NSUInteger)1, @"A segment without points still gets the last known one");
+    STAssertEquals([STRCaptureSegmenter pointsOfSamples:samples count:0 fromTime:0 toTime:10].count, (NSUInteger)0, @"An empty track gives no points");
+}
+
+#pragma mark - Finishing
+
+- (void)testFinishWritesTheWholeTrack
+{
+    STRCaptureSegmenter * segmenter = [self segmenter];
+    STAssertFalse([segmenter finish], @"A capture without segments cannot be finished");
+
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < 4; i++) {
+        for (NSUInteger j = 0; j < 20; j++) [segmenter addSample:[self sampleAtTime:count++ * 0.5]];
+        [segmenter closeSegmentWithMediaAtPath:[self mediaFileWithBytes:10] startTime:i * 10 duration:10];
+    }
+    [segmenter addSample:[self sampleAtTime:count++ * 0.5]];
+    STAssertTrue([segmenter finish], @"The capture should be finished");
+    STAssertTrue(segmenter.finished, @"The segmenter should know it is finished");
+
+    NSDictionary * info = [self JSONObjectAtPath:[_capturePath stringByAppendingPathComponent:@"capture-info.json"]];
+    STAssertEqualObjects([info objectForKey:@"segments_complete"], @YES, @"The capture should be marked complete");
+    NSString * relativePath = [_token stringByAppendingPathComponent:_token];
+    STAssertEqualObjects([info objectForKey:@"geodata_file"], [relativePath stringByAppendingPathExtension:@"json"], @"The whole track replaces the first segment's");
+    STAssertEqualObjects([info objectForKey:@"filtered_geodata_file"], [relativePath stringByAppendingPathExtension:@"filtered.json"], @"The smoothed track should be listed");
+
+    NSArray * track = [[self JSONObjectAtPath:[_capturePath stringByAppendingPathComponent:[_token stringByAppendingPathExtension:@"json"]]] objectForKey:@"points"];
+    NSArray * filtered = [[self JSONObjectAtPath:[_capturePath stringByAppendingPathComponent:[_token stringByAppendingPathExtension:@"filtered.json"]]] objectForKey:@"points"];
+    STAssertEquals(track.count, count, @"Every point should be in the whole track, even after the last segment");
+    STAssertEquals(filtered.count, count, @"Every point should be smoothed");
+
+    // The segments put back together give the track, up to the end of the last one
+    NSMutableArray * joined = [NSMutableArray array];
+    for (NSDictionary * segment in segmenter.segments) {
+        double start = [[segment objectForKey:@"start"] doubleValue];
+        for (NSDictionary * point in [self pointsOfSegment:segment]) {
+            double timestamp = [[point objectForKey:@"timestamp"] doubleValue] + start;
+            if (joined.count > 0 && timestamp <= [[joined lastObject] doubleValue]) continue;
+            [joined addObject:@(timestamp)];
+        }
+    }
+    NSArray * trackTimes = [[track valueForKey:@"timestamp"] subarrayWithRange:NSMakeRange(0, count - 1)];
+    STAssertEquals(joined.count, trackTimes.count, @"The segments should hold every point of the track once");
+    for (NSUInteger i = 0; i < MIN(joined.count, trackTimes.count); i++) {
+        STAssertEqualsWithAccuracy([[joined objectAtIndex:i] doubleValue], [[trackTimes objectAtIndex:i] doubleValue], 1e-9, @"Point %u should match", (unsigned)i);
+    }
+    STAssertNil([segmenter closeSegmentWithMediaAtPath:[self mediaFileWithBytes:10] startTime:40 duration:10], @"A finished capture takes no more segments");
+}
+
+@end
+
+@implementation STRCaptureSegmenterTests (InternalMethods)
+
+-(STRCaptureSegmenter *)segmenter {
+    return [[STRCaptureSegmenter alloc] initWithToken:_token directoryPath:_capturePath segmentDuration:10];
+}
+
+-(NSString *)mediaFileWithBytes:(NSUInteger)bytes {
+    // Stands in for a movie file closed by the data collector
+    NSString * recordingPath = [_rootPath stringByAppendingPathComponent:@"recording"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:recordingPath withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString * path = [recordingPath stringByAppendingPathComponent:[[STRCaptureToken generateToken] stringByAppendingPathExtension:@"mov"]];
+    [[NSMutableData dataWithLength:bytes] writeToFile:path atomically:YES];
+    return path;
+}
+
+-(STRTrackSample)sampleAtTime:(double)timestamp {
+    STRTrackSample sample = { 43.6254 + timestamp * 1e-4, -72.5179 + timestamp * 2e-4, 90, 5, timestamp };
+    return sample;
+}
+
+-(id)JSONObjectAtPath:(NSString *)path {
+    NSData * data = [NSData dataWithContentsOfFile:path];
+    return (data) ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+}
+
+-(NSArray *)pointsOfSegment:(NSDictionary *)segment {
+    NSString * path = [_capturePath stringByAppendingPathComponent:[[segment objectForKey:@"geodata_file"] lastPathComponent]];
+    return [[self JSONObjectAtPath:path] objectForKey:@"points"];
+}
+
+@end
@@ -0,0 +1,169 @@
+//
+//  STRCaptureSyncManagerTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureSyncManagerTests.h"
+#import "STRCaptureSyncManager.h"
+#import "STRCaptureUploadManager.h"
+#import "STRCapturePathResolver.h"
+#import "STRTestCaptureFixtures.h"
+#import "STRLoopbackHTTPServer.h"
+
+@interface STRCaptureSyncManagerTests () {
+    NSString * _capturesPath;
+    STRCapturePathResolver * _resolver;
+    STRTestCaptureFixtures * _fixtures;
+    STRCaptureSyncManager * _syncManager;
+    STRLoopbackHTTPServer * _server;
+}
+@end
+
+@interface STRCaptureSyncManagerTests (InternalMethods)
+-(BOOL)syncTokens:(NSArray *)tokens presentTokens:(NSArray **)presentTokens missingTokens:(NSArray **)missingTokens error:(NSError **)error;
+@end
+
+@implementation STRCaptureSyncManagerTests
+
+- (void)setUp
+{
+    [super setUp];
+    _capturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureSyncManagerTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:_capturesPath];
+    _fixtures = [[STRTestCaptureFixtures alloc] initWithPathResolver:_resolver];
+    _syncManager = [[STRCaptureSyncManager alloc] initWithPathResolver:_resolver];
+
+    // The stand-in for the server
+    _server = [[STRLoopbackHTTPServer alloc] init];
+    STAssertTrue([_server start], @"The stand-in server should start");
+    _syncManager.syncURL = _server.URL;
+}
+
+- (void)tearDown
+{
+    [_server stop];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Manifests
+
+- (void)testManifestListsReadableCaptures
+{
+    NSMutableArray * tokens = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [tokens addObject:[_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260 + i * 3600]]];
+    }
+    NSString * noMedia = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352259]];
+    [[NSFileManager defaultManager] removeItemAtPath:[_fixtures pathOfFile:[noMedia stringByAppendingPathExtension:@"jpg"] inCapture:noMedia] error:nil];
+
+    NSArray * unreadableTokens = nil;
+    NSData * manifest = [_syncManager manifestForCapturesWithTokens:[tokens arrayByAddingObjectsFromArray:@[ noMedia, @"not-a-token" ]] unreadableTokens:&unreadableTokens];
+    STAssertEqualObjects(unreadableTokens, (@[ noMedia, @"not-a-token" ]), @"Captures that cannot be read should be left out");
+    STAssertEquals(manifest.length, (NSUInteger)(10 + 3 * 25), @"Each entry should take 25 bytes");
+
+    NSDictionary * digests = [STRCaptureSyncManager digestsInManifest:manifest];
+    STAssertEquals(digests.count, (NSUInteger)3, @"Every readable capture should be listed");
+    for (NSString * token in tokens) {
+        STAssertEqualObjects([digests objectForKey:token], [_syncManager digestOfCaptureWithToken:token], @"The manifest should hold the digest of %@", token);
+    }
+    STAssertNil([STRCaptureSyncManager digestsInManifest:[manifest subdataWithRange:NSMakeRange(0, manifest.length - 1)]], @"A truncated manifest should be rejected");
+}
+
+- (void)testDigestFollowsContent
+{
+    NSString * token = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    NSData * digest = [_syncManager digestOfCaptureWithToken:token];
+    STAssertEquals(digest.length, (NSUInteger)8, @"A digest should be 8 bytes");
+    STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[_fixtures pathOfFile:@".checksums.json" inCapture:token]], @"The checksums should be recorded for the next sync");
+    STAssertEqualObjects([_syncManager digestOfCaptureWithToken:token], digest, @"An unchanged capture should keep its digest");
+
+    // A track filtered after recording is new content for the server
+    NSDictionary * geoData = @{ @"points" : @[ @{ @"timestamp" : @0, @"accuracy" : @5, @"coords" : @[ @39.9601, @-83.0002 ], @"heading" : @91 } ] };
+    [[NSJSONSerialization dataWithJSONObject:geoData options:0 error:nil] writeToFile:[_fixtures pathOfFile:[token stringByAppendingPathExtension:@"json"] inCapture:token] atomically:YES];
+    STAssertFalse([[_syncManager digestOfCaptureWithToken:token] isEqualToData:digest], @"Changing the geodata should change the digest");
+}
+
+#pragma mark - Syncing
+
+- (void)testOnlyMissingCapturesAreReported
+{
+    NSString * held = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    NSString * changed = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352261]];
+    NSString * added = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352262]];
+    NSString * damaged = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352263]];
+    [[NSFileManager defaultManager] removeItemAtPath:[_fixtures pathOfFile:[damaged stringByAppendingPathExtension:@"json"] inCapture:damaged] error:nil];
+
+    // The server holds the first capture as it is, and an older version of the second
+    NSMutableData * staleDigest = [[_syncManager digestOfCaptureWithToken:changed] mutableCopy];
+    ((uint8_t *)staleDigest.mutableBytes)[0] ^= 0xff;
+    NSDictionary * serverDigests = @{ held : [_syncManager digestOfCaptureWithToken:held], changed : staleDigest };
+    _server.responseBodyHandler = ^NSData * (NSData * requestBody) {
+        NSDictionary * digests = [STRCaptureSyncManager digestsInManifest:requestBody];
+        if (!digests) return [@"{\"error\":\"true\",\"message\":\"Bad manifest\"}" dataUsingEncoding:NSUTF8StringEncoding];
+        NSMutableArray * missing = [NSMutableArray array];
+        for (NSString * token in digests) {
+            if (![[serverDigests objectForKey:token] isEqualToData:[digests objectForKey:token]]) [missing addObject:token];
+        }
+        return [NSJSONSerialization dataWithJSONObject:@{ @"error" : @"false", @"missing" : missing } options:0 error:nil];
+    };
+
+    NSArray * presentTokens = nil, * missingTokens = nil;
+    NSError * error = nil;
+    STAssertTrue([self syncTokens:@[ held, changed, added, damaged ] presentTokens:&presentTokens missingTokens:&missingTokens error:&error], @"The sync should finish");
+    STAssertNil(error, @"The sync should succeed");
+    STAssertEqualObjects(presentTokens, (@[ held ]), @"Only the capture the server holds unchanged is present");
+    STAssertEqualObjects(missingTokens, (@[ changed, added, damaged ]), @"Changed, new and unreadable captures should be uploaded");
+    STAssertEquals(_server.requestCount, (NSUInteger)1, @"The whole manifest should be sent in one request");
+}
+
+- (void)testServerErrorsAreReported
+{
+    NSString * token = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    NSArray * presentTokens = nil, * missingTokens = nil;
+    NSError * error = nil;
+
+    // A server that does not support syncing
+    _server.responseStatusCode = 404;
+    STAssertTrue([self syncTokens:@[ token ] presentTokens:&presentTokens missingTokens:&missingTokens error:&error], @"The sync should finish");
+    STAssertEquals(error.code, (NSInteger)STRCaptureUploadErrorHTTPStatus, @"The status should be reported");
+    STAssertEqualObjects([error.userInfo objectForKey:STRCaptureUploadHTTPStatusCodeKey], @404, @"The status code should be kept");
+    STAssertNil(missingTokens, @"Nothing should be reported as missing when the server could not be asked");
+
+    _server.responseStatusCode = 200;
+    _server.responseBody = [@"{\"error\":\"false\",\"token\":\"\"}" dataUsingEncoding:NSUTF8StringEncoding];
+    STAssertTrue([self syncTokens:@[ token ] presentTokens:&presentTokens missingTokens:&missingTokens error:&error], @"The sync should finish");
+    STAssertEquals(error.code, (NSInteger)STRCaptureUploadErrorUnreadableResponse, @"An answer without a list of missing captures cannot be used");
+    STAssertNil(presentTokens, @"No capture should be taken as present");
+}
+
+@end
+
+@implementation STRCaptureSyncManagerTests (InternalMethods)
+
+-(BOOL)syncTokens:(NSArray *)tokens presentTokens:(NSArray **)presentTokens missingTokens:(NSArray **)missingTokens error:(NSError **)error {
+    __block BOOL finished = NO;
+    __block NSArray * present = nil, * missing = nil;
+    __block NSError * syncError = nil;
+    [_syncManager syncCapturesWithTokens:tokens completionHandler:^(NSArray * foundPresentTokens, NSArray * foundMissingTokens, NSError * foundError) {
+        present = foundPresentTokens;
+        missing = foundMissingTokens;
+        syncError = foundError;
+        finished = YES;
+    }];
+    NSDate * timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+    while (!finished && [timeout timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    *presentTokens = present;
+    *missingTokens = missing;
+    *error = syncError;
+    return finished;
+}
+
+@end
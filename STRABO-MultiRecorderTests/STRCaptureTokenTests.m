@@ -0,0 +1,46 @@
+//
+//  STRCaptureTokenTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureTokenTests.h"
+#import "STRCaptureToken.h"
+
+@implementation STRCaptureTokenTests
+
+#pragma mark - Behavior
+
+- (void)testTokensSortInCreationOrder
+{
+    NSMutableArray * tokens = [NSMutableArray array];
+    for (int i = 0; i < 1000; i++) {
+        [tokens addObject:[STRCaptureToken generateToken]];
+    }
+    STAssertEqualObjects([tokens sortedArrayUsingSelector:@selector(compare:)], tokens, @"Tokens generated in a row should already be sorted");
+    STAssertEquals([[NSSet setWithArray:tokens] count], tokens.count, @"Tokens should be unique");
+
+    NSString * older = [STRCaptureToken generateTokenWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260]];
+    STAssertEquals([older compare:[tokens objectAtIndex:0]], NSOrderedAscending, @"An older capture should sort first");
+}
+
+- (void)testCreationDateIsReadFromToken
+{
+    NSDate * date = [NSDate dateWithTimeIntervalSince1970:1350662400.250];
+    NSString * token = [STRCaptureToken generateTokenWithDate:date];
+    STAssertEquals(token.length, (NSUInteger)32, @"Tokens should have a fixed width");
+    STAssertEqualsWithAccuracy([[STRCaptureToken creationDateForToken:token] timeIntervalSince1970], date.timeIntervalSince1970, 0.001, @"The token should carry its creation date");
+}
+
+- (void)testLegacyTokensRemainValid
+{
+    NSString * legacyToken = @"338d2c23d2308bfced6117b3e9d63180d5594c8a9f5b8bd5a050914c239f358d";
+    STAssertTrue([STRCaptureToken isValidToken:legacyToken], @"Legacy hash tokens should be accepted");
+    STAssertFalse([STRCaptureToken isTimeOrderedToken:legacyToken], @"Legacy hash tokens carry no date");
+    STAssertNil([STRCaptureToken creationDateForToken:legacyToken], @"Legacy hash tokens carry no date");
+    STAssertFalse([STRCaptureToken isValidToken:@".DS_Store"], @"Other directory entries are not tokens");
+}
+
+@end
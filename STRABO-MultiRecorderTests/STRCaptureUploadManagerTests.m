@@ -0,0 +1,247 @@
+//
+//  STRCaptureUploadManagerTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRCaptureUploadManagerTests.h"
+#import "STRCaptureUploadManager.h"
+#import "STRCapturePathResolver.h"
+#import "STRTestCaptureFixtures.h"
+
+// The number of times the manager sends a capture before it gives up on it
+#define kBatchMaximumAttempts 3
+
+// The steps of a batch upload that the scripted manager replaces
+@interface STRCaptureUploadManager (TestAccess)
+-(BOOL)captureIsIntact:(STRCapture *)capture;
+-(unsigned long long)estimatedUploadSizeOfCapture:(STRCapture *)capture;
+-(BOOL)generateBatchUploadRequestForCaptures:(NSArray *)captures;
+-(void)startCurrentUpload;
+-(void)handleBatchResponse:(NSData *)responseJSONdata;
+@end
+
+/**
+ Answers each batch request with a response from its handler instead of sending it, so
+ that the tests control exactly what the server says about each capture.
+ */
+@interface STRScriptedBatchUploadManager : STRCaptureUploadManager {
+    NSArray * requestTokens;
+}
+// Returns the response body for the tokens of a request, and sets its HTTP status
+@property(copy)NSData * (^responseHandler)(NSArray * tokens, NSUInteger requestNumber, NSInteger * statusCode);
+// The tokens of each request, in the order they were sent
+@property(readonly)NSMutableArray * sentRequests;
+@end
+
+@implementation STRScriptedBatchUploadManager
+
+@synthesize responseHandler = _responseHandler;
+@synthesize sentRequests = _sentRequests;
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _sentRequests = [NSMutableArray array];
+    }
+    return self;
+}
+
+-(BOOL)captureIsIntact:(STRCapture *)capture {
+    return YES;
+}
+
+-(unsigned long long)estimatedUploadSizeOfCapture:(STRCapture *)capture {
+    return 1024;
+}
+
+-(BOOL)generateBatchUploadRequestForCaptures:(NSArray *)captures {
+    requestTokens = [captures valueForKey:@"token"];
+    return YES;
+}
+
+-(void)startCurrentUpload {
+    [_sentRequests addObject:requestTokens];
+    NSInteger statusCode = 200;
+    NSData * response = _responseHandler(requestTokens, _sentRequests.count, &statusCode);
+    [self setValue:@(statusCode) forKey:@"responseStatusCode"];
+    [self handleBatchResponse:response];
+}
+
+@end
+
+@interface STRCaptureUploadManagerTests () <STRCaptureUploadManagerDelegate> {
+    NSString * _capturesPath;
+    STRCapturePathResolver * _resolver;
+    STRTestCaptureFixtures * _fixtures;
+    STRScriptedBatchUploadManager * _uploadManager;
+    NSArray * _tokens;
+    NSArray * _captures;
+
+    // What the delegate was told
+    NSMutableArray * _uploadedTokens;
+    NSMutableDictionary * _failureErrors;
+    NSArray * _finishedUploadedTokens;
+    NSArray * _finishedFailedTokens;
+}
+@end
+
+@interface STRCaptureUploadManagerTests (InternalMethods)
++(NSData *)responseWithResults:(NSArray *)results;
++(NSDictionary *)resultForToken:(NSString *)token failed:(BOOL)failed;
+@end
+
+@implementation STRCaptureUploadManagerTests
+
+- (void)setUp
+{
+    [super setUp];
+    _capturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRCaptureUploadManagerTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:_capturesPath];
+    _fixtures = [[STRTestCaptureFixtures alloc] initWithPathResolver:_resolver];
+
+    NSMutableArray * tokens = [NSMutableArray array];
+    NSMutableArray * captures = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 4; i++) {
+        NSString * token = [_fixtures writeCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260 + i * 60]];
+        [tokens addObject:token];
+        [captures addObject:[STRCapture captureFromFilesAtDirectory:token pathResolver:_resolver]];
+    }
+    _tokens = tokens;
+    _captures = captures;
+
+    _uploadManager = [[STRScriptedBatchUploadManager alloc] init];
+    // Every capture fits in one request
+    _uploadManager.maximumBatchBytes = 1024 * 1024;
+    _uploadManager.delegate = self;
+    _uploadedTokens = [NSMutableArray array];
+    _failureErrors = [NSMutableDictionary dictionary];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Batch Responses
+
+- (void)testMixedResultsRetryOnlyTheFailedCaptures
+{
+    NSString * rejected = [_tokens objectAtIndex:1];
+    _uploadManager.responseHandler = ^NSData *(NSArray * tokens, NSUInteger requestNumber, NSInteger * statusCode) {
+        NSMutableArray * results = [NSMutableArray array];
+        for (NSString * token in tokens) {
+            [results addObject:[STRCaptureUploadManagerTests resultForToken:token failed:(requestNumber == 1 && [token isEqualToString:rejected])]];
+        }
+        return [STRCaptureUploadManagerTests responseWithResults:results];
+    };
+    [_uploadManager beginBatchUploadForCaptures:_captures];
+
+    STAssertEquals(_uploadManager.sentRequests.count, (NSUInteger)2, @"The rejected capture should be sent once more");
+    STAssertEqualObjects([_uploadManager.sentRequests objectAtIndex:1], @[ rejected ], @"Only the rejected capture should be sent again");
+    STAssertEqualObjects([NSSet setWithArray:_finishedUploadedTokens], [NSSet setWithArray:_tokens], @"Every capture should be uploaded in the end");
+    STAssertEquals(_finishedFailedTokens.count, (NSUInteger)0, @"No capture should be given up on");
+    STAssertEquals(_uploadedTokens.count, (NSUInteger)4, @"The delegate should hear about each capture once");
+    STAssertTrue([[[_fixtures captureInfoOfCapture:rejected] objectForKey:@"uploaded_at"] doubleValue] > 0, @"The capture should be marked as uploaded");
+}
+
+- (void)testCaptureMissingFromTheResponseIsRetried
+{
+    NSString * forgotten = [_tokens objectAtIndex:2];
+    _uploadManager.responseHandler = ^NSData *(NSArray * tokens, NSUInteger requestNumber, NSInteger * statusCode) {
+        NSMutableArray * results = [NSMutableArray array];
+        for (NSString * token in tokens) {
+            if (requestNumber == 1 && [token isEqualToString:forgotten]) continue;
+            [results addObject:[STRCaptureUploadManagerTests resultForToken:token failed:NO]];
+        }
+        return [STRCaptureUploadManagerTests responseWithResults:results];
+    };
+    [_uploadManager beginBatchUploadForCaptures:_captures];
+
+    STAssertEquals(_uploadManager.sentRequests.count, (NSUInteger)2, @"The capture without a result should be sent again");
+    STAssertEqualObjects([_uploadManager.sentRequests objectAtIndex:1], @[ forgotten ], @"Only the capture without a result should be sent again");
+    STAssertEquals(_finishedUploadedTokens.count, (NSUInteger)4, @"Every capture should be uploaded in the end");
+    STAssertTrue([[[_fixtures captureInfoOfCapture:forgotten] objectForKey:@"uploaded_at"] doubleValue] > 0, @"The capture should be marked as uploaded once the server reports it");
+}
+
+- (void)testWholeRequestFailureRetriesEveryCapture
+{
+    _uploadManager.responseHandler = ^NSData *(NSArray * tokens, NSUInteger requestNumber, NSInteger * statusCode) {
+        if (requestNumber == 1) {
+            *statusCode = 503;
+            return [NSData data];
+        }
+        if (requestNumber == 2) {
+            return [@"<html>Bad gateway</html>" dataUsingEncoding:NSUTF8StringEncoding];
+        }
+        NSMutableArray * results = [NSMutableArray array];
+        for (NSString * token in tokens) {
+            [results addObject:[STRCaptureUploadManagerTests resultForToken:token failed:NO]];
+        }
+        return [STRCaptureUploadManagerTests responseWithResults:results];
+    };
+    [_uploadManager beginBatchUploadForCaptures:_captures];
+
+    STAssertEquals(_uploadManager.sentRequests.count, (NSUInteger)3, @"An HTTP error and an unreadable response should each cost one more request");
+    for (NSArray * request in _uploadManager.sentRequests) {
+        STAssertEqualObjects([NSSet setWithArray:request], [NSSet setWithArray:_tokens], @"Every capture of a failed request should be sent again");
+    }
+    STAssertEquals(_finishedUploadedTokens.count, (NSUInteger)4, @"Every capture should be uploaded on the third attempt");
+    STAssertEquals(_finishedFailedTokens.count, (NSUInteger)0, @"No capture should be given up on");
+}
+
+- (void)testCapturesAreGivenUpOnAfterTheLastAttempt
+{
+    NSString * hopeless = [_tokens objectAtIndex:3];
+    _uploadManager.responseHandler = ^NSData *(NSArray * tokens, NSUInteger requestNumber, NSInteger * statusCode) {
+        NSMutableArray * results = [NSMutableArray array];
+        for (NSString * token in tokens) {
+            [results addObject:[STRCaptureUploadManagerTests resultForToken:token failed:[token isEqualToString:hopeless]]];
+        }
+        return [STRCaptureUploadManagerTests responseWithResults:results];
+    };
+    [_uploadManager beginBatchUploadForCaptures:_captures];
+
+    STAssertEquals(_uploadManager.sentRequests.count, (NSUInteger)kBatchMaximumAttempts, @"The capture should be sent %d times in all", kBatchMaximumAttempts);
+    STAssertEqualObjects(_finishedFailedTokens, @[ hopeless ], @"The capture should be given up on");
+    STAssertEquals(_finishedUploadedTokens.count, (NSUInteger)3, @"The other captures should be uploaded");
+    NSError * error = [_failureErrors objectForKey:hopeless];
+    STAssertEquals(error.code, (NSInteger)STRCaptureUploadErrorServerRejected, @"The delegate should get the server's rejection");
+    STAssertEqualObjects(error.localizedDescription, @"Rejected by the test server", @"The server's message should be passed on");
+    STAssertEquals([[[_fixtures captureInfoOfCapture:hopeless] objectForKey:@"uploaded_at"] doubleValue], 0.0, @"The capture should not be marked as uploaded");
+}
+
+#pragma mark - STRCaptureUploadManagerDelegate
+
+-(void)fileUploadedSuccessfullyWithToken:(NSString *)token {
+    [_uploadedTokens addObject:token];
+}
+
+-(void)batchUploadOfCaptureWithToken:(NSString *)token didFailWithError:(NSError *)error {
+    if (error) [_failureErrors setObject:error forKey:token];
+}
+
+-(void)batchUploadDidFinishWithUploadedTokens:(NSArray *)uploadedTokens failedTokens:(NSArray *)failedTokens {
+    _finishedUploadedTokens = uploadedTokens;
+    _finishedFailedTokens = failedTokens;
+}
+
+@end
+
+@implementation STRCaptureUploadManagerTests (InternalMethods)
+
++(NSData *)responseWithResults:(NSArray *)results {
+    return [NSJSONSerialization dataWithJSONObject:@{ @"error" : @"false", @"message" : @"", @"results" : results } options:0 error:nil];
+}
+
++(NSDictionary *)resultForToken:(NSString *)token failed:(BOOL)failed {
+    return @{ @"token" : token, @"error" : (failed) ? @"true" : @"false", @"message" : (failed) ? @"Rejected by the test server" : @"" };
+}
+
+@end
@@ -0,0 +1,55 @@
+//
+//  STRLoggerTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRLoggerTests.h"
+#import "STRLogger.h"
+
+static NSUInteger argumentEvaluations = 0;
+
+static NSString * CountedArgument(void) {
+    argumentEvaluations++;
+    return @"argument";
+}
+
+@implementation STRLoggerTests
+
+- (void)setUp
+{
+    [super setUp];
+    [STRLogger setConsoleOutputEnabled:NO];
+}
+
+- (void)tearDown
+{
+    [STRLogger flush];
+    [STRLogger setLevel:STRLogLevelWarning];
+    [STRLogger setConsoleOutputEnabled:YES];
+    [super tearDown];
+}
+
+#pragma mark - Behavior
+
+- (void)testDisabledLevelSkipsArguments
+{
+    [STRLogger setLevel:STRLogLevelInfo forCategory:STRLogCategoryStorage];
+    argumentEvaluations = 0;
+    STRLogDebug(STRLogCategoryStorage, @"Not logged: %@", CountedArgument());
+    STAssertEquals(argumentEvaluations, (NSUInteger)0, @"Arguments of a disabled message were evaluated");
+    STRLogInfo(STRLogCategoryStorage, @"Logged: %@", CountedArgument());
+    STAssertEquals(argumentEvaluations, (NSUInteger)1, @"Arguments of an enabled message were not evaluated once");
+}
+
+- (void)testLevelsArePerCategory
+{
+    [STRLogger setLevel:STRLogLevelOff];
+    [STRLogger setLevel:STRLogLevelTrace forCategory:STRLogCategoryUpload];
+    STAssertTrue(STRLogIsEnabled(STRLogCategoryUpload, STRLogLevelTrace), @"Upload trace messages should be enabled");
+    STAssertFalse(STRLogIsEnabled(STRLogCategoryPlayback, STRLogLevelError), @"Playback messages should be disabled");
+}
+
+@end
@@ -0,0 +1,229 @@
+//
+//  STRSegmentUploadQueueTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRSegmentUploadQueueTests.h"
+#import "STRSegmentUploadQueue.h"
+#import "STRCaptureSegmenter.h"
+#import "STRCaptureToken.h"
+
+@interface STRSegmentUploadQueueTests () <STRSegmentUploadQueueDelegate, STRCaptureSegmenterDelegate> {
+    NSString * _rootPath;
+    // What the fake sender was asked to send, and the handlers it has not called yet
+    NSMutableArray * _sent;
+    NSMutableArray * _handlers;
+    STRSegmentUploadQueue * _queue;
+    NSMutableArray * _uploaded;
+    NSMutableArray * _completed;
+    NSMutableArray * _abandoned;
+}
+@end
+
+@interface STRSegmentUploadQueueTests (InternalMethods)
+-(NSDictionary *)segmentWithIndex:(NSUInteger)index;
+-(void)spinRunLoop;
+-(void)finishNextRequestWithSuccess:(BOOL)uploaded error:(NSError *)error;
+@end
+
+@implementation STRSegmentUploadQueueTests
+
+- (void)setUp
+{
+    [super setUp];
+    _rootPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRSegmentUploadQueueTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_rootPath error:nil];
+    _sent = [NSMutableArray array];
+    _handlers = [NSMutableArray array];
+    _uploaded = [NSMutableArray array];
+    _completed = [NSMutableArray array];
+    _abandoned = [NSMutableArray array];
+
+    // Each request is recorded as the capture's token and the segment index, or "done"
+    NSMutableArray * sent = _sent;
+    NSMutableArray * handlers = _handlers;
+    _queue = [[STRSegmentUploadQueue alloc] initWithSender:^(NSDictionary * segment, NSString * capturePath, STRSegmentUploadCompletionHandler completionHandler) {
+        NSString * part = (segment) ? [[segment objectForKey:@"index"] stringValue] : @"done";
+        [sent addObject:[NSString stringWithFormat:@"%@:%@", [capturePath lastPathComponent], part]];
+        [handlers addObject:[completionHandler copy]];
+    }];
+    _queue.delegate = self;
+    _queue.baseRetryDelay = 0.01;
+    _queue.maximumRetryDelay = 0.01;
+    _queue.maximumAttempts = 3;
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_rootPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Ordering
+
+- (void)testSegmentsAreSentInOrderOneAtATime
+{
+    NSString * capturePath = [_rootPath stringByAppendingPathComponent:@"capture"];
+    [_queue enqueueSegment:[self segmentWithIndex:0] ofCaptureAtPath:capturePath];
+    [self spinRunLoop];
+    STAssertEqualObjects(_sent, (@[ @"capture:0" ]), @"A segment should be sent as soon as it is queued");
+
+    // Segments closed while the first one is being sent wait their turn
+    [_queue enqueueSegment:[self segmentWithIndex:1] ofCaptureAtPath:capturePath];
+    [_queue enqueueSegment:[self segmentWithIndex:2] ofCaptureAtPath:capturePath];
+    [_queue enqueueCompletionOfCaptureAtPath:capturePath];
+    [self spinRunLoop];
+    STAssertEquals(_sent.count, (NSUInteger)1, @"Only one request should be in flight");
+    STAssertEquals(_queue.pendingRequestCount, (NSUInteger)4, @"Every request should be waiting");
+
+    for (NSUInteger i = 0; i < 4; i++) [self finishNextRequestWithSuccess:YES error:nil];
+    STAssertEqualObjects(_sent, (@[ @"capture:0", @"capture:1", @"capture:2", @"capture:done" ]), @"The capture should be completed after its segments, in order");
+    STAssertEqualObjects([_uploaded valueForKey:@"index"], (@[ @0, @1, @2 ]), @"Each segment should be reported");
+    STAssertEqualObjects(_completed, (@[ capturePath ]), @"The completed capture should be reported");
+    STAssertEquals(_queue.pendingRequestCount, (NSUInteger)0, @"Nothing should be left");
+}
+
+- (void)testSegmentsAreSentWhileRecordingContinues
+{
+    // Synthetic segment files go through a segmenter straight into the queue
+    NSString * token = [STRCaptureToken generateToken];
+    STRCaptureSegmenter * segmenter = [[STRCaptureSegmenter alloc] initWithToken:token directoryPath:[_rootPath stringByAppendingPathComponent:token] segmentDuration:10];
+    segmenter.delegate = self;
+    NSString * recordingPath = [_rootPath stringByAppendingPathComponent:@"recording"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:recordingPath withIntermediateDirectories:YES attributes:nil error:nil];
+
+    for (NSUInteger i = 0; i < 3; i++) {
+        for (NSUInteger j = 0; j < 10; j++) {
+            STRTrackSample sample = { 43.6 + j * 1e-4, -72.5, 0, 5, i * 10 + j };
+            [segmenter addSample:sample];
+        }
+        NSString * mediaPath = [recordingPath stringByAppendingPathComponent:[NSString stringWithFormat:@"segment%u.mov", (unsigned)i]];
+        [[NSMutableData dataWithLength:1024] writeToFile:mediaPath atomically:YES];
+        [segmenter closeSegmentWithMediaAtPath:mediaPath startTime:i * 10 duration:10];
+        [self spinRunLoop];
+        STAssertEquals(_sent.count, i + 1, @"Segment %u should be sent before the next one is recorded", (unsigned)i);
+        // The files the sender gets are already in the capture directory
+        NSDictionary * segment = [segmenter.segments objectAtIndex:i];
+        NSString * geoDataPath = [segmenter.directoryPath stringByAppendingPathComponent:[[segment objectForKey:@"geodata_file"] lastPathComponent]];
+        STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:geoDataPath], @"The geodata of the segment should be written");
+        [self finishNextRequestWithSuccess:YES error:nil];
+    }
+
+    STAssertTrue([segmenter finish], @"The capture should be finished");
+    [_queue enqueueCompletionOfCaptureAtPath:segmenter.directoryPath];
+    [self finishNextRequestWithSuccess:YES error:nil];
+    STAssertEqualObjects([_sent lastObject], ([NSString stringWithFormat:@"%@:done", token]), @"Only the completion is left when the recording stops");
+    STAssertEquals(_uploaded.count, (NSUInteger)3, @"Every segment should be uploaded");
+}
+
+#pragma mark - Failures
+
+- (void)testFailedSegmentIsRetriedBeforeLaterOnes
+{
+    NSString * capturePath = [_rootPath stringByAppendingPathComponent:@"capture"];
+    [_queue enqueueSegment:[self segmentWithIndex:0] ofCaptureAtPath:capturePath];
+    [_queue enqueueSegment:[self segmentWithIndex:1] ofCaptureAtPath:capturePath];
+    NSError * timedOut = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil];
+    [self finishNextRequestWithSuccess:NO error:timedOut];
+    [self finishNextRequestWithSuccess:YES error:nil];
+    [self finishNextRequestWithSuccess:YES error:nil];
+    STAssertEqualObjects(_sent, (@[ @"capture:0", @"capture:0", @"capture:1" ]), @"The failed segment should be sent again before the next one");
+    STAssertEquals(_abandoned.count, (NSUInteger)0, @"A retried segment does not give up the capture");
+}
+
+- (void)testNewSegmentsWaitForTheRetryDelay
+{
+    _queue.baseRetryDelay = 0.5;
+    _queue.maximumRetryDelay = 0.5;
+    NSString * capturePath = [_rootPath stringByAppendingPathComponent:@"capture"];
+    [_queue enqueueSegment:[self segmentWithIndex:0] ofCaptureAtPath:capturePath];
+    NSError * timedOut = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil];
+    [self finishNextRequestWithSuccess:NO error:timedOut];
+
+    // A segment closes while the failed one waits for its retry
+    [_queue enqueueSegment:[self segmentWithIndex:1] ofCaptureAtPath:capturePath];
+    [self spinRunLoop];
+    STAssertEqualObjects(_sent, (@[ @"capture:0" ]), @"Nothing should be sent before the retry delay has passed");
+
+    // The delay is between half and all of the base delay
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.6]];
+    STAssertEqualObjects(_sent, (@[ @"capture:0", @"capture:0" ]), @"The failed segment should be retried once the delay has passed");
+    [self finishNextRequestWithSuccess:YES error:nil];
+    [self finishNextRequestWithSuccess:YES error:nil];
+    STAssertEqualObjects([_sent lastObject], @"capture:1", @"The new segment should follow the retried one");
+}
+
+- (void)testGivingUpDropsOnlyThatCapture
+{
+    NSString * failingPath = [_rootPath stringByAppendingPathComponent:@"failing"];
+    NSString * otherPath = [_rootPath stringByAppendingPathComponent:@"other"];
+    [_queue enqueueSegment:[self segmentWithIndex:0] ofCaptureAtPath:failingPath];
+    [_queue enqueueSegment:[self segmentWithIndex:1] ofCaptureAtPath:failingPath];
+    [_queue enqueueSegment:[self segmentWithIndex:0] ofCaptureAtPath:otherPath];
+
+    NSError * unavailable = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNotConnectedToInternet userInfo:nil];
+    for (NSUInteger i = 0; i < 3; i++) [self finishNextRequestWithSuccess:NO error:unavailable];
+    STAssertEqualObjects(_abandoned, (@[ failingPath ]), @"The capture should be given up on after three attempts");
+
+    [_queue enqueueSegment:[self segmentWithIndex:2] ofCaptureAtPath:failingPath];
+    [self finishNextRequestWithSuccess:YES error:nil];
+    STAssertEqualObjects([_sent lastObject], @"other:0", @"The other capture should still be sent");
+    STAssertFalse([_sent containsObject:@"failing:1"], @"The rest of the given up capture should be dropped");
+    STAssertFalse([_sent containsObject:@"failing:2"], @"Later segments of the given up capture should be ignored");
+}
+
+- (void)testUnreadableSegmentIsNotRetried
+{
+    NSString * capturePath = [_rootPath stringByAppendingPathComponent:@"capture"];
+    [_queue enqueueSegment:[self segmentWithIndex:0] ofCaptureAtPath:capturePath];
+    [self finishNextRequestWithSuccess:NO error:nil];
+    STAssertEquals(_sent.count, (NSUInteger)1, @"Missing files are not worth another attempt");
+    STAssertEqualObjects(_abandoned, (@[ capturePath ]), @"The capture should be given up on at once");
+}
+
+#pragma mark - STRSegmentUploadQueueDelegate
+
+-(void)segmentUploadQueue:(STRSegmentUploadQueue *)queue didUploadSegment:(NSDictionary *)segment ofCaptureAtPath:(NSString *)capturePath {
+    [_uploaded addObject:segment];
+}
+
+-(void)segmentUploadQueue:(STRSegmentUploadQueue *)queue didCompleteCaptureAtPath:(NSString *)capturePath {
+    [_completed addObject:capturePath];
+}
+
+-(void)segmentUploadQueue:(STRSegmentUploadQueue *)queue didGiveUpOnCaptureAtPath:(NSString *)capturePath error:(NSError *)error {
+    [_abandoned addObject:capturePath];
+}
+
+#pragma mark - STRCaptureSegmenterDelegate
+
+-(void)captureSegmenter:(STRCaptureSegmenter *)segmenter didCloseSegment:(NSDictionary *)segment {
+    [_queue enqueueSegment:segment ofCaptureAtPath:segmenter.directoryPath];
+}
+
+@end
+
+@implementation STRSegmentUploadQueueTests (InternalMethods)
+
+-(NSDictionary *)segmentWithIndex:(NSUInteger)index {
+    return @{ @"index" : @(index), @"start" : @(index * 10.0), @"duration" : @10 };
+}
+
+-(void)spinRunLoop {
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+}
+
+-(void)finishNextRequestWithSuccess:(BOOL)uploaded error:(NSError *)error {
+    [self spinRunLoop];
+    STAssertTrue(_handlers.count > 0, @"A request should be in flight");
+    if (_handlers.count == 0) return;
+    STRSegmentUploadCompletionHandler handler = [_handlers objectAtIndex:0];
+    [_handlers removeObjectAtIndex:0];
+    handler(uploaded, error);
+    [self spinRunLoop];
+}
+
+@end
@@ -0,0 +1,125 @@
+//
+//  STRSettingsTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRSettingsTests.h"
+#import "STRSettings.h"
+
+#import <libkern/OSAtomic.h>
+
+#define kSwapCount 200
+#define kReaderCount 4
+
+@implementation STRSettingsTests
+
+- (void)tearDown
+{
+    [STRSettings removeAllOverrides];
+    [super tearDown];
+}
+
+#pragma mark - Snapshots
+
+- (void)testSharedSettingsAreLoadedOnce
+{
+    STRSettings * settings = [STRSettings sharedSettings];
+    STAssertTrue([STRSettings sharedSettings] == settings, @"Without overrides every call should return the same snapshot");
+    STAssertEquals(settings.uploadBatchMaxBytes, [[settings.settingsDict objectForKey:@"Upload_Batch_Max_Bytes"] unsignedIntegerValue], @"Typed values should match the plist");
+    STAssertEquals(settings.advancedLogging, [[settings.settingsDict objectForKey:@"Advanced_Logging"] boolValue], @"Typed values should match the plist");
+}
+
+- (void)testOverrideSwapsSnapshotAndNotifies
+{
+    STRSettings * before = [STRSettings sharedSettings];
+    NSTimeInterval fileInterval = before.geoDataSamplingInterval;
+    __block NSNotification * received = nil;
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:STRSettingsDidChangeNotification object:nil queue:nil usingBlock:^(NSNotification * notification) {
+        received = notification;
+    }];
+
+    [STRSettings setOverrideValue:@2.5 forKey:@"Geodata_Sampling_Interval"];
+    STRSettings * after = [STRSettings sharedSettings];
+    STAssertTrue(after != before, @"An override should swap in a new snapshot");
+    STAssertEquals(after.geoDataSamplingInterval, 2.5, @"The new snapshot should hold the override");
+    STAssertEquals(before.geoDataSamplingInterval, fileInterval, @"The old snapshot should not change");
+    STAssertTrue(received.object == after, @"The notification should carry the new snapshot");
+    STAssertEqualObjects([received.userInfo objectForKey:STRSettingsChangedKeysKey], [NSSet setWithObject:@"Geodata_Sampling_Interval"], @"Only the overridden key changed");
+
+    // Setting the same value again changes nothing
+    received = nil;
+    [STRSettings setOverrideValue:@2.5 forKey:@"Geodata_Sampling_Interval"];
+    STAssertNil(received, @"An override that changes no value should not notify");
+    STAssertTrue([STRSettings sharedSettings] == after, @"An override that changes no value should keep the snapshot");
+
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+}
+
+- (void)testReplacedSnapshotsAreFreed
+{
+    __weak STRSettings * replaced = nil;
+    @autoreleasepool {
+        [STRSettings setOverrideValue:@3.5 forKey:@"Geodata_Sampling_Interval"];
+        replaced = [STRSettings sharedSettings];
+        STAssertNotNil(replaced, @"The current snapshot should be held");
+        [STRSettings setOverrideValue:@4.5 forKey:@"Geodata_Sampling_Interval"];
+    }
+    STAssertNil(replaced, @"A snapshot that nothing holds should be freed once it is replaced");
+    STAssertEquals([[STRSettings sharedSettings] geoDataSamplingInterval], 4.5, @"The current snapshot should still be held");
+}
+
+- (void)testRemovingOverridesRestoresFileValues
+{
+    NSUInteger fileBatchSize = [[STRSettings sharedSettings] parallelBatchSize];
+    [STRSettings setOverrideValues:@{ @"Parallel_Batch_Size" : @7, @"Parser_Map_Threshold" : @1024 }];
+    STAssertEquals([[STRSettings sharedSettings] parallelBatchSize], (NSUInteger)7, @"The override should apply");
+    STAssertEquals([STRSettings overrideValues].count, (NSUInteger)2, @"Both overrides should be kept");
+
+    [STRSettings setOverrideValue:nil forKey:@"Parser_Map_Threshold"];
+    STAssertEquals([STRSettings overrideValues].count, (NSUInteger)1, @"A nil value should remove its override");
+
+    [STRSettings removeAllOverrides];
+    STAssertEquals([[STRSettings sharedSettings] parallelBatchSize], fileBatchSize, @"The plist value should be back");
+    STAssertEquals([STRSettings overrideValues].count, (NSUInteger)0, @"No override should be left");
+}
+
+- (void)testValuesOfTheWrongTypeReadAsMissing
+{
+    [STRSettings setOverrideValues:@{ @"Parallel_Batch_Size" : @"many", @"Parser_Map_Threshold" : @-5, @"Upload_URL" : @"http://example.com" }];
+    STRSettings * settings = [STRSettings sharedSettings];
+    STAssertEquals(settings.parallelBatchSize, (NSUInteger)0, @"A string should read as missing");
+    STAssertEquals(settings.parserMapThreshold, (NSUInteger)0, @"A negative size should read as missing");
+    STAssertNil(settings.uploadPath, @"An endpoint without a URL dictionary should read as missing");
+}
+
+#pragma mark - Concurrent Access
+
+- (void)testReadersSeeWholeSnapshots
+{
+    // The writer always sets the threshold to twice the batch size
+    [STRSettings setOverrideValues:@{ @"Parallel_Batch_Size" : @1, @"Parser_Map_Threshold" : @2 }];
+    __block volatile int32_t done = 0;
+    __block volatile int32_t torn = 0;
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    for (int reader = 0; reader < kReaderCount; reader++) {
+        dispatch_group_async(group, queue, ^{
+            while (!done) {
+                STRSettings * settings = [STRSettings sharedSettings];
+                if (settings.parserMapThreshold != settings.parallelBatchSize * 2) OSAtomicIncrement32Barrier(&torn);
+            }
+        });
+    }
+    for (NSUInteger i = 1; i <= kSwapCount; i++) {
+        [STRSettings setOverrideValues:@{ @"Parallel_Batch_Size" : @(i), @"Parser_Map_Threshold" : @(i * 2) }];
+    }
+    OSAtomicIncrement32Barrier(&done);
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    STAssertTrue(torn == 0, @"Readers should never see half of an override, but %d did", torn);
+    STAssertEquals([[STRSettings sharedSettings] parallelBatchSize], (NSUInteger)kSwapCount, @"The last override should win");
+}
+
+@end
@@ -0,0 +1,79 @@
+//
+//  STRTestCaptureFixtures.h
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class STRCapturePathResolver;
+
+/**
+ Writes small captures for the unit tests to read.
+
+ Captures are written into the directory of a resolver, usually one on a temporary directory, in the layout that STRCaptureFileOrganizer uses: a capture info file, a geodata file, media and a thumbnail, in the directory the resolver gives the token.
+ */
+@interface STRTestCaptureFixtures : NSObject
+
+/**
+ The resolver whose directory the captures are written to.
+ */
+@property(readonly)STRCapturePathResolver * resolver;
+
+/**
+ @param resolver The resolver whose directory the captures are written to.
+ */
+-(id)initWithPathResolver:(STRCapturePathResolver *)resolver;
+
+/**
+ Writes an image capture with a time-ordered token, one geodata point and media of its own.
+
+ @param date The creation date of the capture.
+
+ @return NSString The token of the capture.
+ */
+-(NSString *)writeCaptureWithDate:(NSDate *)date;
+
+/**
+ Writes an image capture with a time-ordered token.
+
+ @param date The creation date of the capture.
+
+ @param extraInfo Keys that are added to the capture info, or replace its defaults. You may pass nil.
+
+ @param points The geodata points. Pass nil for a single point.
+
+ @param media The bytes of the media file. Pass nil for 1 KB that differs from capture to capture.
+
+ @return NSString The token of the capture.
+ */
+-(NSString *)writeCaptureWithDate:(NSDate *)date info:(NSDictionary *)extraInfo points:(NSArray *)points media:(NSData *)media;
+
+/**
+ Writes an image capture with the given token, such as a legacy one.
+
+ The parameters are those of writeCaptureWithDate:info:points:media:.
+
+ @return NSString The token of the capture.
+ */
+-(NSString *)writeCaptureWithToken:(NSString *)token date:(NSDate *)date info:(NSDictionary *)extraInfo points:(NSArray *)points media:(NSData *)media;
+
+/**
+ The absolute path of a file in a capture directory.
+
+ @param fileName The name of the file, such as `capture-info.json`.
+
+ @param token The token of the capture.
+ */
+-(NSString *)pathOfFile:(NSString *)fileName inCapture:(NSString *)token;
+
+/**
+ The capture info file of a capture as read from disk, or nil if there is none.
+
+ @param token The token of the capture.
+ */
+-(NSDictionary *)captureInfoOfCapture:(NSString *)token;
+
+@end
@@ -0,0 +1,85 @@
+//
+//  STRTestCaptureFixtures.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTestCaptureFixtures.h"
+#import "STRCapturePathResolver.h"
+#import "STRCaptureToken.h"
+
+@implementation STRTestCaptureFixtures
+
+@synthesize resolver = _resolver;
+
+- (id)initWithPathResolver:(STRCapturePathResolver *)resolver
+{
+    self = [super init];
+    if (self) {
+        _resolver = resolver;
+    }
+    return self;
+}
+
+#pragma mark - Writing Captures
+
+-(NSString *)writeCaptureWithDate:(NSDate *)date {
+    return [self writeCaptureWithDate:date info:nil points:nil media:nil];
+}
+
+-(NSString *)writeCaptureWithDate:(NSDate *)date info:(NSDictionary *)extraInfo points:(NSArray *)points media:(NSData *)media {
+    return [self writeCaptureWithToken:[STRCaptureToken generateTokenWithDate:date] date:date info:extraInfo points:points media:media];
+}
+
+-(NSString *)writeCaptureWithToken:(NSString *)token date:(NSDate *)date info:(NSDictionary *)extraInfo points:(NSArray *)points media:(NSData *)media {
+    NSString * directory = [_resolver absolutePathForRelativePath:[_resolver relativeDirectoryForToken:token]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+
+    NSString * relativePath = [token stringByAppendingPathComponent:token];
+    NSMutableDictionary * info = [@{
+    @"created_at" : @([date timeIntervalSince1970]),
+    @"geodata_file" : [relativePath stringByAppendingPathExtension:@"json"],
+    @"coords" : @[ @39.96, @-83.0 ],
+    @"heading" : @90,
+    @"media_file" : [relativePath stringByAppendingPathExtension:@"jpg"],
+    @"orientation" : @"vertical",
+    @"thumbnail_file" : [relativePath stringByAppendingPathExtension:@"png"],
+    @"title" : @"Untitled Capture",
+    @"token" : token,
+    @"media_type" : @"image",
+    @"uploaded_at" : @0
+    } mutableCopy];
+    if (extraInfo) [info addEntriesFromDictionary:extraInfo];
+
+    if (!points) {
+        points = @[ @{ @"timestamp" : @0, @"accuracy" : @15, @"coords" : @[ @39.96, @-83.0 ], @"heading" : @90 } ];
+    }
+    if (!media) {
+        // Each capture gets its own media, so that digests differ
+        NSMutableData * tokenMedia = [NSMutableData dataWithLength:1024];
+        [tokenMedia appendData:[token dataUsingEncoding:NSUTF8StringEncoding]];
+        media = tokenMedia;
+    }
+
+    [[NSJSONSerialization dataWithJSONObject:info options:0 error:nil] writeToFile:[directory stringByAppendingPathComponent:@"capture-info.json"] atomically:YES];
+    [[NSJSONSerialization dataWithJSONObject:@{ @"points" : points } options:0 error:nil] writeToFile:[directory stringByAppendingPathComponent:[token stringByAppendingPathExtension:@"json"]] atomically:YES];
+    [media writeToFile:[directory stringByAppendingPathComponent:[token stringByAppendingPathExtension:@"jpg"]] atomically:YES];
+    [[NSMutableData dataWithLength:64] writeToFile:[directory stringByAppendingPathComponent:[token stringByAppendingPathExtension:@"png"]] atomically:YES];
+    return token;
+}
+
+#pragma mark - Reading Captures
+
+-(NSString *)pathOfFile:(NSString *)fileName inCapture:(NSString *)token {
+    return [[_resolver absolutePathForRelativePath:[_resolver relativeDirectoryForToken:token]] stringByAppendingPathComponent:fileName];
+}
+
+-(NSDictionary *)captureInfoOfCapture:(NSString *)token {
+    NSData * data = [NSData dataWithContentsOfFile:[self pathOfFile:@"capture-info.json" inCapture:token]];
+    if (!data) return nil;
+    return [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+}
+
+@end
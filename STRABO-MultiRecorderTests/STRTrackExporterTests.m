@@ -0,0 +1,170 @@
+//
+//  STRTrackExporterTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackExporterTests.h"
+#import "STRTrackExporter.h"
+#import "STRCapture.h"
+#import "STRCapturePathResolver.h"
+#import "STRCaptureToken.h"
+
+@interface STRTrackExporterTests () <NSXMLParserDelegate> {
+    NSString * _capturesPath;
+    STRCapturePathResolver * _resolver;
+    NSCountedSet * _elementCounts;
+    NSMutableString * _firstName;
+    BOOL _inName;
+    NSUInteger _captureCount;
+}
+@end
+
+@interface STRTrackExporterTests (InternalMethods)
+-(STRCapture *)writeCaptureWithTitle:(NSString *)title points:(NSUInteger)points;
+-(NSString *)exportCaptures:(NSArray *)captures format:(STRTrackExportFormat)format;
+-(void)parseXMLAtPath:(NSString *)path;
+@end
+
+@implementation STRTrackExporterTests
+
+- (void)setUp
+{
+    [super setUp];
+    _capturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRTrackExporterTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:_capturesPath];
+    _captureCount = 0;
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Formats
+
+- (void)testGeoJSONHasEveryPointAndTheMetadata
+{
+    STRCapture * capture = [self writeCaptureWithTitle:@"Main \"St\"" points:50];
+    NSString * path = [self exportCaptures:@[ capture ] format:STRTrackExportFormatGeoJSON];
+
+    NSDictionary * collection = [NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:path] options:0 error:nil];
+    STAssertEqualObjects([collection objectForKey:@"type"], @"FeatureCollection", @"The export should be a FeatureCollection");
+    NSDictionary * feature = [[collection objectForKey:@"features"] objectAtIndex:0];
+    NSDictionary * properties = [feature objectForKey:@"properties"];
+    NSArray * coordinates = [[feature objectForKey:@"geometry"] objectForKey:@"coordinates"];
+    STAssertEquals(coordinates.count, (NSUInteger)50, @"Every point should be exported");
+    STAssertEqualsWithAccuracy([[[coordinates objectAtIndex:0] objectAtIndex:0] doubleValue], -83.0, 0.0000001, @"Positions should be longitude first");
+    STAssertEquals([[properties objectForKey:@"coordTimes"] count], (NSUInteger)50, @"Every point should have a time");
+    STAssertEquals([[properties objectForKey:@"accuracies"] count], (NSUInteger)50, @"Every point should have an accuracy");
+    STAssertEqualObjects([[properties objectForKey:@"coordTimes"] objectAtIndex:1], @"2012-08-07T15:11:00.500Z", @"Times should be the creation date plus the point's timestamp");
+    STAssertEqualObjects([[properties objectForKey:@"headings"] objectAtIndex:3], @3, @"Headings should be exported");
+    STAssertEqualObjects([properties objectForKey:@"title"], @"Main \"St\"", @"The title should survive escaping");
+    STAssertEqualObjects([properties objectForKey:@"token"], capture.token, @"The token should be exported");
+}
+
+- (void)testGPXHasEveryPoint
+{
+    STRCapture * first = [self writeCaptureWithTitle:@"Fish & <Chips>" points:20];
+    STRCapture * second = [self writeCaptureWithTitle:@"Second" points:30];
+    [self parseXMLAtPath:[self exportCaptures:@[ first, second ] format:STRTrackExportFormatGPX]];
+
+    STAssertEquals([_elementCounts countForObject:@"trk"], (NSUInteger)2, @"Each capture should be a track");
+    STAssertEquals([_elementCounts countForObject:@"trkpt"], (NSUInteger)50, @"Every point should be exported");
+    STAssertEquals([_elementCounts countForObject:@"strabo:accuracy"], (NSUInteger)50, @"Every point should have an accuracy");
+    STAssertEqualObjects(_firstName, @"Fish & <Chips>", @"The title should survive escaping");
+}
+
+- (void)testKMLListsMatchingTimesAndPositions
+{
+    STRCapture * capture = [self writeCaptureWithTitle:@"Track" points:40];
+    [self parseXMLAtPath:[self exportCaptures:@[ capture ] format:STRTrackExportFormatKML]];
+
+    STAssertEquals([_elementCounts countForObject:@"when"], (NSUInteger)40, @"Every point should have a time");
+    STAssertEquals([_elementCounts countForObject:@"gx:coord"], (NSUInteger)40, @"Every point should have a position");
+    STAssertEquals([_elementCounts countForObject:@"gx:angles"], (NSUInteger)40, @"Every point should have a heading");
+    STAssertEquals([_elementCounts countForObject:@"gx:value"], (NSUInteger)40, @"Every point should have an accuracy");
+}
+
+#pragma mark - Damaged Geodata
+
+- (void)testTruncatedTrackDoesNotBreakTheExport
+{
+    STRCapture * intact = [self writeCaptureWithTitle:@"Intact" points:10];
+    STRCapture * truncated = [self writeCaptureWithTitle:@"Truncated" points:10];
+    [@"{\"points\":[{\"timestamp\":0," writeToFile:[_resolver absolutePathForCaptureFile:truncated.geoDataPath] atomically:NO encoding:NSUTF8StringEncoding error:nil];
+
+    NSString * path = [self exportCaptures:@[ truncated, intact ] format:STRTrackExportFormatGeoJSON];
+    NSDictionary * collection = [NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:path] options:0 error:nil];
+    STAssertEquals([[collection objectForKey:@"features"] count], (NSUInteger)2, @"Both captures should be exported");
+    STAssertEqualObjects([[[collection objectForKey:@"features"] objectAtIndex:0] objectForKey:@"geometry"], [NSNull null], @"A track that cannot be read should have no geometry");
+    STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[path stringByAppendingPathExtension:@"partial"]], @"No partial file should be left behind");
+}
+
+#pragma mark - NSXMLParserDelegate
+
+- (void)parser:(NSXMLParser *)parser didStartElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName attributes:(NSDictionary *)attributeDict
+{
+    [_elementCounts addObject:elementName];
+    _inName = [elementName isEqualToString:@"name"] && !_firstName.length && [_elementCounts countForObject:@"trk"];
+}
+
+- (void)parser:(NSXMLParser *)parser foundCharacters:(NSString *)string
+{
+    if (_inName) [_firstName appendString:string];
+}
+
+- (void)parser:(NSXMLParser *)parser didEndElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName
+{
+    _inName = NO;
+}
+
+@end
+
+@implementation STRTrackExporterTests (InternalMethods)
+
+-(STRCapture *)writeCaptureWithTitle:(NSString *)title points:(NSUInteger)points {
+    NSDate * date = [NSDate dateWithTimeIntervalSince1970:1344352260 + _captureCount++];
+    NSString * token = [STRCaptureToken generateTokenWithDate:date];
+    NSString * relativeDirectory = [_resolver relativeDirectoryForToken:token];
+    NSString * directory = [_resolver absolutePathForRelativePath:relativeDirectory];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+
+    NSMutableArray * track = [NSMutableArray arrayWithCapacity:points];
+    for (NSUInteger i = 0; i < points; i++) {
+        [track addObject:@{ @"timestamp" : @(i * 0.5), @"accuracy" : @10, @"coords" : @[ @(39.96 + i * 0.0001), @-83.0 ], @"heading" : @(i) }];
+    }
+    NSString * geoDataFile = [token stringByAppendingPathExtension:@"json"];
+    [[NSJSONSerialization dataWithJSONObject:@{ @"points" : track } options:0 error:nil] writeToFile:[directory stringByAppendingPathComponent:geoDataFile] atomically:YES];
+
+    // STRCapture reads through the shared resolver, so fill in the capture directly
+    STRCapture * capture = [[STRCapture alloc] init];
+    [capture setValue:token forKey:@"token"];
+    [capture setValue:@"video" forKey:@"type"];
+    [capture setValue:date forKey:@"creationDate"];
+    [capture setValue:[relativeDirectory stringByAppendingPathComponent:geoDataFile] forKey:@"geoDataPath"];
+    capture.title = title;
+    return capture;
+}
+
+-(NSString *)exportCaptures:(NSArray *)captures format:(STRTrackExportFormat)format {
+    STRTrackExporter * exporter = [[STRTrackExporter alloc] initWithFormat:format pathResolver:_resolver];
+    NSString * path = [[_capturesPath stringByAppendingPathComponent:@"export"] stringByAppendingPathExtension:[exporter pathExtension]];
+    STAssertTrue([exporter exportCaptures:captures toPath:path], @"The export should succeed");
+    return path;
+}
+
+-(void)parseXMLAtPath:(NSString *)path {
+    _elementCounts = [NSCountedSet set];
+    _firstName = [NSMutableString string];
+    NSXMLParser * parser = [[NSXMLParser alloc] initWithContentsOfURL:[NSURL fileURLWithPath:path]];
+    parser.delegate = self;
+    STAssertTrue([parser parse], @"The export should be well-formed XML: %@", parser.parserError);
+}
+
+@end
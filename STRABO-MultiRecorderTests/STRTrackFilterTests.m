@@ -0,0 +1,225 @@
+//
+//  STRTrackFilterTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackFilterTests.h"
+#import "STRTrackFilter.h"
+
+#define kMetersPerDegree 111195.08
+#define kOriginLatitude 43.6254
+#define kOriginLongitude -72.5179
+
+@interface STRTrackFilterTests () {
+    unsigned short _seed[3];
+}
+@end
+
+@interface STRTrackFilterTests (InternalMethods)
+-(double)gaussian;
+-(STRTrackSample *)newWalkWithCount:(NSUInteger)count accuracy:(double)accuracy truth:(STRTrackSample *)truth;
+-(double)rmsErrorOfSamples:(const STRTrackSample *)samples truth:(const STRTrackSample *)truth count:(NSUInteger)count;
+@end
+
+@implementation STRTrackFilterTests
+
+- (void)setUp
+{
+    [super setUp];
+    // A fixed seed keeps the noisy tracks the same from run to run
+    _seed[0] = 0x1234;
+    _seed[1] = 0x5678;
+    _seed[2] = 0x9abc;
+}
+
+#pragma mark - Positions
+
+- (void)testFilteringReducesPositionError
+{
+    NSUInteger count = 600;
+    STRTrackSample * truth = malloc(count * sizeof(STRTrackSample));
+    STRTrackSample * raw = [self newWalkWithCount:count accuracy:10 truth:truth];
+    STRTrackSample * filtered = malloc(count * sizeof(STRTrackSample));
+    STRTrackSample * smoothed = malloc(count * sizeof(STRTrackSample));
+
+    STRTrackFilter * filter = [[STRTrackFilter alloc] init];
+    for (NSUInteger i = 0; i < count; i++) {
+        filtered[i] = [filter filterSample:raw[i]];
+        smoothed[i] = raw[i];
+    }
+    [filter smoothSamples:smoothed count:count];
+
+    double rawError = [self rmsErrorOfSamples:raw truth:truth count:count];
+    double filteredError = [self rmsErrorOfSamples:filtered truth:truth count:count];
+    double smoothedError = [self rmsErrorOfSamples:smoothed truth:truth count:count];
+    STAssertTrue(filteredError < rawError * 0.7, @"Filtering should cut the error of %f m, not leave %f m", rawError, filteredError);
+    STAssertTrue(smoothedError < filteredError, @"Smoothing should beat filtering: %f m against %f m", smoothedError, filteredError);
+    STAssertTrue(filtered[count - 1].accuracy < 10, @"The estimated error should fall below the accuracy of a single fix");
+    for (NSUInteger i = 0; i < count; i++) {
+        STAssertEquals(smoothed[i].timestamp, raw[i].timestamp, @"Smoothing should keep the timestamps");
+    }
+
+    free(truth);
+    free(raw);
+    free(filtered);
+    free(smoothed);
+}
+
+- (void)testRepeatedFixesAreNotCountedAgain
+{
+    STRTrackSample first = { kOriginLatitude, kOriginLongitude, -1, 20, 0 };
+    STRTrackSample second = { kOriginLatitude + 0.0002, kOriginLongitude, -1, 20, 2 };
+
+    STRTrackFilter * once = [[STRTrackFilter alloc] init];
+    [once filterSample:first];
+    STRTrackSample expected = [once filterSample:second];
+
+    // Heading updates repeat the last fix many times before the next one arrives
+    STRTrackFilter * repeated = [[STRTrackFilter alloc] init];
+    [repeated filterSample:first];
+    for (NSUInteger i = 1; i < 50; i++) {
+        STRTrackSample repeat = first;
+        repeat.timestamp = i * 0.02;
+        repeat.heading = i;
+        [repeated filterSample:repeat];
+    }
+    STRTrackSample result = [repeated filterSample:second];
+
+    STAssertEqualsWithAccuracy(result.latitude, expected.latitude, 1e-9, @"Repeated fixes should not pull the track");
+    STAssertEqualsWithAccuracy(result.accuracy, expected.accuracy, 1e-6, @"Repeated fixes should not make the estimate more confident");
+}
+
+- (void)testSamplesWithoutAFixOnlyCarryTheEstimate
+{
+    STRTrackFilter * filter = [[STRTrackFilter alloc] init];
+    STRTrackSample fix = { kOriginLatitude, kOriginLongitude, -1, 10, 0 };
+    [filter filterSample:fix];
+    STRTrackSample noFix = { 0, 0, -1, -1, 1 };
+    STRTrackSample result = [filter filterSample:noFix];
+    STAssertEqualsWithAccuracy(result.latitude, kOriginLatitude, 1e-6, @"A sample without a fix should not move the track");
+    STAssertEqualsWithAccuracy(result.longitude, kOriginLongitude, 1e-6, @"A sample without a fix should not move the track");
+    STAssertTrue(result.accuracy > 10, @"The estimate should grow less certain without fixes");
+
+    [filter reset];
+    STRTrackSample first = [filter filterSample:noFix];
+    STAssertEquals(first.accuracy, -1.0, @"There is no estimate before the first fix");
+}
+
+#pragma mark - Headings
+
+- (void)testHeadingsAverageAcrossNorth
+{
+    STRTrackFilter * filter = [[STRTrackFilter alloc] init];
+    STRTrackSample sample = { kOriginLatitude, kOriginLongitude, 0, 10, 0 };
+    STRTrackSample result = sample;
+    for (NSUInteger i = 0; i < 100; i++) {
+        sample.heading = (i % 2) ? 356.0 : 4.0;
+        sample.timestamp = i * 0.1;
+        result = [filter filterSample:sample];
+        STAssertTrue(result.heading >= 0 && result.heading < 360, @"Headings should stay between 0 and 360, not %f", result.heading);
+    }
+    double distanceFromNorth = MIN(result.heading, 360.0 - result.heading);
+    STAssertTrue(distanceFromNorth < 4.0, @"A compass swinging across north should average to north, not %f", result.heading);
+}
+
+- (void)testMissingHeadingsAreSkippedAndBackfilled
+{
+    STRTrackSample samples[4] = {
+        { kOriginLatitude, kOriginLongitude, -1, 10, 0 },
+        { kOriginLatitude, kOriginLongitude, -1, 10, 1 },
+        { kOriginLatitude, kOriginLongitude, 90, 10, 2 },
+        { kOriginLatitude, kOriginLongitude, -1, 10, 3 }
+    };
+    STRTrackFilter * filter = [[STRTrackFilter alloc] init];
+    STAssertEquals([filter filterSample:samples[0]].heading, -1.0, @"There is no heading before the first valid one");
+    [filter filterSample:samples[1]];
+    STAssertEqualsWithAccuracy([filter filterSample:samples[2]].heading, 90.0, 1e-9, @"The first valid heading should be taken as it is");
+    STAssertEqualsWithAccuracy([filter filterSample:samples[3]].heading, 90.0, 1e-9, @"A missing heading should not change the estimate");
+
+    [filter smoothSamples:samples count:4];
+    for (NSUInteger i = 0; i < 4; i++) {
+        STAssertEqualsWithAccuracy(samples[i].heading, 90.0, 1e-9, @"Smoothing should fill the heading in before the first valid one");
+    }
+}
+
+#pragma mark - Files
+
+- (void)testSmoothTrackAtPath
+{
+    NSString * directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRTrackFilterTests"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString * sourcePath = [directory stringByAppendingPathComponent:@"track.json"];
+    NSString * destinationPath = [directory stringByAppendingPathComponent:@"track.filtered.json"];
+
+    NSUInteger count = 100;
+    STRTrackSample * truth = malloc(count * sizeof(STRTrackSample));
+    STRTrackSample * raw = [self newWalkWithCount:count accuracy:15 truth:truth];
+    NSMutableArray * points = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [points addObject:[STRTrackFilter pointFromSample:raw[i]]];
+    }
+    [[NSJSONSerialization dataWithJSONObject:@{ @"points" : points } options:0 error:nil] writeToFile:sourcePath atomically:YES];
+
+    STRTrackFilter * filter = [[STRTrackFilter alloc] init];
+    STAssertTrue([filter smoothTrackAtPath:sourcePath toPath:destinationPath], @"The track should be smoothed");
+    NSArray * smoothedPoints = [[NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:destinationPath] options:0 error:nil] objectForKey:@"points"];
+    STAssertEquals(smoothedPoints.count, count, @"Every point should be written");
+    STRTrackSample last = [STRTrackFilter sampleFromPoint:[smoothedPoints lastObject]];
+    STAssertEquals(last.timestamp, raw[count - 1].timestamp, @"The timestamps should be kept");
+    STAssertTrue(last.accuracy > 0 && last.accuracy < 15, @"The smoothed accuracy should be the estimated error");
+
+    STAssertFalse([filter smoothTrackAtPath:[directory stringByAppendingPathComponent:@"missing.json"] toPath:destinationPath], @"A missing track should fail");
+    [[@"{\"points\":[{\"coo" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:sourcePath atomically:YES];
+    STAssertFalse([filter smoothTrackAtPath:sourcePath toPath:destinationPath], @"A damaged track should fail");
+
+    free(truth);
+    free(raw);
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:nil];
+}
+
+@end
+
+@implementation STRTrackFilterTests (InternalMethods)
+
+-(double)gaussian {
+    // Box-Muller
+    double u = erand48(_seed), v = erand48(_seed);
+    return sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+}
+
+// A walk at 1.4 m/s that turns once, sampled every second, with fixes scattered by
+// about their reported accuracy
+-(STRTrackSample *)newWalkWithCount:(NSUInteger)count accuracy:(double)accuracy truth:(STRTrackSample *)truth {
+    STRTrackSample * raw = malloc(count * sizeof(STRTrackSample));
+    double metersPerDegreeLongitude = kMetersPerDegree * cos(kOriginLatitude * M_PI / 180.0);
+    double east = 0, north = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        if (i < count / 2) east += 1.4; else north += 1.4;
+        truth[i].latitude = kOriginLatitude + north / kMetersPerDegree;
+        truth[i].longitude = kOriginLongitude + east / metersPerDegreeLongitude;
+        truth[i].heading = (i < count / 2) ? 90 : 0;
+        truth[i].accuracy = 0;
+        truth[i].timestamp = i;
+        raw[i] = truth[i];
+        raw[i].latitude += [self gaussian] * accuracy * 0.7 / kMetersPerDegree;
+        raw[i].longitude += [self gaussian] * accuracy * 0.7 / metersPerDegreeLongitude;
+        raw[i].accuracy = accuracy;
+    }
+    return raw;
+}
+
+-(double)rmsErrorOfSamples:(const STRTrackSample *)samples truth:(const STRTrackSample *)truth count:(NSUInteger)count {
+    double metersPerDegreeLongitude = kMetersPerDegree * cos(kOriginLatitude * M_PI / 180.0);
+    double sum = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        double north = (samples[i].latitude - truth[i].latitude) * kMetersPerDegree;
+        double east = (samples[i].longitude - truth[i].longitude) * metersPerDegreeLongitude;
+        sum += north * north + east * east;
+    }
+    return sqrt(sum / count);
+}
+
+@end
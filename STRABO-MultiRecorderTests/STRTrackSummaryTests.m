@@ -0,0 +1,148 @@
+//
+//  STRTrackSummaryTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRTrackSummaryTests.h"
+#import "STRTrackSummary.h"
+#import "STRCaptureFileParser.h"
+#import "STRCapturePathResolver.h"
+#import "STRTestCaptureFixtures.h"
+
+// Three fixes 0.001 degrees apart along the equator and then north, with a point without a fix between them
+static const STRTrackSample kSTRTestTrack[] = {
+    { 0.0,   0.0,   350.0,  5.0, 0.0 },
+    { 0.0,   0.001,  10.0, 15.0, 2.0 },
+    { 0.0,   0.0,    -1.0, -1.0, 3.0 },
+    { 0.001, 0.001,   5.0, 10.0, 5.0 },
+};
+
+@interface STRTrackSummaryTests () {
+    NSString * _capturesPath;
+    STRCapturePathResolver * _resolver;
+    STRTestCaptureFixtures * _fixtures;
+}
+@end
+
+@interface STRTrackSummaryTests (InternalMethods)
+-(NSString *)writeTrackCaptureWithDate:(NSDate *)date info:(NSDictionary *)extraInfo;
+@end
+
+@implementation STRTrackSummaryTests
+
+- (void)setUp
+{
+    [super setUp];
+    _capturesPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRTrackSummaryTests"];
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_capturesPath withIntermediateDirectories:YES attributes:nil error:nil];
+    _resolver = [[STRCapturePathResolver alloc] initWithCapturesDirectoryPath:_capturesPath];
+    _fixtures = [[STRTestCaptureFixtures alloc] initWithPathResolver:_resolver];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_capturesPath error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Summarizing Tracks
+
+- (void)testSummaryOfSamples
+{
+    STRTrackSummary * summary = [STRTrackSummary summaryOfSamples:kSTRTestTrack count:4];
+    STAssertEquals(summary.pointCount, (NSUInteger)4, @"Every point should be counted");
+    STAssertEquals(summary.duration, 5.0, @"The duration should run from the first point to the last");
+    // Each step is 0.001 degrees of a great circle
+    STAssertEqualsWithAccuracy(summary.distance, 2 * 6371008.8 * 0.001 * M_PI / 180.0, 0.01, @"Only fixes should count towards the distance");
+    STAssertEquals(summary.southWest.latitude, 0.0, @"The point without a fix should not stretch the bounds");
+    STAssertEquals(summary.northEast.latitude, 0.001, @"north");
+    STAssertEquals(summary.northEast.longitude, 0.001, @"east");
+    STAssertEquals(summary.meanAccuracy, 10.0, @"The accuracy should be averaged over the fixes");
+    STAssertEquals(summary.headingRangeStart, 350.0, @"The heading range should cross north");
+    STAssertEquals(summary.headingRangeEnd, 10.0, @"The heading range should cross north");
+}
+
+- (void)testSummaryOfTrackWithoutFixes
+{
+    STRTrackSummary * empty = [STRTrackSummary summaryOfSamples:NULL count:0];
+    STAssertEquals(empty.pointCount, (NSUInteger)0, @"An empty track should have no points");
+    STAssertEquals(empty.duration, 0.0, @"An empty track should have no duration");
+    STAssertFalse(CLLocationCoordinate2DIsValid(empty.southWest), @"An empty track should have no bounds");
+    STAssertEquals(empty.meanAccuracy, -1.0, @"An empty track should have no accuracy");
+    STAssertEquals(empty.headingRangeStart, -1.0, @"An empty track should have no headings");
+    STAssertEquals([[empty dictionaryRepresentation] count], (NSUInteger)3, @"Only the point count, duration and distance should be saved");
+
+    // Headings spread over most of the circle
+    STRTrackSample turning[] = { { 0, 0, 90, -1, 0 }, { 0, 0, 200, -1, 1 }, { 0, 0, 330, -1, 2 } };
+    STRTrackSummary * summary = [STRTrackSummary summaryOfSamples:turning count:3];
+    // From 330 round through north to 200 is 230 degrees; from 90 to 330 would be 240
+    STAssertEquals(summary.headingRangeStart, 330.0, @"The range should leave out the widest gap");
+    STAssertEquals(summary.headingRangeEnd, 200.0, @"The range should leave out the widest gap");
+    STAssertEquals(summary.distance, 0.0, @"A track without fixes should have no length");
+}
+
+#pragma mark - Reading and Writing Summaries
+
+- (void)testSummaryRoundTripsThroughCaptureInfo
+{
+    STRTrackSummary * summary = [STRTrackSummary summaryOfSamples:kSTRTestTrack count:4];
+    NSDictionary * info = @{ @"coords" : @[ @0, @0 ], @"token" : @"abc", @"track_summary" : [summary dictionaryRepresentation] };
+    NSString * path = [_capturesPath stringByAppendingPathComponent:@"capture-info.json"];
+    [[NSJSONSerialization dataWithJSONObject:info options:0 error:nil] writeToFile:path atomically:YES];
+
+    STRCaptureInfoFields fields;
+    STAssertTrue([[STRCaptureFileParser parserForCurrentThread] parseCaptureInfoAtPath:path fields:&fields], @"The capture info should parse");
+    STAssertTrue(fields.hasTrackSummary, @"The summary should be found");
+    STRTrackSummary * parsed = [[STRTrackSummary alloc] initWithValues:fields.trackSummary];
+    STRTrackSummary * read = [STRTrackSummary summaryFromDictionary:[info objectForKey:@"track_summary"]];
+    for (STRTrackSummary * copy in @[ parsed, read ]) {
+        STAssertEquals(copy.pointCount, summary.pointCount, @"The point count should read back");
+        STAssertEquals(copy.duration, summary.duration, @"The duration should read back");
+        STAssertEqualsWithAccuracy(copy.distance, summary.distance, 1e-6, @"The distance should read back");
+        STAssertEquals(copy.northEast.latitude, summary.northEast.latitude, @"The bounds should read back");
+        STAssertEquals(copy.meanAccuracy, summary.meanAccuracy, @"The accuracy should read back");
+        STAssertEquals(copy.headingRangeStart, summary.headingRangeStart, @"The heading range should read back");
+        STAssertEquals(copy.headingRangeEnd, summary.headingRangeEnd, @"The heading range should read back");
+    }
+
+    STAssertNil([STRTrackSummary summaryFromDictionary:@{ @"point_count" : @4 }], @"A summary without a duration and distance should be refused");
+}
+
+#pragma mark - Backfill
+
+- (void)testBackfillSummarizesOnlyCapturesWithoutSummary
+{
+    NSString * old = [self writeTrackCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344352260] info:nil];
+    NSDictionary * existingSummary = @{ @"point_count" : @99, @"duration" : @1, @"distance" : @2 };
+    NSString * summarized = [self writeTrackCaptureWithDate:[NSDate dateWithTimeIntervalSince1970:1344355860] info:@{ @"track_summary" : existingSummary }];
+
+    STAssertEquals([STRTrackSummary backfillCapturesOfResolver:_resolver], (NSUInteger)1, @"Only the capture without a summary should be summarized");
+    NSDictionary * info = [_fixtures captureInfoOfCapture:old];
+    STRTrackSummary * saved = [STRTrackSummary summaryFromDictionary:[info objectForKey:@"track_summary"]];
+    STAssertEquals(saved.pointCount, (NSUInteger)4, @"The summary should be saved in the capture info");
+    STAssertEquals(saved.headingRangeStart, 350.0, @"The summary should be saved in the capture info");
+    STAssertEqualObjects([info objectForKey:@"title"], @"Untitled Capture", @"The rest of the capture info should be kept");
+    STAssertEqualObjects([[_fixtures captureInfoOfCapture:summarized] objectForKey:@"track_summary"], existingSummary, @"An existing summary should be left alone");
+
+    STAssertEquals([STRTrackSummary backfillCapturesOfResolver:_resolver], (NSUInteger)0, @"A second backfill should find nothing to do");
+}
+
+@end
+
+@implementation STRTrackSummaryTests (InternalMethods)
+
+-(NSString *)writeTrackCaptureWithDate:(NSDate *)date info:(NSDictionary *)extraInfo {
+    NSMutableDictionary * info = [@{ @"coords" : @[ @0, @0 ], @"heading" : @350 } mutableCopy];
+    if (extraInfo) [info addEntriesFromDictionary:extraInfo];
+    NSMutableArray * points = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 4; i++) {
+        [points addObject:[STRTrackFilter pointFromSample:kSTRTestTrack[i]]];
+    }
+    return [_fixtures writeCaptureWithDate:date info:info points:points media:nil];
+}
+
+@end
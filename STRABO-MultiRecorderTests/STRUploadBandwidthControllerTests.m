@@ -0,0 +1,196 @@
+//
+//  STRUploadBandwidthControllerTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadBandwidthControllerTests.h"
+#import "STRUploadBandwidthController.h"
+#import "STRCaptureDataCollector.h"
+#import "STRSettings.h"
+
+// The defaults of a new controller
+#define kInitialChunkSize 16384
+#define kMinimumChunkSize 4096
+#define kMaximumChunkSize 65536
+
+@implementation STRUploadBandwidthControllerTests
+
+- (void)tearDown
+{
+    [STRSettings removeAllOverrides];
+    [super tearDown];
+}
+
+#pragma mark - Rate Limiting
+
+- (void)testUnlimitedUploadsGetAWholeChunk
+{
+    STRUploadBandwidthController * controller = [[STRUploadBandwidthController alloc] init];
+    STAssertEquals([controller bytesAllowedNow], (NSUInteger)kInitialChunkSize, @"Without a cap the first chunk should be sent at once");
+    STAssertEquals([controller delayUntilBytesAllowed], 0.0, @"Without a cap nothing should wait");
+}
+
+- (void)testRateCapHoldsBackWritesUntilTheBucketFills
+{
+    STRUploadBandwidthController * controller = [[STRUploadBandwidthController alloc] init];
+    controller.maxBytesPerSecond = 8192;
+    // The bucket starts empty and a write waits for a minimum chunk, half a second here
+    STAssertEquals([controller bytesAllowedNow], (NSUInteger)0, @"An empty bucket should allow nothing");
+    NSTimeInterval delay = [controller delayUntilBytesAllowed];
+    STAssertTrue(delay > 0 && delay <= 0.5, @"The delay should be the time to fill a minimum chunk, not %f", delay);
+
+    [NSThread sleepForTimeInterval:delay + 0.05];
+    NSUInteger allowed = [controller bytesAllowedNow];
+    STAssertTrue(allowed >= kMinimumChunkSize && allowed <= 8192, @"After the delay a write of at least a minimum chunk should be allowed, not %lu", (unsigned long)allowed);
+    STAssertEquals([controller delayUntilBytesAllowed], 0.0, @"Nothing should wait once bytes are allowed");
+}
+
+- (void)testWritesComeOutOfTheBucket
+{
+    STRUploadBandwidthController * controller = [[STRUploadBandwidthController alloc] init];
+    controller.maxBytesPerSecond = 8192;
+    [NSThread sleepForTimeInterval:1.05];
+    NSUInteger allowed = [controller bytesAllowedNow];
+    STAssertEquals(allowed, (NSUInteger)8192, @"The bucket should hold one second of bytes at most");
+
+    STRUploadRequestMeter * meter = [controller beginRequest];
+    [meter didWriteBytes:allowed endingAtOffset:allowed];
+    STAssertEquals([controller bytesAllowedNow], (NSUInteger)0, @"The written bytes should empty the bucket");
+    STAssertTrue([controller delayUntilBytesAllowed] > 0.4, @"The next write should wait about half a second");
+}
+
+- (void)testCapBelowTheMinimumChunkStillAllowsWrites
+{
+    STRUploadBandwidthController * controller = [[STRUploadBandwidthController alloc] init];
+    controller.maxBytesPerSecond = 1000;
+    [NSThread sleepForTimeInterval:1.05];
+    STAssertEquals([controller bytesAllowedNow], (NSUInteger)1000, @"A cap below the minimum chunk should allow a whole second of bytes");
+}
+
+#pragma mark - Pausing
+
+- (void)testPausedUploadsSendNothing
+{
+    STRUploadBandwidthController * controller = [[STRUploadBandwidthController alloc] init];
+    [controller pause];
+    STAssertTrue(controller.isPaused, @"The controller should be paused");
+    STAssertEquals([controller bytesAllowedNow], (NSUInteger)0, @"A paused controller should allow nothing");
+    STAssertTrue([controller delayUntilBytesAllowed] > 0, @"A paused controller should ask to check back later");
+
+    [controller resume];
+    STAssertEquals([controller bytesAllowedNow], (NSUInteger)kInitialChunkSize, @"Uploads should continue after resume");
+}
+
+- (void)testPausedUploadsSendNothingUnderACap
+{
+    STRUploadBandwidthController * controller = [[STRUploadBandwidthController alloc] init];
+    controller.maxBytesPerSecond = 8192;
+    [controller pause];
+    [NSThread sleepForTimeInterval:1.05];
+    STAssertEquals([controller bytesAllowedNow], (NSUInteger)0, @"A full bucket should not matter while paused");
+
+    // The time spent paused does not turn into a burst
+    [controller resume];
+    STAssertEquals([controller bytesAllowedNow], (NSUInteger)0, @"The bucket should not fill while paused");
+    STAssertTrue([controller delayUntilBytesAllowed] > 0.4, @"After resume the bucket should fill at the cap again");
+}
+
+- (void)testRecordingPausesOnlyWhenTheSettingsAsk
+{
+    STRUploadBandwidthController * controller = [STRUploadBandwidthController sharedController];
+    NSNotificationCenter * center = [NSNotificationCenter defaultCenter];
+    NSDictionary * unsegmented = @{ STRCaptureRecordingSegmentedKey : @NO };
+
+    [STRSettings setOverrideValue:@NO forKey:@"Pause_Uploads_While_Recording"];
+    [center postNotificationName:STRCaptureRecordingDidBeginNotification object:nil userInfo:unsegmented];
+    STAssertFalse(controller.isPaused, @"Uploads should go on when the settings do not ask for a pause");
+    [center postNotificationName:STRCaptureRecordingDidEndNotification object:nil];
+
+    // An override applies from the next recording on
+    [STRSettings setOverrideValue:@YES forKey:@"Pause_Uploads_While_Recording"];
+    [center postNotificationName:STRCaptureRecordingDidBeginNotification object:nil userInfo:unsegmented];
+    STAssertTrue(controller.isPaused, @"Uploads should pause for the recording");
+    [center postNotificationName:STRCaptureRecordingDidEndNotification object:nil];
+    STAssertFalse(controller.isPaused, @"Uploads should continue when the recording ends");
+
+    [center postNotificationName:STRCaptureRecordingDidBeginNotification object:nil userInfo:@{ STRCaptureRecordingSegmentedKey : @YES }];
+    STAssertFalse(controller.isPaused, @"A segmented recording is uploaded while it records");
+    [center postNotificationName:STRCaptureRecordingDidEndNotification object:nil];
+
+    // Turning the setting off in the middle of a recording lets uploads go on
+    [center postNotificationName:STRCaptureRecordingDidBeginNotification object:nil userInfo:unsegmented];
+    STAssertTrue(controller.isPaused, @"Uploads should pause for the recording");
+    [STRSettings setOverrideValue:@NO forKey:@"Pause_Uploads_While_Recording"];
+    STAssertFalse(controller.isPaused, @"Uploads should continue once the settings stop asking for a pause");
+    [center postNotificationName:STRCaptureRecordingDidEndNotification object:nil];
+
+    // A pause that was asked for directly outlasts the setting, even during a recording pause
+    [STRSettings setOverrideValue:@YES forKey:@"Pause_Uploads_While_Recording"];
+    [center postNotificationName:STRCaptureRecordingDidBeginNotification object:nil userInfo:unsegmented];
+    [controller pause];
+    [STRSettings setOverrideValue:@NO forKey:@"Pause_Uploads_While_Recording"];
+    STAssertTrue(controller.isPaused, @"Only a pause for a recording should follow the setting");
+    [center postNotificationName:STRCaptureRecordingDidEndNotification object:nil];
+    STAssertTrue(controller.isPaused, @"The end of the recording should not undo a call to pause");
+    [controller resume];
+}
+
+- (void)testRecordingDoesNotUndoADirectPause
+{
+    STRUploadBandwidthController * controller = [STRUploadBandwidthController sharedController];
+    NSNotificationCenter * center = [NSNotificationCenter defaultCenter];
+    [STRSettings setOverrideValue:@NO forKey:@"Pause_Uploads_While_Recording"];
+
+    [controller pause];
+    [center postNotificationName:STRCaptureRecordingDidBeginNotification object:nil userInfo:@{ STRCaptureRecordingSegmentedKey : @NO }];
+    [center postNotificationName:STRCaptureRecordingDidEndNotification object:nil];
+    STAssertTrue(controller.isPaused, @"A call to pause should stand until resume");
+
+    [controller resume];
+    STAssertFalse(controller.isPaused, @"Resume should end the pause");
+}
+
+#pragma mark - Measuring
+
+- (void)testConcurrentRequestsKeepTheirOwnMarks
+{
+    STRUploadBandwidthController * controller = [[STRUploadBandwidthController alloc] init];
+    STRUploadRequestMeter * first = [controller beginRequest];
+    [first didWriteBytes:1000 endingAtOffset:1000];
+    // A second request starting must not wipe the marks of the first
+    STRUploadRequestMeter * second = [controller beginRequest];
+    [second didWriteBytes:500 endingAtOffset:500];
+    [NSThread sleepForTimeInterval:0.1];
+
+    [first didConfirmBytesSent:1000];
+    STAssertTrue(controller.measuredRoundTripTime >= 0.1, @"The write of the first request should be timed, not %f", controller.measuredRoundTripTime);
+    [second didConfirmBytesSent:500];
+    STAssertTrue(controller.measuredRoundTripTime >= 0.1, @"The write of the second request should be timed too, not %f", controller.measuredRoundTripTime);
+}
+
+- (void)testAdaptiveChunkSizeFollowsTheLink
+{
+    // A fast link with a long round trip wants more than the largest chunk queued
+    STRUploadBandwidthController * fast = [[STRUploadBandwidthController alloc] init];
+    STRUploadRequestMeter * meter = [fast beginRequest];
+    [meter didConfirmBytesSent:0];
+    [meter didWriteBytes:100000 endingAtOffset:100000];
+    [NSThread sleepForTimeInterval:0.1];
+    [meter didConfirmBytesSent:100000];
+    STAssertTrue(fast.measuredThroughput > 0, @"Throughput should be measured");
+    STAssertEquals([fast bytesAllowedNow], (NSUInteger)kMaximumChunkSize, @"Chunks should grow to the largest size on a fast link");
+
+    // A slow link wants as little as possible sitting in buffers
+    STRUploadBandwidthController * slow = [[STRUploadBandwidthController alloc] init];
+    meter = [slow beginRequest];
+    [meter didConfirmBytesSent:0];
+    [NSThread sleepForTimeInterval:0.2];
+    [meter didWriteBytes:1000 endingAtOffset:1000];
+    [meter didConfirmBytesSent:1000];
+    STAssertEquals([slow bytesAllowedNow], (NSUInteger)kMinimumChunkSize, @"Chunks should shrink to the smallest size on a slow link");
+}
+
+@end
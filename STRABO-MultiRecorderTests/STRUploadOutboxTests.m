@@ -0,0 +1,145 @@
+//
+//  STRUploadOutboxTests.m
+//  STRABO-MultiRecorderTests
+//
+//  Created by Thomas N Beatty on 10/19/12.
+//  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+//
+
+#import "STRUploadOutboxTests.h"
+#import "STRUploadOutbox.h"
+#import "STRCaptureUploadManager.h"
+#import "STRCapture.h"
+#import "STRCaptureToken.h"
+
+@interface STRUploadOutboxTests () {
+    NSString * _outboxPath;
+}
+@end
+
+@interface STRUploadOutboxTests (InternalMethods)
+-(STRCapture *)captureWithUploadDate:(NSDate *)uploadDate;
+-(NSError *)errorWithHTTPStatus:(NSInteger)statusCode;
+@end
+
+@implementation STRUploadOutboxTests
+
+- (void)setUp
+{
+    [super setUp];
+    _outboxPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"STRUploadOutboxTests/outbox.json"];
+    [[NSFileManager defaultManager] removeItemAtPath:[_outboxPath stringByDeletingLastPathComponent] error:nil];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:[_outboxPath stringByDeletingLastPathComponent] error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Persistence
+
+- (void)testQueueSurvivesRestart
+{
+    STRUploadOutbox * outbox = [[STRUploadOutbox alloc] initWithPath:_outboxPath];
+    NSArray * captures = @[ [self captureWithUploadDate:nil], [self captureWithUploadDate:nil], [self captureWithUploadDate:nil] ];
+    for (STRCapture * capture in captures) {
+        STAssertTrue([outbox enqueueCapture:capture], @"The capture should be queued");
+    }
+    STAssertTrue([outbox enqueueCapture:[captures objectAtIndex:0]], @"Queueing a capture twice should succeed");
+    NSArray * tokens = [captures valueForKey:@"token"];
+    STAssertEqualObjects([outbox pendingTokens], tokens, @"Captures should be queued once, in order");
+
+    // A new outbox on the same file stands in for the app being launched again
+    STRUploadOutbox * relaunched = [[STRUploadOutbox alloc] initWithPath:_outboxPath];
+    STAssertEqualObjects([relaunched pendingTokens], tokens, @"The queue should be read back after a restart");
+    STAssertEquals([relaunched attemptsForCaptureWithToken:[tokens objectAtIndex:1]], (NSUInteger)0, @"No attempts have been made yet");
+    STAssertNotNil([relaunched nextAttemptDateForCaptureWithToken:[tokens objectAtIndex:1]], @"Queued captures should have a next attempt date");
+
+    STAssertTrue([relaunched removeCaptureWithToken:[tokens objectAtIndex:1]], @"A queued capture should be removable");
+    STAssertFalse([relaunched removeCaptureWithToken:[tokens objectAtIndex:1]], @"A capture should only be removed once");
+    STRUploadOutbox * relaunchedAgain = [[STRUploadOutbox alloc] initWithPath:_outboxPath];
+    STAssertEqualObjects([relaunchedAgain pendingTokens], (@[ [tokens objectAtIndex:0], [tokens objectAtIndex:2] ]), @"The removal should be saved");
+}
+
+- (void)testDamagedOutboxFileStartsEmpty
+{
+    [[NSFileManager defaultManager] createDirectoryAtPath:[_outboxPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    [[@"{\"jobs\":[{\"tok" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:_outboxPath atomically:YES];
+    STRUploadOutbox * outbox = [[STRUploadOutbox alloc] initWithPath:_outboxPath];
+    STAssertEquals([outbox pendingTokens].count, (NSUInteger)0, @"A damaged outbox file should give an empty outbox");
+    STAssertTrue([outbox enqueueCapture:[self captureWithUploadDate:nil]], @"A damaged outbox file should be replaced");
+}
+
+#pragma mark - Upload Dates
+
+- (void)testUploadedCapturesAreNotQueued
+{
+    STRCapture * uploaded = [self captureWithUploadDate:[NSDate date]];
+    STRCapture * notUploaded = [self captureWithUploadDate:nil];
+    STAssertTrue([uploaded hasBeenUploaded], @"A capture with an upload date has been uploaded");
+    STAssertFalse([notUploaded hasBeenUploaded], @"A capture without an upload date has not been uploaded");
+
+    STRUploadOutbox * outbox = [[STRUploadOutbox alloc] initWithPath:_outboxPath];
+    STAssertFalse([outbox enqueueCapture:uploaded], @"An uploaded capture should not be queued");
+    STAssertEquals([outbox pendingTokens].count, (NSUInteger)0, @"An uploaded capture should not be queued");
+}
+
+#pragma mark - Retry Policy
+
+- (void)testRetryDelaysGrowAndStayWithinBounds
+{
+    STRUploadOutbox * outbox = [[STRUploadOutbox alloc] initWithPath:_outboxPath];
+    outbox.baseRetryDelay = 2;
+    outbox.maximumRetryDelay = 60;
+    for (NSUInteger sample = 0; sample < 200; sample++) {
+        for (NSUInteger attempts = 1; attempts <= 10; attempts++) {
+            NSTimeInterval cap = MIN(2 * pow(2, attempts - 1), 60.0);
+            NSTimeInterval delay = [outbox retryDelayAfterAttempts:attempts];
+            STAssertTrue(delay >= cap / 2 && delay <= cap, @"The delay after %lu attempts should be between %f and %f, not %f", (unsigned long)attempts, cap / 2, cap, delay);
+        }
+    }
+
+    // The jitter should spread retries out rather than always pick the same delay
+    NSMutableSet * delays = [NSMutableSet set];
+    for (NSUInteger sample = 0; sample < 20; sample++) {
+        [delays addObject:@([outbox retryDelayAfterAttempts:3])];
+    }
+    STAssertTrue(delays.count > 1, @"Retry delays should be randomized");
+}
+
+- (void)testErrorClassification
+{
+    STAssertTrue([STRUploadOutbox isRetryableError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil]], @"Timeouts should be retried");
+    STAssertTrue([STRUploadOutbox isRetryableError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNotConnectedToInternet userInfo:nil]], @"A missing network should be retried");
+    STAssertTrue([STRUploadOutbox isRetryableError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil]], @"A lost connection should be retried");
+    STAssertFalse([STRUploadOutbox isRetryableError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorUnsupportedURL userInfo:nil]], @"An unsupported URL is permanent");
+
+    STAssertTrue([STRUploadOutbox isRetryableError:[self errorWithHTTPStatus:503]], @"Server faults should be retried");
+    STAssertTrue([STRUploadOutbox isRetryableError:[self errorWithHTTPStatus:429]], @"Throttling should be retried");
+    STAssertTrue([STRUploadOutbox isRetryableError:[self errorWithHTTPStatus:408]], @"Request timeouts should be retried");
+    STAssertFalse([STRUploadOutbox isRetryableError:[self errorWithHTTPStatus:400]], @"Bad requests are permanent");
+    STAssertFalse([STRUploadOutbox isRetryableError:[self errorWithHTTPStatus:413]], @"Requests that are too large are permanent");
+
+    STAssertFalse([STRUploadOutbox isRetryableError:[NSError errorWithDomain:STRCaptureUploadErrorDomain code:STRCaptureUploadErrorServerRejected userInfo:nil]], @"A rejected capture is permanent");
+    STAssertTrue([STRUploadOutbox isRetryableError:[NSError errorWithDomain:STRCaptureUploadErrorDomain code:STRCaptureUploadErrorUnreadableResponse userInfo:nil]], @"An unreadable response should be retried");
+    STAssertTrue([STRUploadOutbox isRetryableError:nil], @"Unknown errors should be retried");
+}
+
+@end
+
+@implementation STRUploadOutboxTests (InternalMethods)
+
+-(STRCapture *)captureWithUploadDate:(NSDate *)uploadDate {
+    STRCapture * capture = [[STRCapture alloc] init];
+    [capture setValue:[STRCaptureToken generateToken] forKey:@"token"];
+    [capture setValue:@"image" forKey:@"type"];
+    capture.uploadDate = uploadDate;
+    return capture;
+}
+
+-(NSError *)errorWithHTTPStatus:(NSInteger)statusCode {
+    return [NSError errorWithDomain:STRCaptureUploadErrorDomain code:STRCaptureUploadErrorHTTPStatus userInfo:@{ STRCaptureUploadHTTPStatusCodeKey : @(statusCode) }];
+}
+
+@end
@@ -0,0 +1,1597 @@
+#!/usr/bin/env python3
+#
+#  capture_corpus.py
+#  STRABO-MultiRecorder
+#
+#  Created by Thomas N Beatty on 10/19/12.
+#  Copyright (c) 2012 Strabo, LLC. All rights reserved.
+#
+"""Generates synthetic capture corpora and load tests a captures directory.
+
+The SDK stores every capture in its own directory under
+Documents/StraboCaptures, in the layout that STRCaptureFileOrganizer writes:
+
+    <shard>/<token>/capture-info.json
+    <shard>/<token>/<token>.json        geodata track: {"points": [...]}
+    <shard>/<token>/<token>.png         thumbnail
+    <shard>/<token>/<token>.jpg|.mov    media
+
+The shard is `t` and the first 5 characters of a time-ordered token, or `h`
+and the first 2 of a legacy one (see STRCapturePathResolver). Older versions
+of the SDK left out the shard directory.
+
+`generate` fills a directory with captures in exactly that layout, or in the
+flat one with --flat. `migrate` moves flat captures into shards. Capture
+times and coordinates follow configurable distributions, and the same seed
+always produces the same corpus.
+
+`loadtest` runs concurrent creates, listings, date queries, saves, deletes and
+track reads against a directory. Each operation does the same file system work
+as the SDK method it is named after (see CaptureStore), and takes the same
+per-capture locks (see CaptureLocks), so the latencies show how the on-disk
+layout behaves under load. It reports latency percentiles per operation.
+
+`verify` checks every capture in parallel the way STRCaptureIntegrityScanner
+does, and can move damaged captures to .quarantine. `damage` breaks a share of
+a corpus's captures so there is something to find.
+
+`segments` records one capture in segments the way STRCaptureSegmenter does,
+splitting a synthetic track at the segment boundaries, and checks that every
+point lands in exactly one segment. It then replays the uploads the way
+STRSegmentUploadQueue sends them, in virtual time, and reports how long the
+upload runs on after the recording stops, against uploading the whole capture.
+
+`sync` builds the manifest that STRCaptureSyncManager posts before a synced
+upload, first hashing every file and then from the recorded checksums, and
+checks what a server holding part of the captures would answer. With --serve
+it is instead a stand-in for the server: it answers manifests posted to it
+with the captures that are not in its own captures directory.
+
+`summaries` summarizes the tracks of the captures that have no
+`track_summary` in their info file, the way the STRTrackSummary backfill does,
+and then times listing every capture's duration and length from the geodata
+files and from the summaries. `generate --no-summaries` writes captures as
+older versions of the SDK did, without summaries.
+
+Only the Python 3 standard library is used, so the tool runs on any Linux or
+Mac box. Copy a generated corpus into an app's Documents directory, or run the
+load test against a directory copied off a device.
+
+Examples:
+
+    capture_corpus.py generate --root /tmp/StraboCaptures --count 10000 --points 600
+    capture_corpus.py loadtest --root /tmp/StraboCaptures --threads 8 --duration 30
+    capture_corpus.py generate --root /tmp/Flat --count 10000 --flat
+    capture_corpus.py loadtest --root /tmp/Flat --threads 8 --duration 30 --migrate
+    capture_corpus.py sync --root /tmp/StraboCaptures --held-fraction 0.9
+    capture_corpus.py summaries --root /tmp/StraboCaptures
+"""
+
+import argparse
+import concurrent.futures
+import datetime
+import hashlib
+import http.server
+import json
+import math
+import os
+import random
+import shutil
+import struct
+import sys
+import threading
+import time
+import uuid
+import zlib
+
+CAPTURE_INFO_FILE = 'capture-info.json'
+EARTH_METERS_PER_DEGREE = 111111.0
+EARTH_RADIUS = 6371008.8
+LAYOUT_MARKER_FILE = '.sharded-layout'
+TIME_ORDERED_SHARD_LENGTH = 5
+LEGACY_SHARD_LENGTH = 2
+# Milliseconds covered by one time-ordered shard, about three days
+TIME_ORDERED_SHARD_SPAN = 1 << 28
+
+
+# -- Sizes and distributions -- #
+
+def parse_size(text):
+    """Parses a byte count such as 512, 64K or 10M."""
+    text = text.strip().upper()
+    multipliers = {'K': 1024, 'M': 1024 ** 2, 'G': 1024 ** 3}
+    if text and text[-1] in multipliers:
+        return int(float(text[:-1]) * multipliers[text[-1]])
+    return int(text)
+
+
+def parse_date(text):
+    return datetime.datetime.strptime(text, '%Y-%m-%d').replace(tzinfo=datetime.timezone.utc)
+
+
+def parse_mix(text):
+    """Parses an operation mix such as save=4,list=1."""
+    mix = {}
+    for part in text.split(','):
+        name, _, weight = part.partition('=')
+        name = name.strip()
+        if name not in OPERATIONS:
+            raise argparse.ArgumentTypeError('unknown operation: %s' % name)
+        mix[name] = float(weight or 1)
+    return mix
+
+
+def capture_times(rng, count, start, end, distribution, session_size):
+    """Returns `count` unix timestamps between start and end, newest last."""
+    start_ts, end_ts = start.timestamp(), end.timestamp()
+    span = max(end_ts - start_ts, 1)
+    times = []
+    if distribution == 'uniform':
+        times = [start_ts + rng.random() * span for _ in range(count)]
+    elif distribution == 'diurnal':
+        # Uniform over days, with most captures in the afternoon
+        days = max(int(span // 86400), 1)
+        for _ in range(count):
+            day = start_ts + rng.randrange(days) * 86400
+            hour = min(max(rng.gauss(15, 3), 0), 23.99)
+            times.append(day + hour * 3600)
+    elif distribution == 'sessions':
+        # Bursts of captures a minute or so apart, as when a user records a site
+        while len(times) < count:
+            t = start_ts + rng.random() * span
+            for _ in range(min(max(1, int(rng.expovariate(1.0 / session_size))), count - len(times))):
+                times.append(t)
+                t += rng.expovariate(1.0 / 60)
+    times = [min(t, end_ts) for t in times]
+    times.sort()
+    return times
+
+
+def capture_origins(rng, count, center, spread_km, distribution, clusters):
+    """Returns `count` (latitude, longitude) pairs around center."""
+    lat0, lon0 = center
+    spread = spread_km * 1000
+
+    def offset(lat, lon, north, east):
+        return (lat + north / EARTH_METERS_PER_DEGREE,
+                lon + east / (EARTH_METERS_PER_DEGREE * math.cos(math.radians(lat))))
+
+    if distribution == 'uniform':
+        return [offset(lat0, lon0, rng.uniform(-spread, spread), rng.uniform(-spread, spread)) for _ in range(count)]
+    if distribution == 'gaussian':
+        return [offset(lat0, lon0, rng.gauss(0, spread), rng.gauss(0, spread)) for _ in range(count)]
+    # Clustered: a few hot spots, each a tight gaussian
+    centers = [offset(lat0, lon0, rng.gauss(0, spread), rng.gauss(0, spread)) for _ in range(max(clusters, 1))]
+    points = []
+    for _ in range(count):
+        lat, lon = rng.choice(centers)
+        points.append(offset(lat, lon, rng.gauss(0, spread / 20), rng.gauss(0, spread / 20)))
+    return points
+
+
+# -- File contents -- #
+
+def make_token(rng, device_id, created_at, legacy=False):
+    """A token in the format of STRCaptureToken: milliseconds, device hash and random bits, in hex.
+
+    Legacy tokens are the 64-character hashes that earlier versions of the SDK wrote.
+    """
+    if legacy:
+        letters = 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789'
+        random_part = ''.join(rng.choice(letters) for _ in range(10))
+        return hashlib.sha256(('%s-%s-%d' % (device_id, random_part, int(created_at))).encode('utf-8')).hexdigest()
+    device = hashlib.sha256(device_id.encode('utf-8')).hexdigest()[:8]
+    return '%012x%s%012x' % (int(created_at * 1000), device, rng.getrandbits(48))
+
+
+def token_time(token):
+    """The creation time carried by a time-ordered token, or None for legacy tokens."""
+    if len(token) != 32:
+        return None
+    try:
+        return int(token[:12], 16) / 1000.0
+    except ValueError:
+        return None
+
+
+def shard_for_token(token):
+    """STRCapturePathResolver shardForToken: t + 5 hex digits of a time-ordered token, h + 2 of a legacy one."""
+    if token_time(token) is not None:
+        return 't' + token[:TIME_ORDERED_SHARD_LENGTH]
+    if len(token) == 64 and all(c in '0123456789abcdefABCDEF' for c in token):
+        return 'h' + token[:LEGACY_SHARD_LENGTH]
+    return None
+
+
+def is_time_ordered_shard(name):
+    return len(name) == TIME_ORDERED_SHARD_LENGTH + 1 and name.startswith('t')
+
+
+def is_legacy_shard(name):
+    return len(name) == LEGACY_SHARD_LENGTH + 1 and name.startswith('h')
+
+
+def list_directory(path):
+    try:
+        return os.listdir(path)
+    except OSError:
+        return []
+
+
+def make_png(width, height, rng=None):
+    """A valid RGB PNG. Noise if rng is given, otherwise a gradient."""
+    def chunk(kind, data):
+        body = kind + data
+        return struct.pack('>I', len(data)) + body + struct.pack('>I', zlib.crc32(body) & 0xffffffff)
+
+    rows = bytearray()
+    for y in range(height):
+        rows.append(0)
+        if rng:
+            rows.extend(rng.getrandbits(8) for _ in range(width * 3))
+        else:
+            shade = 64 + (128 * y) // max(height, 1)
+            rows.extend(bytes((shade, shade, 96)) * width)
+    header = struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0)
+    return b'\x89PNG\r\n\x1a\n' + chunk(b'IHDR', header) + chunk(b'IDAT', zlib.compress(bytes(rows))) + chunk(b'IEND', b'')
+
+
+def make_media(kind, size, rng, fill):
+    """A media blob of `size` bytes that starts and ends like a JPEG or QuickTime file."""
+    if kind == 'image':
+        head = b'\xff\xd8\xff\xe0\x00\x10JFIF\x00\x01\x01\x00\x00\x01\x00\x01\x00\x00'
+        tail = b'\xff\xd9'
+    else:
+        head = struct.pack('>I', 20) + b'ftypqt  \x00\x00\x02\x00qt  '
+        head += struct.pack('>I', max(size - len(head), 8)) + b'mdat'
+        tail = b''
+    body_size = max(size - len(head) - len(tail), 0)
+    body = rng.randbytes(body_size) if fill == 'random' else bytes(body_size)
+    return head + body + tail
+
+
+def make_track(rng, points, latitude, longitude, speed):
+    """A geodata track as written by STRGeoLocationData: a walk with irregular update times."""
+    track = []
+    heading = rng.uniform(0, 360)
+    timestamp = 0.0
+    for _ in range(points):
+        track.append({
+            'coords': [latitude, longitude],
+            'heading': round(heading, 2),
+            'accuracy': rng.choice((5, 5, 10, 10, 10, 15, 30, 65)),
+            'timestamp': round(timestamp, 6),
+        })
+        interval = rng.uniform(0.3, 1.7)
+        heading = (heading + rng.gauss(0, 10)) % 360
+        distance = speed * interval
+        latitude += math.cos(math.radians(heading)) * distance / EARTH_METERS_PER_DEGREE
+        longitude += math.sin(math.radians(heading)) * distance / (EARTH_METERS_PER_DEGREE * math.cos(math.radians(latitude)))
+        timestamp += interval
+    return {'points': track}
+
+
+def write_json(path, value):
+    with open(path, 'w') as handle:
+        json.dump(value, handle, separators=(',', ':'))
+
+
+def replace_json(path, value):
+    """Writes beside the file and renames over it, as NSDataWritingAtomic does, so readers see the old file or the new one."""
+    write_json(path + '.tmp', value)
+    os.replace(path + '.tmp', path)
+
+
+class CaptureLocks(object):
+    """STRCaptureLockTable: tokens hashed over a fixed table of locks.
+
+    Only writers lock here. The SDK's upload readers share a reader/writer lock,
+    but nothing in this tool uploads, so plain locks are enough.
+    """
+
+    def __init__(self, stripes=128):
+        self.stripes = [threading.Lock() for _ in range(stripes)]
+
+    def lock_for(self, token):
+        return self.stripes[zlib.crc32(token.encode('utf-8')) % len(self.stripes)]
+
+
+CAPTURE_LOCKS = CaptureLocks()
+
+
+# -- The store -- #
+
+class CaptureStore(object):
+    """Performs the same file system work as the SDK's capture classes.
+
+    Paths are resolved the way STRCapturePathResolver resolves them, so a store
+    works on the sharded layout, the flat layout, or a mix of both part way
+    through a migration.
+    """
+
+    def __init__(self, root, flat=False):
+        self.root = root
+        self.flat = flat
+        os.makedirs(root, exist_ok=True)
+
+    # STRCapturePathResolver
+
+    def relative_directory_for(self, token):
+        """relativeDirectoryForToken:, or the bare token when writing the flat layout."""
+        shard = None if self.flat else shard_for_token(token)
+        return '%s/%s' % (shard, token) if shard else token
+
+    def directory_of(self, token):
+        """relativeDirectoryOfCaptureWithToken: checks the shard, the root, then the shard again."""
+        shard = shard_for_token(token)
+        sharded = '%s/%s' % (shard, token) if shard else token
+        for candidate in (sharded, token, sharded):
+            if os.path.isdir(os.path.join(self.root, candidate)):
+                return candidate
+        return None
+
+    def legacy_directories(self):
+        """legacyCaptureDirectories: the root is listed before the shards, so a moving capture is never missed."""
+        directories = {}
+        shards = []
+        for entry in os.listdir(self.root):
+            if is_legacy_shard(entry):
+                shards.append(entry)
+            elif token_time(entry) is None and not is_time_ordered_shard(entry) and not entry.startswith('.'):
+                directories[entry] = entry
+        for shard in shards:
+            for token in list_directory(os.path.join(self.root, shard)):
+                if not token.startswith('.'):
+                    directories[token] = '%s/%s' % (shard, token)
+        return list(directories.values())
+
+    def time_ordered_directories(self, start=None, end=None, oldest_first=False):
+        """enumerateTimeOrderedCaptureDirectoriesFromDate:toDate:oldestFirst:usingBlock: lists shards one at a time."""
+        start_ms = 0 if start is None else max(int(start * 1000), 0)
+        end_ms = float('inf') if end is None else int(end * 1000)
+        shards, flat_tokens = set(), {}
+        for entry in os.listdir(self.root):
+            if is_time_ordered_shard(entry):
+                shards.add(entry)
+            elif token_time(entry) is not None:
+                shard = shard_for_token(entry)
+                shards.add(shard)
+                flat_tokens.setdefault(shard, []).append(entry)
+        for shard in sorted(shards, reverse=not oldest_first):
+            shard_start = int(shard[1:], 16) * TIME_ORDERED_SHARD_SPAN
+            if shard_start > end_ms:
+                if oldest_first:
+                    break
+                continue
+            if shard_start + TIME_ORDERED_SHARD_SPAN <= start_ms:
+                if oldest_first:
+                    continue
+                break
+            directories = dict((token, token) for token in flat_tokens.get(shard, ()))
+            for token in list_directory(os.path.join(self.root, shard)):
+                if token_time(token) is not None:
+                    directories[token] = '%s/%s' % (shard, token)
+            for token in sorted(directories, reverse=not oldest_first):
+                yield directories[token]
+
+    def all_directories(self):
+        """allCaptureDirectories"""
+        return self.legacy_directories() + list(self.time_ordered_directories())
+
+    def migrate(self):
+        """migrateFlatCaptures: one rename per capture, then the layout marker once nothing is left."""
+        moved = remaining = 0
+        for entry in os.listdir(self.root):
+            shard = shard_for_token(entry)
+            if shard is None:
+                continue
+            os.makedirs(os.path.join(self.root, shard), exist_ok=True)
+            try:
+                with CAPTURE_LOCKS.lock_for(entry):
+                    os.rename(os.path.join(self.root, entry), os.path.join(self.root, shard, entry))
+                moved += 1
+            except OSError:
+                remaining += 1
+        if remaining == 0:
+            write_json(os.path.join(self.root, LAYOUT_MARKER_FILE), {'layout': 'sharded', 'version': 1, 'migrated_at': time.time()})
+        return moved
+
+    # Captures
+
+    def write_capture(self, token, created_at, coords, heading, media_kind, media, thumbnail, track, uploaded_at=0, summarize=True):
+        """STRCaptureFileOrganizer saveTemp...FilesWithInitialLocation:heading:"""
+        directory = os.path.join(self.root, self.relative_directory_for(token))
+        os.makedirs(directory, exist_ok=True)
+        # Info file paths keep the token/file form whatever the layout
+        relative = '%s/%s' % (token, token)
+        extension = 'jpg' if media_kind == 'image' else 'mov'
+        info = {
+            'created_at': int(created_at),
+            'geodata_file': relative + '.json',
+            'coords': list(coords),
+            'heading': heading,
+            'media_file': '%s.%s' % (relative, extension),
+            'orientation': 'vertical',
+            'thumbnail_file': relative + '.png',
+            'title': 'Untitled Capture',
+            'token': token,
+            'media_type': media_kind,
+            'uploaded_at': uploaded_at,
+        }
+        if summarize:
+            info['track_summary'] = track_summary(track['points'])
+        with open(os.path.join(directory, token + '.png'), 'wb') as handle:
+            handle.write(thumbnail)
+        write_json(os.path.join(directory, token + '.json'), track)
+        with open(os.path.join(directory, '%s.%s' % (token, extension)), 'wb') as handle:
+            handle.write(media)
+        # Last, so listings never find a capture with files missing
+        replace_json(os.path.join(directory, CAPTURE_INFO_FILE), info)
+        return len(media) + len(thumbnail)
+
+    def load_capture(self, directory):
+        """STRCapture captureFromFilesAtDirectory: reads the info file and the thumbnail image."""
+        if '/' not in directory:
+            # A bare token is looked up in both layouts, so a capture migrated since the listing is still found
+            directory = self.directory_of(directory) or directory
+        try:
+            with open(os.path.join(self.root, directory, CAPTURE_INFO_FILE)) as handle:
+                info = json.load(handle)
+            with open(self.capture_file_path(directory, info['thumbnail_file']), 'rb') as handle:
+                handle.read()
+        except (OSError, ValueError, KeyError):
+            # The capture was deleted or moved after it was listed; the SDK skips it
+            return None
+        return info
+
+    def capture_file_path(self, directory, stored_path):
+        """STRCapturePathResolver absolutePathForCaptureFile: follows a capture that moved after it was opened."""
+        path = os.path.join(self.root, directory, os.path.basename(stored_path))
+        if not os.path.exists(path):
+            moved = self.directory_of(os.path.basename(directory))
+            if moved:
+                path = os.path.join(self.root, moved, os.path.basename(stored_path))
+        return path
+
+    def created_at(self, directory):
+        """STRCaptureFileManager creationDateOfCaptureDirectory: reads only the info file."""
+        try:
+            with open(os.path.join(self.root, directory, CAPTURE_INFO_FILE)) as handle:
+                return float(json.load(handle)['created_at'])
+        except (OSError, ValueError, KeyError, TypeError):
+            return float('-inf')
+
+    def sorted_directories(self):
+        """STRCaptureFileManager captureDirectoriesSortedByDate: names of time-ordered tokens sort by date."""
+        dated = [(token_time(os.path.basename(d)), d) for d in self.time_ordered_directories()]
+        dated.extend((self.created_at(d), d) for d in self.legacy_directories())
+        dated.sort(reverse=True)
+        return [directory for _, directory in dated]
+
+    def load_all(self, directories):
+        captures = [self.load_capture(directory) for directory in directories]
+        missing = captures.count(None)
+        return [c for c in captures if c is not None], missing
+
+    def all_captures(self, sort=True):
+        """STRCaptureFileManager allCapturesSorted:"""
+        return self.load_all(self.sorted_directories() if sort else self.all_directories())
+
+    def captures_on_date(self, day):
+        """STRCaptureFileManager capturesOnDate:sorted: lists only the shards that overlap the day."""
+        start = time.mktime(day.timetuple())
+        end = time.mktime((day + datetime.timedelta(days=1)).timetuple()) - 0.001
+        directories = list(self.time_ordered_directories(start, end)) + self.legacy_directories()
+        captures, missing = self.load_all(directories)
+        matches = [c for c in captures if datetime.date.fromtimestamp(c['created_at']) == day]
+        matches.sort(key=lambda c: c['created_at'], reverse=True)
+        return matches, missing
+
+    def recent_captures(self, limit):
+        """STRCaptureFileManager recentCapturesWithLimit: without legacy captures, stops listing once it has enough."""
+        directories = self.sorted_directories() if self.legacy_directories() else self.time_ordered_directories()
+        captures, missing = [], 0
+        for directory in directories:
+            if len(captures) >= limit:
+                break
+            capture = self.load_capture(directory)
+            if capture is None:
+                missing += 1
+            else:
+                captures.append(capture)
+        return captures, missing
+
+    def cursor_for(self, directory):
+        """STRCaptureFileManager cursorForCaptureDirectory: creation milliseconds in 12 hex digits, then the token."""
+        token = os.path.basename(directory)
+        if token_time(token) is not None:
+            return token[:12] + token
+        created = self.created_at(directory)
+        return '%012x%s' % (int(created * 1000) if created > 0 else 0, token)
+
+    def page(self, page_size, cursor=None, oldest_first=False, keep=None):
+        """STRCaptureFileManager capturesWithPageSize:afterCursor:sortOrder:filter:nextCursor: stops reading once the page is full."""
+        def comes_before(a, b):
+            return a < b if oldest_first else a > b
+
+        legacy = {}
+        for directory in self.legacy_directories():
+            key = self.cursor_for(directory)
+            if cursor is None or comes_before(cursor, key):
+                legacy[key] = directory
+        legacy_keys = sorted(legacy, reverse=not oldest_first)
+        start = end = None
+        if cursor is not None:
+            cursor_time = int(cursor[:12], 16) / 1000.0
+            start, end = (cursor_time - 1, None) if oldest_first else (None, cursor_time + 1)
+        ordered = self.time_ordered_directories(start, end, oldest_first)
+
+        def merged():
+            index = 0
+            for directory in ordered:
+                key = self.cursor_for(directory)
+                if cursor is not None and not comes_before(cursor, key):
+                    continue
+                while index < len(legacy_keys) and comes_before(legacy_keys[index], key):
+                    yield legacy[legacy_keys[index]], legacy_keys[index]
+                    index += 1
+                yield directory, key
+            for key in legacy_keys[index:]:
+                yield legacy[key], key
+
+        captures, missing, last = [], 0, None
+        for directory, key in merged():
+            capture = self.load_capture(directory)
+            if capture is None:
+                missing += 1
+            elif keep is None or keep(capture):
+                captures.append(capture)
+            last = key
+            if len(captures) >= page_size:
+                return captures, last, missing
+        return captures, None, missing
+
+    def info_path(self, token):
+        directory = self.directory_of(token)
+        if directory is None:
+            raise FileNotFoundError(token)
+        return os.path.join(self.root, directory, CAPTURE_INFO_FILE)
+
+    def save(self, token, title=None, uploaded_at=None):
+        """STRCapture save: under the capture lock, applies only the changed fields to the info file on disk and renames it into place."""
+        with CAPTURE_LOCKS.lock_for(token):
+            path = self.info_path(token)
+            with open(path) as handle:
+                info = json.load(handle)
+            if title is not None:
+                info['title'] = title
+            if uploaded_at is not None:
+                info['uploaded_at'] = uploaded_at
+            replace_json(path, info)
+
+    def delete(self, token):
+        """STRCaptureFileManager deleteCaptureWithToken:"""
+        with CAPTURE_LOCKS.lock_for(token):
+            directory = self.directory_of(token)
+            if directory is None:
+                raise FileNotFoundError(token)
+            shutil.rmtree(os.path.join(self.root, directory))
+
+    def read_track(self, token):
+        """STRCapture geoDataPoints"""
+        path = self.info_path(token)
+        with open(path) as handle:
+            info = json.load(handle)
+        with open(os.path.join(os.path.dirname(path), os.path.basename(info['geodata_file']))) as handle:
+            points = json.load(handle)['points']
+        return {p['timestamp']: (p['coords'], p['heading']) for p in points}
+
+
+# -- Generating -- #
+
+class CaptureFactory(object):
+    """Builds capture contents from the command line options."""
+
+    def __init__(self, args):
+        self.args = args
+        self.device_id = str(uuid.UUID(int=random.Random(args.seed).getrandbits(128))).upper()
+        thumbnail_rng = random.Random(args.seed) if args.thumbnail_noise else None
+        self.thumbnail = make_png(args.thumbnail_width, args.thumbnail_height, thumbnail_rng)
+        # Zero-filled media is the same for every capture, so build it once
+        self.media = {}
+        if args.media_fill == 'zero':
+            for kind in ('image', 'video'):
+                self.media[kind] = make_media(kind, args.media_bytes, None, 'zero')
+
+    def write(self, store, index, created_at, origin):
+        args = self.args
+        rng = random.Random('%d-%d' % (args.seed, index))
+        kind = 'video' if rng.random() < args.video_fraction else 'image'
+        points = args.points if kind == 'video' else 1
+        token = make_token(rng, self.device_id, created_at, args.legacy_tokens)
+        heading = round(rng.uniform(0, 360), 2)
+        uploaded_at = int(created_at + rng.uniform(60, 86400)) if rng.random() < args.uploaded_fraction else 0
+        media = self.media.get(kind) or make_media(kind, args.media_bytes, rng, args.media_fill)
+        track = make_track(rng, points, origin[0], origin[1], args.speed)
+        return token, store.write_capture(token, created_at, origin, heading, kind, media, self.thumbnail, track, uploaded_at, not args.no_summaries)
+
+
+def generate(args):
+    store = CaptureStore(args.root, flat=args.flat)
+    rng = random.Random(args.seed)
+    times = capture_times(rng, args.count, args.start, args.end, args.time_distribution, args.session_size)
+    origins = capture_origins(rng, args.count, args.center, args.spread_km, args.coord_distribution, args.clusters)
+    factory = CaptureFactory(args)
+
+    started = time.perf_counter()
+    written = 0
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as executor:
+        futures = [executor.submit(factory.write, store, i, times[i], origins[i]) for i in range(args.count)]
+        for done, future in enumerate(concurrent.futures.as_completed(futures), 1):
+            written += future.result()[1]
+            if args.progress and done % 1000 == 0:
+                print('%d/%d captures' % (done, args.count), file=sys.stderr)
+    elapsed = time.perf_counter() - started
+
+    summary = {'root': os.path.abspath(args.root), 'captures': args.count, 'media_bytes': written, 'seconds': round(elapsed, 3)}
+    print(json.dumps(summary))
+
+
+# -- Damage and verification -- #
+
+DAMAGE_KINDS = ('info', 'media', 'geodata', 'thumbnail')
+CHECKSUM_FILE = '.checksums.json'
+QUARANTINE_DIRECTORY = '.quarantine'
+# Captures changed more recently than this may still be being written
+RECENT_CHANGE_SECONDS = 60
+
+
+def damage(args):
+    """Breaks a share of the captures in the ways real devices do, for testing verify."""
+    store = CaptureStore(args.root)
+    rng = random.Random(args.seed)
+    directories = sorted(store.all_directories())
+    damaged = rng.sample(directories, int(len(directories) * args.fraction))
+    counts = dict((kind, 0) for kind in DAMAGE_KINDS)
+    old = time.time() - 3600
+    for directory in damaged:
+        kind = rng.choice(DAMAGE_KINDS)
+        path = os.path.join(store.root, directory)
+        token = os.path.basename(directory)
+        if kind == 'info':
+            # A save interrupted part way through
+            with open(os.path.join(path, CAPTURE_INFO_FILE), 'r+') as handle:
+                handle.truncate(rng.randrange(1, 40))
+        elif kind == 'media':
+            for name in os.listdir(path):
+                if name.endswith('.jpg') or name.endswith('.mov'):
+                    os.remove(os.path.join(path, name))
+        elif kind == 'geodata':
+            geodata = os.path.join(path, token + '.json')
+            with open(geodata, 'r+') as handle:
+                handle.truncate(max(os.path.getsize(geodata) // 2, 1))
+        else:
+            os.remove(os.path.join(path, token + '.png'))
+        counts[kind] += 1
+        # The scanner leaves recently changed captures alone
+        os.utime(path, (old, old))
+        os.utime(os.path.join(path, CAPTURE_INFO_FILE), (old, old))
+    print(json.dumps({'root': os.path.abspath(args.root), 'damaged': counts}))
+
+
+def file_size(path):
+    try:
+        return os.stat(path).st_size
+    except OSError:
+        return -1
+
+
+def read_capture_info(path):
+    """STRCaptureIntegrityScanner captureInfoAtPath: the info file must have everything STRCapture needs."""
+    try:
+        with open(os.path.join(path, CAPTURE_INFO_FILE)) as handle:
+            info = json.load(handle)
+    except (OSError, ValueError):
+        return None
+    if not isinstance(info, dict):
+        return None
+    if not all(isinstance(info.get(key), str) for key in ('token', 'media_file', 'geodata_file', 'thumbnail_file')):
+        return None
+    coords = info.get('coords')
+    return info if isinstance(coords, list) and len(coords) >= 2 else None
+
+
+def geodata_is_complete(path):
+    """geoDataIsCompleteAtPath: a complete track starts with { and ends with }, checked without reading it all."""
+    try:
+        with open(path, 'rb') as handle:
+            head = handle.read(32).lstrip()
+            handle.seek(max(os.fstat(handle.fileno()).st_size - 32, 0))
+            tail = handle.read(32).rstrip()
+    except OSError:
+        return False
+    return head[:1] == b'{' and tail[-1:] == b'}'
+
+
+def sha1_of_file(path):
+    digest = hashlib.sha1()
+    with open(path, 'rb') as handle:
+        for block in iter(lambda: handle.read(64 * 1024), b''):
+            digest.update(block)
+    return digest.hexdigest()
+
+
+def check_capture(path, parse_geodata=False, checksums=False):
+    """STRCaptureIntegrityScanner checkCaptureAtPath:info: returns the names of the issues found."""
+    token = os.path.basename(path)
+    issues = []
+    info = read_capture_info(path)
+    if info:
+        media, geodata, thumbnail = (os.path.basename(info[key]) for key in ('media_file', 'geodata_file', 'thumbnail_file'))
+    else:
+        issues.append('info_unreadable')
+        media = next((token + ext for ext in ('.mov', '.jpg') if file_size(os.path.join(path, token + ext)) >= 0), None)
+        geodata, thumbnail = token + '.json', token + '.png'
+    media_size = file_size(os.path.join(path, media)) if media else -1
+    if media_size < 0:
+        issues.append('media_missing')
+    elif media_size == 0:
+        issues.append('media_empty')
+    geodata_path = os.path.join(path, geodata)
+    if file_size(geodata_path) < 0:
+        issues.append('geodata_missing')
+    elif parse_geodata:
+        try:
+            with open(geodata_path) as handle:
+                if not isinstance(json.load(handle).get('points'), list):
+                    issues.append('geodata_unreadable')
+        except (OSError, ValueError, AttributeError):
+            issues.append('geodata_unreadable')
+    elif not geodata_is_complete(geodata_path):
+        issues.append('geodata_unreadable')
+    if file_size(os.path.join(path, thumbnail)) <= 0:
+        issues.append('thumbnail_missing')
+    if checksums and not issues:
+        names = (media, geodata, thumbnail)
+        checksum_path = os.path.join(path, CHECKSUM_FILE)
+        try:
+            with open(checksum_path) as handle:
+                recorded = json.load(handle)['files']
+        except (OSError, ValueError, KeyError, TypeError):
+            recorded = None
+        if recorded is None:
+            files = dict((name, {'size': file_size(os.path.join(path, name)), 'sha1': sha1_of_file(os.path.join(path, name))}) for name in names)
+            write_json(checksum_path, {'algorithm': 'sha1', 'recorded_at': time.time(), 'files': files})
+        else:
+            for name in names:
+                expected = recorded.get(name)
+                if expected and (file_size(os.path.join(path, name)) != expected['size'] or sha1_of_file(os.path.join(path, name)) != expected['sha1']):
+                    issues.append('checksum_mismatch')
+                    break
+    return issues
+
+
+def recently_changed(path):
+    now = time.time()
+    for candidate in (path, os.path.join(path, CAPTURE_INFO_FILE)):
+        try:
+            if now - os.stat(candidate).st_mtime < RECENT_CHANGE_SECONDS:
+                return True
+        except OSError:
+            pass
+    return False
+
+
+def quarantine(store, directory):
+    """STRCapturePathResolver quarantineCaptureAtRelativeDirectory:"""
+    quarantine_path = os.path.join(store.root, QUARANTINE_DIRECTORY)
+    os.makedirs(quarantine_path, exist_ok=True)
+    token = os.path.basename(directory)
+    target, attempt = os.path.join(quarantine_path, token), 1
+    while os.path.exists(target):
+        target = os.path.join(quarantine_path, '%s-%d' % (token, attempt))
+        attempt += 1
+    try:
+        with CAPTURE_LOCKS.lock_for(token):
+            os.rename(os.path.join(store.root, directory), target)
+        return True
+    except OSError:
+        return False
+
+
+def verify(args):
+    """STRCaptureIntegrityScanner scan, in parallel batches of 64 captures."""
+    store = CaptureStore(args.root)
+    started = time.perf_counter()
+    directories = store.all_directories()
+
+    def scan_batch(batch):
+        results = []
+        for directory in batch:
+            path = os.path.join(store.root, directory)
+            issues = check_capture(path, args.parse_geodata, args.checksums)
+            if not issues:
+                continue
+            # Moved, deleted or still being written since it was listed
+            current = store.directory_of(os.path.basename(directory))
+            if current is None or recently_changed(os.path.join(store.root, current)):
+                results.append((directory, None, 'skipped'))
+                continue
+            outcome = 'quarantined' if args.quarantine and quarantine(store, current) else None
+            results.append((directory, issues, outcome))
+        return results
+
+    batches = [directories[i:i + 64] for i in range(0, len(directories), 64)]
+    issues, quarantined, skipped = {}, [], 0
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as executor:
+        for results in executor.map(scan_batch, batches):
+            for directory, found, outcome in results:
+                token = os.path.basename(directory)
+                if outcome == 'skipped':
+                    skipped += 1
+                    continue
+                issues[token] = found
+                if outcome == 'quarantined':
+                    quarantined.append(token)
+    report = {'scanned': len(directories) - skipped, 'issues': issues, 'repaired': [], 'quarantined': quarantined,
+              'duration': round(time.perf_counter() - started, 3)}
+    if args.json:
+        with open(args.json, 'w') as handle:
+            json.dump(report, handle, indent=2)
+    counts = {}
+    for found in issues.values():
+        for name in found:
+            counts[name] = counts.get(name, 0) + 1
+    print(json.dumps({'scanned': report['scanned'], 'damaged': len(issues), 'issues': counts,
+                      'quarantined': len(quarantined), 'seconds': report['duration']}))
+
+
+# -- Load testing -- #
+
+OPERATIONS = ('create', 'list', 'query', 'recent', 'page', 'save', 'delete', 'track')
+
+
+def percentile(sorted_values, p):
+    """Nearest-rank percentile, as used by STRUploadMetricsRecorder."""
+    if not sorted_values:
+        return None
+    rank = int(math.ceil(p * len(sorted_values)))
+    return sorted_values[max(rank - 1, 0)]
+
+
+class LoadTest(object):
+
+    def __init__(self, args):
+        self.args = args
+        self.store = CaptureStore(args.root)
+        self.factory = CaptureFactory(args)
+        self.lock = threading.Lock()
+        self.tokens = [os.path.basename(directory) for directory in self.store.all_directories()]
+        self.latencies = dict((name, []) for name in OPERATIONS)
+        self.errors = dict((name, {}) for name in OPERATIONS)
+        self.missing_captures = 0
+        self.next_index = 1 << 32
+        days = set()
+        for token in self.tokens[:1000]:
+            info = self.store.load_capture(self.store.directory_of(token))
+            if info:
+                days.add(datetime.date.fromtimestamp(info['created_at']))
+        self.days = sorted(days) or [datetime.date.today()]
+        names = [name for name in OPERATIONS if args.mix.get(name, 0) > 0]
+        self.operation_names = names
+        self.operation_weights = [args.mix[name] for name in names]
+
+    def pick_token(self, rng, remove=False):
+        with self.lock:
+            if not self.tokens:
+                return None
+            index = rng.randrange(len(self.tokens))
+            token = self.tokens[index]
+            if remove:
+                # Swap the last token into its place so that removal is O(1)
+                self.tokens[index] = self.tokens[-1]
+                self.tokens.pop()
+            return token
+
+    def unless_deleted(self, token, operation):
+        """Runs operation on one capture. A capture that a concurrent delete removed counts as missing, as it does in listings; other failures raise."""
+        try:
+            operation()
+        except FileNotFoundError:
+            # A delete holds the capture lock until the directory is gone
+            with CAPTURE_LOCKS.lock_for(token):
+                if self.store.directory_of(token) is not None:
+                    raise
+            return 1
+        return 0
+
+    def run_operation(self, name, rng):
+        store = self.store
+        missing = 0
+        if name == 'create':
+            with self.lock:
+                index = self.next_index
+                self.next_index += 1
+            created_at = time.time()
+            origin = capture_origins(rng, 1, self.args.center, self.args.spread_km, 'gaussian', 1)[0]
+            token, _ = self.factory.write(store, index, created_at, origin)
+            with self.lock:
+                self.tokens.append(token)
+        elif name == 'list':
+            _, missing = store.all_captures(sort=True)
+        elif name == 'query':
+            _, missing = store.captures_on_date(rng.choice(self.days))
+        elif name == 'recent':
+            _, missing = store.recent_captures(self.args.recent_limit)
+        elif name == 'page':
+            # Reads a page a few pages in, as a scrolling list would
+            cursor = None
+            for _ in range(rng.randrange(1, 6)):
+                _, cursor, skipped = store.page(self.args.recent_limit, cursor)
+                missing += skipped
+                if cursor is None:
+                    break
+        elif name == 'save':
+            token = self.pick_token(rng)
+            if token:
+                title = 'Capture %d' % rng.randrange(1000000)
+                missing = self.unless_deleted(token, lambda: store.save(token, title=title))
+        elif name == 'delete':
+            token = self.pick_token(rng, remove=True)
+            if token:
+                store.delete(token)
+        elif name == 'track':
+            token = self.pick_token(rng)
+            if token:
+                missing = self.unless_deleted(token, lambda: store.read_track(token))
+        return missing
+
+    def worker(self, number, deadline, operations):
+        rng = random.Random('%d-worker-%d' % (self.args.seed, number))
+        done = 0
+        while time.perf_counter() < deadline and (operations is None or done < operations):
+            name = rng.choices(self.operation_names, self.operation_weights)[0]
+            started = time.perf_counter()
+            try:
+                missing = self.run_operation(name, rng)
+                elapsed = time.perf_counter() - started
+                with self.lock:
+                    self.latencies[name].append(elapsed)
+                    self.missing_captures += missing
+            except Exception as error:
+                kind = type(error).__name__
+                with self.lock:
+                    self.errors[name][kind] = self.errors[name].get(kind, 0) + 1
+            done += 1
+
+    def run(self):
+        args = self.args
+        per_thread = None if args.operations is None else max(args.operations // args.threads, 1)
+        started = time.perf_counter()
+        deadline = started + (args.duration if args.duration else float('inf'))
+        threads = [threading.Thread(target=self.worker, args=(i, deadline, per_thread)) for i in range(args.threads)]
+        migrated = []
+        if args.migrate:
+            # Moves flat captures into their shards while the workers run, as the SDK does after an update
+            threads.append(threading.Thread(target=lambda: migrated.append(self.store.migrate())))
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        elapsed = time.perf_counter() - started
+
+        report = {'root': os.path.abspath(args.root), 'threads': args.threads, 'seconds': round(elapsed, 3),
+                  'missing_captures': self.missing_captures, 'operations': {}}
+        if migrated:
+            report['migrated_captures'] = migrated[0]
+        for name in OPERATIONS:
+            values = sorted(self.latencies[name])
+            if not values and not self.errors[name]:
+                continue
+            report['operations'][name] = {
+                'count': len(values),
+                'errors': self.errors[name],
+                'throughput': round(len(values) / elapsed, 3) if elapsed > 0 else 0,
+                'mean': sum(values) / len(values) if values else None,
+                'p50': percentile(values, 0.50),
+                'p90': percentile(values, 0.90),
+                'p99': percentile(values, 0.99),
+                'max': values[-1] if values else None,
+            }
+        return report
+
+
+def print_report(report):
+    def ms(value):
+        return '-' if value is None else '%.2f' % (value * 1000)
+
+    print('%-8s %8s %8s %10s %10s %10s %10s %10s' % ('op', 'count', 'errors', 'ops/s', 'p50 ms', 'p90 ms', 'p99 ms', 'max ms'))
+    for name, stats in report['operations'].items():
+        print('%-8s %8d %8d %10.1f %10s %10s %10s %10s' % (
+            name, stats['count'], sum(stats['errors'].values()), stats['throughput'],
+            ms(stats['p50']), ms(stats['p90']), ms(stats['p99']), ms(stats['max'])))
+    if report['missing_captures']:
+        print('%d captures could not be read or saved; they were deleted while the operation ran.' % report['missing_captures'])
+    if 'migrated_captures' in report:
+        print('%d captures were migrated into shards during the run.' % report['migrated_captures'])
+
+
+def migrate(args):
+    store = CaptureStore(args.root)
+    started = time.perf_counter()
+    moved = store.migrate()
+    print(json.dumps({'root': os.path.abspath(args.root), 'migrated_captures': moved, 'seconds': round(time.perf_counter() - started, 3)}))
+
+
+def loadtest(args):
+    report = LoadTest(args).run()
+    print_report(report)
+    if args.json:
+        with open(args.json, 'w') as handle:
+            json.dump(report, handle, indent=2)
+
+
+# -- Segmented recording -- #
+
+class Segmenter(object):
+    """STRCaptureSegmenter: rotates a recording into segment files and records them in the capture info."""
+
+    def __init__(self, store, token, segment_duration):
+        self.token = token
+        self.directory = os.path.join(store.root, store.relative_directory_for(token))
+        self.segment_duration = segment_duration
+        self.segments = []
+        self.pending = []
+        self.previous = None
+        self.all_points = []
+        self.closed_until = 0.0
+        self.finished = False
+
+    def add_point(self, point):
+        self.pending.append(point)
+        self.all_points.append(point)
+
+    def close_segment(self, media_size, start_time, duration):
+        """closeSegmentWithMediaAtPath:startTime:duration: with a sparse media file of the given size."""
+        os.makedirs(self.directory, exist_ok=True)
+        index = len(self.segments)
+        start = max(start_time, self.closed_until)
+        end = start + max(duration, 0)
+        consumed = 0
+        while consumed < len(self.pending) and self.pending[consumed]['timestamp'] < end:
+            consumed += 1
+        candidates = ([self.previous] if self.previous else []) + self.pending[:consumed]
+        points = split_points(candidates, start, end)
+
+        name = '%s.s%04d' % (self.token, index)
+        with open(os.path.join(self.directory, name + '.mov'), 'wb') as handle:
+            handle.truncate(media_size)
+        write_json(os.path.join(self.directory, name + '.json'), {'points': points})
+        segment = {
+            'index': index,
+            'start': start,
+            'duration': end - start,
+            'media_file': '%s/%s.mov' % (self.token, name),
+            'geodata_file': '%s/%s.json' % (self.token, name),
+            'media_bytes': media_size,
+            'points': len(points),
+        }
+        self.segments.append(segment)
+        self.save_capture_info(False)
+        if consumed:
+            self.previous = self.pending[consumed - 1]
+            del self.pending[:consumed]
+        self.closed_until = end
+        return segment
+
+    def finish(self):
+        """finish: writes the whole track and marks the segments complete."""
+        write_json(os.path.join(self.directory, self.token + '.json'), {'points': self.all_points})
+        self.save_capture_info(True)
+        self.finished = True
+
+    def save_capture_info(self, finished):
+        """saveCaptureInfoFinished: edits made to the info file in the meantime are kept."""
+        path = os.path.join(self.directory, CAPTURE_INFO_FILE)
+        summary = track_summary(self.all_points)
+        with CAPTURE_LOCKS.lock_for(self.token):
+            try:
+                with open(path) as handle:
+                    info = json.load(handle)
+            except (OSError, ValueError):
+                info = None
+            if not isinstance(info, dict):
+                first = self.all_points[0] if self.all_points else {'coords': [0, 0], 'heading': -1}
+                info = {'coords': first['coords'], 'heading': first['heading'], 'orientation': 'vertical',
+                        'created_at': int(time.time()), 'title': 'Untitled Capture', 'uploaded_at': 0}
+            relative = '%s/%s' % (self.token, self.token)
+            info.update({
+                'token': self.token,
+                'media_type': 'video',
+                'media_file': self.segments[0]['media_file'],
+                'thumbnail_file': relative + '.png',
+                'geodata_file': relative + '.json' if finished else self.segments[0]['geodata_file'],
+                'segment_duration': self.segment_duration,
+                'segments': self.segments,
+                'segments_complete': finished,
+                'track_summary': summary,
+            })
+            replace_json(path, info)
+
+
+def split_points(points, start, end):
+    """STRCaptureSegmenter pointsOfSamples:count:fromTime:toTime:
+
+    Points in [start, end) are kept with times relative to the start. If
+    nothing was recorded exactly at the start, the last earlier point stands
+    in at time 0.
+    """
+    first = 0
+    while first < len(points) and points[first]['timestamp'] < start:
+        first += 1
+    last = first
+    while last < len(points) and points[last]['timestamp'] < end:
+        last += 1
+    result = []
+    if first > 0 and (first == last or points[first]['timestamp'] > start):
+        result.append(dict(points[first - 1], timestamp=0))
+    for point in points[first:last]:
+        result.append(dict(point, timestamp=point['timestamp'] - start))
+    return result
+
+
+def check_split(track, segments, directory):
+    """Every point of the track must be in exactly one segment, at its own time."""
+    found = []
+    for segment in segments:
+        with open(os.path.join(directory, os.path.basename(segment['geodata_file']))) as handle:
+            points = json.load(handle)['points']
+        for point in points:
+            timestamp = point['timestamp'] + segment['start']
+            # Carried points stand in at the start and are not new
+            if point['timestamp'] == 0 and not any(abs(p['timestamp'] - timestamp) < 1e-9 for p in track):
+                continue
+            found.append(round(timestamp, 6))
+    return found == [round(p['timestamp'], 6) for p in track]
+
+
+def simulate_uploads(segments, bandwidth, completion_bytes, failure_rate, rng, base_delay, max_delay, max_attempts):
+    """STRSegmentUploadQueue in virtual time: one request at a time, in order, with backoff on failure.
+
+    Returns when the last request ends, or None if the capture was given up on.
+    """
+    clock = 0.0
+    jobs = [(s['start'] + s['duration'], s['media_bytes']) for s in segments]
+    jobs.append((jobs[-1][0], completion_bytes))
+    for ready, size in jobs:
+        clock = max(clock, ready)
+        attempts = 0
+        while True:
+            clock += size / bandwidth
+            if rng.random() >= failure_rate:
+                break
+            attempts += 1
+            if attempts >= max_attempts:
+                return None
+            delay = min(base_delay * 2 ** (attempts - 1), max_delay)
+            clock += rng.uniform(delay / 2, delay)
+    return clock
+
+
+def segments(args):
+    store = CaptureStore(args.root)
+    rng = random.Random(args.seed)
+    created_at = time.time()
+    token = make_token(rng, uuid.UUID(int=rng.getrandbits(128)).hex[:8], created_at)
+    segmenter = Segmenter(store, token, args.segment_duration)
+
+    # About one point a second, as a walk records them
+    track = [p for p in make_track(rng, int(args.duration * 1.2) + 2, args.center[0], args.center[1], args.speed)['points']
+             if p['timestamp'] < args.duration]
+    bytes_per_second = args.bitrate / 8.0
+    next_point = 0
+    start = 0.0
+    while start < args.duration:
+        duration = min(args.segment_duration, args.duration - start)
+        while next_point < len(track) and track[next_point]['timestamp'] < start + duration:
+            segmenter.add_point(track[next_point])
+            next_point += 1
+        segment = segmenter.close_segment(int(duration * bytes_per_second), start, duration)
+        if segment['index'] == 0:
+            # STRCaptureViewController writes the thumbnail from the first segment
+            with open(os.path.join(segmenter.directory, token + '.png'), 'wb') as handle:
+                handle.write(make_png(300, 225))
+        start += duration
+    segmenter.finish()
+
+    bandwidth = args.bandwidth / 8.0
+    total_bytes = sum(s['media_bytes'] for s in segmenter.segments)
+    finished = simulate_uploads(segmenter.segments, bandwidth, args.completion_bytes, args.failure_rate, rng,
+                                args.retry_base_delay, args.retry_max_delay, args.max_attempts)
+    report = {
+        'directory': os.path.join(os.path.abspath(args.root), store.relative_directory_for(token)),
+        'segments': len(segmenter.segments),
+        'points': len(track),
+        'split_ok': check_split(track, segmenter.segments, segmenter.directory),
+        'media_bytes': total_bytes,
+        # Seconds from the end of the recording until the server has everything
+        'upload_after_stop': None if finished is None else round(max(finished - args.duration, 0), 3),
+        'whole_upload_after_stop': round((total_bytes + args.completion_bytes) / bandwidth, 3),
+    }
+    print(json.dumps(report))
+
+
+MANIFEST_MAGIC = b'STRM'
+MANIFEST_VERSION = 1
+MANIFEST_DIGEST_LENGTH = 8
+
+
+def capture_checksums(path):
+    """STRCaptureIntegrityScanner checksumsOfCaptureAtRelativeDirectory: recorded checksums stand while a file is unchanged."""
+    info = read_capture_info(path)
+    if not info:
+        return None
+    media, geodata, thumbnail = (os.path.basename(info[key]) for key in ('media_file', 'geodata_file', 'thumbnail_file'))
+    checksum_path = os.path.join(path, CHECKSUM_FILE)
+    try:
+        with open(checksum_path) as handle:
+            recorded = json.load(handle)
+        files, recorded_at = recorded['files'], float(recorded.get('recorded_at', 0))
+        if not isinstance(files, dict):
+            raise TypeError
+    except (OSError, ValueError, KeyError, TypeError):
+        recorded_at = time.time()
+        files = {}
+        for name in (media, geodata, thumbnail):
+            if file_size(os.path.join(path, name)) >= 0:
+                files[name] = {'size': file_size(os.path.join(path, name)), 'sha1': sha1_of_file(os.path.join(path, name))}
+        write_json(checksum_path, {'algorithm': 'sha1', 'recorded_at': recorded_at, 'files': files})
+    checksums = {}
+    for key, name in (('media_file', media), ('geodata_file', geodata)):
+        try:
+            info = os.stat(os.path.join(path, name))
+        except OSError:
+            return None
+        expected = files.get(name)
+        if isinstance(expected, dict) and expected.get('size') == info.st_size and int(info.st_mtime) <= recorded_at:
+            checksums[key] = expected['sha1']
+        else:
+            checksums[key] = sha1_of_file(os.path.join(path, name))
+    return checksums
+
+
+def capture_digest(path):
+    """STRCaptureSyncManager digestOfCaptureWithToken: the first 8 bytes of SHA-1 over both hex checksums."""
+    checksums = capture_checksums(path)
+    if checksums is None:
+        return None
+    combined = (checksums['media_file'] + checksums['geodata_file']).encode('ascii')
+    return hashlib.sha1(combined).digest()[:MANIFEST_DIGEST_LENGTH]
+
+
+def encode_manifest(entries):
+    """manifestForCapturesWithTokens:unreadableTokens: entries are (token, digest) pairs."""
+    body = [struct.pack('>4sBBI', MANIFEST_MAGIC, MANIFEST_VERSION, MANIFEST_DIGEST_LENGTH, len(entries))]
+    for token, digest in entries:
+        raw = bytes.fromhex(token)
+        body.append(struct.pack('B', len(raw)) + raw + digest)
+    return b''.join(body)
+
+
+def decode_manifest(data):
+    """digestsInManifest: returns {token: digest}, or None if the manifest is damaged."""
+    if len(data) < 10:
+        return None
+    magic, version, digest_length, count = struct.unpack('>4sBBI', data[:10])
+    if magic != MANIFEST_MAGIC or version != MANIFEST_VERSION:
+        return None
+    digests, offset = {}, 10
+    for _ in range(count):
+        if offset >= len(data):
+            return None
+        token_length = data[offset]
+        end = offset + 1 + token_length + digest_length
+        if token_length == 0 or token_length > 32 or end > len(data):
+            return None
+        digests[data[offset + 1:offset + 1 + token_length].hex()] = data[offset + 1 + token_length:end]
+        offset = end
+    return digests if offset == len(data) else None
+
+
+def capture_digests(store, jobs):
+    """Digests of every capture, in parallel batches of 64 like the SDK; unreadable captures are None."""
+    directories = store.all_directories()
+
+    def digest_batch(batch):
+        return [(os.path.basename(d), capture_digest(os.path.join(store.root, d))) for d in batch]
+
+    batches = [directories[i:i + 64] for i in range(0, len(directories), 64)]
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs) as executor:
+        return [entry for results in executor.map(digest_batch, batches) for entry in results]
+
+
+def missing_tokens(held, manifest):
+    """What the server answers: tokens it does not hold, or holds with another digest."""
+    return sorted(token for token, digest in manifest.items() if held.get(token) != digest)
+
+
+def serve_sync(store, port, jobs):
+    held = dict((token, digest) for token, digest in capture_digests(store, jobs) if digest is not None)
+
+    class SyncHandler(http.server.BaseHTTPRequestHandler):
+        def do_POST(self):
+            manifest = decode_manifest(self.rfile.read(int(self.headers.get('Content-Length', 0))))
+            if manifest is None:
+                answer = {'error': 'true', 'message': 'The manifest could not be read.'}
+            else:
+                answer = {'error': 'false', 'missing': missing_tokens(held, manifest)}
+            body = json.dumps(answer).encode('utf-8')
+            self.send_response(200)
+            self.send_header('Content-Type', 'application/json')
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+    server = http.server.ThreadingHTTPServer(('', port), SyncHandler)
+    print(json.dumps({'serving': port, 'held': len(held)}))
+    sys.stdout.flush()
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        server.server_close()
+
+
+def sync(args):
+    store = CaptureStore(args.root)
+    if args.serve:
+        serve_sync(store, args.serve, args.jobs)
+        return
+    timings = []
+    for _ in range(2):
+        started = time.perf_counter()
+        entries = capture_digests(store, args.jobs)
+        manifest = encode_manifest([(token, digest) for token, digest in entries if digest is not None])
+        timings.append(time.perf_counter() - started)
+    if args.manifest:
+        with open(args.manifest, 'wb') as handle:
+            handle.write(manifest)
+
+    decoded = decode_manifest(manifest)
+    readable = [(token, digest) for token, digest in entries if digest is not None]
+    rng = random.Random(args.seed)
+    held = dict(entry for entry in readable if rng.random() < args.held_fraction)
+    missing = missing_tokens(held, decoded)
+    print(json.dumps({
+        'captures': len(entries),
+        'unreadable': len(entries) - len(readable),
+        'manifest_bytes': len(manifest),
+        'round_trip_ok': decoded == dict(readable),
+        'first_seconds': round(timings[0], 3),
+        'recorded_seconds': round(timings[1], 3),
+        'held': len(held),
+        'missing': len(missing) + len(entries) - len(readable),
+    }))
+
+
+# -- Track summaries -- #
+
+def track_summary(points):
+    """STRTrackSummary summaryOfSamples:count: and dictionaryRepresentation.
+
+    Only points with a positive accuracy count towards the distance, bounds
+    and mean accuracy. The heading range is the smallest arc, clockwise, that
+    holds every heading that is not negative.
+    """
+    times = [point.get('timestamp', 0) for point in points]
+    fixes = [point for point in points if 'coords' in point and point.get('accuracy', -1) > 0]
+    summary = {
+        'point_count': len(points),
+        'duration': max(times) - min(times) if times else 0.0,
+        'distance': 0.0,
+    }
+    for before, after in zip(fixes, fixes[1:]):
+        (lat1, lon1), (lat2, lon2) = before['coords'][:2], after['coords'][:2]
+        a = (math.sin(math.radians(lat2 - lat1) / 2) ** 2 +
+             math.cos(math.radians(lat1)) * math.cos(math.radians(lat2)) * math.sin(math.radians(lon2 - lon1) / 2) ** 2)
+        summary['distance'] += 2 * EARTH_RADIUS * math.atan2(math.sqrt(a), math.sqrt(1 - a))
+    if fixes:
+        latitudes = [point['coords'][0] for point in fixes]
+        longitudes = [point['coords'][1] for point in fixes]
+        summary['bounds'] = [min(latitudes), min(longitudes), max(latitudes), max(longitudes)]
+        summary['mean_accuracy'] = sum(point['accuracy'] for point in fixes) / len(fixes)
+    headings = sorted(math.fmod(point['heading'], 360) for point in points if point.get('heading', -1) >= 0)
+    if headings:
+        # The circle less the widest gap between neighbouring headings
+        gap_end, widest = 0, headings[0] + 360 - headings[-1]
+        for i in range(1, len(headings)):
+            if headings[i] - headings[i - 1] > widest:
+                gap_end, widest = i, headings[i] - headings[i - 1]
+        summary['heading_range'] = [headings[gap_end], headings[gap_end - 1]]
+    return summary
+
+
+def backfill_summary(path):
+    """STRTrackSummary backfillCaptureAtPath: True if a summary was written."""
+    info = read_capture_info(path)
+    if info is None or isinstance(info.get('track_summary'), dict) or not isinstance(info.get('geodata_file'), str) or not isinstance(info.get('token'), str):
+        return False
+    try:
+        with open(os.path.join(path, os.path.basename(info['geodata_file']))) as handle:
+            points = json.load(handle)['points']
+    except (OSError, ValueError, KeyError, TypeError):
+        return False
+    summary = track_summary(points)
+    # Only the info file is read again and replaced under the lock, so a save in the meantime is kept
+    with CAPTURE_LOCKS.lock_for(info['token']):
+        info = read_capture_info(path)
+        if info is None or isinstance(info.get('track_summary'), dict):
+            return False
+        info['track_summary'] = summary
+        replace_json(os.path.join(path, CAPTURE_INFO_FILE), info)
+    return True
+
+
+def summaries(args):
+    store = CaptureStore(args.root)
+    directories = store.all_directories()
+
+    def backfill_batch(batch):
+        return sum(backfill_summary(os.path.join(store.root, d)) for d in batch)
+
+    started = time.perf_counter()
+    batches = [directories[i:i + 64] for i in range(0, len(directories), 64)]
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as executor:
+        backfilled = sum(executor.map(backfill_batch, batches))
+    backfill_seconds = time.perf_counter() - started
+
+    # A list showing the duration and length of every track, both ways
+    started = time.perf_counter()
+    from_geodata = {}
+    for directory in directories:
+        path = os.path.join(store.root, directory)
+        info = read_capture_info(path)
+        try:
+            with open(os.path.join(path, os.path.basename(info['geodata_file']))) as handle:
+                from_geodata[directory] = track_summary(json.load(handle)['points'])
+        except (OSError, ValueError, KeyError, TypeError):
+            pass
+    geodata_seconds = time.perf_counter() - started
+    started = time.perf_counter()
+    from_summary = {}
+    for directory in directories:
+        info = read_capture_info(os.path.join(store.root, directory))
+        if info is not None and isinstance(info.get('track_summary'), dict):
+            from_summary[directory] = info['track_summary']
+    summary_seconds = time.perf_counter() - started
+
+    matching = sum(1 for directory, summary in from_geodata.items()
+                   if directory in from_summary and from_summary[directory]['point_count'] == summary['point_count'] and
+                   abs(from_summary[directory]['distance'] - summary['distance']) < 1e-6)
+    print(json.dumps({
+        'captures': len(directories),
+        'backfilled': backfilled,
+        'backfill_seconds': round(backfill_seconds, 3),
+        'list_from_geodata_seconds': round(geodata_seconds, 3),
+        'list_from_summary_seconds': round(summary_seconds, 3),
+        'summarized': len(from_summary),
+        'matching': matching,
+    }))
+
+
+# -- Command line -- #
+
+def add_content_options(parser):
+    today = datetime.datetime.now(datetime.timezone.utc).replace(hour=0, minute=0, second=0, microsecond=0)
+    parser.add_argument('--root', default='StraboCaptures', help='captures directory (default: ./StraboCaptures)')
+    parser.add_argument('--seed', type=int, default=1, help='random seed; the same seed gives the same corpus')
+    parser.add_argument('--points', type=int, default=300, help='points per video track (image tracks have one)')
+    parser.add_argument('--video-fraction', type=float, default=0.5, help='share of captures that are videos')
+    parser.add_argument('--uploaded-fraction', type=float, default=0.3, help='share of captures marked as uploaded')
+    parser.add_argument('--media-bytes', type=parse_size, default=parse_size('64K'), help='media file size, e.g. 512K or 10M')
+    parser.add_argument('--media-fill', choices=('zero', 'random'), default='zero', help='media contents after the file header')
+    parser.add_argument('--thumbnail-width', type=int, default=300)
+    parser.add_argument('--thumbnail-height', type=int, default=225)
+    parser.add_argument('--thumbnail-noise', action='store_true', help='incompressible thumbnails, closer to real photos in size')
+    parser.add_argument('--start', type=parse_date, default=today - datetime.timedelta(days=365), help='earliest capture date, YYYY-MM-DD')
+    parser.add_argument('--end', type=parse_date, default=today, help='latest capture date, YYYY-MM-DD')
+    parser.add_argument('--time-distribution', choices=('uniform', 'diurnal', 'sessions'), default='sessions')
+    parser.add_argument('--session-size', type=float, default=8, help='mean captures per session for --time-distribution sessions')
+    parser.add_argument('--center', type=lambda s: tuple(float(v) for v in s.split(',')), default=(39.96, -83.0), help='LAT,LON')
+    parser.add_argument('--spread-km', type=float, default=10, help='spread of capture origins around the center')
+    parser.add_argument('--coord-distribution', choices=('uniform', 'gaussian', 'clustered'), default='clustered')
+    parser.add_argument('--clusters', type=int, default=12, help='hot spots for --coord-distribution clustered')
+    parser.add_argument('--speed', type=float, default=1.5, help='walking speed along video tracks, in m/s')
+    parser.add_argument('--legacy-tokens', action='store_true', help='name captures with the 64-character hash tokens of older SDK versions')
+    parser.add_argument('--no-summaries', action='store_true', help='leave track_summary out of the info files, as older SDK versions did')
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    generate_parser = commands.add_parser('generate', help='write a synthetic corpus')
+    add_content_options(generate_parser)
+    generate_parser.add_argument('--count', type=int, required=True, help='number of captures to write')
+    generate_parser.add_argument('--jobs', type=int, default=8, help='parallel writers')
+    generate_parser.add_argument('--progress', action='store_true')
+    generate_parser.add_argument('--flat', action='store_true', help='write the flat layout of older SDK versions instead of shards')
+
+    damage_parser = commands.add_parser('damage', help='break a share of the captures, for testing verify')
+    damage_parser.add_argument('--root', default='StraboCaptures', help='captures directory (default: ./StraboCaptures)')
+    damage_parser.add_argument('--fraction', type=float, default=0.01, help='share of captures to damage')
+    damage_parser.add_argument('--seed', type=int, default=1)
+
+    verify_parser = commands.add_parser('verify', help='check every capture the way STRCaptureIntegrityScanner does')
+    verify_parser.add_argument('--root', default='StraboCaptures', help='captures directory (default: ./StraboCaptures)')
+    verify_parser.add_argument('--jobs', type=int, default=os.cpu_count() or 4, help='parallel workers')
+    verify_parser.add_argument('--parse-geodata', action='store_true', help='parse every track instead of checking its ends')
+    verify_parser.add_argument('--checksums', action='store_true', help='record SHA-1 checksums, or compare against recorded ones')
+    verify_parser.add_argument('--quarantine', action='store_true', help='move damaged captures to .quarantine')
+    verify_parser.add_argument('--json', help='also write the full report to this file')
+
+    migrate_parser = commands.add_parser('migrate', help='move flat captures into the sharded layout')
+    migrate_parser.add_argument('--root', default='StraboCaptures', help='captures directory (default: ./StraboCaptures)')
+
+    load_parser = commands.add_parser('loadtest', help='run concurrent operations against a captures directory')
+    add_content_options(load_parser)
+    load_parser.add_argument('--threads', type=int, default=4)
+    load_parser.add_argument('--duration', type=float, default=10, help='seconds to run; 0 to run --operations only')
+    load_parser.add_argument('--operations', type=int, help='total operations to run')
+    load_parser.add_argument('--mix', type=parse_mix, default=parse_mix('create=1,list=1,query=2,recent=2,save=4,delete=1,track=3'),
+                             help='operation weights, e.g. save=4,list=1 (operations: %s)' % ', '.join(OPERATIONS))
+    load_parser.add_argument('--recent-limit', type=int, default=20)
+    load_parser.add_argument('--json', help='also write the report to this file')
+    load_parser.add_argument('--migrate', action='store_true', help='migrate flat captures into shards while the load runs')
+
+    segments_parser = commands.add_parser('segments', help='record a capture in segments and simulate uploading them as they close')
+    segments_parser.add_argument('--root', default='StraboCaptures', help='captures directory (default: ./StraboCaptures)')
+    segments_parser.add_argument('--seed', type=int, default=1)
+    segments_parser.add_argument('--duration', type=float, default=3600, help='seconds of recording')
+    segments_parser.add_argument('--segment-duration', type=float, default=60, help='seconds per segment')
+    segments_parser.add_argument('--bitrate', type=parse_size, default=parse_size('5M'), help='bits per second of video, e.g. 5M')
+    segments_parser.add_argument('--bandwidth', type=parse_size, default=parse_size('8M'), help='upload bits per second, e.g. 8M')
+    segments_parser.add_argument('--completion-bytes', type=parse_size, default=parse_size('64K'), help='size of the request that completes the capture')
+    segments_parser.add_argument('--failure-rate', type=float, default=0, help='share of requests that fail and are retried')
+    segments_parser.add_argument('--retry-base-delay', type=float, default=5, help='Upload_Retry_Base_Delay')
+    segments_parser.add_argument('--retry-max-delay', type=float, default=900, help='Upload_Retry_Max_Delay')
+    segments_parser.add_argument('--max-attempts', type=int, default=8, help='Upload_Max_Attempts')
+    segments_parser.add_argument('--center', type=lambda s: tuple(float(v) for v in s.split(',')), default=(39.96, -83.0), help='LAT,LON')
+    segments_parser.add_argument('--speed', type=float, default=1.5, help='walking speed, in m/s')
+
+    sync_parser = commands.add_parser('sync', help='build the sync manifest of a captures directory, or answer manifests as the server')
+    sync_parser.add_argument('--root', default='StraboCaptures', help='captures directory (default: ./StraboCaptures)')
+    sync_parser.add_argument('--seed', type=int, default=1)
+    sync_parser.add_argument('--jobs', type=int, default=os.cpu_count() or 4, help='parallel workers')
+    sync_parser.add_argument('--held-fraction', type=float, default=0.9, help='share of the captures the simulated server already holds')
+    sync_parser.add_argument('--manifest', help='also write the manifest to this file')
+    sync_parser.add_argument('--serve', type=int, metavar='PORT', help='answer manifests posted to this port, holding the captures under --root')
+
+    summaries_parser = commands.add_parser('summaries', help='backfill track summaries and time listing tracks with and without them')
+    summaries_parser.add_argument('--root', default='StraboCaptures', help='captures directory (default: ./StraboCaptures)')
+    summaries_parser.add_argument('--jobs', type=int, default=os.cpu_count() or 4, help='parallel workers')
+
+    args = parser.parse_args(argv)
+    if args.command == 'generate':
+        generate(args)
+    elif args.command in ('damage', 'verify', 'sync', 'summaries'):
+        if not os.path.isdir(args.root):
+            parser.error('no captures directory at %s' % args.root)
+        {'damage': damage, 'verify': verify, 'sync': sync, 'summaries': summaries}[args.command](args)
+    elif args.command == 'segments':
+        if args.segment_duration <= 0 or args.duration <= 0:
+            parser.error('--duration and --segment-duration must be positive')
+        segments(args)
+    elif args.command == 'migrate':
+        if not os.path.isdir(args.root):
+            parser.error('no captures directory at %s' % args.root)
+        migrate(args)
+    else:
+        if not args.duration and args.operations is None:
+            parser.error('give --duration or --operations')
+        if not os.path.isdir(args.root):
+            parser.error('no captures directory at %s' % args.root)
+        loadtest(args)
+
+
+if __name__ == '__main__':
+    main()